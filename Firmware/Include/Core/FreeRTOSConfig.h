@@ -0,0 +1,100 @@
+/**
+ * @file FreeRTOSConfig.h
+ * @brief FreeRTOS configuration for the Forge firmware.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Based on FreeRTOS/Source/include/FreeRTOSConfig_template.h
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+#include <stdint.h>
+extern uint32_t SystemCoreClock;
+// Core/scheduler.c
+void forgeTraceReady(uint32_t number);
+void forgeTraceSwitchedIn(uint32_t number, void *task);
+// Core/profiler.c
+void profileSwitchedOut(uint32_t number, void *task);
+#endif
+
+#define configUSE_PREEMPTION 1
+#define configUSE_TICKLESS_IDLE 1 // Sleep through idle periods instead of taking every tick
+#define configUSE_IDLE_HOOK 0
+#define configUSE_TICK_HOOK 0
+#define configMAX_PRIORITIES (7)
+// Everything the kernel uses is given to it when it's created (Core/memory.c),
+// so there's no heap to fragment or run out; leave MemMang/heap_x.c out of the build
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configSUPPORT_DYNAMIC_ALLOCATION 0
+#define configCPU_CLOCK_HZ (SystemCoreClock)
+#define configTICK_RATE_HZ ((TickType_t)1000) // 1 tick == 1 ms, HAL_GetTick() relies on this
+#define configMINIMAL_STACK_SIZE ((uint16_t)128)
+#define configMAX_TASK_NAME_LEN (16)
+#define configUSE_TRACE_FACILITY 1
+#define configUSE_16_BIT_TICKS 0
+#define configIDLE_SHOULD_YIELD 1
+#define configUSE_MUTEXES 1
+#define configQUEUE_REGISTRY_SIZE 8
+#define configCHECK_FOR_STACK_OVERFLOW 2
+#define configUSE_RECURSIVE_MUTEXES 1
+#define configUSE_MALLOC_FAILED_HOOK 0
+#define configUSE_APPLICATION_TASK_TAG 0
+#define configUSE_COUNTING_SEMAPHORES 1
+#define configGENERATE_RUN_TIME_STATS 0
+
+#define configUSE_CO_ROUTINES 0
+#define configMAX_CO_ROUTINE_PRIORITIES (2)
+
+#define configUSE_TIMERS 0
+#define configTIMER_TASK_PRIORITY (2)
+#define configTIMER_QUEUE_LENGTH 10
+#define configTIMER_TASK_STACK_DEPTH (configMINIMAL_STACK_SIZE * 2)
+
+#define INCLUDE_vTaskPrioritySet 1
+#define INCLUDE_uxTaskPriorityGet 1
+#define INCLUDE_vTaskDelete 1
+#define INCLUDE_vTaskCleanUpResources 0
+#define INCLUDE_vTaskSuspend 1
+#define INCLUDE_vTaskDelayUntil 1
+#define INCLUDE_vTaskDelay 1
+#define INCLUDE_xTaskGetSchedulerState 1
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
+
+#ifdef __NVIC_PRIO_BITS
+#define configPRIO_BITS __NVIC_PRIO_BITS
+#else
+#define configPRIO_BITS 4 /* 15 priority levels */
+#endif
+
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY 0xf
+
+// Interrupts at a numerically lower (more urgent) priority than this, such as
+// the step timer, are never masked by the kernel but must not call any
+// FreeRTOS API.
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+
+#define configKERNEL_INTERRUPT_PRIORITY (configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+
+#define configASSERT(x)           \
+    if ((x) == 0)                 \
+    {                             \
+        taskDISABLE_INTERRUPTS(); \
+        for (;;)                  \
+            ;                     \
+    }
+
+// Times each task's wake-up, from being made ready to running, and what
+// each takes of the CPU; the task number needs configUSE_TRACE_FACILITY
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB) forgeTraceReady((pxTCB)->uxTCBNumber)
+#define traceTASK_SWITCHED_IN() forgeTraceSwitchedIn(pxCurrentTCB->uxTCBNumber, pxCurrentTCB)
+#define traceTASK_SWITCHED_OUT() profileSwitchedOut(pxCurrentTCB->uxTCBNumber, pxCurrentTCB)
+
+#define vPortSVCHandler SVC_Handler
+#define xPortPendSVHandler PendSV_Handler
+// SysTick_Handler is defined in forge.c since it also drives the HAL tick.
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,132 @@
+/**
+ * @file forge.c
+ * @brief One-time bring-up of the MCU and scheduler-aware delays.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "forge.h"
+#include "profiler.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+static bool _halInitialized = false;
+
+extern void xPortSysTickHandler(void);
+
+/**
+ * @brief  Runs the core at 168MHz from the 8MHz HSE (see HSE_VALUE), with the 48MHz USB clock, APB1 at 42MHz and APB2 at 84MHz.
+ * @retval None
+ */
+static void _configureClock(void)
+{
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
+
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+    RCC_OscInitStruct.HSEState = RCC_HSE_ON;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+    RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+    RCC_OscInitStruct.PLL.PLLM = HSE_VALUE / 1000000; // 1MHz PLL input
+    RCC_OscInitStruct.PLL.PLLN = 336;
+    RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2; // 168MHz SYSCLK
+    RCC_OscInitStruct.PLL.PLLQ = 7;             // 48MHz USB/SDIO
+    if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+    {
+        return; // Stay on the HSI; everything still works, just slower
+    }
+
+    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK |
+                                  RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV4;
+    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV2;
+    HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_5);
+
+    SystemCoreClockUpdate();
+}
+
+/**
+ * @brief  Initializes HAL and the system clocks exactly once. Every module init calls this instead of HAL_Init(), so modules can still be brought up in any order (or on their own) without resetting each other's peripherals.
+ * @retval None
+ * @headerfile forge.h
+ */
+void forgeInitHAL(void)
+{
+    if (_halInitialized)
+    {
+        return;
+    }
+    HAL_Init();
+    _configureClock(); // HAL_RCC_ClockConfig re-arms the 1ms tick for the new clock
+    _halInitialized = true;
+}
+
+/**
+ * @brief  Returns whether the FreeRTOS scheduler has been started.
+ * @retval true once forgeStartScheduler has handed control to the scheduler.
+ * @headerfile forge.h
+ */
+bool forgeSchedulerRunning(void)
+{
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+/**
+ * @brief  Waits for at least ms milliseconds. From a task this blocks only the calling task, so the rest of the firmware keeps running. Before the scheduler starts, or from an interrupt, it falls back to spinning on the HAL tick.
+ * @param[in]  ms is the number of milliseconds to wait.
+ * @retval None
+ * @headerfile forge.h
+ */
+void forgeDelay(uint32_t ms)
+{
+    if (forgeSchedulerRunning() && !xPortIsInsideInterrupt())
+    {
+        // +1 so a delay never ends early on a partially elapsed tick
+        vTaskDelay(pdMS_TO_TICKS(ms) + 1);
+        return;
+    }
+
+    uint32_t start = HAL_GetTick();
+    while ((HAL_GetTick() - start) < ms + 1)
+        ;
+}
+
+/**
+ * @brief  Overrides the weak HAL version so vendored code that calls HAL_Delay also yields to other tasks.
+ */
+void HAL_Delay(uint32_t Delay)
+{
+    forgeDelay(Delay);
+}
+
+/**
+ * @brief  Overrides the weak HAL version. With tickless idle SysTick doesn't fire while the idle task sleeps, so once the scheduler runs the kernel tick count (1 tick == 1 ms) is the source of truth.
+ */
+uint32_t HAL_GetTick(void)
+{
+    if (forgeSchedulerRunning())
+    {
+        return xPortIsInsideInterrupt() ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
+    }
+    return uwTick;
+}
+
+void SysTick_Handler(void)
+{
+    PROFILE_ISR_ENTER();
+    HAL_IncTick();
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+    {
+        xPortSysTickHandler();
+    }
+    PROFILE_ISR_EXIT(PROFILE_ISR_TICK);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file forge.h
+ * @brief One-time bring-up of the MCU and scheduler-aware delays.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_CORE_H
+#define __FORGE_CORE_H
+
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A write to a GPIO port's BSRR, for the code that sets pins directly rather
+// than through HAL_GPIO_WritePin. The host sim (Sim/sim.h) defines it first,
+// to see every edge.
+#ifndef FORGE_BSRR
+#define FORGE_BSRR(port, bits) ((port)->BSRR = (bits))
+#endif
+
+    void forgeInitHAL(void);
+    bool forgeSchedulerRunning(void);
+    void forgeDelay(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_CORE_H */
@@ -0,0 +1,281 @@
+/**
+ * @file profsum.c
+ * @brief Host summariser for the profiler's reports (Core/profiler.c): CPU use per task and interrupt, and the headroom left.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Needs nothing from the firmware. From Firmware/Include:
+ *
+ *   gcc -O2 -o profsum Core/host/profsum.c
+ *
+ * Reads the CDC port, or a capture of it, and picks out the report lines
+ * ("// prof" to "// end") from whatever else is on it, e.g. the replies to a
+ * print being streamed:
+ *
+ *   stty -F /dev/ttyACM0 raw -echo && ./profsum /dev/ttyACM0
+ *
+ * Prints a line a report as they come (not with -q), and when the input
+ * ends or on Ctrl-C a table over all of them. A task's share counts time it
+ * ran less the interrupts that preempted it; an interrupt's counts its own
+ * time less any that preempted it. Headroom is the idle task plus the time
+ * the core slept, so it's what a higher step rate could still use.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ENTRIES 32
+#define NAME_LENGTH 16
+
+typedef struct
+{
+    char name[NAME_LENGTH];
+    bool isr;
+    double cycles;      // Over every report
+    double peak;        // Largest share of one window
+    uint32_t minStack;  // Task: fewest stack words left unused
+    uint32_t worstWake; // Task: most cycles from ready to running
+    double count;       // Interrupt: times it ran
+    uint32_t maxRun;    // Interrupt: longest single run
+    uint32_t maxLatency;
+} Entry;
+
+static Entry _entries[MAX_ENTRIES];
+static unsigned _entryCount;
+static double _totalWindow;
+static double _minHeadroom = 1.0;
+static unsigned _reports;
+static uint32_t _clock;
+static volatile sig_atomic_t _stop;
+
+static Entry *_entry(const char *name, bool isr)
+{
+    for (unsigned i = 0; i < _entryCount; i++)
+    {
+        if (_entries[i].isr == isr && strcmp(_entries[i].name, name) == 0)
+            return &_entries[i];
+    }
+    if (_entryCount == MAX_ENTRIES)
+        return NULL;
+    Entry *e = &_entries[_entryCount++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->isr = isr;
+    e->minStack = UINT32_MAX;
+    return e;
+}
+
+static double _us(uint32_t cycles)
+{
+    return (_clock > 0) ? cycles * 1e6 / _clock : 0.0;
+}
+
+/**
+ * @brief  One report as it's read, kept until its "end" line so a report cut off by a reset is dropped whole.
+ */
+typedef struct
+{
+    bool open;
+    uint32_t uptimeMs;
+    uint32_t window;
+    uint32_t clock;
+    unsigned lines;
+    char names[MAX_ENTRIES][NAME_LENGTH];
+    bool isr[MAX_ENTRIES];
+    uint32_t values[MAX_ENTRIES][4];
+} Report;
+
+static void _finish(const Report *r, bool quiet)
+{
+    if (r->window == 0)
+        return;
+    _clock = r->clock;
+    double window = r->window;
+    double busy = 0.0, idle = 0.0, isrs = 0.0;
+    double stepShare = 0.0;
+    uint32_t stepCount = 0, stepRun = 0, stepLatency = 0;
+    for (unsigned i = 0; i < r->lines; i++)
+    {
+        Entry *e = _entry(r->names[i], r->isr[i]);
+        if (e == NULL)
+            continue;
+        const uint32_t *v = r->values[i];
+        double share;
+        if (!r->isr[i])
+        {
+            share = v[0] / window;
+            e->cycles += v[0];
+            if (v[1] < e->minStack)
+                e->minStack = v[1];
+            if (v[2] > e->worstWake)
+                e->worstWake = v[2];
+            if (strcmp(r->names[i], "IDLE") == 0)
+                idle += share;
+            else
+                busy += share;
+        }
+        else
+        {
+            share = v[1] / window;
+            e->count += v[0];
+            e->cycles += v[1];
+            if (v[2] > e->maxRun)
+                e->maxRun = v[2];
+            if (v[3] > e->maxLatency)
+                e->maxLatency = v[3];
+            isrs += share;
+            if (strcmp(r->names[i], "step") == 0)
+            {
+                stepShare = share;
+                stepCount = v[0];
+                stepRun = v[2];
+                stepLatency = v[3];
+            }
+        }
+        if (share > e->peak)
+            e->peak = share;
+    }
+    // What nothing was charged for, the core spent asleep
+    double asleep = 1.0 - busy - idle - isrs;
+    if (asleep < 0.0)
+        asleep = 0.0;
+    double headroom = idle + asleep;
+    if (headroom < _minHeadroom)
+        _minHeadroom = headroom;
+    _totalWindow += window;
+    _reports++;
+
+    if (!quiet)
+    {
+        printf("%8.1fs  tasks %5.1f%%  interrupts %5.1f%%  headroom %5.1f%%  step %5.1f%% at %6.0f/s, longest %.1fus, latency %.2fus\n",
+               r->uptimeMs / 1000.0, busy * 100.0, isrs * 100.0, headroom * 100.0, stepShare * 100.0,
+               stepCount * (double)r->clock / window, _us(stepRun), _us(stepLatency));
+        fflush(stdout);
+    }
+}
+
+static void _summary(void)
+{
+    if (_reports == 0)
+    {
+        printf("no reports seen\n");
+        return;
+    }
+    double seconds = _totalWindow / _clock;
+    printf("\n%u reports over %.1fs at %.0f MHz, least headroom %.1f%%\n\n", _reports, seconds, _clock / 1e6,
+           _minHeadroom * 100.0);
+    printf("task          cpu%%   peak%%  stack left  worst wake-up\n");
+    for (unsigned i = 0; i < _entryCount; i++)
+    {
+        const Entry *e = &_entries[i];
+        if (e->isr)
+            continue;
+        printf("%-12s %5.1f   %5.1f   %5u words  %9.1fus\n", e->name, e->cycles * 100.0 / _totalWindow,
+               e->peak * 100.0, e->minStack, _us(e->worstWake));
+    }
+    printf("\ninterrupt     cpu%%   peak%%       rate  average   longest   worst latency\n");
+    for (unsigned i = 0; i < _entryCount; i++)
+    {
+        const Entry *e = &_entries[i];
+        if (!e->isr)
+            continue;
+        double average = (e->count > 0) ? e->cycles / e->count * 1e6 / _clock : 0.0;
+        printf("%-12s %5.1f   %5.1f  %7.0f/s  %6.2fus  %6.2fus", e->name, e->cycles * 100.0 / _totalWindow,
+               e->peak * 100.0, e->count / seconds, average, _us(e->maxRun));
+        if (e->maxLatency > 0)
+            printf("  %9.2fus", _us(e->maxLatency));
+        printf("\n");
+    }
+}
+
+static void _interrupted(int signal)
+{
+    (void)signal;
+    _stop = 1;
+}
+
+static void _line(Report *r, const char *line, bool quiet)
+{
+    const char *p = strstr(line, "// ");
+    if (p == NULL)
+        return;
+    p += 3;
+    char name[NAME_LENGTH];
+    uint32_t v[4];
+    if (sscanf(p, "prof %u %u %u", &v[0], &v[1], &v[2]) == 3)
+    {
+        memset(r, 0, sizeof(*r));
+        r->open = true;
+        r->uptimeMs = v[0];
+        r->window = v[1];
+        r->clock = v[2];
+    }
+    else if (!r->open)
+    {
+        return;
+    }
+    else if (sscanf(p, "task %15s %u %u %u", name, &v[0], &v[1], &v[2]) == 4 && r->lines < MAX_ENTRIES)
+    {
+        snprintf(r->names[r->lines], NAME_LENGTH, "%s", name);
+        r->isr[r->lines] = false;
+        memcpy(r->values[r->lines++], v, sizeof(v));
+    }
+    else if (sscanf(p, "isr %15s %u %u %u %u", name, &v[0], &v[1], &v[2], &v[3]) == 5 && r->lines < MAX_ENTRIES)
+    {
+        snprintf(r->names[r->lines], NAME_LENGTH, "%s", name);
+        r->isr[r->lines] = true;
+        memcpy(r->values[r->lines++], v, sizeof(v));
+    }
+    else if (strncmp(p, "end", 3) == 0)
+    {
+        _finish(r, quiet);
+        r->open = false;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quiet = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+            quiet = true;
+        else
+            path = argv[i];
+    }
+    FILE *in = (path != NULL) ? fopen(path, "r") : stdin;
+    if (in == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    // Without SA_RESTART, so Ctrl-C ends a read from the port
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _interrupted;
+    sigaction(SIGINT, &action, NULL);
+
+    static Report report;
+    char line[256];
+    while (!_stop)
+    {
+        if (fgets(line, sizeof(line), in) == NULL)
+        {
+            if (errno == EINTR || feof(in) || ferror(in))
+                break;
+            continue;
+        }
+        _line(&report, line, quiet);
+    }
+    _summary();
+    return 0;
+}
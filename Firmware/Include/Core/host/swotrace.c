@@ -0,0 +1,301 @@
+/**
+ * @file swotrace.c
+ * @brief Host decoder for the firmware's SWO trace (Core/trace.c): turns a raw ITM capture into a Chrome trace of segments, speeds, heaters and ADC readings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Needs nothing from the firmware. From Firmware/Include:
+ *
+ *   gcc -O2 -o swotrace Core/host/swotrace.c
+ *
+ * Reads the bytes a probe captured off SWO (as a UART at TRACE_SWO_BAUD),
+ * from a file or stdin, and writes JSON for chrome://tracing or Perfetto:
+ *
+ *   ./swotrace -c 168000000 capture.bin > trace.json
+ *
+ * Segments show as spans on the motion track, the planned speed, each
+ * heater and each ADC channel as counters, and underruns, ITM overflows and
+ * any text on port 0 as instants. The ITM sends a local timestamp after the
+ * packets it belongs to, as cycles since the one before, so events are held
+ * until it comes; times are in microseconds from the start of the capture, at the
+ * core clock given with -c (168MHz if not).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Must match TracePort in Core/trace.h
+enum
+{
+    PORT_TEXT = 0,
+    PORT_SEGMENT_START = 1,
+    PORT_SEGMENT_END = 2,
+    PORT_SPEED = 3,
+    PORT_HEATER = 4,
+    PORT_ADC = 5,
+    PORT_UNDERRUN = 6,
+};
+
+#define MAX_PENDING 256
+#define TEXT_LENGTH 128
+
+typedef struct
+{
+    uint8_t port; // 0xFF for an overflow
+    uint32_t word;
+} Event;
+
+static Event _pending[MAX_PENDING];
+static unsigned _pendingCount;
+static uint64_t _cycles; // Sum of the timestamps so far
+static double _clock = 168000000.0;
+static bool _first = true;
+static char _text[TEXT_LENGTH];
+static unsigned _textLength;
+static unsigned long _events, _overflows, _untimed;
+
+static void _open(const char *ph, const char *name, const char *tid, double us)
+{
+    printf("%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":\"%s\",\"ts\":%.3f", _first ? "" : ",", ph, name, tid,
+           us);
+    _first = false;
+}
+
+static void _textEvent(double us)
+{
+    char escaped[TEXT_LENGTH * 2 + 1];
+    unsigned n = 0;
+    for (unsigned i = 0; i < _textLength; i++)
+    {
+        char c = _text[i];
+        if (c == '"' || c == '\\')
+            escaped[n++] = '\\';
+        escaped[n++] = ((unsigned char)c < 0x20) ? ' ' : c;
+    }
+    escaped[n] = '\0';
+    _textLength = 0;
+    _open("i", escaped, "log", us);
+    printf(",\"s\":\"g\"}");
+}
+
+static void _emit(const Event *e, double us)
+{
+    char name[32];
+    _events++;
+    switch (e->port)
+    {
+    case PORT_TEXT:
+        // Lines of ITM_SendChar text, a character an event
+        if (e->word == '\n' || _textLength == TEXT_LENGTH - 1)
+            _textEvent(us);
+        if (e->word != '\n' && e->word != '\r')
+            _text[_textLength++] = (char)e->word;
+        break;
+    case PORT_SEGMENT_START:
+        snprintf(name, sizeof(name), "segment %u", e->word);
+        _open("B", name, "motion", us);
+        printf("}");
+        break;
+    case PORT_SEGMENT_END:
+        snprintf(name, sizeof(name), "segment %u", e->word);
+        _open("E", name, "motion", us);
+        printf("}");
+        break;
+    case PORT_SPEED:
+    {
+        float speed;
+        memcpy(&speed, &e->word, sizeof(speed));
+        _open("C", "speed", "planner", us);
+        printf(",\"args\":{\"mm/s\":%.3f}}", speed);
+        break;
+    }
+    case PORT_HEATER:
+        snprintf(name, sizeof(name), "heater%u", e->word >> 30);
+        _open("C", name, "heaters", us);
+        printf(",\"args\":{\"duty %%\":%.1f,\"C\":%.1f}}", ((e->word >> 20) & 0x3FFU) / 10.0,
+               (e->word & 0xFFFFFU) / 10.0);
+        break;
+    case PORT_ADC:
+        snprintf(name, sizeof(name), "adc ch%u", e->word >> 16);
+        _open("C", name, "adc", us);
+        printf(",\"args\":{\"raw\":%u}}", e->word & 0xFFFFU);
+        break;
+    case PORT_UNDERRUN:
+        _open("i", "underrun", "motion", us);
+        printf(",\"s\":\"g\",\"args\":{\"segments\":%u}}", e->word);
+        break;
+    case 0xFF:
+        _open("i", "overflow", "itm", us);
+        printf(",\"s\":\"g\"}");
+        break;
+    default:
+        _events--;
+        break;
+    }
+}
+
+static void _flush(void)
+{
+    double us = _cycles * 1e6 / _clock;
+    for (unsigned i = 0; i < _pendingCount; i++)
+        _emit(&_pending[i], us);
+    _pendingCount = 0;
+}
+
+static void _push(uint8_t port, uint32_t word)
+{
+    // With timestamps off there's nothing to wait for; don't wait forever
+    if (_pendingCount == MAX_PENDING)
+    {
+        _flush();
+        _untimed++;
+    }
+    _pending[_pendingCount].port = port;
+    _pending[_pendingCount].word = word;
+    _pendingCount++;
+}
+
+/**
+ * @brief  The packet parser, a byte at a time, so a capture can be read in any size of pieces.
+ */
+typedef struct
+{
+    enum
+    {
+        HEADER,
+        SOURCE,       // Payload of a source packet
+        TIMESTAMP,    // Continuation bytes of a local timestamp
+        CONTINUATION, // Of a packet that's skipped
+    } state;
+    uint8_t header;
+    unsigned need, got;
+    uint32_t value;
+    unsigned zeros; // In a row, towards a sync packet
+} Parser;
+
+static void _byte(Parser *p, uint8_t b)
+{
+    switch (p->state)
+    {
+    case HEADER:
+        if (b == 0x00)
+        {
+            p->zeros++;
+            return;
+        }
+        if (b == 0x80 && p->zeros >= 5)
+        {
+            p->zeros = 0;
+            return;
+        }
+        p->zeros = 0;
+        p->header = b;
+        if (b == 0x70)
+        {
+            _overflows++;
+            _push(0xFF, 0);
+        }
+        else if ((b & 0x0F) == 0x00)
+        {
+            // Local timestamp: 11TC0000 with up to four more bytes, or
+            // 0TTT0000 carrying the value itself
+            if (b & 0x80)
+            {
+                p->state = TIMESTAMP;
+                p->value = 0;
+                p->got = 0;
+            }
+            else
+            {
+                _cycles += (b >> 4) & 0x07;
+                _flush();
+            }
+        }
+        else if ((b & 0x03) != 0)
+        {
+            // Source packet: 1, 2 or 4 bytes; software or hardware
+            p->need = ((b & 0x03) == 3) ? 4 : (b & 0x03);
+            p->got = 0;
+            p->value = 0;
+            p->state = SOURCE;
+        }
+        else if (b & 0x80)
+        {
+            // Extension or global timestamp, skipped to its last byte
+            p->state = CONTINUATION;
+        }
+        break;
+    case SOURCE:
+        p->value |= (uint32_t)b << (8 * p->got);
+        if (++p->got == p->need)
+        {
+            // Hardware packets (the DWT's) are left out
+            if ((p->header & 0x04) == 0)
+                _push(p->header >> 3, p->value);
+            p->state = HEADER;
+        }
+        break;
+    case TIMESTAMP:
+        p->value |= (uint32_t)(b & 0x7F) << (7 * p->got);
+        p->got++;
+        if ((b & 0x80) == 0 || p->got == 4)
+        {
+            _cycles += p->value;
+            _flush();
+            p->state = HEADER;
+        }
+        break;
+    case CONTINUATION:
+        if ((b & 0x80) == 0)
+            p->state = HEADER;
+        break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            _clock = strtod(argv[++i], NULL);
+        else
+            path = argv[i];
+    }
+    if (!(_clock > 0.0))
+    {
+        fprintf(stderr, "usage: swotrace [-c core clock Hz] [capture]\n");
+        return 1;
+    }
+    FILE *in = (path != NULL) ? fopen(path, "rb") : stdin;
+    if (in == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    static Parser parser;
+    uint8_t buffer[4096];
+    size_t n;
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+            _byte(&parser, buffer[i]);
+    }
+    _flush();
+    if (_textLength > 0)
+        _textEvent(_cycles * 1e6 / _clock);
+    printf("\n]}\n");
+
+    fprintf(stderr, "%lu events over %.3fms, %lu ITM overflows", _events, _cycles * 1e3 / _clock, _overflows);
+    if (_untimed > 0)
+        fprintf(stderr, ", %lu times %u events came without a timestamp", _untimed, MAX_PENDING);
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file main.c
+ * @brief Entry point of the Forge firmware.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "forge.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "../Stepper/forge-steppers.h"
+#include "../Temperature/forge-controllers.h"
+#include "../Neopixel/forge-neopixel.h"
+#include "../Neopixel/effects.h"
+#include "../Neopixel/neopixel_batch.h"
+#include "../Motion/forge-motion.h"
+#include "../Storage/forge-storage.h"
+#include "../Storage/sdprint.h"
+#include "../Storage/recovery.h"
+#include "../Usb/forge-usb.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+StepperConfig StepperX1;
+StepperConfig StepperY1;
+StepperConfig StepperZ1;
+StepperConfig StepperE1;
+
+ThermistorConfig T0;
+ThermistorConfig T1;
+ThermistorConfig T2;
+
+PIDControlConfig HeaterHotend;
+PIDControlConfig HeaterBed;
+
+NeoPixelString neopixels;
+NPColorBenchmark ForgeColorBenchmark;
+
+Planner ForgePlanner;
+GcodeMachine ForgeGcode;
+
+char SDPath[4];
+FATFS SDFatFs;
+
+static NeoPixelEffects statusEffects;
+static int8_t hotendEffect;
+static int8_t bedEffect;
+static int8_t progressEffect;
+
+#define STATUS_AMBIENT 25.0f // Shown fully cold
+
+// The three board pixels: hotend, bed, and how far the SD print has got
+void forgeEffectsFrame(NeoPixelEffects *fx)
+{
+    NPfxSetTemperature(fx, hotendEffect, HeaterHotend.lastTemp, STATUS_AMBIENT, HeaterHotend.target_temp);
+    NPfxSetTemperature(fx, bedEffect, HeaterBed.lastTemp, STATUS_AMBIENT, HeaterBed.target_temp);
+    NPfxSetProgress(fx, progressEffect, sdprintProgress());
+}
+
+int main(void)
+{
+    // Everything below calls forgeInitHAL() again; only this first call does anything
+    forgeInitHAL();
+    traceInit(TRACE_SWO_BAUD);
+
+    initForgeSteppers();
+    // Bring the drivers up now; the step interrupt never initializes them
+    initStepper(&StepperX1);
+    initStepper(&StepperY1);
+    initStepper(&StepperZ1);
+    initStepper(&StepperE1);
+    initHeaterControllers();
+    initMotion();
+    initStorage();
+    initUsb();
+    initNeopixel();
+    // Masks interrupts for a fraction of a millisecond, so only while nothing runs yet
+    NPbenchmarkColor(&ForgeColorBenchmark);
+
+    NPfxInit(&statusEffects, &neopixels, 0);
+    hotendEffect = NPfxAddTemperature(&statusEffects, 0, 1, 0x000000FF, 0x00FF0000);
+    bedEffect = NPfxAddTemperature(&statusEffects, 1, 1, 0x000000FF, 0x00FF4000);
+    progressEffect = NPfxAddProgress(&statusEffects, 2, 1, 0x0000FF00, 0x00101010);
+
+    forgeAddHeater(&HeaterHotend);
+    forgeAddHeater(&HeaterBed);
+    forgeSetEffects(&statusEffects);
+    sdprintInit(&ForgeGcode);
+    // A print cut off by a power loss stays journaled until M413 S1 resumes it
+    // or S0 forgets it; resuming on its own could run into a part taken off
+    // the bed
+    recoveryInit();
+
+    forgeStartScheduler();
+
+    // Only reached if the scheduler couldn't allocate its tasks
+    for (;;)
+        ;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file memory.c
+ * @brief Map of the memory the firmware set aside at build time: task stacks, buffers and pools, reported at boot.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Nothing is allocated at run time. FreeRTOS is built without a heap
+ * (configSUPPORT_DYNAMIC_ALLOCATION 0), so every task, semaphore and stream
+ * buffer is given its memory when it's created; LwIP takes its buffers from
+ * fixed-size pools (Net/lwippools.h); everything else is in arrays of fixed
+ * length. So memory can't fragment however long the printer runs, and no
+ * allocation can take longer than it did the first time, or fail.
+ *
+ * Each subsystem adds its blocks to the map as it starts, and the whole map
+ * can be read back a line at a time with forgeMemoryLine, e.g. for the USB
+ * host when it opens the command port.
+ */
+
+#include "memory.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <string.h>
+
+ForgeMemoryMap FORGE_MEMORY;
+
+// From the linker script, as startup_stm32f405xx.s uses them
+extern uint32_t _sdata;
+extern uint32_t _edata;
+extern uint32_t _sbss;
+extern uint32_t _ebss;
+extern uint32_t _estack;
+
+static bool _before(const ForgeMemoryBlock *a, const void *base)
+{
+    if (a->base == NULL)
+        return false;
+    return base == NULL || (uintptr_t)a->base < (uintptr_t)base;
+}
+
+/**
+ * @brief  Adds a block to the map. Call once for each, while starting up.
+ * @param[in]  name says whose it is. Not copied.
+ * @param[in]  base is where it starts, or NULL if it's made of pieces.
+ * @param[in]  size is its size in bytes.
+ * @retval None
+ * @headerfile memory.h
+ */
+void forgeMemoryAdd(const char *name, const void *base, uint32_t size)
+{
+    ForgeMemoryMap *map = &FORGE_MEMORY;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (map->count == 0)
+    {
+        map->staticSize = (uint32_t)((uint8_t *)&_edata - (uint8_t *)&_sdata) +
+                          (uint32_t)((uint8_t *)&_ebss - (uint8_t *)&_sbss);
+        map->unused = (uint32_t)((uint8_t *)&_estack - (uint8_t *)&_ebss);
+    }
+    if (map->count == FORGE_MEMORY_BLOCKS)
+    {
+        map->dropped++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    uint8_t i = 0;
+    while (i < map->count && _before(&map->blocks[i], base))
+        i++;
+    if (base != NULL)
+    {
+        uintptr_t start = (uintptr_t)base;
+        const ForgeMemoryBlock *previous = (i > 0) ? &map->blocks[i - 1] : NULL;
+        const ForgeMemoryBlock *next = (i < map->count) ? &map->blocks[i] : NULL;
+        if ((previous != NULL && (uintptr_t)previous->base + previous->size > start) ||
+            (next != NULL && next->base != NULL && start + size > (uintptr_t)next->base))
+            map->overlaps++;
+    }
+    memmove(&map->blocks[i + 1], &map->blocks[i], (map->count - i) * sizeof(ForgeMemoryBlock));
+    map->blocks[i].name = name;
+    map->blocks[i].base = base;
+    map->blocks[i].size = size;
+    map->count++;
+    map->mapped += size;
+    __set_PRIMASK(primask);
+}
+
+static char *_text(char *p, const char *end, const char *text)
+{
+    while (*text != '\0' && p < end)
+        *p++ = *text++;
+    return p;
+}
+
+static char *_decimal(char *p, const char *end, uint32_t value)
+{
+    char digits[10];
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + value % 10U);
+        value /= 10U;
+    } while (value > 0);
+    while (n > 0 && p < end)
+        *p++ = digits[--n];
+    return p;
+}
+
+static char *_hex(char *p, const char *end, uint32_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    p = _text(p, end, "0x");
+    for (int8_t shift = 28; shift >= 0 && p < end; shift -= 4)
+        *p++ = digits[(value >> shift) & 0xFU];
+    return p;
+}
+
+/**
+ * @brief  Writes one line of the report: "name 0x20001000 4096" for each block, in address order, then a line of totals.
+ * @param[in]  index counts from 0.
+ * @param[out]  line receives the line and its newline, up to FORGE_MEMORY_LINE characters, not terminated.
+ * @retval Its length, or 0 past the last line.
+ * @headerfile memory.h
+ */
+uint32_t forgeMemoryLine(uint8_t index, char *line)
+{
+    const ForgeMemoryMap *map = &FORGE_MEMORY;
+    char *p = line;
+    const char *end = line + FORGE_MEMORY_LINE - 1; // Room for the newline
+    if (index < map->count)
+    {
+        const ForgeMemoryBlock *block = &map->blocks[index];
+        p = _text(p, end, block->name);
+        p = _text(p, end, " ");
+        if (block->base != NULL)
+            p = _hex(p, end, (uint32_t)(uintptr_t)block->base);
+        else
+            p = _text(p, end, "-");
+        p = _text(p, end, " ");
+        p = _decimal(p, end, block->size);
+    }
+    else if (index == map->count)
+    {
+        p = _text(p, end, "mapped ");
+        p = _decimal(p, end, map->mapped);
+        p = _text(p, end, " static ");
+        p = _decimal(p, end, map->staticSize);
+        p = _text(p, end, " unused ");
+        p = _decimal(p, end, map->unused);
+        if (map->dropped > 0 || map->overlaps > 0)
+        {
+            p = _text(p, end, " dropped ");
+            p = _decimal(p, end, map->dropped);
+            p = _text(p, end, " overlaps ");
+            p = _decimal(p, end, map->overlaps);
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    *p++ = '\n';
+    return (uint32_t)(p - line);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file memory.h
+ * @brief Map of the memory the firmware set aside at build time: task stacks, buffers and pools, reported at boot.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_MEMORY_H
+#define __FORGE_MEMORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Entries in the map; the firmware adds about 30
+#define FORGE_MEMORY_BLOCKS 40
+// Longest line forgeMemoryLine writes, with its newline
+#define FORGE_MEMORY_LINE 64
+
+    /**
+     * @brief A block of memory that belongs to one subsystem for good.
+     */
+    typedef struct
+    {
+        const char *name;
+        const void *base; // NULL for memory that isn't in one piece, e.g. LwIP's pools
+        uint32_t size;
+    } ForgeMemoryBlock;
+
+    /**
+     * @brief The map, in address order with the scattered blocks last. Everything is allocated statically, so once the tasks have started it doesn't change.
+     */
+    typedef struct
+    {
+        ForgeMemoryBlock blocks[FORGE_MEMORY_BLOCKS];
+        uint8_t count;
+        uint8_t dropped;     // Blocks that didn't fit in the map
+        uint8_t overlaps;    // Blocks added over one already in the map; always a bug
+        uint32_t mapped;     // Bytes in the blocks
+        uint32_t staticSize; // .data and .bss, from the linker script
+        uint32_t unused;     // Between the end of .bss and the top of RAM, which only the main stack uses
+    } ForgeMemoryMap;
+
+    extern ForgeMemoryMap FORGE_MEMORY;
+
+    void forgeMemoryAdd(const char *name, const void *base, uint32_t size);
+    uint32_t forgeMemoryLine(uint8_t index, char *line);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_MEMORY_H */
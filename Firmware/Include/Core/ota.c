@@ -0,0 +1,305 @@
+/**
+ * @file ota.c
+ * @brief Firmware updates: a new image is staged in the upper half of flash while the printer keeps running, then copied over the running one.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * The F405 can't run from one bank while writing the other, as the parts
+ * with two banks can: while flash is busy, every fetch from it waits, and
+ * the step interrupt runs from flash like everything else. So the two
+ * kinds of write are fitted around motion differently:
+ *
+ *   Erasing a sector takes 1-2s. The slot is erased ahead of time, right
+ *   after boot and after each image, one sector at a time whenever motion
+ *   has been idle for OTA_IDLE_MS, with the scheduler held so the planner
+ *   can't start a move halfway through.
+ *
+ *   Writing a word takes ~16us, less than a step interval at all but the
+ *   highest rates. Each is started with interrupts off, and only with at
+ *   least OTA_WORD_GAP_TICKS to go before the next step event, so the step
+ *   interrupt is never held up. Moves stepping faster than that leave no
+ *   gap, and the writes wait for a slower one.
+ *
+ * So an image can be sent in the middle of a print, as long as the slot was
+ * erased beforehand. Installing it is not background work: otaInstall erases
+ * the running firmware and copies the image over it from RAM with
+ * everything stopped, then resets. There's no bootloader to fall back on;
+ * losing power during those few seconds leaves a board that has to be
+ * flashed over SWD.
+ */
+
+#include "ota.h"
+#include "../Motion/motion.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include <string.h>
+
+OtaSlot OTA;
+
+// From the linker script, as startup_stm32f405xx.s uses them: the initial
+// values of .data are the last thing in flash
+extern uint32_t _sidata;
+extern uint32_t _sdata;
+extern uint32_t _edata;
+
+#define FLASH_ERRORS (FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR | FLASH_SR_WRPERR | FLASH_SR_SOP)
+
+static bool _blank(void)
+{
+    const uint32_t *p = (const uint32_t *)OTA_SLOT_ADDRESS;
+    for (uint32_t i = 0; i < OTA_SLOT_SIZE / 4U; i++)
+    {
+        if (p[i] != 0xFFFFFFFFU)
+            return false;
+    }
+    return true;
+}
+
+static void _flushDataCache(void)
+{
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
+
+static void _eraseAll(void)
+{
+    OTA.nextSector = 0;
+    OTA.length = 0;
+    OTA.state = OTA_ERASING;
+}
+
+/**
+ * @brief  Finds out what the slot holds. An image staged before a reset isn't trusted, so anything but a blank slot is erased again. Call once at startup, before the push task runs.
+ * @retval None
+ * @headerfile ota.h
+ */
+void otaInit(void)
+{
+    memset(&OTA, 0, sizeof(OTA));
+    uint32_t end = (uint32_t)&_sidata + (uint32_t)((uint8_t *)&_edata - (uint8_t *)&_sdata);
+    if (end > OTA_SLOT_ADDRESS)
+        OTA.state = OTA_UNAVAILABLE;
+    else if (_blank())
+        OTA.state = OTA_READY;
+    else
+        _eraseAll();
+}
+
+/**
+ * @brief  Erases the next sector of the slot if motion has been idle long enough. Call from the push task every so often while OTA.state is OTA_ERASING.
+ * @retval None
+ * @headerfile ota.h
+ */
+void otaService(void)
+{
+    OtaSlot *ota = &OTA;
+    if (ota->state != OTA_ERASING)
+        return;
+
+    uint32_t now = HAL_GetTick();
+    if (!motionIdle())
+    {
+        ota->idleSince = 0;
+        ota->stats.eraseWaits++;
+        return;
+    }
+    if (ota->idleSince == 0)
+        ota->idleSince = now | 1U;
+    if (now - ota->idleSince < OTA_IDLE_MS)
+        return;
+
+    // The planner can't start a move while the scheduler is held, and
+    // nothing from flash runs during the erase anyway
+    vTaskSuspendAll();
+    bool idle = motionIdle();
+    HAL_StatusTypeDef status = HAL_ERROR;
+    uint32_t failed = 0;
+    if (idle)
+    {
+        FLASH_EraseInitTypeDef erase;
+        erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+        erase.Banks = FLASH_BANK_1;
+        erase.Sector = OTA_SLOT_FIRST_SECTOR + ota->nextSector;
+        erase.NbSectors = 1;
+        erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+        HAL_FLASH_Unlock();
+        status = HAL_FLASHEx_Erase(&erase, &failed);
+        HAL_FLASH_Lock();
+    }
+    xTaskResumeAll();
+    if (!idle)
+        return;
+
+    // The next sector waits for another full idle period, so motion that was
+    // held up gets going first
+    ota->idleSince = 0;
+    if (status != HAL_OK)
+    {
+        ota->stats.errors++;
+        return;
+    }
+    ota->stats.erases++;
+    if (++ota->nextSector == OTA_SLOT_SECTORS)
+    {
+        _flushDataCache();
+        ota->state = OTA_READY;
+    }
+}
+
+/**
+ * @brief  Starts taking an image. Call while the push task has no chunks to write; if this set the slot erasing, wake it.
+ * @retval false if the slot isn't erased yet, or an image is being received.
+ * @headerfile ota.h
+ */
+bool otaBegin(void)
+{
+    // A new image replaces a staged one that wasn't installed
+    if (OTA.state == OTA_STAGED)
+        _eraseAll();
+    if (OTA.state != OTA_READY)
+        return false;
+    OTA.length = 0;
+    OTA.state = OTA_RECEIVING;
+    return true;
+}
+
+/**
+ * @brief  Writes the next piece of the image into the slot, a word at a time in the gaps between step events, and reads it back. Call from the push task, which is the lowest priority task there is, so waiting for gaps only takes time nobody else wants.
+ * @param[in]  offset is where the piece goes in the image; pieces come in order.
+ * @param[in]  data is the piece.
+ * @param[in]  length is its size in bytes; all but the last piece are a multiple of 4.
+ * @retval false if it doesn't fit or didn't program.
+ * @headerfile ota.h
+ */
+bool otaProgram(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+    OtaSlot *ota = &OTA;
+    if (ota->state != OTA_RECEIVING || offset != ota->length || offset + length > OTA_SLOT_SIZE)
+        return false;
+
+    bool ok = true;
+    HAL_FLASH_Unlock();
+    FLASH->SR = FLASH_ERRORS;
+    FLASH->CR = FLASH_PSIZE_WORD | FLASH_CR_PG;
+    for (uint32_t i = 0; i < length && ok; i += 4U)
+    {
+        uint32_t word = 0xFFFFFFFFU;
+        memcpy(&word, data + i, (length - i < 4U) ? length - i : 4U);
+        volatile uint32_t *target = (volatile uint32_t *)(OTA_SLOT_ADDRESS + offset + i);
+        bool waited = false;
+        for (;;)
+        {
+            __disable_irq();
+            if (motionQuietTicks() >= OTA_WORD_GAP_TICKS)
+                break;
+            __enable_irq();
+            waited = true;
+        }
+        if (waited)
+            ota->stats.gapWaits++;
+        *target = word;
+        // Fetching the next instruction waits for the write to finish, so by
+        // the time interrupts are back on, flash is free again
+        __enable_irq();
+        while (FLASH->SR & FLASH_SR_BSY)
+            ;
+        if (FLASH->SR & FLASH_ERRORS)
+            ok = false;
+        ota->stats.words++;
+    }
+    FLASH->CR &= ~FLASH_CR_PG;
+    HAL_FLASH_Lock();
+
+    // The data cache may still hold lines from before the writes
+    _flushDataCache();
+    if (ok && memcmp((const void *)(OTA_SLOT_ADDRESS + offset), data, length) != 0)
+        ok = false;
+    if (!ok)
+    {
+        ota->stats.errors++;
+        return false;
+    }
+    ota->length = offset + length;
+    return true;
+}
+
+/**
+ * @brief  Ends an image once the push task has written all of it. A whole one is checked for a vector table that makes sense for this chip; anything else has the slot erased again, for which the push task has to be woken.
+ * @param[in]  complete is false if the transfer broke off.
+ * @retval true if an image is now staged for otaInstall.
+ * @headerfile ota.h
+ */
+bool otaFinish(bool complete)
+{
+    OtaSlot *ota = &OTA;
+    if (ota->state != OTA_RECEIVING)
+        return false;
+
+    const uint32_t *vectors = (const uint32_t *)OTA_SLOT_ADDRESS;
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1];
+    bool ram = (sp > SRAM1_BASE && sp <= SRAM1_BASE + 128U * 1024U) ||
+               (sp > CCMDATARAM_BASE && sp <= CCMDATARAM_BASE + 64U * 1024U);
+    // Linked to run where the running firmware does, in Thumb state
+    bool entry = (reset & 1U) && reset >= OTA_APP_ADDRESS && reset < OTA_APP_ADDRESS + OTA_SLOT_SIZE;
+    if (!complete || ota->length < 8U || !ram || !entry)
+    {
+        _eraseAll();
+        return false;
+    }
+    ota->imageLength = ota->length;
+    ota->state = OTA_STAGED;
+    return true;
+}
+
+/**
+ * @brief  Erases the running firmware and copies the staged image over it, then resets. Runs from RAM with interrupts off, without calling anything in flash.
+ */
+static __RAM_FUNC __NO_RETURN void _install(uint32_t words)
+{
+    volatile uint32_t *target = (volatile uint32_t *)OTA_APP_ADDRESS;
+    const volatile uint32_t *source = (const volatile uint32_t *)OTA_SLOT_ADDRESS;
+
+    while (FLASH->SR & FLASH_SR_BSY)
+        ;
+    FLASH->SR = FLASH_ERRORS;
+    for (uint32_t s = 0; s < OTA_APP_SECTORS; s++)
+    {
+        FLASH->CR = FLASH_PSIZE_WORD | FLASH_CR_SER | (s << FLASH_CR_SNB_Pos);
+        FLASH->CR |= FLASH_CR_STRT;
+        while (FLASH->SR & FLASH_SR_BSY)
+            ;
+    }
+    FLASH->CR = FLASH_PSIZE_WORD | FLASH_CR_PG;
+    for (uint32_t i = 0; i < words; i++)
+    {
+        target[i] = source[i];
+        while (FLASH->SR & FLASH_SR_BSY)
+            ;
+    }
+    FLASH->CR = FLASH_CR_LOCK;
+
+    __DSB();
+    SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) | SCB_AIRCR_SYSRESETREQ_Msk;
+    __DSB();
+    for (;;)
+        ;
+}
+
+/**
+ * @brief  Installs the staged image and restarts into it. The copy takes a few seconds during which nothing else runs, so the caller makes sure nothing is printing; this only checks that motion has stopped.
+ * @retval false if there's no image staged or motion isn't idle. Doesn't return otherwise.
+ * @headerfile ota.h
+ */
+bool otaInstall(void)
+{
+    if (OTA.state != OTA_STAGED || !motionIdle())
+        return false;
+    vTaskSuspendAll();
+    __disable_irq();
+    HAL_FLASH_Unlock();
+    _install((OTA.imageLength + 3U) / 4U);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file ota.h
+ * @brief Firmware updates: a new image is staged in the upper half of flash while the printer keeps running, then copied over the running one.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_OTA_H
+#define __FORGE_OTA_H
+
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// The F405 has one bank of 1MB. The firmware runs from sectors 0-7 (512KB)
+// and the new image is staged in sectors 8-11, the other 512KB.
+#define OTA_APP_ADDRESS 0x08000000U
+#define OTA_APP_SECTORS 8U
+#define OTA_SLOT_ADDRESS 0x08080000U
+#define OTA_SLOT_SIZE (512U * 1024U)
+#define OTA_SLOT_FIRST_SECTOR FLASH_SECTOR_8
+#define OTA_SLOT_SECTORS 4U
+
+// A sector erase stalls every fetch from flash for 1-2s, the step
+// interrupt's included, so one is only started once motion has been idle
+// this long: a heat-up, a dwell, a pause or no print at all, not the gap of
+// an underrun.
+#define OTA_IDLE_MS 500U
+// A word write stalls flash for 16us typically; one is only started with at
+// least this long to go before the next step event (timer ticks, 0.25us)
+#define OTA_WORD_GAP_TICKS 160U
+
+    typedef enum
+    {
+        OTA_UNAVAILABLE = 0, // The running firmware reaches into the slot
+        OTA_ERASING,         // The slot has to be erased before an image can go in
+        OTA_READY,
+        OTA_RECEIVING,
+        OTA_STAGED           // A checked image is waiting for otaInstall
+    } OtaState;
+
+    typedef struct
+    {
+        uint32_t erases;      // Sectors
+        uint32_t eraseWaits;  // Times an erase waited for motion to stop
+        uint32_t words;       // Programmed
+        uint32_t gapWaits;    // Word writes held back for a step event
+        uint32_t errors;      // Programming or verify failures
+    } OtaStats;
+
+    /**
+     * @brief The staging slot. The network task starts and ends an image through Net/push.c, the push task erases and programs it in between.
+     */
+    typedef struct
+    {
+        volatile OtaState state;
+        uint8_t nextSector;    // While erasing, counting from OTA_SLOT_FIRST_SECTOR
+        uint32_t idleSince;    // Tick motion was first seen idle, 0 if it isn't
+        uint32_t length;       // Bytes programmed into the slot
+        uint32_t imageLength;  // Of the staged image
+        OtaStats stats;
+    } OtaSlot;
+
+    extern OtaSlot OTA;
+
+    void otaInit(void);
+    void otaService(void);
+    bool otaBegin(void);
+    bool otaProgram(uint32_t offset, const uint8_t *data, uint32_t length);
+    bool otaFinish(bool complete);
+    bool otaInstall(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_OTA_H */
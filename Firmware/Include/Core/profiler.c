@@ -0,0 +1,269 @@
+/**
+ * @file profiler.c
+ * @brief Where the CPU goes: cycles spent in each task and each interrupt, the step interrupt's latency and every task's stack headroom, reported once a second.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Everything is timed with the cycle counter, which forgeStartScheduler
+ * starts. Interrupt handlers in the board headers bracket themselves with
+ * PROFILE_ISR_ENTER and PROFILE_ISR_EXIT; time spent in one that preempted
+ * another is taken off the one it preempted, so each is charged only for
+ * its own work. The kernel calls profileSwitchedOut as it switches a task
+ * out (traceTASK_SWITCHED_OUT), which charges the task for the time since
+ * the last switch less the interrupts in between.
+ *
+ * The core doesn't count cycles while it sleeps in the idle task, so a
+ * report's window is measured with the tick count instead, and whatever of
+ * it no task or interrupt accounts for was spent asleep: headroom, like the
+ * idle task's own cycles.
+ *
+ * The report goes to profileOutput a line at a time; Core/host/profsum.c
+ * turns it into a table:
+ *
+ *   prof <uptime ms> <window cycles> <core clock>
+ *   task <name> <cycles> <stack words never used> <worst wake-up cycles>
+ *   isr <name> <count> <cycles> <longest run cycles> <worst latency cycles>
+ *   end
+ */
+
+#include "profiler.h"
+#include "../Net/json.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+Profiler PROFILE;
+
+static const char *const _isrNames[PROFILE_ISRS] = {"step", "wake", "tick", "usb", "sd", "swo", "uart"};
+
+// What the last report saw, to take the running totals from
+static uint32_t _seenTasks[FORGE_MAX_TASKS];
+static ProfileIsrStats _seenIsrs[PROFILE_ISRS];
+static TickType_t _seenTick;
+static ForgeTaskLatency _latencies[FORGE_MAX_TASKS];
+
+static StackType_t _profileStack[FORGE_STACK_PROFILE];
+static StaticTask_t _profileTcb;
+
+/**
+ * @brief  Marks the start of an interrupt handler; use PROFILE_ISR_ENTER. Interrupts are briefly masked so a nested one can't come in halfway.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileIsrEnter(void)
+{
+    Profiler *p = &PROFILE;
+    // Handlers always start with PRIMASK clear, or they wouldn't be running
+    __disable_irq();
+    uint8_t d = p->depth;
+    if (d < PROFILE_MAX_NESTING)
+    {
+        p->started[d] = DWT->CYCCNT;
+        p->preempted[d] = 0;
+    }
+    p->depth = d + 1U;
+    __enable_irq();
+}
+
+/**
+ * @brief  Marks the end of an interrupt handler and charges it for its run; use PROFILE_ISR_EXIT.
+ * @param[in]  isr says which handler it was.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileIsrExit(ProfileIsr isr)
+{
+    Profiler *p = &PROFILE;
+    __disable_irq();
+    uint32_t now = DWT->CYCCNT;
+    uint8_t d = --p->depth;
+    if (d < PROFILE_MAX_NESTING)
+    {
+        uint32_t elapsed = now - p->started[d];
+        uint32_t own = elapsed - p->preempted[d];
+        if (d > 0)
+            p->preempted[d - 1U] += elapsed;
+        ProfileIsrStats *stats = &p->isrs[isr];
+        stats->count++;
+        stats->cycles += own;
+        if (own > stats->maxCycles)
+            stats->maxCycles = own;
+        p->isrCycles += own;
+    }
+    __enable_irq();
+}
+
+/**
+ * @brief  Records how long after its event an interrupt's handler started, e.g. from a timer's count at entry; use PROFILE_ISR_LATENCY first thing in the handler.
+ * @param[in]  isr says which handler it is.
+ * @param[in]  cycles is the latency in core cycles.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileIsrLatency(ProfileIsr isr, uint32_t cycles)
+{
+    ProfileIsrStats *stats = &PROFILE.isrs[isr];
+    if (cycles > stats->maxLatency)
+        stats->maxLatency = cycles;
+}
+
+/**
+ * @brief  Called by the kernel as a task is switched out. Never call it directly.
+ * @param[in]  number is the task's number, counting from 1 in the order tasks were created.
+ * @param[in]  task is its handle.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileSwitchedOut(uint32_t number, void *task)
+{
+    Profiler *p = &PROFILE;
+    uint32_t i = number - 1U;
+    // The step interrupt isn't masked by the kernel, and mustn't land
+    // between the two reads
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t now = DWT->CYCCNT;
+    uint32_t isr = p->isrCycles;
+    if (i < FORGE_MAX_TASKS)
+    {
+        p->tasks[i].task = (TaskHandle_t)task;
+        p->tasks[i].cycles += (now - p->lastSwitch) - (isr - p->isrAtSwitch);
+    }
+    p->lastSwitch = now;
+    p->isrAtSwitch = isr;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Called from the profiler task with each line of a report, newline included. Override it to send them somewhere; the default drops them.
+ * @param[in]  line is the line, not terminated.
+ * @param[in]  length is its length.
+ * @retval None
+ * @headerfile profiler.h
+ */
+__weak void profileOutput(const char *line, uint32_t length)
+{
+    (void)line;
+    (void)length;
+}
+
+static void _line(JsonWriter *j, char *line)
+{
+    jsonChar(j, '\n');
+    profileOutput(line, (uint32_t)(j->p - line));
+    j->p = line;
+}
+
+static void _report(void)
+{
+    Profiler *p = &PROFILE;
+    char line[PROFILE_LINE];
+    JsonWriter j = {line, line + sizeof(line) - 1}; // Room for the newline
+
+    TickType_t tick = xTaskGetTickCount();
+    uint32_t window = (uint32_t)(tick - _seenTick) * (SystemCoreClock / configTICK_RATE_HZ);
+    _seenTick = tick;
+    jsonRaw(&j, "prof ");
+    jsonUint(&j, (uint32_t)tick * portTICK_PERIOD_MS);
+    jsonChar(&j, ' ');
+    jsonUint(&j, window);
+    jsonChar(&j, ' ');
+    jsonUint(&j, SystemCoreClock);
+    _line(&j, line);
+
+    uint8_t latencies = forgeTaskLatencies(_latencies, FORGE_MAX_TASKS);
+    for (uint8_t i = 0; i < FORGE_MAX_TASKS; i++)
+    {
+        TaskHandle_t task = p->tasks[i].task;
+        if (task == NULL)
+            continue;
+        uint32_t cycles = p->tasks[i].cycles;
+        uint32_t worst = 0;
+        for (uint8_t l = 0; l < latencies; l++)
+        {
+            if (_latencies[l].task == task)
+                worst = _latencies[l].worstCycles;
+        }
+        jsonRaw(&j, "task ");
+        jsonRaw(&j, pcTaskGetName(task));
+        jsonChar(&j, ' ');
+        jsonUint(&j, cycles - _seenTasks[i]);
+        jsonChar(&j, ' ');
+        jsonUint(&j, (uint32_t)uxTaskGetStackHighWaterMark(task));
+        jsonChar(&j, ' ');
+        jsonUint(&j, worst);
+        _line(&j, line);
+        _seenTasks[i] = cycles;
+    }
+    forgeResetTaskLatencies();
+
+    for (uint8_t i = 0; i < PROFILE_ISRS; i++)
+    {
+        ProfileIsrStats now;
+        __disable_irq();
+        now = p->isrs[i];
+        p->isrs[i].maxCycles = 0;
+        p->isrs[i].maxLatency = 0;
+        __enable_irq();
+        jsonRaw(&j, "isr ");
+        jsonRaw(&j, _isrNames[i]);
+        jsonChar(&j, ' ');
+        jsonUint(&j, now.count - _seenIsrs[i].count);
+        jsonChar(&j, ' ');
+        jsonUint(&j, now.cycles - _seenIsrs[i].cycles);
+        jsonChar(&j, ' ');
+        jsonUint(&j, now.maxCycles);
+        jsonChar(&j, ' ');
+        jsonUint(&j, now.maxLatency);
+        _line(&j, line);
+        _seenIsrs[i] = now;
+    }
+
+    jsonRaw(&j, "end");
+    _line(&j, line);
+    p->reports++;
+}
+
+/**
+ * @brief  Sends a report every periodMs. The lowest priority but for idle, so it never takes time anything else wants. A window is at most 10s, short of the 25s it takes a running total to wrap.
+ */
+static void _profileTask(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        uint32_t period = PROFILE.periodMs;
+        vTaskDelay(pdMS_TO_TICKS((period > 0) ? period : PROFILE_PERIOD_MS));
+        if (PROFILE.periodMs > 0)
+            _report();
+        else
+            _seenTick = xTaskGetTickCount();
+    }
+}
+
+/**
+ * @brief  Sets how often a report is sent.
+ * @param[in]  periodMs is the time between reports, up to 10s, or 0 to stop them. Timing goes on regardless.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileSetPeriod(uint32_t periodMs)
+{
+    PROFILE.periodMs = (periodMs > 10000U) ? 10000U : periodMs;
+}
+
+/**
+ * @brief  Starts timing and creates the profiler task. Called by forgeStartScheduler once the cycle counter runs.
+ * @retval None
+ * @headerfile profiler.h
+ */
+void profileStart(void)
+{
+    // The interrupts may already be counting, so only the task side is set up
+    Profiler *p = &PROFILE;
+    p->periodMs = PROFILE_PERIOD_MS;
+    p->lastSwitch = DWT->CYCCNT;
+    _seenTick = xTaskGetTickCount();
+    forgeCreateTask(_profileTask, "prof", FORGE_STACK_PROFILE, FORGE_PRIO_PROFILE, _profileStack, &_profileTcb);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file profiler.h
+ * @brief Where the CPU goes: cycles spent in each task and each interrupt, the step interrupt's latency and every task's stack headroom, reported once a second.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_PROFILER_H
+#define __FORGE_PROFILER_H
+
+#include "scheduler.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Timing the interrupts costs a few dozen cycles each time one runs, which
+// at the highest step rates is about 2% of the CPU; build with 0 to leave
+// them out. Tasks are timed either way.
+#ifndef FORGE_PROFILE_ISRS
+#define FORGE_PROFILE_ISRS 1
+#endif
+
+#define PROFILE_PERIOD_MS 1000
+// Interrupts that can be running at once, one preempting the next
+#define PROFILE_MAX_NESTING 4
+// Longest line of a report, with its newline
+#define PROFILE_LINE 64
+
+#define FORGE_PRIO_PROFILE (tskIDLE_PRIORITY + 1)
+#define FORGE_STACK_PROFILE 256
+
+    /**
+     * @brief The interrupts that are timed, each by its handler in the board headers.
+     */
+    typedef enum
+    {
+        PROFILE_ISR_STEP = 0, // Motion timer, above the kernel
+        PROFILE_ISR_WAKE,     // motionWait's wake-up
+        PROFILE_ISR_TICK,     // SysTick
+        PROFILE_ISR_USB,
+        PROFILE_ISR_SD,       // SDIO and its DMA streams
+        PROFILE_ISR_SWO,      // The probe's SWO capture, with FORGE_USB_DAP
+        PROFILE_ISR_UART,     // The probe's UART, with FORGE_USB_DAP
+        PROFILE_ISRS
+    } ProfileIsr;
+
+    /**
+     * @brief Running totals for one interrupt. Counts and cycles are never reset and wrap, so a report takes the difference from the last; the worst cases are cleared by each report.
+     */
+    typedef struct
+    {
+        uint32_t count;
+        uint32_t cycles;     // Spent in the handler, less interrupts that preempted it
+        uint32_t maxCycles;  // Longest single run
+        uint32_t maxLatency; // Most cycles from the event to the handler, where that can be measured
+    } ProfileIsrStats;
+
+    /**
+     * @brief Running totals for one task, numbered as the kernel numbers them.
+     */
+    typedef struct
+    {
+        TaskHandle_t task; // NULL until it has run
+        uint32_t cycles;   // Spent running, less interrupts; wraps
+    } ProfileTaskStats;
+
+    typedef struct
+    {
+        ProfileTaskStats tasks[FORGE_MAX_TASKS];
+        ProfileIsrStats isrs[PROFILE_ISRS];
+        uint32_t isrCycles;   // In all interrupts together; wraps
+        uint32_t lastSwitch;  // Cycle count at the last task switch
+        uint32_t isrAtSwitch; // isrCycles then
+        uint8_t depth;        // Interrupts running, nested
+        uint32_t started[PROFILE_MAX_NESTING];
+        uint32_t preempted[PROFILE_MAX_NESTING]; // Cycles spent in interrupts nested in each
+
+        uint32_t periodMs; // 0 stops the reports
+        uint32_t reports;
+    } Profiler;
+
+    extern Profiler PROFILE;
+
+    void profileStart(void);
+    void profileSetPeriod(uint32_t periodMs);
+    void profileIsrEnter(void);
+    void profileIsrExit(ProfileIsr isr);
+    void profileIsrLatency(ProfileIsr isr, uint32_t cycles);
+    void profileSwitchedOut(uint32_t number, void *task);
+    void profileOutput(const char *line, uint32_t length);
+
+#if FORGE_PROFILE_ISRS
+#define PROFILE_ISR_ENTER() profileIsrEnter()
+#define PROFILE_ISR_EXIT(isr) profileIsrExit(isr)
+#define PROFILE_ISR_LATENCY(isr, cycles) profileIsrLatency((isr), (cycles))
+#else
+#define PROFILE_ISR_ENTER()
+#define PROFILE_ISR_EXIT(isr)
+#define PROFILE_ISR_LATENCY(isr, cycles)
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_PROFILER_H */
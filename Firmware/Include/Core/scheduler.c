@@ -0,0 +1,372 @@
+/**
+ * @file scheduler.c
+ * @brief Task layout of the Forge firmware on top of FreeRTOS.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * The tasks wait on what they need rather than polling for it: interrupts
+ * hand over data through stream buffers and rings, and wake tasks with
+ * direct notifications or semaphores. Every task's wake-up latency, from
+ * being made ready to running, is timed with the cycle counter from the
+ * kernel's trace hooks (see FreeRTOSConfig.h), so the worst case for the
+ * planner can be read back with forgeTaskLatencies. The same counter tells
+ * how much of the CPU each task and interrupt takes (profiler.c).
+ *
+ * The kernel has no heap: each task's stack and control block are arrays
+ * next to its code, handed over by forgeCreateTask, which also adds the
+ * stack to the memory map (memory.c).
+ */
+
+#include "scheduler.h"
+#include "forge.h"
+#include "memory.h"
+#include "profiler.h"
+#include "trace.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/stream_buffer.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+static PIDControlConfig *_heaters[FORGE_MAX_HEATERS];
+static uint8_t _heaterCount = 0;
+static NeoPixelEffects *_effects = NULL;
+static StreamBufferHandle_t _comms = NULL;
+static TaskHandle_t _commsTask = NULL;
+
+static StaticStreamBuffer_t _commsBuffer;
+static uint8_t _commsStorage[FORGE_COMMS_BUFFER + 1]; // A stream buffer keeps one byte spare
+static StackType_t _heaterStack[FORGE_STACK_HEATER];
+static StaticTask_t _heaterTcb;
+static StackType_t _commsStack[FORGE_STACK_COMMS];
+static StaticTask_t _commsTcb;
+static StackType_t _ledStack[FORGE_STACK_LED];
+static StaticTask_t _ledTcb;
+static StackType_t _idleStack[configMINIMAL_STACK_SIZE];
+static StaticTask_t _idleTcb;
+
+// Cycle count at which each task was made ready, 0 once it has run. Only
+// touched from the kernel's trace hooks, which run inside its critical
+// sections or from PendSV.
+static uint32_t _readySince[FORGE_MAX_TASKS];
+static ForgeTaskLatency _latencies[FORGE_MAX_TASKS];
+static bool _tracing = false;
+
+/**
+ * @brief  Creates a task in memory the caller set aside for it, and adds its stack to the memory map.
+ * @param[in]  code is the task's function, which is passed NULL.
+ * @param[in]  name names it, in the kernel and in the map.
+ * @param[in]  stackDepth is its stack size in words, a FORGE_STACK_ value.
+ * @param[in]  priority is a FORGE_PRIO_ value.
+ * @param[in]  stack is an array of stackDepth words, which the task keeps.
+ * @param[in]  tcb is its control block, which it also keeps.
+ * @retval The task's handle.
+ * @headerfile scheduler.h
+ */
+TaskHandle_t forgeCreateTask(TaskFunction_t code, const char *name, uint32_t stackDepth, UBaseType_t priority,
+                             StackType_t *stack, StaticTask_t *tcb)
+{
+    forgeMemoryAdd(name, stack, stackDepth * sizeof(StackType_t));
+    return xTaskCreateStatic(code, name, stackDepth, NULL, priority, stack, tcb);
+}
+
+/**
+ * @brief  Registers a heater to be stepped by the heater task. Must be called before forgeStartScheduler.
+ * @param[in]  heater is an initialized controller.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeAddHeater(PIDControlConfig *heater)
+{
+    if (_heaterCount < FORGE_MAX_HEATERS)
+    {
+        _heaters[_heaterCount++] = heater;
+    }
+}
+
+/**
+ * @brief  Sets the effects engine rendered by the LED task, or NULL for none. Must be called before forgeStartScheduler.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeSetEffects(NeoPixelEffects *fx)
+{
+    _effects = fx;
+}
+
+static void _heaterTask(void *arg)
+{
+    (void)arg;
+    TickType_t last = xTaskGetTickCount();
+    for (;;)
+    {
+        // Fixed rate rather than fixed delay, so the PID sample time doesn't drift with load
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(FORGE_HEATER_PERIOD_MS));
+        for (uint8_t i = 0; i < _heaterCount; i++)
+        {
+            PIDControlConfig *heater = _heaters[i];
+            singleStepController(heater);
+            const ThermistorConfig *therm = heater->thermistorCfg;
+            traceEvent(TRACE_ADC, (therm->Therm_ADC_Channel << 16) | (therm->_uhADCxConvertedValue & 0xFFFFU));
+            traceEvent(TRACE_HEATER, traceHeater(i, heater->lastOutput, heater->lastTemp));
+            forgeHeaterStepped(i, heater);
+        }
+    }
+}
+
+/**
+ * @brief  Hands the bytes the link queued to forgeCommsReceive. Sleeps on its notification rather than in the stream buffer, so forgeCommsWake can run it with nothing queued.
+ */
+static void _commsRun(void *arg)
+{
+    (void)arg;
+    uint8_t data[FORGE_COMMS_CHUNK];
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        forgeCommsWoken();
+        size_t n;
+        while ((n = xStreamBufferReceive(_comms, data, sizeof(data), 0)) > 0)
+            forgeCommsReceive(data, n);
+        forgeCommsDrained();
+    }
+}
+
+static void _ledTask(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        forgeEffectsFrame(_effects);
+        NPfxTick(_effects);
+        vTaskDelay(pdMS_TO_TICKS(_effects->frameMs));
+    }
+}
+
+/**
+ * @brief  Queues bytes from the command link, e.g. the USB CDC port's receive, for the comms task. Doesn't wait for room. Call from a task; only one may feed it.
+ * @param[in]  data is the bytes received.
+ * @param[in]  length is how many there are.
+ * @retval How many were queued. The link keeps the rest and offers them again once forgeCommsDrained is called.
+ * @headerfile scheduler.h
+ */
+size_t forgeCommsSend(const uint8_t *data, size_t length)
+{
+    if (_comms == NULL)
+        return 0;
+    size_t n = xStreamBufferSend(_comms, data, length, 0);
+    if (n > 0)
+        xTaskNotifyGive(_commsTask);
+    return n;
+}
+
+/**
+ * @brief  Like forgeCommsSend, for a link that receives in an interrupt, e.g. a UART's. Call at or below configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ * @retval How many were queued; the rest didn't fit and are lost.
+ * @headerfile scheduler.h
+ */
+size_t forgeCommsFromISR(const uint8_t *data, size_t length)
+{
+    if (_comms == NULL)
+        return 0;
+    BaseType_t woken = pdFALSE;
+    size_t n = xStreamBufferSendFromISR(_comms, data, length, &woken);
+    if (n > 0)
+        vTaskNotifyGiveFromISR(_commsTask, &woken);
+    portYIELD_FROM_ISR(woken);
+    return n;
+}
+
+/**
+ * @brief  Runs the comms task once without queueing anything, e.g. for the link to act on an event in order with its input. Call from a task.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeCommsWake(void)
+{
+    if (_commsTask != NULL)
+        xTaskNotifyGive(_commsTask);
+}
+
+/**
+ * @brief  Called from the comms task each time it wakes, before any of the bytes. The default does nothing.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+__weak void forgeCommsWoken(void)
+{
+}
+
+/**
+ * @brief  Called from the comms task with the bytes the link queued, in order, in pieces of up to FORGE_COMMS_CHUNK that may split lines. Override it to run them; the default drops them.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+__weak void forgeCommsReceive(const uint8_t *data, size_t length)
+{
+    (void)data;
+    (void)length;
+}
+
+/**
+ * @brief  Called from the comms task once it has handed over everything queued, e.g. to flush the replies and let the link queue what didn't fit. The default does nothing.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+__weak void forgeCommsDrained(void)
+{
+}
+
+/**
+ * @brief  Called from the heater task after each heater is stepped, e.g. to log lastTemp and lastOutput. The default does nothing.
+ * @param[in]  index is the order the heater was added in.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+__weak void forgeHeaterStepped(uint8_t index, const PIDControlConfig *heater)
+{
+    (void)index;
+    (void)heater;
+}
+
+/**
+ * @brief  Called from the LED task before each frame, to give the effects their readings: NPfxSetProgress, NPfxSetTemperature. The default does nothing.
+ * @param[in]  fx is the engine set with forgeSetEffects.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+__weak void forgeEffectsFrame(NeoPixelEffects *fx)
+{
+    (void)fx;
+}
+
+/**
+ * @brief  Creates the firmware tasks and hands control to the scheduler. Call once, after forgeInitHAL and the module inits.
+ * @retval Never returns unless the tasks couldn't be created.
+ * @headerfile scheduler.h
+ */
+void forgeStartScheduler(void)
+{
+    // The cycle counter times wake-ups; it only runs with trace enabled
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    // Tasks made before now, mostly by the module inits, would count the
+    // time until the scheduler starts
+    memset(_readySince, 0, sizeof(_readySince));
+    _tracing = true;
+    profileStart();
+
+    // Senders wake the task themselves, so the trigger level doesn't matter
+    forgeMemoryAdd("comms rx", _commsStorage, sizeof(_commsStorage));
+    _comms = xStreamBufferCreateStatic(FORGE_COMMS_BUFFER, 1, _commsStorage, &_commsBuffer);
+    if (_heaterCount > 0)
+    {
+        forgeCreateTask(_heaterTask, "heat", FORGE_STACK_HEATER, FORGE_PRIO_HEATER, _heaterStack, &_heaterTcb);
+    }
+    _commsTask = forgeCreateTask(_commsRun, "comms", FORGE_STACK_COMMS, FORGE_PRIO_COMMS, _commsStack, &_commsTcb);
+    if (_effects != NULL)
+    {
+        forgeCreateTask(_ledTask, "led", FORGE_STACK_LED, FORGE_PRIO_LED, _ledStack, &_ledTcb);
+    }
+
+    vTaskStartScheduler();
+}
+
+/**
+ * @brief  Called by the kernel as a task is made ready to run. Never call it directly.
+ * @param[in]  number is the task's number, counting from 1 in the order tasks were created.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeTraceReady(uint32_t number)
+{
+    uint32_t i = number - 1U;
+    if (!_tracing || i >= FORGE_MAX_TASKS)
+        return;
+    // Never 0, which means it has run
+    _readySince[i] = DWT->CYCCNT | 1U;
+}
+
+/**
+ * @brief  Called by the kernel as a task is switched in. Only its first run after being made ready counts; running again after being preempted doesn't. Never call it directly.
+ * @param[in]  number is the task's number.
+ * @param[in]  task is its handle.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeTraceSwitchedIn(uint32_t number, void *task)
+{
+    uint32_t i = number - 1U;
+    if (i >= FORGE_MAX_TASKS || _readySince[i] == 0)
+        return;
+    // Without the marker bit, or a task run at once would wrap to UINT32_MAX
+    uint32_t cycles = DWT->CYCCNT - (_readySince[i] & ~1U);
+    _readySince[i] = 0;
+
+    ForgeTaskLatency *latency = &_latencies[i];
+    latency->task = (TaskHandle_t)task;
+    latency->wakeups++;
+    latency->lastCycles = cycles;
+    if (cycles > latency->worstCycles)
+        latency->worstCycles = cycles;
+}
+
+/**
+ * @brief  Copies the wake-up latency of every task that has run, in the order they were created. Divide cycles by SystemCoreClock / 1000000 for microseconds.
+ * @param[out]  latencies receives the entries.
+ * @param[in]  max is how many fit.
+ * @retval The number of entries copied.
+ * @headerfile scheduler.h
+ */
+uint8_t forgeTaskLatencies(ForgeTaskLatency *latencies, uint8_t max)
+{
+    uint8_t n = 0;
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < FORGE_MAX_TASKS && n < max; i++)
+    {
+        if (_latencies[i].task != NULL)
+            latencies[n++] = _latencies[i];
+    }
+    taskEXIT_CRITICAL();
+    return n;
+}
+
+/**
+ * @brief  Clears the worst cases and counts, e.g. once startup is over, keeping which task is which.
+ * @retval None
+ * @headerfile scheduler.h
+ */
+void forgeResetTaskLatencies(void)
+{
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < FORGE_MAX_TASKS; i++)
+    {
+        _latencies[i].wakeups = 0;
+        _latencies[i].worstCycles = 0;
+        _latencies[i].lastCycles = 0;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
+{
+    (void)xTask;
+    (void)pcTaskName;
+    // Nothing sensible to recover; stop here so a debugger shows the culprit
+    __disable_irq();
+    for (;;)
+        ;
+}
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
+{
+    forgeMemoryAdd("idle", _idleStack, sizeof(_idleStack));
+    *ppxIdleTaskTCBBuffer = &_idleTcb;
+    *ppxIdleTaskStackBuffer = _idleStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
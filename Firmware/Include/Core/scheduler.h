@@ -0,0 +1,103 @@
+/**
+ * @file scheduler.h
+ * @brief Task layout of the Forge firmware on top of FreeRTOS.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_SCHEDULER_H
+#define __FORGE_SCHEDULER_H
+
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../Temperature/control.h"
+#include "../Neopixel/effects.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Step pulses come from the motion timer interrupt, above all of these. The
+// SD reader preempts everything so a free buffer is refilled at once; the
+// heaters preempt the tasks that parse and plan, but only briefly, and so
+// does the USB task, which does what the OTG interrupt would in short bursts.
+// Whatever feeds the planner runs right below those: the print task, and the
+// comms task for G-code streamed over USB. Nothing else can starve it, however
+// busy the network or a push get.
+// The power-loss journal only copies a few hundred bytes to backup SRAM, and
+// shares the next level with the network stack.
+// LEDs are purely cosmetic and run last. So do writes of pushed files,
+// below the network task that fills them, as flash programming spins there
+// waiting for gaps in the stepping.
+#define FORGE_PRIO_STORAGE (configMAX_PRIORITIES - 1)
+#define FORGE_PRIO_HEATER (configMAX_PRIORITIES - 2)
+#define FORGE_PRIO_USB (configMAX_PRIORITIES - 2)
+#define FORGE_PRIO_PLANNER (configMAX_PRIORITIES - 3)
+#define FORGE_PRIO_COMMS (configMAX_PRIORITIES - 3)
+#define FORGE_PRIO_JOURNAL (tskIDLE_PRIORITY + 2)
+#define FORGE_PRIO_NET (tskIDLE_PRIORITY + 2)
+#define FORGE_PRIO_LED (tskIDLE_PRIORITY + 1)
+#define FORGE_PRIO_PUSH (tskIDLE_PRIORITY + 1)
+
+#define FORGE_STACK_STORAGE 512 // FatFs
+#define FORGE_STACK_HEATER 512  // readTemperature/singleStepController use floats
+#define FORGE_STACK_PLANNER 512
+#define FORGE_STACK_JOURNAL 256
+#define FORGE_STACK_USB 512 // The class drivers and SCSI nest a few calls deep
+#define FORGE_STACK_MSC 256
+#define FORGE_STACK_COMMS 512 // Runs G-code, like the print task
+#define FORGE_STACK_NET 768  // LwIP's input path and its callbacks
+#define FORGE_STACK_LED 256
+#define FORGE_STACK_PUSH 512 // FatFs
+
+#define FORGE_HEATER_PERIOD_MS 100
+#define FORGE_MAX_HEATERS 3
+// Bytes the command link can hand the comms task before it has to catch up
+#define FORGE_COMMS_BUFFER 256
+#define FORGE_COMMS_CHUNK 64
+// Tasks whose wake-up latency is kept, numbered in the order they were
+// created; the firmware has about a dozen
+#define FORGE_MAX_TASKS 16
+
+    /**
+     * @brief How long a task took to run once it was ready to: after a notification, a semaphore or the end of a delay. For the tasks that feed the planner, the worst case is how far the motion queue can drain before they get to refill it.
+     */
+    typedef struct
+    {
+        TaskHandle_t task;    // NULL for an entry no task has used yet
+        uint32_t wakeups;
+        uint32_t worstCycles; // CPU cycles (SystemCoreClock) from ready to running
+        uint32_t lastCycles;
+    } ForgeTaskLatency;
+
+    TaskHandle_t forgeCreateTask(TaskFunction_t code, const char *name, uint32_t stackDepth, UBaseType_t priority,
+                                 StackType_t *stack, StaticTask_t *tcb);
+    void forgeAddHeater(PIDControlConfig *heater);
+    void forgeSetEffects(NeoPixelEffects *fx);
+    void forgeStartScheduler(void);
+
+    size_t forgeCommsSend(const uint8_t *data, size_t length);
+    size_t forgeCommsFromISR(const uint8_t *data, size_t length);
+    void forgeCommsWake(void);
+    void forgeCommsWoken(void);
+    void forgeCommsReceive(const uint8_t *data, size_t length);
+    void forgeCommsDrained(void);
+    void forgeHeaterStepped(uint8_t index, const PIDControlConfig *heater);
+    void forgeEffectsFrame(NeoPixelEffects *fx);
+
+    uint8_t forgeTaskLatencies(ForgeTaskLatency *latencies, uint8_t max);
+    void forgeResetTaskLatencies(void);
+    void forgeTraceReady(uint32_t number);
+    void forgeTraceSwitchedIn(uint32_t number, void *task);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SCHEDULER_H */
@@ -0,0 +1,67 @@
+/**
+ * @file trace.c
+ * @brief Timestamped binary trace events out of the SWO pin, through the ITM: motion segments, planned speeds, heaters and ADC readings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * A trace point is one store to an ITM stimulus port (traceEvent), a few
+ * cycles, and the ITM does the rest: it adds a timestamp in core cycles
+ * and shifts the packets out of PB3 while the core gets on with it. Nothing
+ * is formatted and nothing waits, so the points can sit in the step
+ * interrupt. The firmware sets up the ITM and the SWO pin itself, so any
+ * probe that captures SWO as a UART at TRACE_SWO_BAUD can record it, the
+ * Forge's own DAP included; Core/host/swotrace.c turns a capture into a
+ * timeline for chrome://tracing or Perfetto.
+ */
+
+#include "trace.h"
+#include "forge.h"
+
+Trace TRACE;
+
+/**
+ * @brief  Routes the ITM out of the SWO pin (PB3) as a UART and enables the trace ports, with a local timestamp on each event. A debugger that sets up trace itself overrides this, and a probe that isn't capturing costs nothing but the dropped events.
+ * @param[in]  baud is the SWO rate; it must divide SystemCoreClock.
+ * @retval None
+ * @headerfile trace.h
+ */
+void traceInit(uint32_t baud)
+{
+    forgeInitHAL();
+    TRACE.baud = baud;
+    TRACE.dropped = 0;
+#if FORGE_TRACE
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    // Asynchronous trace, so only TRACESWO is taken from the GPIOs
+    DBGMCU->CR = (DBGMCU->CR & ~DBGMCU_CR_TRACE_MODE) | DBGMCU_CR_TRACE_IOEN;
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = GPIO_PIN_3;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF0_TRACE;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    // NRZ, without the formatter, so the pin carries the bare ITM packets
+    TPI->SPPR = 2U;
+    TPI->ACPR = SystemCoreClock / baud - 1U;
+    TPI->FFCR = 0x100U;
+
+    // Sync packets every 2^24 cycles let a decoder find its way into a
+    // stream it joined halfway
+    DWT->CTRL = (DWT->CTRL & ~DWT_CTRL_SYNCTAP_Msk) | (1UL << DWT_CTRL_SYNCTAP_Pos) | DWT_CTRL_CYCCNTENA_Msk;
+
+    ITM->LAR = 0xC5ACCE55U;
+    ITM->TCR = 0;
+    while (ITM->TCR & ITM_TCR_BUSY_Msk)
+        ;
+    // Timestamps count core cycles, undivided
+    ITM->TCR = (1UL << ITM_TCR_TraceBusID_Pos) | ITM_TCR_SYNCENA_Msk | ITM_TCR_TSENA_Msk | ITM_TCR_ITMENA_Msk;
+    ITM->TPR = 0;
+    ITM->TER = (1UL << TRACE_PORTS) - 1U;
+#endif
+}
@@ -0,0 +1,106 @@
+/**
+ * @file trace.h
+ * @brief Timestamped binary trace events out of the SWO pin, through the ITM: motion segments, planned speeds, heaters and ADC readings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_TRACE_H
+#define __FORGE_TRACE_H
+
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Build with 0 to leave every trace point out
+#ifndef FORGE_TRACE
+#define FORGE_TRACE 1
+#endif
+
+// SWO runs as a UART off the core clock: 168MHz / 84. Any rate that divides
+// the core clock will do, up to what the probe takes (the DAP firmware's
+// SWO_UART_MAX_BAUDRATE).
+#define TRACE_SWO_BAUD 2000000U
+
+    /**
+     * @brief What each stimulus port carries: one 32 bit word an event, written in one go so an event is never torn. Port 0 is left for text, as ITM_SendChar uses it. Core/host/swotrace.c decodes them.
+     */
+    typedef enum
+    {
+        TRACE_SEGMENT_START = 1, // Segment tag, as the step interrupt starts it
+        TRACE_SEGMENT_END = 2,   // Segment tag, as its last step goes out
+        TRACE_SPEED = 3,         // Planned speed of the segment just queued, mm/s as a float's bits
+        TRACE_HEATER = 4,        // Index << 30 | duty in 0.1% << 20 | temperature in 0.1C
+        TRACE_ADC = 5,           // ADC channel << 16 | reading
+        TRACE_UNDERRUN = 6,      // Segments completed when the queue ran dry mid-stream
+        TRACE_PORTS
+    } TracePort;
+
+    typedef struct
+    {
+        uint32_t baud;
+        volatile uint32_t dropped; // Events the ITM had no room for
+    } Trace;
+
+    extern Trace TRACE;
+
+    void traceInit(uint32_t baud);
+
+    /**
+     * @brief  Sends one event, timestamped by the ITM, if the port is enabled. Never waits: with the ITM's FIFO full, e.g. no probe or a slow one, the event is dropped and counted. Safe from any interrupt, including the step interrupt.
+     * @param[in]  port says what it is.
+     * @param[in]  word is its payload.
+     * @retval None
+     */
+    __STATIC_FORCEINLINE void traceEvent(TracePort port, uint32_t word)
+    {
+#if FORGE_TRACE
+        if ((ITM->TER & (1UL << port)) == 0)
+            return;
+        // Reads as 1 while the FIFO has room
+        if (ITM->PORT[port].u32 == 0UL)
+        {
+            TRACE.dropped++;
+            return;
+        }
+        ITM->PORT[port].u32 = word;
+#else
+        (void)port;
+        (void)word;
+#endif
+    }
+
+    /**
+     * @brief  Packs a heater's state for TRACE_HEATER.
+     * @param[in]  index is the heater, 0-3.
+     * @param[in]  duty is 0 to 1; anything outside is clamped, as the PWM does.
+     * @param[in]  temperature is in C, 0 to 104857.
+     * @retval The payload.
+     */
+    __STATIC_FORCEINLINE uint32_t traceHeater(uint8_t index, float duty, float temperature)
+    {
+        if (!(duty > 0.0f))
+            duty = 0.0f;
+        if (duty > 1.0f)
+            duty = 1.0f;
+        if (!(temperature > 0.0f))
+            temperature = 0.0f;
+        if (temperature > 104857.0f)
+            temperature = 104857.0f;
+        return ((uint32_t)index << 30) | ((uint32_t)(duty * 1000.0f + 0.5f) << 20) |
+               (uint32_t)(temperature * 10.0f + 0.5f);
+    }
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_TRACE_H */
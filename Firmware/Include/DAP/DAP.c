@@ -77,6 +77,9 @@ static void Set_Clock_Delay(uint32_t clock) {
 
     DAP_Data.clock_delay = delay;
   }
+#if ((DAP_SWD != 0) && (DAP_SWD_SPI != 0))
+  SWD_SPI_Clock(clock);
+#endif
 }
 
 
@@ -1805,8 +1808,8 @@ void DAP_Setup(void) {
   DAP_Data.jtag_dev.count = 0U;
 #endif
 
+  DAP_SETUP();  // Device specific setup, first: it clocks the SWD SPI
+
   // Sets DAP_Data.fast_clock and DAP_Data.clock_delay.
   Set_Clock_Delay(DAP_DEFAULT_SWJ_CLOCK);
-
-  DAP_SETUP();  // Device specific setup
 }
@@ -274,6 +274,7 @@ extern "C"
 
 // Functions
 extern void     SWJ_Sequence    (uint32_t count, const uint8_t *data);
+extern void     SWD_SPI_Clock   (uint32_t clock);
 extern void     SWD_Sequence    (uint32_t info,  const uint8_t *swdo, uint8_t *swdi);
 extern void     JTAG_Sequence   (uint32_t info,  const uint8_t *tdi,  uint8_t *tdo);
 extern void     JTAG_IR         (uint32_t ir);
@@ -308,12 +309,26 @@ extern uint32_t SWO_Control_Manchester  (uint32_t active);
 extern void     SWO_Capture_Manchester  (uint8_t *buf, uint32_t num);
 extern uint32_t SWO_GetCount_Manchester (void);
 
+// Forge: SWO capture interrupts, trace buffer and streaming task
+extern void     SWO_Setup                     (void);
+extern void     SWO_UART_DMA_IRQHandler       (void);
+extern void     SWO_UART_IRQHandler           (void);
+extern void     SWO_Manchester_DMA_IRQHandler (void);
+extern void     SWO_Manchester_TIM_IRQHandler (void);
+extern __NO_RETURN void SWO_Thread            (void *argument);
+
 extern uint32_t UART_Transport (const uint8_t *request, uint8_t *response);
 extern uint32_t UART_Configure (const uint8_t *request, uint8_t *response);
 extern uint32_t UART_Control   (const uint8_t *request, uint8_t *response);
 extern uint32_t UART_Status                            (uint8_t *response);
 extern uint32_t UART_Transfer  (const uint8_t *request, uint8_t *response);
 
+// Forge: UART interrupts and buffers
+extern void     UART_Setup              (void);
+extern void     UART_RX_DMA_IRQHandler  (void);
+extern void     UART_TX_DMA_IRQHandler  (void);
+extern void     UART_IRQHandler         (void);
+
 extern uint8_t  USB_COM_PORT_Activate (uint32_t cmd);
 
 extern uint32_t DAP_ProcessVendorCommand (const uint8_t *request, uint8_t *response);
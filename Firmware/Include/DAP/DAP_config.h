@@ -48,12 +48,12 @@ This information includes:
 #include "RTE_Components.h"
 #include CMSIS_device_header
 #else
-#include "device.h"                             // Debug Unit Cortex-M Processor Header File
+#include "../HAL/stm32f4xx_hal.h"               // Debug Unit Cortex-M Processor Header File
 #endif
 
 /// Processor Clock of the Cortex-M MCU used in the Debug Unit.
 /// This value is used to calculate the SWD/JTAG clock speed.
-#define CPU_CLOCK               100000000U      ///< Specifies the CPU Clock in Hz.
+#define CPU_CLOCK               168000000U      ///< Specifies the CPU Clock in Hz.
 
 /// Number of processor cycles for I/O Port write operations.
 /// This value is used to calculate the SWD/JTAG clock speed that is generated with I/O
@@ -69,7 +69,12 @@ This information includes:
 
 /// Indicate that JTAG communication mode is available at the Debug Port.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
-#define DAP_JTAG                1               ///< JTAG Mode: 1 = available, 0 = not available.
+/// The Forge's probe port only brings out SWD.
+#define DAP_JTAG                0               ///< JTAG Mode: 1 = available, 0 = not available.
+
+/// Shift the SWD request and data phases with SPI2, leaving only the turnaround, ACK and parity
+/// bits to GPIO (SW_DP.c). Clocks below what SPI2 can divide down to are bit-banged throughout.
+#define DAP_SWD_SPI             1               ///< SWD by SPI: 1 = SPI2 and GPIO, 0 = GPIO only.
 
 /// Configure maximum number of JTAG devices on the scan chain connected to the Debug Access Port.
 /// This setting impacts the RAM requirements of the Debug Unit. Valid range is 1 .. 255.
@@ -88,53 +93,77 @@ This information includes:
 /// This configuration settings is used to optimize the communication performance with the
 /// debugger and depends on the USB peripheral. Typical vales are 64 for Full-speed USB HID or WinUSB,
 /// 1024 for High-speed USB HID and 512 for High-speed USB WinUSB.
-#define DAP_PACKET_SIZE         512U            ///< Specifies Packet Size in bytes.
+/// The Forge's USB runs at full speed, so its WinUSB endpoints carry 64 bytes.
+#define DAP_PACKET_SIZE         64U             ///< Specifies Packet Size in bytes.
 
 /// Maximum Package Buffers for Command and Response data.
 /// This configuration settings is used to optimize the communication performance with the
 /// debugger and depends on the USB peripheral. For devices with limited RAM or USB buffer the
 /// setting can be reduced (valid range is 1 .. 255).
+/// usb_dap.c receives this many ahead, so the host can pipeline DAP_TransferBlock packets:
+/// the next is already in while one runs and the response before it goes out.
 #define DAP_PACKET_COUNT        8U              ///< Specifies number of packets buffered.
 
 /// Indicate that UART Serial Wire Output (SWO) trace is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
 #define SWO_UART                1               ///< SWO UART:  1 = available, 0 = not available.
 
-/// USART Driver instance number for the UART SWO.
-#define SWO_UART_DRIVER         0               ///< USART Driver instance number (Driver_USART#).
+/// Pin the SWO is captured on, by USART6 RX (AF8) as a UART or TIM8 CH2 (AF3) as Manchester.
+/// SWO.c drives them directly rather than through a USART driver.
+#define SWO_GPIO_PORT           GPIOC           ///< SWO input port.
+#define SWO_GPIO_PIN            GPIO_PIN_7      ///< SWO input pin.
+
+/// Priority of the SWO capture interrupts; below the step interrupt, within FreeRTOS' reach.
+#define SWO_IRQ_PRIORITY        6U              ///< NVIC priority of the SWO DMA, USART and timer interrupts.
 
 /// Maximum SWO UART Baudrate.
+/// USART6 oversampling by 8 off the 84MHz APB2 clock tops out at 10.5MBaud.
 #define SWO_UART_MAX_BAUDRATE   10000000U       ///< SWO UART Maximum Baudrate in Hz.
 
 /// Indicate that Manchester Serial Wire Output (SWO) trace is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
-#define SWO_MANCHESTER          0               ///< SWO Manchester:  1 = available, 0 = not available.
+#define SWO_MANCHESTER          1               ///< SWO Manchester:  1 = available, 0 = not available.
+
+/// Maximum SWO Manchester Baudrate: every edge is an interrupt-decoded DMA capture.
+#define SWO_MANCHESTER_MAX_BAUDRATE 1000000U    ///< SWO Manchester Maximum Baudrate in Hz.
 
 /// SWO Trace Buffer Size.
-#define SWO_BUFFER_SIZE         4096U           ///< SWO Trace Buffer Size in bytes (must be 2^n).
+#define SWO_BUFFER_SIZE         16384U          ///< SWO Trace Buffer Size in bytes (must be 2^n).
 
 /// SWO Streaming Trace.
+/// Needs a third bulk endpoint, which OTG_FS has no IN endpoint left for (Usb/usbd_conf.h);
+/// the host reads the trace with DAP_SWO_Data instead.
 #define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
-#define TIMESTAMP_CLOCK         100000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
+#define TIMESTAMP_CLOCK         168000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
 
 /// Indicate that UART Communication Port is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
 #define DAP_UART                1               ///< DAP UART:  1 = available, 0 = not available.
 
-/// USART Driver instance number for the UART Communication Port.
-#define DAP_UART_DRIVER         1               ///< USART Driver instance number (Driver_USART#).
+/// Pins of the UART Communication Port: USART1 (AF7), TX on PA9 and RX on PA10. USART1's
+/// other pins, PB6/PB7, are the screen's I2C; PA9 and PA10 are OTG_FS's VBUS and ID, which
+/// the self-powered device port leaves unused (Usb/usbd_conf.c).
+#define DAP_UART_GPIO_PORT      GPIOA           ///< UART port.
+#define DAP_UART_TX_PIN         GPIO_PIN_9      ///< UART TX pin, to the target's RX.
+#define DAP_UART_RX_PIN         GPIO_PIN_10     ///< UART RX pin, from the target's TX.
 
-/// UART Receive Buffer Size.
-#define DAP_UART_RX_BUFFER_SIZE 1024U           ///< Uart Receive Buffer Size in bytes (must be 2^n).
+/// Priority of the UART interrupts; with the SWO's, under FreeRTOS's syscall limit.
+#define DAP_UART_IRQ_PRIORITY   6U              ///< UART interrupt priority.
+
+/// Maximum UART Baudrate: PCLK2 / 16.
+#define DAP_UART_MAX_BAUDRATE   5250000U        ///< UART Maximum Baudrate in Hz.
+
+/// UART Receive Buffer Size. At 3MBaud this is 27ms of data between the host's reads.
+#define DAP_UART_RX_BUFFER_SIZE 8192U           ///< Uart Receive Buffer Size in bytes (must be 2^n).
 
 /// UART Transmit Buffer Size.
-#define DAP_UART_TX_BUFFER_SIZE 1024U           ///< Uart Transmit Buffer Size in bytes (must be 2^n).
+#define DAP_UART_TX_BUFFER_SIZE 4096U           ///< Uart Transmit Buffer Size in bytes (must be 2^n).
 
 /// Indicate that UART Communication via USB COM Port is available.
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
-#define DAP_UART_USB_COM_PORT   1               ///< USB COM Port:  1 = available, 0 = not available.
+#define DAP_UART_USB_COM_PORT   0               ///< USB COM Port:  1 = available, 0 = not available.
 
 /// Debug Unit is connected to fixed Target Device.
 /// The Debug Unit may be part of an evaluation board and always connected to a fixed
@@ -298,6 +327,43 @@ of the same I/O port. The following SWDIO I/O Pin functions are provided:
 */
 
 
+// Forge probe port -------------------------------------
+//
+// SWCLK  PB13, SPI2_SCK (AF5)
+// SWDIO  PB15, SPI2_MOSI (AF5), driving the line, and PB14, SPI2_MISO (AF5),
+//        reading it: both pins are wired to SWDIO, and PB15 is let go to
+//        input whenever the target drives it
+// nRESET PB12, open drain with a pull-up
+//
+// PB14 stays on SPI2 throughout, and reads the same through IDR. PB13 and
+// PB15 are GPIO outputs between SPI phases, so each switch is a single MODER
+// write; their output latches are kept at SWD's idle level, high, which is
+// where SPI2 (CPOL = 1) leaves the clock too. PB12-PB15 are free header
+// pins, with USB on PA11/PA12, so nothing else on the board uses them.
+
+#define SWD_SPI                 SPI2
+#define SWCLK_PORT              GPIOB
+#define SWCLK_PIN               13U
+#define SWDIO_PORT              GPIOB
+#define SWDIO_PIN               15U             ///< Drives the line
+#define SWDIO_IN_PIN            14U             ///< Reads it
+#define nRESET_PORT             GPIOB
+#define nRESET_PIN              12U
+
+#define PIN_MODE_INPUT          0U
+#define PIN_MODE_OUTPUT         1U
+#define PIN_MODE_AF             2U
+
+/** Switch a pin's mode without touching its configuration otherwise.
+\param port GPIO port.
+\param pin  pin number.
+\param mode PIN_MODE_INPUT, PIN_MODE_OUTPUT or PIN_MODE_AF.
+*/
+__STATIC_FORCEINLINE void PIN_MODE (GPIO_TypeDef *port, uint32_t pin, uint32_t mode) {
+  port->MODER = (port->MODER & ~(3UL << (2U*pin))) | (mode << (2U*pin));
+}
+
+
 // Configure DAP I/O pins ------------------------------
 
 /** Setup JTAG I/O pins: TCK, TMS, TDI, TDO, nTRST, and nRESET.
@@ -306,7 +372,7 @@ Configures the DAP Hardware I/O pins for JTAG mode:
  - TDO to input mode.
 */
 __STATIC_INLINE void PORT_JTAG_SETUP (void) {
-  ;
+  ;                             // No JTAG on the Forge's port
 }
 
 /** Setup SWD I/O pins: SWCLK, SWDIO, and nRESET.
@@ -315,7 +381,12 @@ Configures the DAP Hardware I/O pins for Serial Wire Debug (SWD) mode:
  - TDI, nTRST to HighZ mode (pins are unused in SWD mode).
 */
 __STATIC_INLINE void PORT_SWD_SETUP (void) {
-  ;
+  SWCLK_PORT->BSRR  = 1UL << SWCLK_PIN;
+  SWDIO_PORT->BSRR  = 1UL << SWDIO_PIN;
+  nRESET_PORT->BSRR = 1UL << nRESET_PIN;
+  PIN_MODE(SWCLK_PORT,  SWCLK_PIN,  PIN_MODE_OUTPUT);
+  PIN_MODE(SWDIO_PORT,  SWDIO_PIN,  PIN_MODE_OUTPUT);
+  PIN_MODE(nRESET_PORT, nRESET_PIN, PIN_MODE_OUTPUT);
 }
 
 /** Disable JTAG/SWD I/O Pins.
@@ -323,7 +394,9 @@ Disables the DAP Hardware I/O pins which configures:
  - TCK/SWCLK, TMS/SWDIO, TDI, TDO, nTRST, nRESET to High-Z mode.
 */
 __STATIC_INLINE void PORT_OFF (void) {
-  ;
+  PIN_MODE(SWCLK_PORT,  SWCLK_PIN,  PIN_MODE_INPUT);
+  PIN_MODE(SWDIO_PORT,  SWDIO_PIN,  PIN_MODE_INPUT);
+  PIN_MODE(nRESET_PORT, nRESET_PIN, PIN_MODE_INPUT);
 }
 
 
@@ -333,21 +406,21 @@ __STATIC_INLINE void PORT_OFF (void) {
 \return Current status of the SWCLK/TCK DAP hardware I/O pin.
 */
 __STATIC_FORCEINLINE uint32_t PIN_SWCLK_TCK_IN  (void) {
-  return (0U);
+  return ((SWCLK_PORT->IDR >> SWCLK_PIN) & 1U);
 }
 
 /** SWCLK/TCK I/O pin: Set Output to High.
 Set the SWCLK/TCK DAP hardware I/O pin to high level.
 */
 __STATIC_FORCEINLINE void     PIN_SWCLK_TCK_SET (void) {
-  ;
+  SWCLK_PORT->BSRR = 1UL << SWCLK_PIN;
 }
 
 /** SWCLK/TCK I/O pin: Set Output to Low.
 Set the SWCLK/TCK DAP hardware I/O pin to low level.
 */
 __STATIC_FORCEINLINE void     PIN_SWCLK_TCK_CLR (void) {
-  ;
+  SWCLK_PORT->BSRR = 1UL << (SWCLK_PIN + 16U);
 }
 
 
@@ -357,35 +430,35 @@ __STATIC_FORCEINLINE void     PIN_SWCLK_TCK_CLR (void) {
 \return Current status of the SWDIO/TMS DAP hardware I/O pin.
 */
 __STATIC_FORCEINLINE uint32_t PIN_SWDIO_TMS_IN  (void) {
-  return (0U);
+  return ((SWDIO_PORT->IDR >> SWDIO_IN_PIN) & 1U);
 }
 
 /** SWDIO/TMS I/O pin: Set Output to High.
 Set the SWDIO/TMS DAP hardware I/O pin to high level.
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_TMS_SET (void) {
-  ;
+  SWDIO_PORT->BSRR = 1UL << SWDIO_PIN;
 }
 
 /** SWDIO/TMS I/O pin: Set Output to Low.
 Set the SWDIO/TMS DAP hardware I/O pin to low level.
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_TMS_CLR (void) {
-  ;
+  SWDIO_PORT->BSRR = 1UL << (SWDIO_PIN + 16U);
 }
 
 /** SWDIO I/O pin: Get Input (used in SWD mode only).
 \return Current status of the SWDIO DAP hardware I/O pin.
 */
 __STATIC_FORCEINLINE uint32_t PIN_SWDIO_IN      (void) {
-  return (0U);
+  return ((SWDIO_PORT->IDR >> SWDIO_IN_PIN) & 1U);
 }
 
 /** SWDIO I/O pin: Set Output (used in SWD mode only).
 \param bit Output value for the SWDIO DAP hardware I/O pin.
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_OUT     (uint32_t bit) {
-  ;
+  SWDIO_PORT->BSRR = 1UL << (SWDIO_PIN + ((bit & 1U) ? 0U : 16U));
 }
 
 /** SWDIO I/O pin: Switch to Output mode (used in SWD mode only).
@@ -393,7 +466,7 @@ Configure the SWDIO DAP hardware I/O pin to output mode. This function is
 called prior \ref PIN_SWDIO_OUT function calls.
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_OUT_ENABLE  (void) {
-  ;
+  PIN_MODE(SWDIO_PORT, SWDIO_PIN, PIN_MODE_OUTPUT);
 }
 
 /** SWDIO I/O pin: Switch to Input mode (used in SWD mode only).
@@ -401,7 +474,7 @@ Configure the SWDIO DAP hardware I/O pin to input mode. This function is
 called prior \ref PIN_SWDIO_IN function calls.
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_OUT_DISABLE (void) {
-  ;
+  PIN_MODE(SWDIO_PORT, SWDIO_PIN, PIN_MODE_INPUT);
 }
 
 
@@ -456,7 +529,7 @@ __STATIC_FORCEINLINE void     PIN_nTRST_OUT  (uint32_t bit) {
 \return Current status of the nRESET DAP hardware I/O pin.
 */
 __STATIC_FORCEINLINE uint32_t PIN_nRESET_IN  (void) {
-  return (0U);
+  return ((nRESET_PORT->IDR >> nRESET_PIN) & 1U);
 }
 
 /** nRESET I/O pin: Set Output.
@@ -465,7 +538,7 @@ __STATIC_FORCEINLINE uint32_t PIN_nRESET_IN  (void) {
            - 1: release device hardware reset.
 */
 __STATIC_FORCEINLINE void     PIN_nRESET_OUT (uint32_t bit) {
-  ;
+  nRESET_PORT->BSRR = 1UL << (nRESET_PIN + ((bit & 1U) ? 0U : 16U));
 }
 
 ///@}
@@ -541,7 +614,30 @@ Status LEDs. In detail the operation of Hardware I/O and LED pins are enabled an
  - LED output pins are enabled and LEDs are turned off.
 */
 __STATIC_INLINE void DAP_SETUP (void) {
-  ;
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_SPI2_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  // Alternate functions first, so SW_DP.c only has to switch the mode
+  GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull      = GPIO_PULLUP;
+  GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = GPIO_AF5_SPI2;
+  GPIO_InitStruct.Pin       = 1UL << SWCLK_PIN;
+  HAL_GPIO_Init(SWCLK_PORT, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin       = (1UL << SWDIO_PIN) | (1UL << SWDIO_IN_PIN);
+  HAL_GPIO_Init(SWDIO_PORT, &GPIO_InitStruct);
+
+  nRESET_PORT->BSRR = 1UL << nRESET_PIN;
+  GPIO_InitStruct.Mode      = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_LOW;
+  GPIO_InitStruct.Alternate = 0U;
+  GPIO_InitStruct.Pin       = 1UL << nRESET_PIN;
+  HAL_GPIO_Init(nRESET_PORT, &GPIO_InitStruct);
+
+  PORT_OFF();
 }
 
 /** Reset Target Device with custom specific I/O pin or command sequence.
@@ -27,14 +27,12 @@
 
 #include "DAP_config.h"
 #include "DAP.h"
-#if (SWO_UART != 0)
-#include "Driver_USART.h"
-#endif
+#include "../Core/memory.h"
 #if (SWO_STREAM != 0)
-#include "cmsis_os2.h"
-#define   osObjectsExternal
-#include "osObjects.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
 #endif
+#include <string.h>
 
 #if (SWO_STREAM != 0)
 #ifdef DAP_FW_V1
@@ -42,17 +40,14 @@
 #endif
 #endif
 
-#if (SWO_UART != 0)
-
-// USART Driver
-#define _USART_Driver_(n)  Driver_USART##n
-#define  USART_Driver_(n) _USART_Driver_(n)
-extern ARM_DRIVER_USART    USART_Driver_(SWO_UART_DRIVER);
-#define pUSART           (&USART_Driver_(SWO_UART_DRIVER))
-
-static uint8_t USART_Ready = 0U;
-
-#endif  /* (SWO_UART != 0) */
+// Forge port: instead of a CMSIS USART driver, SWO is captured on PC7
+// straight off the peripherals (see DAP_config.h). In UART mode USART6
+// receives it by DMA into TraceBuf, a block at a time in double buffer
+// mode, so the next block is always armed before the current one ends and
+// nothing is lost between them at up to SWO_UART_MAX_BAUDRATE. In
+// Manchester mode TIM8 timestamps every edge by DMA and the edges are
+// decoded in its interrupts. Streaming runs on a FreeRTOS task, notified
+// where the reference used thread flags.
 
 
 #if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
@@ -61,7 +56,7 @@ static uint8_t USART_Ready = 0U;
 #define SWO_STREAM_TIMEOUT      50U     /* Stream timeout in ms */
 
 #define USB_BLOCK_SIZE          512U    /* USB Block Size */
-#define TRACE_BLOCK_SIZE        64U     /* Trace Block Size (2^n: 32...512) */
+#define TRACE_BLOCK_SIZE        256U    /* Trace Block Size (2^n: 32...512) */
 
 // Trace State
 static uint8_t  TraceTransport =  0U;       /* Trace Transport */
@@ -70,12 +65,12 @@ static uint8_t  TraceStatus    =  0U;       /* Trace Status without Errors */
 static uint8_t  TraceError[2]  = {0U, 0U};  /* Trace Error flags (banked) */
 static uint8_t  TraceError_n   =  0U;       /* Active Trace Error bank */
 
-// Trace Buffer
-static uint8_t  TraceBuf[SWO_BUFFER_SIZE];  /* Trace Buffer (must be 2^n) */
+// Trace Buffer; a UART block may run on past the end, and is copied back
+// to the start as it completes
+static uint8_t  TraceBuf[SWO_BUFFER_SIZE + TRACE_BLOCK_SIZE];  /* Trace Buffer (must be 2^n) */
 static volatile uint32_t TraceIndexI  = 0U; /* Incoming Trace Index */
 static volatile uint32_t TraceIndexO  = 0U; /* Outgoing Trace Index */
 static volatile uint8_t  TraceUpdate;       /* Trace Update Flag */
-static          uint32_t TraceBlockSize;    /* Current Trace Block Size */
 
 #if (TIMESTAMP_CLOCK != 0U)
 // Trace Timestamp
@@ -93,58 +88,204 @@ static uint8_t  GetTraceStatus (void);
 static void     SetTraceError  (uint8_t flag);
 
 #if (SWO_STREAM != 0)
-extern osThreadId_t      SWO_ThreadId;
+extern TaskHandle_t      SWO_ThreadId;
 static volatile uint8_t  TransferBusy = 0U; /* Transfer Busy Flag */
 static          uint32_t TransferSize;      /* Current Transfer Size */
+
+// Wake the SWO Thread, from a task or an interrupt
+static void SWO_Notify (void) {
+  BaseType_t woken = pdFALSE;
+
+  if (SWO_ThreadId == NULL) {
+    return;
+  }
+  if (xPortIsInsideInterrupt()) {
+    vTaskNotifyGiveFromISR(SWO_ThreadId, &woken);
+    portYIELD_FROM_ISR(woken);
+  } else {
+    xTaskNotifyGive(SWO_ThreadId);
+  }
+}
+
+// Wake the SWO Thread once a whole USB block is waiting
+//   count: trace bytes available
+static void SWO_NotifyBlock (uint32_t count) {
+  if (TraceTransport == 2U) {
+    if (count >= (USB_BLOCK_SIZE - (TraceIndexO & (USB_BLOCK_SIZE - 1U)))) {
+      SWO_Notify();
+    }
+  }
+}
 #endif
 
+// Configure the SWO pin
+//   alternate: GPIO alternate function, or 0 for an input
+//   pull:      GPIO pull, to the line's idle level
+static void SWO_Pin (uint32_t alternate, uint32_t pull) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  __HAL_RCC_GPIOC_CLK_ENABLE();
+  GPIO_InitStruct.Pin   = SWO_GPIO_PIN;
+  GPIO_InitStruct.Mode  = (alternate != 0U) ? GPIO_MODE_AF_PP : GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull  = pull;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = alternate;
+  HAL_GPIO_Init(SWO_GPIO_PORT, &GPIO_InitStruct);
+}
+
+// Stop a DMA stream and wait until it has
+//   stream: DMA stream
+static void SWO_StopDMA (DMA_Stream_TypeDef *stream) {
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN) {
+  }
+}
+
 
 #if (SWO_UART != 0)
 
-// USART Driver Callback function
-//   event: event mask
-static void USART_Callback (uint32_t event) {
-  uint32_t index_i;
-  uint32_t index_o;
-  uint32_t count;
-  uint32_t num;
+#define SWO_USART               USART6
+#define SWO_UART_DMA            DMA2_Stream1
+#define SWO_UART_DMA_CHANNEL    DMA_CHANNEL_5
+#define SWO_UART_DMA_FLAGS      (DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 | \
+                                 DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1)
+
+static uint8_t  USART_Ready = 0U;
 
-  if (event &  ARM_USART_EVENT_RECEIVE_COMPLETE) {
+// DMA targets: the block being filled, at TraceIndexI, and the one armed
+// after it. Either is TraceBuf, or UART_Discard while capture is paused.
+static          uint8_t  UART_Discard[TRACE_BLOCK_SIZE];
+static volatile uint8_t  UART_Filling;      /* Block being filled is in TraceBuf */
+static volatile uint8_t  UART_Next;         /* Block armed next is in TraceBuf */
+
+// Point the idle DMA target at the next block, or at UART_Discard once
+// TraceBuf has no room left for it (which pauses capture)
+static void UART_ArmNext (void) {
+  uint32_t index;
+  uint8_t *buf;
+
+  index = TraceIndexI + ((UART_Filling != 0U) ? TRACE_BLOCK_SIZE : 0U);
+  if (((TraceStatus & DAP_SWO_CAPTURE_PAUSED) == 0U) &&
+      ((index + TRACE_BLOCK_SIZE - TraceIndexO) <= SWO_BUFFER_SIZE)) {
+    buf = &TraceBuf[index & (SWO_BUFFER_SIZE - 1U)];
+    UART_Next = 1U;
+  } else {
+    buf = UART_Discard;
+    UART_Next = 0U;
+    if (TraceStatus == DAP_SWO_CAPTURE_ACTIVE) {
+      TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+    }
+  }
+  if (SWO_UART_DMA->CR & DMA_SxCR_CT) {
+    SWO_UART_DMA->M0AR = (uint32_t)buf;
+  } else {
+    SWO_UART_DMA->M1AR = (uint32_t)buf;
+  }
+}
+
+// Commit num bytes received into the block at TraceIndexI
+static void UART_Commit (uint32_t num) {
+  uint32_t index;
+  uint32_t over;
+
+  index = TraceIndexI & (SWO_BUFFER_SIZE - 1U);
+  if ((index + num) > SWO_BUFFER_SIZE) {
+    over = index + num - SWO_BUFFER_SIZE;
+    memcpy(&TraceBuf[0], &TraceBuf[SWO_BUFFER_SIZE], over);
+  }
 #if (TIMESTAMP_CLOCK != 0U)
-    TraceTimestamp.tick = TIMESTAMP_GET();
+  TraceTimestamp.tick = TIMESTAMP_GET();
 #endif
-    index_o  = TraceIndexO;
-    index_i  = TraceIndexI;
-    index_i += TraceBlockSize;
-    TraceIndexI = index_i;
+  TraceIndexI += num;
 #if (TIMESTAMP_CLOCK != 0U)
-    TraceTimestamp.index = index_i;
+  TraceTimestamp.index = TraceIndexI;
 #endif
-    num   = TRACE_BLOCK_SIZE - (index_i & (TRACE_BLOCK_SIZE - 1U));
-    count = index_i - index_o;
-    if (count <= (SWO_BUFFER_SIZE - num)) {
-      index_i &= SWO_BUFFER_SIZE - 1U;
-      TraceBlockSize = num;
-      pUSART->Receive(&TraceBuf[index_i], num);
-    } else {
-      TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+  TraceUpdate = 1U;
+}
+
+// Start receiving at TraceIndexI, stream and USART off
+static void UART_Start (void) {
+  DMA_Stream_TypeDef *dma = SWO_UART_DMA;
+
+  DMA2->LIFCR = SWO_UART_DMA_FLAGS;
+  dma->CR   = SWO_UART_DMA_CHANNEL | DMA_SxCR_DBM | DMA_SxCR_PL_1 | DMA_SxCR_MINC |
+              DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+  dma->PAR  = (uint32_t)&SWO_USART->DR;
+  dma->NDTR = TRACE_BLOCK_SIZE;
+  dma->FCR  = 0U;                           /* Direct mode */
+
+  // Target 0 fills first, target 1 is armed behind it
+  UART_Filling = 0U;
+  dma->M1AR = (uint32_t)UART_Discard;       /* CT is 0, so ArmNext sets M1AR */
+  UART_ArmNext();
+  dma->M0AR = dma->M1AR;
+  UART_Filling = UART_Next;
+  UART_ArmNext();
+
+  (void)SWO_USART->SR;
+  (void)SWO_USART->DR;
+  dma->CR |= DMA_SxCR_EN;
+  SWO_USART->CR3 |= USART_CR3_DMAR | USART_CR3_EIE;
+  SWO_USART->CR1 |= USART_CR1_RE;
+}
+
+// Stop receiving, committing whatever the block being filled got
+static void UART_Stop (void) {
+  uint32_t num;
+
+  SWO_USART->CR1 &= ~USART_CR1_RE;
+  SWO_USART->CR3 &= ~(USART_CR3_DMAR | USART_CR3_EIE);
+  SWO_StopDMA(SWO_UART_DMA);
+  if ((DMA2->LISR & DMA_LISR_TCIF1) == 0U) {
+    num = TRACE_BLOCK_SIZE - SWO_UART_DMA->NDTR;
+    if ((UART_Filling != 0U) && (num != 0U)) {
+      UART_Commit(num);
     }
+  } else if (UART_Filling != 0U) {
+    UART_Commit(TRACE_BLOCK_SIZE);
+  }
+  DMA2->LIFCR = SWO_UART_DMA_FLAGS;
+  UART_Filling = 0U;
+  UART_Next = 0U;
+}
+
+// SWO UART DMA interrupt: a block is complete and the DMA has moved on to
+// the one armed behind it
+void SWO_UART_DMA_IRQHandler (void) {
+  uint32_t flags;
+
+  flags = DMA2->LISR;
+  DMA2->LIFCR = SWO_UART_DMA_FLAGS;
+
+  if (flags & DMA_LISR_TEIF1) {
+    SetTraceError(DAP_SWO_STREAM_ERROR);
+  }
+  if (flags & DMA_LISR_TCIF1) {
+    if (UART_Filling != 0U) {
+      UART_Commit(TRACE_BLOCK_SIZE);
+    }
+    UART_Filling = UART_Next;
+    UART_ArmNext();
     TraceUpdate = 1U;
 #if (SWO_STREAM != 0)
-    if (TraceTransport == 2U) {
-      if (count >= (USB_BLOCK_SIZE - (index_o & (USB_BLOCK_SIZE - 1U)))) {
-        osThreadFlagsSet(SWO_ThreadId, 1U);
-      }
-    }
+    SWO_NotifyBlock(TraceIndexI - TraceIndexO);
 #endif
   }
-  if (event &  ARM_USART_EVENT_RX_OVERFLOW) {
-    SetTraceError(DAP_SWO_BUFFER_OVERRUN);
-  }
-  if (event & (ARM_USART_EVENT_RX_BREAK         |
-               ARM_USART_EVENT_RX_FRAMING_ERROR |
-               ARM_USART_EVENT_RX_PARITY_ERROR)) {
-    SetTraceError(DAP_SWO_STREAM_ERROR);
+}
+
+// SWO USART interrupt: receive errors only, the data goes by DMA
+void SWO_UART_IRQHandler (void) {
+  uint32_t sr;
+
+  sr = SWO_USART->SR;
+  if (sr & (USART_SR_ORE | USART_SR_FE | USART_SR_NE | USART_SR_PE)) {
+    (void)SWO_USART->DR;                    /* Clears them */
+    if (sr & USART_SR_ORE) {
+      SetTraceError(DAP_SWO_BUFFER_OVERRUN);
+    }
+    if (sr & (USART_SR_FE | USART_SR_NE | USART_SR_PE)) {
+      SetTraceError(DAP_SWO_STREAM_ERROR);
+    }
   }
 }
 
@@ -152,25 +293,27 @@ static void USART_Callback (uint32_t event) {
 //   enable: enable flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t SWO_Mode_UART (uint32_t enable) {
-  int32_t status;
 
   USART_Ready = 0U;
 
   if (enable != 0U) {
-    status = pUSART->Initialize(USART_Callback);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
-    }
-    status = pUSART->PowerControl(ARM_POWER_FULL);
-    if (status != ARM_DRIVER_OK) {
-      pUSART->Uninitialize();
-      return (0U);
-    }
+    __HAL_RCC_USART6_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    SWO_USART->CR1 = USART_CR1_OVER8;       /* 8N1, sampled 8 times a bit */
+    SWO_USART->CR2 = 0U;
+    SWO_USART->CR3 = USART_CR3_ONEBIT;
+    SWO_Pin(GPIO_AF8_USART6, GPIO_PULLUP);  /* NRZ idles high */
+    HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, SWO_IRQ_PRIORITY, 0U);
+    HAL_NVIC_SetPriority(USART6_IRQn, SWO_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+    HAL_NVIC_EnableIRQ(USART6_IRQn);
   } else {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-    pUSART->PowerControl(ARM_POWER_OFF);
-    pUSART->Uninitialize();
+    UART_Stop();
+    SWO_USART->CR1 = 0U;
+    HAL_NVIC_DisableIRQ(DMA2_Stream1_IRQn);
+    HAL_NVIC_DisableIRQ(USART6_IRQn);
+    SWO_Pin(0U, GPIO_NOPULL);
+    __HAL_RCC_USART6_CLK_DISABLE();
   }
   return (1U);
 }
@@ -179,73 +322,55 @@ __WEAK uint32_t SWO_Mode_UART (uint32_t enable) {
 //   baudrate: requested baudrate
 //   return:   actual baudrate or 0 when not configured
 __WEAK uint32_t SWO_Baudrate_UART (uint32_t baudrate) {
-  int32_t  status;
-  uint32_t index;
-  uint32_t num;
+  uint32_t clock;
+  uint32_t div;
 
   if (baudrate > SWO_UART_MAX_BAUDRATE) {
     baudrate = SWO_UART_MAX_BAUDRATE;
   }
-
-  if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    if (pUSART->GetStatus().rx_busy) {
-      TraceIndexI += pUSART->GetRxCount();
-      pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-    }
+  if (baudrate == 0U) {
+    USART_Ready = 0U;
+    return (0U);
   }
 
-  status = pUSART->Control(ARM_USART_MODE_ASYNCHRONOUS |
-                           ARM_USART_DATA_BITS_8       |
-                           ARM_USART_PARITY_NONE       |
-                           ARM_USART_STOP_BITS_1,
-                           baudrate);
-
-  if (status == ARM_DRIVER_OK) {
-    USART_Ready = 1U;
-  } else {
+  // Oversampling by 8, the divider in eighths: the closest rate at or
+  // below the one asked for, which the debugger then sets the target to
+  clock = HAL_RCC_GetPCLK2Freq();
+  div = (clock + baudrate - 1U) / baudrate;
+  if (div < 8U) {
+    div = 8U;
+  }
+  if (div > 0x7FFFU) {
     USART_Ready = 0U;
     return (0U);
   }
 
   if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-    if ((TraceStatus & DAP_SWO_CAPTURE_PAUSED) == 0U) {
-      index = TraceIndexI & (SWO_BUFFER_SIZE - 1U);
-      num = TRACE_BLOCK_SIZE - (index & (TRACE_BLOCK_SIZE - 1U));
-      TraceBlockSize = num;
-      pUSART->Receive(&TraceBuf[index], num);
-    }
-    pUSART->Control(ARM_USART_CONTROL_RX, 1U);
+    UART_Stop();
+  }
+  SWO_USART->CR1 &= ~USART_CR1_UE;
+  SWO_USART->BRR  = ((div >> 3) << 4) | (div & 7U);
+  SWO_USART->CR1 |= USART_CR1_UE;
+  USART_Ready = 1U;
+  if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
+    UART_Start();
   }
 
-  return (baudrate);
+  return (clock / div);
 }
 
 // Control SWO Capture (UART)
 //   active: active flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t SWO_Control_UART (uint32_t active) {
-  int32_t status;
 
   if (active) {
     if (!USART_Ready) {
       return (0U);
     }
-    TraceBlockSize = 1U;
-    status = pUSART->Receive(&TraceBuf[0], 1U);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
-    }
-    status = pUSART->Control(ARM_USART_CONTROL_RX, 1U);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
-    }
+    UART_Start();
   } else {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    if (pUSART->GetStatus().rx_busy) {
-      TraceIndexI += pUSART->GetRxCount();
-      pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-    }
+    UART_Stop();
   }
   return (1U);
 }
@@ -254,19 +379,30 @@ __WEAK uint32_t SWO_Control_UART (uint32_t active) {
 //   buf: pointer to buffer for capturing
 //   num: number of bytes to capture
 __WEAK void SWO_Capture_UART (uint8_t *buf, uint32_t num) {
-  TraceBlockSize = num;
-  pUSART->Receive(buf, num);
+  // Capture never stops, it only goes to UART_Discard while paused; the
+  // next block is armed in TraceBuf again as the current one completes
+  (void)buf;
+  (void)num;
 }
 
 // Get SWO Pending Trace Count (UART)
 //   return: number of pending trace data bytes
 __WEAK uint32_t SWO_GetCount_UART (void) {
   uint32_t count;
+  uint32_t index;
 
-  if (pUSART->GetStatus().rx_busy) {
-    count = pUSART->GetRxCount();
+  if (UART_Filling == 0U) {
+    return (0U);
+  }
+  if (DMA2->LISR & DMA_LISR_TCIF1) {
+    count = TRACE_BLOCK_SIZE;               /* Complete, not committed yet */
   } else {
-    count = 0U;
+    count = TRACE_BLOCK_SIZE - SWO_UART_DMA->NDTR;
+  }
+  // What has run on past the end of TraceBuf isn't at its start yet
+  index = TraceIndexI & (SWO_BUFFER_SIZE - 1U);
+  if ((index + count) > SWO_BUFFER_SIZE) {
+    count = SWO_BUFFER_SIZE - index;
   }
   return (count);
 }
@@ -276,41 +412,296 @@ __WEAK uint32_t SWO_GetCount_UART (void) {
 
 #if (SWO_MANCHESTER != 0)
 
+// Every edge of the line resets TIM8 (reset mode, triggered by TI2FP2 on
+// both edges) and channel 1, mapped onto the same input, captures the count
+// it had reached: the time since the edge before. The DMA stores them in a
+// ring that's decoded at half and full and when the line has gone quiet.
+// A quiet line lets the counter run to its update event, which only happens
+// 65536 ticks after an edge.
+#define SWO_TIM                 TIM8
+#define SWO_TIM_DMA             DMA2_Stream2
+#define SWO_TIM_DMA_CHANNEL     DMA_CHANNEL_7
+#define SWO_TIM_DMA_FLAGS       (DMA_LIFCR_CTCIF2 | DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTEIF2 | \
+                                 DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CFEIF2)
+#define SWO_EDGES               256U    /* Edge ring (2^n) */
+
+static uint16_t Edges[SWO_EDGES];
+
+// Manchester Decoder: each bit has an edge in its middle, falling for a 1,
+// and one on its boundary with the next if they're the same. Packets start
+// with a 1 out of a low, idle line and hold whole bytes, LSB first.
+#define MAN_IDLE                0U      /* Waiting for a start bit */
+#define MAN_START               1U      /* In the start bit */
+#define MAN_DATA                2U      /* In the data bits */
+#define MAN_LOST                3U      /* Out of step, waiting for the line to go idle */
+
+static uint8_t  Manchester_Ready = 0U;
+static struct {
+  uint8_t  state;
+  uint8_t  level;                       /* Line level after the last edge */
+  uint8_t  bits;                        /* Bits of byte so far */
+  uint8_t  byte;
+  uint32_t since;                       /* Ticks since the last mid-bit edge */
+  uint32_t read;                        /* Next edge in Edges to decode */
+  uint32_t half;                        /* Ticks up to which an edge is on a bit boundary (3/4 bit) */
+  uint32_t full;                        /* Ticks up to which it's the next mid-bit edge (5/4 bit) */
+} Manchester;
+
+// Store one decoded byte, unless TraceBuf is full, which pauses capture
+static void Manchester_Put (uint8_t byte) {
+  uint32_t index;
+
+  index = TraceIndexI;
+  if ((TraceStatus & DAP_SWO_CAPTURE_PAUSED) || ((index - TraceIndexO) >= SWO_BUFFER_SIZE)) {
+    if (TraceStatus == DAP_SWO_CAPTURE_ACTIVE) {
+      TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+    }
+    return;
+  }
+  TraceBuf[index & (SWO_BUFFER_SIZE - 1U)] = byte;
+  TraceIndexI = index + 1U;
+}
+
+// Decode the edges captured since the last call; interrupts only
+static void Manchester_Decode (void) {
+  uint32_t write;
+  uint32_t read;
+  uint32_t count;
+  uint32_t ticks;
+
+  write = (SWO_EDGES - SWO_TIM_DMA->NDTR) & (SWO_EDGES - 1U);
+  read  = Manchester.read;
+  count = TraceIndexI;
+  while (read != write) {
+    ticks = Edges[read];
+    read = (read + 1U) & (SWO_EDGES - 1U);
+
+    if (ticks > Manchester.full) {
+      // The line sat low: a start bit's leading edge. A packet cut off
+      // between bytes means it was decoded wrong.
+      if ((Manchester.state == MAN_DATA) && (Manchester.bits != 0U)) {
+        SetTraceError(DAP_SWO_STREAM_ERROR);
+      }
+      Manchester.state = MAN_START;
+      Manchester.level = 1U;
+      Manchester.since = 0U;
+      continue;
+    }
+    switch (Manchester.state) {
+      case MAN_IDLE:
+        Manchester.state = MAN_START;
+        Manchester.level = 1U;
+        Manchester.since = 0U;
+        break;
+      case MAN_START:
+        if (ticks <= Manchester.half) {
+          Manchester.state = MAN_DATA;
+          Manchester.level = 0U;
+          Manchester.since = 0U;
+          Manchester.bits  = 0U;
+          Manchester.byte  = 0U;
+        } else {
+          Manchester.state = MAN_LOST;
+          SetTraceError(DAP_SWO_STREAM_ERROR);
+        }
+        break;
+      case MAN_DATA:
+        Manchester.level ^= 1U;
+        Manchester.since += ticks;
+        if (Manchester.since <= Manchester.half) {
+          break;                        /* Bit boundary */
+        }
+        if (Manchester.since > Manchester.full) {
+          Manchester.state = MAN_LOST;
+          SetTraceError(DAP_SWO_STREAM_ERROR);
+          break;
+        }
+        Manchester.since = 0U;
+        if (Manchester.level == 0U) {
+          Manchester.byte |= (uint8_t)(1U << Manchester.bits);
+        }
+        if (++Manchester.bits == 8U) {
+          Manchester_Put(Manchester.byte);
+          Manchester.bits = 0U;
+          Manchester.byte = 0U;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  Manchester.read = read;
+
+  if (TraceIndexI != count) {
+#if (TIMESTAMP_CLOCK != 0U)
+    TraceTimestamp.tick  = TIMESTAMP_GET();
+    TraceTimestamp.index = TraceIndexI;
+#endif
+    TraceUpdate = 1U;
+#if (SWO_STREAM != 0)
+    SWO_NotifyBlock(TraceIndexI - TraceIndexO);
+#endif
+  }
+}
+
+// SWO Manchester DMA interrupt: half the edge ring is full
+void SWO_Manchester_DMA_IRQHandler (void) {
+  uint32_t flags;
+
+  flags = DMA2->LISR;
+  DMA2->LIFCR = SWO_TIM_DMA_FLAGS;
+  if (flags & DMA_LISR_TEIF2) {
+    SetTraceError(DAP_SWO_STREAM_ERROR);
+  }
+  Manchester_Decode();
+}
+
+// SWO Manchester timer interrupt: no edge for 65536 ticks, so the line is
+// idle and whatever came before it is complete
+void SWO_Manchester_TIM_IRQHandler (void) {
+  SWO_TIM->SR = ~TIM_SR_UIF;
+  Manchester_Decode();
+  if ((Manchester.state == MAN_DATA) && (Manchester.bits != 0U)) {
+    SetTraceError(DAP_SWO_STREAM_ERROR);
+  }
+  Manchester.state = MAN_IDLE;
+}
+
+// Stop capturing edges
+static void Manchester_Stop (void) {
+  SWO_TIM->CR1 &= ~TIM_CR1_CEN;
+  SWO_TIM->DIER = 0U;
+  SWO_StopDMA(SWO_TIM_DMA);
+  DMA2->LIFCR = SWO_TIM_DMA_FLAGS;
+  SWO_TIM->SR = 0U;
+}
+
 // Enable or disable SWO Mode (Manchester)
 //   enable: enable flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t SWO_Mode_Manchester (uint32_t enable) {
-  return (0U);
+
+  Manchester_Ready = 0U;
+
+  if (enable != 0U) {
+    __HAL_RCC_TIM8_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    SWO_TIM->CR1   = TIM_CR1_URS;           /* Only an overflow is an update event */
+    SWO_TIM->PSC   = 0U;
+    SWO_TIM->ARR   = 0xFFFFU;
+    SWO_TIM->CCMR1 = TIM_CCMR1_CC1S_1 |     /* IC1 on TI2 */
+                     TIM_CCMR1_CC2S_0;      /* IC2 on TI2, for TI2FP2 */
+    SWO_TIM->CCER  = TIM_CCER_CC1P | TIM_CCER_CC1NP | TIM_CCER_CC1E |
+                     TIM_CCER_CC2P | TIM_CCER_CC2NP;   /* Both edges */
+    SWO_TIM->SMCR  = TIM_SMCR_TS_2 | TIM_SMCR_TS_1 |   /* TI2FP2 */
+                     TIM_SMCR_SMS_2;                   /* Reset mode */
+    SWO_Pin(GPIO_AF3_TIM8, GPIO_PULLDOWN);  /* Manchester idles low */
+    HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, SWO_IRQ_PRIORITY, 0U);
+    HAL_NVIC_SetPriority(TIM8_UP_TIM13_IRQn, SWO_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+    HAL_NVIC_EnableIRQ(TIM8_UP_TIM13_IRQn);
+  } else {
+    Manchester_Stop();
+    HAL_NVIC_DisableIRQ(DMA2_Stream2_IRQn);
+    HAL_NVIC_DisableIRQ(TIM8_UP_TIM13_IRQn);
+    SWO_Pin(0U, GPIO_NOPULL);
+    __HAL_RCC_TIM8_CLK_DISABLE();
+  }
+  return (1U);
 }
 
 // Configure SWO Baudrate (Manchester)
 //   baudrate: requested baudrate
 //   return:   actual baudrate or 0 when not configured
 __WEAK uint32_t SWO_Baudrate_Manchester (uint32_t baudrate) {
-  return (0U);
+  uint32_t clock;
+  uint32_t bit;
+
+  if (baudrate > SWO_MANCHESTER_MAX_BAUDRATE) {
+    baudrate = SWO_MANCHESTER_MAX_BAUDRATE;
+  }
+  if (baudrate == 0U) {
+    Manchester_Ready = 0U;
+    return (0U);
+  }
+
+  // TIM8 runs at twice PCLK2. A bit must be short enough that an idle
+  // line still overflows the counter well after it.
+  clock = 2U * HAL_RCC_GetPCLK2Freq();
+  bit = clock / baudrate;
+  if ((bit < 8U) || (bit > 0xC000U)) {
+    Manchester_Ready = 0U;
+    return (0U);
+  }
+  Manchester.half = (bit * 3U) / 4U;
+  Manchester.full = (bit * 5U) / 4U;
+  Manchester_Ready = 1U;
+
+  return (clock / bit);
 }
 
 // Control SWO Capture (Manchester)
 //   active: active flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t SWO_Control_Manchester (uint32_t active) {
-  return (0U);
+  DMA_Stream_TypeDef *dma = SWO_TIM_DMA;
+
+  if (active) {
+    if (!Manchester_Ready) {
+      return (0U);
+    }
+    Manchester.state = MAN_IDLE;
+    Manchester.read  = 0U;
+
+    DMA2->LIFCR = SWO_TIM_DMA_FLAGS;
+    dma->CR   = SWO_TIM_DMA_CHANNEL | DMA_SxCR_PL_1 | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 |
+                DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+    dma->PAR  = (uint32_t)&SWO_TIM->CCR1;
+    dma->M0AR = (uint32_t)Edges;
+    dma->NDTR = SWO_EDGES;
+    dma->FCR  = 0U;
+    dma->CR  |= DMA_SxCR_EN;
+
+    SWO_TIM->CNT  = 0U;
+    SWO_TIM->SR   = 0U;
+    SWO_TIM->DIER = TIM_DIER_CC1DE | TIM_DIER_UIE;
+    SWO_TIM->CR1 |= TIM_CR1_CEN;
+  } else {
+    Manchester_Stop();
+    // Edges still in the ring are decoded with interrupts off, like the
+    // interrupts would have
+    __disable_irq();
+    Manchester_Decode();
+    __enable_irq();
+  }
+  return (1U);
 }
 
 // Start SWO Capture (Manchester)
 //   buf: pointer to buffer for capturing
 //   num: number of bytes to capture
 __WEAK void SWO_Capture_Manchester (uint8_t *buf, uint32_t num) {
+  // Decoding never stops; bytes are stored again once capture isn't paused
+  (void)buf;
+  (void)num;
 }
 
 // Get SWO Pending Trace Count (Manchester)
 //   return: number of pending trace data bytes
 __WEAK uint32_t SWO_GetCount_Manchester (void) {
+  // Bytes go into TraceBuf as they're decoded
+  return (0U);
 }
 
 #endif  /* (SWO_MANCHESTER != 0) */
 
 
+// Register the trace buffer in the memory map
+void SWO_Setup (void) {
+  forgeMemoryAdd("swo", TraceBuf, sizeof(TraceBuf));
+}
+
+
 // Clear Trace Errors and Data
 static void ClearTrace (void) {
 
@@ -593,7 +984,7 @@ uint32_t SWO_Control (const uint8_t *request, uint8_t *response) {
       TraceStatus = active;
 #if (SWO_STREAM != 0)
       if (TraceTransport == 2U) {
-        osThreadFlagsSet(SWO_ThreadId, 1U);
+        SWO_Notify();
       }
 #endif
     }
@@ -739,27 +1130,28 @@ void SWO_TransferComplete (void) {
   TraceIndexO += TransferSize;
   TransferBusy = 0U;
   ResumeTrace();
-  osThreadFlagsSet(SWO_ThreadId, 1U);
+  SWO_Notify();
 }
 
 // SWO Thread
 __NO_RETURN void SWO_Thread (void *argument) {
-  uint32_t timeout;
+  TickType_t timeout;
   uint32_t flags;
   uint32_t count;
   uint32_t index;
   uint32_t i, n;
   (void)   argument;
 
-  timeout = osWaitForever;
+  timeout = portMAX_DELAY;
 
   for (;;) {
-    flags = osThreadFlagsWait(1U, osFlagsWaitAny, timeout);
+    // 0 when it timed out, like osFlagsErrorTimeout
+    flags = ulTaskNotifyTake(pdTRUE, timeout);
     if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-      timeout = SWO_STREAM_TIMEOUT;
+      timeout = pdMS_TO_TICKS(SWO_STREAM_TIMEOUT);
     } else {
-      timeout = osWaitForever;
-      flags   = osFlagsErrorTimeout;
+      timeout = portMAX_DELAY;
+      flags   = 0U;
     }
     if (TransferBusy == 0U) {
       count = GetTraceCount();
@@ -769,7 +1161,7 @@ __NO_RETURN void SWO_Thread (void *argument) {
         if (count > n) {
           count = n;
         }
-        if (flags != osFlagsErrorTimeout) {
+        if (flags != 0U) {
           i = index & (USB_BLOCK_SIZE - 1U);
           if (i == 0U) {
             count &= ~(USB_BLOCK_SIZE - 1U);
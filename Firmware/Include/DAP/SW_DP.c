@@ -270,11 +270,237 @@ SWD_TransferFunction(Fast)
 SWD_TransferFunction(Slow)
 
 
+#if (DAP_SWD_SPI != 0)
+
+// SWD by SPI: the request and the data words are shifted by SWD_SPI, LSB
+// first with the clock idling high (CPOL = 1) and data changing on its
+// falling edges (CPHA = 1), as SWD has them. The turnaround, ACK and parity
+// bits, which don't come in bytes, are bit-banged in between at roughly
+// the same rate. Received words come in by DMA, so an interrupt that holds
+// off the polling loop only stretches the clock instead of overrunning the
+// receiver; SWD doesn't mind a clock that pauses.
+
+#define SWD_SPI_DMA             DMA1_Stream3    /* SPI2_RX */
+#define SWD_SPI_DMA_CHANNEL     DMA_CHANNEL_0
+#define SWD_SPI_DMA_FLAGS       (DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 | \
+                                 DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3)
+
+static uint8_t SWD_SPI_Active = 0U;     /* Clock is within SWD_SPI's range */
+static uint32_t SWD_SPI_Word;            /* DMA target, kept off the stack in case it's in CCM RAM */
+
+// Set the SPI clock: the fastest SWD_SPI can divide down to that isn't
+// above the requested clock, or bit-banging if it can't go that slow
+//   clock:  requested SWD clock in Hertz
+void SWD_SPI_Clock (uint32_t clock) {
+  uint32_t pclk;
+  uint32_t br;
+
+  pclk = HAL_RCC_GetPCLK1Freq();
+  for (br = 0U; br < 8U; br++) {
+    if ((pclk >> (br + 1U)) <= clock) {
+      break;
+    }
+  }
+
+  SWD_SPI->CR1 = 0U;
+  if (br == 8U) {
+    SWD_SPI_Active = 0U;
+    return;
+  }
+  SWD_SPI->CR2 = 0U;
+  SWD_SPI->CR1 = SPI_CR1_MSTR | SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_LSBFIRST |
+                 SPI_CR1_SSM | SPI_CR1_SSI | (br << SPI_CR1_BR_Pos) | SPI_CR1_SPE;
+
+  SWD_SPI_DMA->CR  = 0U;
+  SWD_SPI_DMA->PAR = (uint32_t)&SWD_SPI->DR;
+  SWD_SPI_DMA->FCR = 0U;
+  SWD_SPI_Active = 1U;
+}
+
+// Hand SWCLK to the SPI, or take it back
+#define SWCLK_SPI()   PIN_MODE(SWCLK_PORT, SWCLK_PIN, PIN_MODE_AF)
+#define SWCLK_GPIO()  PIN_MODE(SWCLK_PORT, SWCLK_PIN, PIN_MODE_OUTPUT)
+
+// Empty the receiver of what the last writes shifted in
+__STATIC_FORCEINLINE void SPI_Flush (void) {
+  (void)SWD_SPI->DR;
+  (void)SWD_SPI->SR;            /* Clears OVR after the DR read */
+}
+
+// Shift out bytes and wait until the last has left
+//   data:   bytes, LSB first
+//   num:    byte count
+static void SPI_Write (const uint8_t *data, uint32_t num) {
+  while (num--) {
+    while ((SWD_SPI->SR & SPI_SR_TXE) == 0U);
+    *(__IO uint8_t *)&SWD_SPI->DR = *data++;
+  }
+  while ((SWD_SPI->SR & SPI_SR_TXE) == 0U);
+  while (SWD_SPI->SR & SPI_SR_BSY);
+  SPI_Flush();
+}
+
+// Shift in a word, by DMA, while clocking out ones
+//   return: the word
+static uint32_t SPI_Read (void) {
+  uint32_t n;
+
+  SPI_Flush();
+  DMA1->LIFCR = SWD_SPI_DMA_FLAGS;
+  SWD_SPI_DMA->M0AR = (uint32_t)&SWD_SPI_Word;
+  SWD_SPI_DMA->NDTR = 4U;
+  SWD_SPI_DMA->CR   = SWD_SPI_DMA_CHANNEL | DMA_SxCR_PL_1 | DMA_SxCR_MINC | DMA_SxCR_EN;
+  SWD_SPI->CR2 = SPI_CR2_RXDMAEN;
+  for (n = 4U; n; n--) {
+    while ((SWD_SPI->SR & SPI_SR_TXE) == 0U);
+    *(__IO uint8_t *)&SWD_SPI->DR = 0xFFU;
+  }
+  while (SWD_SPI_DMA->CR & DMA_SxCR_EN);
+  SWD_SPI->CR2 = 0U;
+  __DMB();
+  return (SWD_SPI_Word);
+}
+
+// Parity of a word
+__STATIC_FORCEINLINE uint32_t SWD_Parity (uint32_t val) {
+  val ^= val >> 16;
+  val ^= val >> 8;
+  val ^= val >> 4;
+  val ^= val >> 2;
+  val ^= val >> 1;
+  return (val & 1U);
+}
+
+// SWD Transfer I/O by SPI
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+static uint8_t SWD_TransferSPI (uint32_t request, uint32_t *data) {
+  uint32_t ack;
+  uint32_t bit;
+  uint32_t val;
+  uint32_t parity;
+  uint8_t  buf[4];
+
+  uint32_t n;
+
+  /* Packet Request: Start, APnDP, RnW, A2, A3, Parity, Stop, Park */
+  parity = SWD_Parity(request & 0x0FU);
+  buf[0] = (uint8_t)(0x81U | ((request & 0x0FU) << 1) | (parity << 5));
+  PIN_MODE(SWDIO_PORT, SWDIO_PIN, PIN_MODE_AF);
+  SWCLK_SPI();
+  SPI_Write(buf, 1U);
+  SWCLK_GPIO();
+
+  /* Turnaround */
+  PIN_SWDIO_OUT_DISABLE();
+  for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+    SW_CLOCK_CYCLE();
+  }
+
+  /* Acknowledge response */
+  SW_READ_BIT(bit);
+  ack  = bit << 0;
+  SW_READ_BIT(bit);
+  ack |= bit << 1;
+  SW_READ_BIT(bit);
+  ack |= bit << 2;
+
+  if (ack == DAP_TRANSFER_OK) {         /* OK response */
+    /* Data transfer */
+    if (request & DAP_TRANSFER_RnW) {
+      /* Read data */
+      SWCLK_SPI();
+      val = SPI_Read();                 /* Read RDATA[0:31] */
+      SWCLK_GPIO();
+      SW_READ_BIT(bit);                 /* Read Parity */
+      if ((SWD_Parity(val) ^ bit) & 1U) {
+        ack = DAP_TRANSFER_ERROR;
+      }
+      if (data) { *data = val; }
+      /* Turnaround */
+      for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+      PIN_SWDIO_OUT_ENABLE();
+    } else {
+      /* Turnaround */
+      for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+      /* Write data */
+      val = *data;
+      buf[0] = (uint8_t)(val >>  0);
+      buf[1] = (uint8_t)(val >>  8);
+      buf[2] = (uint8_t)(val >> 16);
+      buf[3] = (uint8_t)(val >> 24);
+      PIN_MODE(SWDIO_PORT, SWDIO_PIN, PIN_MODE_AF);
+      SWCLK_SPI();
+      SPI_Write(buf, 4U);               /* Write WDATA[0:31] */
+      SWCLK_GPIO();
+      PIN_SWDIO_OUT_ENABLE();
+      SW_WRITE_BIT(SWD_Parity(val));    /* Write Parity Bit */
+    }
+    /* Capture Timestamp */
+    if (request & DAP_TRANSFER_TIMESTAMP) {
+      DAP_Data.timestamp = TIMESTAMP_GET();
+    }
+    /* Idle cycles */
+    n = DAP_Data.transfer.idle_cycles;
+    if (n) {
+      PIN_SWDIO_OUT(0U);
+      for (; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+    }
+    PIN_SWDIO_OUT(1U);
+    return ((uint8_t)ack);
+  }
+
+  if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT)) {
+    /* WAIT or FAULT response */
+    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) != 0U)) {
+      for (n = 32U+1U; n; n--) {
+        SW_CLOCK_CYCLE();               /* Dummy Read RDATA[0:31] + Parity */
+      }
+    }
+    /* Turnaround */
+    for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+      SW_CLOCK_CYCLE();
+    }
+    PIN_SWDIO_OUT_ENABLE();
+    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) == 0U)) {
+      PIN_SWDIO_OUT(0U);
+      for (n = 32U+1U; n; n--) {
+        SW_CLOCK_CYCLE();               /* Dummy Write WDATA[0:31] + Parity */
+      }
+    }
+    PIN_SWDIO_OUT(1U);
+    return ((uint8_t)ack);
+  }
+
+  /* Protocol error */
+  for (n = DAP_Data.swd_conf.turnaround + 32U + 1U; n; n--) {
+    SW_CLOCK_CYCLE();                   /* Back off data phase */
+  }
+  PIN_SWDIO_OUT_ENABLE();
+  PIN_SWDIO_OUT(1U);
+  return ((uint8_t)ack);
+}
+
+#endif  /* (DAP_SWD_SPI != 0) */
+
+
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
+#if (DAP_SWD_SPI != 0)
+  if (SWD_SPI_Active) {
+    return SWD_TransferSPI(request, data);
+  }
+#endif
   if (DAP_Data.fast_clock) {
     return SWD_TransferFast(request, data);
   } else {
@@ -27,6 +27,7 @@
 
 #include "DAP_config.h"
 #include "DAP.h"
+#include "../Core/memory.h"
 
 #if (DAP_UART != 0)
 
@@ -34,18 +35,44 @@
 #error "UART Communication Port not supported in DAP V1!"
 #endif
 
-#include "Driver_USART.h"
-
-#include "cmsis_os2.h"
 #include <string.h>
 
-#define UART_RX_BLOCK_SIZE    32U   /* Uart Rx Block Size (must be 2^n) */
+// Forge port: instead of a CMSIS USART driver, the UART is USART1 on PA9/PA10
+// straight off the peripherals (see DAP_config.h). Reception never stops for
+// software: DMA2 Stream5 runs circular over the whole of UartRxBuf, and
+// UartRxIndexI is caught up with its write position on the half and full
+// transfer interrupts, on the USART's IDLE interrupt at the end of each
+// burst, and before each read. Transmission is DMA2 Stream7 from UartTxBuf,
+// a contiguous run at a time. No byte waits on an interrupt, so the port
+// keeps up at DAP_UART_MAX_BAUDRATE for as long as the host drains it.
+
+#if ((DAP_UART_RX_BUFFER_SIZE & (DAP_UART_RX_BUFFER_SIZE - 1U)) != 0U) || \
+    ((DAP_UART_TX_BUFFER_SIZE & (DAP_UART_TX_BUFFER_SIZE - 1U)) != 0U)
+#error "DAP UART buffer sizes must be powers of 2!"
+#endif
+#if (DAP_UART_RX_BUFFER_SIZE > 0x8000U) || (DAP_UART_TX_BUFFER_SIZE > 0x8000U)
+#error "DAP UART buffers must fit a DMA transfer!"
+#endif
 
-// USART Driver
-#define _USART_Driver_(n)  Driver_USART##n
-#define  USART_Driver_(n) _USART_Driver_(n)
-extern ARM_DRIVER_USART    USART_Driver_(DAP_UART_DRIVER);
-#define pUSART           (&USART_Driver_(DAP_UART_DRIVER))
+// Room kept between the DMA and the oldest unread byte: what can arrive
+// between the host's status and the copy out of the buffer
+#define UART_RX_MARGIN        256U
+
+// UART Configure control byte
+#define UART_DATA_BITS_Msk    0x07U     /* 0 = 8 data bits */
+#define UART_PARITY_Pos       4U
+#define UART_PARITY_Msk       0x30U     /* 0 = none, 1 = even, 2 = odd */
+#define UART_STOP_BITS_Pos    6U
+#define UART_STOP_BITS_Msk    0xC0U     /* 0 = 1, 1 = 2, 2 = 1.5, 3 = 0.5 */
+
+#define DAP_USART             USART1
+#define UART_DMA_CHANNEL      DMA_CHANNEL_4
+#define UART_RX_DMA           DMA2_Stream5
+#define UART_RX_DMA_FLAGS     (DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | \
+                               DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5)
+#define UART_TX_DMA           DMA2_Stream7
+#define UART_TX_DMA_FLAGS     (DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7 | \
+                               DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7)
 
 // UART Configuration
 #if (DAP_UART_USB_COM_PORT != 0)
@@ -58,14 +85,14 @@ static uint8_t  UartTransport = DAP_UART_TRANSPORT_NONE;
 static uint8_t  UartConfigured = 0U;
 static uint8_t  UartReceiveEnabled = 0U;
 static uint8_t  UartTransmitEnabled = 0U;
-static uint8_t  UartTransmitActive = 0U;
+static volatile uint8_t  UartTransmitActive = 0U;
 
 // UART TX Buffer
 static uint8_t  UartTxBuf[DAP_UART_TX_BUFFER_SIZE];
 static volatile uint32_t UartTxIndexI = 0U;
 static volatile uint32_t UartTxIndexO = 0U;
 
-// UART RX Buffer
+// UART RX Buffer, the RX DMA's circular target
 static uint8_t  UartRxBuf[DAP_UART_RX_BUFFER_SIZE];
 static volatile uint32_t UartRxIndexI = 0U;
 static volatile uint32_t UartRxIndexO = 0U;
@@ -76,7 +103,7 @@ static volatile uint8_t  UartErrorFraming = 0U;
 static volatile uint8_t  UartErrorParity = 0U;
 
 // UART Transmit
-static uint32_t UartTxNum = 0U;
+static volatile uint32_t UartTxNum = 0U;
 
 // Function prototypes
 static uint8_t  UART_Init (void);
@@ -92,34 +119,131 @@ static void     UART_Receive (void);
 static void     UART_Transmit (void);
 
 
-// USART Driver Callback function
-//   event: event mask
-static void USART_Callback (uint32_t event) {
-  if (event &  ARM_USART_EVENT_SEND_COMPLETE) {
-    UartTxIndexO += UartTxNum;
-    UartTransmitActive = 0U;
-    UART_Transmit();
+// Configure the UART pins
+//   alternate: GPIO alternate function, or 0 for inputs
+static void UART_Pins (uint32_t alternate) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  GPIO_InitStruct.Pin   = DAP_UART_TX_PIN | DAP_UART_RX_PIN;
+  GPIO_InitStruct.Mode  = (alternate != 0U) ? GPIO_MODE_AF_PP : GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull  = GPIO_PULLUP;      /* Idles high */
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = alternate;
+  HAL_GPIO_Init(DAP_UART_GPIO_PORT, &GPIO_InitStruct);
+}
+
+// Stop a DMA stream and wait until it has
+//   stream: DMA stream
+static void UART_StopDMA (DMA_Stream_TypeDef *stream) {
+  stream->CR &= ~DMA_SxCR_EN;
+  while (stream->CR & DMA_SxCR_EN) {
   }
-  if (event &  ARM_USART_EVENT_RECEIVE_COMPLETE) {
-    UartRxIndexI += UART_RX_BLOCK_SIZE;
+}
+
+// Catch UartRxIndexI up with the RX DMA's write position. The interrupts
+// run it at least twice a lap, so it never falls a whole buffer behind;
+// anywhere else it runs with them masked.
+static void UART_Receive (void) {
+  uint32_t index;
+
+  index = DAP_UART_RX_BUFFER_SIZE - UART_RX_DMA->NDTR;
+  UartRxIndexI += (index - UartRxIndexI) & (DAP_UART_RX_BUFFER_SIZE - 1U);
+}
+
+// Bytes received and not yet read, dropping the oldest once the DMA is
+// about to write over them
+//   return: number of bytes
+static uint32_t UART_Receive_Count (void) {
+  uint32_t num;
+
+  __disable_irq();
+  if (UartReceiveEnabled != 0U) {
     UART_Receive();
   }
-  if (event &  ARM_USART_EVENT_RX_OVERFLOW) {
+  num = UartRxIndexI - UartRxIndexO;
+  if (num > (DAP_UART_RX_BUFFER_SIZE - UART_RX_MARGIN)) {
+    // Overflow
+    UartErrorRxDataLost = 1U;
+    num = DAP_UART_RX_BUFFER_SIZE - UART_RX_MARGIN;
+    UartRxIndexO = UartRxIndexI - num;
+  }
+  __enable_irq();
+
+  return (num);
+}
+
+// Bytes queued and not yet handed to the USART
+//   return: number of bytes
+static uint32_t UART_Transmit_Count (void) {
+  uint32_t num;
+
+  __disable_irq();
+  num = UartTxIndexI - UartTxIndexO;
+  if (UartTransmitActive != 0U) {
+    num -= UartTxNum - UART_TX_DMA->NDTR;
+  }
+  __enable_irq();
+
+  return (num);
+}
+
+// UART RX DMA interrupt: half or all of the buffer has been written
+void UART_RX_DMA_IRQHandler (void) {
+  uint32_t flags;
+
+  flags = DMA2->HISR;
+  DMA2->HIFCR = UART_RX_DMA_FLAGS;
+
+  if (flags & DMA_HISR_TEIF5) {
     UartErrorRxDataLost = 1U;
   }
-  if (event &  ARM_USART_EVENT_RX_FRAMING_ERROR) {
-    UartErrorFraming = 1U;
+  if (flags & (DMA_HISR_HTIF5 | DMA_HISR_TCIF5)) {
+    UART_Receive();
+  }
+}
+
+// UART TX DMA interrupt: the run in flight is with the USART, so start
+// the next
+void UART_TX_DMA_IRQHandler (void) {
+  uint32_t flags;
+
+  flags = DMA2->HISR;
+  DMA2->HIFCR = UART_TX_DMA_FLAGS;
+
+  if (flags & (DMA_HISR_TCIF7 | DMA_HISR_TEIF7)) {
+    UartTxIndexO += UartTxNum;
+    UartTransmitActive = 0U;
+    UART_Transmit();
   }
-  if (event &  ARM_USART_EVENT_RX_PARITY_ERROR) {
-    UartErrorParity = 1U;
+}
+
+// UART USART interrupt: the line went idle after a burst, or a receive
+// error; the data goes by DMA
+void UART_IRQHandler (void) {
+  uint32_t sr;
+
+  sr = DAP_USART->SR;
+  if (sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_FE | USART_SR_NE | USART_SR_PE)) {
+    (void)DAP_USART->DR;                    /* Clears them */
+    if (sr & USART_SR_IDLE) {
+      UART_Receive();
+    }
+    if (sr & USART_SR_ORE) {
+      UartErrorRxDataLost = 1U;
+    }
+    if (sr & (USART_SR_FE | USART_SR_NE)) {
+      UartErrorFraming = 1U;
+    }
+    if (sr & USART_SR_PE) {
+      UartErrorParity = 1U;
+    }
   }
 }
 
 // Init UART
 //   return: DAP_OK or DAP_ERROR
 static uint8_t UART_Init (void) {
-  int32_t status;
-  uint8_t ret = DAP_ERROR;
 
   UartConfigured = 0U;
   UartReceiveEnabled = 0U;
@@ -134,23 +258,51 @@ static uint8_t UART_Init (void) {
   UartRxIndexO = 0U;
   UartTxNum = 0U;
 
-  status = pUSART->Initialize(USART_Callback);
-  if (status == ARM_DRIVER_OK) {
-    status = pUSART->PowerControl(ARM_POWER_FULL);
-  }
-  if (status == ARM_DRIVER_OK) {
-    ret = DAP_OK;
-  }
-
-  return (ret);
+  __HAL_RCC_USART1_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  DAP_USART->CR1 = 0U;
+  DAP_USART->CR2 = 0U;
+  DAP_USART->CR3 = 0U;
+  UART_Pins(GPIO_AF7_USART1);
+
+  // Stream5 fills UartRxBuf over and over; Stream7 is set up per run
+  UART_StopDMA(UART_RX_DMA);
+  UART_StopDMA(UART_TX_DMA);
+  DMA2->HIFCR = UART_RX_DMA_FLAGS | UART_TX_DMA_FLAGS;
+  UART_RX_DMA->CR  = UART_DMA_CHANNEL | DMA_SxCR_PL_1 | DMA_SxCR_MINC | DMA_SxCR_CIRC |
+                     DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+  UART_RX_DMA->PAR = (uint32_t)&DAP_USART->DR;
+  UART_RX_DMA->M0AR = (uint32_t)UartRxBuf;
+  UART_RX_DMA->FCR = 0U;                    /* Direct mode */
+  UART_TX_DMA->CR  = UART_DMA_CHANNEL | DMA_SxCR_PL_0 | DMA_SxCR_MINC | DMA_SxCR_DIR_0 |
+                     DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+  UART_TX_DMA->PAR = (uint32_t)&DAP_USART->DR;
+  UART_TX_DMA->FCR = 0U;
+
+  HAL_NVIC_SetPriority(USART1_IRQn, DAP_UART_IRQ_PRIORITY, 0U);
+  HAL_NVIC_SetPriority(DMA2_Stream5_IRQn, DAP_UART_IRQ_PRIORITY, 0U);
+  HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, DAP_UART_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(USART1_IRQn);
+  HAL_NVIC_EnableIRQ(DMA2_Stream5_IRQn);
+  HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+
+  return (DAP_OK);
 }
 
 // Un-Init UART
 static void UART_Uninit (void) {
   UartConfigured = 0U;
 
-  pUSART->PowerControl(ARM_POWER_OFF);
-  pUSART->Uninitialize();
+  HAL_NVIC_DisableIRQ(USART1_IRQn);
+  HAL_NVIC_DisableIRQ(DMA2_Stream5_IRQn);
+  HAL_NVIC_DisableIRQ(DMA2_Stream7_IRQn);
+  UART_StopDMA(UART_RX_DMA);
+  UART_StopDMA(UART_TX_DMA);
+  DMA2->HIFCR = UART_RX_DMA_FLAGS | UART_TX_DMA_FLAGS;
+  DAP_USART->CR1 = 0U;
+  DAP_USART->CR3 = 0U;
+  UART_Pins(0U);
+  __HAL_RCC_USART1_CLK_DISABLE();
 }
 
 // Get UART Status
@@ -183,32 +335,28 @@ static uint8_t UART_Get_Status (void) {
 // Enable UART Receive
 //   return: DAP_OK or DAP_ERROR
 static uint8_t UART_Receive_Enable (void) {
-  int32_t status;
-  uint8_t ret = DAP_ERROR;
 
   if (UartReceiveEnabled == 0U) {
     // Flush Buffers
     UartRxIndexI = 0U;
     UartRxIndexO = 0U;
 
-    UART_Receive();
-    status = pUSART->Control(ARM_USART_CONTROL_RX, 1U);
-    if (status == ARM_DRIVER_OK) {
-      UartReceiveEnabled = 1U;
-      ret = DAP_OK;
-    }
-  } else {
-    ret = DAP_OK;
+    DMA2->HIFCR = UART_RX_DMA_FLAGS;
+    UART_RX_DMA->NDTR = DAP_UART_RX_BUFFER_SIZE;
+    UART_RX_DMA->CR  |= DMA_SxCR_EN;
+    (void)DAP_USART->SR;
+    (void)DAP_USART->DR;
+    DAP_USART->CR3 |= USART_CR3_DMAR | USART_CR3_EIE;
+    DAP_USART->CR1 |= USART_CR1_RE | USART_CR1_IDLEIE | USART_CR1_PEIE;
+    UartReceiveEnabled = 1U;
   }
 
-  return (ret);
+  return (DAP_OK);
 }
 
 // Enable UART Transmit
 //   return: DAP_OK or DAP_ERROR
 static uint8_t UART_Transmit_Enable (void) {
-  int32_t status;
-  uint8_t ret = DAP_ERROR;
 
   if (UartTransmitEnabled == 0U) {
     // Flush Buffers
@@ -217,23 +365,21 @@ static uint8_t UART_Transmit_Enable (void) {
     UartTxIndexO = 0U;
     UartTxNum = 0U;
 
-    status = pUSART->Control(ARM_USART_CONTROL_TX, 1U);
-    if (status == ARM_DRIVER_OK) {
-      UartTransmitEnabled = 1U;
-      ret = DAP_OK;
-    }
-  } else {
-    ret = DAP_OK;
+    DAP_USART->CR3 |= USART_CR3_DMAT;
+    DAP_USART->CR1 |= USART_CR1_TE;
+    UartTransmitEnabled = 1U;
   }
 
-  return (ret);
+  return (DAP_OK);
 }
 
 // Disable UART Receive
 static void UART_Receive_Disable (void) {
   if (UartReceiveEnabled != 0U) {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
+    DAP_USART->CR1 &= ~(USART_CR1_RE | USART_CR1_IDLEIE | USART_CR1_PEIE);
+    DAP_USART->CR3 &= ~(USART_CR3_DMAR | USART_CR3_EIE);
+    UART_StopDMA(UART_RX_DMA);
+    DMA2->HIFCR = UART_RX_DMA_FLAGS;
     UartReceiveEnabled = 0U;
   }
 }
@@ -241,8 +387,10 @@ static void UART_Receive_Disable (void) {
 // Disable UART Transmit
 static void UART_Transmit_Disable (void) {
   if (UartTransmitEnabled != 0U) {
-    pUSART->Control(ARM_USART_ABORT_SEND, 0U);
-    pUSART->Control(ARM_USART_CONTROL_TX, 0U);
+    UART_StopDMA(UART_TX_DMA);
+    DMA2->HIFCR = UART_TX_DMA_FLAGS;
+    DAP_USART->CR3 &= ~USART_CR3_DMAT;
+    DAP_USART->CR1 &= ~USART_CR1_TE;
     UartTransmitActive = 0U;
     UartTransmitEnabled = 0U;
   }
@@ -250,32 +398,28 @@ static void UART_Transmit_Disable (void) {
 
 // Flush UART Receive buffer
 static void UART_Receive_Flush (void) {
-  pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-  UartRxIndexI = 0U;
-  UartRxIndexO = 0U;
   if (UartReceiveEnabled != 0U) {
-    UART_Receive();
+    // Restarts the DMA at the start of the buffer
+    UART_Receive_Disable();
+    UART_Receive_Enable();
+  } else {
+    UartRxIndexI = 0U;
+    UartRxIndexO = 0U;
   }
 }
 
 // Flush UART Transmit buffer
 static void UART_Transmit_Flush (void) {
-  pUSART->Control(ARM_USART_ABORT_SEND, 0U);
+  UART_StopDMA(UART_TX_DMA);
+  DMA2->HIFCR = UART_TX_DMA_FLAGS;
   UartTransmitActive = 0U;
   UartTxIndexI = 0U;
   UartTxIndexO = 0U;
   UartTxNum = 0U;
 }
 
-// Receive data from target via UART
-static void UART_Receive (void) {
-  uint32_t index;
-
-  index = UartRxIndexI & (DAP_UART_RX_BUFFER_SIZE - 1U);
-  pUSART->Receive(&UartRxBuf[index], UART_RX_BLOCK_SIZE);
-}
-
-// Transmit available data to target via UART
+// Transmit available data to target via UART, from the TX DMA interrupt
+// or with it masked
 static void UART_Transmit (void) {
   uint32_t count;
   uint32_t index;
@@ -283,17 +427,25 @@ static void UART_Transmit (void) {
   count = UartTxIndexI - UartTxIndexO;
   index = UartTxIndexO & (DAP_UART_TX_BUFFER_SIZE - 1U);
 
-  if (count != 0U) {
+  if ((count != 0U) && (UartTransmitEnabled != 0U)) {
     if ((index + count) <= DAP_UART_TX_BUFFER_SIZE) {
       UartTxNum = count;
     } else {
       UartTxNum = DAP_UART_TX_BUFFER_SIZE - index;
     }
     UartTransmitActive = 1U;
-    pUSART->Send(&UartTxBuf[index], UartTxNum);
+    UART_TX_DMA->M0AR = (uint32_t)&UartTxBuf[index];
+    UART_TX_DMA->NDTR = UartTxNum;
+    UART_TX_DMA->CR  |= DMA_SxCR_EN;
   }
 }
 
+// Register the UART buffers in the memory map
+void UART_Setup (void) {
+  forgeMemoryAdd("uart rx", UartRxBuf, sizeof(UartRxBuf));
+  forgeMemoryAdd("uart tx", UartTxBuf, sizeof(UartTxBuf));
+}
+
 // Process UART Transport command and prepare response
 //   request:  pointer to request data
 //   response: pointer to response data
@@ -393,7 +545,9 @@ uint32_t UART_Transport (const uint8_t *request, uint8_t *response) {
 uint32_t UART_Configure (const uint8_t *request, uint8_t *response) {
   uint8_t  control, status;
   uint32_t baudrate;
-  int32_t  result;
+  uint32_t parity, stop;
+  uint32_t clock, div;
+  uint32_t cr1;
 
   if (UartTransport != DAP_UART_TRANSPORT_DAP_COMMAND) {
     status = DAP_UART_CFG_ERROR_DATA_BITS |
@@ -409,35 +563,56 @@ uint32_t UART_Configure (const uint8_t *request, uint8_t *response) {
                (uint32_t)(*(request+3) << 16) |
                (uint32_t)(*(request+4) << 24);
 
-    result = pUSART->Control(control |
-                             ARM_USART_MODE_ASYNCHRONOUS |
-                             ARM_USART_FLOW_CONTROL_NONE,
-                             baudrate);
-    if (result == ARM_DRIVER_OK) {
-      UartConfigured = 1U;
+    if ((control & UART_DATA_BITS_Msk) != 0U) {
+      status |= DAP_UART_CFG_ERROR_DATA_BITS;
+    }
+    parity = (control & UART_PARITY_Msk) >> UART_PARITY_Pos;
+    if (parity > 2U) {
+      status |= DAP_UART_CFG_ERROR_PARITY;
+    }
+    stop = (control & UART_STOP_BITS_Msk) >> UART_STOP_BITS_Pos;
+
+    // Oversampling by 16, the divider in sixteenths: the closest rate to the
+    // one asked for, 3MHz and its fractions exactly
+    clock = HAL_RCC_GetPCLK2Freq();
+    if ((baudrate == 0U) || (baudrate > DAP_UART_MAX_BAUDRATE)) {
+      div = 0U;
     } else {
+      div = (clock + (baudrate / 2U)) / baudrate;
+      if (div < 16U) {
+        div = 16U;
+      }
+      if (div > 0xFFFFU) {
+        div = 0U;
+      }
+    }
+
+    if (status != 0U) {
       UartConfigured = 0U;
-      switch (result) {
-        case ARM_USART_ERROR_BAUDRATE:
-          status = 0U;
-          baudrate = 0U;
-          break;
-        case ARM_USART_ERROR_DATA_BITS:
-          status = DAP_UART_CFG_ERROR_DATA_BITS;
-          break;
-        case ARM_USART_ERROR_PARITY:
-          status = DAP_UART_CFG_ERROR_PARITY;
-          break;
-        case ARM_USART_ERROR_STOP_BITS:
-          status = DAP_UART_CFG_ERROR_STOP_BITS;
-          break;
-        default:
-          status = DAP_UART_CFG_ERROR_DATA_BITS |
-                   DAP_UART_CFG_ERROR_PARITY    |
-                   DAP_UART_CFG_ERROR_STOP_BITS;
-          baudrate = 0U;
-          break;
+    } else if (div == 0U) {
+      UartConfigured = 0U;
+      baudrate = 0U;
+    } else {
+      // The frame can't change under a byte, so the USART stops for it;
+      // the DMA streams carry on where they were
+      cr1 = DAP_USART->CR1 & ~(USART_CR1_UE | USART_CR1_M | USART_CR1_PCE | USART_CR1_PS);
+      if (parity != 0U) {
+        cr1 |= USART_CR1_M | USART_CR1_PCE;     /* 8 data bits and the parity bit */
+        if (parity == 2U) {
+          cr1 |= USART_CR1_PS;
+        }
+      }
+      DAP_USART->CR1 &= ~USART_CR1_UE;
+      switch (stop) {
+        case 1U:  DAP_USART->CR2 = USART_CR2_STOP_1;                    break;
+        case 2U:  DAP_USART->CR2 = USART_CR2_STOP_1 | USART_CR2_STOP_0; break;
+        case 3U:  DAP_USART->CR2 = USART_CR2_STOP_0;                    break;
+        default:  DAP_USART->CR2 = 0U;                                  break;
       }
+      DAP_USART->BRR = div;
+      DAP_USART->CR1 = cr1 | USART_CR1_UE;
+      UartConfigured = 1U;
+      baudrate = clock / div;
     }
   }
 
@@ -514,7 +689,6 @@ uint32_t UART_Control (const uint8_t *request, uint8_t *response) {
 //             number of bytes in request (upper 16 bits)
 uint32_t UART_Status (uint8_t *response) {
   uint32_t rx_cnt, tx_cnt;
-  uint32_t cnt;
   uint8_t  status;
 
   if ((UartTransport != DAP_UART_TRANSPORT_DAP_COMMAND) ||
@@ -524,20 +698,8 @@ uint32_t UART_Status (uint8_t *response) {
     status = 0U;
   } else {
 
-    rx_cnt  = UartRxIndexI - UartRxIndexO;
-    rx_cnt += pUSART->GetRxCount();
-    if (rx_cnt > (DAP_UART_RX_BUFFER_SIZE - (UART_RX_BLOCK_SIZE*2))) {
-      // Overflow
-      UartErrorRxDataLost = 1U;
-      rx_cnt = (DAP_UART_RX_BUFFER_SIZE - (UART_RX_BLOCK_SIZE*2));
-      UartRxIndexO = UartRxIndexI - rx_cnt;
-    }
-
-    tx_cnt = UartTxIndexI - UartTxIndexO;
-    cnt = pUSART->GetTxCount();
-    if (UartTransmitActive != 0U) {
-      tx_cnt -= cnt;
-    }
+    rx_cnt = UART_Receive_Count();
+    tx_cnt = UART_Transmit_Count();
 
     status = UART_Get_Status();
   }
@@ -583,14 +745,7 @@ uint32_t UART_Transfer (const uint8_t *request, uint8_t *response) {
     if (rx_cnt > (DAP_PACKET_SIZE - 6U)) {
       rx_cnt = (DAP_PACKET_SIZE - 6U);
     }
-    rx_num  = UartRxIndexI - UartRxIndexO;
-    rx_num += pUSART->GetRxCount();
-    if (rx_num > (DAP_UART_RX_BUFFER_SIZE - (UART_RX_BLOCK_SIZE*2))) {
-      // Overflow
-      UartErrorRxDataLost = 1U;
-      rx_num = (DAP_UART_RX_BUFFER_SIZE - (UART_RX_BLOCK_SIZE*2));
-      UartRxIndexO = UartRxIndexI - rx_num;
-    }
+    rx_num = UART_Receive_Count();
     if (rx_cnt > rx_num) {
       rx_cnt = rx_num;
     }
@@ -614,11 +769,7 @@ uint32_t UART_Transfer (const uint8_t *request, uint8_t *response) {
     if (tx_cnt > (DAP_PACKET_SIZE - 5U)) {
       tx_cnt = (DAP_PACKET_SIZE - 5U);
     }
-    tx_num = UartTxIndexI - UartTxIndexO;
-    num = pUSART->GetTxCount();
-    if (UartTransmitActive != 0U) {
-      tx_num -= num;
-    }
+    tx_num = UART_Transmit_Count();
     if (tx_cnt > (DAP_UART_TX_BUFFER_SIZE - tx_num)) {
       tx_cnt = (DAP_UART_TX_BUFFER_SIZE - tx_num);
     }
@@ -631,11 +782,12 @@ uint32_t UART_Transfer (const uint8_t *request, uint8_t *response) {
       memcpy(&UartTxBuf[index],  tx_data,      num);
       memcpy(&UartTxBuf[0],     &tx_data[num], tx_cnt - num);
     }
+    __disable_irq();
     UartTxIndexI += tx_cnt;
-
     if (UartTransmitActive == 0U) {
       UART_Transmit();
     }
+    __enable_irq();
 
     status = UART_Get_Status();
   }
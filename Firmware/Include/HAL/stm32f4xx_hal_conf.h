@@ -59,7 +59,7 @@
 /* #define HAL_RNG_MODULE_ENABLED      */   
 /* #define HAL_RTC_MODULE_ENABLED      */
 /* #define HAL_SAI_MODULE_ENABLED      */   
-/* #define HAL_SD_MODULE_ENABLED       */
+#define HAL_SD_MODULE_ENABLED
 #define HAL_SPI_MODULE_ENABLED
 #define HAL_TIM_MODULE_ENABLED
 #define HAL_UART_MODULE_ENABLED
@@ -68,7 +68,7 @@
 /* #define HAL_SMARTCARD_MODULE_ENABLED*/
 /* #define HAL_WWDG_MODULE_ENABLED     */
 #define HAL_CORTEX_MODULE_ENABLED   
-/* #define HAL_PCD_MODULE_ENABLED      */
+#define HAL_PCD_MODULE_ENABLED
 /* #define HAL_HCD_MODULE_ENABLED      */
 #define USE_FULL_LL_DRIVER
 
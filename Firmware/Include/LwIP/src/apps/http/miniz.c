@@ -0,0 +1,137 @@
+/**
+ * @file miniz.c
+ * @brief The part of miniz's API that makefsdata uses to deflate files, done with the host's zlib.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * makefsdata.c includes "../miniz.c" when built with MAKEFS_SUPPORT_DEFLATE,
+ * expecting miniz itself here. This stands in for it, so the tool builds
+ * with nothing more than zlib, which every host has. Like miniz without
+ * TDEFL_WRITE_ZLIB_HEADER, it writes raw deflate streams, which is what
+ * browsers take for "Content-Encoding: deflate". Host only; link with -lz.
+ */
+
+#ifndef MINIZ_HEADER_INCLUDED
+#define MINIZ_HEADER_INCLUDED
+
+#include <zlib.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned char mz_uint8;
+typedef unsigned int mz_uint;
+
+#define MZ_MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// The low 12 bits of the flags are miniz's probe count, which is how it
+// encodes the level; the table is miniz's own
+#define TDEFL_MAX_PROBES_MASK 0xFFF
+#define TDEFL_GREEDY_PARSING_FLAG 0x04000
+#define TDEFL_FORCE_ALL_RAW_BLOCKS 0x80000
+static const mz_uint s_tdefl_num_probes[11] = {0, 1, 6, 32, 16, 32, 128, 256, 512, 768, 1500};
+
+typedef enum
+{
+    TDEFL_STATUS_BAD_PARAM = -2,
+    TDEFL_STATUS_PUT_BUF_FAILED = -1,
+    TDEFL_STATUS_OKAY = 0,
+    TDEFL_STATUS_DONE = 1
+} tdefl_status;
+
+typedef enum
+{
+    TDEFL_NO_FLUSH = 0,
+    TDEFL_SYNC_FLUSH = 2,
+    TDEFL_FULL_FLUSH = 3,
+    TDEFL_FINISH = 4
+} tdefl_flush;
+
+typedef enum
+{
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct
+{
+    int level;
+} tdefl_compressor;
+
+typedef struct
+{
+    int unused;
+} tinfl_decompressor;
+
+typedef int (*tdefl_put_buf_func_ptr)(const void *buf, int len, void *user);
+
+static tdefl_status tdefl_init(tdefl_compressor *d, tdefl_put_buf_func_ptr put, void *user, int flags)
+{
+    if (put != NULL || user != NULL)
+        return TDEFL_STATUS_BAD_PARAM; // Only whole buffers at once, as makefsdata does it
+    if (flags & TDEFL_FORCE_ALL_RAW_BLOCKS)
+    {
+        d->level = 0;
+        return TDEFL_STATUS_OKAY;
+    }
+    mz_uint probes = (mz_uint)flags & TDEFL_MAX_PROBES_MASK;
+    d->level = 9;
+    for (int i = 1; i < 10; i++)
+    {
+        if (s_tdefl_num_probes[i] == probes)
+        {
+            d->level = i;
+            break;
+        }
+    }
+    return TDEFL_STATUS_OKAY;
+}
+
+static tdefl_status tdefl_compress(tdefl_compressor *d, const void *in, size_t *in_size, void *out, size_t *out_size,
+                                   tdefl_flush flush)
+{
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (flush != TDEFL_FINISH || deflateInit2(&z, d->level, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return TDEFL_STATUS_BAD_PARAM;
+    z.next_in = (Bytef *)in;
+    z.avail_in = (uInt)*in_size;
+    z.next_out = (Bytef *)out;
+    z.avail_out = (uInt)*out_size;
+    int err = deflate(&z, Z_FINISH);
+    *in_size = z.total_in;
+    *out_size = z.total_out;
+    deflateEnd(&z);
+    return (err == Z_STREAM_END) ? TDEFL_STATUS_DONE : TDEFL_STATUS_PUT_BUF_FAILED;
+}
+
+static void tinfl_init(tinfl_decompressor *r)
+{
+    r->unused = 0;
+}
+
+static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *in, size_t *in_size, mz_uint8 *out_start,
+                                     mz_uint8 *out_next, size_t *out_size, mz_uint flags)
+{
+    (void)r;
+    (void)out_start;
+    (void)flags;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -15) != Z_OK)
+        return TINFL_STATUS_FAILED;
+    z.next_in = (Bytef *)in;
+    z.avail_in = (uInt)*in_size;
+    z.next_out = out_next;
+    z.avail_out = (uInt)*out_size;
+    int err = inflate(&z, Z_FINISH);
+    *in_size = z.total_in;
+    *out_size = z.total_out;
+    inflateEnd(&z);
+    return (err == Z_STREAM_END) ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+}
+
+#endif /* MINIZ_HEADER_INCLUDED */
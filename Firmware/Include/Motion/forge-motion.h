@@ -0,0 +1,76 @@
+/**
+ * @file forge-motion.h
+ * @brief Kinematics and motion wiring of the Forge
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_MOTION_CFG_H
+#define __FORGE_MOTION_CFG_H
+
+#include "motion.h"
+#include "planner.h"
+#include "gcode.h"
+#include "../Core/profiler.h"
+#include "../Stepper/forge-steppers.h"
+#include "../Temperature/forge-controllers.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern Planner ForgePlanner;
+    extern GcodeMachine ForgeGcode;
+
+    void forgeHome(uint32_t axes)
+    {
+        if (axes & (1 << MOTION_AXIS_X))
+            homeStepper(&StepperX1, STEP_DIR_0);
+        if (axes & (1 << MOTION_AXIS_Y))
+            homeStepper(&StepperY1, STEP_DIR_0);
+        if (axes & (1 << MOTION_AXIS_Z))
+            homeStepper(&StepperZ1, STEP_DIR_0);
+    }
+
+    void initMotion(void)
+    {
+        // 1/16 microstepping: GT2 belt on 20T pulleys, 8mm lead screw, geared extruder
+        const float32_t stepsPerMm[FORGE_AXES] = {80.0f, 80.0f, 400.0f, 93.0f};
+        // klipper/printer.cfg: max_velocity, max_z_velocity, max_accel, max_z_accel;
+        // extrude-only moves get max_accel, as Klipper gives them by default
+        const float32_t maxFeed[FORGE_AXES] = {500.0f, 500.0f, 5.0f, 60.0f};         // mm/s
+        const float32_t maxAccel[FORGE_AXES] = {6000.0f, 6000.0f, 100.0f, 6000.0f}; // mm/s^2
+        StepperConfig *axes[FORGE_AXES] = {&StepperX1, &StepperY1, &StepperZ1, &StepperE1};
+
+        motionInit(axes);
+        ForgePlanner = createPlanner(stepsPerMm, maxFeed, maxAccel);
+        ForgeGcode = createGcodeMachine(&ForgePlanner, &HeaterHotend, &HeaterBed);
+        ForgeGcode.home = forgeHome;
+    }
+
+    // The timer's count at entry is how long after the update the handler
+    // started, in ticks of MOTION_TIMER_HZ
+    void TIM7_IRQHandler(void)
+    {
+        PROFILE_ISR_LATENCY(PROFILE_ISR_STEP, MOTION_TIMER->CNT * (SystemCoreClock / MOTION_TIMER_HZ));
+        PROFILE_ISR_ENTER();
+        motionTimerIRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_STEP);
+    }
+
+    void TIM6_DAC_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        motionWakeIRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_WAKE);
+    }
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_MOTION_CFG_H */
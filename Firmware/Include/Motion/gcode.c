@@ -0,0 +1,448 @@
+/**
+ * @file gcode.c
+ * @brief Streaming G-code parser driving the planner and heaters.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "gcode.h"
+#include "../Core/forge.h"
+#include "../DSP/Include/arm_math.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char _axisLetters[FORGE_AXES] = {'X', 'Y', 'Z', 'E'};
+
+GcodeMachine createGcodeMachine(Planner *planner, PIDControlConfig *hotend, PIDControlConfig *bed)
+{
+    GcodeMachine out;
+    out.planner = planner;
+    out.hotend = hotend;
+    out.bed = bed;
+    out.home = NULL;
+    out.card = NULL;
+    out.relative = false;
+    out.relativeE = false;
+    out.feed = GCODE_DEFAULT_FEED;
+    out.length = 0;
+    out.overflow = false;
+    out.streamOffset = 0;
+    out.lineOffset = 0;
+    out.doneOffset = 0;
+    out.lines = 0;
+    out.errors = 0;
+    out.lastError = GCODE_ERROR_NONE;
+    return out;
+}
+
+/**
+ * @brief  Parses a decimal number without exponent. Slicers never emit one, and strtof is both locale dependent and several times slower.
+ * @param[in]  p is the first character of the number.
+ * @param[in]  end is one past the last character of the line.
+ * @param[out]  out receives the value.
+ * @retval One past the last character used, or NULL if there were no digits.
+ */
+static const char *_parseNumber(const char *p, const char *end, float32_t *out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint32_t whole = 0;
+    uint32_t fraction = 0;
+    uint32_t scale = 1;
+    bool digits = false;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        whole = whole * 10 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            // Past 7 places a float can't hold the difference anyway
+            if (scale < 10000000)
+            {
+                fraction = fraction * 10 + (*p - '0');
+                scale *= 10;
+            }
+            p++;
+            digits = true;
+        }
+    }
+    if (!digits)
+        return NULL;
+
+    float32_t value = (float32_t)whole + (float32_t)fraction / (float32_t)scale;
+    *out = negative ? -value : value;
+    return p;
+}
+
+/**
+ * @brief  Parses one line of G-code. Comments (; and parentheses), line numbers and checksums are skipped; they are not verified. Whatever follows M23 is its file name, up to a comment.
+ * @param[in]  line is the text of the line, without the line ending.
+ * @param[in]  length is the number of characters in line.
+ * @param[out]  out receives the command.
+ * @retval GCODE_ERROR_NONE, or GCODE_ERROR_BAD_WORD if a letter wasn't followed by a number.
+ * @headerfile gcode.h
+ */
+GcodeError gcodeParseLine(const char *line, uint16_t length, GcodeCommand *out)
+{
+    const char *p = line;
+    const char *end = line + length;
+    out->letter = 0;
+    out->code = 0;
+    out->present = 0;
+    out->text = NULL;
+    out->textLength = 0;
+
+    while (p < end)
+    {
+        char c = *p++;
+        if (c == ';' || c == '*')
+            break;
+        if (c == '(')
+        {
+            while (p < end && *p != ')')
+                p++;
+            p++;
+            continue;
+        }
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if (c < 'A' || c > 'Z')
+            continue; // Whitespace and anything else between words
+
+        float32_t value;
+        const char *next = _parseNumber(p, end, &value);
+        if (next == NULL)
+            return GCODE_ERROR_BAD_WORD;
+        p = next;
+
+        if (c == 'N')
+            continue;
+        if (out->letter == 0 && (c == 'G' || c == 'M' || c == 'T'))
+        {
+            out->letter = c;
+            out->code = (uint16_t)value;
+            if (c == 'M' && out->code == 23)
+            {
+                // A file name isn't words, so the rest of the line is taken whole
+                while (p < end && (*p == ' ' || *p == '\t'))
+                    p++;
+                const char *stop = p;
+                while (stop < end && *stop != ';' && *stop != '*')
+                    stop++;
+                while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t'))
+                    stop--;
+                out->text = p;
+                out->textLength = (uint16_t)(stop - p);
+                break;
+            }
+            continue;
+        }
+        out->present |= 1UL << (c - 'A');
+        out->value[c - 'A'] = value;
+    }
+    return GCODE_ERROR_NONE;
+}
+
+/**
+ * @brief  Tags the segments of the line starting at offset with it and with the modes it starts in, so a print resumed from the segment being stepped runs the line again as it first ran.
+ */
+static void _startLine(GcodeMachine *m, uint32_t offset)
+{
+    MotionTag *tag = &m->planner->tag;
+    float32_t feed = m->feed * 60.0f + 0.5f;
+    m->lineOffset = offset;
+    tag->offset = offset;
+    tag->feed = (feed < 65535.0f) ? (uint16_t)feed : 65535;
+    tag->flags = (m->relative ? GCODE_TAG_RELATIVE : 0) | (m->relativeE ? GCODE_TAG_RELATIVE_E : 0);
+}
+
+static void _move(GcodeMachine *m, const GcodeCommand *cmd)
+{
+    Planner *pl = m->planner;
+    float32_t target[FORGE_AXES];
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        target[a] = pl->position[a];
+        if (!gcodeHas(cmd, _axisLetters[a]))
+            continue;
+        float32_t v = gcodeValue(cmd, _axisLetters[a]);
+        bool relative = (a == MOTION_AXIS_E) ? m->relativeE : m->relative;
+        target[a] = relative ? target[a] + v : v;
+    }
+    if (gcodeHas(cmd, 'F') && gcodeValue(cmd, 'F') > 0.0f)
+    {
+        m->feed = gcodeValue(cmd, 'F') / 60.0f; // F is mm/min
+    }
+    plannerLine(pl, target, m->feed);
+}
+
+static void _setPosition(GcodeMachine *m, const GcodeCommand *cmd)
+{
+    Planner *pl = m->planner;
+    float32_t position[FORGE_AXES];
+    bool any = false;
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        position[a] = pl->position[a];
+        if (gcodeHas(cmd, _axisLetters[a]))
+        {
+            position[a] = gcodeValue(cmd, _axisLetters[a]);
+            any = true;
+        }
+    }
+    if (!any)
+    {
+        for (uint8_t a = 0; a < FORGE_AXES; a++)
+            position[a] = 0.0f;
+    }
+    plannerSetPosition(pl, position);
+}
+
+static void _home(GcodeMachine *m, const GcodeCommand *cmd)
+{
+    uint32_t axes = 0;
+    for (uint8_t a = 0; a < MOTION_AXIS_E; a++)
+    {
+        if (gcodeHas(cmd, _axisLetters[a]))
+            axes |= 1 << a;
+    }
+    if (axes == 0)
+        axes = (1 << MOTION_AXIS_X) | (1 << MOTION_AXIS_Y) | (1 << MOTION_AXIS_Z);
+
+    plannerSync(m->planner);
+    if (m->home != NULL && !m->planner->dryRun)
+        m->home(axes);
+
+    float32_t position[FORGE_AXES];
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        position[a] = (axes & (1 << a)) ? 0.0f : m->planner->position[a];
+    }
+    plannerSetPosition(m->planner, position);
+}
+
+static void _setTemperature(GcodeMachine *m, PIDControlConfig *heater, const GcodeCommand *cmd, bool wait)
+{
+    if (heater == NULL || !gcodeHas(cmd, 'S') || m->planner->dryRun)
+        return;
+    float32_t target = gcodeValue(cmd, 'S');
+    heater->target_temp = target;
+    if (!wait || target <= 0.0f)
+        return;
+
+    // Only heating is waited for, as S does in Marlin: cooling to a target,
+    // or to one below ambient, may never get within the window. The heater
+    // task owns the ADC; lastTemp is its last reading, which unlike its error
+    // terms doesn't depend on the target it was taken against.
+    plannerSync(m->planner);
+    while (heater->_t == 0 || target - heater->lastTemp > GCODE_TEMP_WINDOW)
+    {
+        forgeDelay(100);
+    }
+}
+
+/**
+ * @brief  Executes a parsed command. Moves block while the motion queue is full, and M109/M190 block until the heater has heated up to its target, so this should be called from the task that owns the print.
+ * @param[in]  m is the interpreter state.
+ * @param[in]  cmd is a command from gcodeParseLine.
+ * @retval None
+ * @headerfile gcode.h
+ */
+void gcodeExecute(GcodeMachine *m, const GcodeCommand *cmd)
+{
+    m->lastError = GCODE_ERROR_NONE;
+    if (cmd->letter == 'G')
+    {
+        switch (cmd->code)
+        {
+        case 0:
+        case 1:
+            _move(m, cmd);
+            return;
+        case 28:
+            _home(m, cmd);
+            return;
+        case 90:
+            m->relative = false;
+            m->relativeE = false;
+            return;
+        case 91:
+            m->relative = true;
+            m->relativeE = true;
+            return;
+        case 92:
+            _setPosition(m, cmd);
+            return;
+        default:
+            break;
+        }
+    }
+    else if (cmd->letter == 'M')
+    {
+        switch (cmd->code)
+        {
+        case 23:
+        case 24:
+        case 25:
+        case 413:
+        case GCODE_SD_BENCHMARK:
+            if (m->card == NULL)
+                break;
+            m->card(cmd);
+            return;
+        case 82:
+            m->relativeE = false;
+            return;
+        case 83:
+            m->relativeE = true;
+            return;
+        case 104:
+            _setTemperature(m, m->hotend, cmd, false);
+            return;
+        case 109:
+            _setTemperature(m, m->hotend, cmd, true);
+            return;
+        case 140:
+            _setTemperature(m, m->bed, cmd, false);
+            return;
+        case 190:
+            _setTemperature(m, m->bed, cmd, true);
+            return;
+        case 400:
+            plannerSync(m->planner);
+            return;
+        default:
+            break;
+        }
+    }
+    else if (cmd->letter == 0)
+    {
+        return; // Blank or comment-only line
+    }
+    m->lastError = GCODE_ERROR_UNSUPPORTED;
+}
+
+static void _runLine(GcodeMachine *m)
+{
+    GcodeCommand cmd;
+    m->lines++;
+    if (m->overflow)
+    {
+        m->overflow = false;
+        m->lastError = GCODE_ERROR_LINE_TOO_LONG;
+        m->errors++;
+        return;
+    }
+    GcodeError err = gcodeParseLine(m->line, m->length, &cmd);
+    if (err != GCODE_ERROR_NONE)
+    {
+        m->lastError = err;
+        m->errors++;
+        return;
+    }
+    gcodeExecute(m, &cmd);
+}
+
+/**
+ * @brief  Runs every complete line in data. A line split across calls is carried over in the machine, so data can be cut anywhere, e.g. at file read boundaries.
+ * @param[in]  m is the interpreter state.
+ * @param[in]  data is raw G-code text.
+ * @param[in]  length is the number of bytes in data.
+ * @retval The number of lines run.
+ * @headerfile gcode.h
+ */
+uint32_t gcodeFeed(GcodeMachine *m, const uint8_t *data, uint32_t length)
+{
+    uint32_t lines = 0;
+    const uint8_t *base = data;
+    const uint8_t *end = data + length;
+    while (data < end)
+    {
+        const uint8_t *nl = memchr(data, '\n', end - data);
+        const uint8_t *stop = (nl != NULL) ? nl : end;
+        uint32_t n = stop - data;
+
+        if (m->length == 0 && !m->overflow)
+            _startLine(m, m->streamOffset + (data - base));
+
+        // Parse straight from data when the whole line is there; only lines
+        // that straddle two calls are copied
+        if (m->length == 0 && nl != NULL && !m->overflow)
+        {
+            if (n > 0 && data[n - 1] == '\r')
+                n--;
+            if (n <= GCODE_MAX_LINE)
+            {
+                GcodeCommand cmd;
+                m->lines++;
+                GcodeError err = gcodeParseLine((const char *)data, (uint16_t)n, &cmd);
+                if (err == GCODE_ERROR_NONE)
+                {
+                    gcodeExecute(m, &cmd);
+                }
+                else
+                {
+                    m->lastError = err;
+                    m->errors++;
+                }
+            }
+            else
+            {
+                m->overflow = true;
+                _runLine(m);
+            }
+            lines++;
+            data = nl + 1;
+            m->doneOffset = m->streamOffset + (data - base);
+            continue;
+        }
+
+        if (m->length + n > GCODE_MAX_LINE)
+        {
+            m->overflow = true;
+            m->length = 0;
+        }
+        else
+        {
+            memcpy(m->line + m->length, data, n);
+            m->length += n;
+        }
+        if (nl == NULL)
+            break;
+
+        if (m->length > 0 && m->line[m->length - 1] == '\r')
+            m->length--;
+        _runLine(m);
+        m->length = 0;
+        lines++;
+        data = nl + 1;
+        m->doneOffset = m->streamOffset + (data - base);
+    }
+    m->streamOffset += length;
+    return lines;
+}
+
+/**
+ * @brief  Runs a final line that had no line ending, e.g. at the end of a file.
+ * @headerfile gcode.h
+ */
+void gcodeFinish(GcodeMachine *m)
+{
+    if (m->length > 0 || m->overflow)
+    {
+        _runLine(m);
+    }
+    m->length = 0;
+}
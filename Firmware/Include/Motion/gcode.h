@@ -0,0 +1,113 @@
+/**
+ * @file gcode.h
+ * @brief Streaming G-code parser driving the planner and heaters.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_GCODE_H
+#define __FORGE_GCODE_H
+
+#include "planner.h"
+#include "../Temperature/control.h"
+#include "../DSP/Include/arm_math.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GCODE_MAX_LINE 128
+#define GCODE_DEFAULT_FEED 25.0f // mm/s until the first F word
+#define GCODE_TEMP_WINDOW 2.0f   // M109/M190 wait until within this many degrees below the target
+#define GCODE_SD_BENCHMARK 990   // M-code that times reading the file M23 selected
+
+// MotionTag.flags: the modes a line started in
+#define GCODE_TAG_RELATIVE 0x01   // G91
+#define GCODE_TAG_RELATIVE_E 0x02 // M83
+
+    /**
+     * @brief Stores an error from parsing or executing a line.
+     */
+    typedef enum
+    {
+        GCODE_ERROR_NONE = 0,
+        GCODE_ERROR_LINE_TOO_LONG,
+        GCODE_ERROR_BAD_WORD,
+        GCODE_ERROR_UNSUPPORTED // Not fatal, the line was skipped
+    } GcodeError;
+
+    /**
+     * @brief One parsed line, e.g. G1 X10 F3000 is letter 'G', code 1 and the X and F words.
+     */
+    typedef struct
+    {
+        char letter; // 'G', 'M' or 'T', 0 for a line with no command
+        uint16_t code;
+        uint32_t present;     // Bit (c - 'A') set for each word c on the line
+        float32_t value[26];  // Indexed by c - 'A'
+        const char *text;     // M23's file name, in the parsed line; NULL for any other command
+        uint16_t textLength;
+    } GcodeCommand;
+
+    /**
+     * @brief Modal state of the interpreter plus the partial line carried between calls to gcodeFeed.
+     */
+    typedef struct
+    {
+        Planner *planner;
+        PIDControlConfig *hotend;
+        PIDControlConfig *bed;
+
+        /**
+         * @brief Called for G28 with a mask of (1 << MOTION_AXIS_n) for each axis to home, after the queue has drained. May be NULL, in which case G28 just zeroes those axes.
+         */
+        void (*home)(uint32_t axes);
+
+        /**
+         * @brief Called for the SD card commands, those gcodeCardCommand is true for: M23 selects a file, M24 starts or resumes printing it, M25 pauses, M413 resumes a print cut off by a power loss, and M990 (GCODE_SD_BENCHMARK) times reading the file. May be NULL, in which case they are unsupported.
+         */
+        void (*card)(const GcodeCommand *cmd);
+
+        bool relative;  // G91
+        bool relativeE; // M83
+        float32_t feed; // mm/s
+
+        char line[GCODE_MAX_LINE];
+        uint16_t length;
+        bool overflow;
+
+        uint32_t streamOffset; // Offset of the next byte gcodeFeed will see, e.g. in the file
+        uint32_t lineOffset;   // Offset of the start of the line being run
+        uint32_t doneOffset;   // Offset just past the last line that has finished running
+
+        uint32_t lines;
+        uint32_t errors;
+        GcodeError lastError;
+    } GcodeMachine;
+
+    GcodeMachine createGcodeMachine(Planner *planner, PIDControlConfig *hotend, PIDControlConfig *bed);
+
+    GcodeError gcodeParseLine(const char *line, uint16_t length, GcodeCommand *out);
+    void gcodeExecute(GcodeMachine *m, const GcodeCommand *cmd);
+    uint32_t gcodeFeed(GcodeMachine *m, const uint8_t *data, uint32_t length);
+    void gcodeFinish(GcodeMachine *m);
+
+    static inline bool gcodeHas(const GcodeCommand *cmd, char c) { return (cmd->present >> (c - 'A')) & 1; }
+    static inline float32_t gcodeValue(const GcodeCommand *cmd, char c) { return cmd->value[c - 'A']; }
+    static inline bool gcodeCardCommand(const GcodeCommand *cmd)
+    {
+        return cmd->letter == 'M' &&
+               ((cmd->code >= 23 && cmd->code <= 25) || cmd->code == 413 || cmd->code == GCODE_SD_BENCHMARK);
+    }
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_GCODE_H */
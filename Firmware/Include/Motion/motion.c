@@ -0,0 +1,505 @@
+/**
+ * @file motion.c
+ * @brief Timer-driven step generation from a queue of straight-line segments.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "motion.h"
+#include "../Core/forge.h"
+#include "../Core/memory.h"
+#include "../Core/trace.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+static StepperConfig *_axes[FORGE_AXES];
+static TIM_HandleTypeDef _htim;
+
+// Single producer (the planner) writes _head, the step interrupt writes _tail.
+// Both only ever increase; the slot is index & (MOTION_QUEUE_LENGTH - 1).
+static MotionSegment _queue[MOTION_QUEUE_LENGTH];
+static volatile uint32_t _head = 0;
+static volatile uint32_t _tail = 0;
+
+static const MotionSegment *_current = NULL;
+static uint32_t _remaining;
+// ARR is 16 bits, so a step interval longer than 0x10000 ticks is split into
+// _periods equal timer periods, and only the last of them steps
+static uint32_t _periods;
+static uint32_t _periodsLeft;
+static uint32_t _error[FORGE_AXES];
+static int8_t _delta[FORGE_AXES];
+
+// Position in the planner's step space (dirMask bit set counts up), and where
+// the current segment started
+static int32_t _position[FORGE_AXES];
+static int32_t _segmentStart[FORGE_AXES];
+static int8_t _sign[FORGE_AXES];
+
+static volatile bool _running = false;
+static volatile bool _streaming = false;
+// Set once the producer waits for the queue to empty (M400, M109, G28), so
+// the queue running dry then is on purpose and not an underrun; the next
+// push clears it
+static volatile bool _draining = false;
+static volatile MotionStats _stats;
+
+// Set while a task is blocked in motionWait; the step interrupt clears it
+// when it pends the wake-up
+static volatile bool _waiting = false;
+static volatile bool _waitIdle = false;
+static SemaphoreHandle_t _wake;
+static StaticSemaphore_t _wakeBuffer;
+
+/**
+ * @brief  Sets up the step timer. The steppers must already be initialized; they are only driven from the timer interrupt from here on.
+ * @param[in]  axes are the steppers for X, Y, Z and E, in that order. An entry may be NULL for an axis that isn't fitted.
+ * @retval None
+ * @headerfile motion.h
+ */
+void motionInit(StepperConfig *axes[FORGE_AXES])
+{
+    forgeMemoryAdd("motion queue", _queue, sizeof(_queue));
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        _axes[a] = axes[a];
+        if (axes[a] != NULL)
+        {
+            // Put DIR in a known state; segments only write it on a change
+            setDirectionStepper(axes[a], STEP_DIR_0);
+        }
+    }
+
+    __HAL_RCC_TIM7_CLK_ENABLE();
+    // APB1 timers run at twice PCLK1 whenever APB1 is divided
+    uint32_t timerClock = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+        timerClock *= 2;
+
+    _htim.Instance = MOTION_TIMER;
+    _htim.Init.Prescaler = (timerClock / MOTION_TIMER_HZ) - 1;
+    _htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    _htim.Init.Period = 0xFFFF;
+    _htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    // ARR is rewritten from the interrupt right after an update, and has to
+    // apply to the period that just started
+    _htim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    HAL_TIM_Base_Init(&_htim);
+    __HAL_TIM_CLEAR_FLAG(&_htim, TIM_FLAG_UPDATE);
+    __HAL_TIM_ENABLE_IT(&_htim, TIM_IT_UPDATE);
+
+    // Above everything else, including the kernel; the handler never calls
+    // into FreeRTOS
+    HAL_NVIC_SetPriority(MOTION_TIMER_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(MOTION_TIMER_IRQn);
+
+    // Only ever pended by the step interrupt, and at the kernel's level since
+    // it does call into FreeRTOS
+    _wake = xSemaphoreCreateBinaryStatic(&_wakeBuffer);
+    HAL_NVIC_SetPriority(MOTION_WAKE_IRQn, configLIBRARY_LOWEST_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(MOTION_WAKE_IRQn);
+}
+
+/**
+ * @brief  Sets the time to the next step event. Called from the interrupt, or with interrupts masked.
+ * @param[in]  interval is in timer ticks, any length from MOTION_MIN_INTERVAL up.
+ */
+static void _setInterval(uint32_t interval)
+{
+    if (interval < MOTION_MIN_INTERVAL)
+        interval = MOTION_MIN_INTERVAL;
+    uint32_t periods = (interval >> 16) + ((interval & 0xFFFF) != 0);
+    // Off by less than a tick in 0x10000 for the split ones
+    uint32_t period = interval / periods;
+    _periods = periods;
+    _periodsLeft = periods;
+    MOTION_TIMER->ARR = period - 1;
+    if (MOTION_TIMER->CNT >= period - 1)
+        MOTION_TIMER->CNT = 0;
+}
+
+/**
+ * @brief  The time from the step event just made to the next: the distance of one event over the average of the ramp's speeds at the two, exact at constant acceleration. Called from the interrupt, or with interrupts masked.
+ * @retval Timer ticks, never fewer than at full speed.
+ */
+static uint32_t _nextInterval(const MotionSegment *seg)
+{
+    uint32_t stepped = seg->events - _remaining;
+    const MotionRamp *ramp = &seg->ramp;
+    float32_t from2, to2;
+    if (stepped < ramp->accelUntil)
+    {
+        from2 = ramp->entry2 + seg->accel2 * (float32_t)stepped;
+        to2 = from2 + seg->accel2;
+    }
+    else if (stepped >= ramp->decelAfter)
+    {
+        to2 = ramp->exit2 + seg->accel2 * (float32_t)(_remaining - 1);
+        from2 = to2 + seg->accel2;
+    }
+    else
+    {
+        return seg->interval;
+    }
+
+    float32_t from, to;
+    arm_sqrt_f32(from2, &from);
+    arm_sqrt_f32(to2, &to);
+    float32_t interval = (2.0f * (float32_t)MOTION_TIMER_HZ) / (from + to);
+    return (interval < (float32_t)seg->interval) ? seg->interval : (uint32_t)(interval + 0.5f);
+}
+
+/**
+ * @brief  Starts on the next queued segment. Called from the interrupt, or with interrupts masked.
+ * @retval false if the queue is empty.
+ */
+static bool _loadNext(void)
+{
+    uint32_t tail = _tail;
+    if (tail == _head)
+    {
+        _current = NULL;
+        return false;
+    }
+    const MotionSegment *seg = &_queue[tail & (MOTION_QUEUE_LENGTH - 1)];
+
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        StepperConfig *cfg = _axes[a];
+        _error[a] = seg->events >> 1; // Round to the nearest step instead of down
+        _segmentStart[a] = _position[a];
+        _sign[a] = (seg->dirMask & (1 << a)) ? 1 : -1;
+        if (cfg == NULL || seg->steps[a] == 0)
+            continue;
+        StepperDirection dir = (seg->dirMask & (1 << a)) ? STEP_DIR_1 : STEP_DIR_0;
+        if (dir != cfg->direction)
+        {
+            // The first step is at least one interval away, far more than the
+            // 20ns DIR setup time the TMC2209 needs
+            FORGE_BSRR(cfg->DIRx, (dir == STEP_DIR_1) ? cfg->DIR_Pin : (cfg->DIR_Pin << 16));
+            cfg->direction = dir;
+        }
+        _delta[a] = ((dir == STEP_DIR_1) == cfg->dir1IsClockwise) ? 1 : -1;
+    }
+
+    _current = seg;
+    _remaining = seg->events;
+    _setInterval(_nextInterval(seg));
+    traceEvent(TRACE_SEGMENT_START, seg->tag.offset);
+    return true;
+}
+
+static void _startTimer(void)
+{
+    if (!_loadNext())
+        return;
+    MOTION_TIMER->CNT = 0;
+    _running = true;
+    MOTION_TIMER->CR1 |= TIM_CR1_CEN;
+}
+
+static void _stopTimer(void)
+{
+    MOTION_TIMER->CR1 &= ~TIM_CR1_CEN;
+    _running = false;
+}
+
+/**
+ * @brief  Queues a segment without blocking. Segments with no steps are dropped.
+ * @param[in]  seg is copied into the queue.
+ * @retval false if the queue is full.
+ * @headerfile motion.h
+ */
+bool motionPush(const MotionSegment *seg)
+{
+    if (seg->events == 0)
+        return true;
+
+    uint32_t head = _head;
+    if (head - _tail >= MOTION_QUEUE_LENGTH)
+        return false;
+    _queue[head & (MOTION_QUEUE_LENGTH - 1)] = *seg;
+    _draining = false;
+    __DMB(); // The segment must be visible before the interrupt can see the new head
+    _head = head + 1;
+
+    if (!_running)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (!_running)
+            _startTimer();
+        __set_PRIMASK(primask);
+    }
+    return true;
+}
+
+/**
+ * @brief  Returns how many segments have been pushed since boot. Segments are numbered from 0 in the order they're pushed, so this is the number the next one will get.
+ * @headerfile motion.h
+ */
+uint32_t motionPushed(void)
+{
+    return _head;
+}
+
+/**
+ * @brief  Returns the number of the oldest segment the step interrupt hasn't started on, or motionPushed() if it has started on all of them. Only that segment and the ones after it can be retimed.
+ * @headerfile motion.h
+ */
+uint32_t motionRetimable(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t id = (_current != NULL) ? _tail + 1 : _tail;
+    __set_PRIMASK(primask);
+    return id;
+}
+
+/**
+ * @brief  Replaces the ramp of a queued segment the step interrupt hasn't started on. Call with interrupts disabled, across every segment a replan changes, so the interrupt can't run a segment's old exit speed into the next one's new entry speed.
+ * @param[in]  id is the segment's number, see motionPushed.
+ * @param[in]  ramp is copied into it.
+ * @retval false if it has started, or already finished, and keeps the ramp it had.
+ * @headerfile motion.h
+ */
+bool motionRetime(uint32_t id, const MotionRamp *ramp)
+{
+    uint32_t first = (_current != NULL) ? _tail + 1 : _tail;
+    if (id - first >= _head - first)
+        return false;
+    _queue[id & (MOTION_QUEUE_LENGTH - 1)].ramp = *ramp;
+    return true;
+}
+
+/**
+ * @brief  Returns the number of segments that can be pushed without motionPush failing.
+ * @headerfile motion.h
+ */
+uint32_t motionQueueFree(void)
+{
+    return MOTION_QUEUE_LENGTH - (_head - _tail);
+}
+
+/**
+ * @brief  Returns true when the queue is empty and the last segment has finished stepping.
+ * @headerfile motion.h
+ */
+bool motionIdle(void)
+{
+    return !_running && _head == _tail;
+}
+
+/**
+ * @brief  Returns how long until the next step event, e.g. to fit something that stalls the CPU in between. Call with interrupts disabled, so the answer still holds when it's acted on.
+ * @retval Timer ticks (MOTION_TIMER_HZ) to the next step event, or UINT32_MAX while idle.
+ * @headerfile motion.h
+ */
+uint32_t motionQuietTicks(void)
+{
+    if (!_running)
+        return UINT32_MAX;
+    uint32_t arr = MOTION_TIMER->ARR;
+    uint32_t cnt = MOTION_TIMER->CNT;
+    return ((cnt < arr) ? arr - cnt : 0) + (_periodsLeft - 1) * (arr + 1);
+}
+
+static bool _waitOver(void)
+{
+    if (_waitIdle)
+        return !_running && _head == _tail;
+    return MOTION_QUEUE_LENGTH - (_head - _tail) >= MOTION_WAKE_ROOM;
+}
+
+/**
+ * @brief  Blocks the calling task until MOTION_WAKE_ROOM slots are free, or until motion is idle. The step interrupt wakes it as soon as that's so, rather than it polling. It may also return early, so check again and call it in a loop. Only one task may wait at a time: the one that owns the planner.
+ * @param[in]  idle waits for motionIdle() rather than for room.
+ * @retval None
+ * @headerfile motion.h
+ */
+void motionWait(bool idle)
+{
+    if (!forgeSchedulerRunning())
+    {
+        forgeDelay(1);
+        return;
+    }
+    // A wake-up left over from a wait that ended on its own
+    xSemaphoreTake(_wake, 0);
+    if (idle)
+        _draining = true;
+    _waitIdle = idle;
+    _waiting = true;
+    // Looked at again once _waiting is set, so a segment finishing in
+    // between isn't missed
+    if (!_waitOver())
+        xSemaphoreTake(_wake, pdMS_TO_TICKS(MOTION_WAIT_MS));
+    _waiting = false;
+}
+
+/**
+ * @brief  Marks whether a producer is expected to keep the queue full, e.g. while a print is running. Running dry while streaming is counted as an underrun.
+ * @headerfile motion.h
+ */
+void motionSetStreaming(bool streaming)
+{
+    _streaming = streaming;
+}
+
+/**
+ * @brief  Copies the step interrupt's counters.
+ * @param[out]  stats receives the counters.
+ * @headerfile motion.h
+ */
+void motionGetStats(MotionStats *stats)
+{
+    stats->segments = _stats.segments;
+    stats->events = _stats.events;
+    stats->underruns = _stats.underruns;
+}
+
+/**
+ * @brief  Reads which segment is being stepped and where it started, consistently with each other.
+ * @param[out]  tag receives the tag of the running segment.
+ * @param[out]  position receives the step position at the start of that segment, in the planner's step space.
+ * @retval false if nothing is moving, in which case position is the current position and tag is left alone.
+ * @headerfile motion.h
+ */
+bool motionSnapshot(MotionTag *tag, int32_t position[FORGE_AXES])
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool moving = (_current != NULL);
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        position[a] = moving ? _segmentStart[a] : _position[a];
+    }
+    if (moving)
+        *tag = _current->tag;
+    __set_PRIMASK(primask);
+    return moving;
+}
+
+/**
+ * @brief  Redefines the step position without moving, e.g. for G92. Only call it while motionIdle().
+ * @param[in]  position is the new step position of every axis.
+ * @headerfile motion.h
+ */
+void motionSetPosition(const int32_t position[FORGE_AXES])
+{
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        _position[a] = position[a];
+    }
+}
+
+/**
+ * @brief  Called from the step interrupt as each segment finishes, e.g. to log it. Overrides must be short and must not call into FreeRTOS. The default does nothing.
+ * @param[in]  position is the step position the segment ended at.
+ * @retval None
+ * @headerfile motion.h
+ */
+__weak void motionSegmentDone(const MotionSegment *seg, const int32_t position[FORGE_AXES])
+{
+    (void)seg;
+    (void)position;
+}
+
+/**
+ * @brief  Generates one step event of the current segment. Must be called from the MOTION_TIMER interrupt handler.
+ * @headerfile motion.h
+ */
+void motionTimerIRQHandler(void)
+{
+    if (!(MOTION_TIMER->SR & TIM_SR_UIF))
+        return;
+    MOTION_TIMER->SR = ~TIM_SR_UIF;
+
+    const MotionSegment *seg = _current;
+    if (seg == NULL)
+    {
+        _stopTimer();
+        return;
+    }
+    if (--_periodsLeft > 0)
+        return;
+    _periodsLeft = _periods;
+
+    StepperConfig *pulsed[FORGE_AXES];
+    uint8_t numPulsed = 0;
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        _error[a] += seg->steps[a];
+        if (_error[a] < seg->events)
+            continue;
+        _error[a] -= seg->events;
+
+        StepperConfig *cfg = _axes[a];
+        if (cfg == NULL)
+            continue;
+        int32_t next = cfg->currentPosition + _delta[a];
+        if (cfg->minPosition != cfg->maxPosition &&
+            (next < cfg->minPosition || next > cfg->maxPosition))
+        {
+            cfg->lastError = (next < cfg->minPosition) ? STEPPER_REACHED_MIN_POS : STEPPER_REACHED_MAX_POS;
+            continue;
+        }
+        cfg->currentPosition = next;
+        _position[a] += _sign[a];
+        // Straight to BSRR; this runs up to 100k times a second
+        FORGE_BSRR(cfg->STEPx, cfg->STEP_Pin);
+        pulsed[numPulsed++] = cfg;
+    }
+
+    // Keep STEP high for at least 100ns (17 cycles at 168MHz)
+    for (uint8_t i = 0; i < 17; i++)
+        __NOP();
+    for (uint8_t i = 0; i < numPulsed; i++)
+    {
+        FORGE_BSRR(pulsed[i]->STEPx, pulsed[i]->STEP_Pin << 16);
+    }
+    _stats.events++;
+
+    if (--_remaining == 0)
+    {
+        _stats.segments++;
+        traceEvent(TRACE_SEGMENT_END, seg->tag.offset);
+        motionSegmentDone(seg, _position);
+        _tail = _tail + 1;
+        if (!_loadNext())
+        {
+            if (_streaming && !_draining)
+            {
+                _stats.underruns++;
+                traceEvent(TRACE_UNDERRUN, _stats.segments);
+            }
+            _stopTimer();
+        }
+        if (_waiting && _waitOver())
+        {
+            _waiting = false;
+            NVIC_SetPendingIRQ(MOTION_WAKE_IRQn);
+        }
+    }
+    else if (_remaining <= seg->events - seg->ramp.decelAfter || seg->events - _remaining <= seg->ramp.accelUntil)
+    {
+        // Ramping, or the first event at full speed after it
+        _setInterval(_nextInterval(seg));
+    }
+}
+
+/**
+ * @brief  Wakes the task in motionWait. Must be called from the MOTION_WAKE_IRQn interrupt handler.
+ * @headerfile motion.h
+ */
+void motionWakeIRQHandler(void)
+{
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_wake, &woken);
+    portYIELD_FROM_ISR(woken);
+}
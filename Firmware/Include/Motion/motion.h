@@ -0,0 +1,118 @@
+/**
+ * @file motion.h
+ * @brief Timer-driven step generation from a queue of straight-line segments.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_MOTION_H
+#define __FORGE_MOTION_H
+
+#include "../Stepper/stepper.h"
+#include "../DSP/Include/arm_math.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FORGE_AXES 4 // X, Y, Z, E
+
+#define MOTION_AXIS_X 0
+#define MOTION_AXIS_Y 1
+#define MOTION_AXIS_Z 2
+#define MOTION_AXIS_E 3
+
+// Must be a power of two. The planner ends the queue at rest, so a move
+// only reaches a speed once the queue holds the distance to stop from it,
+// v^2/2a: 500mm/s at 6000mm/s^2 (forge-motion.h) is 20.8mm, 208 segments of
+// 0.1mm. 256 of them are ~51ms of motion at that speed.
+#define MOTION_QUEUE_LENGTH 256
+#define MOTION_TIMER_HZ 4000000 // 0.25us resolution; longer than 16ms takes several timer periods
+#define MOTION_MIN_INTERVAL 40  // 10us, 100k step events per second
+
+// TIM7 is a basic timer with nothing else to do; its handler must call motionTimerIRQHandler()
+#define MOTION_TIMER TIM7
+#define MOTION_TIMER_IRQn TIM7_IRQn
+// The step interrupt runs above the kernel, so it wakes a task in motionWait
+// by pending this one, which doesn't. TIM6 and the DAC are unused, so nothing
+// else raises it; its handler must call motionWakeIRQHandler()
+#define MOTION_WAKE_IRQn TIM6_DAC_IRQn
+// motionWait for room returns once this many slots are free, so the planner
+// refills the queue in bursts rather than being woken for every segment
+#define MOTION_WAKE_ROOM 16
+// Longest motionWait blocks without being woken, in case a wake-up is missed
+#define MOTION_WAIT_MS 5
+
+    /**
+     * @brief How a segment's speed changes along it: up from the entry speed over the first accelUntil step events, and down to the exit speed over the events after decelAfter. Speeds are in step events a second. The planner may change it with motionRetime until the segment starts.
+     */
+    typedef struct
+    {
+        float32_t entry2;    // Entry speed squared
+        float32_t exit2;     // Exit speed squared
+        uint32_t accelUntil; // Events spent speeding up, from the start
+        uint32_t decelAfter; // Events before slowing down, at most events
+    } MotionRamp;
+
+    /**
+     * @brief Where a segment came from, copied from the planner into the segment and opaque to the step interrupt. gcode.c keeps the file offset of the line and the modes the line started in, which is what a resumed print needs to run it again.
+     */
+    typedef struct
+    {
+        uint32_t offset; // e.g. the file offset of the line
+        uint16_t feed;   // e.g. the feed in force, in mm/min
+        uint8_t flags;   // e.g. GCODE_TAG_RELATIVE
+    } MotionTag;
+
+    /**
+     * @brief A straight line in step space. Every axis steps in proportion to the axis with the most steps (Bresenham), one step event every interval timer ticks once at speed, and closer together or further apart as the ramp says at its ends.
+     */
+    typedef struct
+    {
+        uint32_t steps[FORGE_AXES]; // Unsigned step count per axis
+        uint32_t events;            // Largest of steps[], the number of step events
+        uint32_t interval;          // Timer ticks between step events at full speed
+        float32_t accel2;           // Twice the acceleration, in step events a second squared
+        MotionRamp ramp;
+        uint8_t dirMask;            // Bit n set means axis n moves in STEP_DIR_1
+        MotionTag tag;
+    } MotionSegment;
+
+    /**
+     * @brief Counters kept by the step interrupt. Read them with motionGetStats.
+     */
+    typedef struct
+    {
+        uint32_t segments;  // Segments completed
+        uint32_t events;    // Step events generated
+        uint32_t underruns; // Times the queue ran dry while streaming
+    } MotionStats;
+
+    void motionInit(StepperConfig *axes[FORGE_AXES]);
+    bool motionPush(const MotionSegment *seg);
+    uint32_t motionPushed(void);
+    uint32_t motionRetimable(void);
+    bool motionRetime(uint32_t id, const MotionRamp *ramp);
+    uint32_t motionQueueFree(void);
+    bool motionIdle(void);
+    uint32_t motionQuietTicks(void);
+    void motionWait(bool idle);
+    void motionSetStreaming(bool streaming);
+    void motionGetStats(MotionStats *stats);
+    bool motionSnapshot(MotionTag *tag, int32_t position[FORGE_AXES]);
+    void motionSetPosition(const int32_t position[FORGE_AXES]);
+    void motionSegmentDone(const MotionSegment *seg, const int32_t position[FORGE_AXES]);
+    void motionTimerIRQHandler(void);
+    void motionWakeIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_MOTION_H */
@@ -0,0 +1,379 @@
+/**
+ * @file planner.c
+ * @brief Turns moves in millimeters into step segments for the motion queue.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "planner.h"
+#include "../Core/memory.h"
+#include "../Core/trace.h"
+#include "../DSP/Include/arm_math.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <math.h>
+
+/**
+ * @brief What the planner keeps about a queued segment to replan its speeds, in mm along its path (or along E, for an extrude-only move).
+ */
+typedef struct
+{
+    float32_t length;
+    float32_t eventsPerMm; // The segment's step events per mm of length
+    float32_t accel;       // mm/s^2, what its axes' limits allow along it
+    float32_t cruise;      // mm/s, the speed it asked for, within its axes' limits
+    float32_t maxEntry;    // mm/s, what the corner from the segment before allows
+    float32_t entry;       // mm/s, as its ramp was last queued with
+    float32_t exit;
+    float32_t planEntry;   // mm/s, while replanning
+    float32_t planExit;
+    uint32_t events;
+    MotionRamp ramp; // For planEntry and planExit, until it's queued
+} PlannerBlock;
+
+// One for each slot of the motion queue, by segment number (motionPushed)
+static PlannerBlock _blocks[MOTION_QUEUE_LENGTH];
+
+Planner createPlanner(const float32_t stepsPerMm[FORGE_AXES], const float32_t maxFeed[FORGE_AXES],
+                      const float32_t maxAccel[FORGE_AXES])
+{
+    Planner out;
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        out.stepsPerMm[a] = stepsPerMm[a];
+        out.maxFeed[a] = maxFeed[a];
+        out.maxAccel[a] = maxAccel[a];
+        out.position[a] = 0.0f;
+        out.stepPosition[a] = 0;
+    }
+    for (uint8_t i = 0; i < 3; i++)
+        out.unit[i] = 0.0f;
+    out.lastCruise = 0.0f;
+    out.lastCentripetal = 0.0f;
+    out.planned = 0;
+    out.dryRun = false;
+    out.tag.offset = 0;
+    out.tag.feed = 0;
+    out.tag.flags = 0;
+    out.segments = 0;
+    out.waits = 0;
+    out.lastError = PLANNER_ERROR_NONE;
+    forgeMemoryAdd("planner", _blocks, sizeof(_blocks));
+    return out;
+}
+
+static float32_t _sqrt(float32_t x)
+{
+    float32_t out;
+    arm_sqrt_f32(x, &out);
+    return out;
+}
+
+/**
+ * @brief  The ramp that takes a segment from entry to exit, as near its cruise speed as its length allows, in its own step events.
+ */
+static void _ramp(const PlannerBlock *b, float32_t entry, float32_t exit, MotionRamp *ramp)
+{
+    float32_t twoAccel = 2.0f * b->accel;
+    float32_t accelLength = (b->cruise * b->cruise - entry * entry) / twoAccel;
+    float32_t decelLength = (b->cruise * b->cruise - exit * exit) / twoAccel;
+    if (accelLength + decelLength > b->length)
+    {
+        // Too short to reach cruise: up until the two ramps meet, then down
+        accelLength = (twoAccel * b->length + exit * exit - entry * entry) / (2.0f * twoAccel);
+        if (accelLength < 0.0f)
+            accelLength = 0.0f;
+        if (accelLength > b->length)
+            accelLength = b->length;
+        decelLength = b->length - accelLength;
+    }
+    uint32_t decel = (uint32_t)(decelLength * b->eventsPerMm + 0.5f);
+    ramp->entry2 = entry * entry * b->eventsPerMm * b->eventsPerMm;
+    ramp->exit2 = exit * exit * b->eventsPerMm * b->eventsPerMm;
+    ramp->decelAfter = (decel < b->events) ? b->events - decel : 0;
+    ramp->accelUntil = (uint32_t)(accelLength * b->eventsPerMm + 0.5f);
+    if (ramp->accelUntil > ramp->decelAfter)
+        ramp->accelUntil = ramp->decelAfter;
+}
+
+/**
+ * @brief  Replans the speeds of the queued segments the step interrupt hasn't started on, now that the newest has been added, and retimes the ones that change. The newest always ends at rest, so however long the next move takes to come, the queue runs dry stopped. The passes are Grbl's: backwards from the newest, each entry as fast as stopping by the end allows; then forwards from the oldest that can change, each exit as fast as speeding up from its entry allows.
+ */
+static void _replan(Planner *pl)
+{
+    uint32_t end = motionPushed();
+    for (;;)
+    {
+        // The oldest that can change: the one after any running, or the
+        // first that could still get faster
+        uint32_t from = motionRetimable();
+        if ((int32_t)(pl->planned - from) > 0)
+            from = pl->planned;
+        if ((int32_t)(end - from) <= 0)
+            return;
+        uint32_t planned = pl->planned;
+
+        float32_t exit = 0.0f;
+        for (uint32_t id = end - 1; id != from; id--)
+        {
+            PlannerBlock *b = &_blocks[id & (MOTION_QUEUE_LENGTH - 1)];
+            float32_t entry = _sqrt(exit * exit + 2.0f * b->accel * b->length);
+            b->planEntry = (entry < b->maxEntry) ? entry : b->maxEntry;
+            exit = b->planEntry;
+        }
+
+        // Its entry is the exit of the one before, which is running or can't change
+        float32_t entry = _blocks[from & (MOTION_QUEUE_LENGTH - 1)].entry;
+        for (uint32_t id = from; id != end; id++)
+        {
+            PlannerBlock *b = &_blocks[id & (MOTION_QUEUE_LENGTH - 1)];
+            PlannerBlock *next = (id + 1 != end) ? &_blocks[(id + 1) & (MOTION_QUEUE_LENGTH - 1)] : NULL;
+            float32_t reachable = _sqrt(entry * entry + 2.0f * b->accel * b->length);
+            exit = (next != NULL) ? next->planEntry : 0.0f;
+            // The next can't get any faster if this one speeds up all along to
+            // reach it, or if it's at its corner's limit
+            if (exit >= reachable)
+            {
+                exit = reachable;
+                planned = id + 1;
+            }
+            else if (next != NULL && exit >= next->maxEntry)
+            {
+                planned = id + 1;
+            }
+            b->planEntry = entry;
+            b->planExit = exit;
+            if (entry != b->entry || exit != b->exit)
+                _ramp(b, entry, exit, &b->ramp);
+            entry = exit;
+        }
+
+        // Worked out with interrupts on, swapped in with them off: a few
+        // copies, fewer the further ahead the queue is planned
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        bool started = (int32_t)(motionRetimable() - from) > 0;
+        if (!started)
+        {
+            for (uint32_t id = from; id != end; id++)
+            {
+                PlannerBlock *b = &_blocks[id & (MOTION_QUEUE_LENGTH - 1)];
+                if (b->planEntry == b->entry && b->planExit == b->exit)
+                    continue;
+                motionRetime(id, &b->ramp);
+                b->entry = b->planEntry;
+                b->exit = b->planExit;
+            }
+        }
+        __set_PRIMASK(primask);
+        if (!started)
+        {
+            pl->planned = planned;
+            return;
+        }
+        // It started on from with the old speeds meanwhile; plan from the next
+    }
+}
+
+/**
+ * @brief  Plans a straight move to target at feed and queues it, blocking the calling task while the motion queue is full. The speed is the requested feed along the XYZ path (or along E for extrude-only moves), lowered as needed so no axis exceeds its maxFeed, and reached and left at each axis's maxAccel at most. Each move is queued to end at rest and the ones queued ahead of it that haven't started are sped up to meet it.
+ * @param[in]  pl is the planner.
+ * @param[in]  target is the absolute end position of every axis in mm.
+ * @param[in]  feed is the requested speed in mm/s.
+ * @retval None
+ * @headerfile planner.h
+ */
+void plannerLine(Planner *pl, const float32_t target[FORGE_AXES], float32_t feed)
+{
+    if (!(feed > 0.0f))
+    {
+        pl->lastError = PLANNER_ERROR_INVALID_FEED;
+        return;
+    }
+
+    MotionSegment seg;
+    seg.events = 0;
+    seg.dirMask = 0;
+    seg.tag = pl->tag;
+    float32_t delta[FORGE_AXES];
+    int32_t stepTarget[FORGE_AXES];
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        delta[a] = target[a] - pl->position[a];
+        stepTarget[a] = (int32_t)lroundf(target[a] * pl->stepsPerMm[a]);
+        int32_t steps = stepTarget[a] - pl->stepPosition[a];
+        if (steps < 0)
+        {
+            steps = -steps;
+        }
+        else
+        {
+            seg.dirMask |= 1 << a;
+        }
+        seg.steps[a] = (uint32_t)steps;
+        if (seg.steps[a] > seg.events)
+            seg.events = seg.steps[a];
+    }
+
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        pl->position[a] = target[a];
+    }
+    if (seg.events == 0)
+    {
+        // Shorter than a step; the remainder carries into the next move
+        pl->lastError = PLANNER_ERROR_ZERO_LENGTH;
+        return;
+    }
+
+    float32_t length;
+    arm_sqrt_f32(delta[MOTION_AXIS_X] * delta[MOTION_AXIS_X] +
+                     delta[MOTION_AXIS_Y] * delta[MOTION_AXIS_Y] +
+                     delta[MOTION_AXIS_Z] * delta[MOTION_AXIS_Z],
+                 &length);
+    float32_t unit[3] = {0.0f, 0.0f, 0.0f};
+    if (length == 0.0f)
+    {
+        length = fabsf(delta[MOTION_AXIS_E]);
+    }
+    else
+    {
+        for (uint8_t i = 0; i < 3; i++)
+            unit[i] = delta[i] / length;
+    }
+
+    // Each axis's share of the move's speed and acceleration is its share
+    // of the length, so the slowest axis sets both
+    float32_t seconds = length / feed;
+    float32_t accel = INFINITY;
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        if (delta[a] == 0.0f)
+            continue;
+        float32_t axisSeconds = fabsf(delta[a]) / pl->maxFeed[a];
+        if (axisSeconds > seconds)
+            seconds = axisSeconds;
+        float32_t axisAccel = pl->maxAccel[a] * length / fabsf(delta[a]);
+        if (axisAccel < accel)
+            accel = axisAccel;
+    }
+    float32_t cruise = length / seconds;
+    float32_t interval = (seconds * MOTION_TIMER_HZ) / (float32_t)seg.events;
+    seg.interval = (interval >= (float32_t)0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)interval;
+
+    // The fastest the corner into this move can be taken: Grbl's junction
+    // deviation, from the speed a square corner may be taken at. Stopped
+    // when either side is extrude-only or there's nothing before it.
+    float32_t maxEntry = 0.0f;
+    float32_t prevUnit2 = pl->unit[0] * pl->unit[0] + pl->unit[1] * pl->unit[1] + pl->unit[2] * pl->unit[2];
+    if (unit[0] != 0.0f || unit[1] != 0.0f || unit[2] != 0.0f)
+    {
+        if (prevUnit2 > 0.0f)
+        {
+            float32_t cosTheta = -(pl->unit[0] * unit[0] + pl->unit[1] * unit[1] + pl->unit[2] * unit[2]);
+            maxEntry = (cruise < pl->lastCruise) ? cruise : pl->lastCruise;
+            if (cosTheta > -0.999999f)
+            {
+                float32_t sinHalf = _sqrt(0.5f * (1.0f - cosTheta));
+                float32_t junction2 = PLANNER_CORNER_SPEED * PLANNER_CORNER_SPEED * 0.41421356f *
+                                      sinHalf / (1.0f - sinHalf);
+                // A curve cut into moves shorter than that corner's arc would
+                // be taken faster than its acceleration allows going round it;
+                // Klipper's cap, from half of either move's length
+                float32_t centripetal = 0.5f * length * accel;
+                if (pl->lastCentripetal < centripetal)
+                    centripetal = pl->lastCentripetal;
+                centripetal *= sinHalf / _sqrt(0.5f * (1.0f + cosTheta));
+                if (centripetal < junction2)
+                    junction2 = centripetal;
+                float32_t junction = _sqrt(junction2);
+                if (junction < maxEntry)
+                    maxEntry = junction;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < 3; i++)
+        pl->unit[i] = unit[i];
+    pl->lastCruise = cruise;
+    pl->lastCentripetal = 0.5f * length * accel;
+
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        pl->stepPosition[a] = stepTarget[a];
+    }
+    pl->segments++;
+    pl->lastError = PLANNER_ERROR_NONE;
+    if (pl->dryRun)
+        return;
+
+    union
+    {
+        float32_t f;
+        uint32_t u;
+    } speed = {cruise};
+    traceEvent(TRACE_SPEED, speed.u);
+
+    // Its block shares a slot with the segment a full queue ago, which may
+    // still be replanned, so there has to be room before it's filled in
+    if (motionQueueFree() == 0)
+    {
+        pl->waits++;
+        // Woken by the step interrupt once there's room for a burst
+        do
+        {
+            motionWait(false);
+        } while (motionQueueFree() == 0);
+    }
+
+    // Queued to start and end at rest, then sped up by the replan
+    PlannerBlock *b = &_blocks[motionPushed() & (MOTION_QUEUE_LENGTH - 1)];
+    b->length = length;
+    b->eventsPerMm = (float32_t)seg.events / length;
+    b->accel = accel;
+    b->cruise = cruise;
+    b->maxEntry = maxEntry;
+    b->entry = 0.0f;
+    b->exit = 0.0f;
+    b->events = seg.events;
+    _ramp(b, 0.0f, 0.0f, &b->ramp);
+    seg.accel2 = 2.0f * accel * b->eventsPerMm;
+    seg.ramp = b->ramp;
+    motionPush(&seg);
+    _replan(pl);
+}
+
+/**
+ * @brief  Redefines the current position without moving (G92). Waits for queued motion to finish first.
+ * @param[in]  position is the new position of every axis in mm.
+ * @retval None
+ * @headerfile planner.h
+ */
+void plannerSetPosition(Planner *pl, const float32_t position[FORGE_AXES])
+{
+    plannerSync(pl);
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        pl->position[a] = position[a];
+        pl->stepPosition[a] = (int32_t)lroundf(position[a] * pl->stepsPerMm[a]);
+    }
+    if (!pl->dryRun)
+        motionSetPosition(pl->stepPosition);
+    pl->lastError = PLANNER_ERROR_NONE;
+}
+
+/**
+ * @brief  Blocks the calling task until every queued segment has been stepped.
+ * @retval None
+ * @headerfile planner.h
+ */
+void plannerSync(Planner *pl)
+{
+    if (pl->dryRun)
+        return;
+    while (!motionIdle())
+    {
+        motionWait(true);
+    }
+}
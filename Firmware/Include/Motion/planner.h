@@ -0,0 +1,75 @@
+/**
+ * @file planner.h
+ * @brief Turns moves in millimeters into step segments for the motion queue.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_PLANNER_H
+#define __FORGE_PLANNER_H
+
+#include "motion.h"
+#include "../DSP/Include/arm_math.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Stores an error from the last planner call.
+     */
+    typedef enum
+    {
+        PLANNER_ERROR_NONE = 0,
+        PLANNER_ERROR_INVALID_FEED,
+        PLANNER_ERROR_ZERO_LENGTH // Not fatal, the move was simply dropped
+    } PlannerError;
+
+// The speed a 90 degree corner is taken at; others are faster the shallower
+// they are, down to none for a reversal. Klipper's square_corner_velocity.
+#define PLANNER_CORNER_SPEED 5.0f // mm/s
+
+    /**
+     * @brief Stores the machine position and the limits used to plan moves.
+     */
+    typedef struct
+    {
+        float32_t stepsPerMm[FORGE_AXES];
+        float32_t maxFeed[FORGE_AXES];  // mm/s, per axis
+        float32_t maxAccel[FORGE_AXES]; // mm/s^2, per axis
+
+        float32_t position[FORGE_AXES]; // mm, end of the last planned move
+        int32_t stepPosition[FORGE_AXES];
+
+        uint32_t planned;   // Segments before this one are as fast as they'll ever get
+        float32_t unit[3];  // Direction of the last segment in XYZ, zero for an extrude-only one
+        float32_t lastCruise;
+        float32_t lastCentripetal; // Half the last segment's length times its acceleration
+
+        bool dryRun; // Plan segments but don't queue them, for benchmarking
+        MotionTag tag; // Copied into each segment
+
+        uint32_t segments; // Segments planned
+        uint32_t waits;    // Times the planner blocked on a full motion queue
+
+        PlannerError lastError;
+    } Planner;
+
+    Planner createPlanner(const float32_t stepsPerMm[FORGE_AXES], const float32_t maxFeed[FORGE_AXES],
+                          const float32_t maxAccel[FORGE_AXES]);
+
+    void plannerLine(Planner *pl, const float32_t target[FORGE_AXES], float32_t feed);
+    void plannerSetPosition(Planner *pl, const float32_t position[FORGE_AXES]);
+    void plannerSync(Planner *pl);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_PLANNER_H */
@@ -0,0 +1,275 @@
+/**
+ * @file effects.c
+ * @brief Frame-based status effects for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "effects.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#define NPFX_REDRAW 0xFFFF
+
+/**
+ * @brief  Linear blend between two packed WRGB colors.
+ * @param[in]  a is the color at t = 0.
+ * @param[in]  b is the color at t = 256.
+ * @param[in]  t is the blend factor, 0-256.
+ * @retval The blended packed color.
+ */
+static uint32_t _blend(uint32_t a, uint32_t b, uint16_t t)
+{
+    uint32_t out = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 8)
+    {
+        int32_t ca = (a >> shift) & 0xFF;
+        int32_t cb = (b >> shift) & 0xFF;
+        out |= (uint32_t)((ca + (((cb - ca) * (int32_t)t) >> 8)) & 0xFF) << shift;
+    }
+    return out;
+}
+
+/**
+ * @brief  Scale every component of a packed color by level/256.
+ */
+static uint32_t _scale(uint32_t c, uint16_t level)
+{
+    return _blend(0, c, level);
+}
+
+static void _fillRange(NeoPixelString *nps, uint16_t first, uint16_t count, uint32_t c)
+{
+    for (uint16_t i = first; i < first + count; i++)
+    {
+        NPsetPixelColorC(nps, i, c);
+    }
+}
+
+/**
+ * @brief  Prepares an effects engine for a string. Effects are then added with the NPfxAdd* functions and rendered by calling NPfxTick from the main loop as often as convenient; frames are rate-limited to fps.
+ * @param[in]  fx is the engine to initialize.
+ * @param[in]  nps is the string the effects draw into. Brightness and gamma are still applied by the string on output.
+ * @param[in]  fps is the frame rate, 0 for NPFX_DEFAULT_FPS.
+ * @retval None
+ * @headerfile effects.h
+ */
+void NPfxInit(NeoPixelEffects *fx, NeoPixelString *nps, uint32_t fps)
+{
+    fx->nps = nps;
+    fx->frameMs = 1000 / (fps ? fps : NPFX_DEFAULT_FPS);
+    fx->lastFrame = HAL_GetTick();
+    fx->dirty = true;
+    for (uint8_t i = 0; i < NPFX_MAX_EFFECTS; i++)
+    {
+        fx->effects[i].type = NPFX_NONE;
+    }
+}
+
+static int8_t _add(NeoPixelEffects *fx, NeoPixelEffectType type, uint16_t first,
+                   uint16_t count, uint32_t colorA, uint32_t colorB)
+{
+    for (int8_t i = 0; i < NPFX_MAX_EFFECTS; i++)
+    {
+        NeoPixelEffect *e = &fx->effects[i];
+        if (e->type == NPFX_NONE)
+        {
+            e->type = type;
+            e->first = first;
+            e->count = count;
+            e->colorA = colorA;
+            e->colorB = colorB;
+            e->target = 0;
+            e->shown = NPFX_REDRAW;
+            e->periodMs = 0;
+            e->lastLevel = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief  Adds a progress bar covering count pixels from first. The pixel at the fill edge is blended, so the bar moves in 1/256 pixel steps.
+ * @retval The effect id, or -1 if NPFX_MAX_EFFECTS are already in use.
+ * @headerfile effects.h
+ */
+int8_t NPfxAddProgress(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                       uint32_t filled, uint32_t empty)
+{
+    return _add(fx, NPFX_PROGRESS, first, count, filled, empty);
+}
+
+/**
+ * @brief  Adds a heater indicator: count pixels from first show a blend from cold to hot as the heater approaches its target.
+ * @retval The effect id, or -1 if NPFX_MAX_EFFECTS are already in use.
+ * @headerfile effects.h
+ */
+int8_t NPfxAddTemperature(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                          uint32_t cold, uint32_t hot)
+{
+    return _add(fx, NPFX_TEMPERATURE, first, count, cold, hot);
+}
+
+/**
+ * @brief  Adds a breathing pulse of color with the given period.
+ * @retval The effect id, or -1 if NPFX_MAX_EFFECTS are already in use.
+ * @headerfile effects.h
+ */
+int8_t NPfxAddPulse(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                    uint32_t color, uint32_t periodMs)
+{
+    int8_t id = _add(fx, NPFX_PULSE, first, count, color, 0);
+    if (id >= 0)
+    {
+        fx->effects[id].periodMs = periodMs ? periodMs : 1;
+    }
+    return id;
+}
+
+/**
+ * @brief  Removes an effect and blanks its pixels.
+ * @headerfile effects.h
+ */
+void NPfxRemove(NeoPixelEffects *fx, int8_t id)
+{
+    if (id < 0 || id >= NPFX_MAX_EFFECTS)
+        return;
+    NeoPixelEffect *e = &fx->effects[id];
+    _fillRange(fx->nps, e->first, e->count, 0);
+    e->type = NPFX_NONE;
+    fx->dirty = true;
+}
+
+/**
+ * @brief  Sets the value shown by a progress bar.
+ * @param[in]  permille is the progress, 0-1000.
+ * @headerfile effects.h
+ */
+void NPfxSetProgress(NeoPixelEffects *fx, int8_t id, uint16_t permille)
+{
+    if (id < 0 || id >= NPFX_MAX_EFFECTS)
+        return;
+    fx->effects[id].target = (permille > 1000) ? 1000 : permille;
+}
+
+/**
+ * @brief  Sets the reading shown by a heater indicator. The blend is quantized to 256 steps, so small temperature noise doesn't cause redraws.
+ * @param[in]  current is the measured temperature.
+ * @param[in]  ambient is the temperature shown fully cold.
+ * @param[in]  target is the temperature shown fully hot.
+ * @headerfile effects.h
+ */
+void NPfxSetTemperature(NeoPixelEffects *fx, int8_t id, float32_t current,
+                        float32_t ambient, float32_t target)
+{
+    if (id < 0 || id >= NPFX_MAX_EFFECTS)
+        return;
+    float32_t t = 0.0f;
+    if (target > ambient)
+    {
+        t = (current - ambient) / (target - ambient);
+    }
+    if (t < 0.0f)
+        t = 0.0f;
+    if (t > 1.0f)
+        t = 1.0f;
+    fx->effects[id].target = (uint16_t)(t * 256.0f);
+}
+
+static void _renderProgress(NeoPixelEffects *fx, NeoPixelEffect *e)
+{
+    if (e->target == e->shown)
+        return;
+
+    // Fill edge in 1/256 pixel units
+    uint32_t edge = ((uint32_t)e->target * e->count * 256) / 1000;
+    uint16_t from = 0, to = e->count;
+    if (e->shown != NPFX_REDRAW)
+    {
+        // Only the pixels between the old and new edge change
+        uint32_t oldEdge = ((uint32_t)e->shown * e->count * 256) / 1000;
+        uint32_t lo = (oldEdge < edge) ? oldEdge : edge;
+        uint32_t hi = (oldEdge < edge) ? edge : oldEdge;
+        from = lo >> 8;
+        to = (hi >> 8) + 1;
+        if (to > e->count)
+            to = e->count;
+    }
+
+    for (uint16_t i = from; i < to; i++)
+    {
+        uint32_t c;
+        if (((uint32_t)(i + 1) << 8) <= edge)
+            c = e->colorA;
+        else if (((uint32_t)i << 8) >= edge)
+            c = e->colorB;
+        else
+            c = _blend(e->colorB, e->colorA, edge & 0xFF);
+        NPsetPixelColorC(fx->nps, e->first + i, c);
+    }
+    e->shown = e->target;
+    fx->dirty = true;
+}
+
+static void _renderTemperature(NeoPixelEffects *fx, NeoPixelEffect *e)
+{
+    if (e->target == e->shown)
+        return;
+    _fillRange(fx->nps, e->first, e->count, _blend(e->colorA, e->colorB, e->target));
+    e->shown = e->target;
+    fx->dirty = true;
+}
+
+static void _renderPulse(NeoPixelEffects *fx, NeoPixelEffect *e, uint32_t now)
+{
+    uint8_t phase = (uint8_t)(((now % e->periodMs) * 256) / e->periodMs);
+    uint8_t level = _NeoPixelSineTable[phase];
+    if (level == e->lastLevel && e->shown != NPFX_REDRAW)
+        return;
+    _fillRange(fx->nps, e->first, e->count, _scale(e->colorA, (uint16_t)level + 1));
+    e->lastLevel = level;
+    e->shown = 0;
+    fx->dirty = true;
+}
+
+/**
+ * @brief  Renders one frame if at least frameMs have passed since the last one. Each effect only rewrites the pixels that changed, and the string is only sent when something did change, so a static display costs almost nothing.
+ * @param[in]  fx is the effects engine.
+ * @retval true if a frame was sent to the string.
+ * @headerfile effects.h
+ */
+bool NPfxTick(NeoPixelEffects *fx)
+{
+    uint32_t now = HAL_GetTick();
+    if (now - fx->lastFrame < fx->frameMs)
+        return false;
+    fx->lastFrame = now;
+
+    for (uint8_t i = 0; i < NPFX_MAX_EFFECTS; i++)
+    {
+        NeoPixelEffect *e = &fx->effects[i];
+        switch (e->type)
+        {
+        case NPFX_PROGRESS:
+            _renderProgress(fx, e);
+            break;
+        case NPFX_TEMPERATURE:
+            _renderTemperature(fx, e);
+            break;
+        case NPFX_PULSE:
+            _renderPulse(fx, e, now);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!fx->dirty)
+        return false;
+    NPshow(fx->nps);
+    fx->dirty = false;
+    return true;
+}
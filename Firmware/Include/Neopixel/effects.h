@@ -0,0 +1,83 @@
+/**
+ * @file effects.h
+ * @brief Frame-based status effects for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_NEOPIXEL_EFFECTS_H
+#define __FORGE_NEOPIXEL_EFFECTS_H
+
+#include "neopixel.h"
+#include "../DSP/Include/arm_math.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NPFX_MAX_EFFECTS 4
+#define NPFX_DEFAULT_FPS 30
+
+    typedef enum
+    {
+        NPFX_NONE = 0,
+        NPFX_PROGRESS,    ///< Bar filling with print progress
+        NPFX_TEMPERATURE, ///< Cold->hot color blend from current/target temperature
+        NPFX_PULSE        ///< Color breathing on a sine curve
+    } NeoPixelEffectType;
+
+    /**
+     * @brief One effect bound to a range of pixels. The fields under each
+     * type are that effect's state; effects only write the pixels whose value
+     * actually changes, so an idle effect costs a few compares per frame.
+     */
+    typedef struct
+    {
+        NeoPixelEffectType type;
+        uint16_t first;
+        uint16_t count;
+        uint32_t colorA; ///< Progress: filled, temperature: cold, pulse: color
+        uint32_t colorB; ///< Progress: empty, temperature: hot
+
+        uint16_t target; ///< Progress: 0-1000 permille, temperature: 0-256 blend
+        uint16_t shown;  ///< Value last rendered; 0xFFFF forces a redraw
+
+        uint32_t periodMs; ///< Pulse period
+        uint8_t lastLevel; ///< Pulse level last rendered
+    } NeoPixelEffect;
+
+    typedef struct
+    {
+        NeoPixelString *nps;
+        NeoPixelEffect effects[NPFX_MAX_EFFECTS];
+        uint32_t frameMs;   ///< Minimum time between frames
+        uint32_t lastFrame; ///< HAL_GetTick() of the last frame
+        bool dirty;         ///< Pixels changed since the last NPshow()
+    } NeoPixelEffects;
+
+    void NPfxInit(NeoPixelEffects *fx, NeoPixelString *nps, uint32_t fps);
+    int8_t NPfxAddProgress(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                           uint32_t filled, uint32_t empty);
+    int8_t NPfxAddTemperature(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                              uint32_t cold, uint32_t hot);
+    int8_t NPfxAddPulse(NeoPixelEffects *fx, uint16_t first, uint16_t count,
+                        uint32_t color, uint32_t periodMs);
+    void NPfxRemove(NeoPixelEffects *fx, int8_t id);
+
+    void NPfxSetProgress(NeoPixelEffects *fx, int8_t id, uint16_t permille);
+    void NPfxSetTemperature(NeoPixelEffects *fx, int8_t id, float32_t current,
+                            float32_t ambient, float32_t target);
+
+    bool NPfxTick(NeoPixelEffects *fx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_NEOPIXEL_EFFECTS_H */
@@ -11,6 +11,8 @@
 #define __FORGE_NEO_H
 
 #include "neopixel.h"
+#include "neopixel_pwm.h"
+#include "neopixel_spi.h"
 #include "../HAL/stm32f4xx_hal.h"
 
 #ifdef __cplusplus
@@ -20,11 +22,40 @@ extern "C"
 
     extern NeoPixelString neopixels;
 
+// Define FORGE_NEOPIXEL_SPI when the strip data line is wired to PB15
+// (SPI2_MOSI) instead of the default PA3. The probe drives SWDIO from PB15
+// on SPI2, so it can't be built with FORGE_USB_DAP.
+#if defined(FORGE_NEOPIXEL_SPI) && defined(FORGE_USB_DAP)
+#error "FORGE_NEOPIXEL_SPI and FORGE_USB_DAP both need SPI2"
+#endif
+#ifdef FORGE_NEOPIXEL_SPI
+    void initNeopixel(void)
+    {
+        neopixels = createNPS(3, GPIOB, GPIO_PIN_15, NEO_GRB);
+        // SPI2_TX is on DMA1 stream 4 channel 0
+        NPbeginSPI(&neopixels, SPI2, GPIO_AF5_SPI2,
+                   DMA1_Stream4, DMA_CHANNEL_0, DMA1_Stream4_IRQn);
+    }
+
+    void DMA1_Stream4_IRQHandler(void)
+    {
+        NPdmaIRQHandlerSPI();
+    }
+#else
     void initNeopixel(void)
     {
         neopixels = createNPS(3, GPIOA, GPIO_PIN_3, NEO_GRB);
+        // PA3 is TIM5_CH4, whose CC request is on DMA1 stream 1 channel 6
+        NPbeginPWM(&neopixels, TIM5, TIM_CHANNEL_4, GPIO_AF2_TIM5,
+                   DMA1_Stream1, DMA_CHANNEL_6, DMA1_Stream1_IRQn);
     }
 
+    void DMA1_Stream1_IRQHandler(void)
+    {
+        NPdmaIRQHandlerPWM();
+    }
+#endif
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
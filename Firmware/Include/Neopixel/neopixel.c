@@ -8,12 +8,28 @@
  */
 
 #include "neopixel.h"
+#include "neopixel_pwm.h"
+#include "neopixel_spi.h"
+#include "neopixel_batch.h"
 #include <stdbool.h>
+#include <ctype.h>
 #include "../HAL/stm32f4xx_hal.h"
 #include "../CMSIS-Core/cmsis_compiler.h"
 
 uint8_t PIXELS_MEM[MAX_PIXELS];
 
+// Brightness/gamma curve applied to every byte on the way out. Rebuilt by
+// NPsetBrightness() and NPsetGamma(); identity until either is used.
+uint8_t PIXELS_OUTPUT[256];
+
+// Front/back copies of the pixel buffer used by the DMA backends. NPshow()
+// snapshots PIXELS_MEM into whichever one isn't on the wire, so the
+// application can keep drawing the next frame while the current one is still
+// being clocked out.
+uint8_t PIXELS_FRAMES[2][MAX_PIXELS];
+
+static void _rebuildOutput(NeoPixelString *nps);
+
 /*!
   @note    Copied from the official adafruit repo
   @brief   "Empty" NeoPixel constructor when length, pin and/or pixel type
@@ -39,6 +55,9 @@ NeoPixelString createNPSvoid(void)
     out.bOffset = 2;
     out.wOffset = 1;
     out.endTime = 0;
+    out.gamma = false;
+    out.backend = NEO_BACKEND_BITBANG;
+    _rebuildOutput(&out);
     return out;
 }
 
@@ -63,6 +82,9 @@ NeoPixelString createNPS(uint16_t n, GPIO_TypeDef *gpioPort, uint32_t gpioPin,
     out.brightness = 0;
     out.pixels = NULL;
     out.endTime = 0;
+    out.gamma = false;
+    out.backend = NEO_BACKEND_BITBANG;
+    _rebuildOutput(&out);
 
     updateType(&out, type);
     updateLength(&out, n);
@@ -145,15 +167,31 @@ void updateType(NeoPixelString *nps, neoPixelType t)
 
 /*!
   @brief   Transmit pixel data in RAM to NeoPixels.
-  @note    Interrupts are temporarily disabled in order to achieve the correct NeoPixel signal timing.
+  @note    With the bit-bang backend, interrupts are temporarily disabled in
+           order to achieve the correct NeoPixel signal timing. With the
+           PWM/DMA or SPI/DMA backends (see NPbeginPWM() and NPbeginSPI())
+           this returns immediately and the frame is clocked out in the
+           background.
   @param   nps         The NeoPixelString structure.
 */
 void NPshow(NeoPixelString *nps)
 {
-    SystemCoreClockUpdate();
     if (!nps->pixels)
         return;
 
+    if (nps->backend == NEO_BACKEND_PWM_DMA)
+    {
+        NPshowPWM(nps);
+        return;
+    }
+    if (nps->backend == NEO_BACKEND_SPI_DMA)
+    {
+        NPshowSPI(nps);
+        return;
+    }
+
+    SystemCoreClockUpdate();
+
     while (!NPcanShow(nps))
         ;
 
@@ -174,7 +212,7 @@ void NPshow(NeoPixelString *nps)
         cyc = DWT_CYCCNT + CYCLES_800;
         while (p < end)
         {
-            pix = *p++;
+            pix = PIXELS_OUTPUT[*p++];
             for (mask = 0x80; mask; mask >>= 1)
             {
                 while (DWT_CYCCNT - cyc < CYCLES_800)
@@ -203,7 +241,7 @@ void NPshow(NeoPixelString *nps)
         cyc = DWT_CYCCNT + CYCLES_400;
         while (p < end)
         {
-            pix = *p++;
+            pix = PIXELS_OUTPUT[*p++];
             for (mask = 0x80; mask; mask >>= 1)
             {
                 while (DWT_CYCCNT - cyc < CYCLES_400)
@@ -267,12 +305,6 @@ void NPsetPixelColorRGB(NeoPixelString *nps, uint16_t n, uint8_t r, uint8_t g, u
 {
     if (n < nps->numLEDs)
     {
-        if (nps->brightness)
-        {
-            r = (r * nps->brightness) >> 8;
-            g = (g * nps->brightness) >> 8;
-            b = (b * nps->brightness) >> 8;
-        }
         uint8_t *p;
         if (nps->wOffset == nps->rOffset)
         {                            // Is an RGB-type strip
@@ -304,13 +336,6 @@ void NPsetPixelColorRGBW(NeoPixelString *nps, uint16_t n, uint8_t r, uint8_t g,
 {
     if (n < nps->numLEDs)
     {
-        if (nps->brightness)
-        {
-            r = (r * nps->brightness) >> 8;
-            g = (g * nps->brightness) >> 8;
-            b = (b * nps->brightness) >> 8;
-            w = (w * nps->brightness) >> 8;
-        }
         uint8_t *p;
         if (nps->wOffset == nps->rOffset)
         {                            // Is an RGB-type strip
@@ -340,12 +365,6 @@ void NPsetPixelColorC(NeoPixelString *nps, uint16_t n, uint32_t c)
     if (n < nps->numLEDs)
     {
         uint8_t *p, r = (uint8_t)(c >> 16), g = (uint8_t)(c >> 8), b = (uint8_t)c;
-        if (nps->brightness)
-        { // See notes in setBrightness()
-            r = (r * nps->brightness) >> 8;
-            g = (g * nps->brightness) >> 8;
-            b = (b * nps->brightness) >> 8;
-        }
         if (nps->wOffset == nps->rOffset)
         {
             p = &nps->pixels[n * 3];
@@ -353,8 +372,7 @@ void NPsetPixelColorC(NeoPixelString *nps, uint16_t n, uint32_t c)
         else
         {
             p = &nps->pixels[n * 4];
-            uint8_t w = (uint8_t)(c >> 24);
-            p[nps->wOffset] = nps->brightness ? ((w * nps->brightness) >> 8) : w;
+            p[nps->wOffset] = (uint8_t)(c >> 24);
         }
         p[nps->rOffset] = r;
         p[nps->gOffset] = g;
@@ -399,7 +417,7 @@ void NPfill(NeoPixelString *nps, uint32_t c, uint16_t first, uint16_t count)
 
     for (i = first; i < end; i++)
     {
-        setPixelColor(nps, i, c);
+        NPsetPixelColorC(nps, i, c);
     }
 }
 
@@ -427,7 +445,7 @@ void NPfill(NeoPixelString *nps, uint32_t c, uint16_t first, uint16_t count)
            one-size-fits-all operation of gamma32(). Diffusing the LEDs also
            really seems to help when using low-saturation colors.
 */
-static uint32_t NPColorHSV(uint16_t hue, uint8_t sat, uint8_t val)
+uint32_t NPColorHSV(uint16_t hue, uint8_t sat, uint8_t val)
 {
     uint8_t r, g, b;
 
@@ -526,10 +544,8 @@ static uint32_t NPColorHSV(uint16_t hue, uint8_t sat, uint8_t val)
   @return  'Packed' 32-bit RGB or WRGB value. Most significant byte is white
            (for RGBW pixels) or 0 (for RGB pixels), next is red, then green,
            and least significant byte is blue.
-  @note    If the strip brightness has been changed from the default value
-           of 255, the color read from a pixel may not exactly match what
-           was previously written with one of the setPixelColor() functions.
-           This gets more pronounced at lower brightness levels.
+  @note    Brightness and gamma are only applied on the way out (see
+           NPencodeOutput()), so this always returns exactly what was set.
 */
 uint32_t NPgetPixelColor(NeoPixelString *nps, uint16_t n)
 {
@@ -541,39 +557,35 @@ uint32_t NPgetPixelColor(NeoPixelString *nps, uint16_t n)
     if (nps->wOffset == nps->rOffset)
     { // Is RGB-type device
         p = &nps->pixels[n * 3];
-        if (nps->brightness)
-        {
-            // Stored color was decimated by setBrightness(). Returned value
-            // attempts to scale back to an approximation of the original 24-bit
-            // value used when setting the pixel color, but there will always be
-            // some error -- those bits are simply gone. Issue is most
-            // pronounced at low brightness levels.
-            return (((uint32_t)(p[nps->rOffset] << 8) / nps->brightness) << 16) |
-                   (((uint32_t)(p[nps->gOffset] << 8) / nps->brightness) << 8) |
-                   ((uint32_t)(p[nps->bOffset] << 8) / nps->brightness);
-        }
-        else
-        {
-            // No brightness adjustment has been made -- return 'raw' color
-            return ((uint32_t)p[nps->rOffset] << 16) | ((uint32_t)p[nps->gOffset] << 8) |
-                   (uint32_t)p[nps->bOffset];
-        }
+        return ((uint32_t)p[nps->rOffset] << 16) | ((uint32_t)p[nps->gOffset] << 8) |
+               (uint32_t)p[nps->bOffset];
     }
     else
     { // Is RGBW-type device
         p = &nps->pixels[n * 4];
-        if (nps->brightness)
-        { // Return scaled color
-            return (((uint32_t)(p[nps->wOffset] << 8) / nps->brightness) << 24) |
-                   (((uint32_t)(p[nps->rOffset] << 8) / nps->brightness) << 16) |
-                   (((uint32_t)(p[nps->gOffset] << 8) / nps->brightness) << 8) |
-                   ((uint32_t)(p[nps->bOffset] << 8) / nps->brightness);
-        }
-        else
-        { // Return raw color
-            return ((uint32_t)p[nps->wOffset] << 24) | ((uint32_t)p[nps->rOffset] << 16) |
-                   ((uint32_t)p[nps->gOffset] << 8) | (uint32_t)p[nps->bOffset];
-        }
+        return ((uint32_t)p[nps->wOffset] << 24) | ((uint32_t)p[nps->rOffset] << 16) |
+               ((uint32_t)p[nps->gOffset] << 8) | (uint32_t)p[nps->bOffset];
+    }
+}
+
+/*!
+  @brief   Rebuild PIXELS_OUTPUT from the string's brightness and gamma
+           settings. Gamma is applied first so dimming keeps the corrected
+           curve shape.
+  @param   nps         The NeoPixelString structure.
+*/
+static void _rebuildOutput(NeoPixelString *nps)
+{
+    // brightness is stored +1 with 0 meaning unscaled; see NPsetBrightness()
+    uint16_t scale = nps->brightness ? nps->brightness : 256;
+    for (uint16_t i = 0; i < 256; i++)
+    {
+        uint8_t v = nps->gamma ? _NeoPixelGammaTable[i] : (uint8_t)i;
+        PIXELS_OUTPUT[i] = (uint8_t)((v * scale) >> 8);
+    }
+    if (nps->backend == NEO_BACKEND_SPI_DMA)
+    {
+        NPrebuildLUTSPI();
     }
 }
 
@@ -583,15 +595,10 @@ uint32_t NPgetPixelColor(NeoPixelString *nps, uint16_t n)
            refresh the LEDs at this level.
   @param   nps         The NeoPixelString structure.
   @param   b  Brightness setting, 0=minimum (off), 255=brightest.
-  @note    This was intended for one-time use in one's setup() function,
-           not as an animation effect in itself. Because of the way this
-           library "pre-multiplies" LED colors in RAM, changing the
-           brightness is often a "lossy" operation -- what you write to
-           pixels isn't necessary the same as what you'll read back.
-           Repeated brightness changes using this function exacerbate the
-           problem. Smart programs therefore treat the strip as a
-           write-only resource, maintaining their own state to render each
-           frame of an animation, not relying on read-modify-write.
+  @note    Brightness is applied while the frame is encoded for output,
+           through the PIXELS_OUTPUT table, so the pixel buffer keeps the
+           colors exactly as they were set. It is fine to use this as an
+           animation effect; it costs one 256-entry table rebuild per change.
 */
 void NPsetBrightness(NeoPixelString *nps, uint8_t b)
 {
@@ -603,32 +610,41 @@ void NPsetBrightness(NeoPixelString *nps, uint8_t b)
     // brightness (off), 255 = just below max brightness.
     uint8_t newBrightness = b + 1;
     if (newBrightness != nps->brightness)
-    { // Compare against prior value
-        // Brightness has changed -- re-scale existing data in RAM,
-        // This process is potentially "lossy," especially when increasing
-        // brightness. The tight timing in the WS2811/WS2812 code means there
-        // aren't enough free cycles to perform this scaling on the fly as data
-        // is issued. So we make a pass through the existing color data in RAM
-        // and scale it (subsequent graphics commands also work at this
-        // brightness level). If there's a significant step up in brightness,
-        // the limited number of steps (quantization) in the old data will be
-        // quite visible in the re-scaled version. For a non-destructive
-        // change, you'll need to re-render the full strip data. C'est la vie.
-        uint8_t c, *ptr = nps->pixels,
-                   oldBrightness = nps->brightness - 1; // De-wrap old brightness value
-        uint16_t scale;
-        if (oldBrightness == 0)
-            scale = 0; // Avoid /0
-        else if (b == 255)
-            scale = 65535 / oldBrightness;
-        else
-            scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
-        for (uint16_t i = 0; i < nps->numBytes; i++)
-        {
-            c = *ptr;
-            *ptr++ = (c * scale) >> 8;
-        }
+    {
         nps->brightness = newBrightness;
+        _rebuildOutput(nps);
+    }
+}
+
+/*!
+  @brief   Enable or disable gamma correction on output. Like brightness this
+           is applied while encoding, the same curve as gamma32().
+  @param   nps         The NeoPixelString structure.
+  @param   enabled     true to gamma-correct every byte sent to the strip.
+*/
+void NPsetGamma(NeoPixelString *nps, bool enabled)
+{
+    if (enabled != nps->gamma)
+    {
+        nps->gamma = enabled;
+        _rebuildOutput(nps);
+    }
+}
+
+/*!
+  @brief   Translate raw pixel bytes into wire bytes through PIXELS_OUTPUT
+           (brightness and gamma). Used by the backends when they snapshot a
+           frame.
+  @param   src  Pixel buffer.
+  @param   dst  Output buffer, at least n bytes.
+  @param   n    Number of bytes.
+*/
+void NPencodeOutput(const uint8_t *src, uint8_t *dst, uint16_t n)
+{
+    const uint8_t *end = src + n;
+    while (src < end)
+    {
+        *dst++ = PIXELS_OUTPUT[*src++];
     }
 }
 
@@ -681,13 +697,29 @@ uint32_t gamma32(uint32_t x)
 void NPrainbow(NeoPixelString *nps, uint16_t first_hue, int8_t reps,
              uint8_t saturation, uint8_t brightness, bool gammify)
 {
-    for (uint16_t i = 0; i < nps->numLEDs; i++)
+    // Converted in chunks through the batch paths rather than one
+    // NPColorHSV()/gamma32() call per pixel.
+    uint16_t hues[32];
+    uint32_t colors[32];
+    if (nps->numLEDs == 0)
+        return;
+    int32_t step = ((int32_t)reps * 65536) / nps->numLEDs;
+    for (uint16_t base = 0; base < nps->numLEDs; base += 32)
     {
-        uint16_t hue = first_hue + (i * reps * 65536) / nps->numLEDs;
-        uint32_t color = ColorHSV(hue, saturation, brightness);
+        uint16_t n = nps->numLEDs - base;
+        if (n > 32)
+            n = 32;
+        for (uint16_t i = 0; i < n; i++)
+        {
+            hues[i] = (uint16_t)(first_hue + (int32_t)(base + i) * step);
+        }
+        NPColorHSVBatch(hues, saturation, brightness, colors, n);
         if (gammify)
-            color = gamma32(color);
-        setPixelColor(i, color);
+            NPgamma32Batch(colors, n);
+        for (uint16_t i = 0; i < n; i++)
+        {
+            NPsetPixelColorC(nps, base + i, colors[i]);
+        }
     }
 }
 
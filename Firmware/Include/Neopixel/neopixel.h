@@ -7,8 +7,8 @@
  * @copyright 2024
  */
 
-#ifndef __FORGE_STEPPER_H
-#define __FORGE_STEPPER_H
+#ifndef __NEOPIXEL_H
+#define __NEOPIXEL_H
 
 #include "../CMSIS-Core/cmsis_compiler.h"
 #include <stdbool.h>
@@ -19,18 +19,21 @@ extern "C"
 {
 #endif
 
-    uint32_t _getTime()
+    static inline uint32_t _getTime(void)
     {
         return (uint32_t)TIM2->CNT;
     }
 
-    void _setupTime()
+    static inline void _setupTime(void)
     {
         TIM2->PSC = 16000 - 1;
     }
 
 #define MAX_PIXELS 2048
 
+    extern uint8_t PIXELS_FRAMES[2][MAX_PIXELS];
+    extern uint8_t PIXELS_OUTPUT[256];
+
 // The order of primary colors in the NeoPixel data stream can vary among
 // device types, manufacturers and even different revisions of the same
 // item.  The third parameter to the Adafruit_NeoPixel constructor encodes
@@ -116,11 +119,21 @@ extern "C"
 typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
 #endif
 
+    /*!
+    @brief   Selects how NPshow() puts the pixel buffer on the wire.
+    */
+    typedef enum
+    {
+        NEO_BACKEND_BITBANG = 0, ///< GPIO toggling with interrupts disabled
+        NEO_BACKEND_PWM_DMA,     ///< Timer PWM compare stream fed by circular DMA
+        NEO_BACKEND_SPI_DMA      ///< LUT-expanded bit patterns on an SPI MOSI pin
+    } NeoPixelBackend;
+
     // These two tables are declared outside the Adafruit_NeoPixel class
     // because some boards may require oldschool compilers that don't
     // handle the C++11 constexpr keyword.
 
-    /* A PROGMEM (flash mem) table containing 8-bit unsigned sine wave (0-255).
+    /* A table in flash, being const, containing 8-bit unsigned sine wave (0-255).
        Copy & paste this snippet into a Python REPL to regenerate:
     import math
     for x in range(256):
@@ -184,7 +197,8 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
         uint16_t numLEDs;       ///< Number of RGB LEDs in strip
         uint16_t numBytes;      ///< Size of 'pixels' buffer below
         int16_t pin;            ///< Output pin number (-1 if not yet set)
-        uint8_t brightness;     ///< Strip brightness 0-255 (stored as +1)
+        uint8_t brightness;     ///< Strip brightness 0-255 (stored as +1), applied on output
+        bool gamma;             ///< Gamma-correct on output
         uint8_t *pixels;        ///< Holds LED color values (3 or 4 bytes each)
         uint8_t rOffset;        ///< Red index within each 3- or 4-byte pixel
         uint8_t gOffset;        ///< Index of green byte
@@ -193,6 +207,7 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
         uint32_t endTime;       ///< Latch timing reference
         GPIO_TypeDef *gpioPort; ///< Output GPIO PORT
         uint32_t gpioPin;       ///< Output GPIO PIN
+        NeoPixelBackend backend; ///< Output driver used by NPshow()
     } NeoPixelString;
 
     NeoPixelString createNPSvoid(void);
@@ -211,6 +226,8 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
     void NPsetPixelColorC(NeoPixelString *nps, uint16_t n, uint32_t c);
     void NPfill(NeoPixelString *nps, uint32_t c, uint16_t first, uint16_t count);
     void NPsetBrightness(NeoPixelString *nps, uint8_t b);
+    void NPsetGamma(NeoPixelString *nps, bool enabled);
+    void NPencodeOutput(const uint8_t *src, uint8_t *dst, uint16_t n);
     void NPclear(NeoPixelString *nps);
     void updateLength(NeoPixelString *nps, uint16_t n);
     void updateType(NeoPixelString *nps, neoPixelType t);
@@ -227,7 +244,7 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
     @return  1 or true if show() will start sending immediately, 0 or false
                 if show() would block (meaning some idle time is available).
     */
-    bool NPcanShow(NeoPixelString *nps)
+    static inline bool NPcanShow(NeoPixelString *nps)
     {
         // It's normal and possible for endTime to exceed micros() if the
         // 32-bit clock counter has rolled over (about every 70 minutes).
@@ -266,23 +283,23 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 writes past the ends of the buffer. Great power, great
                 responsibility and all that.
     */
-    uint8_t *NPgetPixels(NeoPixelString *nps) { return nps->pixels; };
-    uint8_t NPgetBrightness(NeoPixelString *nps) { return nps->brightness - 1; };
+    static inline uint8_t *NPgetPixels(NeoPixelString *nps) { return nps->pixels; };
+    static inline uint8_t NPgetBrightness(NeoPixelString *nps) { return nps->brightness - 1; };
     /*!
     @brief   Retrieve the pin number used for NeoPixel data output.
     @return  Pin number (-1 if not set).
     */
-    int16_t NPgetPin(NeoPixelString *nps) { return nps->pin; };
+    static inline int16_t NPgetPin(NeoPixelString *nps) { return nps->pin; };
     /*!
-    @brief   Retrieve the port number used for NeoPixel data output.
-    @return  Port number
+    @brief   Retrieve the GPIO port used for NeoPixel data output.
+    @return  GPIO port
     */
-    int16_t NPgetPort(NeoPixelString *nps) { return nps->gpioPort; };
+    static inline GPIO_TypeDef *NPgetPort(NeoPixelString *nps) { return nps->gpioPort; };
     /*!
     @brief   Return the number of pixels in an Adafruit_NeoPixel strip object.
     @return  Pixel count (0 if not set).
     */
-    uint16_t NPnumPixels(NeoPixelString *nps) { return nps->numLEDs; }
+    static inline uint16_t NPnumPixels(NeoPixelString *nps) { return nps->numLEDs; }
     uint32_t NPgetPixelColor(NeoPixelString *nps, uint16_t n);
     /*!
     @brief   An 8-bit integer sine wave function, not directly compatible
@@ -296,9 +313,9 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 a signed int8_t, but you'll most likely want unsigned as this
                 output is often used for pixel brightness in animation effects.
     */
-    static uint8_t sine8(uint8_t x)
+    static inline uint8_t sine8(uint8_t x)
     {
-        return pgm_read_byte(&_NeoPixelSineTable[x]); // 0-255 in, 0-255 out
+        return _NeoPixelSineTable[x]; // 0-255 in, 0-255 out
     }
     /*!
     @brief   An 8-bit gamma-correction function for basic pixel brightness
@@ -311,9 +328,9 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 NeoPixels in average tasks. If you need finer control you'll
                 need to provide your own gamma-correction function instead.
     */
-    static uint8_t gamma8(uint8_t x)
+    static inline uint8_t gamma8(uint8_t x)
     {
-        return pgm_read_byte(&_NeoPixelGammaTable[x]); // 0-255 in, 0-255 out
+        return _NeoPixelGammaTable[x]; // 0-255 in, 0-255 out
     }
     /*!
     @brief   Convert separate red, green and blue values into a single
@@ -326,7 +343,7 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 function. Packed RGB format is predictable, regardless of
                 LED strand color order.
     */
-    static uint32_t NPColor(uint8_t r, uint8_t g, uint8_t b)
+    static inline uint32_t NPColor(uint8_t r, uint8_t g, uint8_t b)
     {
         return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
     }
@@ -342,11 +359,11 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 function. Packed WRGB format is predictable, regardless of
                 LED strand color order.
     */
-    static uint32_t NPColor(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+    static inline uint32_t NPColorW(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
     {
         return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
     }
-    static uint32_t NPColorHSV(uint16_t hue, uint8_t sat, uint8_t val);
+    uint32_t NPColorHSV(uint16_t hue, uint8_t sat, uint8_t val);
     /*!
     @brief   A gamma-correction function for 32-bit packed RGB or WRGB
                 colors. Makes color transitions appear more perceptially
@@ -359,16 +376,14 @@ typedef uint8_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
                 control you'll need to provide your own gamma-correction
                 function instead.
     */
-    static uint32_t gamma32(uint32_t x);
+    uint32_t gamma32(uint32_t x);
 
     void NPrainbow(NeoPixelString *nps, uint16_t first_hue, int8_t reps,
                    uint8_t saturation, uint8_t brightness,
                    bool gammify);
 
-    static neoPixelType NPstr2order(const char *v);
-
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
 
-#endif /* __FORGE_STEPPER_H */
\ No newline at end of file
+#endif /* __NEOPIXEL_H */
\ No newline at end of file
@@ -0,0 +1,208 @@
+/**
+ * @file neopixel_batch.c
+ * @brief Table-driven batch color conversion for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "neopixel_batch.h"
+#include <stdbool.h>
+#include "../HAL/stm32f4xx_hal.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+
+// Fully saturated, full value packed RGB for every hexcone hue. Built once by
+// NPinitHueTable() instead of living in flash so it can't drift from the
+// NPColorHSV() math it replaces.
+static uint32_t _NeoPixelHueTable[NEO_HUE_STEPS + 1];
+static bool _hueTableReady = false;
+
+/*!
+  @brief   Build the hue table. Called automatically by NPColorHSVBatch();
+           call it up front to keep the 6KB fill out of the first frame.
+*/
+void NPinitHueTable(void)
+{
+    for (uint16_t hue = 0; hue <= NEO_HUE_STEPS; hue++)
+    {
+        uint8_t r, g, b;
+        // Same slices as NPColorHSV(); branches are fine here, this runs once
+        if (hue < 255)
+        {
+            r = 255, g = hue, b = 0;
+        }
+        else if (hue < 510)
+        {
+            r = 510 - hue, g = 255, b = 0;
+        }
+        else if (hue < 765)
+        {
+            r = 0, g = 255, b = hue - 510;
+        }
+        else if (hue < 1020)
+        {
+            r = 0, g = 1020 - hue, b = 255;
+        }
+        else if (hue < 1275)
+        {
+            r = hue - 1020, g = 0, b = 255;
+        }
+        else if (hue < 1530)
+        {
+            r = 255, g = 0, b = 1530 - hue;
+        }
+        else
+        {
+            r = 255, g = b = 0;
+        }
+        _NeoPixelHueTable[hue] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    }
+    _hueTableReady = true;
+}
+
+/*!
+  @brief   Multiply each byte of a packed color by s/256, s = 1-256. The even
+           and odd bytes are split into two 16-bit lanes each, so one 32-bit
+           multiply scales two components (255 * 256 still fits a lane).
+*/
+__STATIC_FORCEINLINE uint32_t _scalePacked(uint32_t c, uint32_t s)
+{
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    uint32_t even = __UXTB16(c);      // 00BB00bb -> lanes of bytes 0 and 2
+    uint32_t odd = __UXTB16(c >> 8);  // lanes of bytes 1 and 3
+#else
+    uint32_t even = c & 0x00FF00FF;
+    uint32_t odd = (c >> 8) & 0x00FF00FF;
+#endif
+    return (((even * s) >> 8) & 0x00FF00FF) | ((odd * s) & 0xFF00FF00);
+}
+
+/*!
+  @brief   Saturating per-byte add of packed colors.
+*/
+__STATIC_FORCEINLINE uint32_t _addPacked(uint32_t a, uint32_t b)
+{
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    return __UQADD8(a, b);
+#else
+    uint32_t out = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF);
+        out |= (sum > 0xFF ? 0xFF : sum) << shift;
+    }
+    return out;
+#endif
+}
+
+/*!
+  @brief   Convert an array of hues to packed RGB colors. Gives the same
+           result as calling NPColorHSV() on each hue, but the hexcone is a
+           table lookup and saturation/value are applied to all three
+           components at once with packed arithmetic.
+  @param   hues  Hues, 0-65535 for one loop of the color wheel.
+  @param   sat   Saturation shared by all pixels, 0-255.
+  @param   val   Value shared by all pixels, 0-255.
+  @param   out   Packed 0RGB results, n entries.
+  @param   n     Number of pixels.
+*/
+void NPColorHSVBatch(const uint16_t *hues, uint8_t sat, uint8_t val,
+                     uint32_t *out, uint16_t n)
+{
+    if (!_hueTableReady)
+    {
+        NPinitHueTable();
+    }
+
+    uint32_t s1 = 1 + sat;                          // 1 to 256; allows >>8 instead of /255
+    uint32_t v1 = 1 + val;                          // same reason
+    uint32_t s2 = (uint32_t)(255 - sat) * 0x010101; // 255-sat in R, G and B, not W
+
+    for (uint16_t i = 0; i < n; i++)
+    {
+        uint32_t hue = ((uint32_t)hues[i] * NEO_HUE_STEPS + 32768) >> 16;
+        uint32_t c = _NeoPixelHueTable[hue];
+        c = _addPacked(_scalePacked(c, s1), s2);
+        out[i] = _scalePacked(c, v1);
+    }
+}
+
+/*!
+  @brief   Gamma-correct an array of packed RGB/WRGB colors in place. Same
+           curve as gamma32(), but each color is read and written as one
+           word with the four table lookups done on registers rather than
+           through a byte pointer into the value.
+  @param   colors  Packed colors, n entries.
+  @param   n       Number of pixels.
+*/
+void NPgamma32Batch(uint32_t *colors, uint16_t n)
+{
+    const uint8_t *table = _NeoPixelGammaTable;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        uint32_t c = colors[i];
+        colors[i] = ((uint32_t)table[c >> 24] << 24) |
+                    ((uint32_t)table[(c >> 16) & 0xFF] << 16) |
+                    ((uint32_t)table[(c >> 8) & 0xFF] << 8) |
+                    (uint32_t)table[c & 0xFF];
+    }
+}
+
+#define NEO_BENCH_PIXELS 256
+
+/*!
+  @brief   Measure the per-pixel cost of the scalar and batch conversions with
+           the DWT cycle counter. Interrupts are masked during each
+           measurement so the numbers are repeatable. main.c runs it once
+           at boot, before the scheduler, and the USB command port reports
+           the result to whoever opens it; it takes well under a
+           millisecond.
+  @param   result  Filled with cycles per pixel for each path.
+*/
+void NPbenchmarkColor(NPColorBenchmark *result)
+{
+    static uint16_t hues[NEO_BENCH_PIXELS];
+    static uint32_t colors[NEO_BENCH_PIXELS];
+    volatile uint32_t sink = 0; // keeps the scalar loops from being optimized out
+    uint32_t start, primask;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    NPinitHueTable();
+    for (uint16_t i = 0; i < NEO_BENCH_PIXELS; i++)
+    {
+        hues[i] = (uint16_t)(i * 65536UL / NEO_BENCH_PIXELS);
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    start = DWT->CYCCNT;
+    for (uint16_t i = 0; i < NEO_BENCH_PIXELS; i++)
+    {
+        sink += NPColorHSV(hues[i], 200, 180);
+    }
+    result->scalarHSV = (DWT->CYCCNT - start) / NEO_BENCH_PIXELS;
+
+    start = DWT->CYCCNT;
+    NPColorHSVBatch(hues, 200, 180, colors, NEO_BENCH_PIXELS);
+    result->batchHSV = (DWT->CYCCNT - start) / NEO_BENCH_PIXELS;
+
+    start = DWT->CYCCNT;
+    for (uint16_t i = 0; i < NEO_BENCH_PIXELS; i++)
+    {
+        sink += gamma32(colors[i]);
+    }
+    result->scalarGamma = (DWT->CYCCNT - start) / NEO_BENCH_PIXELS;
+
+    start = DWT->CYCCNT;
+    NPgamma32Batch(colors, NEO_BENCH_PIXELS);
+    result->batchGamma = (DWT->CYCCNT - start) / NEO_BENCH_PIXELS;
+
+    __set_PRIMASK(primask);
+
+    result->pixels = NEO_BENCH_PIXELS;
+    (void)sink;
+}
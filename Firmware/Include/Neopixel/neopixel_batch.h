@@ -0,0 +1,49 @@
+/**
+ * @file neopixel_batch.h
+ * @brief Table-driven batch color conversion for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_NEOPIXEL_BATCH_H
+#define __FORGE_NEOPIXEL_BATCH_H
+
+#include "neopixel.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Number of distinct hues in the 8-bit RGB hexcone (see NPColorHSV()). The
+// hue table has one extra entry so the rollover back to red needs no modulo.
+#define NEO_HUE_STEPS 1530
+
+    /*!
+    @brief   Cycle counts from NPbenchmarkColor(), per pixel.
+    */
+    typedef struct
+    {
+        uint32_t pixels;      ///< Pixels converted per measurement
+        uint32_t scalarHSV;   ///< NPColorHSV() per pixel
+        uint32_t batchHSV;    ///< NPColorHSVBatch() per pixel
+        uint32_t scalarGamma; ///< gamma32() per pixel
+        uint32_t batchGamma;  ///< NPgamma32Batch() per pixel
+    } NPColorBenchmark;
+
+    void NPinitHueTable(void);
+    void NPColorHSVBatch(const uint16_t *hues, uint8_t sat, uint8_t val,
+                         uint32_t *out, uint16_t n);
+    void NPgamma32Batch(uint32_t *colors, uint16_t n);
+    void NPbenchmarkColor(NPColorBenchmark *result);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_NEOPIXEL_BATCH_H */
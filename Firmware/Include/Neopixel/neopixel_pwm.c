@@ -0,0 +1,277 @@
+/**
+ * @file neopixel_pwm.c
+ * @brief Timer PWM + DMA output backend for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "neopixel_pwm.h"
+#include <stdbool.h>
+#include "../HAL/stm32f4xx_hal.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+
+NeoPixelPWM NEO_PWM;
+
+static GPIO_InitTypeDef GPIO_InitStruct;
+
+/*!
+  @brief   Get the input clock of a general purpose/advanced timer. Timers on
+           an APB bus with a prescaler other than 1 run at twice PCLK.
+  @param   tim  Timer instance.
+  @return  Timer kernel clock in Hz.
+*/
+static uint32_t _timerClock(TIM_TypeDef *tim)
+{
+    if (tim == TIM1 || tim == TIM8 || tim == TIM9 || tim == TIM10 || tim == TIM11)
+    {
+        uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+        return ((RCC->CFGR & RCC_CFGR_PPRE2) == RCC_CFGR_PPRE2_DIV1) ? pclk : 2 * pclk;
+    }
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+    return ((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_CFGR_PPRE1_DIV1) ? pclk : 2 * pclk;
+}
+
+static void _enableTimerClock(TIM_TypeDef *tim)
+{
+    if (tim == TIM1)
+        __HAL_RCC_TIM1_CLK_ENABLE();
+    else if (tim == TIM2)
+        __HAL_RCC_TIM2_CLK_ENABLE();
+    else if (tim == TIM3)
+        __HAL_RCC_TIM3_CLK_ENABLE();
+    else if (tim == TIM4)
+        __HAL_RCC_TIM4_CLK_ENABLE();
+    else if (tim == TIM5)
+        __HAL_RCC_TIM5_CLK_ENABLE();
+    else if (tim == TIM8)
+        __HAL_RCC_TIM8_CLK_ENABLE();
+    else if (tim == TIM9)
+        __HAL_RCC_TIM9_CLK_ENABLE();
+}
+
+/*!
+  @brief   Configure a string to be driven by timer PWM + DMA instead of
+           bit-banging. The data pin must be a timer channel output; each bit
+           period is one timer period and the compare value selects the
+           high time, so the CPU only touches the stream once per half ring.
+  @param   nps           The NeoPixelString structure. Its GPIO port/pin are
+                         switched to the timer alternate function.
+  @param   tim           Timer instance (e.g. TIM5).
+  @param   timerChannel  TIM_CHANNEL_1 .. TIM_CHANNEL_4.
+  @param   alternate     GPIO alternate function for the pin (e.g. GPIO_AF2_TIM5).
+  @param   dmaStream     DMA stream wired to the channel's CC request.
+  @param   dmaChannel    DMA request channel (e.g. DMA_CHANNEL_6).
+  @param   dmaIRQn       IRQ of dmaStream. Its handler must call
+                         NPdmaIRQHandlerPWM().
+*/
+void NPbeginPWM(NeoPixelString *nps, TIM_TypeDef *tim, uint32_t timerChannel,
+                uint32_t alternate, DMA_Stream_TypeDef *dmaStream,
+                uint32_t dmaChannel, IRQn_Type dmaIRQn)
+{
+    NeoPixelPWM *pwm = &NEO_PWM;
+    TIM_OC_InitTypeDef sConfigOC = {0};
+
+    _enableTimerClock(tim);
+    if ((uint32_t)dmaStream < DMA2_BASE)
+        __HAL_RCC_DMA1_CLK_ENABLE();
+    else
+        __HAL_RCC_DMA2_CLK_ENABLE();
+
+    // Pull-down keeps the line low while the channel is disabled between frames
+    GPIO_InitStruct.Pin = nps->gpioPin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = alternate;
+    HAL_GPIO_Init(nps->gpioPort, &GPIO_InitStruct);
+
+    uint32_t bitHz = 800000;
+#if defined(NEO_KHZ400)
+    if (!nps->is800KHz)
+        bitHz = 400000;
+#endif
+    uint32_t period = _timerClock(tim) / bitHz;
+    // T0H ~= 0.32 of a bit period, T1H ~= 0.64 (0.4us / 0.8us at 800KHz)
+    pwm->t0h = (period * 8) / 25;
+    pwm->t1h = (period * 16) / 25;
+
+    pwm->htim.Instance = tim;
+    pwm->htim.Init.Prescaler = 0;
+    pwm->htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    pwm->htim.Init.Period = period - 1;
+    pwm->htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    pwm->htim.Init.RepetitionCounter = 0;
+    pwm->htim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    HAL_TIM_PWM_Init(&pwm->htim);
+
+    sConfigOC.OCMode = TIM_OCMODE_PWM1;
+    sConfigOC.Pulse = 0;
+    sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+    sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+    HAL_TIM_PWM_ConfigChannel(&pwm->htim, &sConfigOC, timerChannel);
+
+    pwm->hdma.Instance = dmaStream;
+    pwm->hdma.Init.Channel = dmaChannel;
+    pwm->hdma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    pwm->hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    pwm->hdma.Init.MemInc = DMA_MINC_ENABLE;
+    pwm->hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    pwm->hdma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    pwm->hdma.Init.Mode = DMA_CIRCULAR;
+    pwm->hdma.Init.Priority = DMA_PRIORITY_HIGH;
+    pwm->hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&pwm->hdma);
+    // TIM_CHANNEL_x is 0x0/0x4/0x8/0xC, TIM_DMA_ID_CCx is 1..4
+    __HAL_LINKDMA(&pwm->htim, hdma[TIM_DMA_ID_CC1 + (timerChannel >> 2)], pwm->hdma);
+
+    // Below the step timer: a late refill only stretches a bit, it never
+    // corrupts motion.
+    HAL_NVIC_SetPriority(dmaIRQn, 6, 0);
+    HAL_NVIC_EnableIRQ(dmaIRQn);
+
+    pwm->timerChannel = timerChannel;
+    pwm->dmaIRQn = dmaIRQn;
+    pwm->busy = false;
+    pwm->pending = false;
+    pwm->front = 0;
+
+    nps->backend = NEO_BACKEND_PWM_DMA;
+    nps->begun = true;
+}
+
+/*!
+  @brief   Encode the next chunk of the front buffer into one half of the
+           compare ring. Once the frame is exhausted the half is filled with
+           0 compare values (line held low) which form the latch period.
+*/
+static void _encodeHalf(NeoPixelPWM *pwm, uint8_t half)
+{
+    uint32_t *out = &pwm->compare[half * NEO_PWM_SLOTS_PER_HALF];
+    uint32_t t0h = pwm->t0h, t1h = pwm->t1h;
+    uint16_t n = 0;
+
+    pwm->halfIsLatch[half] = (pwm->cursor >= pwm->frameBytes);
+
+    while (n < NEO_PWM_SLOTS_PER_HALF && pwm->cursor < pwm->frameBytes)
+    {
+        uint8_t pix = pwm->frame[pwm->cursor++];
+        for (uint8_t mask = 0x80; mask; mask >>= 1)
+        {
+            out[n++] = (pix & mask) ? t1h : t0h;
+        }
+    }
+    while (n < NEO_PWM_SLOTS_PER_HALF)
+    {
+        out[n++] = 0;
+    }
+}
+
+static void _startFrame(NeoPixelPWM *pwm, const uint8_t *frame, uint16_t bytes)
+{
+    pwm->frame = frame;
+    pwm->frameBytes = bytes;
+    pwm->cursor = 0;
+    pwm->latchSlotsSent = 0;
+    pwm->busy = true;
+
+    _encodeHalf(pwm, 0);
+    _encodeHalf(pwm, 1);
+
+    __HAL_TIM_SET_COUNTER(&pwm->htim, 0);
+    HAL_TIM_PWM_Start_DMA(&pwm->htim, pwm->timerChannel, pwm->compare,
+                          2 * NEO_PWM_SLOTS_PER_HALF);
+}
+
+static void _halfDone(NeoPixelPWM *pwm, uint8_t half)
+{
+    if (pwm->halfIsLatch[half])
+    {
+        // Halves are refilled in order, so if the half that just played was
+        // latch the one now playing is too: all data is already out.
+        pwm->latchSlotsSent += NEO_PWM_SLOTS_PER_HALF;
+        if (pwm->latchSlotsSent >= NEO_PWM_LATCH_SLOTS)
+        {
+            HAL_TIM_PWM_Stop_DMA(&pwm->htim, pwm->timerChannel);
+            pwm->busy = false;
+            if (pwm->pending)
+            {
+                pwm->pending = false;
+                pwm->front ^= 1;
+                _startFrame(pwm, PIXELS_FRAMES[pwm->front], pwm->pendingBytes);
+            }
+            return;
+        }
+    }
+    _encodeHalf(pwm, half);
+}
+
+/*!
+  @brief   Queue the current pixel buffer for output and return immediately.
+           If a frame is still being sent, the new one is held in the back
+           buffer and goes out as soon as the current one has latched; only
+           the most recent pending frame is kept.
+  @param   nps         The NeoPixelString structure.
+*/
+void NPshowPWM(NeoPixelString *nps)
+{
+    NeoPixelPWM *pwm = &NEO_PWM;
+    uint32_t primask = __get_PRIMASK();
+
+    // Claim the back buffer: with pending cleared the DMA interrupt can't
+    // swap it to the front while it is being written.
+    __disable_irq();
+    pwm->pending = false;
+    uint8_t back = pwm->front ^ 1;
+    __set_PRIMASK(primask);
+
+    NPencodeOutput(nps->pixels, PIXELS_FRAMES[back], nps->numBytes);
+
+    __disable_irq();
+    if (pwm->busy)
+    {
+        pwm->pendingBytes = nps->numBytes;
+        pwm->pending = true;
+    }
+    else
+    {
+        pwm->front = back;
+        _startFrame(pwm, PIXELS_FRAMES[back], nps->numBytes);
+    }
+    __set_PRIMASK(primask);
+}
+
+/*!
+  @brief   Check whether a frame is still being clocked out.
+  @return  true while the DMA is running (including the latch period).
+*/
+bool NPbusyPWM(void)
+{
+    return NEO_PWM.busy;
+}
+
+/*!
+  @brief   Must be called from the IRQ handler of the DMA stream passed to
+           NPbeginPWM().
+*/
+void NPdmaIRQHandlerPWM(void)
+{
+    HAL_DMA_IRQHandler(&NEO_PWM.hdma);
+}
+
+void HAL_TIM_PWM_PulseFinishedHalfCpltCallback(TIM_HandleTypeDef *htim)
+{
+    if (htim == &NEO_PWM.htim)
+    {
+        _halfDone(&NEO_PWM, 0);
+    }
+}
+
+void HAL_TIM_PWM_PulseFinishedCallback(TIM_HandleTypeDef *htim)
+{
+    if (htim == &NEO_PWM.htim)
+    {
+        _halfDone(&NEO_PWM, 1);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file neopixel_pwm.h
+ * @brief Timer PWM + DMA output backend for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_NEOPIXEL_PWM_H
+#define __FORGE_NEOPIXEL_PWM_H
+
+#include "neopixel.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Number of pixel-data bytes encoded into each half of the compare ring. Each
+// byte becomes 8 compare values, so the whole ring is
+// 2 * NEO_PWM_BYTES_PER_HALF * 8 words. Larger halves mean fewer DMA
+// interrupts per frame at the cost of RAM.
+#define NEO_PWM_BYTES_PER_HALF 12
+#define NEO_PWM_SLOTS_PER_HALF (NEO_PWM_BYTES_PER_HALF * 8)
+
+// Number of low bit-periods sent after the last data bit so the strip
+// latches (300us at 800KHz, same quiet time that NPcanShow() waits for).
+#define NEO_PWM_LATCH_SLOTS 240
+
+    /*!
+    @brief   State of the PWM/DMA output backend. There is a single instance
+             of this (NEO_PWM) in the same way there is a single PIXELS_MEM.
+    */
+    typedef struct
+    {
+        TIM_HandleTypeDef htim;
+        DMA_HandleTypeDef hdma;
+        uint32_t timerChannel;
+        IRQn_Type dmaIRQn;
+
+        uint32_t t0h; ///< Compare value for a 0 bit
+        uint32_t t1h; ///< Compare value for a 1 bit
+
+        uint32_t compare[2 * NEO_PWM_SLOTS_PER_HALF]; ///< Circular DMA source
+
+        const uint8_t *frame;      ///< Front buffer currently being sent
+        uint16_t frameBytes;       ///< Number of bytes in frame
+        uint16_t cursor;           ///< Next byte of frame to encode
+        uint16_t latchSlotsSent;   ///< Low bit-periods played after the data
+        bool halfIsLatch[2];       ///< true if that half of compare[] holds no data
+        volatile bool busy;        ///< DMA is running
+        volatile bool pending;     ///< A newer frame is waiting in the back buffer
+        uint8_t front;             ///< Index of the front buffer in PIXELS_FRAMES
+        uint16_t pendingBytes;     ///< Byte count of the pending frame
+    } NeoPixelPWM;
+
+    extern NeoPixelPWM NEO_PWM;
+
+    void NPbeginPWM(NeoPixelString *nps, TIM_TypeDef *tim, uint32_t timerChannel,
+                    uint32_t alternate, DMA_Stream_TypeDef *dmaStream,
+                    uint32_t dmaChannel, IRQn_Type dmaIRQn);
+    void NPshowPWM(NeoPixelString *nps);
+    bool NPbusyPWM(void);
+    void NPdmaIRQHandlerPWM(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_NEOPIXEL_PWM_H */
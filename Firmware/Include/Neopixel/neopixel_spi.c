@@ -0,0 +1,284 @@
+/**
+ * @file neopixel_spi.c
+ * @brief SPI MOSI + DMA output backend for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "neopixel_spi.h"
+#include <string.h>
+#include <stdbool.h>
+#include "../HAL/stm32f4xx_hal.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+
+NeoPixelSPI NEO_SPI;
+
+static GPIO_InitTypeDef GPIO_InitStruct;
+
+/*!
+  @brief   Expand one byte into its 24-bit SPI pattern, 3 SPI bits per
+           neopixel bit, MSB first.
+*/
+static uint32_t _expandByte(uint8_t v)
+{
+    uint32_t out = 0;
+    for (uint8_t mask = 0x80; mask; mask >>= 1)
+    {
+        out = (out << NEO_SPI_BITS_PER_BIT) | ((v & mask) ? 0b110 : 0b100);
+    }
+    return out;
+}
+
+/*!
+  @brief   Rebuild the expansion table from PIXELS_OUTPUT, folding the
+           string's brightness and gamma into the bit patterns. Called by
+           the core library whenever either setting changes.
+*/
+void NPrebuildLUTSPI(void)
+{
+    for (uint16_t i = 0; i < 256; i++)
+    {
+        NEO_SPI.lut[i] = _expandByte(PIXELS_OUTPUT[i]);
+    }
+}
+
+static uint32_t _spiClock(SPI_TypeDef *spi)
+{
+    return (spi == SPI1) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+}
+
+static void _enableSPIClock(SPI_TypeDef *spi)
+{
+    if (spi == SPI1)
+        __HAL_RCC_SPI1_CLK_ENABLE();
+    else if (spi == SPI2)
+        __HAL_RCC_SPI2_CLK_ENABLE();
+    else if (spi == SPI3)
+        __HAL_RCC_SPI3_CLK_ENABLE();
+}
+
+/*!
+  @brief   Pick the SPI prescaler whose bit rate is closest to
+           NEO_SPI_TARGET_HZ. Anything within roughly +-30% keeps every
+           high/low time inside the WS2812 tolerances.
+*/
+static uint32_t _pickPrescaler(uint32_t pclk)
+{
+    static const uint32_t prescalers[8] = {
+        SPI_BAUDRATEPRESCALER_2, SPI_BAUDRATEPRESCALER_4,
+        SPI_BAUDRATEPRESCALER_8, SPI_BAUDRATEPRESCALER_16,
+        SPI_BAUDRATEPRESCALER_32, SPI_BAUDRATEPRESCALER_64,
+        SPI_BAUDRATEPRESCALER_128, SPI_BAUDRATEPRESCALER_256};
+    uint32_t best = prescalers[7];
+    uint32_t bestError = 0xFFFFFFFF;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        uint32_t hz = pclk >> (i + 1);
+        uint32_t error = (hz > NEO_SPI_TARGET_HZ) ? hz - NEO_SPI_TARGET_HZ : NEO_SPI_TARGET_HZ - hz;
+        if (error < bestError)
+        {
+            bestError = error;
+            best = prescalers[i];
+        }
+    }
+    return best;
+}
+
+/*!
+  @brief   Configure a string to be driven from an SPI MOSI pin. Pixel bytes
+           are expanded through a 256-entry table into SPI bit patterns and
+           streamed by circular DMA, so there is no per-bit CPU work and no
+           interrupt masking. Brightness and gamma are folded into the table,
+           so the frame snapshot is a plain copy.
+  @param   nps        The NeoPixelString structure. Its GPIO port/pin must be
+                      the MOSI pin of spi and are switched to the SPI
+                      alternate function.
+  @param   spi        SPI instance (e.g. SPI2).
+  @param   alternate  GPIO alternate function for the pin (e.g. GPIO_AF5_SPI2).
+  @param   dmaStream  DMA stream wired to the SPI TX request.
+  @param   dmaChannel DMA request channel (e.g. DMA_CHANNEL_0).
+  @param   dmaIRQn    IRQ of dmaStream. Its handler must call
+                      NPdmaIRQHandlerSPI().
+*/
+void NPbeginSPI(NeoPixelString *nps, SPI_TypeDef *spi, uint32_t alternate,
+                DMA_Stream_TypeDef *dmaStream, uint32_t dmaChannel,
+                IRQn_Type dmaIRQn)
+{
+    NeoPixelSPI *out = &NEO_SPI;
+
+    _enableSPIClock(spi);
+    if ((uint32_t)dmaStream < DMA2_BASE)
+        __HAL_RCC_DMA1_CLK_ENABLE();
+    else
+        __HAL_RCC_DMA2_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = nps->gpioPin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = alternate;
+    HAL_GPIO_Init(nps->gpioPort, &GPIO_InitStruct);
+
+    out->hspi.Instance = spi;
+    out->hspi.Init.Mode = SPI_MODE_MASTER;
+    out->hspi.Init.Direction = SPI_DIRECTION_2LINES; // MISO/SCK are simply left unmapped
+    out->hspi.Init.DataSize = SPI_DATASIZE_8BIT;
+    out->hspi.Init.CLKPolarity = SPI_POLARITY_LOW;
+    out->hspi.Init.CLKPhase = SPI_PHASE_1EDGE;
+    out->hspi.Init.NSS = SPI_NSS_SOFT;
+    out->hspi.Init.BaudRatePrescaler = _pickPrescaler(_spiClock(spi));
+    out->hspi.Init.FirstBit = SPI_FIRSTBIT_MSB;
+    out->hspi.Init.TIMode = SPI_TIMODE_DISABLE;
+    out->hspi.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
+    out->hspi.Init.CRCPolynomial = 7;
+    HAL_SPI_Init(&out->hspi);
+
+    out->hdma.Instance = dmaStream;
+    out->hdma.Init.Channel = dmaChannel;
+    out->hdma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    out->hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    out->hdma.Init.MemInc = DMA_MINC_ENABLE;
+    out->hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    out->hdma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    out->hdma.Init.Mode = DMA_CIRCULAR;
+    out->hdma.Init.Priority = DMA_PRIORITY_HIGH;
+    out->hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&out->hdma);
+    __HAL_LINKDMA(&out->hspi, hdmatx, out->hdma);
+
+    HAL_NVIC_SetPriority(dmaIRQn, 6, 0);
+    HAL_NVIC_EnableIRQ(dmaIRQn);
+
+    NPrebuildLUTSPI();
+    out->dmaIRQn = dmaIRQn;
+    out->busy = false;
+    out->pending = false;
+    out->front = 0;
+
+    nps->backend = NEO_BACKEND_SPI_DMA;
+    nps->begun = true;
+}
+
+static void _encodeHalf(NeoPixelSPI *spi, uint8_t half)
+{
+    uint8_t *out = &spi->encoded[half * NEO_SPI_ENCODED_PER_HALF];
+    uint8_t *end = out + NEO_SPI_ENCODED_PER_HALF;
+
+    spi->halfIsLatch[half] = (spi->cursor >= spi->frameBytes);
+
+    while (out < end && spi->cursor < spi->frameBytes)
+    {
+        uint32_t bits = spi->lut[spi->frame[spi->cursor++]];
+        out[0] = (uint8_t)(bits >> 16);
+        out[1] = (uint8_t)(bits >> 8);
+        out[2] = (uint8_t)bits;
+        out += NEO_SPI_BITS_PER_BIT;
+    }
+    if (out < end)
+    {
+        memset(out, 0, end - out);
+    }
+}
+
+static void _startFrame(NeoPixelSPI *spi, const uint8_t *frame, uint16_t bytes)
+{
+    spi->frame = frame;
+    spi->frameBytes = bytes;
+    spi->cursor = 0;
+    spi->latchBytesSent = 0;
+    spi->busy = true;
+
+    _encodeHalf(spi, 0);
+    _encodeHalf(spi, 1);
+
+    HAL_SPI_Transmit_DMA(&spi->hspi, spi->encoded, 2 * NEO_SPI_ENCODED_PER_HALF);
+}
+
+static void _halfDone(NeoPixelSPI *spi, uint8_t half)
+{
+    if (spi->halfIsLatch[half])
+    {
+        spi->latchBytesSent += NEO_SPI_ENCODED_PER_HALF;
+        if (spi->latchBytesSent >= NEO_SPI_LATCH_BYTES)
+        {
+            // MOSI idles at the last bit sent, which is always 0 here
+            HAL_SPI_DMAStop(&spi->hspi);
+            spi->busy = false;
+            if (spi->pending)
+            {
+                spi->pending = false;
+                spi->front ^= 1;
+                _startFrame(spi, PIXELS_FRAMES[spi->front], spi->pendingBytes);
+            }
+            return;
+        }
+    }
+    _encodeHalf(spi, half);
+}
+
+/*!
+  @brief   Queue the current pixel buffer for output and return immediately.
+           Same front/back buffering rules as NPshowPWM().
+  @param   nps         The NeoPixelString structure.
+*/
+void NPshowSPI(NeoPixelString *nps)
+{
+    NeoPixelSPI *spi = &NEO_SPI;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    spi->pending = false;
+    uint8_t back = spi->front ^ 1;
+    __set_PRIMASK(primask);
+
+    memcpy(PIXELS_FRAMES[back], nps->pixels, nps->numBytes);
+
+    __disable_irq();
+    if (spi->busy)
+    {
+        spi->pendingBytes = nps->numBytes;
+        spi->pending = true;
+    }
+    else
+    {
+        spi->front = back;
+        _startFrame(spi, PIXELS_FRAMES[back], nps->numBytes);
+    }
+    __set_PRIMASK(primask);
+}
+
+/*!
+  @brief   Check whether a frame is still being clocked out.
+  @return  true while the DMA is running (including the latch period).
+*/
+bool NPbusySPI(void)
+{
+    return NEO_SPI.busy;
+}
+
+/*!
+  @brief   Must be called from the IRQ handler of the DMA stream passed to
+           NPbeginSPI().
+*/
+void NPdmaIRQHandlerSPI(void)
+{
+    HAL_DMA_IRQHandler(&NEO_SPI.hdma);
+}
+
+void HAL_SPI_TxHalfCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == &NEO_SPI.hspi)
+    {
+        _halfDone(&NEO_SPI, 0);
+    }
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == &NEO_SPI.hspi)
+    {
+        _halfDone(&NEO_SPI, 1);
+    }
+}
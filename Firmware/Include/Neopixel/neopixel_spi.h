@@ -0,0 +1,80 @@
+/**
+ * @file neopixel_spi.h
+ * @brief SPI MOSI + DMA output backend for neopixel strings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_NEOPIXEL_SPI_H
+#define __FORGE_NEOPIXEL_SPI_H
+
+#include "neopixel.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Each neopixel bit is sent as 3 SPI bits (0 -> 100, 1 -> 110), so every
+// pixel-data byte expands to 3 SPI bytes. The SPI clock is picked close to
+// 2.4MHz so one neopixel bit lasts ~1.25us.
+#define NEO_SPI_BITS_PER_BIT 3
+#define NEO_SPI_TARGET_HZ 2400000
+
+// Number of pixel-data bytes encoded into each half of the SPI ring.
+#define NEO_SPI_BYTES_PER_HALF 16
+#define NEO_SPI_ENCODED_PER_HALF (NEO_SPI_BYTES_PER_HALF * NEO_SPI_BITS_PER_BIT)
+
+// Low SPI bytes sent after the data so the strip latches (>= 300us).
+#define NEO_SPI_LATCH_BYTES 96
+
+    /*!
+    @brief   State of the SPI/DMA output backend. Like NEO_PWM there is a
+             single instance of this.
+    */
+    typedef struct
+    {
+        SPI_HandleTypeDef hspi;
+        DMA_HandleTypeDef hdma;
+        IRQn_Type dmaIRQn;
+
+        /*!
+        @brief   Byte -> 24-bit SPI pattern, in transmit order (first SPI
+                 byte in bits 23..16). Built from PIXELS_OUTPUT, so brightness
+                 and gamma cost nothing per pixel.
+        */
+        uint32_t lut[256];
+
+        uint8_t encoded[2 * NEO_SPI_ENCODED_PER_HALF]; ///< Circular DMA source
+
+        const uint8_t *frame;   ///< Front buffer currently being sent
+        uint16_t frameBytes;    ///< Number of bytes in frame
+        uint16_t cursor;        ///< Next byte of frame to encode
+        uint16_t latchBytesSent; ///< Low SPI bytes played after the data
+        bool halfIsLatch[2];    ///< true if that half of encoded[] holds no data
+        volatile bool busy;     ///< DMA is running
+        volatile bool pending;  ///< A newer frame is waiting in the back buffer
+        uint8_t front;          ///< Index of the front buffer in PIXELS_FRAMES
+        uint16_t pendingBytes;  ///< Byte count of the pending frame
+    } NeoPixelSPI;
+
+    extern NeoPixelSPI NEO_SPI;
+
+    void NPbeginSPI(NeoPixelString *nps, SPI_TypeDef *spi, uint32_t alternate,
+                    DMA_Stream_TypeDef *dmaStream, uint32_t dmaChannel,
+                    IRQn_Type dmaIRQn);
+    void NPshowSPI(NeoPixelString *nps);
+    void NPrebuildLUTSPI(void);
+    bool NPbusySPI(void);
+    void NPdmaIRQHandlerSPI(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_NEOPIXEL_SPI_H */
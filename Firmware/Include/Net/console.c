@@ -0,0 +1,273 @@
+/**
+ * @file console.c
+ * @brief Host commands over TCP, for the network build, where the USB network interface takes the CDC port's endpoints.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * The console stands in for the CDC port (Usb/usb_cdc.c). What the client
+ * sends goes to the comms task (Core/scheduler.c) the way an upload goes to
+ * push.c in web.c: it stays in the pbufs it came in, with TCP's window shut
+ * over it, until the comms task's stream buffer takes it. The replies go
+ * through a ring like the CDC port's, which the network task hands to TCP.
+ */
+
+#include "console.h"
+#include "net.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <string.h>
+
+Console CONSOLE;
+
+static StaticSemaphore_t _txLockBuffer;
+static StaticSemaphore_t _txSpaceBuffer;
+
+/**
+ * @brief  Queues as much of the pending data for the comms task as its stream buffer takes, and opens TCP's window by as much. Network task only.
+ */
+static void _feed(Console *c)
+{
+    while (c->pending != NULL)
+    {
+        struct pbuf *p = c->pending;
+        u16_t taken = (u16_t)forgeCommsSend((const uint8_t *)p->payload, p->len);
+        if (taken == 0)
+            break;
+        c->stats.rxBytes += taken;
+        c->pending = pbuf_free_header(p, taken);
+        tcp_recved(c->client, taken);
+    }
+}
+
+/**
+ * @brief  Hands TCP as many of the replies as its send buffer takes. Network task only.
+ */
+static void _send(Console *c)
+{
+    const uint8_t *data;
+    uint32_t n;
+    bool sent = false;
+    while ((n = cdctxNext(&c->tx, &data, true)) > 0)
+    {
+        u16_t room = tcp_sndbuf(c->client);
+        if (n > room)
+            n = room;
+        if (n == 0 || tcp_write(c->client, data, (u16_t)n, TCP_WRITE_FLAG_COPY) != ERR_OK)
+            break;
+        cdctxDone(&c->tx, n);
+        c->stats.txBytes += n;
+        sent = true;
+    }
+    if (sent)
+    {
+        tcp_output(c->client);
+        xSemaphoreGive(c->txSpace);
+    }
+}
+
+/**
+ * @brief  Forgets the client, whose pcb LwIP has freed or is about to.
+ */
+static void _drop(Console *c)
+{
+    c->open = false;
+    c->client = NULL;
+    if (c->pending != NULL)
+    {
+        pbuf_free(c->pending);
+        c->pending = NULL;
+    }
+}
+
+static void _close(Console *c)
+{
+    struct tcp_pcb *pcb = c->client;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    _drop(c);
+    if (tcp_close(pcb) != ERR_OK)
+        tcp_abort(pcb);
+}
+
+static err_t _received(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    (void)pcb;
+    Console *c = arg;
+    if (p == NULL)
+    {
+        // The client closed its end
+        _close(c);
+        return ERR_OK;
+    }
+    if (err != ERR_OK)
+    {
+        pbuf_free(p);
+        return err;
+    }
+
+    if (c->pending == NULL)
+        c->pending = p;
+    else
+        pbuf_cat(c->pending, p);
+    _feed(c);
+    return ERR_OK;
+}
+
+static err_t _sent(void *arg, struct tcp_pcb *pcb, u16_t length)
+{
+    (void)pcb;
+    (void)length;
+    _send(arg);
+    return ERR_OK;
+}
+
+static void _error(void *arg, err_t err)
+{
+    (void)err;
+    _drop(arg);
+}
+
+static err_t _accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    Console *c = arg;
+    if (err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+    if (c->client != NULL)
+    {
+        c->stats.refused++;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    c->client = pcb;
+    c->pending = NULL;
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, _received);
+    tcp_sent(pcb, _sent);
+    tcp_err(pcb, _error);
+    // Commands are short and each waits for its reply
+    tcp_nagle_disable(pcb);
+    c->stats.connections++;
+    c->open = true;
+    c->greet = true;
+    forgeCommsWake();
+    return ERR_OK;
+}
+
+/**
+ * @brief  Starts listening on CONSOLE_PORT. Call from the network task once the interface is up.
+ * @retval None
+ * @headerfile console.h
+ */
+void consoleInit(void)
+{
+    Console *c = &CONSOLE;
+    memset(c, 0, sizeof(*c));
+    cdctxReset(&c->tx);
+    c->txLock = xSemaphoreCreateMutexStatic(&_txLockBuffer);
+    c->txSpace = xSemaphoreCreateBinaryStatic(&_txSpaceBuffer);
+    forgeMemoryAdd("console", c, sizeof(*c));
+
+    struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb == NULL || tcp_bind(pcb, IP_ANY_TYPE, CONSOLE_PORT) != ERR_OK)
+        return;
+    c->listener = tcp_listen(pcb);
+    tcp_arg(c->listener, c);
+    tcp_accept(c->listener, _accept);
+}
+
+/**
+ * @brief  Queues more of what the client sent for the comms task and sends the replies. Call from the network task each time it wakes.
+ * @retval None
+ * @headerfile console.h
+ */
+void consoleService(void)
+{
+    Console *c = &CONSOLE;
+    if (c->client == NULL)
+    {
+        // Replies to a client that has gone
+        uint32_t stale = cdctxPending(&c->tx);
+        if (stale > 0)
+        {
+            cdctxDone(&c->tx, stale);
+            xSemaphoreGive(c->txSpace);
+        }
+        return;
+    }
+    _feed(c);
+    _send(c);
+}
+
+/**
+ * @brief  Queues bytes for the client; the network task sends them on consoleDrained, or sooner once there's a segment's worth. Waits up to CONSOLE_TX_TIMEOUT_MS for room. Call from a task.
+ * @retval The number of bytes queued; the rest were dropped, e.g. because nobody is connected.
+ * @headerfile console.h
+ */
+uint32_t consoleWrite(const uint8_t *data, uint32_t length)
+{
+    Console *c = &CONSOLE;
+    if (!c->open)
+    {
+        c->stats.txDropped += length;
+        return 0;
+    }
+
+    xSemaphoreTake(c->txLock, portMAX_DELAY);
+    uint32_t done = 0;
+    for (;;)
+    {
+        done += cdctxWrite(&c->tx, data + done, length - done);
+        if (cdctxPending(&c->tx) >= TCP_MSS || done < length)
+            netWake();
+        if (done == length)
+            break;
+        if (xSemaphoreTake(c->txSpace, pdMS_TO_TICKS(CONSOLE_TX_TIMEOUT_MS)) != pdTRUE)
+            break;
+    }
+    xSemaphoreGive(c->txLock);
+
+    c->stats.txDropped += length - done;
+    return done;
+}
+
+/**
+ * @brief  Comms task side, as it wakes: runs consoleOpened if a client has just connected, ahead of any of its input.
+ * @retval None
+ * @headerfile console.h
+ */
+void consoleWoken(void)
+{
+    Console *c = &CONSOLE;
+    if (c->greet)
+    {
+        c->greet = false;
+        consoleOpened();
+    }
+}
+
+/**
+ * @brief  Comms task side, once it has run everything queued: has the network task send the replies and queue what the stream buffer had no room for.
+ * @retval None
+ * @headerfile console.h
+ */
+void consoleDrained(void)
+{
+    Console *c = &CONSOLE;
+    if (c->pending != NULL || cdctxPending(&c->tx) > 0)
+        netWake();
+}
+
+/**
+ * @brief  Called from the comms task when a client connects, before any of its input, e.g. to greet it. Whatever it writes goes out ahead of the replies. The default does nothing.
+ * @retval None
+ * @headerfile console.h
+ */
+__weak void consoleOpened(void)
+{
+}
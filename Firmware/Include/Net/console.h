@@ -0,0 +1,72 @@
+/**
+ * @file console.h
+ * @brief Host commands over TCP, for the network build, where the USB network interface takes the CDC port's endpoints.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_CONSOLE_H
+#define __FORGE_CONSOLE_H
+
+#include "../Usb/cdc_ring.h"
+#include "../LwIP/src/include/lwip/tcp.h"
+#include "../LwIP/src/include/lwip/pbuf.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A raw TCP port, e.g. for nc or a host's socket:// serial URL
+#define CONSOLE_PORT 23
+// How long consoleWrite waits for room before dropping the rest, as
+// cdcWrite does
+#define CONSOLE_TX_TIMEOUT_MS 50
+
+    typedef struct
+    {
+        uint32_t connections;
+        uint32_t refused;   // Connections turned away while another was open
+        uint32_t rxBytes;
+        uint32_t txBytes;
+        uint32_t txDropped; // Bytes consoleWrite gave up on
+    } ConsoleStats;
+
+    /**
+     * @brief The single console, one connection at a time. The network task queues what the client sends for the comms task and sends tx; writers fill tx under txLock.
+     */
+    typedef struct
+    {
+        struct tcp_pcb *listener;
+        struct tcp_pcb *client; // NULL while nobody is connected
+        struct pbuf *pending;   // Received but not yet queued for the comms task, its TCP window still shut
+        CDCTxRing tx;           // Replies; sent whole, as TCP packs them itself
+        SemaphoreHandle_t txLock;
+        SemaphoreHandle_t txSpace; // Given as the network task takes replies
+
+        volatile bool open;  // A client is connected
+        volatile bool greet; // It just connected; consoleOpened is due
+
+        ConsoleStats stats;
+    } Console;
+
+    extern Console CONSOLE;
+
+    void consoleInit(void);
+    void consoleService(void);
+    uint32_t consoleWrite(const uint8_t *data, uint32_t length);
+    void consoleWoken(void);
+    void consoleDrained(void);
+    void consoleOpened(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_CONSOLE_H */
@@ -0,0 +1,253 @@
+/**
+ * @file ecmif.c
+ * @brief LwIP network interface over USB CDC-ECM, receiving into buffers that LwIP then uses in place.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "ecmif.h"
+#include "../LwIP/src/include/lwip/etharp.h"
+#include "../LwIP/src/include/lwip/ethip6.h"
+#include "../LwIP/src/include/netif/ethernet.h"
+#include <string.h>
+
+#define RX_MASK (ECMIF_RX_BUFFERS - 1U)
+#define TX_MASK (ECMIF_TX_QUEUE - 1U)
+
+/**
+ * @brief  LwIP is done with a frame: the buffer goes back to the endpoint. Runs wherever the last pbuf_free does, which is the network side.
+ */
+static void _rxFree(struct pbuf *p)
+{
+    EcmRxBuffer *b = (EcmRxBuffer *)p;
+    EcmInterface *ecm = b->owner;
+    ecm->free[ecm->freeHead & RX_MASK] = (uint8_t)(b - ecm->rx);
+    ECMIF_BARRIER();
+    ecm->freeHead++;
+    // The endpoint may be NAKing for want of a buffer
+    if (ecm->freeHead - ecm->freeTail == 1U)
+        ecm->wakeUsb();
+}
+
+static err_t _output(struct netif *netif, struct pbuf *p)
+{
+    EcmInterface *ecm = netif->state;
+    if (!ecm->linkUp || ecm->txHead - ecm->txTail >= ECMIF_TX_QUEUE)
+    {
+        ecm->stats.txDropped++;
+        return ERR_MEM;
+    }
+
+    // The endpoint sends one buffer per frame. A frame that is already one,
+    // and whose data stays put, goes out as is; TCP doesn't touch a segment
+    // again while its pbuf is referenced here.
+    if (p->next == NULL && !PBUF_NEEDS_COPY(p))
+    {
+        pbuf_ref(p);
+    }
+    else
+    {
+        p = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        if (p == NULL)
+        {
+            ecm->stats.txDropped++;
+            return ERR_MEM;
+        }
+        ecm->stats.txCopied++;
+    }
+
+    ecm->tx[ecm->txHead & TX_MASK] = p;
+    ECMIF_BARRIER();
+    ecm->txHead++;
+    ecm->wakeUsb();
+    return ERR_OK;
+}
+
+/**
+ * @brief  Hands the buffers to their rings. Call once, before netif_add and before the USB side can run.
+ * @param[in]  mac is the interface's own address, not the one the host's end of the link gets from the ECM descriptor.
+ * @param[in]  wakeUsb is called when a frame is queued or the endpoint can have a buffer again.
+ * @param[in]  wakeNet is called when a frame arrives, a frame has been sent or the link changes.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifSetup(EcmInterface *ecm, const uint8_t mac[6], void (*wakeUsb)(void), void (*wakeNet)(void))
+{
+    memset(&ecm->stats, 0, sizeof(ecm->stats));
+    for (uint32_t i = 0; i < ECMIF_RX_BUFFERS; i++)
+    {
+        ecm->rx[i].owner = ecm;
+        ecm->rx[i].pbuf.custom_free_function = _rxFree;
+        ecm->free[i] = (uint8_t)i;
+    }
+    ecm->freeHead = ECMIF_RX_BUFFERS;
+    ecm->freeTail = 0;
+    ecm->filledHead = 0;
+    ecm->filledTail = 0;
+    ecm->txHead = 0;
+    ecm->txSent = 0;
+    ecm->txTail = 0;
+    ecm->linkUp = false;
+    ecm->wakeUsb = wakeUsb;
+    ecm->wakeNet = wakeNet;
+    memcpy(ecm->mac, mac, sizeof(ecm->mac));
+}
+
+/**
+ * @brief  The init function for netif_add, with the EcmInterface as state.
+ * @retval ERR_OK
+ * @headerfile ecmif.h
+ */
+err_t ecmifInit(struct netif *netif)
+{
+    EcmInterface *ecm = netif->state;
+    netif->name[0] = 'u';
+    netif->name[1] = 'e';
+#if LWIP_IPV4
+    netif->output = etharp_output;
+#endif
+#if LWIP_IPV6
+    netif->output_ip6 = ethip6_output;
+#endif
+    netif->linkoutput = _output;
+    netif->mtu = ECMIF_MTU;
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    memcpy(netif->hwaddr, ecm->mac, ETH_HWADDR_LEN);
+    // The host sends everything down the link, so multicast needs no filter
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET | NETIF_FLAG_IGMP;
+    return ERR_OK;
+}
+
+/**
+ * @brief  Does the network side's share: follows the link, frees sent frames and passes received ones to LwIP. Call from the task that runs LwIP whenever wakeNet was called.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifService(EcmInterface *ecm)
+{
+    struct netif *netif = &ecm->netif;
+    bool up = ecm->linkUp;
+    if (up && !netif_is_link_up(netif))
+        netif_set_link_up(netif);
+    else if (!up && netif_is_link_up(netif))
+        netif_set_link_down(netif);
+
+    uint32_t sent = ecm->txSent;
+    while (ecm->txTail != sent)
+    {
+        pbuf_free(ecm->tx[ecm->txTail & TX_MASK]);
+        ecm->txTail++;
+    }
+
+    uint32_t head = ecm->filledHead;
+    ECMIF_BARRIER();
+    while (ecm->filledTail != head)
+    {
+        EcmRxBuffer *b = &ecm->rx[ecm->filled[ecm->filledTail & RX_MASK]];
+        ecm->filledTail++;
+        // As PBUF_RAM rather than PBUF_REF: the data follows the pbuf, so
+        // LwIP may move the payload back over headers it stripped, and
+        // answers an echo request in the same buffer. It also goes back out
+        // through _output without a copy.
+        struct pbuf *p = pbuf_alloced_custom(PBUF_RAW, (u16_t)(ETH_PAD_SIZE + b->length), PBUF_RAM,
+                                             &b->pbuf, b->data, sizeof(b->data));
+        if (netif->input(p, netif) != ERR_OK)
+        {
+            ecm->stats.rxDropped++;
+            pbuf_free(p);
+        }
+    }
+}
+
+/**
+ * @brief  The buffer the endpoint should receive the next frame into, or NULL if LwIP still has them all. Asking again returns the same one until ecmifRxCommit. USB side only.
+ * @headerfile ecmif.h
+ */
+uint8_t *ecmifRxBuffer(EcmInterface *ecm)
+{
+    if (ecm->freeTail == ecm->freeHead)
+        return NULL;
+    ECMIF_BARRIER();
+    return ecm->rx[ecm->free[ecm->freeTail & RX_MASK]].data + ETH_PAD_SIZE;
+}
+
+/**
+ * @brief  Passes the frame in the buffer from ecmifRxBuffer to the network side. A frame too short to have an Ethernet header leaves the buffer for the next one. USB side only.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifRxCommit(EcmInterface *ecm, uint32_t length)
+{
+    if (length < SIZEOF_ETH_HDR || length > ECMIF_FRAME_SIZE)
+        return;
+    uint8_t index = ecm->free[ecm->freeTail & RX_MASK];
+    ecm->rx[index].length = (uint16_t)length;
+    ecm->freeTail++;
+    ecm->filled[ecm->filledHead & RX_MASK] = index;
+    ECMIF_BARRIER();
+    ecm->filledHead++;
+    ecm->stats.rxFrames++;
+    ecm->stats.rxBytes += length;
+    ecm->wakeNet();
+}
+
+/**
+ * @brief  The next frame to send, without the padding. It stays queued until ecmifTxDone. USB side only.
+ * @retval The length of the frame, or 0 if there is none.
+ * @headerfile ecmif.h
+ */
+uint32_t ecmifTxNext(EcmInterface *ecm, const uint8_t **data)
+{
+    if (ecm->txSent == ecm->txHead)
+        return 0;
+    ECMIF_BARRIER();
+    struct pbuf *p = ecm->tx[ecm->txSent & TX_MASK];
+    *data = (const uint8_t *)p->payload + ETH_PAD_SIZE;
+    return p->len - ETH_PAD_SIZE;
+}
+
+/**
+ * @brief  The frame from ecmifTxNext is on the wire; the network side frees it. USB side only.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifTxDone(EcmInterface *ecm)
+{
+    // Flushed while it was on the wire
+    if (ecm->txSent == ecm->txHead)
+        return;
+    struct pbuf *p = ecm->tx[ecm->txSent & TX_MASK];
+    ecm->stats.txFrames++;
+    ecm->stats.txBytes += p->len - ETH_PAD_SIZE;
+    ECMIF_BARRIER();
+    ecm->txSent++;
+    ecm->wakeNet();
+}
+
+/**
+ * @brief  Gives up on everything queued to send, e.g. when the host deconfigures the device. USB side only.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifTxFlush(EcmInterface *ecm)
+{
+    uint32_t head = ecm->txHead;
+    if (ecm->txSent == head)
+        return;
+    ecm->stats.txDropped += head - ecm->txSent;
+    ecm->txSent = head;
+    ecm->wakeNet();
+}
+
+/**
+ * @brief  Reports the host bringing the link up or down. USB side only.
+ * @retval None
+ * @headerfile ecmif.h
+ */
+void ecmifLink(EcmInterface *ecm, bool up)
+{
+    ecm->linkUp = up;
+    ecm->wakeNet();
+}
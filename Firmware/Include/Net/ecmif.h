@@ -0,0 +1,118 @@
+/**
+ * @file ecmif.h
+ * @brief LwIP network interface over USB CDC-ECM, receiving into buffers that LwIP then uses in place.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_ECMIF_H
+#define __FORGE_ECMIF_H
+
+#include "../LwIP/src/include/lwip/opt.h"
+#include "../LwIP/src/include/lwip/pbuf.h"
+#include "../LwIP/src/include/lwip/netif.h"
+#include "../LwIP/src/include/lwip/err.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Frames the endpoint can fill before LwIP has let go of the oldest; the
+// OUT endpoint NAKs once all are taken. Both counts are powers of two, so
+// the indices can run freely.
+#define ECMIF_RX_BUFFERS 8U
+#define ECMIF_TX_QUEUE 8U
+// The ECM class stops a frame at 1514 bytes, but receives whole packets, so
+// the last one can run up to the next 64 byte boundary
+#define ECMIF_FRAME_SIZE 1536U
+#define ECMIF_MTU 1500U
+
+// Orders a buffer's contents before the index that publishes it. The host
+// tools build the rings with a compiler fence instead.
+#ifndef ECMIF_BARRIER
+#define ECMIF_BARRIER() __DMB()
+#endif
+
+    struct EcmInterface;
+
+    /**
+     * @brief A receive buffer. The endpoint writes the frame ETH_PAD_SIZE bytes in, so that the IP header is word aligned, and LwIP gets it as a custom pbuf over data, which hands the buffer back when it's freed.
+     */
+    typedef struct
+    {
+        struct pbuf_custom pbuf;
+        struct EcmInterface *owner;
+        uint16_t length; // Bytes of frame, without the padding
+        uint8_t data[ETH_PAD_SIZE + ECMIF_FRAME_SIZE] __ALIGNED(4);
+    } EcmRxBuffer;
+
+    typedef struct
+    {
+        uint32_t rxFrames;
+        uint32_t rxBytes;
+        uint32_t rxStalls;  // Times the endpoint had to wait for LwIP to free a buffer, counted by the USB side
+        uint32_t rxDropped; // Frames LwIP turned away
+        uint32_t txFrames;
+        uint32_t txBytes;
+        uint32_t txCopied;  // Frames that had to be gathered into one buffer first
+        uint32_t txDropped; // Frames turned away because the queue was full or the link down
+    } EcmifStats;
+
+    /**
+     * @brief The interface and its rings. The USB side fills free receive buffers and sends queued frames; the network side, the only one that calls into LwIP, does everything else.
+     */
+    typedef struct EcmInterface
+    {
+        struct netif netif;
+        EcmRxBuffer rx[ECMIF_RX_BUFFERS];
+
+        // Received frames, USB side to network side
+        uint8_t filled[ECMIF_RX_BUFFERS];
+        volatile uint32_t filledHead; // USB side only
+        volatile uint32_t filledTail; // Network side only
+
+        // Buffers LwIP is done with, network side to USB side. The one at
+        // freeTail is the one the endpoint is receiving into.
+        uint8_t free[ECMIF_RX_BUFFERS];
+        volatile uint32_t freeHead; // Network side only
+        volatile uint32_t freeTail; // USB side only
+
+        // Frames to send, as referenced pbufs. The network side queues at
+        // txHead and frees up to txSent, which the USB side advances.
+        struct pbuf *tx[ECMIF_TX_QUEUE];
+        volatile uint32_t txHead;
+        volatile uint32_t txSent;
+        uint32_t txTail;
+
+        volatile bool linkUp; // Set by the USB side, acted on by the network side
+
+        // Called when the other side has something to do, from whichever side
+        void (*wakeUsb)(void);
+        void (*wakeNet)(void);
+
+        uint8_t mac[6];
+        EcmifStats stats;
+    } EcmInterface;
+
+    void ecmifSetup(EcmInterface *ecm, const uint8_t mac[6], void (*wakeUsb)(void), void (*wakeNet)(void));
+    err_t ecmifInit(struct netif *netif);
+    void ecmifService(EcmInterface *ecm);
+
+    uint8_t *ecmifRxBuffer(EcmInterface *ecm);
+    void ecmifRxCommit(EcmInterface *ecm, uint32_t length);
+    uint32_t ecmifTxNext(EcmInterface *ecm, const uint8_t **data);
+    void ecmifTxDone(EcmInterface *ecm);
+    void ecmifTxFlush(EcmInterface *ecm);
+    void ecmifLink(EcmInterface *ecm, bool up);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_ECMIF_H */
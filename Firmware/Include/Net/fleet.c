@@ -0,0 +1,531 @@
+/**
+ * @file fleet.c
+ * @brief Print farm telemetry over MQTT: batched, delta-compressed state from a fixed pool of messages, and commands from the broker.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Topics, with <id> the last four bytes of the printer's MAC address in hex:
+ *
+ *   forge/<id>/state     telemetry, below
+ *   forge/<id>/online    "1" while connected, "0" from the broker once the
+ *                        printer goes away (the will); both retained
+ *   forge/<id>/cmd/pause, cmd/resume       payload ignored
+ *   forge/<id>/cmd/hotend, cmd/bed         target in degrees C, e.g. "215"
+ *   forge/<id>/cmd/rate                    "<sample ms> <publish ms>"
+ *
+ * Commands must not be published retained, or the broker hands them over
+ * again on every reconnect.
+ *
+ * The state is looked at every sample period. A field that moved by less
+ * than its deadband since it was last sent is left out, and a sample with
+ * nothing left isn't sent at all, so an idle printer publishes nothing but
+ * its keep-alives. What's left is batched into one message per publish
+ * period:
+ *
+ *   {"seq":41,"t":123456,"k":0,"s":[{"dt":0,"ht":201.5},{"dt":250,"ht":202.0,"z":0.30}]}
+ *
+ * t is the printer's clock in ms at the first sample and dt counts from it.
+ * Keys: ht/hT hotend temperature and target, bt/bT the bed's, x y z e the
+ * position in mm, p progress in per mille, st the print's state (the
+ * SDPrintState numbers). A temperature that isn't known is null.
+ *
+ * A keyframe ("k":1) has every field. One goes out on connecting, every
+ * FLEET_KEYFRAME_MS and after a message was dropped, and it's retained, so a
+ * subscriber starts from the last keyframe and applies the messages after
+ * it in seq order. A gap in seq means to wait for the next keyframe.
+ *
+ * Messages are built in a fixed pool and wait there until the client's
+ * output buffer has room, so a slow link costs neither LwIP's heap nor the
+ * printer's own. Everything runs in the network task from one LwIP timer.
+ */
+
+#include "fleet.h"
+#include "json.h"
+#include "../Core/memory.h"
+#include "../LwIP/src/include/lwip/sys.h"
+#include "../LwIP/src/include/lwip/timeouts.h"
+#include "../LwIP/src/include/lwip/etharp.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+FleetClient FLEET;
+
+#define TOPIC_STATE 0
+#define TOPIC_ONLINE 1
+#define TOPIC_SUBSCRIBE 2 // forge/<id>/cmd/+
+#define TOPIC_COMMAND 3   // forge/<id>/cmd/, the prefix of each command
+// Room left for one more sample in a message, and its closing "]}"
+#define SAMPLE_MAX 160U
+#define COMMAND_RATE 4
+
+static const char *const _commands[] = {"pause", "resume", "hotend", "bed", "rate"};
+
+/**
+ * @brief One value in a message: its key, the smallest change worth sending (0 for any), and its decimals.
+ */
+typedef struct
+{
+    const char *key;
+    float deadband;
+    uint8_t decimals;
+} FleetField;
+
+static const FleetField _fields[FLEET_FIELDS] = {
+    {"ht", FLEET_TEMP_DEADBAND, 1},     {"hT", 0.0f, 1},
+    {"bt", FLEET_TEMP_DEADBAND, 1},     {"bT", 0.0f, 1},
+    {"x", FLEET_POSITION_DEADBAND, 2},  {"y", FLEET_POSITION_DEADBAND, 2},
+    {"z", FLEET_POSITION_DEADBAND, 2},  {"e", FLEET_POSITION_DEADBAND, 2},
+    {"p", FLEET_PROGRESS_DEADBAND, 0},  {"st", 0.0f, 0}};
+
+/**
+ * @brief  Reports the printer's state for telemetry. The default knows nothing; the board file overrides it.
+ * @param[out]  sample is filled in.
+ * @retval None
+ * @headerfile fleet.h
+ */
+__WEAK void fleetSample(FleetSample *sample)
+{
+    sample->hotend = sample->hotendTarget = sample->bed = sample->bedTarget = NAN;
+    for (uint8_t a = 0; a < 4; a++)
+        sample->position[a] = 0.0f;
+    sample->progress = 0;
+    sample->state = 0;
+}
+
+/**
+ * @brief  Carries out a command from the broker. The default ignores it; the board file overrides it.
+ * @param[in]  command is what to do.
+ * @param[in]  value is the target temperature, for FLEET_CMD_HOTEND and FLEET_CMD_BED.
+ * @retval None
+ * @headerfile fleet.h
+ */
+__WEAK void fleetCommand(FleetCommand command, float value)
+{
+    (void)command;
+    (void)value;
+}
+
+static void _values(const FleetSample *sample, float values[FLEET_FIELDS])
+{
+    values[0] = sample->hotend;
+    values[1] = sample->hotendTarget;
+    values[2] = sample->bed;
+    values[3] = sample->bedTarget;
+    for (uint8_t a = 0; a < 4; a++)
+        values[4 + a] = sample->position[a];
+    values[8] = (float)sample->progress;
+    values[9] = (float)sample->state;
+}
+
+static bool _changed(uint8_t field, float value, float sent)
+{
+    if (isnan(value) || isnan(sent))
+        return isnan(value) != isnan(sent);
+    float deadband = _fields[field].deadband;
+    if (deadband == 0.0f)
+        return value != sent;
+    return fabsf(value - sent) >= deadband;
+}
+
+/**
+ * @brief  Hands queued messages to the client for as long as its output buffer takes them.
+ */
+static void _flush(FleetClient *fleet)
+{
+    while (fleet->queueTail != fleet->queueHead)
+    {
+        uint8_t i = fleet->queue[fleet->queueTail & (FLEET_POOL_MESSAGES - 1U)];
+        FleetMessage *m = &fleet->messages[i];
+        if (mqtt_publish(&fleet->client, fleet->topics[TOPIC_STATE], m->data, m->length, 0, m->keyframe ? 1 : 0,
+                         NULL, NULL) != ERR_OK)
+            return;
+        fleet->stats.published++;
+        fleet->stats.bytes += m->length;
+        fleet->freeList[fleet->freeCount++] = i;
+        fleet->queueTail++;
+    }
+}
+
+static void _dropQueued(FleetClient *fleet)
+{
+    while (fleet->queueTail != fleet->queueHead)
+    {
+        fleet->freeList[fleet->freeCount++] = fleet->queue[fleet->queueTail & (FLEET_POOL_MESSAGES - 1U)];
+        fleet->queueTail++;
+    }
+}
+
+/**
+ * @brief  Starts a message in a free slot. With none free the oldest queued message goes, and the subscribers get a keyframe next to make up for it.
+ */
+static FleetMessage *_open(FleetClient *fleet, bool keyframe, uint32_t now)
+{
+    if (fleet->freeCount == 0)
+    {
+        fleet->freeList[fleet->freeCount++] = fleet->queue[fleet->queueTail & (FLEET_POOL_MESSAGES - 1U)];
+        fleet->queueTail++;
+        fleet->stats.dropped++;
+        fleet->keyframeDue = true;
+    }
+    fleet->open = (int8_t)fleet->freeList[--fleet->freeCount];
+    fleet->openTick = now;
+    FleetMessage *m = &fleet->messages[fleet->open];
+    m->keyframe = keyframe;
+
+    JsonWriter j = {m->data, m->data + FLEET_MESSAGE_SIZE};
+    jsonRaw(&j, "{\"seq\":");
+    jsonUint(&j, fleet->seq++);
+    jsonRaw(&j, ",\"t\":");
+    jsonUint(&j, now);
+    jsonRaw(&j, keyframe ? ",\"k\":1,\"s\":[" : ",\"k\":0,\"s\":[");
+    m->length = (uint16_t)(j.p - m->data);
+    return m;
+}
+
+static void _close(FleetClient *fleet)
+{
+    if (fleet->open < 0)
+        return;
+    FleetMessage *m = &fleet->messages[fleet->open];
+    JsonWriter j = {m->data + m->length, m->data + FLEET_MESSAGE_SIZE};
+    jsonRaw(&j, "]}");
+    m->length = (uint16_t)(j.p - m->data);
+    fleet->queue[fleet->queueHead & (FLEET_POOL_MESSAGES - 1U)] = (uint8_t)fleet->open;
+    fleet->queueHead++;
+    fleet->open = -1;
+}
+
+/**
+ * @brief  Adds a sample with the fields that changed to the open message, opening one if there's none or it's full. A keyframe has every field and a message to itself.
+ */
+static void _sample(FleetClient *fleet, const float values[FLEET_FIELDS], bool keyframe, uint32_t now)
+{
+    bool changed[FLEET_FIELDS];
+    bool any = false;
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+    {
+        changed[f] = keyframe || _changed(f, values[f], fleet->sent[f]);
+        any |= changed[f];
+    }
+    if (!any)
+    {
+        fleet->stats.unchanged++;
+        return;
+    }
+    fleet->stats.samples++;
+
+    if (keyframe)
+    {
+        // Everything older is out of date now
+        _close(fleet);
+        _dropQueued(fleet);
+        fleet->stats.keyframes++;
+        fleet->lastKeyframe = now;
+        fleet->keyframeDue = false;
+    }
+    else if (fleet->open >= 0 && fleet->messages[fleet->open].length + SAMPLE_MAX > FLEET_MESSAGE_SIZE)
+    {
+        _close(fleet);
+    }
+    FleetMessage *m = (fleet->open >= 0) ? &fleet->messages[fleet->open] : _open(fleet, keyframe, now);
+
+    JsonWriter j = {m->data + m->length, m->data + FLEET_MESSAGE_SIZE - 2U};
+    bool first = m->data[m->length - 1] == '[';
+    jsonRaw(&j, first ? "{\"dt\":" : ",{\"dt\":");
+    jsonUint(&j, now - fleet->openTick);
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+    {
+        if (!changed[f])
+            continue;
+        jsonRaw(&j, ",\"");
+        jsonRaw(&j, _fields[f].key);
+        jsonRaw(&j, "\":");
+        jsonFixed(&j, values[f], _fields[f].decimals);
+        fleet->sent[f] = values[f];
+    }
+    jsonChar(&j, '}');
+    m->length = (uint16_t)(j.p - m->data);
+
+    if (keyframe)
+        _close(fleet);
+}
+
+static void _subscribed(void *arg, err_t err)
+{
+    (void)arg;
+    (void)err;
+}
+
+static void _incoming(void *arg, const char *topic, u32_t length)
+{
+    FleetClient *fleet = (FleetClient *)arg;
+    fleet->command = -1;
+    fleet->commandLength = 0;
+
+    size_t prefix = strlen(fleet->topics[TOPIC_COMMAND]);
+    if (strncmp(topic, fleet->topics[TOPIC_COMMAND], prefix) != 0)
+        return;
+    for (uint8_t c = 0; c < sizeof(_commands) / sizeof(_commands[0]); c++)
+    {
+        if (strcmp(topic + prefix, _commands[c]) == 0)
+            fleet->command = (int8_t)c;
+    }
+    if (fleet->command < 0 || length >= FLEET_COMMAND_SIZE)
+    {
+        fleet->command = -1;
+        fleet->stats.badCommands++;
+    }
+}
+
+static void _run(FleetClient *fleet)
+{
+    char *end;
+    const char *text = fleet->commandData;
+    switch (fleet->command)
+    {
+    case FLEET_CMD_PAUSE:
+    case FLEET_CMD_RESUME:
+        fleetCommand((FleetCommand)fleet->command, 0.0f);
+        break;
+    case FLEET_CMD_HOTEND:
+    case FLEET_CMD_BED:
+    {
+        float target = strtof(text, &end);
+        if (end == text || !(target >= 0.0f && target <= FLEET_MAX_TARGET))
+        {
+            fleet->stats.badCommands++;
+            return;
+        }
+        fleetCommand((FleetCommand)fleet->command, target);
+        break;
+    }
+    case COMMAND_RATE:
+    {
+        uint32_t sample = (uint32_t)strtoul(text, &end, 10);
+        uint32_t publish = (uint32_t)strtoul(end, NULL, 10);
+        if (sample < FLEET_MIN_SAMPLE_MS || publish < sample)
+        {
+            fleet->stats.badCommands++;
+            return;
+        }
+        // Takes effect from the next sample
+        fleet->sampleMs = sample;
+        fleet->publishMs = publish;
+        break;
+    }
+    default:
+        return;
+    }
+    fleet->stats.commands++;
+}
+
+static void _data(void *arg, const u8_t *data, u16_t length, u8_t flags)
+{
+    FleetClient *fleet = (FleetClient *)arg;
+    if (fleet->command < 0)
+        return;
+    // _incoming turned away anything longer than the buffer
+    memcpy(&fleet->commandData[fleet->commandLength], data, length);
+    fleet->commandLength = (uint8_t)(fleet->commandLength + length);
+    if (flags & MQTT_DATA_FLAG_LAST)
+    {
+        fleet->commandData[fleet->commandLength] = '\0';
+        _run(fleet);
+        fleet->command = -1;
+    }
+}
+
+static void _connected(mqtt_client_t *client, void *arg, mqtt_connection_status_t status)
+{
+    FleetClient *fleet = (FleetClient *)arg;
+    fleet->connecting = false;
+    if (status != MQTT_CONNECT_ACCEPTED)
+    {
+        // Look for the host again, in case it came back with a new address
+        if (ip_addr_isany(&fleet->broker))
+            fleet->brokerFound = false;
+        return;
+    }
+
+    fleet->stats.connects++;
+    // Connecting wiped the client, callbacks included
+    mqtt_set_inpub_callback(client, _incoming, _data, fleet);
+    mqtt_subscribe(client, fleet->topics[TOPIC_SUBSCRIBE], 1, _subscribed, fleet);
+    mqtt_publish(client, fleet->topics[TOPIC_ONLINE], "1", 1, 1, 1, NULL, NULL);
+
+    // What was queued while the link was down is stale
+    _close(fleet);
+    _dropQueued(fleet);
+    fleet->keyframeDue = true;
+    fleet->lastPublish = sys_now();
+}
+
+/**
+ * @brief  Finds the broker to connect to: the one set, or by default the host at the other end of the USB cable, which is in the ARP table by its MAC address once it has talked to the printer.
+ */
+static bool _broker(FleetClient *fleet, ip_addr_t *broker)
+{
+    if (!ip_addr_isany(&fleet->broker))
+    {
+        ip_addr_copy(*broker, fleet->broker);
+        return true;
+    }
+    static ip4_addr_t host;
+    if (!fleet->brokerFound)
+    {
+        for (size_t i = 0; i < ARP_TABLE_SIZE; i++)
+        {
+            ip4_addr_t *ip;
+            struct netif *netif;
+            struct eth_addr *mac;
+            if (etharp_get_entry(i, &ip, &netif, &mac) && memcmp(mac->addr, fleet->hostMac, 6) == 0)
+            {
+                ip4_addr_copy(host, *ip);
+                fleet->brokerFound = true;
+                break;
+            }
+        }
+        if (!fleet->brokerFound)
+            return false;
+    }
+    ip_addr_copy_from_ip4(*broker, host);
+    return true;
+}
+
+static void _connect(FleetClient *fleet, uint32_t now)
+{
+    if (fleet->connecting || now - fleet->lastAttempt < FLEET_RECONNECT_MS)
+        return;
+    fleet->lastAttempt = now;
+
+    ip_addr_t broker;
+    if (!_broker(fleet, &broker))
+        return;
+
+    struct mqtt_connect_client_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.client_id = fleet->id;
+    info.keep_alive = FLEET_KEEP_ALIVE_S;
+    info.will_topic = fleet->topics[TOPIC_ONLINE];
+    info.will_msg = "0";
+    info.will_qos = 1;
+    info.will_retain = 1;
+    if (mqtt_client_connect(&fleet->client, &broker, fleet->port, _connected, fleet, &info) == ERR_OK)
+        fleet->connecting = true;
+}
+
+static void _tick(void *arg)
+{
+    FleetClient *fleet = (FleetClient *)arg;
+    uint32_t now = sys_now();
+
+    if (!mqtt_client_is_connected(&fleet->client))
+    {
+        _connect(fleet, now);
+    }
+    else
+    {
+        FleetSample sample;
+        float values[FLEET_FIELDS];
+        fleetSample(&sample);
+        _values(&sample, values);
+
+        bool keyframe = fleet->keyframeDue || now - fleet->lastKeyframe >= FLEET_KEYFRAME_MS;
+        _sample(fleet, values, keyframe, now);
+        if (now - fleet->lastPublish >= fleet->publishMs)
+        {
+            _close(fleet);
+            fleet->lastPublish = now;
+        }
+        _flush(fleet);
+    }
+    sys_timeout(fleet->sampleMs, _tick, fleet);
+}
+
+static void _topic(char *topic, const char *id, const char *name)
+{
+    strcpy(topic, "forge/");
+    strcat(topic, id);
+    strcat(topic, name);
+}
+
+/**
+ * @brief  Sets up the client and starts trying to reach the broker. Call from the network task once the interface is up.
+ * @param[in]  netif is the interface, whose address names the printer.
+ * @param[in]  hostMac is the address of the host at the other end of the cable, the broker unless fleetSetBroker says otherwise.
+ * @retval None
+ * @headerfile fleet.h
+ */
+void fleetInit(struct netif *netif, const uint8_t hostMac[6])
+{
+    static const char hex[] = "0123456789abcdef";
+    FleetClient *fleet = &FLEET;
+    memset(fleet, 0, sizeof(*fleet));
+    forgeMemoryAdd("fleet", fleet, sizeof(*fleet));
+    memcpy(fleet->hostMac, hostMac, 6);
+    ip_addr_set_any(false, &fleet->broker);
+    fleet->port = FLEET_BROKER_PORT;
+    fleet->sampleMs = FLEET_SAMPLE_MS;
+    fleet->publishMs = FLEET_PUBLISH_MS;
+    fleet->open = -1;
+    fleet->command = -1;
+    // The first attempt comes on the first tick
+    fleet->lastAttempt = sys_now() - FLEET_RECONNECT_MS;
+    for (uint8_t i = 0; i < FLEET_POOL_MESSAGES; i++)
+        fleet->freeList[i] = i;
+    fleet->freeCount = FLEET_POOL_MESSAGES;
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+        fleet->sent[f] = NAN;
+
+    char id[9];
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        id[2 * i] = hex[netif->hwaddr[2 + i] >> 4];
+        id[2 * i + 1] = hex[netif->hwaddr[2 + i] & 0x0FU];
+    }
+    id[8] = '\0';
+    strcpy(fleet->id, "forge-");
+    strcat(fleet->id, id);
+    _topic(fleet->topics[TOPIC_STATE], id, "/state");
+    _topic(fleet->topics[TOPIC_ONLINE], id, "/online");
+    _topic(fleet->topics[TOPIC_SUBSCRIBE], id, "/cmd/+");
+    _topic(fleet->topics[TOPIC_COMMAND], id, "/cmd/");
+
+    sys_timeout(fleet->sampleMs, _tick, fleet);
+}
+
+/**
+ * @brief  Sets the broker to connect to, dropping the connection to the old one if there was one. Call from the network task.
+ * @param[in]  broker is its address, or NULL (or any) for the host at the other end of the cable.
+ * @param[in]  port is its port, 0 for FLEET_BROKER_PORT.
+ * @retval None
+ * @headerfile fleet.h
+ */
+void fleetSetBroker(const ip_addr_t *broker, u16_t port)
+{
+    FleetClient *fleet = &FLEET;
+    if (broker != NULL)
+        ip_addr_copy(fleet->broker, *broker);
+    else
+        ip_addr_set_any(false, &fleet->broker);
+    fleet->brokerFound = false;
+    fleet->port = (port != 0) ? port : FLEET_BROKER_PORT;
+    if (mqtt_client_is_connected(&fleet->client) || fleet->connecting)
+        mqtt_disconnect(&fleet->client);
+    fleet->connecting = false;
+    fleet->lastAttempt = sys_now() - FLEET_RECONNECT_MS;
+}
+
+/**
+ * @brief  Tells whether the broker is taking telemetry. Call from the network task.
+ * @retval true if connected.
+ * @headerfile fleet.h
+ */
+bool fleetConnected(void)
+{
+    return mqtt_client_is_connected(&FLEET.client) != 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file fleet.h
+ * @brief Print farm telemetry over MQTT: batched, delta-compressed state from a fixed pool of messages, and commands from the broker.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_FLEET_H
+#define __FORGE_FLEET_H
+
+#include "../LwIP/src/include/lwip/apps/mqtt.h"
+#include "../LwIP/src/include/lwip/apps/mqtt_priv.h"
+#include "../LwIP/src/include/lwip/netif.h"
+#include "../LwIP/src/include/lwip/ip_addr.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FLEET_BROKER_PORT 1883
+#define FLEET_KEEP_ALIVE_S 30
+#define FLEET_RECONNECT_MS 5000U
+// Default rates; the broker can change them with a "rate" command. The
+// state is looked at every sample period, and what changed is sent once per
+// publish period as one message.
+#define FLEET_SAMPLE_MS 250U
+#define FLEET_PUBLISH_MS 2000U
+#define FLEET_MIN_SAMPLE_MS 50U
+// A full state, retained, so a subscriber that joins late or missed a
+// message has something to apply the changes to
+#define FLEET_KEYFRAME_MS 60000U
+
+// Messages waiting for room in the client's output buffer. A power of two,
+// so the queue's indices can run freely. When it's full the oldest is
+// dropped, and the next message is a full state.
+#define FLEET_POOL_MESSAGES 4U
+#define FLEET_MESSAGE_SIZE 512U
+#define FLEET_TOPIC_SIZE 40U
+#define FLEET_COMMAND_SIZE 32U // Payload of a command, e.g. "215"
+
+// Changes smaller than these aren't sent
+#define FLEET_TEMP_DEADBAND 0.5f       // Degrees C
+#define FLEET_POSITION_DEADBAND 0.05f  // mm
+#define FLEET_PROGRESS_DEADBAND 5.0f   // Per mille
+// Highest target a command can set
+#define FLEET_MAX_TARGET 300.0f
+
+// Values in a message: the four temperatures, the four axes, progress and
+// the print's state
+#define FLEET_FIELDS 10U
+
+    /**
+     * @brief The printer's state as telemetry reports it. Temperatures that aren't known are NaN.
+     */
+    typedef struct
+    {
+        float hotend;
+        float hotendTarget;
+        float bed;
+        float bedTarget;
+        float position[4]; // mm, X Y Z E
+        uint16_t progress; // Per mille of the file
+        uint8_t state;     // SDPrintState
+    } FleetSample;
+
+    typedef enum
+    {
+        FLEET_CMD_PAUSE = 0,
+        FLEET_CMD_RESUME,
+        FLEET_CMD_HOTEND, // Target temperature in value
+        FLEET_CMD_BED
+    } FleetCommand;
+
+    typedef struct
+    {
+        uint32_t connects;
+        uint32_t published;  // Messages handed to the client
+        uint32_t keyframes;
+        uint32_t bytes;      // Payload bytes published
+        uint32_t samples;    // Sample periods that changed something
+        uint32_t unchanged;  // Sample periods that didn't, so sent nothing
+        uint32_t dropped;    // Messages lost to a full pool
+        uint32_t commands;
+        uint32_t badCommands;
+    } FleetStats;
+
+    /**
+     * @brief A message in the pool. data holds JSON, not terminated.
+     */
+    typedef struct
+    {
+        uint16_t length;
+        bool keyframe;
+        char data[FLEET_MESSAGE_SIZE];
+    } FleetMessage;
+
+    /**
+     * @brief The single MQTT client. Only the network task touches it.
+     */
+    typedef struct
+    {
+        mqtt_client_t client; // Here rather than from mqtt_client_new, which takes it from LwIP's heap
+        ip_addr_t broker;     // Any if it's to be the host at the other end of the cable
+        u16_t port;
+        bool brokerFound;
+        bool connecting;
+        uint32_t lastAttempt;
+        uint8_t hostMac[6];
+
+        char id[16];    // forge-xxxxxxxx, from the interface's address
+        char topics[4][FLEET_TOPIC_SIZE]; // See fleet.c
+
+        uint32_t sampleMs;
+        uint32_t publishMs;
+        uint32_t lastPublish;
+        uint32_t lastKeyframe;
+        bool keyframeDue;
+        uint32_t seq;
+        float sent[FLEET_FIELDS]; // As the subscribers have it, once every queued message reaches them
+
+        // The pool: open is the message samples are going into, or -1
+        FleetMessage messages[FLEET_POOL_MESSAGES];
+        uint8_t queue[FLEET_POOL_MESSAGES];
+        uint32_t queueHead;
+        uint32_t queueTail;
+        uint8_t freeList[FLEET_POOL_MESSAGES];
+        uint8_t freeCount;
+        int8_t open;
+        uint32_t openTick;
+
+        int8_t command; // Topic of the publish coming in, -1 if not one of ours
+        uint8_t commandLength;
+        char commandData[FLEET_COMMAND_SIZE];
+
+        FleetStats stats;
+    } FleetClient;
+
+    extern FleetClient FLEET;
+
+    void fleetInit(struct netif *netif, const uint8_t hostMac[6]);
+    void fleetSetBroker(const ip_addr_t *broker, u16_t port);
+    bool fleetConnected(void);
+
+    // Called from the network task: fill in the printer's state, and carry
+    // out a command from the broker. The defaults report nothing and ignore
+    // commands; the board file overrides them.
+    void fleetSample(FleetSample *sample);
+    void fleetCommand(FleetCommand command, float value);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_FLEET_H */
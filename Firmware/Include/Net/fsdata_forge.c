@@ -0,0 +1,346 @@
+#include "lwip/apps/fs.h"
+#include "lwip/def.h"
+
+
+#define file_NULL (struct fsdata_file *) NULL
+
+
+#ifndef FS_FILE_FLAGS_HEADER_INCLUDED
+#define FS_FILE_FLAGS_HEADER_INCLUDED 1
+#endif
+#ifndef FS_FILE_FLAGS_HEADER_PERSISTENT
+#define FS_FILE_FLAGS_HEADER_PERSISTENT 0
+#endif
+/* FSDATA_FILE_ALIGNMENT: 0=off, 1=by variable, 2=by include */
+#ifndef FSDATA_FILE_ALIGNMENT
+#define FSDATA_FILE_ALIGNMENT 0
+#endif
+#ifndef FSDATA_ALIGN_PRE
+#define FSDATA_ALIGN_PRE
+#endif
+#ifndef FSDATA_ALIGN_POST
+#define FSDATA_ALIGN_POST
+#endif
+#if FSDATA_FILE_ALIGNMENT==2
+#include "fsdata_alignment.h"
+#endif
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__404_html = 0;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__404_html[] FSDATA_ALIGN_POST = {
+/* /404.html (10 chars) */
+0x2f,0x34,0x30,0x34,0x2e,0x68,0x74,0x6d,0x6c,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 404 File not found
+" (29 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x34,0x30,0x34,0x20,0x46,0x69,0x6c,
+0x65,0x20,0x6e,0x6f,0x74,0x20,0x66,0x6f,0x75,0x6e,0x64,0x0d,0x0a,
+/* "Server: Forge
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x46,0x6f,0x72,0x67,0x65,0x0d,0x0a,
+/* "Content-Length: 125
+" (18+ bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x4c,0x65,0x6e,0x67,0x74,0x68,0x3a,0x20,
+0x31,0x32,0x35,0x0d,0x0a,
+/* "Content-Encoding: deflate
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
+0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "Content-Type: text/html
+
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x74,0x65,
+0x78,0x74,0x2f,0x68,0x74,0x6d,0x6c,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (125 bytes) */
+0x4d,0x8e,0xbb,0x0e,0xc2,0x30,0x0c,0x45,0xf7,0x7e,0x45,0xc8,0x8e,0x2c,0x36,0x06,
+0xc7,0x0b,0x8f,0xb1,0x30,0xb0,0x30,0x1a,0xe2,0x34,0x48,0x69,0x82,0x82,0x3b,0xf0,
+0xf7,0x04,0xb2,0x30,0x59,0xf6,0xb9,0xc7,0xba,0xb8,0xda,0x9f,0x76,0x97,0xeb,0xf9,
+0x60,0xa2,0xce,0x89,0x06,0xfc,0x0e,0x93,0x38,0x4f,0xce,0x4a,0xb6,0x84,0x51,0xd8,
+0x13,0xce,0xa2,0x6c,0xee,0x91,0xeb,0x4b,0xd4,0xd9,0x45,0xc3,0x7a,0xdb,0x98,0x3e,
+0x34,0x09,0x8d,0x45,0x4d,0x28,0x4b,0xf6,0x08,0xfd,0x80,0xf0,0x93,0x06,0xbc,0x15,
+0xff,0x6e,0x1f,0x36,0xff,0x91,0xb6,0xe1,0x93,0x90,0x4d,0xac,0x12,0x9c,0x05,0x4b,
+0xc7,0x52,0x27,0x41,0xe0,0xe6,0x35,0x00,0x5d,0x82,0x5e,0xe7,0x03,};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__app_js = 1;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__app_js[] FSDATA_ALIGN_POST = {
+/* /app.js (8 chars) */
+0x2f,0x61,0x70,0x70,0x2e,0x6a,0x73,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: Forge
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x46,0x6f,0x72,0x67,0x65,0x0d,0x0a,
+/* "Content-Length: 1247
+" (18+ bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x4c,0x65,0x6e,0x67,0x74,0x68,0x3a,0x20,
+0x31,0x32,0x34,0x37,0x0d,0x0a,
+/* "Content-Encoding: deflate
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
+0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "Content-Type: application/javascript
+
+" (40 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x61,0x76,0x61,0x73,0x63,
+0x72,0x69,0x70,0x74,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (1247 bytes) */
+0x95,0x56,0xef,0x6e,0xdb,0x36,0x10,0xff,0x9e,0xa7,0xb8,0x02,0x6d,0x29,0xad,0x36,
+0xed,0x6e,0x40,0x81,0xc5,0x33,0x82,0xae,0xeb,0xb0,0x0d,0x49,0x5b,0x2c,0xf9,0x30,
+0x2c,0x4b,0x0b,0x5a,0x3a,0x59,0x5a,0x64,0x52,0x23,0x29,0x27,0xee,0x9a,0x77,0xda,
+0x33,0xec,0xc9,0x76,0x47,0xfd,0xb1,0xe4,0x04,0x01,0xf6,0x45,0x22,0xef,0x8e,0xc7,
+0xfb,0xfb,0x3b,0xce,0x66,0xf0,0xc1,0x94,0xa5,0x83,0x99,0xf3,0xca,0xd7,0x4e,0xfe,
+0xe9,0x8c,0x06,0xa5,0x53,0x48,0x6d,0xb1,0x45,0xa2,0x57,0xb6,0xd0,0x5e,0x26,0xeb,
+0x22,0x50,0x67,0x75,0x55,0x1a,0x95,0x4a,0x78,0xbb,0x45,0xbb,0x03,0x8b,0x55,0xb9,
+0x03,0x9f,0xe3,0xd1,0x6c,0x06,0x41,0x12,0x2d,0x38,0xd4,0xa9,0x83,0xc2,0x81,0xdb,
+0xa8,0xb2,0x0c,0xc7,0x36,0x2a,0x45,0xc8,0x2c,0xba,0x7c,0x02,0xce,0x80,0x36,0x3e,
+0x2f,0xf4,0x1a,0x72,0xb4,0xc8,0x82,0x89,0x4a,0x72,0x4c,0xe5,0x51,0x94,0xd5,0x3a,
+0xf1,0x05,0x59,0x10,0xc5,0xf0,0xf7,0x11,0x80,0xa8,0x1d,0x82,0xf3,0xb6,0x48,0xbc,
+0x58,0xd0,0x7e,0xab,0x2c,0x7c,0x78,0x7f,0x7a,0xfa,0xe9,0xec,0x1c,0x96,0xf0,0x72,
+0x3e,0x9f,0x2f,0x8e,0x88,0xdc,0x1f,0x7b,0x1a,0x15,0x29,0x9d,0x24,0xbb,0x7c,0x6d,
+0x35,0xa4,0x26,0xa9,0x37,0x48,0xe6,0xaf,0xd1,0xbf,0x2d,0x91,0x97,0xdf,0xef,0x7e,
+0x4e,0x59,0x68,0x01,0x77,0xc3,0x83,0x1e,0x6f,0x3d,0x91,0x27,0xb0,0xe5,0xe3,0x41,
+0x8d,0x64,0xda,0x1b,0x43,0x2e,0x69,0x4f,0x97,0x45,0x5b,0x58,0x2e,0x97,0xa0,0x6b,
+0x72,0xe9,0xcb,0x17,0x68,0x76,0xb5,0x4e,0x31,0x2b,0x34,0xd2,0xa5,0x27,0x20,0xa6,
+0x02,0x8e,0x61,0xcb,0x9a,0x87,0xaa,0x93,0xd2,0x24,0xd7,0x91,0x6b,0x1c,0x6a,0x5c,
+0xc8,0x49,0xdf,0x99,0xf2,0xb9,0xcc,0x4a,0x63,0x6c,0x44,0x51,0x86,0x6f,0x5e,0xcd,
+0xe7,0xf1,0x04,0x36,0xf7,0x39,0xaf,0xe6,0x31,0x3c,0xa3,0xef,0x22,0x1c,0x77,0x24,
+0xe0,0x06,0xfb,0xd6,0xd3,0x1c,0x5e,0x80,0x38,0x16,0xf4,0x8d,0x36,0xf0,0x1d,0x45,
+0x86,0xed,0x99,0xb3,0x3d,0x42,0xc4,0x44,0xdd,0xec,0xf9,0xee,0x21,0xbe,0x63,0x6d,
+0x63,0xbb,0x73,0x54,0x94,0xcd,0x48,0xab,0x0d,0x4e,0x20,0xef,0xcc,0x0f,0x81,0x62,
+0x1a,0x2b,0x9c,0x7a,0xdc,0x54,0x82,0xb8,0xf0,0xfc,0x39,0xe4,0x92,0x77,0xf0,0xa4,
+0x0b,0xd2,0x49,0x4b,0x91,0xde,0xfc,0x58,0xdc,0x62,0x1a,0xbd,0xe4,0x8b,0x04,0xfc,
+0xfb,0xcf,0x1b,0xbe,0x97,0x65,0xe2,0xc5,0x43,0x3a,0x95,0xa5,0x74,0x0d,0xb4,0x86,
+0xfd,0x81,0xde,0x40,0xfb,0xbf,0x9a,0x2b,0x73,0x83,0x76,0xaf,0x38,0x6c,0x87,0x7a,
+0x43,0xe0,0xad,0xa1,0xa4,0x46,0x1d,0xf7,0x2b,0x2e,0xb2,0xa0,0xfd,0xd9,0x48,0xf5,
+0x38,0x54,0x2e,0x37,0x37,0xfb,0x0c,0x17,0x19,0x05,0x59,0xae,0x6a,0xb7,0x8b,0xdb,
+0xf4,0x34,0xc6,0x3c,0x8d,0x44,0x59,0xe8,0x6b,0x11,0xcb,0xa4,0x54,0xce,0xbd,0x63,
+0xb3,0x96,0x14,0xff,0x81,0xa9,0x8d,0xc0,0x04,0x84,0xd1,0xb4,0x42,0x31,0x74,0x43,
+0x70,0x87,0x22,0x31,0x9d,0x0c,0xab,0x11,0x2f,0x2b,0xca,0x86,0xc5,0x8b,0x11,0xa7,
+0x42,0x9b,0x50,0x05,0x07,0x66,0x65,0xcd,0x9a,0x9a,0xd0,0x0d,0x02,0x17,0xf7,0xb6,
+0x75,0x4c,0xb2,0xcf,0xf9,0x5d,0x89,0xf2,0xa6,0x48,0x3d,0x57,0xea,0xfe,0x5c,0x13,
+0x87,0xa1,0x76,0x2c,0x55,0xe5,0x30,0x25,0xed,0x6d,0x99,0xcb,0x96,0x12,0x8f,0x8c,
+0x40,0x6b,0x8d,0xed,0x4c,0xb7,0x9e,0x1b,0x88,0x24,0x99,0xd8,0x8a,0xb5,0xc5,0x26,
+0x72,0x43,0xed,0x96,0x06,0xc9,0x66,0x79,0xc0,0x5f,0x61,0xc3,0xa4,0x7f,0xcb,0xb9,
+0x14,0xb7,0x1c,0xb0,0x1d,0x7f,0x3e,0xf3,0x07,0xc5,0x95,0xcc,0x8c,0x7d,0x4b,0x98,
+0x32,0xc0,0x13,0xd5,0x65,0xa7,0x35,0x49,0x85,0x78,0x18,0x57,0x30,0xfb,0x52,0x5d,
+0xed,0x9b,0xfb,0xa4,0xf9,0x1d,0x8f,0xf9,0x7d,0xc8,0xbe,0xee,0x3c,0xbb,0x1b,0x27,
+0x07,0xd7,0x0c,0x2f,0xae,0x71,0xb2,0xdd,0x8c,0x24,0x18,0x2b,0xac,0xad,0x75,0x23,
+0xd2,0xef,0x1e,0x28,0x27,0x2a,0xed,0xa8,0xb6,0x65,0x67,0x71,0xdb,0xe2,0x19,0x7a,
+0xf2,0x88,0xe8,0x13,0x42,0xa8,0x80,0x98,0xd4,0xbc,0xda,0x4c,0x9d,0x37,0x16,0x05,
+0x99,0x23,0x09,0x87,0xf5,0xc0,0x65,0x3b,0x40,0x42,0x1b,0x80,0x3d,0x62,0xd8,0x7b,
+0xe0,0xc2,0x8a,0x46,0x40,0xd4,0x5d,0xc7,0xb7,0x8b,0xe1,0x38,0x10,0xad,0x66,0xae,
+0xf2,0x09,0x1c,0x42,0xf4,0x23,0x95,0x9d,0x9a,0x1b,0xdd,0x56,0xcb,0xbd,0xfa,0xce,
+0xb2,0x61,0x81,0xdf,0x37,0x9e,0x6d,0x77,0xe8,0x2f,0x8a,0x0d,0x9a,0xda,0x47,0x6c,
+0xe1,0xa4,0x83,0xfe,0xb1,0x17,0xaf,0xad,0x55,0x3b,0x2e,0x51,0x6f,0xfc,0xae,0xc2,
+0x2e,0xf7,0x32,0xa1,0xe1,0x13,0xf5,0x13,0xe0,0xaf,0x9a,0xe6,0xd5,0x39,0x96,0x98,
+0x50,0xb8,0x5e,0x13,0x47,0xac,0x6a,0xef,0x29,0xb5,0xa9,0xf2,0x6a,0x9a,0x6c,0xd2,
+0x2b,0x11,0x0f,0x9d,0x5b,0x75,0xde,0xad,0xa4,0x4a,0x53,0x9a,0x76,0xda,0x9f,0x16,
+0x8e,0x2a,0x92,0xab,0x30,0x29,0x8b,0x84,0xdd,0x18,0x9b,0xdb,0x04,0xae,0x9f,0x97,
+0x27,0x8c,0xb6,0x2b,0xc9,0xfa,0xc9,0x11,0x49,0x57,0x0c,0xe2,0xb8,0x77,0x21,0x0e,
+0x13,0x8c,0xc6,0xe7,0x45,0x8e,0xb0,0x32,0xe9,0x8e,0x07,0x22,0xc9,0x01,0x77,0x32,
+0x14,0xde,0x61,0x99,0x4d,0x78,0x62,0x82,0x02,0x72,0x6d,0x13,0x06,0x28,0xf3,0xbb,
+0x71,0x9b,0x28,0x0d,0x37,0xb6,0xf0,0x2c,0x0c,0xde,0x34,0xca,0x58,0x20,0x51,0x36,
+0x05,0xe5,0x98,0xac,0x6c,0x98,0xe6,0x47,0x21,0x55,0xcd,0x08,0xa7,0x64,0xdd,0x77,
+0xcc,0xd5,0xab,0x4d,0xe1,0x47,0x9e,0xe1,0xb6,0x8b,0x04,0x6e,0x29,0xca,0xc8,0x07,
+0x7e,0xc0,0x4c,0xd5,0xa5,0x8f,0xda,0xec,0xf1,0x48,0xcb,0x28,0xe1,0xa4,0x7b,0x9d,
+0x98,0x94,0xb2,0x1a,0x60,0xc8,0x5d,0xce,0xaf,0x16,0x3d,0x22,0x3e,0xc9,0xc6,0x68,
+0xc8,0x87,0x74,0x53,0x28,0x99,0xe4,0x85,0xe4,0xc7,0x84,0x4a,0x30,0x9a,0x5d,0x7e,
+0x7c,0x3d,0xfd,0x5d,0x4d,0x3f,0xcf,0xa7,0xdf,0xca,0x4f,0xd3,0xab,0xd9,0x9a,0x0a,
+0xe6,0x13,0x29,0xed,0x05,0x3e,0xfe,0x21,0x5f,0xcc,0x26,0x3c,0xba,0xf6,0xba,0x6e,
+0x49,0x91,0xc6,0x1b,0xf8,0xed,0xec,0xf4,0x27,0xef,0xab,0x5f,0x91,0x32,0xee,0x7a,
+0x13,0x6f,0xa5,0xa9,0x28,0xf4,0xe2,0xc3,0xfb,0xf3,0x0b,0xae,0xbf,0xf6,0x1d,0x73,
+0xc2,0x17,0x2f,0x39,0x51,0xbc,0xe8,0x65,0xdb,0x47,0x8e,0xd1,0x3d,0xf0,0x2d,0x07,
+0x11,0xa9,0xf6,0x85,0xcf,0x8e,0x55,0xb2,0x44,0xbd,0xf6,0xf9,0x1b,0xb3,0xa9,0x6a,
+0xaf,0x56,0x84,0xbf,0x1c,0x09,0xc7,0xa0,0x7b,0x08,0xa5,0x11,0x4d,0x13,0x9a,0x29,
+0x74,0x84,0xf4,0x23,0x3d,0xa7,0x80,0xc7,0xa3,0x57,0x65,0x3c,0x84,0xd6,0xbb,0xde,
+0x66,0xcd,0x72,0xa3,0xcb,0xf7,0x77,0xb3,0xd3,0x96,0x78,0xbf,0x9c,0xbf,0x7f,0x27,
+0x2b,0x65,0x1d,0x46,0xb7,0x14,0x22,0x57,0x19,0xed,0xf0,0x82,0xba,0x2d,0x1e,0xb7,
+0x5e,0xe3,0x54,0xc0,0xcf,0x6e,0x22,0x12,0x80,0xf0,0x8b,0xc0,0xf2,0x31,0xca,0x67,
+0xc0,0x40,0x61,0xae,0x05,0x61,0xa0,0x95,0xab,0x9d,0xc7,0x80,0xf8,0x10,0x56,0x3c,
+0xfe,0x7a,0x41,0xc2,0x6f,0xc1,0x03,0x4e,0xc4,0xfd,0x25,0x1c,0x8a,0xfb,0x8a,0x68,
+0xd0,0x86,0xd1,0x52,0x84,0x60,0x10,0x66,0x25,0xd7,0xfc,0x58,0x3a,0x6c,0x95,0x30,
+0x15,0xf6,0x79,0x18,0xf6,0xc9,0x61,0x44,0xc2,0xd4,0x38,0x0c,0xc9,0x63,0x2e,0x66,
+0x8a,0x6a,0x91,0xca,0x7d,0xd1,0x69,0x79,0x44,0x96,0x9f,0xae,0xf4,0x30,0x15,0x7d,
+0x25,0x30,0x21,0xca,0x86,0x9d,0xda,0x60,0xe5,0xe2,0xe8,0x2e,0xe6,0xef,0x7f,};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__index_html = 2;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__index_html[] FSDATA_ALIGN_POST = {
+/* /index.html (12 chars) */
+0x2f,0x69,0x6e,0x64,0x65,0x78,0x2e,0x68,0x74,0x6d,0x6c,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: Forge
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x46,0x6f,0x72,0x67,0x65,0x0d,0x0a,
+/* "Content-Length: 660
+" (18+ bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x4c,0x65,0x6e,0x67,0x74,0x68,0x3a,0x20,
+0x36,0x36,0x30,0x0d,0x0a,
+/* "Content-Encoding: deflate
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
+0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "Content-Type: text/html
+
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x74,0x65,
+0x78,0x74,0x2f,0x68,0x74,0x6d,0x6c,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (660 bytes) */
+0x7d,0x55,0x4b,0x6f,0x1b,0x21,0x10,0xbe,0xe7,0x57,0x50,0xa4,0xf6,0x14,0x7b,0x93,
+0x9c,0xaa,0x76,0x77,0xa5,0x3e,0x52,0xf5,0xd4,0x5a,0x55,0x22,0x35,0xbd,0xb1,0x30,
+0xf6,0xd2,0xb0,0x80,0x60,0x36,0x8e,0xfb,0xeb,0x3b,0xb0,0x8f,0xd8,0x8e,0x13,0xc9,
+0x36,0xcc,0x37,0xc3,0xbc,0x18,0x3e,0x97,0x6f,0xbe,0xfe,0xfc,0x72,0x73,0xb7,0xba,
+0x66,0x2d,0x76,0xa6,0x3e,0x2b,0xd3,0xc2,0x8c,0xb0,0x9b,0x8a,0x83,0xe5,0x09,0x00,
+0xa1,0x68,0xe9,0x00,0x05,0x93,0xad,0x08,0x11,0xb0,0xe2,0x3d,0xae,0x17,0xef,0xf9,
+0x04,0x5b,0xd1,0x41,0xc5,0x1f,0x34,0x6c,0xbd,0x0b,0xc8,0x99,0x74,0x16,0xc1,0x92,
+0xd9,0x56,0x2b,0x6c,0x2b,0x05,0x0f,0x5a,0xc2,0x22,0x0b,0xe7,0x4c,0x5b,0x8d,0x5a,
+0x98,0x45,0x94,0xc2,0x40,0x75,0x99,0x9c,0xa0,0x46,0x03,0xf5,0x37,0x17,0x36,0x50,
+0x16,0x83,0x70,0x56,0x1a,0x6d,0xef,0x59,0x00,0x53,0xf1,0x88,0x3b,0x03,0xb1,0x05,
+0x20,0xd7,0x6d,0x80,0x75,0xc5,0x8b,0x0c,0x2d,0x65,0x8c,0xe9,0x78,0x31,0xa6,0xd8,
+0x38,0xb5,0x1b,0x13,0x86,0x50,0x97,0xed,0xe5,0xe4,0x92,0x76,0x65,0xf4,0xc2,0x32,
+0xad,0x2a,0x9e,0xfc,0x52,0x8a,0x46,0xc4,0x58,0x71,0xe5,0xb6,0x54,0xa4,0x5b,0xaf,
+0x09,0x25,0xc3,0x64,0x54,0x0f,0xfe,0xc8,0x03,0x55,0x27,0xb4,0xa5,0x25,0x82,0x44,
+0xed,0xd2,0xae,0xbd,0xaa,0x57,0x41,0x5b,0x24,0x9b,0x2b,0x12,0xfd,0x9e,0xdf,0x88,
+0x02,0x81,0xd7,0x8b,0xd1,0x0b,0x7b,0xd2,0xac,0xb5,0x21,0xc5,0xec,0xdd,0xd3,0x41,
+0xa5,0x1f,0xa6,0x14,0x1a,0x11,0x48,0x99,0x80,0x64,0xeb,0x83,0xdb,0x04,0x48,0x75,
+0x95,0x05,0x61,0xe3,0xef,0x61,0x24,0x0f,0x41,0x52,0x7b,0x79,0x7d,0xb1,0xbc,0x18,
+0xbd,0xbe,0x65,0xef,0x3a,0xad,0x94,0xc3,0x8f,0x7b,0x71,0xc1,0x08,0x1f,0x41,0x91,
+0xdd,0x87,0x8b,0xf4,0x79,0x9e,0x19,0x84,0xe0,0xc2,0xdc,0x8c,0x41,0x3a,0x4c,0x34,
+0x7d,0x9b,0x1e,0xd1,0x59,0xa6,0x04,0x8a,0x85,0xec,0x52,0x02,0xa2,0x8f,0x54,0xd1,
+0x2a,0x2d,0x65,0x31,0xa8,0x4f,0xd9,0x51,0x21,0x7d,0x47,0x86,0xbf,0xf2,0xfa,0x9a,
+0xa5,0x68,0xd2,0xe0,0xd4,0x9f,0xd2,0xb2,0x67,0x97,0x53,0x28,0x9e,0xda,0x7f,0x70,
+0x11,0x37,0xd0,0x51,0x27,0x04,0xf6,0x14,0x66,0xbc,0x0f,0x14,0x4d,0x9e,0x1d,0xa4,
+0xeb,0xc7,0x96,0x4a,0x48,0x3f,0xf4,0xfd,0xe1,0xb6,0xf3,0xfe,0x46,0xd0,0x4c,0xe0,
+0x2c,0xae,0xdc,0x16,0xc2,0x20,0x15,0x18,0xa6,0xb3,0xaa,0xfe,0xee,0x68,0x84,0x15,
+0x61,0x2a,0x89,0xb9,0x5b,0x6d,0x86,0x16,0x48,0x71,0xf3,0x3d,0x9f,0x50,0x65,0xdf,
+0x2f,0x28,0x7d,0x8a,0x34,0xeb,0x0e,0x82,0x7d,0x86,0xc3,0x48,0x0d,0x9c,0x0e,0x93,
+0xf1,0x93,0x31,0x92,0xe6,0x54,0x80,0x62,0x6a,0xc9,0x4b,0x5d,0x5c,0xb9,0xa8,0x93,
+0x74,0xba,0x83,0xbf,0xe7,0x3e,0xdd,0xcd,0xbb,0x3f,0xf3,0xee,0xfa,0x79,0xdf,0x72,
+0x32,0x8f,0xc7,0xd9,0xed,0x8e,0x81,0x7f,0xc7,0x00,0xbc,0x94,0xb7,0x9f,0xa6,0x33,
+0x76,0xc2,0x18,0xbe,0xff,0xe0,0x60,0xd3,0xd1,0x33,0xa0,0xa7,0x32,0x4f,0xf6,0x04,
+0x9d,0xef,0xcd,0x78,0x6f,0xe9,0x2d,0x87,0xde,0xee,0xdb,0xcd,0xd8,0xeb,0x13,0x76,
+0xeb,0x8d,0x13,0x6a,0xec,0xcc,0xda,0x85,0x6e,0x70,0x98,0xd1,0x44,0x3c,0xda,0xfa,
+0x1e,0x19,0xee,0x3c,0x8c,0x8f,0x3c,0xeb,0x37,0xd2,0x29,0xda,0x0a,0x29,0xc1,0x13,
+0x07,0x2e,0x49,0x3e,0x5f,0x66,0x90,0x16,0xfe,0x34,0xfd,0xc3,0xb9,0xd8,0x37,0x9d,
+0xa6,0xeb,0x9c,0x62,0xcd,0xb3,0x6f,0x44,0x03,0xa6,0x3e,0x88,0x21,0x5b,0x90,0xf7,
+0x8d,0x7b,0xe4,0x23,0x55,0xe8,0x44,0x02,0x2c,0x13,0x12,0xdb,0xb6,0x40,0x0f,0xca,
+0x25,0x16,0x1b,0x4e,0x52,0x59,0x29,0xe5,0xd7,0xc8,0x26,0x66,0x16,0x39,0x22,0x9a,
+0xbd,0x1a,0x89,0x3b,0x8e,0xbb,0x7f,0xdc,0xaf,0x62,0xa2,0x48,0x19,0xb4,0x47,0x16,
+0x83,0x24,0x76,0x16,0xde,0x2f,0xff,0x66,0x0a,0x1b,0xe0,0x64,0x37,0x92,0x73,0x31,
+0xfc,0xcd,0xfc,0x07,};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__style_css = 3;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__style_css[] FSDATA_ALIGN_POST = {
+/* /style.css (11 chars) */
+0x2f,0x73,0x74,0x79,0x6c,0x65,0x2e,0x63,0x73,0x73,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: Forge
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x46,0x6f,0x72,0x67,0x65,0x0d,0x0a,
+/* "Content-Length: 528
+" (18+ bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x4c,0x65,0x6e,0x67,0x74,0x68,0x3a,0x20,
+0x35,0x32,0x38,0x0d,0x0a,
+/* "Content-Encoding: deflate
+" (27 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
+0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "Content-Type: text/css
+
+" (26 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x74,0x65,
+0x78,0x74,0x2f,0x63,0x73,0x73,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (528 bytes) */
+0x6d,0x53,0xed,0x6e,0xa3,0x30,0x10,0xfc,0xdf,0xa7,0xb0,0x54,0x9d,0x94,0x48,0x31,
+0x07,0xa4,0x49,0x73,0xf0,0x34,0x06,0xaf,0xc1,0xad,0xb1,0x91,0x6d,0x1a,0x72,0xa7,
+0xbe,0xfb,0xed,0x42,0x3e,0x48,0x52,0x19,0x10,0x46,0xde,0x99,0x9d,0xd9,0xa1,0x72,
+0xf2,0xc4,0xfe,0xb1,0x4e,0xf8,0x46,0xdb,0x82,0xa5,0x25,0x53,0xce,0xc6,0x82,0x65,
+0xbb,0x7e,0xfc,0x9d,0x25,0x6f,0x2c,0x9c,0x42,0x84,0x8e,0x0f,0x7a,0xc3,0x82,0xb0,
+0x81,0x07,0xf0,0x5a,0x95,0xac,0x12,0xf5,0x67,0xe3,0xdd,0x60,0x65,0xc1,0x5e,0xd5,
+0x1b,0xae,0xbc,0x64,0xb5,0x33,0xce,0xe3,0x3e,0xcf,0x71,0xf3,0xfd,0xd2,0x82,0x90,
+0xe0,0x11,0x5d,0xea,0xd0,0x1b,0x71,0x2a,0x98,0x32,0x30,0x96,0x4c,0x18,0xdd,0x58,
+0xae,0x11,0x36,0x14,0xac,0x06,0x1b,0xc1,0x97,0xec,0x63,0x08,0x51,0xab,0x13,0xaf,
+0x91,0x1e,0xa8,0x83,0xd0,0x8b,0x1a,0x78,0x05,0xf1,0x08,0x60,0x4b,0xd6,0x0b,0x29,
+0xb5,0x6d,0xb0,0xc5,0x64,0x07,0x1d,0xcb,0xa0,0x7b,0x68,0x22,0xaf,0x68,0xdd,0x9a,
+0x50,0x4a,0x4d,0x4d,0x64,0xcf,0xf2,0x78,0xd0,0x7f,0x01,0x35,0x26,0x5b,0x42,0xc1,
+0x33,0xf9,0xf2,0x0c,0x2d,0xe2,0xb8,0x3f,0x4b,0xfb,0x08,0x63,0xe4,0xd1,0xa3,0x0d,
+0xca,0xf9,0xae,0x60,0x43,0xdf,0x83,0xaf,0x45,0x80,0x1b,0xeb,0x7e,0xbf,0x27,0xc4,
+0x4e,0x68,0xbb,0x14,0xde,0x78,0x2d,0xcb,0xe9,0xc9,0x51,0x36,0x7e,0x8b,0x80,0x4a,
+0xcd,0xd0,0x59,0xb4,0xc0,0x43,0x0f,0x22,0xae,0xc4,0x10,0x1d,0x57,0x3a,0x6e,0x58,
+0xa7,0x6d,0x27,0xc6,0x55,0x76,0x80,0x6e,0xc3,0x32,0xe5,0xd7,0x6b,0xac,0x15,0xfd,
+0xb9,0x8b,0xab,0x13,0xd9,0xdc,0x7d,0x80,0x3a,0x6a,0x47,0x74,0xf7,0x43,0x21,0xfd,
+0x95,0xf3,0x38,0x02,0xee,0x85,0xd4,0x03,0x32,0xed,0xfb,0xf1,0xb1,0xbe,0x72,0x23,
+0x0f,0xad,0x90,0xee,0x48,0xd2,0xb3,0x7e,0x64,0x39,0xde,0xbe,0xa9,0xc4,0x2a,0xdd,
+0xb0,0xf3,0x95,0x64,0xbb,0x35,0x51,0x45,0x51,0x19,0x20,0xa2,0x19,0x16,0x15,0x18,
+0xd1,0x07,0xb4,0xe7,0xf2,0x56,0xb2,0xa3,0x96,0xb1,0x45,0xec,0x34,0xfd,0x35,0x55,
+0xb4,0x1b,0x16,0x25,0x96,0x2c,0xe6,0x97,0xe3,0xfc,0xd2,0xe4,0xed,0xea,0xe8,0x94,
+0x07,0xb4,0x41,0x37,0x6d,0x9c,0x6b,0x0a,0xa5,0x7d,0x88,0xbc,0x6e,0xb5,0x91,0x54,
+0xbf,0xdc,0x23,0xd6,0xb2,0xca,0x80,0x9a,0x8a,0x92,0x4a,0x50,0xd4,0x5a,0x20,0x14,
+0x62,0xd9,0x3f,0x25,0x44,0x4a,0xf9,0xe4,0xc8,0x96,0x1c,0x71,0x5f,0xe0,0x95,0x21,
+0x07,0x5a,0x2d,0x25,0xa5,0xed,0x1a,0x86,0x29,0x6c,0xe9,0x95,0x40,0xea,0xaf,0x05,
+0xc9,0x2c,0xf2,0xac,0x38,0x7d,0x60,0x83,0xc3,0x7b,0x46,0x79,0x9c,0xf2,0xa2,0x69,
+0x42,0xc5,0x7c,0x94,0x40,0xc3,0x84,0x18,0x3a,0x61,0x0c,0xe2,0x2d,0x72,0x96,0x26,
+0x87,0x29,0x7a,0x0f,0x79,0x4a,0xc0,0x7b,0x47,0xfa,0x2e,0xdf,0xeb,0x74,0xfb,0x87,
+0xd0,0xbf,0x5f,0x5e,0x8d,0xb6,0x9f,0x3f,0x83,0x2c,0x3c,0xcf,0x26,0xcf,0x67,0x4f,
+0xee,0x1d,0xf8,0xe1,0x4f,0x7a,0x17,0xb0,0x4f,0xaf,0xd8,0x09,0x66,0xe3,0x29,0x5d,
+0x37,0xfe,0x6a,0x88,0x71,0x4a,0xdf,0xec,0x19,0xf7,0x97,0x01,0x9c,0x7f,0xae,0xff,
+};
+
+
+
+const struct fsdata_file file__404_html[] = { {
+file_NULL,
+data__404_html,
+data__404_html + 12,
+sizeof(data__404_html) - 12,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,
+}};
+
+const struct fsdata_file file__app_js[] = { {
+file__404_html,
+data__app_js,
+data__app_js + 8,
+sizeof(data__app_js) - 8,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,
+}};
+
+const struct fsdata_file file__index_html[] = { {
+file__app_js,
+data__index_html,
+data__index_html + 12,
+sizeof(data__index_html) - 12,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,
+}};
+
+const struct fsdata_file file__style_css[] = { {
+file__index_html,
+data__style_css,
+data__style_css + 12,
+sizeof(data__style_css) - 12,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,
+}};
+
+#define FS_ROOT file__style_css
+#define FS_NUMFILES 4
+
@@ -0,0 +1,236 @@
+/**
+ * @file ecmbench.c
+ * @brief Host benchmark of the ECM network interface, built against LwIP's unit test harness.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Builds the firmware's interface with LwIP configured as for its unit tests
+ * (LwIP/test/unit/lwipopts.h, and the harness's sys_arch for the clock).
+ * From Firmware/Include:
+ *
+ *   gcc -O2 -D'ECMIF_BARRIER()=__atomic_thread_fence(__ATOMIC_SEQ_CST)' \
+ *       -ILwIP/src/include -ILwIP/test/unit -ILwIP/system -o ecmbench \
+ *       Net/host/ecmbench.c Net/ecmif.c LwIP/src/core/[a-z]*.c LwIP/src/core/ipv4/[a-z]*.c \
+ *       LwIP/src/core/ipv6/[a-z]*.c LwIP/src/api/tcpip.c LwIP/src/netif/ethernet.c \
+ *       LwIP/test/unit/arch/sys_arch.c
+ *
+ * The loop plays both sides of the interface in turn. As the USB side it
+ * writes each frame from the host into the buffer ecmifRxBuffer hands out,
+ * as the OTG FIFO read does, and drains what LwIP queued to send. As the
+ * network side it runs ecmifService. Three kinds of traffic:
+ *
+ *   ping  64 byte ICMP echo requests, each answered
+ *   udp   1472 byte datagrams to a UDP port that takes them and lets go
+ *   small 18 byte datagrams to the same port, the G-code upload case
+ *
+ * "in place" is ecmif.c as is; "copied" passes each frame to LwIP the way
+ * a driver without its own buffers does, by copying it into a PBUF_POOL
+ * pbuf, to show what that costs per frame. The USB bus is not modelled:
+ * this is the CPU cost of the stack, and a full speed bus tops out near
+ * 800 full sized frames a second.
+ */
+
+#include "../ecmif.h"
+#include "lwip/init.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/etharp.h"
+#include "lwip/udp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip4.h"
+#include "netif/ethernet.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAMES 2000000U
+#define UDP_PORT 9
+
+static EcmInterface _ecm;
+static const uint8_t _mac[6] = {0x02, 0x46, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t _hostMac[6] = {0x06, 0x46, 0x00, 0x00, 0x00, 0x01};
+static unsigned long _usbWakes, _netWakes, _udpReceived, _sent;
+static int _copied;
+
+static void _wakeUsb(void) { _usbWakes++; }
+static void _wakeNet(void) { _netWakes++; }
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void _udpRecv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    (void)arg;
+    (void)pcb;
+    (void)addr;
+    (void)port;
+    _udpReceived++;
+    pbuf_free(p);
+}
+
+static void _put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/**
+ * @brief  An Ethernet frame from the host to the printer carrying an IPv4 packet, as it comes off the endpoint (no padding). Returns its length.
+ */
+static uint32_t _frame(uint8_t *f, uint8_t proto, uint32_t payload)
+{
+    memcpy(f, _mac, 6);
+    memcpy(f + 6, _hostMac, 6);
+    _put16(f + 12, ETHTYPE_IP);
+
+    uint8_t *ip = f + SIZEOF_ETH_HDR;
+    uint32_t length = IP_HLEN + payload;
+    memset(ip, 0, IP_HLEN);
+    ip[0] = 0x45;
+    _put16(ip + 2, (uint16_t)length);
+    ip[8] = 64;
+    ip[9] = proto;
+    ip[12] = 192, ip[13] = 168, ip[14] = 7, ip[15] = 1;
+    ip[16] = 192, ip[17] = 168, ip[18] = 7, ip[19] = 2;
+    uint16_t sum = inet_chksum(ip, IP_HLEN);
+    memcpy(ip + 10, &sum, 2);
+
+    uint8_t *body = ip + IP_HLEN;
+    memset(body, 0, payload);
+    if (proto == IP_PROTO_ICMP)
+    {
+        body[0] = 8; // Echo request
+        _put16(body + 4, 0x1234);
+        for (uint32_t i = 8; i < payload; i++)
+            body[i] = (uint8_t)i;
+        sum = inet_chksum(body, (u16_t)payload);
+        memcpy(body + 2, &sum, 2);
+    }
+    else
+    {
+        _put16(body, 40000);
+        _put16(body + 2, UDP_PORT);
+        _put16(body + 4, (uint16_t)payload);
+        // No checksum, which IPv4 allows
+        for (uint32_t i = 8; i < payload; i++)
+            body[i] = (uint8_t)('A' + i % 26);
+    }
+    return SIZEOF_ETH_HDR + length;
+}
+
+/**
+ * @brief  ecmifService's receive half, for a driver that copies each frame into a pbuf of LwIP's.
+ */
+static void _serviceCopied(EcmInterface *ecm)
+{
+    struct netif *netif = &ecm->netif;
+    uint32_t sent = ecm->txSent;
+    while (ecm->txTail != sent)
+    {
+        pbuf_free(ecm->tx[ecm->txTail & (ECMIF_TX_QUEUE - 1U)]);
+        ecm->txTail++;
+    }
+    while (ecm->filledTail != ecm->filledHead)
+    {
+        EcmRxBuffer *b = &ecm->rx[ecm->filled[ecm->filledTail & (ECMIF_RX_BUFFERS - 1U)]];
+        ecm->filledTail++;
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, (u16_t)(ETH_PAD_SIZE + b->length), PBUF_POOL);
+        if (p != NULL)
+        {
+            pbuf_take(p, b->data, (u16_t)(ETH_PAD_SIZE + b->length));
+            if (netif->input(p, netif) != ERR_OK)
+                pbuf_free(p);
+        }
+        // The buffer goes straight back
+        b->pbuf.custom_free_function(&b->pbuf.pbuf);
+    }
+}
+
+static void _run(const char *name, const uint8_t *frame, uint32_t length)
+{
+    memset(&_ecm.stats, 0, sizeof(_ecm.stats));
+    _udpReceived = _sent = 0;
+    uint32_t stalls = 0;
+
+    double start = _now();
+    for (uint32_t i = 0; i < FRAMES; i++)
+    {
+        // USB side: the frame arrives
+        uint8_t *buffer = ecmifRxBuffer(&_ecm);
+        if (buffer == NULL)
+        {
+            stalls++;
+        }
+        else
+        {
+            memcpy(buffer, frame, length);
+            ecmifRxCommit(&_ecm, length);
+        }
+
+        // Network side
+        if (_copied)
+            _serviceCopied(&_ecm);
+        else
+            ecmifService(&_ecm);
+
+        // USB side: whatever LwIP answered goes out
+        const uint8_t *data;
+        while (ecmifTxNext(&_ecm, &data) > 0)
+        {
+            _sent++;
+            ecmifTxDone(&_ecm);
+        }
+    }
+    if (_copied)
+        _serviceCopied(&_ecm);
+    else
+        ecmifService(&_ecm);
+    double s = _now() - start;
+
+    printf("%-6s %9s %6u %12.0f %10.1f %9lu %9lu %7u %8lu\n", name, _copied ? "copied" : "in place", length,
+           FRAMES / s, FRAMES * (double)length / s / 1e6, _sent, _udpReceived, stalls,
+           (unsigned long)_ecm.stats.txCopied);
+}
+
+int main(void)
+{
+    static uint8_t ping[ECMIF_FRAME_SIZE], udp[ECMIF_FRAME_SIZE], small[ECMIF_FRAME_SIZE];
+    uint32_t pingLength = _frame(ping, IP_PROTO_ICMP, 64);
+    uint32_t udpLength = _frame(udp, IP_PROTO_UDP, 1480);
+    uint32_t smallLength = _frame(small, IP_PROTO_UDP, 26);
+
+    lwip_init();
+    ecmifSetup(&_ecm, _mac, _wakeUsb, _wakeNet);
+    ip4_addr_t address, netmask, gateway;
+    IP4_ADDR(&address, 192, 168, 7, 2);
+    IP4_ADDR(&netmask, 255, 255, 255, 0);
+    IP4_ADDR(&gateway, 0, 0, 0, 0);
+    netif_add(&_ecm.netif, &address, &netmask, &gateway, &_ecm, ecmifInit, ethernet_input);
+    netif_set_up(&_ecm.netif);
+    ecmifLink(&_ecm, true);
+    ecmifService(&_ecm);
+
+    // The host is already known, as it would be after its first packet
+    ip4_addr_t host;
+    IP4_ADDR(&host, 192, 168, 7, 1);
+    etharp_add_static_entry(&host, (struct eth_addr *)_hostMac);
+
+    struct udp_pcb *pcb = udp_new();
+    udp_bind(pcb, IP_ADDR_ANY, UDP_PORT);
+    udp_recv(pcb, _udpRecv, NULL);
+
+    printf("kind        mode  bytes     frames/s     MB/s in      sent  received  stalls  tx gathered\n");
+    for (_copied = 0; _copied < 2; _copied++)
+    {
+        _run("ping", ping, pingLength);
+        _run("udp", udp, udpLength);
+        _run("small", small, smallLength);
+    }
+    printf("wakeups: usb %lu, net %lu\n", _usbWakes, _netWakes);
+    return 0;
+}
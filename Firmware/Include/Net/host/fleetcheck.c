@@ -0,0 +1,717 @@
+/**
+ * @file fleetcheck.c
+ * @brief Host check of fleet telemetry against a stand-in MQTT broker, over LwIP's loopback interface.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Builds fleet.c and LwIP's MQTT client with the firmware's lwipopts.h, plus
+ * the loopback interface. From Firmware/Include:
+ *
+ *   gcc -O2 -DLWIP_HAVE_LOOPIF=1 -DLWIP_NETIF_LOOPBACK=1 -ILwIP/src/include -INet \
+ *       -ILwIP/system -o fleetcheck Net/host/fleetcheck.c Net/fleet.c Net/json.c \
+ *       LwIP/src/apps/mqtt/mqtt.c LwIP/src/core/[a-z]*.c LwIP/src/core/ipv4/[a-z]*.c \
+ *       LwIP/src/netif/ethernet.c -lm
+ *
+ * The broker is a small MQTT 3.1.1 server on LwIP's raw TCP API in the same
+ * process, behaving as mosquitto does for what the printer uses: CONNECT
+ * with a will, SUBSCRIBE with + and # filters, PUBLISH at QoS 0 and 1,
+ * retained messages, PINGREQ, and the will published when a connection is
+ * lost. It also subscribes to everything itself, as mosquitto_sub -t '#'
+ * would, and rebuilds the printer's state from the keyframes and changes
+ * the way a farm dashboard does.
+ *
+ * The printer is a model: heaters settling towards their targets with a
+ * little noise, and a print moving the head around. fleetSample reads the
+ * model and keeps what it saw, so every sample the broker gets can be
+ * checked against the truth: each field has to be within its deadband,
+ * plus the rounding of the decimals sent. The script, in simulated time
+ * (which runs far faster than real time):
+ *
+ *   10s  set the hotend and bed over cmd/, then two bad commands
+ *   60s  the print starts; it's paused at 120s and resumed at 150s
+ *   200s sample and publish every 50ms, and the broker stops reading for
+ *        25s, so the pool fills and messages are dropped
+ *   300s the broker drops the connection; the will says "0" until the
+ *        printer is back
+ *   630s the print is done
+ *
+ * "naive" is what sending every field of every sample, one message each,
+ * would have cost in payload bytes.
+ */
+
+#define _GNU_SOURCE
+#include "../fleet.h"
+#include "../json.h"
+#include "lwip/init.h"
+#include "lwip/tcp.h"
+#include "lwip/timeouts.h"
+#include "lwip/netif.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PORT 1883
+#define END_MS 660000U
+#define HISTORY 4096U // Samples remembered, a power of two
+#define SESSION_BUFFER 16384U
+#define RETAINED 8
+
+static uint32_t _ms;
+static int _failures;
+
+u32_t sys_now(void)
+{
+    return _ms;
+}
+
+// Core/memory.c needs the firmware's linker script; there's no map to keep here
+void forgeMemoryAdd(const char *name, const void *base, uint32_t size)
+{
+    (void)name;
+    (void)base;
+    (void)size;
+}
+
+static void _check(int ok, const char *what)
+{
+    printf("%s %s\n", ok ? "pass" : "FAIL", what);
+    if (!ok)
+        _failures++;
+}
+
+/*
+ * The printer
+ */
+
+typedef struct
+{
+    float hotend, hotendTarget, bed, bedTarget;
+    float position[4];
+    uint16_t progress;
+    uint8_t state;
+} Model;
+
+static Model _model = {25.0f, 0.0f, 25.0f, 0.0f, {0, 0, 0, 0}, 0, 0};
+static uint32_t _printMs, _lastStep, _noise = 1;
+static struct
+{
+    uint32_t ms;
+    float values[FLEET_FIELDS];
+} _history[HISTORY];
+static uint32_t _samples, _paused, _resumed;
+
+static float _rand(void)
+{
+    _noise = _noise * 1103515245U + 12345U;
+    return (float)((_noise >> 16) & 0x7FFFU) / 32768.0f - 0.5f;
+}
+
+static void _step(void)
+{
+    float dt = (float)(_ms - _lastStep) / 1000.0f;
+    _lastStep = _ms;
+    _model.hotend += (_model.hotendTarget > 25.0f ? _model.hotendTarget - _model.hotend : 25.0f - _model.hotend) * dt / 20.0f;
+    _model.bed += (_model.bedTarget > 25.0f ? _model.bedTarget - _model.bed : 25.0f - _model.bed) * dt / 60.0f;
+    if (_model.state != 1)
+        return;
+    _printMs += (uint32_t)(dt * 1000.0f + 0.5f);
+    float t = (float)_printMs / 1000.0f;
+    _model.position[0] = 100.0f + 60.0f * sinf(t / 3.0f);
+    _model.position[1] = 100.0f + 60.0f * cosf(t / 5.0f);
+    _model.position[2] = 0.2f + 0.2f * floorf(t / 30.0f);
+    _model.position[3] = t * 0.8f;
+    _model.progress = (uint16_t)(_printMs / 540U);
+    if (_model.progress >= 1000U)
+    {
+        _model.progress = 1000U;
+        _model.state = 3;
+    }
+}
+
+void fleetSample(FleetSample *sample)
+{
+    _step();
+    sample->hotend = _model.hotend + _rand() * 0.4f;
+    sample->hotendTarget = _model.hotendTarget;
+    sample->bed = _model.bed + _rand() * 0.4f;
+    sample->bedTarget = _model.bedTarget;
+    for (uint8_t a = 0; a < 4; a++)
+        sample->position[a] = _model.position[a];
+    sample->progress = _model.progress;
+    sample->state = _model.state;
+
+    uint32_t i = _samples++ & (HISTORY - 1U);
+    float *v = _history[i].values;
+    _history[i].ms = _ms;
+    v[0] = sample->hotend, v[1] = sample->hotendTarget, v[2] = sample->bed, v[3] = sample->bedTarget;
+    for (uint8_t a = 0; a < 4; a++)
+        v[4 + a] = sample->position[a];
+    v[8] = sample->progress, v[9] = sample->state;
+}
+
+void fleetCommand(FleetCommand command, float value)
+{
+    switch (command)
+    {
+    case FLEET_CMD_PAUSE:
+        _paused++;
+        if (_model.state == 1)
+            _model.state = 2;
+        break;
+    case FLEET_CMD_RESUME:
+        _resumed++;
+        if (_model.state == 2)
+            _model.state = 1;
+        break;
+    case FLEET_CMD_HOTEND:
+        _model.hotendTarget = value;
+        break;
+    case FLEET_CMD_BED:
+        _model.bedTarget = value;
+        break;
+    }
+}
+
+static const float *_truth(uint32_t ms)
+{
+    for (uint32_t n = 0; n < HISTORY && n < _samples; n++)
+    {
+        uint32_t i = (_samples - 1U - n) & (HISTORY - 1U);
+        if (_history[i].ms == ms)
+            return _history[i].values;
+    }
+    return NULL;
+}
+
+/*
+ * The farm's side: rebuilds the state from what the broker delivers
+ */
+
+static const char *const _keys[FLEET_FIELDS] = {"ht", "hT", "bt", "bT", "x", "y", "z", "e", "p", "st"};
+static const float _deadbands[FLEET_FIELDS] = {FLEET_TEMP_DEADBAND, 0, FLEET_TEMP_DEADBAND, 0,
+                                               FLEET_POSITION_DEADBAND, FLEET_POSITION_DEADBAND,
+                                               FLEET_POSITION_DEADBAND, FLEET_POSITION_DEADBAND,
+                                               FLEET_PROGRESS_DEADBAND, 0};
+static const float _rounding[FLEET_FIELDS] = {0.05f, 0.05f, 0.05f, 0.05f, 0.005f, 0.005f, 0.005f, 0.005f, 0.5f, 0.5f};
+
+static struct
+{
+    float state[FLEET_FIELDS];
+    bool valid;
+    uint32_t seq;
+    uint32_t messages, keyframes, bytes, entries, checked, violations, gaps, unknown;
+    float worst[FLEET_FIELDS]; // Largest error, as a fraction of what's allowed
+    char online[8];
+    uint32_t onlineChanges;
+} _farm;
+
+static const char *_number(const char *p, float *v)
+{
+    if (strncmp(p, "null", 4) == 0)
+    {
+        *v = NAN;
+        return p + 4;
+    }
+    char *end;
+    *v = strtof(p, &end);
+    return end;
+}
+
+static void _entry(const char *p, const char **next, uint32_t t)
+{
+    // {"dt":250,"ht":202.0,"z":0.30}
+    float dt;
+    p = _number(p + 6, &dt);
+    while (*p == ',')
+    {
+        const char *key = p + 2;
+        const char *quote = strchr(key, '"');
+        size_t length = (size_t)(quote - key);
+        float v;
+        p = _number(quote + 2, &v);
+        uint8_t f = 0;
+        while (f < FLEET_FIELDS && !(strlen(_keys[f]) == length && strncmp(_keys[f], key, length) == 0))
+            f++;
+        if (f == FLEET_FIELDS)
+            _farm.unknown++;
+        else
+            _farm.state[f] = v;
+    }
+    *next = p + 1;
+    _farm.entries++;
+
+    const float *truth = _truth(t + (uint32_t)dt);
+    if (truth == NULL || !_farm.valid)
+        return;
+    _farm.checked++;
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+    {
+        if (isnan(truth[f]) || isnan(_farm.state[f]))
+        {
+            if (isnan(truth[f]) != isnan(_farm.state[f]))
+                _farm.violations++;
+            continue;
+        }
+        float allowed = _deadbands[f] + _rounding[f] + 1e-3f;
+        float error = fabsf(truth[f] - _farm.state[f]) / allowed;
+        if (error > _farm.worst[f])
+            _farm.worst[f] = error;
+        if (error > 1.0f)
+            _farm.violations++;
+    }
+}
+
+static void _observe(const char *topic, const uint8_t *payload, uint32_t length)
+{
+    char text[FLEET_MESSAGE_SIZE + 1];
+    if (strstr(topic, "/online") != NULL)
+    {
+        uint32_t n = length < 7 ? length : 7;
+        memcpy(_farm.online, payload, n);
+        _farm.online[n] = '\0';
+        _farm.onlineChanges++;
+        return;
+    }
+    if (strstr(topic, "/state") == NULL || length > FLEET_MESSAGE_SIZE)
+        return;
+    memcpy(text, payload, length);
+    text[length] = '\0';
+    _farm.messages++;
+    _farm.bytes += length;
+
+    // {"seq":41,"t":123456,"k":0,"s":[...]}
+    float seq, t, k;
+    const char *p = _number(text + 7, &seq);
+    p = _number(p + 5, &t);
+    p = _number(p + 5, &k);
+    if (k != 0.0f)
+    {
+        _farm.keyframes++;
+        _farm.valid = true;
+    }
+    else if ((uint32_t)seq != _farm.seq + 1U && _farm.valid)
+    {
+        // Lost something; wait for the next keyframe
+        _farm.gaps++;
+        _farm.valid = false;
+    }
+    _farm.seq = (uint32_t)seq;
+    p += 6;
+    while (*p == '{')
+    {
+        _entry(p, &p, (uint32_t)t);
+        if (*p == ',')
+            p++;
+    }
+}
+
+/*
+ * The broker
+ */
+
+typedef struct
+{
+    struct tcp_pcb *pcb;
+    uint8_t in[SESSION_BUFFER];
+    uint32_t used;
+    uint32_t unread; // Bytes not yet given back to the window, while stalled
+    bool stalled;
+    char filter[64];
+    char will[64];
+    char willMessage[16];
+    bool willRetain;
+} Session;
+
+static struct
+{
+    char topic[64];
+    uint8_t payload[FLEET_MESSAGE_SIZE];
+    uint32_t length;
+} _retained[RETAINED];
+
+static Session _session;
+static bool _connected;
+
+static bool _matches(const char *filter, const char *topic)
+{
+    while (*filter != '\0')
+    {
+        if (*filter == '#')
+            return true;
+        if (*filter == '+')
+        {
+            while (*topic != '\0' && *topic != '/')
+                topic++;
+            filter++;
+            continue;
+        }
+        if (*filter != *topic)
+            return false;
+        filter++, topic++;
+    }
+    return *topic == '\0';
+}
+
+static void _send(Session *s, const uint8_t *data, uint32_t length)
+{
+    tcp_write(s->pcb, data, (u16_t)length, TCP_WRITE_FLAG_COPY);
+    tcp_output(s->pcb);
+}
+
+static void _deliver(Session *s, const char *topic, const uint8_t *payload, uint32_t length, bool retain)
+{
+    uint8_t packet[FLEET_MESSAGE_SIZE + 80];
+    uint32_t topicLength = (uint32_t)strlen(topic);
+    uint32_t remaining = 2U + topicLength + length;
+    uint32_t n = 0;
+    packet[n++] = (uint8_t)(0x30U | (retain ? 1U : 0U));
+    do
+    {
+        uint8_t b = remaining & 0x7FU;
+        remaining >>= 7;
+        packet[n++] = (uint8_t)(b | (remaining > 0 ? 0x80U : 0U));
+    } while (remaining > 0);
+    packet[n++] = (uint8_t)(topicLength >> 8);
+    packet[n++] = (uint8_t)topicLength;
+    memcpy(packet + n, topic, topicLength);
+    n += topicLength;
+    memcpy(packet + n, payload, length);
+    _send(s, packet, n + length);
+}
+
+static void _route(const char *topic, const uint8_t *payload, uint32_t length, bool retain)
+{
+    if (retain)
+    {
+        int free = -1;
+        for (int i = 0; i < RETAINED; i++)
+        {
+            if (strcmp(_retained[i].topic, topic) == 0)
+                _retained[i].topic[0] = '\0';
+            if (_retained[i].topic[0] == '\0' && free < 0)
+                free = i;
+        }
+        if (length > 0 && free >= 0)
+        {
+            strcpy(_retained[free].topic, topic);
+            memcpy(_retained[free].payload, payload, length);
+            _retained[free].length = length;
+        }
+    }
+    _observe(topic, payload, length);
+    if (_connected && _session.filter[0] != '\0' && _matches(_session.filter, topic))
+        _deliver(&_session, topic, payload, length, false);
+}
+
+static uint16_t _get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void _packet(Session *s, uint8_t type, const uint8_t *p, uint32_t length)
+{
+    switch (type >> 4)
+    {
+    case 1: // CONNECT
+    {
+        uint8_t flags = p[7];
+        const uint8_t *q = p + 10;
+        q += 2 + _get16(q); // Client id
+        s->will[0] = '\0';
+        if (flags & 0x04U)
+        {
+            uint16_t n = _get16(q);
+            memcpy(s->will, q + 2, n);
+            s->will[n] = '\0';
+            q += 2 + n;
+            n = _get16(q);
+            memcpy(s->willMessage, q + 2, n);
+            s->willMessage[n] = '\0';
+            s->willRetain = (flags & 0x20U) != 0;
+        }
+        static const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+        _send(s, connack, sizeof(connack));
+        break;
+    }
+    case 8: // SUBSCRIBE
+    {
+        uint16_t n = _get16(p + 2);
+        memcpy(s->filter, p + 4, n);
+        s->filter[n] = '\0';
+        uint8_t suback[] = {0x90, 0x03, p[0], p[1], (uint8_t)(p[4 + n] > 1 ? 1 : p[4 + n])};
+        _send(s, suback, sizeof(suback));
+        for (int i = 0; i < RETAINED; i++)
+        {
+            if (_retained[i].topic[0] != '\0' && _matches(s->filter, _retained[i].topic))
+                _deliver(s, _retained[i].topic, _retained[i].payload, _retained[i].length, true);
+        }
+        break;
+    }
+    case 3: // PUBLISH
+    {
+        uint8_t qos = (type >> 1) & 3U;
+        uint16_t n = _get16(p);
+        char topic[64];
+        memcpy(topic, p + 2, n);
+        topic[n] = '\0';
+        uint32_t offset = 2U + n;
+        if (qos > 0)
+        {
+            uint8_t puback[] = {0x40, 0x02, p[offset], p[offset + 1]};
+            _send(s, puback, sizeof(puback));
+            offset += 2;
+        }
+        _route(topic, p + offset, length - offset, (type & 1U) != 0);
+        break;
+    }
+    case 12: // PINGREQ
+    {
+        static const uint8_t pingresp[] = {0xD0, 0x00};
+        _send(s, pingresp, sizeof(pingresp));
+        break;
+    }
+    case 14: // DISCONNECT: no will
+        s->will[0] = '\0';
+        break;
+    default:
+        break;
+    }
+}
+
+static void _parse(Session *s)
+{
+    uint32_t at = 0;
+    for (;;)
+    {
+        uint32_t remaining = 0, shift = 0, i = at + 1;
+        while (i < s->used && (s->in[i] & 0x80U))
+            remaining |= (uint32_t)(s->in[i++] & 0x7FU) << shift, shift += 7;
+        if (i >= s->used)
+            break;
+        remaining |= (uint32_t)s->in[i++] << shift;
+        if (s->used - i < remaining)
+            break;
+        _packet(s, s->in[at], &s->in[i], remaining);
+        at = i + remaining;
+    }
+    memmove(s->in, s->in + at, s->used - at);
+    s->used -= at;
+}
+
+static void _lost(Session *s)
+{
+    _connected = false;
+    s->pcb = NULL;
+    s->filter[0] = '\0';
+    if (s->will[0] != '\0')
+        _route(s->will, (const uint8_t *)s->willMessage, (uint32_t)strlen(s->willMessage), s->willRetain);
+}
+
+static err_t _recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    Session *s = (Session *)arg;
+    (void)err;
+    if (p == NULL)
+    {
+        tcp_close(pcb);
+        _lost(s);
+        return ERR_OK;
+    }
+    if (s->used + p->tot_len > SESSION_BUFFER)
+        abort();
+    pbuf_copy_partial(p, s->in + s->used, p->tot_len, 0);
+    s->used += p->tot_len;
+    if (s->stalled)
+    {
+        s->unread += p->tot_len;
+    }
+    else
+    {
+        tcp_recved(pcb, p->tot_len);
+        _parse(s);
+    }
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void _error(void *arg, err_t err)
+{
+    (void)err;
+    _lost((Session *)arg);
+}
+
+static err_t _accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    (void)arg;
+    (void)err;
+    Session *s = &_session;
+    memset(s, 0, sizeof(*s));
+    s->pcb = pcb;
+    _connected = true;
+    tcp_arg(pcb, s);
+    tcp_recv(pcb, _recv);
+    tcp_err(pcb, _error);
+    return ERR_OK;
+}
+
+static void _stall(bool stalled)
+{
+    Session *s = &_session;
+    s->stalled = stalled;
+    if (!stalled && s->pcb != NULL)
+    {
+        tcp_recved(s->pcb, (u16_t)s->unread);
+        s->unread = 0;
+        _parse(s);
+    }
+}
+
+static void _drop(void)
+{
+    if (_session.pcb == NULL)
+        return;
+    struct tcp_pcb *pcb = _session.pcb;
+    tcp_arg(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_abort(pcb);
+    _lost(&_session);
+}
+
+static void _command(const char *name, const char *payload)
+{
+    char topic[64];
+    strcpy(topic, FLEET.topics[3]);
+    strcat(topic, name);
+    _route(topic, (const uint8_t *)payload, (uint32_t)strlen(payload), false);
+}
+
+/*
+ * The script
+ */
+
+static uint32_t _fullSample(void)
+{
+    char buffer[256];
+    JsonWriter j = {buffer, buffer + sizeof(buffer)};
+    const float *v = _truth(_history[(_samples - 1U) & (HISTORY - 1U)].ms);
+    jsonRaw(&j, "{\"seq\":1234,\"t\":123456,\"k\":1,\"s\":[{\"dt\":0");
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+    {
+        jsonRaw(&j, ",\"");
+        jsonRaw(&j, _keys[f]);
+        jsonRaw(&j, "\":");
+        jsonFixed(&j, v[f], f < 4 ? 1 : (f < 8 ? 2 : 0));
+    }
+    jsonRaw(&j, "}]}");
+    return (uint32_t)(j.p - buffer);
+}
+
+int main(void)
+{
+    lwip_init();
+    struct tcp_pcb *listener = tcp_new();
+    tcp_bind(listener, IP_ADDR_ANY, PORT);
+    listener = tcp_listen(listener);
+    tcp_accept(listener, _accept);
+
+    struct netif named;
+    memset(&named, 0, sizeof(named));
+    static const uint8_t mac[6] = {0x02, 0x46, 0x12, 0x34, 0x56, 0x78};
+    static const uint8_t hostMac[6] = {0x06, 0x46, 0x12, 0x34, 0x56, 0x78};
+    memcpy(named.hwaddr, mac, 6);
+    fleetInit(&named, hostMac);
+    ip_addr_t broker;
+    IP_ADDR4(&broker, 127, 0, 0, 1);
+    fleetSetBroker(&broker, PORT);
+
+    uint32_t naive = 0, lastSamples = 0, connectedAt = 0, reconnectedAt = 0;
+    uint32_t droppedBeforeStall = 0;
+    for (_ms = 1; _ms <= END_MS; _ms++)
+    {
+        switch (_ms)
+        {
+        case 10000:
+            _command("hotend", "210");
+            _command("bed", "60");
+            break;
+        case 15000:
+            _command("hotend", "hot");
+            _command("bed", "999");
+            _command("launch", "1");
+            break;
+        case 60000:
+            _model.state = 1;
+            break;
+        case 120000:
+            _command("pause", "");
+            break;
+        case 150000:
+            _command("resume", "");
+            break;
+        case 200000:
+            _command("rate", "50 50");
+            droppedBeforeStall = FLEET.stats.dropped;
+            break;
+        case 201000:
+            _stall(true);
+            break;
+        case 226000:
+            _stall(false);
+            _command("rate", "250 2000");
+            break;
+        case 300000:
+            _drop();
+            break;
+        default:
+            break;
+        }
+        sys_check_timeouts();
+        netif_poll_all();
+
+        if (connectedAt == 0 && fleetConnected())
+            connectedAt = _ms;
+        if (_ms > 300000 && reconnectedAt == 0 && fleetConnected())
+            reconnectedAt = _ms;
+        while (lastSamples != _samples)
+        {
+            lastSamples++;
+            naive += _fullSample();
+        }
+    }
+
+    const FleetStats *st = &FLEET.stats;
+    printf("simulated %us; %u samples, %u with changes, %u unchanged\n", END_MS / 1000U, _samples, st->samples,
+           st->unchanged);
+    printf("published %u messages (%u keyframes), %u bytes; naive %u bytes, %.1fx smaller\n", st->published,
+           st->keyframes, st->bytes, naive, (double)naive / (double)st->bytes);
+    printf("broker got %u messages, %u samples, %u checked against the model; %u gaps, %u dropped by the pool\n",
+           _farm.messages, _farm.entries, _farm.checked, _farm.gaps, st->dropped);
+    printf("worst error, as a share of deadband + rounding:");
+    for (uint8_t f = 0; f < FLEET_FIELDS; f++)
+        printf(" %s %.2f", _keys[f], (double)_farm.worst[f]);
+    printf("\nconnected at %ums, again %ums after the broker dropped it\n", connectedAt, reconnectedAt - 300000U);
+
+    _check(_farm.violations == 0 && _farm.checked > 1000, "every sample within its deadband of the model");
+    _check(_farm.unknown == 0, "only known keys");
+    _check(st->bytes * 3U < naive, "delta compression saves at least 3x");
+    _check(_model.hotendTarget == 210.0f && _model.bedTarget == 60.0f, "set temperatures");
+    _check(st->badCommands == 3, "bad commands refused");
+    _check(_paused == 1 && _resumed == 1, "pause and resume");
+    _check(FLEET.sampleMs == 250U && FLEET.publishMs == 2000U, "rates changed");
+    _check(st->dropped > droppedBeforeStall && _farm.gaps > 0, "stalled broker: pool full, messages dropped");
+    _check(_farm.valid, "state rebuilt again after the gap");
+    _check(st->connects == 2 && reconnectedAt - 300000U <= FLEET_RECONNECT_MS + 1000U, "reconnected");
+    _check(_farm.onlineChanges == 3 && strcmp(_farm.online, "1") == 0, "online 1, will 0, online 1");
+    _check(_model.state == 3 && _farm.state[9] == 3.0f, "print finished, and the broker knows");
+    bool retainedKeyframe = false;
+    for (int i = 0; i < RETAINED; i++)
+    {
+        if (strcmp(_retained[i].topic, FLEET.topics[0]) == 0)
+            retainedKeyframe = memmem(_retained[i].payload, _retained[i].length, "\"k\":1", 5) != NULL;
+    }
+    _check(retainedKeyframe, "retained state is a keyframe");
+    return _failures == 0 ? 0 : 1;
+}
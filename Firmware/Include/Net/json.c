@@ -0,0 +1,111 @@
+/**
+ * @file json.c
+ * @brief Writing JSON into a fixed buffer, for the replies and messages the network services send.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "json.h"
+#include <math.h>
+
+/**
+ * @brief  Writes s as it is, e.g. punctuation and keys.
+ * @param[in]  j is the reply being written.
+ * @param[in]  s is the text.
+ * @retval None
+ * @headerfile json.h
+ */
+void jsonRaw(JsonWriter *j, const char *s)
+{
+    while (*s != '\0' && j->p < j->end)
+        *j->p++ = *s++;
+}
+
+/**
+ * @brief  Writes one character.
+ * @param[in]  j is the reply being written.
+ * @param[in]  c is the character.
+ * @retval None
+ * @headerfile json.h
+ */
+void jsonChar(JsonWriter *j, char c)
+{
+    if (j->p < j->end)
+        *j->p++ = c;
+}
+
+/**
+ * @brief  Writes v in decimal.
+ * @param[in]  j is the reply being written.
+ * @param[in]  v is the number.
+ * @retval None
+ * @headerfile json.h
+ */
+void jsonUint(JsonWriter *j, uint32_t v)
+{
+    char digits[10];
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + v % 10U);
+        v /= 10U;
+    } while (v > 0);
+    while (n > 0)
+        jsonChar(j, digits[--n]);
+}
+
+/**
+ * @brief  Writes v rounded to the given number of decimals. A temperature that hasn't been read yet is NaN, which JSON has no word for but null.
+ * @param[in]  j is the reply being written.
+ * @param[in]  v is the number.
+ * @param[in]  decimals is how many digits follow the point, 0 for none.
+ * @retval None
+ * @headerfile json.h
+ */
+void jsonFixed(JsonWriter *j, float v, uint8_t decimals)
+{
+    if (!isfinite(v))
+    {
+        jsonRaw(j, "null");
+        return;
+    }
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++)
+        scale *= 10U;
+    if (v < 0.0f)
+    {
+        // Only once it's known not to round to zero, so there's no "-0.0"
+        if ((uint32_t)(-v * (float)scale + 0.5f) > 0)
+            jsonChar(j, '-');
+        v = -v;
+    }
+    uint32_t scaled = (uint32_t)(v * (float)scale + 0.5f);
+    jsonUint(j, scaled / scale);
+    if (decimals == 0)
+        return;
+    jsonChar(j, '.');
+    for (uint32_t d = scale / 10U; d > 0; d /= 10U)
+        jsonChar(j, (char)('0' + (scaled / d) % 10U));
+}
+
+/**
+ * @brief  Writes s as a JSON string, quoted, with quotes and backslashes escaped and control characters left out.
+ * @param[in]  j is the reply being written.
+ * @param[in]  s is the text.
+ * @retval None
+ * @headerfile json.h
+ */
+void jsonString(JsonWriter *j, const char *s)
+{
+    jsonChar(j, '"');
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            jsonChar(j, '\\');
+        if ((uint8_t)*s >= 0x20U)
+            jsonChar(j, *s);
+    }
+    jsonChar(j, '"');
+}
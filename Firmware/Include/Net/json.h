@@ -0,0 +1,39 @@
+/**
+ * @file json.h
+ * @brief Writing JSON into a fixed buffer, for the replies and messages the network services send.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_JSON_H
+#define __FORGE_JSON_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief A reply being written. Everything past end is cut off, so a caller that needs the whole of it checks p < end afterwards.
+     */
+    typedef struct
+    {
+        char *p;
+        char *end;
+    } JsonWriter;
+
+    void jsonRaw(JsonWriter *j, const char *s);
+    void jsonChar(JsonWriter *j, char c);
+    void jsonUint(JsonWriter *j, uint32_t v);
+    void jsonFixed(JsonWriter *j, float v, uint8_t decimals);
+    void jsonString(JsonWriter *j, const char *s);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_JSON_H */
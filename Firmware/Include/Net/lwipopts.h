@@ -0,0 +1,99 @@
+/**
+ * @file lwipopts.h
+ * @brief Configuration of LwIP for the Forge. LwIP includes this as "lwipopts.h", so this directory has to be on the include path, along with LwIP/src/include and LwIP/system for arch/cc.h.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_LWIPOPTS_H
+#define __FORGE_LWIPOPTS_H
+
+// Only the network task calls into LwIP (net.c), using the raw API, so
+// there is no tcpip thread and nothing to lock
+#define NO_SYS 1
+#define SYS_LIGHTWEIGHT_PROT 0
+#define LWIP_NETCONN 0
+#define LWIP_SOCKET 0
+
+#define MEM_ALIGNMENT 4
+// Outgoing frames and the TCP send buffers come from the fixed-size pools in
+// lwippools.h rather than a heap, so a long run can't fragment it and an
+// allocation takes the same time every time; received frames stay in the
+// interface's own buffers (ecmif.c)
+#define MEM_USE_POOLS 1
+#define MEMP_USE_CUSTOM_POOLS 1
+#define MEM_USE_POOLS_TRY_BIGGER_POOL 1
+#define MEMP_NUM_PBUF 16
+#define PBUF_POOL_SIZE 4
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
+#define LWIP_ARP 1
+#define LWIP_ETHERNET 1
+#define LWIP_IPV4 1
+#define LWIP_IPV6 0
+#define LWIP_DHCP 0
+// Hosts fall back to link local addresses on a link without a DHCP server,
+// and so does the printer; the host finds it as forge.local
+#define LWIP_AUTOIP 1
+#define LWIP_IGMP 1
+#define LWIP_MDNS_RESPONDER 1
+#define LWIP_NUM_NETIF_CLIENT_DATA 1
+#define MDNS_MAX_SERVICES 2
+#define MEMP_NUM_SYS_TIMEOUT (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 7)
+#define LWIP_NETIF_HOSTNAME 1
+
+// Two bytes ahead of the 14 byte Ethernet header word align the IP header
+#define ETH_PAD_SIZE 2
+
+#define LWIP_UDP 1
+#define LWIP_TCP 1
+#define TCP_MSS 1460
+#define TCP_WND (4 * TCP_MSS)
+#define TCP_SND_BUF (4 * TCP_MSS)
+#define TCP_SND_QUEUELEN (2 * TCP_SND_BUF / TCP_MSS)
+#define MEMP_NUM_TCP_SEG TCP_SND_QUEUELEN
+// The dashboard's connections, fleet telemetry's and the console's
+#define MEMP_NUM_TCP_PCB (MEMP_NUM_PARALLEL_HTTPD_CONNS + 2)
+// Segments held for later would keep receive buffers from the endpoint,
+// which has only ECMIF_RX_BUFFERS of them; the host resends instead
+#define TCP_QUEUE_OOSEQ 0
+// Every TCP segment is built in one pbuf, which the interface can send
+// without gathering it first
+#define LWIP_NETIF_TX_SINGLE_PBUF 1
+
+// The dashboard (web.c). Pages come from fsdata_forge.c with their headers
+// made by makefsdata; the JSON replies are made when asked for and httpd
+// adds their headers.
+#define LWIP_HTTPD_CGI 1
+#define LWIP_HTTPD_SUPPORT_POST 1
+#define LWIP_HTTPD_CUSTOM_FILES 1
+#define LWIP_HTTPD_DYNAMIC_HEADERS 1
+#define LWIP_HTTPD_MAX_CGI_PARAMETERS 4
+#define HTTPD_SERVER_AGENT "Forge"
+#define HTTPD_FSDATA_FILE "fsdata_forge.c"
+// The pages are sent from flash as they are; the JSON replies are built in
+// buffers that are used again as soon as httpd closes the file, so those are
+// copied
+#define HTTP_IS_DATA_VOLATILE(hs) (((uintptr_t)(hs)->file >= 0x20000000U) ? TCP_WRITE_FLAG_COPY : 0)
+// An upload's window is opened as push.c takes the data, not as it arrives
+#define LWIP_HTTPD_POST_MANUAL_WND 1
+// Connection state from a pool of its own too
+#define HTTPD_USE_MEM_POOL 1
+#define MEMP_NUM_PARALLEL_HTTPD_CONNS 4
+
+// Files pushed with TFTP (push.c), named as long as they can be over HTTP
+#define TFTP_MAX_FILENAME_LEN 48
+
+// Fleet telemetry (fleet.c). A whole message has to fit in the client's
+// output buffer at once, and this holds about three.
+#define MQTT_OUTPUT_RINGBUF_SIZE 1536
+#define MQTT_VAR_HEADER_BUFFER_LEN 128
+#define MQTT_REQ_MAX_IN_FLIGHT 4
+
+#define LWIP_STATS 0
+#define LWIP_NETIF_LINK_CALLBACK 0
+#define LWIP_NETIF_STATUS_CALLBACK 0
+
+#endif /* __FORGE_LWIPOPTS_H */
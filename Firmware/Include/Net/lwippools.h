@@ -0,0 +1,34 @@
+/**
+ * @file lwippools.h
+ * @brief The fixed-size pools LwIP's mem_malloc takes from instead of a heap (MEM_USE_POOLS). LwIP includes this as "lwippools.h" from memp_std.h, once for each pool list.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+// No include guard: memp_std.h includes this several times over, with
+// LWIP_MALLOC_MEMPOOL defined differently each time.
+
+// Sizes are of the largest request each pool serves; LwIP adds the few bytes
+// it keeps in front of each block. A request too big for its pool's free blocks goes to the next pool up
+// (MEM_USE_POOLS_TRY_BIGGER_POOL), so the small pools can run dry without
+// anything failing while a big block is free.
+LWIP_MALLOC_MEMPOOL_START
+// TCP acknowledgements and control segments, ARP, and the AutoIP and mDNS
+// host state, which are allocated once
+LWIP_MALLOC_MEMPOOL(16, 128)
+// mDNS replies, built in a 500 byte packet, the mDNS service record, and
+// TFTP's acknowledgements and errors
+LWIP_MALLOC_MEMPOOL(6, 640)
+// Full-size TCP segments: with LWIP_NETIF_TX_SINGLE_PBUF each is copied
+// into one block of the pbuf, the headers and an MSS, 1532 bytes. Enough for the send queue of two
+// connections, e.g. the dashboard and fleet telemetry. The pbuf is 8 bytes
+// bigger on a 64 bit host, for the tools in Net/host. A plain number either
+// way: LwIP pastes it into the pool's name.
+#if UINTPTR_MAX > 0xFFFFFFFFUL
+LWIP_MALLOC_MEMPOOL(8, 1544)
+#else
+LWIP_MALLOC_MEMPOOL(8, 1536)
+#endif
+LWIP_MALLOC_MEMPOOL_END
@@ -0,0 +1,115 @@
+/**
+ * @file net.c
+ * @brief The network stack: LwIP on the USB network interface, run by a task of its own.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "net.h"
+#include "web.h"
+#include "fleet.h"
+#include "push.h"
+#include "console.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Usb/usb.h"
+#include "../LwIP/src/include/lwip/init.h"
+#include "../LwIP/src/include/lwip/timeouts.h"
+#include "../LwIP/src/include/lwip/memp.h"
+#include "../LwIP/src/include/lwip/autoip.h"
+#include "../LwIP/src/include/lwip/apps/mdns.h"
+#include "../LwIP/src/include/netif/ethernet.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdlib.h>
+
+Network NET;
+
+static StackType_t _netStack[FORGE_STACK_NET];
+static StaticTask_t _netTcb;
+
+/**
+ * @brief  Adds LwIP's pools to the memory map, as one entry since they aren't in one piece: the protocol control blocks, pbufs and the mem_malloc pools of lwippools.h.
+ */
+static void _mapPools(void)
+{
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < MEMP_MAX; i++)
+        total += memp_pools[i]->num * (MEMP_SIZE + MEMP_ALIGN_SIZE(memp_pools[i]->size));
+    forgeMemoryAdd("lwip pools", NULL, total);
+}
+
+// LwIP's clock when it runs without an OS layer
+u32_t sys_now(void)
+{
+    return (u32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static void _netTask(void *arg)
+{
+    (void)arg;
+    Network *net = &NET;
+    struct netif *netif = &net->ecm.netif;
+
+    lwip_init();
+    _mapPools();
+    netif_add(netif, IP4_ADDR_ANY4, IP4_ADDR_ANY4, IP4_ADDR_ANY4, &net->ecm, ecmifInit, ethernet_input);
+    netif_set_hostname(netif, NET_HOSTNAME);
+    netif_set_default(netif);
+    netif_set_up(netif);
+    // Probing waits for the link; the address is picked again whenever it
+    // comes back up
+    autoip_start(netif);
+    mdns_resp_init();
+    mdns_resp_add_netif(netif, NET_HOSTNAME, NET_MDNS_TTL);
+    webInit(netif);
+    consoleInit();
+    pushInit();
+    fleetInit(netif, net->hostMac);
+
+    for (;;)
+    {
+        u32_t sleep = sys_timeouts_sleeptime();
+        if (sleep > NET_MAX_SLEEP_MS)
+            sleep = NET_MAX_SLEEP_MS;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleep));
+        net->wakeups++;
+        ecmifService(&net->ecm);
+        webService();
+        consoleService();
+        sys_check_timeouts();
+    }
+}
+
+/**
+ * @brief  Wakes the network task, e.g. because a frame arrived. Call from a task.
+ * @retval None
+ * @headerfile net.h
+ */
+void netWake(void)
+{
+    if (NET.task != NULL)
+        xTaskNotifyGive(NET.task);
+}
+
+/**
+ * @brief  Sets up the interface and creates the network task. Both ends of the link get locally administered addresses made from the chip's unique ID, so they stay the same across reboots. Call once before usbBegin, then register the interface with usbecmInit.
+ * @retval None
+ * @headerfile net.h
+ */
+void netInit(void)
+{
+    Network *net = &NET;
+    uint32_t id = HAL_GetUIDw0() ^ (HAL_GetUIDw1() * 31U) ^ (HAL_GetUIDw2() * 961U);
+    uint8_t mac[6] = {0x02, 0x46, (uint8_t)(id >> 24), (uint8_t)(id >> 16), (uint8_t)(id >> 8), (uint8_t)id};
+    for (uint8_t i = 0; i < 6; i++)
+        net->hostMac[i] = mac[i];
+    net->hostMac[0] = 0x06;
+    // AutoIP picks its address with LWIP_RAND
+    srand(id);
+
+    ecmifSetup(&net->ecm, mac, usbWake, netWake);
+    forgeMemoryAdd("net", net, sizeof(*net));
+    net->task = forgeCreateTask(_netTask, "net", FORGE_STACK_NET, FORGE_PRIO_NET, _netStack, &_netTcb);
+}
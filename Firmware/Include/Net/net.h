@@ -0,0 +1,49 @@
+/**
+ * @file net.h
+ * @brief The network stack: LwIP on the USB network interface, run by a task of its own.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_NET_H
+#define __FORGE_NET_H
+
+#include "ecmif.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NET_HOSTNAME "forge"
+#define NET_MDNS_TTL 120 // Seconds
+// LwIP's timers are checked at least this often even without traffic
+#define NET_MAX_SLEEP_MS 250
+
+    /**
+     * @brief The single network stack. Everything that calls into LwIP runs in its task.
+     */
+    typedef struct
+    {
+        EcmInterface ecm;
+        TaskHandle_t task;
+        uint8_t hostMac[6]; // The host's end of the link, given to it by the ECM descriptor
+        uint32_t wakeups;
+    } Network;
+
+    extern Network NET;
+
+    void netInit(void);
+    void netWake(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_NET_H */
@@ -0,0 +1,378 @@
+/**
+ * @file push.c
+ * @brief Files pushed over the network, to the SD card or as a firmware image: the network task fills chunks while a task of its own writes them out.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Files come in over HTTP (web.c, POST /upload and /firmware) or TFTP (a
+ * put to port 69, handled here). Either way the network task only copies
+ * the data into the chunk being filled and goes back to the network; a
+ * full chunk is handed to the push task, which writes it while the next
+ * ones fill. A card that takes a while over a write, or flash programming
+ * that waits for gaps in the stepping, holds up the sender only once every
+ * chunk is taken: HTTP by keeping TCP's window shut (web.c), TFTP, which
+ * can't be held back, by its ACK coming late, which it waits for.
+ *
+ * A file named PUSH_FIRMWARE_NAME is a firmware image, staged in flash by
+ * Core/ota.c for /ota.cgi?install. Anything else is written to the card
+ * under its own name, as long as nothing else has the card.
+ */
+
+#include "push.h"
+#include "net.h"
+#include "../Core/ota.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Storage/sdcard.h"
+#include "../Storage/sdprint.h"
+#include "../Storage/sd_diskio.h"
+#include "../LwIP/src/include/lwip/apps/tftp_server.h"
+#include <string.h>
+#include <strings.h>
+
+Push PUSH;
+
+static StackType_t _pushStack[FORGE_STACK_PUSH];
+static StaticTask_t _pushTcb;
+
+/**
+ * @brief  Writes the chunks the network task hands over, and erases the firmware slot whenever that's due and motion allows. The lowest priority task, so flash programming can spin waiting for a step gap.
+ */
+static void _pushTask(void *arg)
+{
+    (void)arg;
+    Push *push = &PUSH;
+    uint32_t position = 0; // Bytes of the current push written so far
+    for (;;)
+    {
+        TickType_t wait = (OTA.state == OTA_ERASING) ? pdMS_TO_TICKS(PUSH_ERASE_POLL_MS) : portMAX_DELAY;
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        while (push->written != push->filled)
+        {
+            PushChunk *chunk = &push->chunks[push->written & (PUSH_CHUNKS - 1U)];
+            if (push->written == 0)
+                position = 0;
+            if (!push->failed)
+            {
+                uint32_t start = HAL_GetTick();
+                bool ok;
+                if (push->target == PUSH_FIRMWARE)
+                {
+                    ok = otaProgram(position, chunk->data, chunk->length);
+                }
+                else
+                {
+                    UINT written;
+                    ok = f_write(&push->file, chunk->data, chunk->length, &written) == FR_OK &&
+                         written == chunk->length;
+                }
+                if (!ok)
+                    push->failed = true;
+                uint32_t ms = HAL_GetTick() - start;
+                if (ms > push->stats.writeMaxMs)
+                    push->stats.writeMaxMs = ms;
+            }
+            position += chunk->length;
+            __DMB(); // Done with the chunk before it's handed back
+            push->written++;
+            netWake();
+        }
+        otaService();
+    }
+}
+
+/**
+ * @brief  Hands the chunk being filled to the push task.
+ */
+static void _handOff(Push *push)
+{
+    push->chunks[push->filled & (PUSH_CHUNKS - 1U)].length = push->offset;
+    push->flushed += push->offset;
+    push->offset = 0;
+    __DMB(); // The chunk must be complete before the push task can see it
+    push->filled++;
+    xTaskNotifyGive(push->task);
+}
+
+static void _path(char *path, const char *name)
+{
+    strcpy(path, SDPath);
+    strcat(path, name);
+}
+
+static void _drain(Push *push)
+{
+    if (push->offset > 0)
+        _handOff(push);
+    while (push->written != push->filled)
+        vTaskDelay(1);
+}
+
+/**
+ * @brief  Tells whether a name is fit for the card: letters, digits, '.', '-' and '_', not starting with '.', so it can't climb out of the root directory.
+ * @param[in]  name is the name as sent.
+ * @retval true if it can be used.
+ * @headerfile push.h
+ */
+bool pushValidName(const char *name)
+{
+    size_t length = strlen(name);
+    if (length == 0 || length > PUSH_MAX_NAME || name[0] == '.')
+        return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '.' || c == '-' || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief  Starts a push: PUSH_FIRMWARE_NAME into the firmware slot, anything else to a new file on the card, replacing one of the same name. Call from the network task.
+ * @param[in]  name is the file's name, without a path.
+ * @retval PUSH_OK if data can follow; otherwise why not, which is also kept as PUSH.result.
+ * @headerfile push.h
+ */
+PushResult pushBegin(const char *name)
+{
+    Push *push = &PUSH;
+    PushResult result = PUSH_OK;
+    if (push->target != PUSH_NONE)
+    {
+        result = PUSH_BUSY;
+    }
+    else if (strcmp(name, PUSH_FIRMWARE_NAME) == 0)
+    {
+        if (otaBegin())
+            push->target = PUSH_FIRMWARE;
+        else
+            result = PUSH_BUSY;
+        // A slot holding an image is erased again, which is the push task's job
+        xTaskNotifyGive(push->task);
+    }
+    else if (!pushValidName(name))
+    {
+        result = PUSH_BAD_NAME;
+    }
+    else
+    {
+        // Not while a print or the USB drive has the card: FatFs isn't built
+        // reentrant, and the host would see the file change under it
+        char path[SDPRINT_MAX_PATH];
+        _path(path, name);
+        if (!SDclaim(SD_OWNER_PUSH))
+            result = PUSH_BUSY;
+        else if (f_open(&push->file, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        {
+            SDrelease(SD_OWNER_PUSH);
+            result = PUSH_FAILED_OPEN;
+        }
+        else
+            push->target = PUSH_FILE;
+    }
+
+    if (result != PUSH_OK)
+    {
+        push->result = result;
+        push->stats.failures++;
+        return result;
+    }
+    strcpy(push->name, name);
+    push->filled = push->written = 0;
+    push->offset = 0;
+    push->received = push->flushed = 0;
+    push->failed = false;
+    push->result = PUSH_RESULT_NONE;
+    return PUSH_OK;
+}
+
+/**
+ * @brief  Copies as much data as there's room for into the chunks, without waiting. Call from the network task.
+ * @param[in]  data is the data.
+ * @param[in]  length is its size in bytes.
+ * @retval How many bytes were taken; the rest has to be offered again once the push task has caught up (it wakes the network task when it has).
+ * @headerfile push.h
+ */
+uint32_t pushOffer(const uint8_t *data, uint32_t length)
+{
+    Push *push = &PUSH;
+    uint32_t taken = 0;
+    while (taken < length)
+    {
+        if (push->filled - push->written >= PUSH_CHUNKS)
+            break;
+        PushChunk *chunk = &push->chunks[push->filled & (PUSH_CHUNKS - 1U)];
+        uint32_t n = PUSH_CHUNK_SIZE - push->offset;
+        if (n > length - taken)
+            n = length - taken;
+        memcpy(&chunk->data[push->offset], data + taken, n);
+        push->offset += n;
+        taken += n;
+        if (push->offset == PUSH_CHUNK_SIZE)
+            _handOff(push);
+    }
+    push->received += taken;
+    if (taken < length)
+        push->stats.stalls++;
+    return taken;
+}
+
+/**
+ * @brief  Copies all of the data into the chunks, waiting up to PUSH_STALL_MS for room. For a sender that can't be held back any other way. Call from the network task.
+ * @param[in]  data is the data.
+ * @param[in]  length is its size in bytes.
+ * @retval false if the push task didn't make room in time.
+ * @headerfile push.h
+ */
+bool pushPut(const uint8_t *data, uint32_t length)
+{
+    uint32_t waited = 0;
+    for (;;)
+    {
+        uint32_t taken = pushOffer(data, length);
+        data += taken;
+        length -= taken;
+        if (length == 0)
+            return true;
+        if (waited++ >= PUSH_STALL_MS)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+/**
+ * @brief  Ends the push once the push task has written everything. A file is kept and an image staged only if all of it arrived and was written. Call from the network task.
+ * @param[in]  complete is true if the sender got to the end.
+ * @retval How it went, which is also kept as PUSH.result.
+ * @headerfile push.h
+ */
+PushResult pushEnd(bool complete)
+{
+    Push *push = &PUSH;
+    if (push->target == PUSH_NONE)
+        return push->result;
+    _drain(push);
+
+    PushResult result;
+    if (push->target == PUSH_FIRMWARE)
+    {
+        if (push->failed)
+            result = PUSH_FAILED_WRITE;
+        else if (!complete)
+            result = PUSH_TRUNCATED;
+        else
+            result = PUSH_OK;
+        // Has the slot erased again for anything but a good image
+        if (!otaFinish(result == PUSH_OK) && result == PUSH_OK)
+            result = PUSH_BAD_IMAGE;
+        if (result == PUSH_OK)
+            push->stats.images++;
+        else
+            xTaskNotifyGive(push->task);
+    }
+    else
+    {
+        FRESULT closed = f_close(&push->file);
+        if (push->failed || closed != FR_OK)
+            result = PUSH_FAILED_WRITE;
+        else if (!complete)
+            result = PUSH_TRUNCATED;
+        else
+            result = PUSH_OK;
+        // Half a G-code file prints half a part
+        if (result != PUSH_OK)
+        {
+            char path[SDPRINT_MAX_PATH];
+            _path(path, push->name);
+            f_unlink(path);
+        }
+        else
+            push->stats.files++;
+        SDrelease(SD_OWNER_PUSH);
+    }
+
+    if (result == PUSH_OK)
+        push->stats.bytes += push->flushed;
+    else
+        push->stats.failures++;
+    push->result = result;
+    push->target = PUSH_NONE;
+    return result;
+}
+
+/**
+ * @brief  Tells whether a push is under way.
+ * @retval true between pushBegin and pushEnd.
+ * @headerfile push.h
+ */
+bool pushActive(void)
+{
+    return PUSH.target != PUSH_NONE;
+}
+
+/*
+ * TFTP: one transfer at a time, which is all LwIP's server does. Only puts;
+ * a file is complete when its last block is short.
+ */
+
+static bool _tftpLast;
+
+static void *_tftpOpen(const char *name, const char *mode, u8_t write)
+{
+    // netascii would rewrite line endings, and there's nothing to read
+    if (!write || strcasecmp(mode, "octet") != 0)
+        return NULL;
+    _tftpLast = false;
+    return (pushBegin(name) == PUSH_OK) ? &PUSH : NULL;
+}
+
+static void _tftpClose(void *handle)
+{
+    (void)handle;
+    pushEnd(_tftpLast);
+}
+
+static int _tftpRead(void *handle, void *buffer, int bytes)
+{
+    (void)handle;
+    (void)buffer;
+    (void)bytes;
+    return -1;
+}
+
+static int _tftpWrite(void *handle, struct pbuf *p)
+{
+    (void)handle;
+    for (struct pbuf *q = p; q != NULL; q = q->next)
+    {
+        if (!pushPut((const uint8_t *)q->payload, q->len))
+            return -1;
+    }
+    // The server sends the ACK after this returns, so the next block comes
+    // while the push task writes
+    if (p->tot_len < 512U)
+        _tftpLast = true;
+    return 0;
+}
+
+static const struct tftp_context _tftp = {_tftpOpen, _tftpClose, _tftpRead, _tftpWrite};
+
+/**
+ * @brief  Looks at the firmware slot, starts the push task and the TFTP server. Call from the network task once the interface is up.
+ * @retval None
+ * @headerfile push.h
+ */
+void pushInit(void)
+{
+    Push *push = &PUSH;
+    memset(push, 0, sizeof(*push));
+    forgeMemoryAdd("push", push, sizeof(*push));
+    otaInit();
+    push->task = forgeCreateTask(_pushTask, "push", FORGE_STACK_PUSH, FORGE_PRIO_PUSH, _pushStack, &_pushTcb);
+    tftp_init(&_tftp);
+}
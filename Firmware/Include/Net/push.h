@@ -0,0 +1,110 @@
+/**
+ * @file push.h
+ * @brief Files pushed over the network, to the SD card or as a firmware image: the network task fills chunks while a task of its own writes them out.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_PUSH_H
+#define __FORGE_PUSH_H
+
+#include "../FatFs/src/ff.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Chunks the network can be filling or have waiting while one is written.
+// A power of two, so the indices can run freely. Each is whole sectors, so
+// FatFs writes it straight to the card without its own buffer.
+#define PUSH_CHUNKS 4U
+#define PUSH_CHUNK_SIZE 4096U
+// A sender that can't be held back (TFTP) waits this long for a chunk
+// before the transfer is given up
+#define PUSH_STALL_MS 2000U
+// Name that makes a push a firmware image rather than a file on the card
+#define PUSH_FIRMWARE_NAME "forge.bin"
+// While the slot still needs erasing, the task looks for an idle moment this often
+#define PUSH_ERASE_POLL_MS 100U
+#define PUSH_MAX_NAME 48 // Characters of a pushed file's name
+
+    typedef enum
+    {
+        PUSH_NONE = 0,
+        PUSH_FILE,     // To the SD card
+        PUSH_FIRMWARE  // Into the flash slot (Core/ota.c)
+    } PushTarget;
+
+    typedef enum
+    {
+        PUSH_RESULT_NONE = 0,
+        PUSH_OK,
+        PUSH_BUSY,          // Another push, a print or the USB drive has the card, or the slot isn't erased yet
+        PUSH_BAD_NAME,      // Only letters, digits, '.', '-' and '_', not starting with '.'
+        PUSH_FAILED_OPEN,
+        PUSH_FAILED_WRITE,  // The card is full or failed, or flash didn't program; a partial file was removed
+        PUSH_TRUNCATED,     // The transfer ended early; a partial file was removed
+        PUSH_BAD_IMAGE      // Not firmware for this board
+    } PushResult;
+
+    typedef struct
+    {
+        uint32_t files;
+        uint32_t images;
+        uint32_t bytes;
+        uint32_t failures;
+        uint32_t stalls;     // Times the network found every chunk taken
+        uint32_t writeMaxMs; // Longest a chunk took to write
+    } PushStats;
+
+    typedef struct
+    {
+        uint8_t data[PUSH_CHUNK_SIZE] __ALIGNED(4); // DMA source for the card, so not in CCM RAM
+        uint32_t length;
+    } PushChunk;
+
+    /**
+     * @brief The single push. The network task opens, fills and ends it; the push task writes the chunks in between.
+     */
+    typedef struct
+    {
+        PushChunk chunks[PUSH_CHUNKS];
+        volatile uint32_t filled;  // Chunks handed to the push task, written by the network task
+        volatile uint32_t written; // Chunks done with, written by the push task
+        uint32_t offset;           // Bytes in the chunk being filled
+
+        PushTarget target;
+        FIL file;
+        char name[PUSH_MAX_NAME + 1];
+        uint32_t received;         // Bytes taken from the sender
+        uint32_t flushed;          // Bytes handed to the push task
+        volatile bool failed;      // Set by the push task
+        PushResult result;         // Of the last push
+
+        TaskHandle_t task;
+        PushStats stats;
+    } Push;
+
+    extern Push PUSH;
+
+    void pushInit(void);
+    PushResult pushBegin(const char *name);
+    uint32_t pushOffer(const uint8_t *data, uint32_t length);
+    bool pushPut(const uint8_t *data, uint32_t length);
+    PushResult pushEnd(bool complete);
+    bool pushActive(void);
+    bool pushValidName(const char *name);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_PUSH_H */
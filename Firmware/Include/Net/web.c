@@ -0,0 +1,517 @@
+/**
+ * @file web.c
+ * @brief The printer's web dashboard: LwIP's httpd with the pages in fsdata_forge.c, a status JSON, and G-code and firmware uploads through push.c.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * GET  /                       the dashboard, from www/ by way of fsdata_forge.c
+ * GET  /status.json            temperatures, position, the print job and the
+ *                              step interrupt's cycle counts
+ * GET  /print.cgi?start=<name> prints a file from the card; also ?pause,
+ *                              ?resume and ?abort. Replies with the status.
+ * POST /upload?name=<name>     writes the body to the card as it comes in,
+ *                              then replies with /upload.json
+ * POST /firmware               stages the body as a firmware image (see
+ *                              Core/ota.c), then replies with /upload.json
+ * GET  /ota.cgi?install        installs the staged image and restarts, if
+ *                              nothing is printing or being pushed
+ * GET  /fleet.cgi?broker=<ip>  sets the MQTT broker for fleet telemetry
+ *                              (fleet.c), &port=<port> optional; an empty
+ *                              address means the USB host
+ *
+ * fsdata_forge.c is made from www/ by LwIP's makefsdata, deflating each page
+ * (see LwIP/src/apps/http/miniz.c). After changing a page, from
+ * Firmware/Include:
+ *
+ *   gcc -DMAKEFS_SUPPORT_DEFLATE=1 -ILwIP/src/include -INet -ILwIP/system \
+ *       -o makefsdata LwIP/src/apps/http/makefsdata/makefsdata.c -lz
+ *   cd Net && ../makefsdata www -defl -f:fsdata_forge.c
+ *
+ * An upload's body is handed to push.c as it arrives, and TCP's window is
+ * only opened again for what push.c took. When its chunks are all waiting
+ * to be written, the rest stays in WEB.pending, the window stays shut and
+ * the sender waits, until the push task wakes this task to try again.
+ */
+
+#include "web.h"
+#include "net.h"
+#include "json.h"
+#include "fleet.h"
+#include "../Core/memory.h"
+#include "../Core/ota.h"
+#include "../Core/profiler.h"
+#include "../Motion/motion.h"
+#include "../Storage/sd_diskio.h"
+#include "../LwIP/src/include/lwip/apps/httpd.h"
+#include "../LwIP/src/include/lwip/apps/fs.h"
+#include "../LwIP/src/include/lwip/apps/mdns.h"
+#include "../LwIP/src/include/lwip/sys.h"
+#include "../LwIP/src/include/lwip/timeouts.h"
+#include <stdlib.h>
+#include <string.h>
+
+WebServer WEB;
+
+#define UPLOAD_PREFIX "/upload?name="
+#define UPLOAD_PREFIX_LENGTH (sizeof(UPLOAD_PREFIX) - 1)
+#define FIRMWARE_URI "/firmware"
+#define WATCHDOG_MS 1000U
+
+static const char _busy[] = "{\"busy\":true}";
+static const char *const _states[] = {"idle", "printing", "paused", "done", "failed"};
+static const char *const _errors[] = {"", "busy", "open failed", "read failed", "seek failed", "file changed", "aborted"};
+static const char *const _results[] = {"", "ok", "busy", "bad name", "open failed", "write failed", "truncated", "bad image"};
+static const char *const _otaStates[] = {"unavailable", "erasing", "ready", "receiving", "staged"};
+static const char _axes[FORGE_AXES] = {'x', 'y', 'z', 'e'};
+
+static void _heater(JsonWriter *j, const char *name, const PIDControlConfig *heater)
+{
+    jsonRaw(j, ",\"");
+    jsonRaw(j, name);
+    jsonRaw(j, "\":");
+    if (heater == NULL)
+    {
+        jsonRaw(j, "null");
+        return;
+    }
+    jsonRaw(j, "{\"temp\":");
+    jsonFixed(j, heater->lastTemp, 1);
+    jsonRaw(j, ",\"target\":");
+    jsonFixed(j, heater->target_temp, 1);
+    jsonRaw(j, ",\"power\":");
+    jsonFixed(j, heater->lastOutput, 2);
+    jsonChar(j, '}');
+}
+
+static void _status(JsonWriter *j)
+{
+    const WebServer *web = &WEB;
+    const SDPrintJob *job = &SD_PRINT;
+    const GcodeMachine *machine = job->machine;
+    SDPrintState state = job->state;
+
+    uint32_t ms = 0;
+    if (state == SDPRINT_RUNNING || state == SDPRINT_PAUSED)
+        ms = HAL_GetTick() - job->startTick;
+    else if (state == SDPRINT_DONE || state == SDPRINT_FAILED)
+        ms = job->endTick - job->startTick;
+
+    jsonRaw(j, "{\"state\":");
+    jsonString(j, _states[state]);
+    jsonRaw(j, ",\"file\":");
+    jsonString(j, job->path);
+    jsonRaw(j, ",\"progress\":");
+    jsonFixed(j, (float32_t)sdprintProgress() / 10.0f, 1);
+    jsonRaw(j, ",\"elapsed\":");
+    jsonUint(j, ms / 1000U);
+    jsonRaw(j, ",\"error\":");
+    jsonString(j, _errors[job->lastError]);
+    jsonRaw(j, ",\"start\":");
+    jsonString(j, _errors[web->started]);
+
+    _heater(j, "hotend", (machine != NULL) ? machine->hotend : NULL);
+    _heater(j, "bed", (machine != NULL) ? machine->bed : NULL);
+
+    // Where the segment being stepped started, which is never more than one
+    // segment behind
+    MotionTag tag;
+    int32_t steps[FORGE_AXES];
+    bool moving = motionSnapshot(&tag, steps);
+    jsonRaw(j, ",\"moving\":");
+    jsonRaw(j, moving ? "true" : "false");
+    jsonRaw(j, ",\"position\":{");
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        if (a > 0)
+            jsonChar(j, ',');
+        jsonChar(j, '"');
+        jsonChar(j, _axes[a]);
+        jsonRaw(j, "\":");
+        if (machine != NULL)
+            jsonFixed(j, (float32_t)steps[a] / machine->planner->stepsPerMm[a], 2);
+        else
+            jsonRaw(j, "null");
+    }
+
+    MotionStats stats;
+    motionGetStats(&stats);
+    jsonRaw(j, "},\"segments\":");
+    jsonUint(j, stats.segments);
+    jsonRaw(j, ",\"underruns\":");
+    jsonUint(j, stats.underruns);
+
+    // The profiler's running totals for the step interrupt and the cycle
+    // counter they were read at; both wrap, so the load between two replies
+    // is the difference of one over the other's (Sim/host/motionbench.c)
+    const ProfileIsrStats *step = &PROFILE.isrs[PROFILE_ISR_STEP];
+    jsonRaw(j, ",\"stepIsr\":{\"count\":");
+    jsonUint(j, step->count);
+    jsonRaw(j, ",\"cycles\":");
+    jsonUint(j, step->cycles);
+    jsonRaw(j, ",\"at\":");
+    jsonUint(j, DWT->CYCCNT);
+    jsonChar(j, '}');
+
+    jsonRaw(j, ",\"fleet\":{\"id\":");
+    jsonString(j, FLEET.id);
+    jsonRaw(j, ",\"connected\":");
+    jsonRaw(j, fleetConnected() ? "true" : "false");
+    jsonChar(j, '}');
+
+    jsonRaw(j, ",\"ota\":{\"state\":");
+    jsonString(j, _otaStates[OTA.state]);
+    jsonRaw(j, ",\"staged\":");
+    jsonUint(j, (OTA.state == OTA_STAGED) ? OTA.imageLength : 0);
+    jsonChar(j, '}');
+
+    // Over HTTP or TFTP; only an HTTP upload says how big it is
+    jsonRaw(j, ",\"upload\":");
+    if (pushActive())
+    {
+        jsonRaw(j, "{\"file\":");
+        jsonString(j, PUSH.name);
+        jsonRaw(j, ",\"bytes\":");
+        jsonUint(j, PUSH.received);
+        jsonRaw(j, ",\"size\":");
+        if (web->uploader != NULL)
+            jsonUint(j, web->expected);
+        else
+            jsonRaw(j, "null");
+        jsonChar(j, '}');
+    }
+    else
+    {
+        jsonRaw(j, "null");
+    }
+    jsonChar(j, '}');
+}
+
+static void _uploaded(JsonWriter *j)
+{
+    const WebServer *web = &WEB;
+    jsonRaw(j, "{\"result\":");
+    jsonString(j, _results[web->result]);
+    // One that was turned away never had a file
+    PushResult r = web->result;
+    if (r == PUSH_OK || r == PUSH_FAILED_WRITE || r == PUSH_TRUNCATED || r == PUSH_BAD_IMAGE)
+    {
+        jsonRaw(j, ",\"file\":");
+        jsonString(j, web->name);
+        jsonRaw(j, ",\"bytes\":");
+        jsonUint(j, web->received);
+    }
+    jsonChar(j, '}');
+}
+
+/**
+ * @brief  The dynamic files. httpd calls this before looking in fsdata_forge.c, and adds the headers itself from the extension. The replies are made whole here, so they are as consistent as the printer's state is at one moment.
+ */
+int fs_open_custom(struct fs_file *file, const char *name)
+{
+    WebServer *web = &WEB;
+    bool status = strcmp(name, "/status.json") == 0;
+    if (!status && strcmp(name, "/upload.json") != 0)
+        return 0;
+
+    uint8_t i = 0;
+    while (i < WEB_STATUS_BUFFERS && web->statusUsed[i])
+        i++;
+    if (i == WEB_STATUS_BUFFERS)
+    {
+        web->stats.statusBusy++;
+        file->data = _busy;
+        file->len = (int)sizeof(_busy) - 1;
+        file->pextension = NULL;
+    }
+    else
+    {
+        JsonWriter j = {web->status[i], web->status[i] + WEB_STATUS_SIZE};
+        if (status)
+            _status(&j);
+        else
+            _uploaded(&j);
+        web->statusUsed[i] = true;
+        file->data = web->status[i];
+        file->len = (int)(j.p - web->status[i]);
+        file->pextension = &web->statusUsed[i];
+    }
+    file->index = file->len;
+    file->flags = 0;
+    web->stats.statusServed++;
+    return 1;
+}
+
+void fs_close_custom(struct fs_file *file)
+{
+    // The reply was copied into TCP's buffers as it went out, see
+    // HTTP_IS_DATA_VOLATILE in lwipopts.h
+    if (file->pextension != NULL)
+        *(bool *)file->pextension = false;
+}
+
+static void _path(char *path, const char *name)
+{
+    strcpy(path, SDPath);
+    strcat(path, name);
+}
+
+static void _respond(char *uri, u16_t length)
+{
+    strncpy(uri, "/upload.json", length);
+    uri[length - 1] = '\0';
+}
+
+/**
+ * @brief  Ends the upload, keeping the file or staging the image only if all of it arrived and was written.
+ */
+static void _finish(WebServer *web)
+{
+    if (web->pending != NULL)
+    {
+        pbuf_free(web->pending);
+        web->pending = NULL;
+    }
+    web->result = pushEnd(web->received == web->expected);
+    if (web->result == PUSH_OK)
+    {
+        web->stats.uploads++;
+        web->stats.uploadBytes += web->received;
+    }
+    else
+    {
+        web->stats.uploadFailures++;
+    }
+    web->uploader = NULL;
+}
+
+/**
+ * @brief  Turns an upload away. Its reply is made straight after, so it reports this result without disturbing an upload that is under way.
+ */
+static err_t _refuse(WebServer *web, PushResult result)
+{
+    web->result = result;
+    web->stats.uploadFailures++;
+    return ERR_VAL;
+}
+
+/**
+ * @brief  Hands push.c as much of the pending body as it takes, and opens TCP's window by as much. Opening it for the last of the body has httpd finish the upload, from inside httpd_post_data_recved, so nothing of the upload is touched after that.
+ */
+static void _feed(WebServer *web)
+{
+    while (web->pending != NULL)
+    {
+        struct pbuf *p = web->pending;
+        u16_t taken = (u16_t)pushOffer((const uint8_t *)p->payload, p->len);
+        if (taken == 0)
+            break;
+        web->received += taken;
+        web->lastData = sys_now();
+        web->pending = pbuf_free_header(p, taken);
+        httpd_post_data_recved(web->uploader, taken);
+    }
+}
+
+err_t httpd_post_begin(void *connection, const char *uri, const char *http_request, u16_t http_request_len,
+                       int content_len, char *response_uri, u16_t response_uri_len, u8_t *post_auto_wnd)
+{
+    (void)http_request;
+    (void)http_request_len;
+    WebServer *web = &WEB;
+    const char *name;
+    if (strcmp(uri, FIRMWARE_URI) == 0)
+        name = PUSH_FIRMWARE_NAME;
+    else if (strncmp(uri, UPLOAD_PREFIX, UPLOAD_PREFIX_LENGTH) == 0)
+        name = uri + UPLOAD_PREFIX_LENGTH;
+    else
+        return ERR_VAL; // Not found
+    _respond(response_uri, response_uri_len);
+
+    if (web->uploader != NULL)
+        return _refuse(web, PUSH_BUSY);
+    PushResult result = pushBegin(name);
+    if (result != PUSH_OK)
+        return _refuse(web, result);
+
+    *post_auto_wnd = 0;
+    strcpy(web->name, name);
+    web->uploader = connection;
+    web->pending = NULL;
+    web->expected = (uint32_t)content_len;
+    web->received = 0;
+    web->lastData = sys_now();
+    return ERR_OK;
+}
+
+/**
+ * @brief  Queues each piece of the body behind what's still pending, from where the USB endpoint put it, and hands push.c what it will take.
+ */
+err_t httpd_post_receive_data(void *connection, struct pbuf *p)
+{
+    WebServer *web = &WEB;
+    // Given up on by _watchdog already: its window is opened anyway, so
+    // httpd can get to the end and close it
+    if (connection != web->uploader)
+    {
+        httpd_post_data_recved(connection, p->tot_len);
+        pbuf_free(p);
+        return ERR_ARG;
+    }
+
+    if (web->pending == NULL)
+        web->pending = p;
+    else
+        pbuf_cat(web->pending, p);
+    web->lastData = sys_now();
+    _feed(web);
+    return ERR_OK;
+}
+
+/**
+ * @brief  Called once all of the body has been taken, or when the connection closes before that.
+ */
+void httpd_post_finished(void *connection, char *response_uri, u16_t response_uri_len)
+{
+    WebServer *web = &WEB;
+    _respond(response_uri, response_uri_len);
+    if (connection == web->uploader)
+        _finish(web);
+}
+
+/**
+ * @brief  Installs a staged firmware image from /ota.cgi, as long as nothing is printing or being pushed; doesn't reply if it does.
+ */
+static const char *_otaCgi(int index, int count, char *params[], char *values[])
+{
+    (void)index;
+    (void)values;
+    WebServer *web = &WEB;
+    web->stats.commands++;
+    SDPrintState state = SD_PRINT.state;
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(params[i], "install") == 0 && state != SDPRINT_RUNNING && state != SDPRINT_PAUSED &&
+            !pushActive())
+            otaInstall();
+    }
+    return "/status.json";
+}
+
+/**
+ * @brief  Runs the print job from /print.cgi. Whatever the command, the reply is the status it leads to.
+ */
+static const char *_printCgi(int index, int count, char *params[], char *values[])
+{
+    (void)index;
+    WebServer *web = &WEB;
+    web->stats.commands++;
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(params[i], "start") == 0)
+        {
+            char path[SDPRINT_MAX_PATH];
+            if (values[i] == NULL || !pushValidName(values[i]))
+            {
+                web->started = SDPRINT_ERROR_FAILED_OPEN;
+                continue;
+            }
+            _path(path, values[i]);
+            web->started = sdprintStart(path);
+        }
+        else if (strcmp(params[i], "pause") == 0)
+        {
+            sdprintPause();
+        }
+        else if (strcmp(params[i], "resume") == 0)
+        {
+            sdprintResume();
+        }
+        else if (strcmp(params[i], "abort") == 0)
+        {
+            sdprintAbort();
+        }
+    }
+    return "/status.json";
+}
+
+/**
+ * @brief  Points fleet telemetry at a broker from /fleet.cgi. A bad address is ignored.
+ */
+static const char *_fleetCgi(int index, int count, char *params[], char *values[])
+{
+    (void)index;
+    WebServer *web = &WEB;
+    web->stats.commands++;
+    const char *broker = NULL;
+    u16_t port = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (values[i] == NULL)
+            continue;
+        if (strcmp(params[i], "broker") == 0)
+            broker = values[i];
+        else if (strcmp(params[i], "port") == 0)
+            port = (u16_t)strtoul(values[i], NULL, 10);
+    }
+    if (broker != NULL)
+    {
+        ip_addr_t address;
+        if (broker[0] == '\0')
+            fleetSetBroker(NULL, port);
+        else if (ipaddr_aton(broker, &address))
+            fleetSetBroker(&address, port);
+    }
+    return "/status.json";
+}
+
+static const tCGI _cgis[] = {{"/print.cgi", _printCgi}, {"/fleet.cgi", _fleetCgi}, {"/ota.cgi", _otaCgi}};
+
+/**
+ * @brief  Cleans up after an upload whose connection went away without httpd saying so, which it doesn't when the host resets it.
+ */
+static void _watchdog(void *arg)
+{
+    (void)arg;
+    WebServer *web = &WEB;
+    if (web->uploader != NULL && sys_now() - web->lastData > WEB_UPLOAD_TIMEOUT_MS)
+        _finish(web);
+    sys_timeout(WATCHDOG_MS, _watchdog, NULL);
+}
+
+/**
+ * @brief  Hands push.c more of an upload that had to wait for it. Call from the network task whenever it wakes; the push task wakes it when a chunk is written.
+ * @retval None
+ * @headerfile web.h
+ */
+void webService(void)
+{
+    WebServer *web = &WEB;
+    if (web->uploader != NULL)
+        _feed(web);
+}
+
+static void _txt(struct mdns_service *service, void *data)
+{
+    (void)data;
+    mdns_resp_add_service_txtitem(service, "path=/", 6);
+}
+
+/**
+ * @brief  Starts the server on port 80 and announces it over mDNS, so browsers that browse for printers find it. Call from the network task once the interface is up.
+ * @param[in]  netif is the interface to announce the server on.
+ * @retval None
+ * @headerfile web.h
+ */
+void webInit(struct netif *netif)
+{
+    WebServer *web = &WEB;
+    memset(web, 0, sizeof(*web));
+    forgeMemoryAdd("web", web, sizeof(*web));
+
+    httpd_init();
+    http_set_cgi_handlers(_cgis, (int)(sizeof(_cgis) / sizeof(_cgis[0])));
+    mdns_resp_add_service(netif, NET_HOSTNAME, "_http", DNSSD_PROTO_TCP, HTTPD_SERVER_PORT, NET_MDNS_TTL, _txt, NULL);
+    sys_timeout(WATCHDOG_MS, _watchdog, NULL);
+}
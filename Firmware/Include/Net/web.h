@@ -0,0 +1,72 @@
+/**
+ * @file web.h
+ * @brief The printer's web dashboard: LwIP's httpd with the pages in fsdata_forge.c, a status JSON, and G-code and firmware uploads through push.c.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_WEB_H
+#define __FORGE_WEB_H
+
+#include "push.h"
+#include "../Storage/sdprint.h"
+#include "../LwIP/src/include/lwip/netif.h"
+#include "../LwIP/src/include/lwip/pbuf.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// /status.json and /upload.json responses that can be on their way at once;
+// a request beyond that gets a short "busy" reply
+#define WEB_STATUS_BUFFERS 2
+#define WEB_STATUS_SIZE 768 // The longest status, every field at its widest, is about 700
+// An upload that makes no progress for this long is given up on, which is
+// also how one whose connection was reset gets cleaned up
+#define WEB_UPLOAD_TIMEOUT_MS 10000U
+
+    typedef struct
+    {
+        uint32_t statusServed;
+        uint32_t statusBusy;     // Replies that found every status buffer in use
+        uint32_t commands;       // /print.cgi requests
+        uint32_t uploads;        // Completed
+        uint32_t uploadBytes;
+        uint32_t uploadFailures;
+    } WebStats;
+
+    /**
+     * @brief The single web server. Only the network task touches it.
+     */
+    typedef struct
+    {
+        char status[WEB_STATUS_BUFFERS][WEB_STATUS_SIZE];
+        bool statusUsed[WEB_STATUS_BUFFERS];
+
+        void *uploader;       // httpd's connection sending a file, NULL if none
+        struct pbuf *pending; // Body received but not yet taken by push.c, its TCP window still shut
+        char name[PUSH_MAX_NAME + 1];
+        uint32_t expected;    // Content-Length of the upload
+        uint32_t received;    // Taken by push.c
+        uint32_t lastData;    // Tick at which data last came in or was taken
+        PushResult result;    // Of the last upload, finished or turned away
+        SDPrintError started; // What the last /print.cgi?start= got back
+
+        WebStats stats;
+    } WebServer;
+
+    extern WebServer WEB;
+
+    void webInit(struct netif *netif);
+    void webService(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_WEB_H */
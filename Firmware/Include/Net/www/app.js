@@ -0,0 +1,79 @@
+// Polls /status.json and drives /print.cgi and /upload. Every reply the
+// printer sends is small and made fresh, so nothing here is cached.
+(function () {
+  'use strict';
+  var POLL_MS = 1000;
+
+  function $(id) { return document.getElementById(id); }
+  function text(id, v) { $(id).textContent = (v === null || v === undefined) ? '-' : v; }
+
+  function clock(s) {
+    var h = Math.floor(s / 3600), m = Math.floor(s / 60) % 60;
+    s = s % 60;
+    return h + ':' + (m < 10 ? '0' : '') + m + ':' + (s < 10 ? '0' : '') + s;
+  }
+
+  function heater(name, h) {
+    text(name + '-temp', h && h.temp !== null ? h.temp.toFixed(1) + ' °C' : null);
+    text(name + '-target', h && h.target !== null ? h.target.toFixed(1) + ' °C' : null);
+    text(name + '-power', h && h.power !== null ? Math.round(h.power * 100) + '%' : null);
+  }
+
+  function show(s) {
+    if (s.busy) return;
+    $('link').className = '';
+    text('link', 'online');
+    text('state', s.state);
+    text('file', s.file);
+    text('percent', s.progress.toFixed(1));
+    $('progress').style.width = s.progress + '%';
+    text('elapsed', clock(s.elapsed));
+    text('error', s.start || s.error);
+    heater('hotend', s.hotend);
+    heater('bed', s.bed);
+    ['x', 'y', 'z', 'e'].forEach(function (a) {
+      text(a, s.position[a] === null ? null : s.position[a].toFixed(2));
+    });
+    text('segments', s.segments);
+    text('underruns', s.underruns);
+  }
+
+  function get(url) {
+    return fetch(url, { cache: 'no-store' }).then(function (r) { return r.json(); });
+  }
+
+  function poll() {
+    get('/status.json').then(show, function () {
+      $('link').className = 'down';
+      text('link', 'offline');
+    }).then(function () { setTimeout(poll, POLL_MS); });
+  }
+
+  Array.prototype.forEach.call(document.querySelectorAll('button[data-cmd]'), function (b) {
+    b.addEventListener('click', function () { get('/print.cgi?' + b.dataset.cmd).then(show); });
+  });
+
+  // The body is the file itself, not a form, so the printer can write it to
+  // the card as it arrives
+  $('upload').addEventListener('submit', function (ev) {
+    ev.preventDefault();
+    var f = $('gcode').files[0];
+    if (!f) return;
+    var name = f.name.replace(/[^A-Za-z0-9._-]/g, '_').replace(/^\.+/, '');
+    var x = new XMLHttpRequest();
+    x.open('POST', '/upload?name=' + name);
+    x.upload.onprogress = function (p) {
+      if (p.lengthComputable) $('sent').style.width = (100 * p.loaded / p.total) + '%';
+    };
+    x.onload = function () {
+      var r = JSON.parse(x.responseText);
+      text('uploaded', name + ': ' + (r.result === 'ok' ? r.bytes + ' bytes' : r.result || 'busy'));
+      if (r.result === 'ok' && $('print').checked) get('/print.cgi?start=' + name).then(show);
+    };
+    x.onerror = function () { text('uploaded', name + ': failed'); };
+    text('uploaded', name + ': sending');
+    x.send(f);
+  });
+
+  poll();
+})();
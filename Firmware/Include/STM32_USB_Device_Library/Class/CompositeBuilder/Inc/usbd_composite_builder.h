@@ -130,6 +130,32 @@ extern "C" {
 #define USBD_CMPSIT_ACTIVATE_MTP                           0U
 #endif /* USBD_CMPSIT_ACTIVATE_MTP */
 
+#ifndef USBD_CMPSIT_ACTIVATE_VENDOR
+#define USBD_CMPSIT_ACTIVATE_VENDOR                        0U
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
+
+/* A vendor specific interface (class 0xFF) with a single bulk IN endpoint.
+   The class driver is supplied by the application. */
+#ifndef USBD_CMPSIT_VENDOR_PACKET_SIZE
+#define USBD_CMPSIT_VENDOR_PACKET_SIZE                     64U
+#endif /* USBD_CMPSIT_VENDOR_PACKET_SIZE */
+
+#ifndef USBD_CMPSIT_ACTIVATE_DAP
+#define USBD_CMPSIT_ACTIVATE_DAP                           0U
+#endif /* USBD_CMPSIT_ACTIVATE_DAP */
+
+/* A CMSIS-DAP v2 interface (class 0xFF): bulk OUT for commands, bulk IN for
+   responses and bulk IN for the SWO stream, in that order. Hosts find it by
+   its interface string, which must contain "CMSIS-DAP" and is supplied by
+   the application's class driver under this index. */
+#ifndef USBD_CMPSIT_DAP_EPS
+#define USBD_CMPSIT_DAP_EPS                                3U /* 2U without the SWO stream */
+#endif /* USBD_CMPSIT_DAP_EPS */
+
+#ifndef USBD_CMPSIT_DAP_STRING_INDEX
+#define USBD_CMPSIT_DAP_STRING_INDEX                       0x10U
+#endif /* USBD_CMPSIT_DAP_STRING_INDEX */
+
 
 /* This is the maximum supported configuration descriptor size
    User may define this value in usbd_conf.h in order to optimize footprint */
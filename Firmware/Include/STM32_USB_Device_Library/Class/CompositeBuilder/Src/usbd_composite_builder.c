@@ -149,6 +149,14 @@ static void  USBD_CMPSIT_CCIDDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO
 static void  USBD_CMPSIT_MTPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
 #endif /* USBD_CMPSIT_ACTIVATE_MTP == 1U */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1U
+static void  USBD_CMPSIT_VendorDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR == 1U */
+
+#if USBD_CMPSIT_ACTIVATE_DAP == 1U
+static void  USBD_CMPSIT_DAPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
+#endif /* USBD_CMPSIT_ACTIVATE_DAP == 1U */
+
 /**
   * @}
   */
@@ -661,6 +669,63 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
       break;
 #endif /* USBD_CMPSIT_ACTIVATE_MTP */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1
+    case CLASS_TYPE_VENDOR:
+      /* Same packet size at both speeds, the application picks it */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = USBD_CMPSIT_VENDOR_PACKET_SIZE;
+
+      /* Find the first available interface slot and Assign number of interfaces */
+      idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
+      pdev->tclasslist[pdev->classId].NumIf = 1U;
+      pdev->tclasslist[pdev->classId].Ifs[0] = idxIf;
+
+      /* Assign endpoint numbers */
+      pdev->tclasslist[pdev->classId].NumEps = 1U; /* EPx_IN */
+
+      /* Set IN endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[0];
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+
+      /* Configure and Append the Descriptor */
+      USBD_CMPSIT_VendorDesc(pdev, (uint32_t)pCmpstFSConfDesc, &CurrFSConfDescSz, (uint8_t)USBD_SPEED_FULL);
+
+#ifdef USE_USB_HS
+      USBD_CMPSIT_VendorDesc(pdev, (uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz, (uint8_t)USBD_SPEED_HIGH);
+#endif /* USE_USB_HS */
+
+      break;
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
+
+#if USBD_CMPSIT_ACTIVATE_DAP == 1
+    case CLASS_TYPE_DAP:
+      /* Bulk packets are the same size as the vendor stream's */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = USBD_CMPSIT_VENDOR_PACKET_SIZE;
+
+      /* Find the first available interface slot and Assign number of interfaces */
+      idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
+      pdev->tclasslist[pdev->classId].NumIf = 1U;
+      pdev->tclasslist[pdev->classId].Ifs[0] = idxIf;
+
+      /* Assign endpoint numbers */
+      pdev->tclasslist[pdev->classId].NumEps = USBD_CMPSIT_DAP_EPS; /* EPx_OUT, EPx_IN[, EPx_IN (SWO)] */
+
+      /* Set the command OUT, response IN and SWO IN endpoint slots */
+      for (uint32_t i = 0U; i < USBD_CMPSIT_DAP_EPS; i++)
+      {
+        iEp = pdev->tclasslist[pdev->classId].EpAdd[i];
+        USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+      }
+
+      /* Configure and Append the Descriptor */
+      USBD_CMPSIT_DAPDesc(pdev, (uint32_t)pCmpstFSConfDesc, &CurrFSConfDescSz, (uint8_t)USBD_SPEED_FULL);
+
+#ifdef USE_USB_HS
+      USBD_CMPSIT_DAPDesc(pdev, (uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz, (uint8_t)USBD_SPEED_HIGH);
+#endif /* USE_USB_HS */
+
+      break;
+#endif /* USBD_CMPSIT_ACTIVATE_DAP */
+
     default:
       UNUSED(idxIf);
       UNUSED(iEp);
@@ -1760,6 +1825,66 @@ static void  USBD_CMPSIT_MTPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO
 }
 #endif /* USBD_CMPSIT_ACTIVATE_MTP == 1 */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1
+/**
+  * @brief  USBD_CMPSIT_VendorDesc
+  *         Configure and Append the vendor specific Descriptor
+  * @param  pdev: device instance
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @retval None
+  */
+static void  USBD_CMPSIT_VendorDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed)
+{
+  USBD_IfDescTypeDef *pIfDesc;
+  USBD_EpDescTypeDef *pEpDesc;
+
+  /* Append vendor Interface descriptor */
+  __USBD_CMPSIT_SET_IF((pdev->tclasslist[pdev->classId].Ifs[0]), (0U), \
+                       (uint8_t)(pdev->tclasslist[pdev->classId].NumEps), (0xFFU), (0x00U), (0x00U), (0U));
+
+  /* Append Endpoint descriptor to Configuration descriptor */
+  __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[0].add), (USBD_EP_TYPE_BULK), \
+                       (pdev->tclasslist[pdev->classId].CurrPcktSze), (0U), (0U));
+
+  /* Update Config Descriptor and IAD descriptor */
+  ((USBD_ConfigDescTypeDef *)pConf)->bNumInterfaces += 1U;
+  ((USBD_ConfigDescTypeDef *)pConf)->wTotalLength = (uint16_t)(*Sze);
+}
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR == 1 */
+
+#if USBD_CMPSIT_ACTIVATE_DAP == 1
+/**
+  * @brief  USBD_CMPSIT_DAPDesc
+  *         Configure and Append the CMSIS-DAP v2 Descriptor
+  * @param  pdev: device instance
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @retval None
+  */
+static void  USBD_CMPSIT_DAPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed)
+{
+  USBD_IfDescTypeDef *pIfDesc;
+  USBD_EpDescTypeDef *pEpDesc;
+
+  /* Append vendor Interface descriptor, named for the host to find */
+  __USBD_CMPSIT_SET_IF((pdev->tclasslist[pdev->classId].Ifs[0]), (0U), \
+                       (uint8_t)(pdev->tclasslist[pdev->classId].NumEps), (0xFFU), (0x00U), (0x00U), \
+                       (USBD_CMPSIT_DAP_STRING_INDEX));
+
+  /* Append Endpoint descriptors to Configuration descriptor, in the order the specification gives */
+  for (uint32_t i = 0U; i < USBD_CMPSIT_DAP_EPS; i++)
+  {
+    __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[i].add), (USBD_EP_TYPE_BULK), \
+                         (pdev->tclasslist[pdev->classId].CurrPcktSze), (0U), (0U));
+  }
+
+  /* Update Config Descriptor and IAD descriptor */
+  ((USBD_ConfigDescTypeDef *)pConf)->bNumInterfaces += 1U;
+  ((USBD_ConfigDescTypeDef *)pConf)->wTotalLength = (uint16_t)(*Sze);
+}
+#endif /* USBD_CMPSIT_ACTIVATE_DAP == 1 */
+
 /**
   * @brief  USBD_CMPSIT_SetClassID
   *         Find and set the class ID relative to selected class type and instance
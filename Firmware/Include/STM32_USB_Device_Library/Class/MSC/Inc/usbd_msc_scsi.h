@@ -70,6 +70,9 @@ extern "C" {
 #define SCSI_VERIFY12                               0xAFU
 #define SCSI_VERIFY16                               0x8FU
 
+#define SCSI_SYNCHRONIZE_CACHE10                    0x35U
+#define SCSI_SYNCHRONIZE_CACHE16                    0x91U
+
 #define SCSI_SEND_DIAGNOSTIC                        0x1DU
 #define SCSI_READ_FORMAT_CAPACITIES                 0x23U
 
@@ -159,6 +162,8 @@ int8_t SCSI_ProcessCmd(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *cmd);
 void SCSI_SenseCode(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t sKey,
                     uint8_t ASC);
 
+int8_t USBD_MSC_Sync(uint8_t lun, uint8_t eject);
+
 /**
   * @}
   */
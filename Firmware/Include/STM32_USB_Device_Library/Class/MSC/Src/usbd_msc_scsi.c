@@ -92,6 +92,7 @@ static int8_t SCSI_Write12(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *param
 static int8_t SCSI_Read10(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *params);
 static int8_t SCSI_Read12(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *params);
 static int8_t SCSI_Verify10(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *params);
+static int8_t SCSI_SynchronizeCache(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *params);
 static int8_t SCSI_CheckAddressRange(USBD_HandleTypeDef *pdev, uint8_t lun,
                                      uint32_t blk_offset, uint32_t blk_nbr);
 
@@ -190,6 +191,11 @@ int8_t SCSI_ProcessCmd(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *cmd)
       ret = SCSI_Verify10(pdev, lun, cmd);
       break;
 
+    case SCSI_SYNCHRONIZE_CACHE10:
+    case SCSI_SYNCHRONIZE_CACHE16:
+      ret = SCSI_SynchronizeCache(pdev, lun, cmd);
+      break;
+
     default:
       SCSI_SenseCode(pdev, lun, ILLEGAL_REQUEST, INVALID_CDB);
       hmsc->bot_status = USBD_BOT_STATUS_ERROR;
@@ -646,6 +652,14 @@ static int8_t SCSI_StartStopUnit(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t
   }
   else if ((params[4] & 0x3U) == 0x2U) /* START=0 and LOEJ Load Eject=1 */
   {
+    /* The status goes back only once the storage has written out anything it
+       held back, so the host never reports a half written medium as safe to
+       remove */
+    if (USBD_MSC_Sync(lun, 1U) != 0)
+    {
+      SCSI_SenseCode(pdev, lun, HARDWARE_ERROR, WRITE_FAULT);
+      return -1;
+    }
     hmsc->scsi_medium_state = SCSI_MEDIUM_EJECTED;
   }
   else if ((params[4] & 0x3U) == 0x3U) /* START=1 and LOEJ Load Eject=1 */
@@ -1043,6 +1057,51 @@ static int8_t SCSI_Verify10(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *para
   return 0;
 }
 
+/**
+  * @brief  SCSI_SynchronizeCache
+  *         Process Synchronize Cache (10) and (16) commands: write out
+  *         whatever the storage holds in a write cache
+  * @param  lun: Logical unit number
+  * @param  params: Command parameters
+  * @retval status
+  */
+static int8_t SCSI_SynchronizeCache(USBD_HandleTypeDef *pdev, uint8_t lun, uint8_t *params)
+{
+  UNUSED(params);
+  USBD_MSC_BOT_HandleTypeDef *hmsc = (USBD_MSC_BOT_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+
+  if (hmsc == NULL)
+  {
+    return -1;
+  }
+
+  if (USBD_MSC_Sync(lun, 0U) != 0)
+  {
+    SCSI_SenseCode(pdev, lun, HARDWARE_ERROR, WRITE_FAULT);
+    return -1;
+  }
+
+  hmsc->bot_data_length = 0U;
+
+  return 0;
+}
+
+/**
+  * @brief  USBD_MSC_Sync
+  *         Called for Synchronize Cache and for an eject. Storage that
+  *         caches writes overrides this to write them out
+  * @param  lun: Logical unit number
+  * @param  eject: 1 if the host is ejecting the medium
+  * @retval 0 once everything written so far is on the medium
+  */
+__weak int8_t USBD_MSC_Sync(uint8_t lun, uint8_t eject)
+{
+  UNUSED(lun);
+  UNUSED(eject);
+
+  return 0;
+}
+
 /**
   * @brief  SCSI_CheckAddressRange
   *         Check address range
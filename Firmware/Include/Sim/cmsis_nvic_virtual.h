@@ -0,0 +1,50 @@
+/**
+ * @file cmsis_nvic_virtual.h
+ * @brief The NVIC of the sim build. core_cm4.h includes this in place of its own register accessors, as sim.h defines CMSIS_NVIC_VIRTUAL.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_SIM_NVIC_H
+#define __FORGE_SIM_NVIC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    void simNvicSetPriorityGrouping(uint32_t group);
+    uint32_t simNvicGetPriorityGrouping(void);
+    void simNvicEnableIRQ(IRQn_Type irq);
+    uint32_t simNvicGetEnableIRQ(IRQn_Type irq);
+    void simNvicDisableIRQ(IRQn_Type irq);
+    uint32_t simNvicGetPendingIRQ(IRQn_Type irq);
+    void simNvicSetPendingIRQ(IRQn_Type irq);
+    void simNvicClearPendingIRQ(IRQn_Type irq);
+    uint32_t simNvicGetActive(IRQn_Type irq);
+    void simNvicSetPriority(IRQn_Type irq, uint32_t priority);
+    uint32_t simNvicGetPriority(IRQn_Type irq);
+    void simNvicSystemReset(void);
+
+#define NVIC_SetPriorityGrouping simNvicSetPriorityGrouping
+#define NVIC_GetPriorityGrouping simNvicGetPriorityGrouping
+#define NVIC_EnableIRQ simNvicEnableIRQ
+#define NVIC_GetEnableIRQ simNvicGetEnableIRQ
+#define NVIC_DisableIRQ simNvicDisableIRQ
+#define NVIC_GetPendingIRQ simNvicGetPendingIRQ
+#define NVIC_SetPendingIRQ simNvicSetPendingIRQ
+#define NVIC_ClearPendingIRQ simNvicClearPendingIRQ
+#define NVIC_GetActive simNvicGetActive
+#define NVIC_SetPriority simNvicSetPriority
+#define NVIC_GetPriority simNvicGetPriority
+#define NVIC_SystemReset simNvicSystemReset
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SIM_NVIC_H */
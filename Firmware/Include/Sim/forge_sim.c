@@ -0,0 +1,353 @@
+/**
+ * @file forge_sim.c
+ * @brief forge_sim: the Forge firmware built for the host and run on a simulated MCU, to time step generation and the planner without a board.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * The firmware's own sources, unchanged, with the HAL and FreeRTOS put back
+ * by sim_hal.c and sim_rtos.c and the chip by sim.c. From Firmware/Include:
+ *
+ *   gcc -std=gnu11 -O2 -include Sim/sim.h -ISim -IDevice -ICMSIS-Core -IHAL -ICore \
+ *       -IDSP/Include -IFreeRTOS/Source/include -ffunction-sections -Wl,--gc-sections \
+ *       -DSTM32F405xx -DUSE_HAL_DRIVER -DARM_MATH_CM4 -Wno-overflow \
+ *       -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast -o forge_sim \
+ *       Sim/forge_sim.c Sim/sim.c Sim/sim_hal.c Sim/sim_rtos.c Sim/sim_plant.c \
+ *       Core/forge.c Core/memory.c Core/trace.c Core/scheduler.c Core/profiler.c Net/json.c \
+ *       Motion/motion.c Motion/planner.c Motion/gcode.c Stepper/stepper.c \
+ *       Temperature/therm.c Temperature/control.c Neopixel/effects.c Neopixel/neopixel.c \
+ *       Neopixel/neopixel_pwm.c Neopixel/neopixel_spi.c Neopixel/neopixel_batch.c -lm
+ *
+ * Sim/ comes first on the include path for its portmacro.h, the host's port
+ * of FreeRTOS. The LED driver is only there because the scheduler's LED
+ * task refers to it; the LEDs stay off.
+ *
+ *   ./forge_sim [-e edges] [-s script] [-T thermal.csv] [-P profile] [-t seconds] [-c cycles] [-i cycles]
+ *               [-u] print.gcode
+ *
+ * Runs the file as the print task would from the card, on the board of
+ * main.c, and prints what it took. The options:
+ *
+ *   -e  logs every pin edge, with its cycle, see sim.c, and a junction
+ *       note as each segment ends; host/stepcheck.c checks the step timing
+ *       in it
+ *   -s  changes the thermal plants as the print goes, see sim_plant.c
+ *   -T  writes the plants' temperatures and duties every 100ms, as CSV
+ *   -P  writes the profiler's reports, as the CDC port would, for profsum
+ *   -t  gives up after this much virtual time, 3600s unless given
+ *   -c  charges the parser this many core cycles a byte of G-code; code
+ *       takes no time in the sim otherwise, so this is what makes the
+ *       planner slow enough to starve the step queue
+ *   -i  charges the step interrupt this many core cycles on top of its
+ *       pulse, e.g. what the board's profiler measures it at, for the
+ *       peak load: the most of any SIM_LOAD_MS it spent in the interrupt
+ *   -u  lifts the steppers' travel limits (forge-steppers.h), so G-code
+ *       made for a whole bed steps rather than being clipped
+ *
+ * The carriages start at home, where their drivers' DIAG outputs are high,
+ * and each STEP rising edge moves them one step, away from home while DIR
+ * is high. The heaters warm the plants through their PWM compares and the
+ * thermistors read them back through the ADC, so M109 and M190 wait as long
+ * as they would on the machine. Exits 0 once the file has run and the queue
+ * drained, 1 if it ran out of time, e.g. stuck waiting for a heater, with
+ * what each task was waiting on.
+ */
+
+#include "../Core/forge.h"
+#include "../Core/scheduler.h"
+#include "../Core/profiler.h"
+#include "../Core/trace.h"
+#include "../Stepper/forge-steppers.h"
+#include "../Temperature/forge-controllers.h"
+#include "../Motion/forge-motion.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_READ_CHUNK 512 // As the card is read, SDPRINT_CHUNK
+#define SIM_HOMED_AXES 3   // X, Y and Z have a DIAG to home on
+#define SIM_LOAD_MS 10     // The step interrupt's peak load is its busiest window of this long
+
+void SysTick_Handler(void); // Core/forge.c
+
+StepperConfig StepperX1;
+StepperConfig StepperY1;
+StepperConfig StepperZ1;
+StepperConfig StepperE1;
+
+ThermistorConfig T0;
+ThermistorConfig T1;
+ThermistorConfig T2;
+
+PIDControlConfig HeaterHotend;
+PIDControlConfig HeaterBed;
+
+Planner ForgePlanner;
+GcodeMachine ForgeGcode;
+
+static FILE *_gcode = NULL;
+static FILE *_profile = NULL;
+static uint32_t _cyclesPerByte = 0;
+static uint32_t _isrCycles = 0;
+static uint64_t _loadWindow = 0;
+static uint64_t _loadCycles = 0;
+static uint64_t _peakLoadCycles = 0;
+static uint32_t _bytes = 0;
+static bool _finished = false;
+
+static StackType_t _printStack[FORGE_STACK_PLANNER];
+static StaticTask_t _printTcb;
+
+// Steps from home of each carriage, as the STEP and DIR pins moved it
+static int32_t _carriage[SIM_HOMED_AXES];
+static StepperConfig *const _homed[SIM_HOMED_AXES] = {&StepperX1, &StepperY1, &StepperZ1};
+
+/**
+ * @brief  Moves a carriage a step on each rising edge of its STEP pin, and holds its DIAG high while it's home.
+ */
+static void _stepped(GPIO_TypeDef *port, uint32_t pin, bool level)
+{
+    if (!level)
+        return;
+    for (uint8_t a = 0; a < SIM_HOMED_AXES; a++)
+    {
+        StepperConfig *cfg = _homed[a];
+        if (cfg->STEPx != port || cfg->STEP_Pin != pin)
+            continue;
+        if (cfg->DIRx->ODR & cfg->DIR_Pin)
+            _carriage[a]++;
+        else if (_carriage[a] > 0) // Against the frame it goes no further
+            _carriage[a]--;
+        simGpioDrive(cfg->DIAGx, cfg->DIAG_Pin, _carriage[a] == 0);
+    }
+}
+
+/**
+ * @brief  The step interrupt, charged -i cycles on top of its own, and its cycles added up by window for the peak load.
+ */
+static void _stepIrq(void)
+{
+    uint64_t start = simNow - SIM_IRQ_ENTRY_CYCLES;
+    TIM7_IRQHandler();
+    if (_isrCycles > 0)
+        simCycles(_isrCycles);
+    uint64_t window = start / (SIM_CORE_HZ / 1000U * SIM_LOAD_MS);
+    if (window != _loadWindow)
+    {
+        _loadWindow = window;
+        _loadCycles = 0;
+    }
+    _loadCycles += simNow - start;
+    if (_loadCycles > _peakLoadCycles)
+        _peakLoadCycles = _loadCycles;
+}
+
+static void _name(StepperConfig *cfg, const char *step, const char *dir, const char *enable, const char *diag)
+{
+    simGpioName(cfg->STEPx, cfg->STEP_Pin, step);
+    simGpioName(cfg->DIRx, cfg->DIR_Pin, dir);
+    simGpioName(cfg->Enablex, cfg->Enable_Pin, enable);
+    simGpioName(cfg->DIAGx, cfg->DIAG_Pin, diag);
+}
+
+/**
+ * @brief  Runs the file as sdprint.c's print task does, a chunk at a time, then stops the sim once the queue has drained.
+ */
+static void _printTask(void *arg)
+{
+    (void)arg;
+    uint8_t chunk[SIM_READ_CHUNK];
+    size_t n;
+    motionSetStreaming(true);
+    while ((n = fread(chunk, 1, sizeof(chunk), _gcode)) > 0)
+    {
+        if (_cyclesPerByte > 0)
+            simCycles((uint32_t)n * _cyclesPerByte);
+        // Counted first, so a print stuck in an M109 still shows how far it got
+        _bytes += (uint32_t)n;
+        gcodeFeed(&ForgeGcode, chunk, (uint32_t)n);
+    }
+    gcodeFinish(&ForgeGcode);
+    // The queue draining after the last line isn't an underrun
+    motionSetStreaming(false);
+    plannerSync(&ForgePlanner);
+    _finished = true;
+    simStop();
+}
+
+/**
+ * @brief  Marks the junction in the edge log, so stepcheck knows where the planner may jump an axis's velocity.
+ */
+void motionSegmentDone(const MotionSegment *seg, const int32_t position[FORGE_AXES])
+{
+    (void)seg;
+    (void)position;
+    simEdgeNote("junction");
+}
+
+/**
+ * @brief  The profiler's reports, prefixed as forge-usb.h sends them so profsum reads them as it would the CDC port.
+ */
+void profileOutput(const char *line, uint32_t length)
+{
+    if (_profile == NULL)
+        return;
+    fputs("// ", _profile);
+    fwrite(line, 1, length, _profile);
+}
+
+static double _hostSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void _report(const char *path, double hostSeconds)
+{
+    MotionStats stats;
+    motionGetStats(&stats);
+    double seconds = (double)simNow / SIM_CORE_HZ;
+    uint32_t steps = simIrqTaken(MOTION_TIMER_IRQn);
+
+    printf("forge_sim: %s\n", path);
+    printf("  %s after %.3f s of machine time in %.3f s, %.1fx real time\n",
+           _finished ? "finished" : "ran out of time", seconds, hostSeconds,
+           (hostSeconds > 0.0) ? seconds / hostSeconds : 0.0);
+    printf("  %lu bytes, %lu lines, %lu errors\n", (unsigned long)_bytes, (unsigned long)ForgeGcode.lines,
+           (unsigned long)ForgeGcode.errors);
+    printf("  %lu segments, %lu step events, %lu underruns\n", (unsigned long)stats.segments,
+           (unsigned long)stats.events, (unsigned long)stats.underruns);
+    printf("  step interrupt: %lu taken, %.0f ns each on the host, peak load %.2f%% of %ums\n", (unsigned long)steps,
+           (steps > 0) ? (double)simIrqHostNs(MOTION_TIMER_IRQn) / steps : 0.0,
+           100.0 * (double)_peakLoadCycles / (SIM_CORE_HZ / 1000U * SIM_LOAD_MS), SIM_LOAD_MS);
+    printf("  %llu pin edges\n", (unsigned long long)simEdges());
+    simPlantReport(stdout);
+    if (!_finished)
+        simTaskReport(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *edges = NULL;
+    const char *script = NULL;
+    const char *thermal = NULL;
+    const char *profile = NULL;
+    double limit = 3600.0;
+    bool unlimited = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            edges = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            script = argv[++i];
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+            thermal = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            profile = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            limit = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            _cyclesPerByte = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            _isrCycles = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-u") == 0)
+            unlimited = true;
+        else
+            path = argv[i];
+    }
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: forge_sim [-e edges] [-s script] [-T thermal.csv] [-P profile] [-t seconds] "
+                        "[-c cycles] [-i cycles] [-u] print.gcode\n");
+        return 2;
+    }
+    _gcode = fopen(path, "rb");
+    if (_gcode == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    if (profile != NULL && (_profile = fopen(profile, "w")) == NULL)
+    {
+        perror(profile);
+        return 2;
+    }
+
+    // The vector table, as far as this board uses it
+    simVector(SysTick_IRQn, SysTick_Handler);
+    simVector(MOTION_TIMER_IRQn, _stepIrq);
+    simVector(MOTION_WAKE_IRQn, TIM6_DAC_IRQHandler);
+
+    // As main.c brings the board up, less storage, USB and the LEDs
+    forgeInitHAL();
+    traceInit(TRACE_SWO_BAUD);
+
+    initForgeSteppers();
+    if (unlimited)
+    {
+        StepperX1.minPosition = StepperX1.maxPosition = 0;
+        StepperY1.minPosition = StepperY1.maxPosition = 0;
+        StepperZ1.minPosition = StepperZ1.maxPosition = 0;
+    }
+    _name(&StepperX1, "x_step", "x_dir", "x_en", "x_diag");
+    _name(&StepperY1, "y_step", "y_dir", "y_en", "y_diag");
+    _name(&StepperZ1, "z_step", "z_dir", "z_en", "z_diag");
+    _name(&StepperE1, "e_step", "e_dir", "e_en", "e_diag");
+    if (edges != NULL && !simEdgeLog(edges))
+    {
+        perror(edges);
+        return 2;
+    }
+    for (uint8_t a = 0; a < SIM_HOMED_AXES; a++)
+    {
+        simGpioWatch(_homed[a]->STEPx, _homed[a]->STEP_Pin, _stepped);
+        simGpioDrive(_homed[a]->DIAGx, _homed[a]->DIAG_Pin, true);
+    }
+
+    initStepper(&StepperX1);
+    initStepper(&StepperY1);
+    initStepper(&StepperZ1);
+    initStepper(&StepperE1);
+    initHeaterControllers();
+    initMotion();
+
+    simPlantAdd("hotend", T0.Therm_ADC_Channel, TIM3, &HeaterHotend.timerChannel);
+    simPlantAdd("bed", T1.Therm_ADC_Channel, TIM3, &HeaterBed.timerChannel);
+    if (script != NULL && !simPlantScript(script))
+    {
+        fprintf(stderr, "forge_sim: can't run %s\n", script);
+        return 2;
+    }
+    FILE *thermalFile = NULL;
+    if (thermal != NULL)
+    {
+        thermalFile = fopen(thermal, "w");
+        if (thermalFile == NULL)
+        {
+            perror(thermal);
+            return 2;
+        }
+        simPlantLog(thermalFile);
+    }
+
+    forgeAddHeater(&HeaterHotend);
+    forgeAddHeater(&HeaterBed);
+    forgeCreateTask(_printTask, "print", FORGE_STACK_PLANNER, FORGE_PRIO_PLANNER, _printStack, &_printTcb);
+
+    simSetTimeLimit(simNow + (uint64_t)(limit * SIM_CORE_HZ));
+    double start = _hostSeconds();
+    // Returns here, unlike on the board, once the print task stops the sim
+    forgeStartScheduler();
+    _report(path, _hostSeconds() - start);
+
+    if (thermalFile != NULL)
+        fclose(thermalFile);
+    if (_profile != NULL)
+        fclose(_profile);
+    fclose(_gcode);
+    return _finished ? 0 : 1;
+}
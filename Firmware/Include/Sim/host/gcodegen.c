@@ -0,0 +1,306 @@
+/**
+ * @file gcodegen.c
+ * @brief Writes the motion benchmark corpus: four G-code files, each a load a slicer really produces, the same bytes every time.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Needs nothing from the firmware. From Firmware/Include:
+ *
+ *   gcc -O2 -o gcodegen Sim/host/gcodegen.c -lm
+ *   ./gcodegen [-s scale] bench/
+ *
+ * The directory is made if it isn't there.
+ *
+ * The files, all within 20-180mm of a 200mm bed and, at scale 1, below 5mm
+ * of Z:
+ *
+ *   curves.gcode   Spirals and rose curves in 0.1-0.3mm segments at
+ *                  150mm/s, as an organic model's perimeters come out
+ *   arcs.gcode     Rounded rectangles, slots and gear outlines: arcs of
+ *                  0.5-20mm radius cut into chords 0.01mm off the true arc,
+ *                  as a slicer writes them with arc fitting off. The
+ *                  interpreter has no G2/G3, so these are what it would run
+ *   vase.gcode     A spiral vase: Z rises on every move, 0.4mm segments
+ *                  round a fluted cylinder, so three axes step throughout
+ *   infill.gcode   Dense rectilinear infill, 0.45mm apart at +-45 degrees
+ *                  and 200mm/s, with a reversal every line
+ *
+ * Every file starts with G92 rather than G28, so it runs from wherever the
+ * head is (and with the motors unpowered, on a board on the desk), with
+ * relative E and no heating. -s scales the layers, 1 unless given, so the
+ * corpus can be made longer for steadier numbers; at 1 each file is a few
+ * minutes of printing. Sim/host/motionbench.c runs them.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BED_CENTRE 100.0
+#define LAYER 0.2
+#define LINE_WIDTH 0.45
+#define FILAMENT_AREA 2.405 // 1.75mm filament
+#define CHORD_ERROR 0.01
+
+static const double PI = 3.14159265358979323846;
+
+// Where the last move left the head, so unchanged words aren't written
+typedef struct
+{
+    FILE *f;
+    double x;
+    double y;
+    double z;
+    double feed; // mm/min
+    unsigned long moves;
+} Writer;
+
+static bool _open(Writer *w, const char *dir, const char *name, const char *what)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    w->f = fopen(path, "w");
+    if (w->f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    w->x = w->y = w->z = 0.0;
+    w->feed = 0.0;
+    w->moves = 0;
+    fprintf(w->f, "; Forge motion benchmark: %s\n; Made by Sim/host/gcodegen.c; don't edit, run it again\n", what);
+    fprintf(w->f, "G92 X0 Y0 Z0 E0\nG90\nM83\n");
+    return true;
+}
+
+static void _close(Writer *w, const char *name)
+{
+    fprintf(w->f, "M400\n");
+    fclose(w->f);
+    printf("%-14s %8lu moves\n", name, w->moves);
+}
+
+static void _word(Writer *w, char letter, double value, double *last)
+{
+    if (fabs(value - *last) < 0.0005)
+        return;
+    // Feeds are whole mm/min, as slicers write them
+    fprintf(w->f, (letter == 'F') ? " %c%.0f" : " %c%.3f", letter, value);
+    *last = value;
+}
+
+// A move to (x, y, z), extruding for a line as wide as LINE_WIDTH if print is set
+static void _move(Writer *w, double x, double y, double z, double speed, bool print)
+{
+    double length = sqrt((x - w->x) * (x - w->x) + (y - w->y) * (y - w->y));
+    fputs(print ? "G1" : "G0", w->f);
+    _word(w, 'X', x, &w->x);
+    _word(w, 'Y', y, &w->y);
+    _word(w, 'Z', z, &w->z);
+    if (print && length > 0.0)
+        fprintf(w->f, " E%.5f", length * LINE_WIDTH * LAYER / FILAMENT_AREA);
+    _word(w, 'F', speed * 60.0, &w->feed);
+    fputc('\n', w->f);
+    w->moves++;
+}
+
+// Chords of a circle's arc from a0 to a1 radians, each no more than CHORD_ERROR off it
+static void _arc(Writer *w, double cx, double cy, double r, double a0, double a1, double z, double speed)
+{
+    double step = (r > CHORD_ERROR) ? 2.0 * acos(1.0 - CHORD_ERROR / r) : PI / 2.0;
+    int n = (int)ceil(fabs(a1 - a0) / step);
+    if (n < 1)
+        n = 1;
+    for (int i = 1; i <= n; i++)
+    {
+        double a = a0 + (a1 - a0) * i / n;
+        _move(w, cx + r * cos(a), cy + r * sin(a), z, speed, true);
+    }
+}
+
+static void _curves(Writer *w, int layers)
+{
+    for (int layer = 0; layer < layers; layer++)
+    {
+        double z = LAYER * (layer + 1);
+        // An Archimedean spiral out from the centre, a line width a turn and
+        // 0.2mm a segment
+        _move(w, BED_CENTRE, BED_CENTRE, z, 150.0, false);
+        for (double a = 0.0, r = 0.0; r < 25.0;)
+        {
+            a += 0.2 / ((r > 1.0) ? r : 1.0);
+            r = LINE_WIDTH * a / (2.0 * PI);
+            _move(w, BED_CENTRE + r * cos(a), BED_CENTRE + r * sin(a), z, 150.0, true);
+        }
+        // Rose curves, r = R cos(k t), their petals nested; 0.1-0.3mm segments
+        for (int k = 3; k <= 7; k += 2)
+        {
+            double radius = 30.0 + 5.0 * k;
+            for (int i = 0; i <= 3000; i++)
+            {
+                double t = PI * i / 3000.0;
+                double r = radius * cos(k * t);
+                _move(w, BED_CENTRE + r * cos(t), BED_CENTRE + r * sin(t), z, 150.0, i > 0);
+            }
+        }
+    }
+}
+
+static void _roundedRect(Writer *w, double x0, double y0, double x1, double y1, double r, double z)
+{
+    _move(w, x0 + r, y0, z, 120.0, false);
+    _move(w, x1 - r, y0, z, 120.0, true);
+    _arc(w, x1 - r, y0 + r, r, -PI / 2.0, 0.0, z, 120.0);
+    _move(w, x1, y1 - r, z, 120.0, true);
+    _arc(w, x1 - r, y1 - r, r, 0.0, PI / 2.0, z, 120.0);
+    _move(w, x0 + r, y1, z, 120.0, true);
+    _arc(w, x0 + r, y1 - r, r, PI / 2.0, PI, z, 120.0);
+    _move(w, x0, y0 + r, z, 120.0, true);
+    _arc(w, x0 + r, y0 + r, r, PI, 1.5 * PI, z, 120.0);
+}
+
+// Teeth with a flat flank up, an arc over the tip, a flank down and an arc along the root
+static void _gear(Writer *w, double cx, double cy, double r, int teeth, double z)
+{
+    const double tip = r + 1.5;
+    const double root = r - 1.0;
+    double pitch = 2.0 * PI / teeth;
+    _move(w, cx + root, cy, z, 100.0, false);
+    for (int t = 0; t < teeth; t++)
+    {
+        double a = t * pitch;
+        _move(w, cx + tip * cos(a + pitch * 0.1), cy + tip * sin(a + pitch * 0.1), z, 100.0, true);
+        _arc(w, cx, cy, tip, a + pitch * 0.1, a + pitch * 0.4, z, 100.0);
+        _move(w, cx + root * cos(a + pitch * 0.5), cy + root * sin(a + pitch * 0.5), z, 100.0, true);
+        _arc(w, cx, cy, root, a + pitch * 0.5, a + pitch, z, 100.0);
+    }
+}
+
+static void _arcs(Writer *w, int layers)
+{
+    for (int layer = 0; layer < 10 * layers; layer++)
+    {
+        double z = LAYER * (layer + 1);
+        for (int i = 0; i < 4; i++)
+        {
+            double inset = 3.0 * i;
+            _roundedRect(w, 25.0 + inset, 25.0 + inset, 175.0 - inset, 175.0 - inset, 20.0 - 4.0 * i, z);
+        }
+        // Slots: two half circles joined, down to 0.5mm radius
+        for (int i = 0; i < 12; i++)
+        {
+            double r = 0.5 + 0.4 * i;
+            double x = 50.0 + 8.0 * i;
+            _move(w, x + r, 60.0, z, 120.0, false);
+            _arc(w, x, 60.0, r, 0.0, PI, z, 120.0);
+            _move(w, x - r, 75.0, z, 120.0, true);
+            _arc(w, x, 75.0, r, PI, 2.0 * PI, z, 120.0);
+            _move(w, x + r, 60.0, z, 120.0, true);
+        }
+        _gear(w, 75.0, 125.0, 18.0, 24, z);
+        _gear(w, 130.0, 125.0, 12.0, 16, z);
+    }
+}
+
+static void _vase(Writer *w, int layers)
+{
+    // 0.4mm segments round a 40mm cylinder with 12 flutes 2mm deep
+    const double radius = 40.0;
+    const int segments = (int)(2.0 * PI * radius / 0.4);
+    _move(w, BED_CENTRE + radius, BED_CENTRE, LAYER, 60.0, false);
+    for (int layer = 0; layer < 20 * layers; layer++)
+    {
+        for (int i = 1; i <= segments; i++)
+        {
+            double a = 2.0 * PI * i / segments;
+            double r = radius + 2.0 * cos(12.0 * a);
+            double z = LAYER * (1.0 + layer + (double)i / segments);
+            _move(w, BED_CENTRE + r * cos(a), BED_CENTRE + r * sin(a), z, 60.0, true);
+        }
+    }
+}
+
+static void _infill(Writer *w, int layers)
+{
+    // Each layer fills a 60mm square; the lines run at 45 degrees one
+    // layer and -45 the next, every one of them joined to the last
+    const double half = 30.0;
+    for (int layer = 0; layer < 3 * layers; layer++)
+    {
+        double z = LAYER * (layer + 1);
+        double flip = (layer & 1) ? -1.0 : 1.0;
+        bool first = true;
+        int line = 0;
+        for (double c = -2.0 * half; c <= 2.0 * half; c += LINE_WIDTH * sqrt(2.0), line++)
+        {
+            // The line x - flip * y = c, clipped to the square
+            double u0 = (c > 0.0) ? -half + c : -half;
+            double u1 = (c > 0.0) ? half : half + c;
+            if (u1 - u0 < 0.1)
+                continue;
+            double ax = u0, ay = flip * (u0 - c);
+            double bx = u1, by = flip * (u1 - c);
+            if (line & 1)
+            {
+                double tx = ax, ty = ay;
+                ax = bx;
+                ay = by;
+                bx = tx;
+                by = ty;
+            }
+            _move(w, BED_CENTRE + ax, BED_CENTRE + ay, z, 200.0, !first);
+            _move(w, BED_CENTRE + bx, BED_CENTRE + by, z, 200.0, true);
+            first = false;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int scale = 1;
+    const char *dir = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            scale = atoi(argv[++i]);
+        else
+            dir = argv[i];
+    }
+    if (dir == NULL || scale < 1)
+    {
+        fprintf(stderr, "usage: gcodegen [-s scale] directory\n");
+        return 2;
+    }
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        perror(dir);
+        return 1;
+    }
+
+    static const struct
+    {
+        const char *name;
+        const char *what;
+        void (*write)(Writer *w, int layers);
+    } files[] = {
+        {"curves.gcode", "small-segment curves", _curves},
+        {"arcs.gcode", "arcs as chords", _arcs},
+        {"vase.gcode", "spiral vase", _vase},
+        {"infill.gcode", "dense infill", _infill},
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        Writer w;
+        if (!_open(&w, dir, files[i].name, files[i].what))
+            return 1;
+        files[i].write(&w, scale);
+        _close(&w, files[i].name);
+    }
+    return 0;
+}
@@ -0,0 +1,383 @@
+/**
+ * @file motionbench.c
+ * @brief Runs the motion benchmark corpus through the parser, planner and step interrupt, in forge_sim and on a board, and tabulates what each file cost.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Needs nothing from the firmware. From Firmware/Include:
+ *
+ *   gcc -O2 -o motionbench Sim/host/motionbench.c
+ *   ./gcodegen bench && ./motionbench [-s ./forge_sim] [-c cycles] [-i cycles] \
+ *       [-a address] [-p ms] [-n] bench/[a-z]*.gcode
+ *
+ * On the host each file is run by forge_sim (-u, with -c and -i passed on),
+ * so the numbers are the same on every machine but for the host column. On
+ * the board, given its address on the USB network (-a; FORGE_USB_NETWORK),
+ * each file is uploaded to the card, printed, and /status.json polled every
+ * -p ms, 100 unless given, until it's done; -n skips the host runs. The
+ * board moves as the file says, from wherever the head is, so home it first
+ * or leave the motors unpowered. For each file and where it ran:
+ *
+ *   segments   Segments the step interrupt finished
+ *   seg/s      Of machine time: the rate the file asks the planner for.
+ *              On the host, also of host time, which is how fast this
+ *              build runs the whole pipeline
+ *   peak isr   The most of any window the step interrupt took: forge_sim's
+ *              SIM_LOAD_MS, or the time between two polls on the board,
+ *              from the profiler's DWT cycle counts
+ *   underruns  Times the motion queue ran dry mid-print
+ *
+ * The board's step interrupt costs are also given in cycles each. That is
+ * what -i wants, so the host runs can then be made with the board's cost:
+ * the sim spends no time on code of its own. Likewise -c makes the parser
+ * slow enough to starve the queue, to see how far a change moves that edge.
+ * Exits 1 if a run didn't finish.
+ */
+
+#define _GNU_SOURCE
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HTTP_TIMEOUT_S 10
+#define REPLY_SIZE 4096
+
+typedef struct
+{
+    bool finished;
+    double segments;
+    double seconds;     // Of machine time
+    double hostSeconds; // Host run only
+    double peakLoad;    // 0-1
+    double underruns;
+    double isrCycles; // Board run only: cycles a step interrupt
+} Result;
+
+static const char *_address;
+static unsigned _pollMs = 100;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const char *_baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return (slash != NULL) ? slash + 1 : path;
+}
+
+// The number after "key": in a reply, from start on
+static bool _number(const char *json, const char *key, double *out)
+{
+    char quoted[32];
+    snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+    const char *p = strstr(json, quoted);
+    if (p == NULL)
+        return false;
+    char *end;
+    *out = strtod(p + strlen(quoted), &end);
+    return end != p + strlen(quoted);
+}
+
+/**
+ * @brief  Runs the file in forge_sim and reads its report.
+ */
+static bool _runHost(const char *sim, const char *path, uint32_t cyclesPerByte, uint32_t isrCycles, Result *r)
+{
+    char c[16];
+    char i[16];
+    snprintf(c, sizeof(c), "%u", cyclesPerByte);
+    snprintf(i, sizeof(i), "%u", isrCycles);
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(sim, sim, "-u", "-c", c, "-i", i, path, (char *)NULL);
+        perror(sim);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0)
+    {
+        close(fds[0]);
+        return false;
+    }
+
+    // sscanf stores what it matched before failing, hence a and b
+    FILE *out = fdopen(fds[0], "r");
+    char line[256];
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+        const char *peak = strstr(line, "peak load ");
+        double a, b;
+        if (sscanf(line, " finished after %lf s of machine time in %lf s", &a, &b) == 2)
+        {
+            r->finished = true;
+            r->seconds = a;
+            r->hostSeconds = b;
+        }
+        else if (sscanf(line, " %lf segments, %*f step events, %lf underruns", &a, &b) == 2)
+        {
+            r->segments = a;
+            r->underruns = b;
+        }
+        else if (peak != NULL && sscanf(peak, "peak load %lf", &a) == 1)
+        {
+            r->peakLoad = a / 100.0;
+        }
+    }
+    fclose(out);
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) <= 1;
+}
+
+/**
+ * @brief  One HTTP/1.0 exchange with the board. The body of the reply goes in reply.
+ * @retval The status code, or -1 if there was no reply.
+ */
+static int _http(const char *method, const char *uri, const char *body, size_t length, char *reply, size_t size)
+{
+    struct addrinfo hints;
+    struct addrinfo *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(_address, "80", &hints, &found) != 0)
+        return -1;
+    int s = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    if (s < 0 || connect(s, found->ai_addr, found->ai_addrlen) != 0)
+    {
+        freeaddrinfo(found);
+        if (s >= 0)
+            close(s);
+        return -1;
+    }
+    freeaddrinfo(found);
+    struct timeval timeout = {HTTP_TIMEOUT_S, 0};
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char head[512];
+    int n = snprintf(head, sizeof(head), "%s %s HTTP/1.0\r\nHost: %s\r\nContent-Length: %zu\r\n\r\n", method, uri,
+                     _address, length);
+    bool sent = send(s, head, (size_t)n, MSG_NOSIGNAL) == n;
+    for (size_t done = 0; sent && done < length;)
+    {
+        ssize_t w = send(s, body + done, length - done, MSG_NOSIGNAL);
+        sent = w > 0;
+        done += (w > 0) ? (size_t)w : 0;
+    }
+
+    size_t got = 0;
+    ssize_t r;
+    while (sent && got < size - 1 && (r = recv(s, reply + got, size - 1 - got, 0)) > 0)
+        got += (size_t)r;
+    close(s);
+    reply[got] = '\0';
+
+    int code;
+    if (!sent || sscanf(reply, "HTTP/%*s %d", &code) != 1)
+        return -1;
+    char *start = strstr(reply, "\r\n\r\n");
+    if (start != NULL)
+        memmove(reply, start + 4, strlen(start + 4) + 1);
+    return code;
+}
+
+static bool _state(const char *json, char *state, size_t size)
+{
+    const char *p = strstr(json, "\"state\":\"");
+    if (p == NULL)
+        return false;
+    p += 9;
+    size_t n = strcspn(p, "\"");
+    if (n >= size)
+        n = size - 1;
+    memcpy(state, p, n);
+    state[n] = '\0';
+    return true;
+}
+
+typedef struct
+{
+    double segments;
+    double underruns;
+    uint32_t count;
+    uint32_t cycles;
+    uint32_t at;
+} Sample;
+
+static bool _sample(const char *json, Sample *s)
+{
+    const char *isr = strstr(json, "\"stepIsr\":{");
+    double count, cycles, at;
+    if (isr == NULL || !_number(json, "segments", &s->segments) || !_number(json, "underruns", &s->underruns) ||
+        !_number(isr, "count", &count) || !_number(isr, "cycles", &cycles) || !_number(isr, "at", &at))
+        return false;
+    s->count = (uint32_t)count;
+    s->cycles = (uint32_t)cycles;
+    s->at = (uint32_t)at;
+    return true;
+}
+
+/**
+ * @brief  Uploads the file to the board's card, prints it and polls it to the end.
+ */
+static bool _runBoard(const char *path, Result *r)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    rewind(f);
+    char *body = malloc((size_t)length + 1);
+    bool read = body != NULL && fread(body, 1, (size_t)length, f) == (size_t)length;
+    fclose(f);
+    if (!read)
+    {
+        free(body);
+        return false;
+    }
+
+    static char reply[REPLY_SIZE];
+    char uri[128];
+    snprintf(uri, sizeof(uri), "/upload?name=%s", _baseName(path));
+    int code = _http("POST", uri, body, (size_t)length, reply, sizeof(reply));
+    free(body);
+    if (code != 200 || strstr(reply, "\"result\":\"ok\"") == NULL)
+    {
+        fprintf(stderr, "motionbench: %s: upload failed (%d) %s\n", path, code, reply);
+        return false;
+    }
+
+    Sample first, last;
+    if (_http("GET", "/status.json", NULL, 0, reply, sizeof(reply)) != 200 || !_sample(reply, &first))
+    {
+        fprintf(stderr, "motionbench: %s: no step counts in /status.json; firmware too old?\n", path);
+        return false;
+    }
+    snprintf(uri, sizeof(uri), "/print.cgi?start=%s", _baseName(path));
+    double started = _now();
+    if (_http("GET", uri, NULL, 0, reply, sizeof(reply)) != 200)
+        return false;
+
+    last = first;
+    char state[16] = "printing";
+    _state(reply, state, sizeof(state));
+    while (strcmp(state, "printing") == 0 || strcmp(state, "paused") == 0)
+    {
+        usleep(_pollMs * 1000U);
+        Sample now;
+        if (_http("GET", "/status.json", NULL, 0, reply, sizeof(reply)) != 200 || !_sample(reply, &now) ||
+            !_state(reply, state, sizeof(state)))
+            continue; // Busy, or a reply lost; the next one covers the gap
+        uint32_t window = now.at - last.at;
+        double load = (window > 0) ? (double)(uint32_t)(now.cycles - last.cycles) / window : 0.0;
+        if (load > r->peakLoad)
+            r->peakLoad = load;
+        last = now;
+    }
+
+    r->finished = strcmp(state, "done") == 0;
+    r->seconds = _now() - started;
+    r->segments = last.segments - first.segments;
+    r->underruns = last.underruns - first.underruns;
+    uint32_t count = last.count - first.count;
+    r->isrCycles = (count > 0) ? (double)(uint32_t)(last.cycles - first.cycles) / count : 0.0;
+    if (!r->finished)
+        fprintf(stderr, "motionbench: %s: print ended %s\n", path, state);
+    return r->finished;
+}
+
+static void _row(const char *path, const char *where, const Result *r)
+{
+    printf("%-16s %-6s %10.0f %9.1f", _baseName(path), where, r->segments,
+           (r->seconds > 0.0) ? r->segments / r->seconds : 0.0);
+    if (r->hostSeconds > 0.0)
+        printf(" %9.0f", r->segments / r->hostSeconds);
+    else
+        printf(" %9s", "-");
+    printf(" %8.2f%% %9.0f", 100.0 * r->peakLoad, r->underruns);
+    if (r->isrCycles > 0.0)
+        printf("  %.0f cycles a step interrupt", r->isrCycles);
+    if (!r->finished)
+        printf("  did not finish");
+    putchar('\n');
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *sim = "./forge_sim";
+    uint32_t cyclesPerByte = 0;
+    uint32_t isrCycles = 0;
+    bool host = true;
+    int first = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            sim = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            cyclesPerByte = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            isrCycles = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            _address = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            _pollMs = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-n") == 0)
+            host = false;
+        else
+        {
+            first = i;
+            break;
+        }
+    }
+    if (first == argc || (!host && _address == NULL) || _pollMs == 0)
+    {
+        fprintf(stderr, "usage: motionbench [-s forge_sim] [-c cycles] [-i cycles] [-a address] [-p ms] [-n] "
+                        "file.gcode...\n");
+        return 2;
+    }
+
+    printf("file             where    segments     seg/s  host s/s peak isr underruns\n");
+    bool ok = true;
+    for (int i = first; i < argc; i++)
+    {
+        if (host)
+        {
+            Result r = {0};
+            ok &= _runHost(sim, argv[i], cyclesPerByte, isrCycles, &r) && r.finished;
+            _row(argv[i], "host", &r);
+        }
+        if (_address != NULL)
+        {
+            Result r = {0};
+            ok &= _runBoard(argv[i], &r);
+            _row(argv[i], "board", &r);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,623 @@
+/**
+ * @file stepcheck.c
+ * @brief Host checker for step pulse timing: rebuilds each axis's motion from a forge_sim edge log and flags what a driver or the machine couldn't follow.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Needs nothing from the firmware. From Firmware/Include:
+ *
+ *   gcc -O2 -o stepcheck Sim/host/stepcheck.c -lm
+ *
+ *   ./forge_sim -e edges.log print.gcode && ./stepcheck edges.log
+ *
+ * Reads the edges of the x, y, z and e STEP and DIR pins, found by their
+ * "# signal" names, and checks each step against the driver's timing: STEP
+ * high and low for at least the minimum pulse width (100ns, the TMC2209's
+ * and what motion.c allows) and DIR settled for the setup time before it
+ * (20ns). A rising STEP edge moves its axis a step, up while DIR is high.
+ *
+ * Velocity is taken over windows of -w steps rather than step to step: the
+ * minor axes of a move step on Bresenham's pattern, so single intervals
+ * jump about even at a constant feed, and acceleration from them would be
+ * noise. Acceleration is the change from one window to the next. A run of
+ * steps starts and ends at rest, as motion.c ramps it, at the junction it
+ * set off from or stopped at. Without one in the log, the first step is a
+ * step's travel at constant acceleration from rest, so the rest was sqrt(2)
+ * + 1 times the next interval before it, and the last step is where it
+ * stops. A run ends on a reversal or a gap longer than -g. A reversal with
+ * no gap, as an axis turns round on a curve, is at rest at the junction in
+ * between, or else halfway between the last step one way and the first the
+ * other, for the runs either side.
+ *
+ * At a corner the planner changes each axis's velocity at once, as much as
+ * junction deviation allows for the corner speed (planner.h's
+ * PLANNER_CORNER_SPEED). Across any corner that's at most sqrt(8(sqrt(2) -
+ * 1)) times the corner speed, about 1.82 times. forge_sim notes each
+ * junction in the log, and that much of a change between two windows isn't
+ * counted as acceleration for each junction in them, in proportion to how
+ * much of the jump falls between the two: a window with a junction in it
+ * averages the speeds either side, so its neighbours each see part of the
+ * jump. Between windows with no junction, e.g. along a ramp, the whole
+ * change is acceleration. A log without junction notes gets no allowance.
+ *
+ * A minor axis steps on the major axis's events, up to one late, so a
+ * window can hold a step more or less than its time's worth. That much of
+ * each window's velocity, a step over the window's time, isn't counted
+ * either. It shrinks as the windows grow: at high speed a short window
+ * can't tell a steep ramp from that, and a larger -w can.
+ *
+ * The options, with x=,y=,z=,e= lists of any of the axes:
+ *
+ *   -v  mm/s limits, forge-motion.h's maxFeed unless given
+ *   -a  mm/s^2 limits, forge-motion.h's maxAccel unless given; 0 for none
+ *   -c  corner speed in mm/s, 5 unless given
+ *   -s  steps/mm, forge-motion.h's unless given
+ *   -p  minimum STEP high and low, ns
+ *   -d  minimum DIR setup before STEP, ns
+ *   -w  steps a velocity window, 8 unless given
+ *   -g  ms without a step that counts as stopped, 20 unless given
+ *   -o  writes each window as CSV: seconds, axis, mm, mm/s, mm/s^2
+ *   -n  prints at most this many violations, 50 unless given; all count
+ *
+ * Each violation is a stretch of one axis breaking one limit, reported with
+ * where it started, how many steps or windows it lasted and the worst value.
+ * Also prints a table of each axis's motion and timing, with the interval
+ * jitter: the RMS and largest change from one step interval to the next,
+ * which a clean generator keeps to the timer's tick outside of Bresenham's
+ * pattern. Exits 1 if anything was flagged, for CI.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AXES 4
+#define PINS (8 * 16) // Ports A to H
+#define NO_EDGE UINT64_MAX
+#define JUNCTIONS 1024 // Junctions remembered, far more than a window spans
+
+typedef enum
+{
+    CHECK_VELOCITY = 0,
+    CHECK_ACCEL,
+    CHECK_HIGH,
+    CHECK_LOW,
+    CHECK_SETUP,
+    CHECKS
+} Check;
+
+static const char _axisNames[] = "xyze";
+static const char *const _checkNames[CHECKS] = {"velocity", "acceleration", "STEP high", "STEP low", "DIR setup"};
+static const char *const _checkUnits[CHECKS] = {"mm/s", "mm/s^2", "ns", "ns", "ns"};
+
+// A stretch of one check failing, reported as it ends
+typedef struct
+{
+    bool open;
+    uint64_t since;
+    double position;
+    uint64_t count;
+    double worst;
+} Violation;
+
+typedef struct
+{
+    double stepsPerMm;
+    double maxVelocity;
+    double maxAccel; // 0 for unchecked
+    int stepPin;     // Port * 16 + pin, -1 if the log has none
+    int dirPin;
+
+    bool step;
+    bool dir;
+    uint64_t rose;
+    uint64_t fell;
+    uint64_t dirChanged;
+    int64_t position;
+
+    // The current run of steps, see the file comment
+    bool running;
+    bool runDir;
+    uint64_t lastStep;
+    uint64_t interval; // Last interval in the run, 0 before the second step
+    bool placed;       // The run started from rest at a known cycle, lastFrom
+    uint64_t windowStart;
+    uint32_t windowSteps;
+    double lastVelocity;
+    double lastFrom;   // The last window's first and last cycles, or the
+    double lastTo;     // cycle the axis was at rest at, twice
+
+    uint64_t steps;
+    double peakVelocity;
+    double peakAccel;
+    uint64_t minHigh;
+    uint64_t minLow;
+    uint64_t minSetup;
+    double jitterSquares;
+    uint64_t jitterCount;
+    uint64_t maxJitter;
+    Violation violations[CHECKS];
+} Axis;
+
+static Axis _axes[AXES];
+static int _pinAxis[PINS]; // Axis + 1 for a STEP pin, -(axis + 1) for DIR, 0 for neither
+static double _clock = 168000000.0;
+static uint64_t _minPulse;
+static uint64_t _minSetup;
+static uint32_t _window = 8;
+static uint64_t _gap;
+static double _cornerJump; // mm/s an axis may change by at once, at a corner
+static uint64_t _junctions[JUNCTIONS];
+static uint64_t _junctionCount;
+static FILE *_csv;
+static uint64_t _flagged;
+static uint64_t _printLimit = 50;
+
+static double _seconds(uint64_t cycles)
+{
+    return (double)cycles / _clock;
+}
+
+static double _ns(uint64_t cycles)
+{
+    return (double)cycles * 1e9 / _clock;
+}
+
+static double _mm(const Axis *ax)
+{
+    return (double)ax->position / ax->stepsPerMm;
+}
+
+static void _close(Axis *ax, Check check)
+{
+    Violation *v = &ax->violations[check];
+    if (!v->open)
+        return;
+    v->open = false;
+    if (_flagged++ < _printLimit)
+        printf("%.6fs  %c %-12s %10.3f %-6s at %.3fmm, %llu %s\n", _seconds(v->since), _axisNames[ax - _axes],
+               _checkNames[check], v->worst, _checkUnits[check], v->position, (unsigned long long)v->count,
+               (check <= CHECK_ACCEL) ? "windows" : "steps");
+}
+
+// Worst is the largest for the motion limits and the smallest for the timing ones
+static void _check(Axis *ax, Check check, uint64_t at, double value, bool failed)
+{
+    Violation *v = &ax->violations[check];
+    if (!failed)
+    {
+        _close(ax, check);
+        return;
+    }
+    if (!v->open)
+    {
+        v->open = true;
+        v->since = at;
+        v->position = _mm(ax);
+        v->count = 0;
+        v->worst = value;
+    }
+    v->count++;
+    if ((check <= CHECK_ACCEL) ? (value > v->worst) : (value < v->worst))
+        v->worst = value;
+}
+
+// How many corners' jumps the change from the window a to the window b can
+// hold: each junction in a counts for the part of a after it, each in b for
+// the part of b before it, and one between the two counts whole. A window
+// that's a point, at rest, takes a whole jump.
+static double _jumps(double a0, double a1, double b0, double b1)
+{
+    double jumps = 0.0;
+    for (uint64_t n = _junctionCount; n > 0 && _junctionCount - n < JUNCTIONS; n--)
+    {
+        double t = (double)_junctions[(n - 1) % JUNCTIONS];
+        if (t < a0)
+            break;
+        if (t > b1)
+            continue;
+        if (t <= a1)
+            jumps += (a1 > a0) ? (t - a0) / (a1 - a0) : 1.0;
+        else if (t < b0)
+            jumps += 1.0;
+        else
+            jumps += (b1 > b0) ? (b1 - t) / (b1 - b0) : 1.0;
+    }
+    return jumps;
+}
+
+// The junction from after to before, the last of them or else the first
+static bool _junction(uint64_t after, uint64_t before, bool last, double *at)
+{
+    bool found = false;
+    for (uint64_t n = _junctionCount; n > 0 && _junctionCount - n < JUNCTIONS; n--)
+    {
+        uint64_t t = _junctions[(n - 1) % JUNCTIONS];
+        if (t < after)
+            break;
+        if (t > before)
+            continue;
+        *at = (double)t;
+        found = true;
+        if (last)
+            break;
+    }
+    return found;
+}
+
+// The velocity over the cycles from to to, or at rest at from if they're equal
+static void _accelerate(Axis *ax, double velocity, double from, double to)
+{
+    double centre = 0.5 * (from + to);
+    double lastCentre = 0.5 * (ax->lastFrom + ax->lastTo);
+    if (centre <= lastCentre)
+        return;
+    double change = velocity - ax->lastVelocity;
+    double seconds = _seconds((uint64_t)(centre - lastCentre));
+    double signedAccel = change / seconds;
+    double accel = fabs(signedAccel);
+    if (accel > ax->peakAccel)
+        ax->peakAccel = accel;
+    // What's left once the corners in between have had their jumps, and
+    // each window its step of slack
+    double allowed = _cornerJump * _jumps(ax->lastFrom, ax->lastTo, from, to);
+    if (ax->lastTo > ax->lastFrom)
+        allowed += 1.0 / ax->stepsPerMm / _seconds((uint64_t)(ax->lastTo - ax->lastFrom));
+    if (to > from)
+        allowed += 1.0 / ax->stepsPerMm / _seconds((uint64_t)(to - from));
+    double beyond = (fabs(change) > allowed) ? (fabs(change) - allowed) / seconds : 0.0;
+    if (ax->maxAccel > 0.0)
+        _check(ax, CHECK_ACCEL, (uint64_t)centre, beyond, beyond > ax->maxAccel);
+    if (_csv != NULL)
+        fprintf(_csv, "%.7f,%c,%.4f,%.3f,%.1f\n", _seconds((uint64_t)centre), _axisNames[ax - _axes], _mm(ax),
+                velocity, signedAccel);
+    ax->lastVelocity = velocity;
+    ax->lastFrom = from;
+    ax->lastTo = to;
+}
+
+// The velocity over the steps since the window started, up to the one at end
+static void _closeWindow(Axis *ax, uint64_t end)
+{
+    if (ax->windowSteps == 0 || end <= ax->windowStart)
+        return;
+    double velocity = ax->windowSteps / ax->stepsPerMm / _seconds(end - ax->windowStart);
+    if (!ax->runDir)
+        velocity = -velocity;
+    if (fabs(velocity) > ax->peakVelocity)
+        ax->peakVelocity = fabs(velocity);
+    _check(ax, CHECK_VELOCITY, ax->windowStart, fabs(velocity), fabs(velocity) > ax->maxVelocity);
+    _accelerate(ax, velocity, (double)ax->windowStart, (double)end);
+    ax->windowStart = end;
+    ax->windowSteps = 0;
+}
+
+static void _endRun(Axis *ax, double rest)
+{
+    if (!ax->running)
+        return;
+    _closeWindow(ax, ax->lastStep);
+    _accelerate(ax, 0.0, rest, rest);
+    ax->running = false;
+}
+
+static void _stepped(Axis *ax, uint64_t at)
+{
+    if (ax->dirChanged != NO_EDGE)
+    {
+        uint64_t setup = at - ax->dirChanged;
+        if (setup < ax->minSetup)
+            ax->minSetup = setup;
+        _check(ax, CHECK_SETUP, at, _ns(setup), setup < _minSetup);
+    }
+    if (ax->fell != NO_EDGE)
+    {
+        uint64_t low = at - ax->fell;
+        if (low < ax->minLow)
+            ax->minLow = low;
+        _check(ax, CHECK_LOW, at, _ns(low), low < _minPulse);
+    }
+    ax->rose = at;
+    ax->position += ax->dir ? 1 : -1;
+    ax->steps++;
+
+    double rest = (double)at;
+    bool placed = false;
+    if (ax->running && at - ax->lastStep > _gap)
+    {
+        double stopped = (double)ax->lastStep;
+        _junction(ax->lastStep, at, false, &stopped);
+        _endRun(ax, stopped);
+        placed = _junction((uint64_t)stopped, at, true, &rest);
+    }
+    else if (ax->running && ax->dir != ax->runDir)
+    {
+        if (!_junction(ax->lastStep, at, true, &rest))
+            rest = 0.5 * ((double)ax->lastStep + (double)at);
+        placed = true;
+        _endRun(ax, rest);
+    }
+    else if (!ax->running)
+    {
+        placed = _junction(0, at, true, &rest);
+    }
+    if (!ax->running)
+    {
+        ax->running = true;
+        ax->runDir = ax->dir;
+        ax->interval = 0;
+        ax->placed = placed;
+        ax->windowStart = at;
+        ax->windowSteps = 0;
+        ax->lastVelocity = 0.0;
+        ax->lastFrom = ax->lastTo = rest;
+        ax->lastStep = at;
+        return;
+    }
+
+    uint64_t interval = at - ax->lastStep;
+    if (ax->interval == 0)
+    {
+        // Now it's known how long it took to get to the first step
+        if (!ax->placed)
+            ax->lastFrom = ax->lastTo -= (sqrt(2.0) + 1.0) * (double)interval;
+    }
+    else
+    {
+        uint64_t jitter = (interval > ax->interval) ? interval - ax->interval : ax->interval - interval;
+        ax->jitterSquares += (double)jitter * (double)jitter;
+        ax->jitterCount++;
+        if (jitter > ax->maxJitter)
+            ax->maxJitter = jitter;
+    }
+    ax->interval = interval;
+    ax->lastStep = at;
+    if (++ax->windowSteps == _window)
+        _closeWindow(ax, at);
+}
+
+static void _edge(uint64_t at, int pin, bool level)
+{
+    int which = _pinAxis[pin];
+    if (which == 0)
+        return;
+    Axis *ax = &_axes[abs(which) - 1];
+    if (which < 0)
+    {
+        if (level != ax->dir)
+            ax->dirChanged = at;
+        ax->dir = level;
+        return;
+    }
+    if (level == ax->step)
+        return;
+    ax->step = level;
+    if (level)
+    {
+        _stepped(ax, at);
+        return;
+    }
+    ax->fell = at;
+    if (ax->rose != NO_EDGE)
+    {
+        uint64_t high = at - ax->rose;
+        if (high < ax->minHigh)
+            ax->minHigh = high;
+        _check(ax, CHECK_HIGH, ax->rose, _ns(high), high < _minPulse);
+    }
+}
+
+// "P" then the port letter and pin, as sim.c writes them
+static int _pin(const char *name)
+{
+    if (name[0] != 'P' || name[1] < 'A' || name[1] > 'H')
+        return -1;
+    char *end;
+    long pin = strtol(name + 2, &end, 10);
+    if (end == name + 2 || pin < 0 || pin > 15)
+        return -1;
+    return (name[1] - 'A') * 16 + (int)pin;
+}
+
+static void _header(const char *line)
+{
+    char pinName[8];
+    char signal[32];
+    double clock;
+    if (sscanf(line, "# clock %lf", &clock) == 1 && clock > 0.0)
+    {
+        _clock = clock;
+        return;
+    }
+    if (sscanf(line, "# signal %7s %31s", pinName, signal) != 2)
+        return;
+    int pin = _pin(pinName);
+    if (pin < 0 || strlen(signal) < 3 || signal[1] != '_')
+        return;
+    for (int a = 0; a < AXES; a++)
+    {
+        if (signal[0] != _axisNames[a])
+            continue;
+        if (strcmp(signal + 2, "step") == 0)
+        {
+            _axes[a].stepPin = pin;
+            _pinAxis[pin] = a + 1;
+        }
+        else if (strcmp(signal + 2, "dir") == 0)
+        {
+            _axes[a].dirPin = pin;
+            _pinAxis[pin] = -(a + 1);
+        }
+    }
+}
+
+// "x=500,y=500", into the axes named
+static bool _axisList(const char *arg, double values[AXES])
+{
+    char copy[128];
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *item = strtok(copy, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        const char *axis = strchr(_axisNames, item[0]);
+        if (axis == NULL || item[0] == '\0' || item[1] != '=')
+            return false;
+        values[axis - _axisNames] = strtod(item + 2, NULL);
+    }
+    return true;
+}
+
+static void _summary(void)
+{
+    printf("\naxis    steps   position    peak v    peak a   high    low  setup   jitter rms/max\n");
+    printf("                    (mm)    (mm/s)  (mm/s^2)   (ns)   (ns)   (ns)             (ns)\n");
+    for (int a = 0; a < AXES; a++)
+    {
+        const Axis *ax = &_axes[a];
+        if (ax->stepPin < 0)
+        {
+            printf("%c       no STEP pin in the log\n", _axisNames[a]);
+            continue;
+        }
+        double rms = (ax->jitterCount > 0) ? sqrt(ax->jitterSquares / (double)ax->jitterCount) : 0.0;
+        printf("%c  %10llu %10.3f %9.2f %9.0f", _axisNames[a], (unsigned long long)ax->steps, _mm(ax), ax->peakVelocity,
+               ax->peakAccel);
+        const uint64_t mins[3] = {ax->minHigh, ax->minLow, ax->minSetup};
+        for (int m = 0; m < 3; m++)
+        {
+            if (mins[m] == UINT64_MAX)
+                printf("      -");
+            else
+                printf(" %6.0f", _ns(mins[m]));
+        }
+        printf(" %8.0f/%-8.0f\n", _ns((uint64_t)rms), _ns(ax->maxJitter));
+    }
+    if (_flagged > _printLimit)
+        printf("\n%llu more not shown\n", (unsigned long long)(_flagged - _printLimit));
+    printf("\n%llu violation%s\n", (unsigned long long)_flagged, (_flagged == 1) ? "" : "s");
+}
+
+int main(int argc, char **argv)
+{
+    // forge-motion.h's machine
+    double stepsPerMm[AXES] = {80.0, 80.0, 400.0, 93.0};
+    double maxVelocity[AXES] = {500.0, 500.0, 5.0, 60.0};
+    double maxAccel[AXES] = {6000.0, 6000.0, 100.0, 6000.0};
+    double corner = 5.0;
+    double pulseNs = 100.0;
+    double setupNs = 20.0;
+    double gapMs = 20.0;
+    const char *path = NULL;
+    const char *csv = NULL;
+    bool ok = true;
+
+    for (int i = 1; i < argc && ok; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+            ok = _axisList(argv[++i], maxVelocity);
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            ok = _axisList(argv[++i], maxAccel);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            corner = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            ok = _axisList(argv[++i], stepsPerMm);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            pulseNs = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            setupNs = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            _window = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            gapMs = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            csv = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            _printLimit = strtoull(argv[++i], NULL, 0);
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+            ok = false;
+        else
+            path = argv[i];
+    }
+    if (!ok || path == NULL || _window == 0)
+    {
+        fprintf(stderr, "usage: stepcheck [-v x=mm/s,...] [-a x=mm/s^2,...] [-c mm/s] [-s x=steps/mm,...] [-p ns] [-d ns] "
+                        "[-w steps] [-g ms] [-o windows.csv] [-n count] edges.log\n");
+        return 2;
+    }
+    FILE *in = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (in == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    if (csv != NULL)
+    {
+        if ((_csv = fopen(csv, "w")) == NULL)
+        {
+            perror(csv);
+            return 2;
+        }
+        fprintf(_csv, "seconds,axis,position_mm,velocity_mm_s,accel_mm_s2\n");
+    }
+
+    for (int a = 0; a < AXES; a++)
+    {
+        Axis *ax = &_axes[a];
+        ax->stepsPerMm = stepsPerMm[a];
+        ax->maxVelocity = maxVelocity[a];
+        ax->maxAccel = maxAccel[a];
+        ax->stepPin = ax->dirPin = -1;
+        ax->rose = ax->fell = ax->dirChanged = NO_EDGE;
+        ax->minHigh = ax->minLow = ax->minSetup = UINT64_MAX;
+    }
+
+    // The header comes before the first edge, so the clock is known by then
+    bool timed = false;
+    char line[128];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        if (line[0] == '#')
+        {
+            _header(line);
+            continue;
+        }
+        if (!timed)
+        {
+            _minPulse = (uint64_t)ceil(pulseNs * _clock / 1e9);
+            _minSetup = (uint64_t)ceil(setupNs * _clock / 1e9);
+            _gap = (uint64_t)(gapMs * _clock / 1e3);
+            _cornerJump = corner * sqrt(8.0 * (sqrt(2.0) - 1.0));
+            timed = true;
+        }
+        unsigned long long at;
+        char pinName[16];
+        int level;
+        int fields = sscanf(line, "%llu %15s %d", &at, pinName, &level);
+        if (fields == 2 && strcmp(pinName, "junction") == 0)
+            _junctions[_junctionCount++ % JUNCTIONS] = at;
+        if (fields != 3)
+            continue;
+        int pin = _pin(pinName);
+        if (pin >= 0)
+            _edge(at, pin, level != 0);
+    }
+    if (in != stdin)
+        fclose(in);
+
+    for (int a = 0; a < AXES; a++)
+    {
+        _endRun(&_axes[a], (double)_axes[a].lastStep);
+        for (int c = 0; c < CHECKS; c++)
+        {
+            _close(&_axes[a], (Check)c);
+        }
+    }
+    if (_csv != NULL)
+        fclose(_csv);
+    _summary();
+    return (_flagged > 0) ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file portmacro.h
+ * @brief The FreeRTOS port of the sim build, found ahead of GCC/ARM_CM4F. There's no port.c: sim_rtos.c implements the kernel calls the firmware makes.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define portCHAR char
+#define portFLOAT float
+#define portDOUBLE double
+#define portLONG long
+#define portSHORT short
+#define portSTACK_TYPE uint32_t
+#define portBASE_TYPE long
+#define portPOINTER_SIZE_TYPE uintptr_t
+
+    typedef portSTACK_TYPE StackType_t;
+    typedef long BaseType_t;
+    typedef unsigned long UBaseType_t;
+    typedef uint32_t TickType_t;
+
+#define portMAX_DELAY (TickType_t)0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC 1
+#define portSTACK_GROWTH (-1)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portBYTE_ALIGNMENT 8
+
+    // A task runs until it blocks, so there's nothing to switch to early
+    void vPortYield(void);
+    void vPortEnterCritical(void);
+    void vPortExitCritical(void);
+    uint32_t ulPortRaiseBASEPRI(void);
+    void vPortSetBASEPRI(uint32_t basepri);
+
+#define portYIELD() vPortYield()
+#define portEND_SWITCHING_ISR(xSwitchRequired) ((void)(xSwitchRequired))
+#define portYIELD_FROM_ISR(x) portEND_SWITCHING_ISR(x)
+#define portSET_INTERRUPT_MASK_FROM_ISR() ulPortRaiseBASEPRI()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x) vPortSetBASEPRI(x)
+#define portDISABLE_INTERRUPTS() ((void)ulPortRaiseBASEPRI())
+#define portENABLE_INTERRUPTS() vPortSetBASEPRI(0)
+#define portENTER_CRITICAL() vPortEnterCritical()
+#define portEXIT_CRITICAL() vPortExitCritical()
+
+#define portTASK_FUNCTION_PROTO(vFunction, pvParameters) void vFunction(void *pvParameters)
+#define portTASK_FUNCTION(vFunction, pvParameters) void vFunction(void *pvParameters)
+
+#define portNOP()
+#define portINLINE __inline
+#define portFORCE_INLINE inline __attribute__((always_inline))
+#define portMEMORY_BARRIER() __sync_synchronize()
+
+    bool simInIsr(void);
+
+    portFORCE_INLINE static BaseType_t xPortIsInsideInterrupt(void)
+    {
+        return simInIsr() ? 1 : 0;
+    }
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* PORTMACRO_H */
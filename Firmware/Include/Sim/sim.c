@@ -0,0 +1,634 @@
+/**
+ * @file sim.c
+ * @brief The simulated MCU: the virtual clock, the NVIC, the timers and SysTick, the pins and their edge log, and the ADC's DMA.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Nothing here runs on its own. The kernel (sim_rtos.c) asks for the next
+ * event and runs the clock to it; code that burns cycles (__NOP) runs it
+ * forward too. At each step the timers are brought up to date from their
+ * registers, whatever is due fires, and pending interrupts are taken in
+ * priority order, each able to preempt a less urgent one that is running.
+ *
+ * The firmware writes the registers as it would on the chip, and the sim
+ * only looks at them here, so a timer is reconciled with its CNT, ARR and
+ * CR1 each time: a CNT that isn't what the sim last left there was written,
+ * and restarts the count from the new value. The update event comes when
+ * the count passes ARR, as with ARPE clear.
+ *
+ * A pin's level is its output data while it's an output, and what the sim
+ * drives onto it (simGpioDrive) while it's an input. Every change of level
+ * goes to the edge log, one line each:
+ *
+ *   # forge_sim edges
+ *   # clock <core Hz>
+ *   # signal <pin> <name>          once for each pin simGpioName named
+ *   <cycle> <pin> <0|1>
+ *   <cycle> <note>                 from simEdgeNote, e.g. junction
+ *
+ * with pins written as PA7, and cycles counted from reset.
+ */
+
+#include "sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+GPIO_TypeDef simGPIO[SIM_GPIO_PORTS];
+TIM_TypeDef simTIM[SIM_TIMERS];
+ADC_TypeDef simADC[3];
+ADC_Common_TypeDef simADCCommon;
+DMA_TypeDef simDMA[2];
+DMA_Stream_TypeDef simDMAStream[2][8];
+SPI_TypeDef simSPI[3];
+RCC_TypeDef simRCC;
+PWR_TypeDef simPWR;
+FLASH_TypeDef simFLASH;
+DBGMCU_TypeDef simDBGMCU;
+SCB_Type simSCB;
+SysTick_Type simSysTick;
+ITM_Type simITM;
+DWT_Type simDWT;
+TPI_Type simTPI;
+CoreDebug_Type simCoreDebug;
+
+uint64_t simNow = 0;
+
+typedef struct
+{
+    SimHandler handler;
+    bool enabled;
+    bool pending;
+    bool active;
+    uint8_t priority;
+    uint32_t taken;
+    uint64_t hostNs; // Spent in the handler on the host, nested ones included
+} SimIrq;
+
+typedef struct
+{
+    uint64_t origin; // Cycle at which the count was 0
+    uint32_t seenCnt;
+    bool counting;
+} SimTimer;
+
+static SimIrq _irqs[SIM_IRQS];
+static uint32_t _primask = 0;
+static uint32_t _basepri = 0;   // As the register holds it, in the top bits of a byte; 0 masks nothing
+static uint8_t _depth = 0;      // Handlers running, nested
+static uint16_t _level = 0x100; // Priority of the innermost; above any while in thread mode
+
+static SimTimer _timers[SIM_TIMERS];
+// The update interrupt of each timer; 0 for those the sim doesn't give one
+static const int16_t _timerIrqs[SIM_TIMERS] = {
+    0, TIM1_UP_TIM10_IRQn, TIM2_IRQn, TIM3_IRQn, TIM4_IRQn, TIM5_IRQn, TIM6_DAC_IRQn, TIM7_IRQn,
+    TIM8_UP_TIM13_IRQn, 0, TIM1_UP_TIM10_IRQn, 0, 0, TIM8_UP_TIM13_IRQn, 0};
+
+static uint64_t _tickPeriod = 0; // 0 until SysTick is started
+static uint64_t _tickNext = 0;
+
+static uint32_t _cyccntSeen = 0;
+static uint64_t _cyccntOrigin = 0;
+
+static uint16_t _driven[SIM_GPIO_PORTS]; // Levels the sim puts on input pins
+static const char *_names[SIM_GPIO_PORTS][16];
+static SimPinWatch _watches[SIM_GPIO_PORTS][16];
+static FILE *_edgeFile = NULL;
+static uint64_t _edgeCount = 0;
+
+typedef struct
+{
+    uint32_t *target;
+    uint32_t length;
+} SimAdcDma;
+
+static SimAdcDma _adcDma[3];
+
+static uint64_t _hostNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief  Keeps the cycle counter in step with the clock while it's enabled. A value the firmware wrote, e.g. forgeStartScheduler zeroing it, is counted on from.
+ */
+static void _syncCyccnt(void)
+{
+    if (!(simDWT.CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        _cyccntOrigin = simNow - simDWT.CYCCNT;
+        _cyccntSeen = simDWT.CYCCNT;
+        return;
+    }
+    if (simDWT.CYCCNT != _cyccntSeen)
+        _cyccntOrigin = simNow - simDWT.CYCCNT;
+    _cyccntSeen = (uint32_t)(simNow - _cyccntOrigin);
+    simDWT.CYCCNT = _cyccntSeen;
+}
+
+/**
+ * @brief  Returns the clock a timer counts, in Hz: twice its APB's whenever that APB is divided.
+ * @headerfile sim.h
+ */
+uint32_t simTimerClock(const TIM_TypeDef *tim)
+{
+    uint32_t n = (uint32_t)(tim - simTIM);
+    bool apb2 = (n == 1 || n == 8 || n == 9 || n == 10 || n == 11);
+    uint32_t pclk = apb2 ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    uint32_t ppre = apb2 ? (simRCC.CFGR & RCC_CFGR_PPRE2) : (simRCC.CFGR & RCC_CFGR_PPRE1);
+    return (ppre != 0) ? pclk * 2U : pclk;
+}
+
+static uint64_t _timerTick(uint32_t n)
+{
+    return (uint64_t)(simTIM[n].PSC + 1U) * SIM_CORE_HZ / simTimerClock(&simTIM[n]);
+}
+
+static void _syncTimer(uint32_t n)
+{
+    TIM_TypeDef *tim = &simTIM[n];
+    SimTimer *t = &_timers[n];
+    if (!(tim->CR1 & TIM_CR1_CEN))
+    {
+        t->counting = false;
+        t->seenCnt = tim->CNT;
+        return;
+    }
+    uint64_t tick = _timerTick(n);
+    if (!t->counting || tim->CNT != t->seenCnt)
+    {
+        t->origin = simNow - (uint64_t)tim->CNT * tick;
+        t->seenCnt = tim->CNT;
+        t->counting = true;
+    }
+    uint32_t count = (uint32_t)((simNow - t->origin) / tick);
+    // Counting up through ARR updates it then, whether or not the clock got
+    // here by _fireDue: an interrupt's entry or a masked simCycles can run
+    // past it, and the count must never be taken for one left above ARR
+    if (t->seenCnt <= tim->ARR && count > tim->ARR)
+    {
+        uint64_t periods = count / (tim->ARR + 1U);
+        t->origin += periods * (tim->ARR + 1U) * tick;
+        count = (uint32_t)((simNow - t->origin) / tick);
+        tim->SR |= TIM_SR_UIF;
+        if ((tim->DIER & TIM_DIER_UIE) && _timerIrqs[n] != 0)
+            _irqs[16 + _timerIrqs[n]].pending = true;
+    }
+    t->seenCnt = count;
+    tim->CNT = t->seenCnt;
+}
+
+/**
+ * @brief  Returns when a running timer with its update interrupt enabled next updates, or UINT64_MAX.
+ */
+static uint64_t _timerDue(uint32_t n)
+{
+    TIM_TypeDef *tim = &simTIM[n];
+    if (!_timers[n].counting || !(tim->DIER & TIM_DIER_UIE) || _timerIrqs[n] == 0)
+        return UINT64_MAX;
+    uint64_t tick = _timerTick(n);
+    uint64_t due = _timers[n].origin + (uint64_t)(tim->ARR + 1U) * tick;
+    // ARR set below the count: it runs on to the top and wraps first
+    if (_timers[n].seenCnt > tim->ARR)
+        due = _timers[n].origin + 0x10000ULL * tick;
+    return due;
+}
+
+static void _syncAll(void)
+{
+    for (uint32_t n = 1; n < SIM_TIMERS; n++)
+    {
+        _syncTimer(n);
+    }
+    _syncCyccnt();
+}
+
+/**
+ * @brief  Returns the cycle of the next thing the MCU does on its own: a timer update or a tick. UINT64_MAX if nothing is running.
+ * @headerfile sim.h
+ */
+uint64_t simNextEvent(void)
+{
+    _syncAll();
+    uint64_t next = (_tickPeriod != 0) ? _tickNext : UINT64_MAX;
+    for (uint32_t n = 1; n < SIM_TIMERS; n++)
+    {
+        uint64_t due = _timerDue(n);
+        if (due < next)
+            next = due;
+    }
+    return next;
+}
+
+static void _adcConvert(uint32_t i)
+{
+    ADC_TypeDef *adc = &simADC[i];
+    SimAdcDma *dma = &_adcDma[i];
+    if (dma->target == NULL)
+        return;
+    // Regular ranks 1 to 6 are in SQR3, 5 bits each; enough for the firmware
+    for (uint32_t k = 0; k < dma->length && k < 6; k++)
+    {
+        uint16_t value = simAdcInput((adc->SQR3 >> (5U * k)) & 0x1FU);
+        adc->DR = value;
+        dma->target[k] = value;
+    }
+}
+
+static void _fireDue(void)
+{
+    if (_tickPeriod != 0 && _tickNext <= simNow)
+    {
+        _tickNext += _tickPeriod;
+        simMillisecond();
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            _adcConvert(i);
+        }
+        _irqs[16 + SysTick_IRQn].pending = true;
+    }
+    for (uint32_t n = 1; n < SIM_TIMERS; n++)
+    {
+        uint64_t due = _timerDue(n);
+        if (due > simNow)
+            continue;
+        TIM_TypeDef *tim = &simTIM[n];
+        tim->SR |= TIM_SR_UIF;
+        tim->CNT = 0;
+        _timers[n].seenCnt = 0;
+        _timers[n].origin = due;
+        _irqs[16 + _timerIrqs[n]].pending = true;
+    }
+}
+
+static void _take(uint32_t i)
+{
+    SimIrq *irq = &_irqs[i];
+    irq->pending = false;
+    irq->active = true;
+    uint16_t level = _level;
+    _level = irq->priority;
+    _depth++;
+    simNow += SIM_IRQ_ENTRY_CYCLES;
+    _syncAll();
+
+    uint64_t start = _hostNs();
+    irq->handler();
+    irq->hostNs += _hostNs() - start;
+    irq->taken++;
+
+    _depth--;
+    _level = level;
+    irq->active = false;
+}
+
+/**
+ * @brief  Takes every pending interrupt that is enabled and more urgent than what's running, most urgent first, then the lowest number. Nothing is taken while PRIMASK is set.
+ * @headerfile sim.h
+ */
+void simServiceIrqs(void)
+{
+    while (_primask == 0)
+    {
+        int32_t best = -1;
+        for (uint32_t i = 0; i < SIM_IRQS; i++)
+        {
+            SimIrq *irq = &_irqs[i];
+            if (!irq->pending || !irq->enabled || irq->handler == NULL || irq->priority >= _level)
+                continue;
+            if (_basepri != 0 && ((uint32_t)irq->priority << (8U - __NVIC_PRIO_BITS)) >= _basepri)
+                continue;
+            if (best < 0 || irq->priority < _irqs[best].priority)
+                best = (int32_t)i;
+        }
+        if (best < 0)
+            return;
+        _take((uint32_t)best);
+    }
+}
+
+/**
+ * @brief  Runs the clock to a cycle, firing what falls due on the way and taking the interrupts that raises. The clock never goes back: an event already overdue fires now.
+ * @headerfile sim.h
+ */
+void simRunTo(uint64_t cycles)
+{
+    for (;;)
+    {
+        uint64_t next = simNextEvent();
+        if (next > cycles)
+            break;
+        if (next > simNow)
+            simNow = next;
+        _fireDue();
+        simServiceIrqs();
+    }
+    if (cycles > simNow)
+        simNow = cycles;
+    _syncAll();
+    simServiceIrqs();
+}
+
+/**
+ * @brief  Spends cycles on the core, as __NOP does. Interrupts that fall due in thread mode, or that are more urgent than the running handler, are taken on the spot, at the cycle they fall due; the time they take isn't spent on the work, which finishes that much later.
+ * @headerfile sim.h
+ */
+void simCycles(uint32_t cycles)
+{
+    uint64_t left = cycles;
+    while (_primask == 0)
+    {
+        uint64_t next = simNextEvent();
+        if (next >= simNow + left)
+            break;
+        if (next > simNow)
+        {
+            left -= next - simNow;
+            simNow = next;
+        }
+        _fireDue();
+        simServiceIrqs();
+    }
+    simNow += left;
+    if (_primask == 0)
+        simRunTo(simNow);
+}
+
+uint32_t simGetPrimask(void)
+{
+    return _primask;
+}
+
+void simSetPrimask(uint32_t primask)
+{
+    _primask = primask & 1U;
+    if (_primask == 0)
+        simServiceIrqs();
+}
+
+uint32_t simGetBasepri(void)
+{
+    return _basepri;
+}
+
+void simSetBasepri(uint32_t basepri)
+{
+    _basepri = basepri & 0xFFU;
+    if (_primask == 0)
+        simServiceIrqs();
+}
+
+bool simInIsr(void)
+{
+    return _depth > 0;
+}
+
+/**
+ * @brief  Installs an interrupt handler, as the vector table would.
+ * @headerfile sim.h
+ */
+void simVector(IRQn_Type irq, SimHandler handler)
+{
+    _irqs[16 + irq].handler = handler;
+}
+
+uint32_t simIrqTaken(IRQn_Type irq)
+{
+    return _irqs[16 + irq].taken;
+}
+
+uint64_t simIrqHostNs(IRQn_Type irq)
+{
+    return _irqs[16 + irq].hostNs;
+}
+
+/**
+ * @brief  Starts SysTick, whose exception is the lowest priority, as HAL_InitTick sets it.
+ * @headerfile sim.h
+ */
+void simSysTickStart(uint32_t hz)
+{
+    _tickPeriod = SIM_CORE_HZ / hz;
+    _tickNext = simNow + _tickPeriod;
+    simSysTick.LOAD = (uint32_t)_tickPeriod - 1U;
+    simSysTick.CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+    _irqs[16 + SysTick_IRQn].enabled = true;
+    _irqs[16 + SysTick_IRQn].priority = 15;
+}
+
+void simNvicSetPriorityGrouping(uint32_t group)
+{
+    simSCB.AIRCR = (simSCB.AIRCR & ~SCB_AIRCR_PRIGROUP_Msk) | ((group & 7U) << SCB_AIRCR_PRIGROUP_Pos);
+}
+
+uint32_t simNvicGetPriorityGrouping(void)
+{
+    return (simSCB.AIRCR & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+}
+
+void simNvicEnableIRQ(IRQn_Type irq)
+{
+    _irqs[16 + irq].enabled = true;
+    simServiceIrqs();
+}
+
+uint32_t simNvicGetEnableIRQ(IRQn_Type irq)
+{
+    return _irqs[16 + irq].enabled ? 1U : 0U;
+}
+
+void simNvicDisableIRQ(IRQn_Type irq)
+{
+    _irqs[16 + irq].enabled = false;
+}
+
+uint32_t simNvicGetPendingIRQ(IRQn_Type irq)
+{
+    return _irqs[16 + irq].pending ? 1U : 0U;
+}
+
+void simNvicSetPendingIRQ(IRQn_Type irq)
+{
+    _irqs[16 + irq].pending = true;
+    simServiceIrqs();
+}
+
+void simNvicClearPendingIRQ(IRQn_Type irq)
+{
+    _irqs[16 + irq].pending = false;
+}
+
+uint32_t simNvicGetActive(IRQn_Type irq)
+{
+    return _irqs[16 + irq].active ? 1U : 0U;
+}
+
+// Priorities as the NVIC holds them, in the top __NVIC_PRIO_BITS of a byte
+void simNvicSetPriority(IRQn_Type irq, uint32_t priority)
+{
+    _irqs[16 + irq].priority = (uint8_t)(priority & ((1U << __NVIC_PRIO_BITS) - 1U));
+}
+
+uint32_t simNvicGetPriority(IRQn_Type irq)
+{
+    return _irqs[16 + irq].priority;
+}
+
+void simNvicSystemReset(void)
+{
+    fprintf(stderr, "forge_sim: system reset at cycle %llu\n", (unsigned long long)simNow);
+    exit(1);
+}
+
+static uint32_t _portIndex(const GPIO_TypeDef *port)
+{
+    return (uint32_t)(port - simGPIO);
+}
+
+/**
+ * @brief  Works out a port's pin levels from its mode, output data and what the sim drives, and logs each that changed.
+ */
+static void _refresh(GPIO_TypeDef *port)
+{
+    uint32_t n = _portIndex(port);
+    uint32_t before = port->IDR;
+    uint32_t level = 0;
+    for (uint32_t pin = 0; pin < 16; pin++)
+    {
+        uint32_t mode = (port->MODER >> (2U * pin)) & 3U;
+        uint32_t bit = 1U << pin;
+        // Outputs and alternate functions drive the pin; the sim drives the rest
+        bool high = (mode == 1U || mode == 2U) ? (port->ODR & bit) != 0 : (_driven[n] & bit) != 0;
+        if (high)
+            level |= bit;
+    }
+    port->IDR = level;
+
+    uint32_t changed = before ^ level;
+    while (changed != 0)
+    {
+        uint32_t pin = (uint32_t)__builtin_ctz(changed);
+        changed &= changed - 1U;
+        bool high = (level >> pin) & 1U;
+        _edgeCount++;
+        if (_edgeFile != NULL)
+            fprintf(_edgeFile, "%llu P%c%lu %d\n", (unsigned long long)simNow, (char)('A' + n), (unsigned long)pin, high);
+        if (_watches[n][pin] != NULL)
+            _watches[n][pin](port, 1U << pin, high);
+    }
+}
+
+/**
+ * @brief  A write to a port's BSRR: set bits in the low half, reset in the high, set winning where both are given.
+ * @headerfile sim.h
+ */
+void simGpioBsrr(GPIO_TypeDef *port, uint32_t bits)
+{
+    uint32_t set = bits & 0xFFFFU;
+    uint32_t reset = (bits >> 16) & ~set;
+    port->ODR = (port->ODR | set) & ~reset;
+    _refresh(port);
+}
+
+/**
+ * @brief  Puts a level on input pins, e.g. a driver's DIAG output.
+ * @headerfile sim.h
+ */
+void simGpioDrive(GPIO_TypeDef *port, uint32_t pin, bool level)
+{
+    uint32_t n = _portIndex(port);
+    if (level)
+        _driven[n] |= (uint16_t)pin;
+    else
+        _driven[n] &= (uint16_t)~pin;
+    _refresh(port);
+}
+
+/**
+ * @brief  Called once a port's mode or output data has been written other than through BSRR.
+ * @headerfile sim.h
+ */
+void simGpioConfigured(GPIO_TypeDef *port)
+{
+    _refresh(port);
+}
+
+/**
+ * @brief  Calls watch on every change of level of a pin.
+ * @headerfile sim.h
+ */
+void simGpioWatch(GPIO_TypeDef *port, uint32_t pin, SimPinWatch watch)
+{
+    _watches[_portIndex(port)][__builtin_ctz(pin)] = watch;
+}
+
+/**
+ * @brief  Names a pin in the edge log's header. Name pins before opening the log.
+ * @headerfile sim.h
+ */
+void simGpioName(GPIO_TypeDef *port, uint32_t pin, const char *name)
+{
+    _names[_portIndex(port)][__builtin_ctz(pin)] = name;
+}
+
+/**
+ * @brief  Starts logging every pin edge to a file, after a header with the clock and the named pins.
+ * @retval false if the file can't be opened.
+ * @headerfile sim.h
+ */
+bool simEdgeLog(const char *path)
+{
+    _edgeFile = fopen(path, "w");
+    if (_edgeFile == NULL)
+        return false;
+    static char buffer[1 << 16];
+    setvbuf(_edgeFile, buffer, _IOFBF, sizeof(buffer));
+    fprintf(_edgeFile, "# forge_sim edges\n# clock %u\n", SIM_CORE_HZ);
+    for (uint32_t n = 0; n < SIM_GPIO_PORTS; n++)
+    {
+        for (uint32_t pin = 0; pin < 16; pin++)
+        {
+            if (_names[n][pin] != NULL)
+                fprintf(_edgeFile, "# signal P%c%lu %s\n", (char)('A' + n), (unsigned long)pin, _names[n][pin]);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief  Writes a line of its own into the edge log at the current cycle, e.g. to mark where a segment ended. A note is one word that isn't a pin.
+ * @headerfile sim.h
+ */
+void simEdgeNote(const char *note)
+{
+    if (_edgeFile != NULL)
+        fprintf(_edgeFile, "%llu %s\n", (unsigned long long)simNow, note);
+}
+
+uint64_t simEdges(void)
+{
+    if (_edgeFile != NULL)
+        fflush(_edgeFile);
+    return _edgeCount;
+}
+
+/**
+ * @brief  Points an ADC's DMA at a buffer, as HAL_ADC_Start_DMA does. The sim converts the regular ranks into it at once and then every millisecond, which is as continuous as anything reading it can tell.
+ * @headerfile sim.h
+ */
+void simAdcStart(ADC_TypeDef *adc, uint32_t *target, uint32_t length)
+{
+    uint32_t i = (uint32_t)(adc - simADC);
+    _adcDma[i].target = target;
+    _adcDma[i].length = length;
+    _adcConvert(i);
+}
+
+void simAdcStop(ADC_TypeDef *adc)
+{
+    _adcDma[adc - simADC].target = NULL;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file sim.h
+ * @brief The simulated MCU forge_sim runs the firmware on: a virtual clock, the peripherals as memory on the host, and the core's intrinsics. Force-included ahead of every file of the sim build.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * The firmware's sources are compiled as they are. The device header is
+ * read here first, so every peripheral macro (GPIOA, TIM7, ITM...) can be
+ * pointed at a struct in host memory before any firmware file uses one, and
+ * the intrinsics a file calls after that are the sim's. The HAL calls the
+ * modules make are implemented in sim_hal.c, the FreeRTOS ones in
+ * sim_rtos.c.
+ *
+ * Time is counted in core cycles at SIM_CORE_HZ. Code takes none of it,
+ * except where the firmware burns cycles on purpose: each __NOP() is one,
+ * and taking an interrupt costs SIM_IRQ_ENTRY_CYCLES. A step pulse is as
+ * wide as the firmware makes it, and an interrupt that is late is late by
+ * what held it off. Everything else happens when the timers, the tick and
+ * the tasks' timeouts say, in the same order on every run.
+ */
+
+#ifndef __FORGE_SIM_H
+#define __FORGE_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// core_cm4.h routes the NVIC calls to the sim instead (cmsis_nvic_virtual.h)
+#define CMSIS_NVIC_VIRTUAL
+
+#include "../Device/stm32f4xx.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SIM_CORE_HZ 168000000U
+// Stacking and fetching the vector on a Cortex-M4 with no wait states
+#define SIM_IRQ_ENTRY_CYCLES 12U
+#define SIM_GPIO_PORTS 9   // A to I
+#define SIM_TIMERS 15      // Indexed by timer number; 0 is unused
+#define SIM_IRQS (16 + 82) // The core's exceptions, then the F405's interrupts
+// Host stack of each task; the firmware's own stack arrays go unused
+#define SIM_TASK_STACK (256U * 1024U)
+
+    // The peripherals, in host memory
+    extern GPIO_TypeDef simGPIO[SIM_GPIO_PORTS];
+    extern TIM_TypeDef simTIM[SIM_TIMERS];
+    extern ADC_TypeDef simADC[3];
+    extern ADC_Common_TypeDef simADCCommon;
+    extern DMA_TypeDef simDMA[2];
+    extern DMA_Stream_TypeDef simDMAStream[2][8];
+    extern SPI_TypeDef simSPI[3];
+    extern RCC_TypeDef simRCC;
+    extern PWR_TypeDef simPWR;
+    extern FLASH_TypeDef simFLASH;
+    extern DBGMCU_TypeDef simDBGMCU;
+    extern SCB_Type simSCB;
+    extern SysTick_Type simSysTick;
+    extern ITM_Type simITM;
+    extern DWT_Type simDWT;
+    extern TPI_Type simTPI;
+    extern CoreDebug_Type simCoreDebug;
+
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef GPIOD
+#undef GPIOE
+#undef GPIOF
+#undef GPIOG
+#undef GPIOH
+#undef GPIOI
+#define GPIOA (&simGPIO[0])
+#define GPIOB (&simGPIO[1])
+#define GPIOC (&simGPIO[2])
+#define GPIOD (&simGPIO[3])
+#define GPIOE (&simGPIO[4])
+#define GPIOF (&simGPIO[5])
+#define GPIOG (&simGPIO[6])
+#define GPIOH (&simGPIO[7])
+#define GPIOI (&simGPIO[8])
+
+#undef TIM1
+#undef TIM2
+#undef TIM3
+#undef TIM4
+#undef TIM5
+#undef TIM6
+#undef TIM7
+#undef TIM8
+#undef TIM9
+#undef TIM10
+#undef TIM11
+#undef TIM12
+#undef TIM13
+#undef TIM14
+#define TIM1 (&simTIM[1])
+#define TIM2 (&simTIM[2])
+#define TIM3 (&simTIM[3])
+#define TIM4 (&simTIM[4])
+#define TIM5 (&simTIM[5])
+#define TIM6 (&simTIM[6])
+#define TIM7 (&simTIM[7])
+#define TIM8 (&simTIM[8])
+#define TIM9 (&simTIM[9])
+#define TIM10 (&simTIM[10])
+#define TIM11 (&simTIM[11])
+#define TIM12 (&simTIM[12])
+#define TIM13 (&simTIM[13])
+#define TIM14 (&simTIM[14])
+
+#undef ADC1
+#undef ADC2
+#undef ADC3
+#undef ADC123_COMMON
+#define ADC1 (&simADC[0])
+#define ADC2 (&simADC[1])
+#define ADC3 (&simADC[2])
+#define ADC123_COMMON (&simADCCommon)
+
+#undef DMA1
+#undef DMA2
+#undef DMA1_Stream0
+#undef DMA1_Stream1
+#undef DMA1_Stream2
+#undef DMA1_Stream3
+#undef DMA1_Stream4
+#undef DMA1_Stream5
+#undef DMA1_Stream6
+#undef DMA1_Stream7
+#undef DMA2_Stream0
+#undef DMA2_Stream1
+#undef DMA2_Stream2
+#undef DMA2_Stream3
+#undef DMA2_Stream4
+#undef DMA2_Stream5
+#undef DMA2_Stream6
+#undef DMA2_Stream7
+#define DMA1 (&simDMA[0])
+#define DMA2 (&simDMA[1])
+#define DMA1_Stream0 (&simDMAStream[0][0])
+#define DMA1_Stream1 (&simDMAStream[0][1])
+#define DMA1_Stream2 (&simDMAStream[0][2])
+#define DMA1_Stream3 (&simDMAStream[0][3])
+#define DMA1_Stream4 (&simDMAStream[0][4])
+#define DMA1_Stream5 (&simDMAStream[0][5])
+#define DMA1_Stream6 (&simDMAStream[0][6])
+#define DMA1_Stream7 (&simDMAStream[0][7])
+#define DMA2_Stream0 (&simDMAStream[1][0])
+#define DMA2_Stream1 (&simDMAStream[1][1])
+#define DMA2_Stream2 (&simDMAStream[1][2])
+#define DMA2_Stream3 (&simDMAStream[1][3])
+#define DMA2_Stream4 (&simDMAStream[1][4])
+#define DMA2_Stream5 (&simDMAStream[1][5])
+#define DMA2_Stream6 (&simDMAStream[1][6])
+#define DMA2_Stream7 (&simDMAStream[1][7])
+
+#undef SPI1
+#undef SPI2
+#undef SPI3
+#define SPI1 (&simSPI[0])
+#define SPI2 (&simSPI[1])
+#define SPI3 (&simSPI[2])
+
+#undef RCC
+#undef PWR
+#undef FLASH
+#undef DBGMCU
+#define RCC (&simRCC)
+#define PWR (&simPWR)
+#define FLASH (&simFLASH)
+#define DBGMCU (&simDBGMCU)
+
+#undef SCB
+#undef SysTick
+#undef ITM
+#undef DWT
+#undef TPI
+#undef CoreDebug
+#define SCB (&simSCB)
+#define SysTick (&simSysTick)
+#define ITM (&simITM)
+#define DWT (&simDWT)
+#define TPI (&simTPI)
+#define CoreDebug (&simCoreDebug)
+
+    // The core, as far as the firmware can tell
+    extern uint64_t simNow; // Core cycles since reset
+
+    void simCycles(uint32_t cycles);
+    uint32_t simGetPrimask(void);
+    void simSetPrimask(uint32_t primask);
+    uint32_t simGetBasepri(void);
+    void simSetBasepri(uint32_t basepri);
+    bool simInIsr(void);
+
+#undef __NOP
+#define __NOP() simCycles(1U)
+#undef __WFI
+#define __WFI() ((void)0)
+#undef __WFE
+#define __WFE() ((void)0)
+#undef __BKPT
+#define __BKPT(value) __builtin_trap()
+#define __disable_irq() simSetPrimask(1U)
+#define __enable_irq() simSetPrimask(0U)
+#define __get_PRIMASK() simGetPrimask()
+#define __set_PRIMASK(primask) simSetPrimask(primask)
+#define __DMB() __sync_synchronize()
+#define __DSB() __sync_synchronize()
+#define __ISB() __sync_synchronize()
+
+// Every BSRR write goes through the sim, so two pins of a port changing in
+// the same write are both seen (Core/forge.h)
+#define FORGE_BSRR(port, bits) simGpioBsrr((port), (bits))
+
+    typedef void (*SimHandler)(void);
+    typedef void (*SimPinWatch)(GPIO_TypeDef *port, uint32_t pin, bool level);
+
+    // Interrupts, numbered as IRQn_Type
+    void simVector(IRQn_Type irq, SimHandler handler);
+    uint32_t simIrqTaken(IRQn_Type irq);
+    uint64_t simIrqHostNs(IRQn_Type irq);
+
+    // Pins
+    void simGpioBsrr(GPIO_TypeDef *port, uint32_t bits);
+    void simGpioDrive(GPIO_TypeDef *port, uint32_t pin, bool level);
+    void simGpioConfigured(GPIO_TypeDef *port);
+    void simGpioWatch(GPIO_TypeDef *port, uint32_t pin, SimPinWatch watch);
+    void simGpioName(GPIO_TypeDef *port, uint32_t pin, const char *name);
+    bool simEdgeLog(const char *path);
+    void simEdgeNote(const char *note);
+    uint64_t simEdges(void);
+
+    // Analog inputs and the DMA that reads them
+    void simAdcStart(ADC_TypeDef *adc, uint32_t *target, uint32_t length);
+    void simAdcStop(ADC_TypeDef *adc);
+    uint16_t simAdcInput(uint32_t channel); // sim_plant.c
+
+    // Clocks
+    void simSysTickStart(uint32_t hz);
+    uint32_t simTimerClock(const TIM_TypeDef *tim);
+
+    // Driving the clock, for the kernel (sim_rtos.c) and the plants
+    uint64_t simNextEvent(void);
+    void simRunTo(uint64_t cycles);
+    void simServiceIrqs(void);
+    void simMillisecond(void); // sim_plant.c, every tick
+
+    // The kernel, sim_rtos.c. vTaskStartScheduler returns once simStop is
+    // called or the time limit is reached
+    void simStop(void);
+    void simSetTimeLimit(uint64_t cycles);
+    bool simTimedOut(void);
+    void simTaskReport(FILE *f);
+
+    // Thermal plants, sim_plant.c
+    bool simPlantAdd(const char *name, uint32_t adcChannel, TIM_TypeDef *pwm, const uint32_t *pwmChannel);
+    bool simPlantScript(const char *path);
+    void simPlantLog(FILE *f);
+    void simPlantReport(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SIM_H */
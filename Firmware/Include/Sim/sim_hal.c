@@ -0,0 +1,267 @@
+/**
+ * @file sim_hal.c
+ * @brief The HAL calls the firmware makes, for the sim build, done on the sim's registers.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Each call writes the registers its HAL counterpart would, as far as the
+ * sim reads them: pin modes, timer prescalers, reloads, compares and
+ * enables, ADC ranks, NVIC priorities and the bus dividers. The core always
+ * runs at SIM_CORE_HZ; the clock tree only sets the bus dividers, so the
+ * timers count at the rates the firmware works out from them.
+ *
+ * The LED driver's SPI and DMA only report success. Nothing in the sim
+ * turns the LEDs on (forge_sim.c never calls forgeSetEffects), so none of
+ * it ever moves data.
+ */
+
+#include "sim.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+uint32_t SystemCoreClock = SIM_CORE_HZ;
+const uint8_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9};
+const uint8_t APBPrescTable[8] = {0, 0, 0, 0, 1, 2, 3, 4};
+
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = (1UL << __NVIC_PRIO_BITS);
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+
+// The linker script's section bounds, which memory.c maps. The host has no
+// such layout, so the sizes the map works out from them mean nothing here
+uint32_t _sdata, _edata, _sbss, _ebss, _estack;
+
+void SystemCoreClockUpdate(void)
+{
+    SystemCoreClock = SIM_CORE_HZ;
+}
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+    HAL_NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_4);
+    HAL_InitTick(TICK_INT_PRIORITY);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
+{
+    simSysTickStart(1000U / uwTickFreq);
+    NVIC_SetPriority(SysTick_IRQn, TickPriority);
+    uwTickPrio = TickPriority;
+    return HAL_OK;
+}
+
+void HAL_IncTick(void)
+{
+    uwTick += uwTickFreq;
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+    (void)RCC_OscInitStruct;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+    (void)FLatency;
+    if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_HCLK)
+        MODIFY_REG(simRCC.CFGR, RCC_CFGR_HPRE, RCC_ClkInitStruct->AHBCLKDivider);
+    if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_PCLK1)
+        MODIFY_REG(simRCC.CFGR, RCC_CFGR_PPRE1, RCC_ClkInitStruct->APB1CLKDivider);
+    if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_PCLK2)
+        MODIFY_REG(simRCC.CFGR, RCC_CFGR_PPRE2, RCC_ClkInitStruct->APB2CLKDivider << 3);
+    MODIFY_REG(simRCC.CFGR, RCC_CFGR_SW | RCC_CFGR_SWS, RCC_CFGR_SW_PLL | RCC_CFGR_SWS_PLL);
+    return HAL_InitTick(uwTickPrio);
+}
+
+uint32_t HAL_RCC_GetSysClockFreq(void)
+{
+    return SIM_CORE_HZ;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+    return SIM_CORE_HZ >> AHBPrescTable[(simRCC.CFGR & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return HAL_RCC_GetHCLKFreq() >> APBPrescTable[(simRCC.CFGR & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+    return HAL_RCC_GetHCLKFreq() >> APBPrescTable[(simRCC.CFGR & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos];
+}
+
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup)
+{
+    NVIC_SetPriorityGrouping(PriorityGroup);
+}
+
+// Group 4, as HAL_Init sets it: every bit is preemption, so there's no subpriority
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+    (void)SubPriority;
+    NVIC_SetPriority(IRQn, PreemptPriority);
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+    NVIC_EnableIRQ(IRQn);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+    NVIC_DisableIRQ(IRQn);
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    for (uint32_t pin = 0; pin < 16; pin++)
+    {
+        if (!(GPIO_Init->Pin & (1U << pin)))
+            continue;
+        uint32_t mode = (GPIO_Init->Mode & GPIO_MODE) >> GPIO_MODE_Pos;
+        MODIFY_REG(GPIOx->MODER, 3U << (2U * pin), mode << (2U * pin));
+        MODIFY_REG(GPIOx->OTYPER, 1U << pin, ((GPIO_Init->Mode & OUTPUT_TYPE) >> OUTPUT_TYPE_Pos) << pin);
+        MODIFY_REG(GPIOx->PUPDR, 3U << (2U * pin), GPIO_Init->Pull << (2U * pin));
+        if (mode == MODE_AF)
+            MODIFY_REG(GPIOx->AFR[pin >> 3], 0xFU << (4U * (pin & 7U)), GPIO_Init->Alternate << (4U * (pin & 7U)));
+    }
+    simGpioConfigured(GPIOx);
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+    for (uint32_t pin = 0; pin < 16; pin++)
+    {
+        if (!(GPIO_Pin & (1U << pin)))
+            continue;
+        GPIOx->MODER |= 3U << (2U * pin); // Analog, as the HAL leaves it
+        GPIOx->PUPDR &= ~(3U << (2U * pin));
+        GPIOx->ODR &= ~(1U << pin);
+    }
+    simGpioConfigured(GPIOx);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    simGpioBsrr(GPIOx, (PinState != GPIO_PIN_RESET) ? GPIO_Pin : (uint32_t)GPIO_Pin << 16);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim)
+{
+    TIM_TypeDef *tim = htim->Instance;
+    tim->PSC = htim->Init.Prescaler;
+    tim->ARR = htim->Init.Period;
+    MODIFY_REG(tim->CR1, TIM_CR1_ARPE, htim->Init.AutoReloadPreload);
+    htim->State = HAL_TIM_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim)
+{
+    return HAL_TIM_Base_Init(htim);
+}
+
+// Channels are TIM_CHANNEL_1 to 4, 0 to 12 in fours, as the HAL numbers them
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, const TIM_OC_InitTypeDef *sConfig,
+                                            uint32_t Channel)
+{
+    if (Channel > TIM_CHANNEL_4)
+        return HAL_ERROR;
+    (&htim->Instance->CCR1)[Channel / 4U] = sConfig->Pulse;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+    if (Channel > TIM_CHANNEL_4)
+        return HAL_ERROR;
+    htim->Instance->CCER |= TIM_CCER_CC1E << Channel;
+    htim->Instance->CR1 |= TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start_DMA(TIM_HandleTypeDef *htim, uint32_t Channel, const uint32_t *pData,
+                                        uint16_t Length)
+{
+    (void)pData;
+    (void)Length;
+    return HAL_TIM_PWM_Start(htim, Channel);
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop_DMA(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+    if (Channel > TIM_CHANNEL_4)
+        return HAL_ERROR;
+    htim->Instance->CCER &= ~(TIM_CCER_CC1E << Channel);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc)
+{
+    hadc->State = HAL_ADC_STATE_READY;
+    return HAL_OK;
+}
+
+// Regular ranks 1 to 6, which is as many as SQR3 holds
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig)
+{
+    if (sConfig->Rank < 1U || sConfig->Rank > 6U)
+        return HAL_ERROR;
+    uint32_t shift = 5U * (sConfig->Rank - 1U);
+    MODIFY_REG(hadc->Instance->SQR3, 0x1FU << shift, (sConfig->Channel & 0x1FU) << shift);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length)
+{
+    simAdcStart(hadc->Instance, pData, Length);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc)
+{
+    simAdcStop(hadc->Instance);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+    hdma->State = HAL_DMA_STATE_READY;
+    return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+    (void)hdma;
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)
+{
+    hspi->State = HAL_SPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pData, uint16_t Size)
+{
+    (void)hspi;
+    (void)pData;
+    (void)Size;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DMAStop(SPI_HandleTypeDef *hspi)
+{
+    (void)hspi;
+    return HAL_OK;
+}
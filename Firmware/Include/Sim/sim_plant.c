@@ -0,0 +1,298 @@
+/**
+ * @file sim_plant.c
+ * @brief Thermal plants for the sim: each heater warms a lumped mass, which its thermistor reads back through the ADC.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * A plant is one mass at one temperature, stepped every millisecond:
+ *
+ *   capacity * dT/dt = power * duty - (T - ambient) / resistance
+ *
+ * in J/K, W and K/W. The duty is its heater's PWM compare over the timer's
+ * period, while the channel and the timer are both on. The thermistor is
+ * the one therm.h tabulates, in the divider readTemperature assumes (4.7k
+ * to 3.3V), so the counts it reads are the ones a real sensor would give.
+ *
+ * A script changes the plants as the run goes on, one change a line:
+ *
+ *   # seconds  plant  key=value...
+ *   0     hotend  ambient=25 noise=2
+ *   30    hotend  power=20                  A weak cartridge
+ *   60    bed     sensor=open               A thermistor falls out
+ *
+ * The keys are power, capacity, resistance, ambient, temp (set the
+ * temperature outright), noise (peak ADC counts, deterministic) and
+ * sensor=ok, open or short. Lines must be in time order.
+ */
+
+#include "sim.h"
+#include "../Temperature/therm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_MAX_PLANTS 4
+#define SIM_MAX_CHANGES 64
+#define SIM_PLANT_LOG_MS 100
+#define SIM_DIVIDER_OHMS 4700.0
+
+typedef enum
+{
+    SIM_SENSOR_OK = 0,
+    SIM_SENSOR_OPEN, // Reads as no current: 0 counts
+    SIM_SENSOR_SHORT // Reads as the full rail
+} SimSensor;
+
+typedef struct
+{
+    const char *name;
+    uint32_t adcChannel;
+    TIM_TypeDef *pwm;
+    const uint32_t *pwmChannel; // Read each step, so it may be set after the plant is added
+    double temp;
+    double ambient;
+    double power;
+    double capacity;
+    double resistance;
+    double noise;
+    double peak;
+    double energy; // J put in by the heater
+    SimSensor sensor;
+} SimPlant;
+
+typedef struct
+{
+    uint64_t at;
+    SimPlant *plant;
+    char change[96];
+} SimChange;
+
+static SimPlant _plants[SIM_MAX_PLANTS];
+static uint32_t _plantCount = 0;
+static SimChange _changes[SIM_MAX_CHANGES];
+static uint32_t _changeCount = 0;
+static uint32_t _nextChange = 0;
+static FILE *_log = NULL;
+static uint32_t _ms = 0;
+static uint32_t _noiseSeed = 1;
+
+/**
+ * @brief  Adds a plant, at ambient. The defaults are a hotend's (40W cartridge, aluminium block); a name starting "bed" gets a bed's.
+ * @param[in]  adcChannel is its thermistor's ADC channel.
+ * @param[in]  pwm and pwmChannel are its heater's timer and where its TIM_CHANNEL_ value is kept.
+ * @retval false if there are SIM_MAX_PLANTS already.
+ * @headerfile sim.h
+ */
+bool simPlantAdd(const char *name, uint32_t adcChannel, TIM_TypeDef *pwm, const uint32_t *pwmChannel)
+{
+    if (_plantCount >= SIM_MAX_PLANTS)
+        return false;
+    SimPlant *p = &_plants[_plantCount++];
+    bool bed = strncmp(name, "bed", 3) == 0;
+    p->name = name;
+    p->adcChannel = adcChannel;
+    p->pwm = pwm;
+    p->pwmChannel = pwmChannel;
+    p->ambient = 25.0;
+    p->temp = p->ambient;
+    p->peak = p->temp;
+    p->power = bed ? 150.0 : 40.0;
+    p->capacity = bed ? 450.0 : 9.0;
+    p->resistance = bed ? 0.8 : 7.0;
+    return true;
+}
+
+static SimPlant *_find(const char *name)
+{
+    for (uint32_t i = 0; i < _plantCount; i++)
+    {
+        if (strcmp(_plants[i].name, name) == 0)
+            return &_plants[i];
+    }
+    return NULL;
+}
+
+static void _apply(SimPlant *p, char *change)
+{
+    for (char *item = strtok(change, " \t"); item != NULL; item = strtok(NULL, " \t"))
+    {
+        char *value = strchr(item, '=');
+        if (value == NULL)
+            continue;
+        *value++ = '\0';
+        if (strcmp(item, "sensor") == 0)
+            p->sensor = (strcmp(value, "open") == 0) ? SIM_SENSOR_OPEN : (strcmp(value, "short") == 0) ? SIM_SENSOR_SHORT : SIM_SENSOR_OK;
+        else if (strcmp(item, "power") == 0)
+            p->power = atof(value);
+        else if (strcmp(item, "capacity") == 0)
+            p->capacity = atof(value);
+        else if (strcmp(item, "resistance") == 0)
+            p->resistance = atof(value);
+        else if (strcmp(item, "ambient") == 0)
+            p->ambient = atof(value);
+        else if (strcmp(item, "temp") == 0)
+            p->temp = atof(value);
+        else if (strcmp(item, "noise") == 0)
+            p->noise = atof(value);
+        else
+            fprintf(stderr, "forge_sim: unknown plant key %s\n", item);
+    }
+}
+
+/**
+ * @brief  Reads a script of changes to the plants, which must all have been added. Changes at 0s apply at once.
+ * @retval false if the file can't be read or names a plant there isn't.
+ * @headerfile sim.h
+ */
+bool simPlantScript(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+    char line[160];
+    bool ok = true;
+    while (fgets(line, sizeof(line), f) != NULL && _changeCount < SIM_MAX_CHANGES)
+    {
+        double seconds;
+        char name[16];
+        int used = 0;
+        if (line[0] == '#' || sscanf(line, "%lf %15s %n", &seconds, name, &used) < 2)
+            continue;
+        SimChange *c = &_changes[_changeCount];
+        c->plant = _find(name);
+        if (c->plant == NULL)
+        {
+            fprintf(stderr, "forge_sim: no plant %s\n", name);
+            ok = false;
+            continue;
+        }
+        c->at = (uint64_t)(seconds * SIM_CORE_HZ);
+        strncpy(c->change, line + used, sizeof(c->change) - 1);
+        c->change[strcspn(c->change, "\r\n")] = '\0';
+        _changeCount++;
+    }
+    fclose(f);
+    simMillisecond(); // Anything at 0s
+    return ok;
+}
+
+/**
+ * @brief  Writes every plant's temperature and heater duty every SIM_PLANT_LOG_MS, as CSV.
+ * @headerfile sim.h
+ */
+void simPlantLog(FILE *f)
+{
+    _log = f;
+    fprintf(f, "seconds");
+    for (uint32_t i = 0; i < _plantCount; i++)
+    {
+        fprintf(f, ",%s_temp,%s_duty", _plants[i].name, _plants[i].name);
+    }
+    fputc('\n', f);
+}
+
+static double _duty(const SimPlant *p)
+{
+    const TIM_TypeDef *tim = p->pwm;
+    uint32_t channel = *p->pwmChannel;
+    if (channel > TIM_CHANNEL_4 || !(tim->CR1 & TIM_CR1_CEN) || !(tim->CCER & (TIM_CCER_CC1E << channel)))
+        return 0.0;
+    double duty = (double)(&tim->CCR1)[channel / 4U] / ((double)tim->ARR + 1.0);
+    return (duty > 1.0) ? 1.0 : duty;
+}
+
+/**
+ * @brief  Steps every plant by a millisecond. Called on each tick.
+ * @headerfile sim.h
+ */
+void simMillisecond(void)
+{
+    while (_nextChange < _changeCount && _changes[_nextChange].at <= simNow)
+    {
+        SimChange *c = &_changes[_nextChange++];
+        _apply(c->plant, c->change);
+    }
+
+    for (uint32_t i = 0; i < _plantCount; i++)
+    {
+        SimPlant *p = &_plants[i];
+        double heat = p->power * _duty(p);
+        p->energy += heat * 0.001;
+        p->temp += 0.001 * (heat - (p->temp - p->ambient) / p->resistance) / p->capacity;
+        if (p->temp > p->peak)
+            p->peak = p->temp;
+    }
+
+    if (_log != NULL && (++_ms % SIM_PLANT_LOG_MS) == 0)
+    {
+        fprintf(_log, "%.3f", (double)simNow / SIM_CORE_HZ);
+        for (uint32_t i = 0; i < _plantCount; i++)
+        {
+            fprintf(_log, ",%.2f,%.3f", _plants[i].temp, _duty(&_plants[i]));
+        }
+        fputc('\n', _log);
+    }
+}
+
+/**
+ * @brief  The thermistor's resistance at a temperature, interpolated in therm.h's table and held at its ends.
+ */
+static double _ohms(double temp)
+{
+    if (temp <= _TemperatureKeyTable[0])
+        return _TemperatureValueTable[0];
+    for (uint32_t i = 1; i < 61; i++)
+    {
+        if (temp <= _TemperatureKeyTable[i])
+        {
+            double f = (temp - _TemperatureKeyTable[i - 1]) / (_TemperatureKeyTable[i] - _TemperatureKeyTable[i - 1]);
+            return _TemperatureValueTable[i - 1] + f * (_TemperatureValueTable[i] - _TemperatureValueTable[i - 1]);
+        }
+    }
+    return _TemperatureValueTable[60];
+}
+
+/**
+ * @brief  What an ADC channel converts to: a plant's thermistor, or 0 for a channel with none.
+ * @headerfile sim.h
+ */
+uint16_t simAdcInput(uint32_t channel)
+{
+    for (uint32_t i = 0; i < _plantCount; i++)
+    {
+        SimPlant *p = &_plants[i];
+        if (p->adcChannel != channel)
+            continue;
+        if (p->sensor == SIM_SENSOR_OPEN)
+            return 0;
+        if (p->sensor == SIM_SENSOR_SHORT)
+            return 4095;
+        double counts = 4095.0 * SIM_DIVIDER_OHMS / (_ohms(p->temp) + SIM_DIVIDER_OHMS);
+        if (p->noise > 0.0)
+        {
+            _noiseSeed = _noiseSeed * 1664525U + 1013904223U;
+            counts += p->noise * (((double)(_noiseSeed >> 8) / (double)(1U << 24)) * 2.0 - 1.0);
+        }
+        if (counts < 0.0)
+            counts = 0.0;
+        if (counts > 4095.0)
+            counts = 4095.0;
+        return (uint16_t)(counts + 0.5);
+    }
+    return 0;
+}
+
+/**
+ * @brief  Writes each plant's final state.
+ * @headerfile sim.h
+ */
+void simPlantReport(FILE *f)
+{
+    for (uint32_t i = 0; i < _plantCount; i++)
+    {
+        const SimPlant *p = &_plants[i];
+        fprintf(f, "  %-8s %6.1f C  peak %6.1f C  duty %5.3f  heater %.0f J\n", p->name, p->temp, p->peak, _duty(p),
+                p->energy);
+    }
+}
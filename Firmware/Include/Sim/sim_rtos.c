@@ -0,0 +1,613 @@
+/**
+ * @file sim_rtos.c
+ * @brief The FreeRTOS calls the firmware makes, for the sim build: tasks as coroutines on the virtual clock, their notifications, semaphores and stream buffers.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * A task runs until it blocks, and takes no time doing it, so nothing is
+ * lost by never preempting one: whatever an interrupt makes ready runs as
+ * soon as the running task waits, at the same cycle. Among the ready tasks
+ * the most urgent runs first, then the one made ready first. When none is
+ * ready the clock runs to the next timer update, tick or timeout.
+ *
+ * The scheduler counts as running from the start, so forgeDelay and the
+ * rest wait on the clock even from the module inits. Waiting from there,
+ * outside any task, runs the clock in place, with interrupts taken but no
+ * task run.
+ *
+ * Each task has a host stack of SIM_TASK_STACK; the one the firmware gave
+ * it is left alone, and its high water mark is reported as untouched.
+ */
+
+#include "sim.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../FreeRTOS/Source/include/stream_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define SIM_MAX_TASKS 16
+#define SIM_MAX_QUEUES 16
+#define SIM_MAX_STREAMS 4
+#define SIM_TICK_CYCLES (SIM_CORE_HZ / configTICK_RATE_HZ)
+#define SIM_FOREVER UINT64_MAX
+
+typedef enum
+{
+    SIM_READY = 0,
+    SIM_BLOCKED,
+    SIM_STOPPED // Called simStop, or ran off the end of its function
+} SimTaskState;
+
+struct tskTaskControlBlock
+{
+    ucontext_t context;
+    TaskFunction_t code;
+    void *arg;
+    const char *name;
+    UBaseType_t priority;
+    uint32_t number; // From 1, in the order created, as the kernel numbers them
+    uint32_t depth;
+    SimTaskState state;
+    uint64_t readySeq; // Orders the tasks of a priority made ready
+    uint64_t wakeAt;   // When a block times out, SIM_FOREVER if never
+    const void *waitingOn;
+    const char *waitingFor;
+    uint32_t notified; // The notification value; only ever counted, as by xTaskNotifyGive
+};
+
+// Semaphores and mutexes; there are no queues of items
+struct QueueDefinition
+{
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct StreamBufferDef_t
+{
+    uint8_t *storage;
+    size_t size; // Storage is one byte bigger; a full buffer keeps it spare
+    size_t trigger;
+    size_t head;
+    size_t tail;
+};
+
+static struct tskTaskControlBlock _tasks[SIM_MAX_TASKS];
+static uint32_t _taskCount = 0;
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize); // Core/scheduler.c
+
+static struct tskTaskControlBlock _idle; // Never scheduled; it only has the clock's gaps charged to it
+static struct QueueDefinition _queues[SIM_MAX_QUEUES];
+static uint32_t _queueCount = 0;
+static struct StreamBufferDef_t _streams[SIM_MAX_STREAMS];
+static uint32_t _streamCount = 0;
+
+static ucontext_t _kernel;
+static struct tskTaskControlBlock *_running = NULL;
+static uint64_t _readySeq = 0;
+static bool _stopping = false;
+static bool _timedOut = false;
+static uint64_t _limit = SIM_FOREVER;
+static uint32_t _critical = 0;
+
+// A wait from outside any task, before the scheduler starts
+static const void *_mainWaitingOn = NULL;
+static bool _mainWoken = false;
+
+static void _fail(const char *what)
+{
+    fprintf(stderr, "forge_sim: %s at cycle %llu\n", what, (unsigned long long)simNow);
+    exit(2);
+}
+
+static void _makeReady(struct tskTaskControlBlock *task)
+{
+    task->state = SIM_READY;
+    task->readySeq = _readySeq++;
+    task->waitingOn = NULL;
+    task->waitingFor = NULL;
+    forgeTraceReady(task->number);
+}
+
+/**
+ * @brief  Makes ready every task waiting on an object; each checks again for itself when it runs.
+ */
+static void _wakeWaiters(const void *object)
+{
+    if (object == _mainWaitingOn)
+        _mainWoken = true;
+    for (uint32_t i = 0; i < _taskCount; i++)
+    {
+        if (_tasks[i].state == SIM_BLOCKED && _tasks[i].waitingOn == object)
+            _makeReady(&_tasks[i]);
+    }
+}
+
+static uint64_t _nextTimeout(void)
+{
+    uint64_t next = SIM_FOREVER;
+    for (uint32_t i = 0; i < _taskCount; i++)
+    {
+        if (_tasks[i].state == SIM_BLOCKED && _tasks[i].wakeAt < next)
+            next = _tasks[i].wakeAt;
+    }
+    return next;
+}
+
+static void _wakeTimeouts(void)
+{
+    for (uint32_t i = 0; i < _taskCount; i++)
+    {
+        if (_tasks[i].state == SIM_BLOCKED && _tasks[i].wakeAt <= simNow)
+            _makeReady(&_tasks[i]);
+    }
+}
+
+/**
+ * @brief  Runs the clock to the next thing that happens, no further than limit.
+ * @retval false if nothing ever will.
+ */
+static bool _advance(uint64_t limit)
+{
+    uint64_t next = simNextEvent();
+    uint64_t timeout = _nextTimeout();
+    if (timeout < next)
+        next = timeout;
+    if (limit < next)
+        next = limit;
+    if (next == SIM_FOREVER)
+        return false;
+    simRunTo(next);
+    _wakeTimeouts();
+    return true;
+}
+
+/**
+ * @brief  Waits until woken through object or until the cycle wakeAt. From a task it hands the core back to the kernel; from outside one it runs the clock in place.
+ */
+static void _block(const void *object, const char *what, uint64_t wakeAt)
+{
+    if (simInIsr())
+        _fail("blocking call from an interrupt");
+    if (_running == NULL)
+    {
+        _mainWaitingOn = object;
+        _mainWoken = false;
+        while (!_mainWoken && simNow < wakeAt)
+        {
+            if (!_advance(wakeAt))
+                _fail("waiting outside a task on something that never comes");
+        }
+        _mainWaitingOn = NULL;
+        return;
+    }
+    struct tskTaskControlBlock *task = _running;
+    task->state = SIM_BLOCKED;
+    task->waitingOn = object;
+    task->waitingFor = what;
+    task->wakeAt = wakeAt;
+    swapcontext(&task->context, &_kernel);
+}
+
+static uint64_t _deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+        return SIM_FOREVER;
+    return simNow + (uint64_t)ticks * SIM_TICK_CYCLES;
+}
+
+static void _trampoline(void)
+{
+    struct tskTaskControlBlock *task = _running;
+    task->code(task->arg);
+    task->state = SIM_STOPPED;
+    swapcontext(&task->context, &_kernel);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char *const pcName, const uint32_t ulStackDepth,
+                               void *const pvParameters, UBaseType_t uxPriority, StackType_t *const puxStackBuffer,
+                               StaticTask_t *const pxTaskBuffer)
+{
+    (void)puxStackBuffer;
+    (void)pxTaskBuffer;
+    if (_taskCount >= SIM_MAX_TASKS)
+        _fail("too many tasks");
+    struct tskTaskControlBlock *task = &_tasks[_taskCount++];
+    task->code = pxTaskCode;
+    task->arg = pvParameters;
+    task->name = pcName;
+    task->priority = uxPriority;
+    task->number = _taskCount;
+    task->depth = ulStackDepth;
+    task->wakeAt = SIM_FOREVER;
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = malloc(SIM_TASK_STACK);
+    task->context.uc_stack.ss_size = SIM_TASK_STACK;
+    task->context.uc_link = NULL;
+    if (task->context.uc_stack.ss_sp == NULL)
+        _fail("no memory for a task stack");
+    makecontext(&task->context, _trampoline, 0);
+    _makeReady(task);
+    return task;
+}
+
+static struct tskTaskControlBlock *_pickReady(void)
+{
+    struct tskTaskControlBlock *best = NULL;
+    for (uint32_t i = 0; i < _taskCount; i++)
+    {
+        struct tskTaskControlBlock *task = &_tasks[i];
+        if (task->state != SIM_READY)
+            continue;
+        if (best == NULL || task->priority > best->priority ||
+            (task->priority == best->priority && task->readySeq < best->readySeq))
+            best = task;
+    }
+    return best;
+}
+
+/**
+ * @brief  Runs the tasks until simStop is called or the time limit is reached, then returns.
+ */
+void vTaskStartScheduler(void)
+{
+    StaticTask_t *idleTcb;
+    StackType_t *idleStack;
+    uint32_t idleDepth;
+    vApplicationGetIdleTaskMemory(&idleTcb, &idleStack, &idleDepth);
+    _idle.name = "IDLE";
+    _idle.number = _taskCount + 1U; // Created last, as the kernel does
+    _idle.depth = idleDepth;
+    _idle.state = SIM_BLOCKED;
+
+    while (!_stopping)
+    {
+        if (simNow >= _limit)
+        {
+            _timedOut = true;
+            break;
+        }
+        simServiceIrqs();
+        struct tskTaskControlBlock *task = _pickReady();
+        if (task != NULL)
+        {
+            _running = task;
+            forgeTraceSwitchedIn(task->number, task);
+            swapcontext(&_kernel, &task->context);
+            profileSwitchedOut(task->number, task);
+            _running = NULL;
+            continue;
+        }
+        // The gap to the next wake-up is the idle task's, as the profiler
+        // would see it on the board
+        forgeTraceSwitchedIn(_idle.number, &_idle);
+        bool woke = _advance(_limit);
+        profileSwitchedOut(_idle.number, &_idle);
+        if (!woke)
+        {
+            fprintf(stderr, "forge_sim: every task waits forever at cycle %llu\n", (unsigned long long)simNow);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief  Stops the simulation: vTaskStartScheduler returns once the running task, which never runs again, hands back the core.
+ * @headerfile sim.h
+ */
+void simStop(void)
+{
+    _stopping = true;
+    if (_running != NULL)
+    {
+        _running->state = SIM_STOPPED;
+        swapcontext(&_running->context, &_kernel);
+    }
+}
+
+/**
+ * @brief  Sets the cycle at which vTaskStartScheduler gives up, e.g. on a print stuck waiting for a heater.
+ * @headerfile sim.h
+ */
+void simSetTimeLimit(uint64_t cycles)
+{
+    _limit = cycles;
+}
+
+bool simTimedOut(void)
+{
+    return _timedOut;
+}
+
+/**
+ * @brief  Writes what each task is doing, for a run that ran out of time.
+ * @headerfile sim.h
+ */
+void simTaskReport(FILE *f)
+{
+    for (uint32_t i = 0; i < _taskCount; i++)
+    {
+        const struct tskTaskControlBlock *task = &_tasks[i];
+        const char *state = (task->state == SIM_READY) ? "ready" : (task->state == SIM_STOPPED) ? "stopped" : task->waitingFor;
+        fprintf(f, "  task %-8s prio %lu  %s", task->name, (unsigned long)task->priority, state);
+        if (task->state == SIM_BLOCKED && task->wakeAt != SIM_FOREVER)
+            fprintf(f, " until %.3fs", (double)task->wakeAt / SIM_CORE_HZ);
+        fputc('\n', f);
+    }
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return taskSCHEDULER_RUNNING;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(simNow / SIM_TICK_CYCLES);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+/**
+ * @brief  Waits the rest of this tick and xTicksToDelay - 1 more, as the kernel does.
+ */
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0)
+        return;
+    uint64_t tick = simNow / SIM_TICK_CYCLES;
+    _block(NULL, "delay", (tick + xTicksToDelay) * SIM_TICK_CYCLES);
+}
+
+void vTaskDelayUntil(TickType_t *const pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    *pxPreviousWakeTime = wake;
+    if ((int32_t)(wake - xTaskGetTickCount()) > 0)
+        _block(NULL, "delay", (uint64_t)wake * SIM_TICK_CYCLES);
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    TaskHandle_t task = (xTaskToQuery != NULL) ? xTaskToQuery : _running;
+    return (char *)task->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    TaskHandle_t task = (xTask != NULL) ? xTask : _running;
+    return task->depth;
+}
+
+static void _notify(struct tskTaskControlBlock *task)
+{
+    task->notified++;
+    _wakeWaiters(task);
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction,
+                              uint32_t *pulPreviousNotificationValue)
+{
+    (void)ulValue;
+    if (eAction != eIncrement)
+        _fail("only counting notifications are simulated");
+    if (pulPreviousNotificationValue != NULL)
+        *pulPreviousNotificationValue = xTaskToNotify->notified;
+    _notify(xTaskToNotify);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    _notify(xTaskToNotify);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    if (_running == NULL)
+        _fail("taking a notification outside a task");
+    struct tskTaskControlBlock *task = _running;
+    uint64_t deadline = _deadline(xTicksToWait);
+    while (task->notified == 0 && xTicksToWait != 0 && simNow < deadline)
+        _block(task, "notification", deadline);
+
+    uint32_t value = task->notified;
+    if (value > 0)
+        task->notified = (xClearCountOnExit != pdFALSE) ? 0 : value - 1;
+    return value;
+}
+
+static QueueHandle_t _newQueue(UBaseType_t max, UBaseType_t count)
+{
+    if (_queueCount >= SIM_MAX_QUEUES)
+        _fail("too many semaphores");
+    QueueHandle_t q = &_queues[_queueCount++];
+    q->max = max;
+    q->count = count;
+    return q;
+}
+
+QueueHandle_t xQueueGenericCreateStatic(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize,
+                                        uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue,
+                                        const uint8_t ucQueueType)
+{
+    (void)pucQueueStorage;
+    (void)pxStaticQueue;
+    (void)ucQueueType;
+    if (uxItemSize != 0)
+        _fail("queues of items aren't simulated");
+    return _newQueue(uxQueueLength, 0);
+}
+
+QueueHandle_t xQueueCreateCountingSemaphoreStatic(const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount,
+                                                  StaticQueue_t *pxStaticQueue)
+{
+    (void)pxStaticQueue;
+    return _newQueue(uxMaxCount, uxInitialCount);
+}
+
+// No priority inheritance; no task is ever preempted while it holds one
+QueueHandle_t xQueueCreateMutexStatic(const uint8_t ucQueueType, StaticQueue_t *pxStaticQueue)
+{
+    (void)ucQueueType;
+    (void)pxStaticQueue;
+    return _newQueue(1, 1);
+}
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    uint64_t deadline = _deadline(xTicksToWait);
+    for (;;)
+    {
+        if (xQueue->count > 0)
+        {
+            xQueue->count--;
+            return pdTRUE;
+        }
+        if (xTicksToWait == 0 || simNow >= deadline)
+            return pdFALSE;
+        _block(xQueue, "semaphore", deadline);
+    }
+}
+
+static BaseType_t _give(QueueHandle_t xQueue)
+{
+    if (xQueue->count >= xQueue->max)
+        return errQUEUE_FULL;
+    xQueue->count++;
+    _wakeWaiters(xQueue);
+    return pdTRUE;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void *const pvItemToQueue, TickType_t xTicksToWait,
+                             const BaseType_t xCopyPosition)
+{
+    (void)pvItemToQueue;
+    (void)xTicksToWait;
+    (void)xCopyPosition;
+    return _give(xQueue);
+}
+
+BaseType_t xQueueGiveFromISR(QueueHandle_t xQueue, BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    return _give(xQueue);
+}
+
+StreamBufferHandle_t xStreamBufferGenericCreateStatic(size_t xBufferSizeBytes, size_t xTriggerLevelBytes,
+                                                      BaseType_t xIsMessageBuffer,
+                                                      uint8_t *const pucStreamBufferStorageArea,
+                                                      StaticStreamBuffer_t *const pxStaticStreamBuffer)
+{
+    (void)pxStaticStreamBuffer;
+    if (xIsMessageBuffer != pdFALSE)
+        _fail("message buffers aren't simulated");
+    if (_streamCount >= SIM_MAX_STREAMS)
+        _fail("too many stream buffers");
+    StreamBufferHandle_t s = &_streams[_streamCount++];
+    s->storage = pucStreamBufferStorageArea;
+    s->size = xBufferSizeBytes;
+    s->trigger = (xTriggerLevelBytes > 0) ? xTriggerLevelBytes : 1;
+    s->head = 0;
+    s->tail = 0;
+    return s;
+}
+
+static size_t _streamUsed(StreamBufferHandle_t s)
+{
+    return (s->head + s->size + 1 - s->tail) % (s->size + 1);
+}
+
+static size_t _streamWrite(StreamBufferHandle_t s, const uint8_t *data, size_t length)
+{
+    size_t n = 0;
+    while (n < length && _streamUsed(s) < s->size)
+    {
+        s->storage[s->head] = data[n++];
+        s->head = (s->head + 1) % (s->size + 1);
+    }
+    if (_streamUsed(s) >= s->trigger)
+        _wakeWaiters(s);
+    return n;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes,
+                         TickType_t xTicksToWait)
+{
+    if (xTicksToWait != 0)
+        _fail("waiting for room in a stream buffer isn't simulated");
+    return _streamWrite(xStreamBuffer, pvTxData, xDataLengthBytes);
+}
+
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes,
+                                BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    return _streamWrite(xStreamBuffer, pvTxData, xDataLengthBytes);
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes,
+                            TickType_t xTicksToWait)
+{
+    StreamBufferHandle_t s = xStreamBuffer;
+    uint64_t deadline = _deadline(xTicksToWait);
+    while (_streamUsed(s) < s->trigger && xTicksToWait != 0 && simNow < deadline)
+        _block(s, "stream", deadline);
+
+    uint8_t *data = pvRxData;
+    size_t n = 0;
+    while (n < xBufferLengthBytes && _streamUsed(s) > 0)
+    {
+        data[n++] = s->storage[s->tail];
+        s->tail = (s->tail + 1) % (s->size + 1);
+    }
+    return n;
+}
+
+// The port: critical sections mask what the kernel would, through BASEPRI
+void vPortEnterCritical(void)
+{
+    simSetBasepri(configMAX_SYSCALL_INTERRUPT_PRIORITY);
+    _critical++;
+}
+
+void vPortExitCritical(void)
+{
+    if (_critical > 0 && --_critical == 0)
+        simSetBasepri(0);
+}
+
+uint32_t ulPortRaiseBASEPRI(void)
+{
+    uint32_t old = simGetBasepri();
+    simSetBasepri(configMAX_SYSCALL_INTERRUPT_PRIORITY);
+    return old;
+}
+
+void vPortSetBASEPRI(uint32_t basepri)
+{
+    simSetBasepri(basepri);
+}
+
+// Nothing to switch to early; see the top of the file
+void vPortYield(void)
+{
+}
+
+// SysTick_Handler calls it; the kernel's tick is the clock
+void xPortSysTickHandler(void)
+{
+}
@@ -19,6 +19,7 @@
 #include "../HAL/stm32f4xx_hal.h"
 #include <stdbool.h>
 #include "../CMSIS-Core/cmsis_compiler.h"
+#include "../Core/forge.h"
 
 StepperConfig createStepperConfig(GPIO_TypeDef *STEPx,
                                   uint32_t STEP_Pin,
@@ -50,8 +51,8 @@ StepperConfig createStepperConfig(GPIO_TypeDef *STEPx,
     out.Enablex = Enablex;
     out.Enable_Pin = Enable_Pin;
 
-    out.DIAGx = STEPx;
-    out.DIAG_Pin = STEP_Pin;
+    out.DIAGx = DIAGx;
+    out.DIAG_Pin = DIAG_Pin;
 
     out.dir1IsClockwise = dir1IsClockwise;
 
@@ -67,14 +68,14 @@ StepperConfig createStepperConfig(GPIO_TypeDef *STEPx,
 static GPIO_InitTypeDef GPIO_InitStruct;
 
 /**
- * @brief  Initializes the StepperConfig provided to the function. This involves ensuring that HAL is initialized, configuring all of the pins, setting cfg->_initialized to true, and then delaying one millisecond to ensure the driver has fully turned on. Please ensure that, before calling this function, the system clock and the peripheral clocks are configured so that the registers can be written to.
+ * @brief  Initializes the StepperConfig provided to the function. This involves ensuring that HAL is initialized (once, via forgeInitHAL), configuring all of the pins, setting cfg->_initialized to true, and then delaying one millisecond to ensure the driver has fully turned on. Please ensure that, before calling this function, the system clock and the peripheral clocks are configured so that the registers can be written to.
  * @param[in]  cfg is a pointer to a StepperConfig that should have all of the pins set.
  * @retval None
  * @headerfile stepper.h
  */
 void initStepper(StepperConfig *cfg)
 {
-    HAL_Init();
+    forgeInitHAL();
 
     GPIO_InitStruct.Pin = cfg->STEP_Pin;
     GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
@@ -105,7 +106,7 @@ void initStepper(StepperConfig *cfg)
         cfg->maxHomingSteps = DEFAULT_MAX_HOMING_STEPS;
     }
 
-    HAL_Delay(131); // for StealthChop2
+    forgeDelay(131); // for StealthChop2
 
     cfg->_initialized = true;
     cfg->lastError = STEPPER_ERROR_NONE;
@@ -133,7 +134,7 @@ void setDirectionStepper(StepperConfig *cfg, StepperDirection dir)
         initStepper(cfg);
     }
     _nopTimes(4); // on a 168mhz clock, this will be at least(likely much more than) 24ns
-    HAL_GPIO_WritePin(cfg->DIRx, cfg->DIR_Pin, dir);
+    HAL_GPIO_WritePin(cfg->DIRx, cfg->DIR_Pin, (GPIO_PinState)dir);
     _nopTimes(4); // see note above
     cfg->direction = dir;
     cfg->lastError = STEPPER_ERROR_NONE;
@@ -41,6 +41,12 @@ extern "C"
         STEPPER_INVALID_HOMING_SPEED
     } StepperError;
 
+    typedef enum
+    {
+        STEP_DIR_0 = GPIO_PIN_RESET,
+        STEP_DIR_1 = GPIO_PIN_SET
+    } StepperDirection;
+
     /**
      * @brief Stores configuration data about a TMC2209 stepper driver.
      */
@@ -77,12 +83,6 @@ extern "C"
         int32_t maxPosition; // Inclusive
     } StepperConfig;
 
-    typedef enum
-    {
-        STEP_DIR_0 = GPIO_PIN_RESET,
-        STEP_DIR_1 = GPIO_PIN_SET
-    } StepperDirection;
-
     StepperConfig createStepperConfig(GPIO_TypeDef *STEPx,
                                       uint32_t STEP_Pin,
 
@@ -0,0 +1,217 @@
+/**
+ * @file diskcache.c
+ * @brief Read-ahead and write-combining block cache between FatFs and a block device.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "diskcache.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * @brief  Sets up an empty cache in front of a device.
+ * @param[in]  c is the cache.
+ * @param[in]  readBlocks and writeBlocks do the transfers, each as a single multi-block command. writeBlocks may be NULL for a read-only device.
+ * @param[in]  blockCount is the size of the device in blocks, so read-ahead stops at the end; 0 if unknown.
+ * @retval None
+ * @headerfile diskcache.h
+ */
+void diskcacheInit(DiskCache *c, bool (*readBlocks)(uint8_t *, uint32_t, uint32_t),
+                   bool (*writeBlocks)(const uint8_t *, uint32_t, uint32_t), uint32_t blockCount)
+{
+    c->readBlocks = readBlocks;
+    c->writeBlocks = writeBlocks;
+    c->blockCount = blockCount;
+    memset(&c->stats, 0, sizeof(c->stats));
+    diskcacheInvalidate(c);
+}
+
+static bool _overlaps(uint32_t a, uint32_t aCount, uint32_t b, uint32_t bCount)
+{
+    return a < b + bCount && b < a + aCount;
+}
+
+static int8_t _find(DiskCache *c, uint32_t block)
+{
+    for (uint8_t l = 0; l < DISKCACHE_LINES; l++)
+    {
+        if (c->lineBlock[l] != DISKCACHE_EMPTY && block - c->lineBlock[l] < c->lineCount[l])
+            return l;
+    }
+    return -1;
+}
+
+/**
+ * @brief  Reads the aligned line around block into the least recently used line.
+ */
+static int8_t _fill(DiskCache *c, uint32_t block)
+{
+    uint8_t l = c->victim;
+    uint32_t base = block & ~(uint32_t)(DISKCACHE_LINE_BLOCKS - 1);
+    uint32_t count = DISKCACHE_LINE_BLOCKS;
+    if (c->blockCount != 0 && base + count > c->blockCount)
+        count = c->blockCount - base;
+
+    c->lineBlock[l] = DISKCACHE_EMPTY;
+    c->stats.readTransfers++;
+    if (!c->readBlocks(c->lines[l], base, count))
+        return -1;
+    c->stats.blocksRead += count;
+    c->lineBlock[l] = base;
+    c->lineCount[l] = (uint8_t)count;
+    return l;
+}
+
+/**
+ * @brief  Reads blocks. Runs of a line or more go straight to buf in one transfer; anything shorter is served from a line, reading the whole aligned 4KiB line on a miss so the blocks after it are already there.
+ * @param[in]  c is the cache.
+ * @param[out]  buf receives count blocks.
+ * @param[in]  block is the first block.
+ * @param[in]  count is the number of blocks.
+ * @retval false if a transfer failed.
+ * @headerfile diskcache.h
+ */
+bool diskcacheRead(DiskCache *c, uint8_t *buf, uint32_t block, uint32_t count)
+{
+    c->stats.reads++;
+    // The device has to see held writes before it's read back
+    if (c->pendingCount > 0 && _overlaps(block, count, c->pendingBlock, c->pendingCount))
+    {
+        if (!diskcacheFlush(c))
+            return false;
+    }
+
+    if (count >= DISKCACHE_LINE_BLOCKS)
+    {
+        // The lines are kept up to date on writes, so they can't be newer
+        // than the device here
+        c->stats.readTransfers++;
+        if (!c->readBlocks(buf, block, count))
+            return false;
+        c->stats.blocksRead += count;
+        return true;
+    }
+
+    while (count > 0)
+    {
+        int8_t l = _find(c, block);
+        if (l < 0)
+        {
+            l = _fill(c, block);
+            if (l < 0)
+                return false;
+        }
+        else
+        {
+            c->stats.hits++;
+        }
+        // With two lines, the other one is now the least recently used
+        c->victim = (uint8_t)((l + 1) % DISKCACHE_LINES);
+
+        uint32_t offset = block - c->lineBlock[l];
+        uint32_t n = c->lineCount[l] - offset;
+        if (n > count)
+            n = count;
+        memcpy(buf, c->lines[l] + offset * DISKCACHE_BLOCK_SIZE, n * DISKCACHE_BLOCK_SIZE);
+        buf += n * DISKCACHE_BLOCK_SIZE;
+        block += n;
+        count -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief  Writes blocks. Runs of a line or more go out at once. Shorter ones are held and merged with whatever continues or overwrites them, e.g. a FAT sector updated cluster by cluster, until something else is written, an overlapping read comes in or diskcacheFlush is called.
+ * @param[in]  c is the cache.
+ * @param[in]  buf holds count blocks.
+ * @param[in]  block is the first block.
+ * @param[in]  count is the number of blocks.
+ * @retval false if a transfer failed, which may have been for earlier held writes.
+ * @headerfile diskcache.h
+ */
+bool diskcacheWrite(DiskCache *c, const uint8_t *buf, uint32_t block, uint32_t count)
+{
+    if (c->writeBlocks == NULL)
+        return false;
+    c->stats.writes++;
+
+    // Write through to any line that holds these blocks
+    for (uint8_t l = 0; l < DISKCACHE_LINES; l++)
+    {
+        uint32_t base = c->lineBlock[l];
+        if (base == DISKCACHE_EMPTY || !_overlaps(block, count, base, c->lineCount[l]))
+            continue;
+        uint32_t first = (block > base) ? block : base;
+        uint32_t last = (block + count < base + c->lineCount[l]) ? block + count : base + c->lineCount[l];
+        memcpy(c->lines[l] + (first - base) * DISKCACHE_BLOCK_SIZE,
+               buf + (first - block) * DISKCACHE_BLOCK_SIZE,
+               (last - first) * DISKCACHE_BLOCK_SIZE);
+    }
+
+    if (count >= DISKCACHE_LINE_BLOCKS)
+    {
+        if (!diskcacheFlush(c))
+            return false;
+        c->stats.writeTransfers++;
+        if (!c->writeBlocks(buf, block, count))
+            return false;
+        c->stats.blocksWritten += count;
+        return true;
+    }
+
+    bool merges = c->pendingCount > 0 && block >= c->pendingBlock &&
+                  block <= c->pendingBlock + c->pendingCount &&
+                  block + count <= c->pendingBlock + DISKCACHE_LINE_BLOCKS;
+    if (!merges)
+    {
+        if (!diskcacheFlush(c))
+            return false;
+        c->pendingBlock = block;
+    }
+    uint32_t offset = block - c->pendingBlock;
+    memcpy(c->pending + offset * DISKCACHE_BLOCK_SIZE, buf, count * DISKCACHE_BLOCK_SIZE);
+    if (offset + count > c->pendingCount)
+        c->pendingCount = offset + count;
+
+    if (c->pendingCount == DISKCACHE_LINE_BLOCKS)
+        return diskcacheFlush(c);
+    return true;
+}
+
+/**
+ * @brief  Writes out held blocks, e.g. for CTRL_SYNC.
+ * @retval false if the transfer failed. The blocks are dropped either way.
+ * @headerfile diskcache.h
+ */
+bool diskcacheFlush(DiskCache *c)
+{
+    if (c->pendingCount == 0)
+        return true;
+    uint32_t count = c->pendingCount;
+    c->pendingCount = 0;
+    c->stats.writeTransfers++;
+    if (!c->writeBlocks(c->pending, c->pendingBlock, count))
+        return false;
+    c->stats.blocksWritten += count;
+    return true;
+}
+
+/**
+ * @brief  Drops every line and held write without touching the device, e.g. after the card was swapped.
+ * @headerfile diskcache.h
+ */
+void diskcacheInvalidate(DiskCache *c)
+{
+    for (uint8_t l = 0; l < DISKCACHE_LINES; l++)
+    {
+        c->lineBlock[l] = DISKCACHE_EMPTY;
+        c->lineCount[l] = 0;
+    }
+    c->victim = 0;
+    c->pendingBlock = 0;
+    c->pendingCount = 0;
+}
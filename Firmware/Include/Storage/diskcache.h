@@ -0,0 +1,79 @@
+/**
+ * @file diskcache.h
+ * @brief Read-ahead and write-combining block cache between FatFs and a block device.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_DISKCACHE_H
+#define __FORGE_DISKCACHE_H
+
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DISKCACHE_BLOCK_SIZE 512
+// 4KiB lines, aligned to 4KiB on the device: the page size of most cards,
+// and one cluster on a card formatted with the default allocation unit
+#define DISKCACHE_LINE_BLOCKS 8
+#define DISKCACHE_LINE_SIZE (DISKCACHE_BLOCK_SIZE * DISKCACHE_LINE_BLOCKS)
+// One line tends to hold the FAT, the other the directory or file data
+#define DISKCACHE_LINES 2
+#define DISKCACHE_EMPTY 0xFFFFFFFF
+
+    /**
+     * @brief Counters, to see how well requests are being coalesced.
+     */
+    typedef struct
+    {
+        uint32_t reads;          // Requests from FatFs
+        uint32_t writes;
+        uint32_t hits;           // Blocks served from a line
+        uint32_t readTransfers;  // Multi-block transfers actually issued
+        uint32_t writeTransfers;
+        uint32_t blocksRead;
+        uint32_t blocksWritten;
+    } DiskCacheStats;
+
+    /**
+     * @brief One cache in front of one block device. Not thread safe; every caller has to go through FatFs or hold off FatFs.
+     */
+    typedef struct
+    {
+        // Both transfer count whole blocks starting at block, in one multi-block command
+        bool (*readBlocks)(uint8_t *buf, uint32_t block, uint32_t count);
+        bool (*writeBlocks)(const uint8_t *buf, uint32_t block, uint32_t count);
+        uint32_t blockCount;
+
+        uint8_t lines[DISKCACHE_LINES][DISKCACHE_LINE_SIZE] __ALIGNED(4); // DMA targets, so not in CCM RAM
+        uint32_t lineBlock[DISKCACHE_LINES]; // First block of each line, or DISKCACHE_EMPTY
+        uint8_t lineCount[DISKCACHE_LINES];  // Valid blocks, short only at the end of the device
+        uint8_t victim;
+
+        // Consecutive small writes are held here and go out as one transfer
+        uint8_t pending[DISKCACHE_LINE_SIZE] __ALIGNED(4);
+        uint32_t pendingBlock;
+        uint32_t pendingCount;
+
+        DiskCacheStats stats;
+    } DiskCache;
+
+    void diskcacheInit(DiskCache *c, bool (*readBlocks)(uint8_t *, uint32_t, uint32_t),
+                       bool (*writeBlocks)(const uint8_t *, uint32_t, uint32_t), uint32_t blockCount);
+    bool diskcacheRead(DiskCache *c, uint8_t *buf, uint32_t block, uint32_t count);
+    bool diskcacheWrite(DiskCache *c, const uint8_t *buf, uint32_t block, uint32_t count);
+    bool diskcacheFlush(DiskCache *c);
+    void diskcacheInvalidate(DiskCache *c);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_DISKCACHE_H */
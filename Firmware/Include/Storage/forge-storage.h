@@ -0,0 +1,70 @@
+/**
+ * @file forge-storage.h
+ * @brief SD card slot of the Forge
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_STORAGE_H
+#define __FORGE_STORAGE_H
+
+#include "sdcard.h"
+#include "sd_diskio.h"
+#include "../Core/profiler.h"
+#include "../FatFs/src/ff.h"
+#include "../FatFs/src/ff_gen_drv.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Define FORGE_SD_CARD on a board revision with the card socket. The SDIO
+    // pins can't be remapped on the F405: PC8-PC12 and PD2, and this board
+    // has the heater MOSFETs on PC11 and PC12 (forge-controllers.h) and the
+    // motherboard fan on PD2. Without it the pins are left alone and
+    // everything that reads the card gets SD_ERROR_NO_CARD.
+    void initStorage(void)
+    {
+#ifdef FORGE_SD_CARD
+        // SDIO is on DMA2 channel 4, streams 3 and 6
+        SDbegin(SDIO_IRQn, DMA2_Stream3, DMA2_Stream3_IRQn,
+                DMA2_Stream6, DMA2_Stream6_IRQn, DMA_CHANNEL_4);
+#else
+        SD_CARD.lastError = SD_ERROR_NO_CARD;
+#endif
+        FATFS_LinkDriver(&SD_Driver, SDPath);
+        f_mount(&SDFatFs, SDPath, 0); // Mounted on first access, from a task
+    }
+
+#ifdef FORGE_SD_CARD
+    void SDIO_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SDirqHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SD);
+    }
+
+    void DMA2_Stream3_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SDdmaRxIRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SD);
+    }
+
+    void DMA2_Stream6_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SDdmaTxIRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SD);
+    }
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_STORAGE_H */
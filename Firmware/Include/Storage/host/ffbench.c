@@ -0,0 +1,218 @@
+/**
+ * @file ffbench.c
+ * @brief Host benchmark of FatFs and the disk cache on a RAM disk, across cluster sizes.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Builds the firmware's FatFs, diskio glue and disk cache for Linux. From Firmware/Include:
+ *
+ *   gcc -O2 -IStorage/host -IFatFs/src -o ffbench Storage/host/ffbench.c Storage/diskcache.c \
+ *       FatFs/src/ff.c FatFs/src/diskio.c FatFs/src/ff_gen_drv.c FatFs/src/option/unicode.c
+ *
+ * For each cluster size it formats the disk, writes a file in 1000 byte pieces
+ * and reads it back in chunks of a few sizes, with and without the cache. A RAM disk makes the host
+ * MB/s a measure of FatFs's own overhead; what matters on the card is how many
+ * commands it takes, so the "sdio" column models the 4-bit 24MHz bus with a
+ * fixed cost per command.
+ */
+
+#include "../diskcache.h"
+#include "ff.h"
+#include "ff_gen_drv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RAMDISK_BLOCKS (64UL * 1024 * 1024 / DISKCACHE_BLOCK_SIZE)
+#define FILE_SIZE (16UL * 1024 * 1024)
+#define SDIO_BYTES_PER_US 12.0 // 4 bits at 24MHz
+#define SDIO_COMMAND_US 250.0  // Command, card access time and stop, per transfer
+
+static const char _line[] = "G1 X10.25 Y-3.5 E0.0412\n";
+#define LINE_LENGTH (sizeof(_line) - 1)
+
+static uint8_t *_disk;
+static DiskCache _cache;
+static int _cached = 1;
+static unsigned long _commands;
+
+static bool _readBlocks(uint8_t *buf, uint32_t block, uint32_t count)
+{
+    memcpy(buf, _disk + (size_t)block * DISKCACHE_BLOCK_SIZE, (size_t)count * DISKCACHE_BLOCK_SIZE);
+    _commands++;
+    return true;
+}
+
+static bool _writeBlocks(const uint8_t *buf, uint32_t block, uint32_t count)
+{
+    memcpy(_disk + (size_t)block * DISKCACHE_BLOCK_SIZE, buf, (size_t)count * DISKCACHE_BLOCK_SIZE);
+    _commands++;
+    return true;
+}
+
+static DSTATUS RAM_initialize(BYTE lun)
+{
+    (void)lun;
+    return 0;
+}
+
+static DSTATUS RAM_status(BYTE lun)
+{
+    (void)lun;
+    return 0;
+}
+
+static DRESULT RAM_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+    (void)lun;
+    if (!_cached)
+        return _readBlocks(buff, sector, count) ? RES_OK : RES_ERROR;
+    return diskcacheRead(&_cache, buff, sector, count) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT RAM_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+    (void)lun;
+    if (!_cached)
+        return _writeBlocks(buff, sector, count) ? RES_OK : RES_ERROR;
+    return diskcacheWrite(&_cache, buff, sector, count) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT RAM_ioctl(BYTE lun, BYTE cmd, void *buff)
+{
+    (void)lun;
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        return (!_cached || diskcacheFlush(&_cache)) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *(DWORD *)buff = RAMDISK_BLOCKS;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = DISKCACHE_BLOCK_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD *)buff = 1;
+        return RES_OK;
+    default:
+        return RES_PARERR;
+    }
+}
+
+static const Diskio_drvTypeDef RAM_Driver = {RAM_initialize, RAM_status, RAM_read, RAM_write, RAM_ioctl};
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double _sdioMBps(unsigned long bytes, unsigned long commands)
+{
+    double us = (double)commands * SDIO_COMMAND_US + (double)bytes / SDIO_BYTES_PER_US;
+    return (double)bytes / us;
+}
+
+/**
+ * @brief  Reads the whole file in chunk-sized f_reads and prints one row.
+ */
+static int _readFile(const char *path, UINT chunk, unsigned long cluster, uint8_t *buf)
+{
+    FIL f;
+    UINT n;
+    diskcacheInvalidate(&_cache);
+    memset(&_cache.stats, 0, sizeof(_cache.stats));
+    if (f_open(&f, path, FA_READ) != FR_OK)
+        return -1;
+    _commands = 0;
+    double start = _now();
+    unsigned long total = 0;
+    do
+    {
+        if (f_read(&f, buf, chunk, &n) != FR_OK)
+            return -1;
+        // Spot check what came back, to catch the cache returning the wrong blocks
+        if (n > 0 && (buf[0] != _line[total % LINE_LENGTH] || buf[n - 1] != _line[(total + n - 1) % LINE_LENGTH]))
+        {
+            printf("%7lu %6u data mismatch at %lu\n", cluster, chunk, total);
+            return -1;
+        }
+        total += n;
+    } while (n == chunk);
+    double s = _now() - start;
+    f_close(&f);
+
+    printf("%7lu %6u %5s %9.1f %9lu %9lu %8.2f\n", cluster, chunk, _cached ? "on" : "off",
+           (double)total / s / 1e6, (unsigned long)(_cached ? _cache.stats.reads : _commands),
+           _commands, _sdioMBps(total, _commands));
+    return 0;
+}
+
+int main(void)
+{
+    static char path[4];
+    static FATFS fs;
+    static uint8_t work[_MAX_SS * 8];
+    static uint8_t buf[16384];
+    static uint8_t readBuf[16384];
+    const unsigned long clusters[] = {512, 1024, 2048, 4096, 8192, 16384, 32768};
+    // Partial sectors, one cache line, and the SD print chunk
+    const UINT chunks[] = {100, 512, 4096, 8192};
+
+    _disk = calloc(RAMDISK_BLOCKS, DISKCACHE_BLOCK_SIZE);
+    if (_disk == NULL || FATFS_LinkDriver(&RAM_Driver, path) != 0)
+        return 1;
+    diskcacheInit(&_cache, _readBlocks, _writeBlocks, RAMDISK_BLOCKS);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)_line[i % LINE_LENGTH];
+
+    printf("cluster  chunk cache   host MB/s  requests  commands sdio MB/s\n");
+    for (size_t c = 0; c < sizeof(clusters) / sizeof(clusters[0]); c++)
+    {
+        _cached = 1;
+        if (f_mkfs(path, FM_ANY, clusters[c], work, sizeof(work)) != FR_OK ||
+            f_mount(&fs, path, 1) != FR_OK)
+        {
+            printf("%7lu format failed\n", clusters[c]);
+            continue;
+        }
+
+        // Written in small pieces, which is where write combining matters
+        FIL f;
+        UINT n;
+        char file[16];
+        snprintf(file, sizeof(file), "%sbench.gco", path);
+        for (_cached = 1; _cached >= 0; _cached--)
+        {
+            // Switching modes leaves the lines stale
+            diskcacheInvalidate(&_cache);
+            _commands = 0;
+            if (f_open(&f, file, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+                return 1;
+            for (unsigned long done = 0; done < FILE_SIZE; done += 1000)
+            {
+                if (f_write(&f, buf + done % LINE_LENGTH, 1000, &n) != FR_OK || n != 1000)
+                    return 1;
+            }
+            f_close(&f);
+            printf("%7lu  write %5s %9s %9s %9lu %8.2f\n", clusters[c], _cached ? "on" : "off", "-", "-",
+                   _commands, _sdioMBps(FILE_SIZE, _commands));
+        }
+
+        for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+        {
+            for (_cached = 1; _cached >= 0; _cached--)
+            {
+                if (_readFile(file, chunks[k], clusters[c], readBuf) != 0)
+                    return 1;
+            }
+        }
+        f_mount(NULL, path, 0);
+    }
+    free(_disk);
+    return 0;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file ffconf.h
+ * @brief FatFs configuration for host builds: the firmware's, plus f_mkfs to format the RAM disk.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "../../Core/ffconf.h"
+
+#undef _USE_MKFS
+#define _USE_MKFS 1
@@ -0,0 +1,294 @@
+/**
+ * @file recovery.c
+ * @brief Journals a running SD print to backup SRAM so it can be resumed after a power loss.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "recovery.h"
+#include "sdprint.h"
+#include "../Core/forge.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Motion/motion.h"
+#include "../Motion/planner.h"
+#include "../Motion/gcode.h"
+#include "../FatFs/src/ff.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// Backup SRAM keeps its contents through resets and, with a cell on VBAT,
+// through power loss, and unlike flash can be rewritten every half second
+// forever
+#define RECOVERY_SLOTS ((RecoveryRecord *)BKPSRAM_BASE)
+
+Recovery RECOVERY;
+
+static StackType_t _journalStack[FORGE_STACK_JOURNAL];
+static StaticTask_t _journalTcb;
+
+static uint32_t _crc32(const void *data, uint32_t length)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--)
+    {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static bool _valid(const RecoveryRecord *r)
+{
+    return r->magic == RECOVERY_MAGIC && r->crc == _crc32(r, offsetof(RecoveryRecord, crc));
+}
+
+/**
+ * @brief  Returns the newest valid slot, or -1.
+ */
+static int8_t _newest(void)
+{
+    bool a = _valid(&RECOVERY_SLOTS[0]);
+    bool b = _valid(&RECOVERY_SLOTS[1]);
+    if (a && b)
+        return ((int32_t)(RECOVERY_SLOTS[1].sequence - RECOVERY_SLOTS[0].sequence) > 0) ? 1 : 0;
+    if (a || b)
+        return a ? 0 : 1;
+    return -1;
+}
+
+/**
+ * @brief  Records where the job is. The offset, position and modes have to agree: all come from the segment being stepped if there is one, and from the parser if the queue is empty. The parser may be hundreds of lines ahead, past a G91 or an F the interrupted line didn't run with.
+ */
+static void _journal(Recovery *rec, SDPrintJob *job)
+{
+    GcodeMachine *m = job->machine;
+    Planner *pl = m->planner;
+    RecoveryRecord *r = &rec->scratch;
+    int32_t steps[FORGE_AXES];
+    MotionTag tag;
+
+    // Keep the print task from parsing another line in between; the step
+    // interrupt is taken care of by motionSnapshot
+    vTaskSuspendAll();
+    r->offset = m->doneOffset;
+    for (uint8_t a = 0; a < FORGE_AXES; a++)
+    {
+        r->position[a] = pl->position[a];
+    }
+    r->feed = m->feed;
+    r->relative = m->relative;
+    r->relativeE = m->relativeE;
+    if (motionSnapshot(&tag, steps))
+    {
+        // Run the whole line again from where its segment started, in the
+        // modes it started in
+        r->offset = tag.offset;
+        for (uint8_t a = 0; a < FORGE_AXES; a++)
+        {
+            r->position[a] = (float32_t)steps[a] / pl->stepsPerMm[a];
+        }
+        r->feed = (float32_t)tag.feed / 60.0f;
+        r->relative = (tag.flags & GCODE_TAG_RELATIVE) != 0;
+        r->relativeE = (tag.flags & GCODE_TAG_RELATIVE_E) != 0;
+    }
+    xTaskResumeAll();
+
+    r->hotendTarget = (m->hotend != NULL) ? m->hotend->target_temp : 0.0f;
+    r->bedTarget = (m->bed != NULL) ? m->bed->target_temp : 0.0f;
+    memcpy(r->path, job->path, SDPRINT_MAX_PATH);
+    r->fileSize = (uint32_t)job->size;
+    if (job->clmt[0] <= SDPRINT_CLMT_LENGTH)
+        memcpy(r->clmt, job->clmt, job->clmt[0] * sizeof(DWORD));
+    else
+        r->clmt[0] = job->clmt[0]; // Didn't fit; the resume builds it again
+    r->reserved = 0;
+    r->magic = RECOVERY_MAGIC;
+    r->sequence = ++rec->sequence;
+    r->crc = _crc32(r, offsetof(RecoveryRecord, crc));
+
+    memcpy(&RECOVERY_SLOTS[rec->next], r, sizeof(RecoveryRecord));
+    rec->next ^= 1;
+    rec->records++;
+}
+
+static void _journalTask(void *arg)
+{
+    (void)arg;
+    Recovery *rec = &RECOVERY;
+    SDPrintJob *job = &SD_PRINT;
+    TickType_t last = xTaskGetTickCount();
+    for (;;)
+    {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(RECOVERY_PERIOD_MS));
+
+        SDPrintState state = job->state;
+        if (state == SDPRINT_RUNNING || state == SDPRINT_PAUSED)
+        {
+            // Benchmarks don't move anything, and a path that didn't fit
+            // can't be opened again
+            if (rec->hold || !job->parse || job->machine->planner->dryRun || job->path[0] == '\0')
+                continue;
+            _journal(rec, job);
+            rec->armed = true;
+        }
+        else if (rec->armed)
+        {
+            // A read error leaves the record, the print can still be resumed
+            if (state == SDPRINT_DONE || job->lastError == SDPRINT_ERROR_ABORTED)
+                recoveryClear();
+            rec->armed = false;
+        }
+    }
+}
+
+/**
+ * @brief  Powers the backup SRAM, finds the newest record in it and creates the journal task. Call once before forgeStartScheduler, after sdprintInit.
+ * @retval None
+ * @headerfile recovery.h
+ */
+void recoveryInit(void)
+{
+    Recovery *rec = &RECOVERY;
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_BKPSRAM_CLK_ENABLE();
+    // The backup regulator is what keeps the SRAM alive on VBAT alone
+    HAL_PWREx_EnableBkUpReg();
+
+    forgeMemoryAdd("journal", RECOVERY_SLOTS, 2 * sizeof(RecoveryRecord));
+    int8_t newest = _newest();
+    rec->sequence = (newest >= 0) ? RECOVERY_SLOTS[newest].sequence : 0;
+    rec->next = (newest == 0) ? 1 : 0;
+    rec->armed = false;
+    rec->hold = false;
+    rec->records = 0;
+    rec->lastError = RECOVERY_ERROR_NONE;
+
+    rec->task = forgeCreateTask(_journalTask, "journal", FORGE_STACK_JOURNAL, FORGE_PRIO_JOURNAL, _journalStack, &_journalTcb);
+}
+
+/**
+ * @brief  Checks for a print that was cut off, e.g. to ask the user whether to resume it.
+ * @param[out]  out receives the record, if not NULL.
+ * @retval true if there is one.
+ * @headerfile recovery.h
+ */
+bool recoveryPending(RecoveryRecord *out)
+{
+    int8_t newest = _newest();
+    if (newest < 0)
+        return false;
+    if (out != NULL)
+        memcpy(out, &RECOVERY_SLOTS[newest], sizeof(RecoveryRecord));
+    return true;
+}
+
+/**
+ * @brief  Forgets the journaled print, e.g. when the user declines to resume it.
+ * @headerfile recovery.h
+ */
+void recoveryClear(void)
+{
+    RECOVERY_SLOTS[0].magic = 0;
+    RECOVERY_SLOTS[1].magic = 0;
+}
+
+/**
+ * @brief  Runs one command built in place, without going through the text parser.
+ */
+static void _command(GcodeMachine *m, char letter, uint16_t code, const char *words, const float32_t *values)
+{
+    GcodeCommand cmd;
+    cmd.letter = letter;
+    cmd.code = code;
+    cmd.present = 0;
+    cmd.text = NULL;
+    cmd.textLength = 0;
+    for (uint8_t i = 0; words[i] != '\0'; i++)
+    {
+        cmd.present |= 1UL << (words[i] - 'A');
+        cmd.value[words[i] - 'A'] = values[i];
+    }
+    gcodeExecute(m, &cmd);
+}
+
+/**
+ * @brief  Resumes the journaled print. Lifts Z off the part, rehomes X and Y, reheats, moves back to where the interrupted line started and carries on from that line. Z is assumed not to have moved, which holds for a lead screw with the motors off.
+ * @retval RECOVERY_ERROR_NONE once the print is running again; also stored in RECOVERY.lastError. Blocks for as long as heating takes, so call it from a task other than the print task.
+ * @headerfile recovery.h
+ */
+RecoveryError recoveryResume(void)
+{
+    Recovery *rec = &RECOVERY;
+    RecoveryRecord r;
+    if (!recoveryPending(&r))
+        return rec->lastError = RECOVERY_ERROR_NO_RECORD;
+
+    // Open the file and seek before touching the machine, but hold off
+    // parsing. The size is only looked at once the job has the card.
+    rec->hold = true;
+    SDPrintError err = sdprintStartAt(r.path, r.offset, (r.clmt[0] <= SDPRINT_CLMT_LENGTH) ? r.clmt : NULL, true);
+    if (err != SDPRINT_ERROR_NONE)
+    {
+        rec->hold = false;
+        return rec->lastError = (err == SDPRINT_ERROR_FILE_CHANGED || err == SDPRINT_ERROR_FAILED_OPEN) ? RECOVERY_ERROR_FILE_CHANGED : RECOVERY_ERROR_FAILED_START;
+    }
+    if (SD_PRINT.size != r.fileSize)
+    {
+        sdprintAbort();
+        while (SD_PRINT.state == SDPRINT_PAUSED)
+        {
+            forgeDelay(10);
+        }
+        rec->hold = false;
+        return rec->lastError = RECOVERY_ERROR_FILE_CHANGED;
+    }
+
+    GcodeMachine *m = SD_PRINT.machine;
+    m->relative = false;
+    m->relativeE = false;
+
+    float32_t v[4];
+    v[0] = 0.0f;
+    v[1] = 0.0f;
+    v[2] = r.position[MOTION_AXIS_Z];
+    v[3] = r.position[MOTION_AXIS_E];
+    _command(m, 'G', 92, "XYZE", v);
+    v[0] = r.position[MOTION_AXIS_Z] + RECOVERY_LIFT_MM;
+    v[1] = m->planner->maxFeed[MOTION_AXIS_Z] * 60.0f;
+    _command(m, 'G', 1, "ZF", v);
+    _command(m, 'G', 28, "XY", v); // Only the letters matter
+
+    // Bed first, so the nozzle isn't left oozing while the bed catches up
+    _command(m, 'M', 140, "S", &r.bedTarget);
+    _command(m, 'M', 104, "S", &r.hotendTarget);
+    if (r.bedTarget > 0.0f)
+        _command(m, 'M', 190, "S", &r.bedTarget);
+    if (r.hotendTarget > 0.0f)
+        _command(m, 'M', 109, "S", &r.hotendTarget);
+
+    v[0] = r.position[MOTION_AXIS_X];
+    v[1] = r.position[MOTION_AXIS_Y];
+    v[2] = RECOVERY_TRAVEL_FEED;
+    _command(m, 'G', 1, "XYF", v);
+    v[0] = r.position[MOTION_AXIS_Z];
+    _command(m, 'G', 1, "Z", v);
+    plannerSync(m->planner);
+
+    m->feed = r.feed;
+    m->relative = r.relative;
+    m->relativeE = r.relativeE;
+    rec->hold = false;
+    sdprintResume();
+    return rec->lastError = RECOVERY_ERROR_NONE;
+}
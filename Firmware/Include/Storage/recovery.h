@@ -0,0 +1,97 @@
+/**
+ * @file recovery.h
+ * @brief Journals a running SD print to backup SRAM so it can be resumed after a power loss.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_RECOVERY_H
+#define __FORGE_RECOVERY_H
+
+#include "sdprint.h"
+#include "../Motion/gcode.h"
+#include "../FatFs/src/ff.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../DSP/Include/arm_math.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define RECOVERY_MAGIC 0x43455246 // "FREC"
+#define RECOVERY_PERIOD_MS 500
+#define RECOVERY_LIFT_MM 2.0f       // Z clearance while rehoming X and Y
+#define RECOVERY_TRAVEL_FEED 3000.0f // mm/min, back to where the print stopped
+
+    /**
+     * @brief Stores an error from the last resume.
+     */
+    typedef enum
+    {
+        RECOVERY_ERROR_NONE = 0,
+        RECOVERY_ERROR_NO_RECORD,
+        RECOVERY_ERROR_FILE_CHANGED, // Missing, or a different size or place on the card
+        RECOVERY_ERROR_FAILED_START
+    } RecoveryError;
+
+    /**
+     * @brief One journal entry. Two of these alternate in backup SRAM, so a power loss mid-write leaves the previous one intact.
+     */
+    typedef struct
+    {
+        uint32_t magic;
+        uint32_t sequence;
+
+        char path[SDPRINT_MAX_PATH];
+        uint32_t fileSize;
+        uint32_t offset; // Start of the first line to run again
+
+        float32_t position[FORGE_AXES]; // mm, where the machine was before that line
+        float32_t feed;                 // mm/s
+        float32_t hotendTarget;
+        float32_t bedTarget;
+        uint8_t relative;
+        uint8_t relativeE;
+        uint16_t reserved;
+
+        DWORD clmt[SDPRINT_CLMT_LENGTH]; // Link map of the file, see SDPrintJob
+
+        uint32_t crc; // CRC-32 of everything above
+    } RecoveryRecord;
+
+    /**
+     * @brief State of the journal.
+     */
+    typedef struct
+    {
+        RecoveryRecord scratch; // Built here, then copied to backup SRAM in one go
+        uint32_t sequence;
+        uint8_t next;     // Slot the next record goes in
+        bool armed;       // The running job has been journaled
+        volatile bool hold; // Set while recoveryResume moves the machine
+
+        TaskHandle_t task;
+        uint32_t records; // Records written since boot
+
+        RecoveryError lastError;
+    } Recovery;
+
+    extern Recovery RECOVERY;
+
+    void recoveryInit(void);
+    bool recoveryPending(RecoveryRecord *out);
+    void recoveryClear(void);
+    RecoveryError recoveryResume(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_RECOVERY_H */
@@ -0,0 +1,100 @@
+/**
+ * @file sd_diskio.c
+ * @brief FatFs disk driver for the SD card.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "sd_diskio.h"
+#include "sdcard.h"
+#include "diskcache.h"
+#include "../FatFs/src/ff_gen_drv.h"
+
+DiskCache SD_CACHE;
+
+static bool _readBlocks(uint8_t *buf, uint32_t block, uint32_t count)
+{
+    return SDreadBlocks(buf, block, count) == SD_ERROR_NONE;
+}
+
+static bool _writeBlocks(const uint8_t *buf, uint32_t block, uint32_t count)
+{
+    return SDwriteBlocks(buf, block, count) == SD_ERROR_NONE;
+}
+
+static DSTATUS SD_initialize(BYTE lun)
+{
+    (void)lun;
+    // The card is brought up once by SDbegin; FatFs just checks it worked
+    if (!SD_CARD.ready)
+        return STA_NOINIT;
+    diskcacheInit(&SD_CACHE, _readBlocks, _writeBlocks, SD_CARD.blockCount);
+    return 0;
+}
+
+static DSTATUS SD_status(BYTE lun)
+{
+    (void)lun;
+    return SD_CARD.ready ? 0 : STA_NOINIT;
+}
+
+static DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+    (void)lun;
+    // f_read hands over every whole sector it can in one call, so a large
+    // aligned read is still a single multi-block transfer. The single
+    // sectors FatFs reads for the FAT, directories and partial reads pull in
+    // the 4KiB around them.
+    return diskcacheRead(&SD_CACHE, buff, sector, count) ? RES_OK : RES_ERROR;
+}
+
+#if _USE_WRITE == 1
+static DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+    (void)lun;
+    return diskcacheWrite(&SD_CACHE, buff, sector, count) ? RES_OK : RES_ERROR;
+}
+#endif
+
+#if _USE_IOCTL == 1
+static DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
+{
+    (void)lun;
+    if (!SD_CARD.ready)
+        return RES_NOTRDY;
+
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        if (!diskcacheFlush(&SD_CACHE))
+            return RES_ERROR;
+        return (SDsync() == SD_ERROR_NONE) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *(DWORD *)buff = SD_CARD.blockCount;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = SD_BLOCK_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD *)buff = SD_CARD.eraseBlockSize;
+        return RES_OK;
+    default:
+        return RES_PARERR;
+    }
+}
+#endif
+
+const Diskio_drvTypeDef SD_Driver =
+    {
+        SD_initialize,
+        SD_status,
+        SD_read,
+#if _USE_WRITE == 1
+        SD_write,
+#endif
+#if _USE_IOCTL == 1
+        SD_ioctl,
+#endif
+};
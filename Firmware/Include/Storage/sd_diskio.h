@@ -0,0 +1,33 @@
+/**
+ * @file sd_diskio.h
+ * @brief FatFs disk driver for the SD card.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_SD_DISKIO_H
+#define __FORGE_SD_DISKIO_H
+
+#include "diskcache.h"
+#include "../FatFs/src/ff_gen_drv.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern const Diskio_drvTypeDef SD_Driver;
+    // Everything that reads or writes the card goes through this, so FatFs
+    // and anything else sharing the card see the same data
+    extern DiskCache SD_CACHE;
+
+    extern char SDPath[4];
+    extern FATFS SDFatFs;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SD_DISKIO_H */
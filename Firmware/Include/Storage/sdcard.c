@@ -0,0 +1,380 @@
+/**
+ * @file sdcard.c
+ * @brief SDIO + DMA driver for the SD card slot.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "sdcard.h"
+#include "../Core/forge.h"
+#include "../Core/memory.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+SDCard SD_CARD;
+
+static GPIO_InitTypeDef GPIO_InitStruct;
+static StaticSemaphore_t _doneBuffer;
+static StaticSemaphore_t _lockBuffer;
+
+static void _initDMA(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t channel,
+                     uint32_t direction, IRQn_Type irqn)
+{
+    hdma->Instance = stream;
+    hdma->Init.Channel = channel;
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    // The SDIO decides when the transfer ends, so multi-block reads and
+    // writes are one DMA transfer no matter how many blocks they cover
+    hdma->Init.Mode = DMA_PFCTRL;
+    hdma->Init.Priority = DMA_PRIORITY_VERY_HIGH;
+    hdma->Init.FIFOMode = DMA_FIFOMODE_ENABLE;
+    hdma->Init.FIFOThreshold = DMA_FIFO_THRESHOLD_FULL;
+    hdma->Init.MemBurst = DMA_MBURST_INC4;
+    hdma->Init.PeriphBurst = DMA_PBURST_INC4;
+    HAL_DMA_Init(hdma);
+
+    HAL_NVIC_SetPriority(irqn, 5, 0);
+    HAL_NVIC_EnableIRQ(irqn);
+}
+
+/**
+ * @brief  Brings up the card in 4-bit mode at 24MHz. The SDIO pins are fixed on the F405: PC8-PC11 are D0-D3, PC12 is CK and PD2 is CMD. Check SD_CARD.lastError afterwards; with no card it is SD_ERROR_FAILED_INIT and every later call fails with SD_ERROR_NO_CARD.
+ * @param[in]  sdioIRQn is SDIO_IRQn. Its handler must call SDirqHandler().
+ * @param[in]  rxStream and txStream are the DMA2 streams wired to the SDIO request (stream 3 or 6, and the other one).
+ * @param[in]  rxIRQn and txIRQn are their IRQs. The handlers must call SDdmaRxIRQHandler() and SDdmaTxIRQHandler().
+ * @param[in]  dmaChannel is the SDIO request channel, DMA_CHANNEL_4.
+ * @retval None
+ * @headerfile sdcard.h
+ */
+void SDbegin(IRQn_Type sdioIRQn, DMA_Stream_TypeDef *rxStream, IRQn_Type rxIRQn,
+             DMA_Stream_TypeDef *txStream, IRQn_Type txIRQn, uint32_t dmaChannel)
+{
+    SDCard *sd = &SD_CARD;
+    forgeInitHAL();
+
+    sd->ready = false;
+    sd->busy = false;
+    sd->failed = false;
+    sd->owner = SD_OWNER_NONE;
+    if (sd->done == NULL)
+        sd->done = xSemaphoreCreateBinaryStatic(&_doneBuffer);
+    if (sd->lock == NULL)
+        sd->lock = xSemaphoreCreateMutexStatic(&_lockBuffer);
+
+    __HAL_RCC_SDIO_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_GPIOD_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_12;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF12_SDIO;
+    HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = GPIO_PIN_2;
+    HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
+
+    _initDMA(&sd->hdmaRx, rxStream, dmaChannel, DMA_PERIPH_TO_MEMORY, rxIRQn);
+    _initDMA(&sd->hdmaTx, txStream, dmaChannel, DMA_MEMORY_TO_PERIPH, txIRQn);
+    __HAL_LINKDMA(&sd->hsd, hdmarx, sd->hdmaRx);
+    __HAL_LINKDMA(&sd->hsd, hdmatx, sd->hdmaTx);
+
+    // Card identification has to run at 400KHz in 1-bit mode; HAL_SD_Init
+    // handles that and then switches to ClockDiv
+    sd->hsd.Instance = SDIO;
+    sd->hsd.Init.ClockEdge = SDIO_CLOCK_EDGE_RISING;
+    sd->hsd.Init.ClockBypass = SDIO_CLOCK_BYPASS_DISABLE;
+    sd->hsd.Init.ClockPowerSave = SDIO_CLOCK_POWER_SAVE_DISABLE;
+    sd->hsd.Init.BusWide = SDIO_BUS_WIDE_1B;
+    // Hardware flow control glitches on the F4 (see the errata); DMA with a
+    // full FIFO threshold keeps up at 24MHz without it
+    sd->hsd.Init.HardwareFlowControl = SDIO_HARDWARE_FLOW_CONTROL_DISABLE;
+    sd->hsd.Init.ClockDiv = SDIO_TRANSFER_CLK_DIV;
+
+    HAL_NVIC_SetPriority(sdioIRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(sdioIRQn);
+
+    if (HAL_SD_Init(&sd->hsd) != HAL_OK)
+    {
+        sd->lastError = SD_ERROR_FAILED_INIT;
+        return;
+    }
+    if (HAL_SD_ConfigWideBusOperation(&sd->hsd, SDIO_BUS_WIDE_4B) != HAL_OK)
+    {
+        sd->lastError = SD_ERROR_FAILED_INIT;
+        return;
+    }
+
+    HAL_SD_CardInfoTypeDef info;
+    HAL_SD_GetCardInfo(&sd->hsd, &info);
+    sd->blockCount = info.LogBlockNbr;
+    sd->eraseBlockSize = info.LogBlockSize / SD_BLOCK_SIZE;
+    sd->ready = true;
+    sd->lastError = SD_ERROR_NONE;
+}
+
+static void _complete(bool failed)
+{
+    SD_CARD.failed = failed;
+    SD_CARD.busy = false;
+    if (forgeSchedulerRunning())
+    {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(SD_CARD.done, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd)
+{
+    (void)hsd;
+    _complete(false);
+}
+
+void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
+{
+    (void)hsd;
+    _complete(false);
+}
+
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+    (void)hsd;
+    _complete(true);
+}
+
+/**
+ * @brief  Waits for the running DMA transfer to finish, then for the card to be ready for the next command. A task sleeps on the semaphore; before the scheduler starts this spins instead.
+ */
+static SDError _wait(void)
+{
+    SDCard *sd = &SD_CARD;
+    uint32_t start = HAL_GetTick();
+
+    if (forgeSchedulerRunning() && !xPortIsInsideInterrupt())
+    {
+        if (xSemaphoreTake(sd->done, pdMS_TO_TICKS(SD_TIMEOUT_MS)) != pdTRUE)
+        {
+            HAL_SD_Abort(&sd->hsd);
+            sd->busy = false;
+            return SD_ERROR_TIMEOUT;
+        }
+    }
+    else
+    {
+        while (sd->busy)
+        {
+            if (HAL_GetTick() - start > SD_TIMEOUT_MS)
+            {
+                HAL_SD_Abort(&sd->hsd);
+                sd->busy = false;
+                return SD_ERROR_TIMEOUT;
+            }
+        }
+    }
+    if (sd->failed)
+        return SD_ERROR_FAILED_TRANSFER;
+
+    // Reads come back in transfer state almost at once; writes stay in
+    // programming state while the card commits them
+    while (HAL_SD_GetCardState(&sd->hsd) != HAL_SD_CARD_TRANSFER)
+    {
+        if (HAL_GetTick() - start > SD_TIMEOUT_MS)
+            return SD_ERROR_TIMEOUT;
+        if (forgeSchedulerRunning())
+            taskYIELD();
+    }
+    return SD_ERROR_NONE;
+}
+
+static SDError _transfer(uint8_t *buf, uint32_t block, uint32_t count, bool write)
+{
+    SDCard *sd = &SD_CARD;
+    if (forgeSchedulerRunning())
+        xSemaphoreTake(sd->done, 0); // Drop a completion left over from a timed out transfer
+
+    sd->failed = false;
+    sd->busy = true;
+    HAL_StatusTypeDef status = write ? HAL_SD_WriteBlocks_DMA(&sd->hsd, buf, block, count)
+                                     : HAL_SD_ReadBlocks_DMA(&sd->hsd, buf, block, count);
+    if (status != HAL_OK)
+    {
+        sd->busy = false;
+        return SD_ERROR_FAILED_TRANSFER;
+    }
+    return _wait();
+}
+
+static void _lock(void)
+{
+    if (forgeSchedulerRunning() && !xPortIsInsideInterrupt())
+        xSemaphoreTake(SD_CARD.lock, portMAX_DELAY);
+}
+
+static void _unlock(void)
+{
+    if (forgeSchedulerRunning() && !xPortIsInsideInterrupt())
+        xSemaphoreGive(SD_CARD.lock);
+}
+
+/**
+ * @brief  Returns whether DMA can use buf directly. It can't reach the CCM RAM, and the SDIO FIFO is word wide.
+ */
+static bool _dmaCapable(const void *buf)
+{
+    uint32_t addr = (uint32_t)buf;
+    return (addr & 3) == 0 && !(addr >= CCMDATARAM_BASE && addr <= CCMDATARAM_END);
+}
+
+/**
+ * @brief  Reads count consecutive blocks in a single multi-block command, blocking the calling task until they arrive.
+ * @param[out]  buf receives count * SD_BLOCK_SIZE bytes. Word aligned buffers outside CCM RAM are filled directly by DMA; others go through SD_CARD.scratch one block at a time.
+ * @param[in]  block is the first block number.
+ * @param[in]  count is the number of blocks.
+ * @retval SD_ERROR_NONE on success; also stored in SD_CARD.lastError.
+ * @headerfile sdcard.h
+ */
+SDError SDreadBlocks(uint8_t *buf, uint32_t block, uint32_t count)
+{
+    SDCard *sd = &SD_CARD;
+    if (!sd->ready)
+        return sd->lastError = SD_ERROR_NO_CARD;
+
+    _lock();
+    SDError err = SD_ERROR_NONE;
+    if (_dmaCapable(buf))
+    {
+        err = _transfer(buf, block, count, false);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count && err == SD_ERROR_NONE; i++)
+        {
+            err = _transfer((uint8_t *)sd->scratch, block + i, 1, false);
+            if (err == SD_ERROR_NONE)
+                memcpy(buf + i * SD_BLOCK_SIZE, sd->scratch, SD_BLOCK_SIZE);
+        }
+    }
+    _unlock();
+    return sd->lastError = err;
+}
+
+/**
+ * @brief  Writes count consecutive blocks in a single multi-block command, blocking the calling task until the card has committed them.
+ * @param[in]  buf holds count * SD_BLOCK_SIZE bytes. See SDreadBlocks for alignment.
+ * @param[in]  block is the first block number.
+ * @param[in]  count is the number of blocks.
+ * @retval SD_ERROR_NONE on success; also stored in SD_CARD.lastError.
+ * @headerfile sdcard.h
+ */
+SDError SDwriteBlocks(const uint8_t *buf, uint32_t block, uint32_t count)
+{
+    SDCard *sd = &SD_CARD;
+    if (!sd->ready)
+        return sd->lastError = SD_ERROR_NO_CARD;
+
+    _lock();
+    SDError err = SD_ERROR_NONE;
+    if (_dmaCapable(buf))
+    {
+        err = _transfer((uint8_t *)buf, block, count, true);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count && err == SD_ERROR_NONE; i++)
+        {
+            memcpy(sd->scratch, buf + i * SD_BLOCK_SIZE, SD_BLOCK_SIZE);
+            err = _transfer((uint8_t *)sd->scratch, block + i, 1, true);
+        }
+    }
+    _unlock();
+    return sd->lastError = err;
+}
+
+/**
+ * @brief  Waits until the card has finished any internal programming.
+ * @retval SD_ERROR_NONE once the card is idle.
+ * @headerfile sdcard.h
+ */
+SDError SDsync(void)
+{
+    SDCard *sd = &SD_CARD;
+    if (!sd->ready)
+        return sd->lastError = SD_ERROR_NO_CARD;
+    _lock();
+    SDError err = SD_ERROR_NONE;
+    uint32_t start = HAL_GetTick();
+    while (HAL_SD_GetCardState(&sd->hsd) != HAL_SD_CARD_TRANSFER)
+    {
+        if (HAL_GetTick() - start > SD_TIMEOUT_MS)
+        {
+            err = SD_ERROR_TIMEOUT;
+            break;
+        }
+        forgeDelay(0);
+    }
+    _unlock();
+    return sd->lastError = err;
+}
+
+/**
+ * @brief  Takes the card for owner if nobody has it. Whoever gets it keeps it until SDrelease, and everyone else is turned away meanwhile. Call from a task.
+ * @param[in]  owner is who wants the card.
+ * @retval true if owner has the card now.
+ * @headerfile sdcard.h
+ */
+bool SDclaim(SDOwner owner)
+{
+    SDCard *sd = &SD_CARD;
+    bool claimed = false;
+    taskENTER_CRITICAL();
+    if (sd->owner == SD_OWNER_NONE)
+    {
+        sd->owner = owner;
+        claimed = true;
+    }
+    taskEXIT_CRITICAL();
+    return claimed;
+}
+
+/**
+ * @brief  Gives the card back, if owner has it.
+ * @param[in]  owner is who took it with SDclaim.
+ * @retval None
+ * @headerfile sdcard.h
+ */
+void SDrelease(SDOwner owner)
+{
+    SDCard *sd = &SD_CARD;
+    taskENTER_CRITICAL();
+    if (sd->owner == owner)
+        sd->owner = SD_OWNER_NONE;
+    taskEXIT_CRITICAL();
+}
+
+void SDirqHandler(void)
+{
+    HAL_SD_IRQHandler(&SD_CARD.hsd);
+}
+
+void SDdmaRxIRQHandler(void)
+{
+    HAL_DMA_IRQHandler(SD_CARD.hsd.hdmarx);
+}
+
+void SDdmaTxIRQHandler(void)
+{
+    HAL_DMA_IRQHandler(SD_CARD.hsd.hdmatx);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file sdcard.h
+ * @brief SDIO + DMA driver for the SD card slot.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_SDCARD_H
+#define __FORGE_SDCARD_H
+
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SD_BLOCK_SIZE 512
+#define SD_TIMEOUT_MS 1000
+
+    /**
+     * @brief Stores an error from the last SD card operation.
+     */
+    typedef enum
+    {
+        SD_ERROR_NONE = 0,
+        SD_ERROR_NO_CARD,
+        SD_ERROR_FAILED_INIT,
+        SD_ERROR_FAILED_TRANSFER,
+        SD_ERROR_TIMEOUT
+    } SDError;
+
+    /**
+     * @brief Who has the card. A USB host mounts it whole and FatFs isn't built reentrant, so one of them at a time: see SDclaim.
+     */
+    typedef enum
+    {
+        SD_OWNER_NONE = 0,
+        SD_OWNER_MSC,  // Mounted by a USB host, so FatFs has to stay off the card
+        SD_OWNER_PUSH, // A file is being uploaded over the network
+        SD_OWNER_PRINT // A print, or sdprintBenchmark, is reading a file
+    } SDOwner;
+
+    /**
+     * @brief State of the single SD card slot.
+     */
+    typedef struct
+    {
+        SD_HandleTypeDef hsd;
+        DMA_HandleTypeDef hdmaRx;
+        DMA_HandleTypeDef hdmaTx;
+        SemaphoreHandle_t done; // Given from the transfer complete/error callbacks
+        SemaphoreHandle_t lock; // One transfer at a time, e.g. FatFs and USB mass storage
+        volatile bool busy;
+        volatile bool failed;
+
+        bool ready;
+        uint32_t blockCount;
+        uint32_t eraseBlockSize; // In blocks
+        volatile SDOwner owner; // Changed only by SDclaim and SDrelease
+
+        uint32_t scratch[SD_BLOCK_SIZE / 4]; // For buffers DMA can't reach
+
+        SDError lastError;
+    } SDCard;
+
+    extern SDCard SD_CARD;
+
+    void SDbegin(IRQn_Type sdioIRQn, DMA_Stream_TypeDef *rxStream, IRQn_Type rxIRQn,
+                 DMA_Stream_TypeDef *txStream, IRQn_Type txIRQn, uint32_t dmaChannel);
+    SDError SDreadBlocks(uint8_t *buf, uint32_t block, uint32_t count);
+    SDError SDwriteBlocks(const uint8_t *buf, uint32_t block, uint32_t count);
+    SDError SDsync(void);
+    bool SDclaim(SDOwner owner);
+    void SDrelease(SDOwner owner);
+
+    void SDirqHandler(void);
+    void SDdmaRxIRQHandler(void);
+    void SDdmaTxIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SDCARD_H */
@@ -0,0 +1,347 @@
+/**
+ * @file sdprint.c
+ * @brief Prints a G-code file from the SD card without a host.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "sdprint.h"
+#include "sdcard.h"
+#include "../Core/forge.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Motion/motion.h"
+#include "../FatFs/src/ff.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+SDPrintJob SD_PRINT;
+
+static StaticSemaphore_t _emptyBuffer;
+static StaticSemaphore_t _fullBuffer;
+static StackType_t _readerStack[FORGE_STACK_STORAGE];
+static StaticTask_t _readerTcb;
+static StackType_t _printStack[FORGE_STACK_PLANNER];
+static StaticTask_t _printTcb;
+
+/**
+ * @brief  Fills whichever buffer the print task has released. f_read copies whole sectors straight into the buffer, so each chunk is one multi-block DMA read and the CPU is free for parsing while it runs.
+ */
+static void _readerTask(void *arg)
+{
+    (void)arg;
+    SDPrintJob *job = &SD_PRINT;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint8_t w = 0;
+        for (;;)
+        {
+            if (xSemaphoreTake(job->empty, pdMS_TO_TICKS(100)) != pdTRUE)
+            {
+                if (job->abortRequested)
+                    break;
+                continue;
+            }
+            if (job->abortRequested)
+                break;
+
+            UINT n = 0;
+            if (f_read(&job->file, job->buffers[w], SDPRINT_CHUNK, &n) != FR_OK)
+            {
+                job->lastError = SDPRINT_ERROR_FAILED_READ;
+                n = 0;
+            }
+            job->lengths[w] = n;
+            xSemaphoreGive(job->full);
+            w ^= 1;
+
+            // A short chunk, possibly empty, marks the end of the file
+            if (n < SDPRINT_CHUNK)
+                break;
+        }
+        job->readerDone = true;
+    }
+}
+
+/**
+ * @brief  Parses each buffer as it arrives. Moves block in the planner while the motion queue is full, which is what paces the whole pipeline.
+ */
+static void _printTask(void *arg)
+{
+    (void)arg;
+    SDPrintJob *job = &SD_PRINT;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        GcodeMachine *m = job->machine;
+        bool streaming = job->parse && !m->planner->dryRun;
+        bool finished = false;
+        uint8_t r = 0;
+
+        motionSetStreaming(streaming);
+        while (!finished && !job->abortRequested)
+        {
+            if (job->state == SDPRINT_PAUSED)
+            {
+                // Running dry while paused is expected
+                motionSetStreaming(false);
+                forgeDelay(10);
+                continue;
+            }
+            motionSetStreaming(streaming);
+            if (xSemaphoreTake(job->full, pdMS_TO_TICKS(100)) != pdTRUE)
+                continue;
+
+            UINT n = job->lengths[r];
+            UINT skip = (job->skip < n) ? job->skip : n;
+            job->skip = 0;
+            if (job->parse)
+                gcodeFeed(m, job->buffers[r] + skip, n - skip);
+            job->consumed += n;
+            finished = n < SDPRINT_CHUNK;
+            xSemaphoreGive(job->empty);
+            r ^= 1;
+        }
+        if (finished && job->parse)
+            gcodeFinish(m);
+        // The queue draining after the last line isn't an underrun
+        motionSetStreaming(false);
+
+        while (!job->readerDone)
+        {
+            forgeDelay(1);
+        }
+        f_close(&job->file);
+        // Before the state changes, so whoever waits for the end can start
+        // the next job
+        SDrelease(SD_OWNER_PRINT);
+        if (finished && job->parse)
+            plannerSync(m->planner);
+
+        job->endTick = HAL_GetTick();
+        if (job->abortRequested)
+            job->lastError = SDPRINT_ERROR_ABORTED;
+        job->state = (job->lastError == SDPRINT_ERROR_NONE) ? SDPRINT_DONE : SDPRINT_FAILED;
+    }
+}
+
+/**
+ * @brief  Creates the reader and print tasks. Call once before forgeStartScheduler, after the card and FatFs driver are set up.
+ * @param[in]  machine is the interpreter that runs the file.
+ * @retval None
+ * @headerfile sdprint.h
+ */
+void sdprintInit(GcodeMachine *machine)
+{
+    SDPrintJob *job = &SD_PRINT;
+    job->machine = machine;
+    job->parse = true;
+    job->state = SDPRINT_IDLE;
+    job->lastError = SDPRINT_ERROR_NONE;
+    job->empty = xSemaphoreCreateCountingStatic(2, 0, &_emptyBuffer);
+    job->full = xSemaphoreCreateCountingStatic(2, 0, &_fullBuffer);
+    forgeMemoryAdd("sd print", job, sizeof(*job));
+
+    // The reader mostly sleeps on DMA, so it runs above the print task and
+    // starts the next read the moment a buffer comes free
+    job->reader = forgeCreateTask(_readerTask, "sdread", FORGE_STACK_STORAGE, FORGE_PRIO_STORAGE, _readerStack, &_readerTcb);
+    job->printer = forgeCreateTask(_printTask, "print", FORGE_STACK_PLANNER, FORGE_PRIO_PLANNER, _printStack, &_printTcb);
+}
+
+/**
+ * @brief  Opens a file and starts printing it in the background.
+ * @param[in]  path is the FatFs path of the file, e.g. "0:/part.gcode".
+ * @retval SDPRINT_ERROR_NONE if the job started; also stored in SD_PRINT.lastError.
+ * @headerfile sdprint.h
+ */
+SDPrintError sdprintStart(const char *path)
+{
+    return sdprintStartAt(path, 0, NULL, false);
+}
+
+/**
+ * @brief  Opens a file and starts printing it from the start of a line part way through, e.g. to resume after a power loss.
+ * @param[in]  path is the FatFs path of the file.
+ * @param[in]  offset is the offset in the file of the first line to run. The file is read from the sector it's in, so reads stay sector-aligned.
+ * @param[in]  clmt is a link map saved from SD_PRINT.clmt when the file was last printed, or NULL to build one. With it the seek is a table lookup instead of a walk of the FAT.
+ * @param[in]  paused starts the job in SDPRINT_PAUSED, so the machine can be brought back to where it was before sdprintResume.
+ * @retval SDPRINT_ERROR_NONE if the job started; also stored in SD_PRINT.lastError.
+ * @headerfile sdprint.h
+ */
+SDPrintError sdprintStartAt(const char *path, FSIZE_t offset, const DWORD *clmt, bool paused)
+{
+    SDPrintJob *job = &SD_PRINT;
+    if (job->state == SDPRINT_RUNNING || job->state == SDPRINT_PAUSED)
+        return SDPRINT_ERROR_BUSY;
+    // A USB host or a push may be halfway through writing the very file.
+    // The job keeps the card until it ends, paused or not.
+    if (!SDclaim(SD_OWNER_PRINT))
+        return SDPRINT_ERROR_BUSY;
+
+    if (f_open(&job->file, path, FA_READ) != FR_OK)
+    {
+        SDrelease(SD_OWNER_PRINT);
+        job->state = SDPRINT_FAILED;
+        return job->lastError = SDPRINT_ERROR_FAILED_OPEN;
+    }
+
+    // Fast seek mode. The map is kept with the job so it can be journaled.
+    job->file.cltbl = job->clmt;
+    if (clmt != NULL && clmt[0] <= SDPRINT_CLMT_LENGTH)
+    {
+        // The first fragment starts at the file's first cluster
+        if (clmt[2] != job->file.obj.sclust)
+        {
+            f_close(&job->file);
+            SDrelease(SD_OWNER_PRINT);
+            job->state = SDPRINT_FAILED;
+            return job->lastError = SDPRINT_ERROR_FILE_CHANGED;
+        }
+        memcpy(job->clmt, clmt, clmt[0] * sizeof(DWORD));
+    }
+    else
+    {
+        job->clmt[0] = SDPRINT_CLMT_LENGTH;
+        if (f_lseek(&job->file, CREATE_LINKMAP) != FR_OK)
+            job->file.cltbl = NULL; // Too fragmented; seeks walk the FAT instead
+    }
+
+    job->skip = (UINT)(offset % _MAX_SS);
+    if (offset > 0 && f_lseek(&job->file, offset - job->skip) != FR_OK)
+    {
+        f_close(&job->file);
+        SDrelease(SD_OWNER_PRINT);
+        job->state = SDPRINT_FAILED;
+        return job->lastError = SDPRINT_ERROR_FAILED_SEEK;
+    }
+
+    if (strlen(path) < SDPRINT_MAX_PATH)
+        strcpy(job->path, path);
+    else
+        job->path[0] = '\0';
+
+    job->size = f_size(&job->file);
+    job->consumed = offset - job->skip;
+    job->abortRequested = false;
+    job->readerDone = false;
+    job->lastError = SDPRINT_ERROR_NONE;
+    job->machine->length = 0;
+    job->machine->overflow = false;
+    job->machine->streamOffset = (uint32_t)offset;
+    job->machine->lineOffset = (uint32_t)offset;
+    job->machine->doneOffset = (uint32_t)offset;
+
+    xQueueReset((QueueHandle_t)job->empty);
+    xQueueReset((QueueHandle_t)job->full);
+    xSemaphoreGive(job->empty);
+    xSemaphoreGive(job->empty);
+
+    job->startTick = HAL_GetTick();
+    job->state = paused ? SDPRINT_PAUSED : SDPRINT_RUNNING;
+    xTaskNotifyGive(job->reader);
+    xTaskNotifyGive(job->printer);
+    return SDPRINT_ERROR_NONE;
+}
+
+/**
+ * @brief  Stops parsing after the current line. Moves already queued still run.
+ * @headerfile sdprint.h
+ */
+void sdprintPause(void)
+{
+    if (SD_PRINT.state == SDPRINT_RUNNING)
+        SD_PRINT.state = SDPRINT_PAUSED;
+}
+
+/**
+ * @brief  Continues a paused job.
+ * @headerfile sdprint.h
+ */
+void sdprintResume(void)
+{
+    if (SD_PRINT.state == SDPRINT_PAUSED)
+        SD_PRINT.state = SDPRINT_RUNNING;
+}
+
+/**
+ * @brief  Ends the job after the current line. The job finishes in the SDPRINT_FAILED state with SDPRINT_ERROR_ABORTED.
+ * @headerfile sdprint.h
+ */
+void sdprintAbort(void)
+{
+    if (SD_PRINT.state == SDPRINT_RUNNING || SD_PRINT.state == SDPRINT_PAUSED)
+        SD_PRINT.abortRequested = true;
+}
+
+/**
+ * @brief  Returns how far through the file the parser is, 0-1000, for NPfxSetProgress.
+ * @headerfile sdprint.h
+ */
+uint16_t sdprintProgress(void)
+{
+    if (SD_PRINT.size == 0)
+        return 0;
+    return (uint16_t)(((uint64_t)SD_PRINT.consumed * 1000) / SD_PRINT.size);
+}
+
+/**
+ * @brief  Runs a file through the same double-buffered pipeline as a print, but with the planner in dry-run mode so nothing moves or heats. With parse false the G-code isn't even parsed, which gives the raw read rate of the card. The planner and the interpreter's modes are put back afterwards, so it can be run between prints, e.g. from a host command.
+ * @param[in]  path is the FatFs path of the file.
+ * @param[in]  parse selects parsing and planning each line.
+ * @param[out]  result receives the throughput. A print keeps up when segmentsPerSec is above SDPRINT_REQUIRED_SEGMENTS_PER_SEC.
+ * @retval SDPRINT_ERROR_NONE on success. Blocks the calling task until the file has been read, so don't call it from the reader or print task.
+ * @headerfile sdprint.h
+ */
+SDPrintError sdprintBenchmark(const char *path, bool parse, SDPrintBenchmark *result)
+{
+    SDPrintJob *job = &SD_PRINT;
+    Planner *pl = job->machine->planner;
+    if (job->state == SDPRINT_RUNNING || job->state == SDPRINT_PAUSED)
+        return SDPRINT_ERROR_BUSY;
+
+    // Planning dry still moves the planner's idea of where the head is
+    plannerSync(pl);
+    Planner planner = *pl;
+    GcodeMachine *m = job->machine;
+    bool relative = m->relative;
+    bool relativeE = m->relativeE;
+    float32_t feed = m->feed;
+    pl->dryRun = true;
+    job->parse = parse;
+
+    SDPrintError err = sdprintStart(path);
+    if (err == SDPRINT_ERROR_NONE)
+    {
+        while (job->state == SDPRINT_RUNNING)
+        {
+            forgeDelay(10);
+        }
+        err = job->lastError;
+    }
+
+    job->parse = true;
+
+    uint32_t ms = job->endTick - job->startTick;
+    if (ms == 0)
+        ms = 1;
+    result->bytes = (uint32_t)job->consumed;
+    result->ms = ms;
+    result->mbPerSec = (float32_t)result->bytes / ((float32_t)ms * 1000.0f);
+    result->segments = pl->segments - planner.segments;
+    result->segmentsPerSec = (float32_t)result->segments * 1000.0f / (float32_t)ms;
+
+    *pl = planner;
+    m->relative = relative;
+    m->relativeE = relativeE;
+    m->feed = feed;
+    return err;
+}
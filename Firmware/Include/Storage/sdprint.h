@@ -0,0 +1,120 @@
+/**
+ * @file sdprint.h
+ * @brief Prints a G-code file from the SD card without a host.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_SDPRINT_H
+#define __FORGE_SDPRINT_H
+
+#include "../Motion/gcode.h"
+#include "../FatFs/src/ff.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// 16 sectors: one multi-block read per chunk. Two of them is ~50ms of G-code
+// at 500mm/s in 0.1mm segments, against a few ms to read one.
+#define SDPRINT_CHUNK 8192
+
+// 500mm/s in 0.1mm segments
+#define SDPRINT_REQUIRED_SEGMENTS_PER_SEC 5000
+
+#define SDPRINT_MAX_PATH 64
+// Cluster link map for f_lseek, in DWORDs: room for 15 fragments, which a
+// file written in one go on a reasonably empty card never comes near
+#define SDPRINT_CLMT_LENGTH 32
+
+    typedef enum
+    {
+        SDPRINT_IDLE = 0,
+        SDPRINT_RUNNING,
+        SDPRINT_PAUSED,
+        SDPRINT_DONE,
+        SDPRINT_FAILED
+    } SDPrintState;
+
+    /**
+     * @brief Stores an error from the last job.
+     */
+    typedef enum
+    {
+        SDPRINT_ERROR_NONE = 0,
+        SDPRINT_ERROR_BUSY,
+        SDPRINT_ERROR_FAILED_OPEN,
+        SDPRINT_ERROR_FAILED_READ,
+        SDPRINT_ERROR_FAILED_SEEK,
+        SDPRINT_ERROR_FILE_CHANGED, // The link map given to sdprintStartAt is for another file
+        SDPRINT_ERROR_ABORTED
+    } SDPrintError;
+
+    /**
+     * @brief The single print job. The reader task fills one buffer while the print task parses the other.
+     */
+    typedef struct
+    {
+        FIL file;
+        char path[SDPRINT_MAX_PATH]; // Empty if the path didn't fit
+        DWORD clmt[SDPRINT_CLMT_LENGTH]; // clmt[0] is the used length; larger than SDPRINT_CLMT_LENGTH if it didn't fit
+        uint8_t buffers[2][SDPRINT_CHUNK] __ALIGNED(4); // DMA targets, so not in CCM RAM
+        UINT lengths[2];
+        SemaphoreHandle_t empty; // Counts buffers the reader may fill
+        SemaphoreHandle_t full;  // Counts buffers the print task may parse
+
+        TaskHandle_t reader;
+        TaskHandle_t printer;
+        GcodeMachine *machine;
+        bool parse; // false only while benchmarking raw reads
+
+        volatile SDPrintState state;
+        volatile bool abortRequested;
+        volatile bool readerDone;
+
+        FSIZE_t size;
+        UINT skip; // Bytes of the first chunk before the start offset
+        volatile FSIZE_t consumed; // Bytes handed to the parser
+        uint32_t startTick;
+        uint32_t endTick;
+
+        SDPrintError lastError;
+    } SDPrintJob;
+
+    /**
+     * @brief Result of sdprintBenchmark.
+     */
+    typedef struct
+    {
+        uint32_t bytes;
+        uint32_t ms;
+        float32_t mbPerSec;
+        uint32_t segments;         // Planned, not executed
+        float32_t segmentsPerSec;  // Compare against SDPRINT_REQUIRED_SEGMENTS_PER_SEC
+    } SDPrintBenchmark;
+
+    extern SDPrintJob SD_PRINT;
+
+    void sdprintInit(GcodeMachine *machine);
+    SDPrintError sdprintStart(const char *path);
+    SDPrintError sdprintStartAt(const char *path, FSIZE_t offset, const DWORD *clmt, bool paused);
+    void sdprintPause(void);
+    void sdprintResume(void);
+    void sdprintAbort(void);
+    uint16_t sdprintProgress(void);
+    SDPrintError sdprintBenchmark(const char *path, bool parse, SDPrintBenchmark *result);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_SDPRINT_H */
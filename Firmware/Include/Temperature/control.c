@@ -12,6 +12,7 @@
 #include "../HAL/stm32f4xx_hal.h"
 #include <stdbool.h>
 #include "control.h"
+#include "../Core/forge.h"
 #include "stm32f4xx_ll_bus.h"
 #include "stm32f4xx_ll_rcc.h"
 #include "stm32f4xx_ll_pwr.h"
@@ -29,27 +30,29 @@ PIDControlConfig createController(
     float32_t K_i,
     float32_t K_d)
 {
-    PIDControlConfig out;
+    // Zeroed so _t, _integral, the error history and _initialized start clean
+    PIDControlConfig out = {0};
     out.thermistorCfg = thermistorCfg;
     out.HeaterMOSFETx = HeaterMOSFETx;
     out.HeaterMOSFET_Pin = HeaterMOSFET_Pin;
     out.K_p = K_p;
     out.K_i = K_i;
     out.K_d = K_d;
+    out.lastTemp = 0;
+    out.lastOutput = 0;
     return out;
 }
 
+// The change in error since the step before; the first step has none. A
+// difference centred on x0 would read the next step's error, not written yet
 float32_t _derive(PIDControlConfig *cfg, float32_t x0)
 {
-    const float32_t delta = 1.0e-6f; // or similar
-    float32_t x1 = x0 - delta;
-    float32_t x2 = x0 + delta;
-    float32_t y1 = getError(cfg, x1);
-    float32_t y2 = getError(cfg, x2);
-    return (y2 - y1) / (x2 - x1);
+    uint32_t t = (uint32_t)x0;
+    if (t == 0)
+        return 0.0f;
+    return getError(cfg, (float32_t)t) - getError(cfg, (float32_t)(t - 1));
 }
 
-static GPIO_InitTypeDef GPIO_InitStruct;
 TIM_OC_InitTypeDef sConfig;
 
 // Define the timer handle and PWM channel handles
@@ -136,7 +139,7 @@ TIM_HandleTypeDef htim2;
 
 void initController(PIDControlConfig *cfg)
 {
-    HAL_Init();
+    forgeInitHAL();
     PWM_Init(cfg->HeaterMOSFETx, cfg->HeaterMOSFET_Pin, cfg->timerChannel);
 
     initThermistor(cfg->thermistorCfg);
@@ -146,9 +149,10 @@ void initController(PIDControlConfig *cfg)
 
 float32_t getError(PIDControlConfig *cfg, float32_t t)
 {
+    // The history is a ring of the last 1024 steps, as gcode.c reads it
     if (roundf(t) == t)
     {
-        return cfg->errors[(uint32_t)t];
+        return cfg->errors[(uint32_t)t % 1024];
     }
 
     float32_t closest_low_error = cfg->errors[0];
@@ -160,13 +164,13 @@ float32_t getError(PIDControlConfig *cfg, float32_t t)
     {
         if (i > t)
         {
-            closest_high_error = cfg->errors[i];
+            closest_high_error = cfg->errors[i % 1024];
             closest_high_index = i;
         }
 
         if (i < t)
         {
-            closest_low_error = cfg->errors[i];
+            closest_low_error = cfg->errors[i % 1024];
             closest_low_index = i;
         }
     }
@@ -181,7 +185,7 @@ void singleStepController(PIDControlConfig *cfg)
     float32_t temp = readTemperature(cfg->thermistorCfg);
 
     float32_t error = cfg->target_temp - temp;
-    cfg->errors[cfg->_t] = error;
+    cfg->errors[cfg->_t % 1024] = error;
 
     float32_t derivative = _derive(cfg, cfg->_t);
 
@@ -192,4 +196,6 @@ void singleStepController(PIDControlConfig *cfg)
     float32_t out = (cfg->K_p * error) + (cfg->K_i * cfg->_integral) + (cfg->K_d * derivative);
 
     PWM_SetDutyCycle(cfg->timerChannel, out);
+    cfg->lastTemp = temp;
+    cfg->lastOutput = out;
 }
\ No newline at end of file
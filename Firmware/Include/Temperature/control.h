@@ -30,6 +30,8 @@ extern "C"
         float32_t K_i;
         float32_t K_d;
         float32_t target_temp;
+        float32_t lastTemp;   // Read by the last singleStepController
+        float32_t lastOutput; // Duty cycle it wrote
         uint32_t _t;
         float32_t _integral;
         float32_t errors[1024];
@@ -51,6 +53,7 @@ extern "C"
 
     void initController(PIDControlConfig *cfg);
     void singleStepController(PIDControlConfig *cfg);
+    float32_t getError(PIDControlConfig *cfg, float32_t t);
 
     void PWM_SetDutyCycle(uint32_t channel, float32_t dutyCycle); // Internal use only
 
@@ -27,8 +27,12 @@ extern PIDControlConfig HeaterBed;
 void initHeaterControllers(void)
 {
     initThermistors();
+    // PC11 and PC12 are also SDIO D3 and CK, which is why the card slot is
+    // off unless FORGE_SD_CARD says the board has one (forge-storage.h)
     HeaterHotend = createController(&T0, GPIOC, GPIO_PIN_11, 22.2f, 1.08f, 114.0f);
     HeaterBed = createController(&T1, GPIOC, GPIO_PIN_12, 10.0f, 0.023f, 305.0f);
+    // Both share TIM3, so each needs its own compare; createController leaves them on channel 1
+    HeaterBed.timerChannel = TIM_CHANNEL_2;
 }
 
 void tuneHeaters(void)
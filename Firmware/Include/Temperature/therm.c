@@ -10,6 +10,7 @@
 #include "../CMSIS-Core/cmsis_compiler.h"
 #include "../HAL/stm32f4xx_hal.h"
 #include <stdbool.h>
+#include "../Core/forge.h"
 
 #include "therm.h"
 
@@ -32,7 +33,7 @@ static ADC_HandleTypeDef AdcHandle;
 void initThermistor(ThermistorConfig *cfg)
 {
     ADC_ChannelConfTypeDef sConfig;
-    HAL_Init();
+    forgeInitHAL();
 
     GPIO_InitStruct.Pin = cfg->Therm_Pin;
     GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
@@ -71,7 +72,8 @@ void initThermistor(ThermistorConfig *cfg)
         return;
     }
 
-    if (HAL_ADC_Start_DMA(&AdcHandle, &cfg->_uhADCxConvertedValue, 1) != HAL_OK)
+    // Volatile as the DMA writes it; the HAL only passes the address on
+    if (HAL_ADC_Start_DMA(&AdcHandle, (uint32_t *)&cfg->_uhADCxConvertedValue, 1) != HAL_OK)
     {
         cfg->lastError = THERM_ERROR_FAILED_START_CONV;
         return;
@@ -79,7 +81,7 @@ void initThermistor(ThermistorConfig *cfg)
 
     cfg->_initialized = true;
     cfg->lastError = THERM_ERROR_NONE;
-    HAL_Delay(100); // just want to make sure that it's finished converting, this is probably giant overkill
+    forgeDelay(100); // just want to make sure that it's finished converting, this is probably giant overkill
 }
 
 float32_t readTemperature(ThermistorConfig *cfg)
@@ -105,14 +107,16 @@ float32_t readTemperature(ThermistorConfig *cfg)
             closest_high_temp = _TemperatureKeyTable[i];
         }
 
+        if (_TemperatureValueTable[i] == resistance)
+            return _TemperatureKeyTable[i];
+
+        // The table falls as it goes, so the first entry below is the neighbour; those after it are further off
         if (_TemperatureValueTable[i] < resistance)
         {
             closest_low_val = _TemperatureValueTable[i];
             closest_low_temp = _TemperatureKeyTable[i];
+            break;
         }
-
-        if (_TemperatureValueTable[i] == resistance)
-            return _TemperatureKeyTable[i];
     }
 
     cfg->lastCertainty = CERTAINTY_LOWER;
@@ -8,6 +8,7 @@
  */
 
 #include "tuning.h"
+#include "../Core/forge.h"
 
 TIM_HandleTypeDef htim2; // Handle for TIM2
 
@@ -60,7 +61,7 @@ void readTemps(PIDControlConfig *cfg, float32_t *out, uint32_t duration_secs)
         for (uint32_t f = 0; f < 1000; f++)
         {
             singleStepController(cfg);
-            HAL_Delay(1);
+            forgeDelay(1);
         }
     }
 }
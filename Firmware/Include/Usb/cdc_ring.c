@@ -0,0 +1,169 @@
+/**
+ * @file cdc_ring.c
+ * @brief Lock-free single producer, single consumer rings between the USB CDC endpoints and the command parser.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "cdc_ring.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define RX_MASK (CDC_RX_SLOTS - 1)
+#define TX_MASK (CDC_TX_SIZE - 1)
+
+/**
+ * @brief  Empties the ring. Only while neither side is using it, e.g. before the endpoint is armed.
+ * @headerfile cdc_ring.h
+ */
+void cdcrxReset(CDCRxRing *r)
+{
+    r->head = 0;
+    r->tail = 0;
+    r->offset = 0;
+}
+
+/**
+ * @brief  Producer side: returns the slot the next packet should be received into, or NULL while the ring is full.
+ * @headerfile cdc_ring.h
+ */
+uint8_t *cdcrxSlot(CDCRxRing *r)
+{
+    uint32_t head = r->head;
+    if (head - r->tail >= CDC_RX_SLOTS)
+        return NULL;
+    return r->data[head & RX_MASK];
+}
+
+/**
+ * @brief  Producer side: publishes the packet received into the slot from cdcrxSlot.
+ * @param[in]  length is the packet length, 1 to CDC_PACKET_SIZE.
+ * @headerfile cdc_ring.h
+ */
+void cdcrxCommit(CDCRxRing *r, uint16_t length)
+{
+    uint32_t head = r->head;
+    r->length[head & RX_MASK] = length;
+    CDC_RING_BARRIER();
+    r->head = head + 1;
+}
+
+/**
+ * @brief  Consumer side: returns the oldest unconsumed bytes without copying them. Runs on into the following packets while they are full and don't wrap, so most lines come back whole.
+ * @param[out]  data receives a pointer into the ring, valid until cdcrxConsume.
+ * @retval The number of bytes at data, 0 if the ring is empty.
+ * @headerfile cdc_ring.h
+ */
+uint32_t cdcrxPeek(CDCRxRing *r, const uint8_t **data)
+{
+    uint32_t tail = r->tail;
+    uint32_t head = r->head;
+    if (tail == head)
+        return 0;
+    CDC_RING_BARRIER();
+
+    uint32_t s = tail & RX_MASK;
+    *data = r->data[s] + r->offset;
+    uint32_t length = r->length[s] - r->offset;
+    while (r->length[s] == CDC_PACKET_SIZE && s + 1 < CDC_RX_SLOTS && ++tail != head)
+    {
+        s++;
+        length += r->length[s];
+    }
+    return length;
+}
+
+/**
+ * @brief  Consumer side: releases bytes returned by cdcrxPeek, and with them any slot that is used up.
+ * @headerfile cdc_ring.h
+ */
+void cdcrxConsume(CDCRxRing *r, uint32_t length)
+{
+    uint32_t tail = r->tail;
+    while (length > 0)
+    {
+        uint32_t left = r->length[tail & RX_MASK] - r->offset;
+        if (length < left)
+        {
+            r->offset += length;
+            break;
+        }
+        length -= left;
+        r->offset = 0;
+        tail++;
+    }
+    CDC_RING_BARRIER();
+    r->tail = tail;
+}
+
+/**
+ * @brief  Empties the ring. Only while neither side is using it.
+ * @headerfile cdc_ring.h
+ */
+void cdctxReset(CDCTxRing *r)
+{
+    r->head = 0;
+    r->tail = 0;
+}
+
+/**
+ * @brief  Producer side: appends as much of data as fits.
+ * @retval The number of bytes taken.
+ * @headerfile cdc_ring.h
+ */
+uint32_t cdctxWrite(CDCTxRing *r, const uint8_t *data, uint32_t length)
+{
+    uint32_t head = r->head;
+    uint32_t space = CDC_TX_SIZE - (head - r->tail);
+    if (length > space)
+        length = space;
+
+    uint32_t at = head & TX_MASK;
+    uint32_t first = CDC_TX_SIZE - at;
+    if (first > length)
+        first = length;
+    memcpy(r->data + at, data, first);
+    memcpy(r->data, data + first, length - first);
+    CDC_RING_BARRIER();
+    r->head = head + length;
+    return length;
+}
+
+/**
+ * @brief  USB side: returns the next bytes to send, in place. Only whole packets are returned unless partial is set, so responses written a few bytes at a time share packets. The end of the ring can still cut a packet short.
+ * @param[out]  data receives a pointer into the ring, valid until cdctxDone.
+ * @param[in]  partial also returns a last packet that isn't full, e.g. once the parser has run out of input.
+ * @retval The number of bytes at data, 0 if there is nothing to send yet.
+ * @headerfile cdc_ring.h
+ */
+uint32_t cdctxNext(CDCTxRing *r, const uint8_t **data, bool partial)
+{
+    uint32_t tail = r->tail;
+    uint32_t pending = r->head - tail;
+    if (pending == 0 || (pending < CDC_PACKET_SIZE && !partial))
+        return 0;
+    CDC_RING_BARRIER();
+
+    uint32_t at = tail & TX_MASK;
+    uint32_t length = CDC_TX_SIZE - at;
+    if (length > pending)
+        length = pending;
+    if (length > CDC_TX_MAX_TRANSFER)
+        length = CDC_TX_MAX_TRANSFER;
+    if (!partial && length >= CDC_PACKET_SIZE)
+        length -= length % CDC_PACKET_SIZE;
+    *data = r->data + at;
+    return length;
+}
+
+/**
+ * @brief  USB side: releases bytes from cdctxNext once they have been sent.
+ * @headerfile cdc_ring.h
+ */
+void cdctxDone(CDCTxRing *r, uint32_t length)
+{
+    r->tail += length;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file cdc_ring.h
+ * @brief Lock-free single producer, single consumer rings between the USB CDC endpoints and the command parser.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_CDC_RING_H
+#define __FORGE_CDC_RING_H
+
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define CDC_PACKET_SIZE 64
+// 4KiB of commands, ~4ms of a saturated full speed bus; the endpoint NAKs
+// once every slot is taken. Both sizes are powers of two, so head and tail
+// can run freely.
+#define CDC_RX_SLOTS 64
+#define CDC_TX_SIZE 2048
+// One IN transfer is at most the endpoint's TX FIFO
+#define CDC_TX_MAX_TRANSFER 512
+
+// Orders the slot contents before the index that publishes them. The host
+// tools build these rings with a compiler fence instead.
+#ifndef CDC_RING_BARRIER
+#define CDC_RING_BARRIER() __DMB()
+#endif
+
+    /**
+     * @brief Received packets, in the slots the endpoint wrote them to. Consecutive full slots are contiguous, so a line split across packets can still be parsed where it is.
+     */
+    typedef struct
+    {
+        uint8_t data[CDC_RX_SLOTS][CDC_PACKET_SIZE] __ALIGNED(4);
+        volatile uint16_t length[CDC_RX_SLOTS];
+        volatile uint32_t head; // Packets received, written by the USB side only
+        volatile uint32_t tail; // Packets consumed, written by the parser only
+        uint32_t offset;        // Bytes of the tail packet already consumed
+    } CDCRxRing;
+
+    /**
+     * @brief Responses waiting to go out. The producer appends bytes; the USB side sends them in whole packets.
+     */
+    typedef struct
+    {
+        uint8_t data[CDC_TX_SIZE] __ALIGNED(4);
+        volatile uint32_t head; // Bytes written, by the producer only
+        volatile uint32_t tail; // Bytes sent, by the USB side only
+    } CDCTxRing;
+
+    void cdcrxReset(CDCRxRing *r);
+    uint8_t *cdcrxSlot(CDCRxRing *r);
+    void cdcrxCommit(CDCRxRing *r, uint16_t length);
+    uint32_t cdcrxPeek(CDCRxRing *r, const uint8_t **data);
+    void cdcrxConsume(CDCRxRing *r, uint32_t length);
+
+    void cdctxReset(CDCTxRing *r);
+    uint32_t cdctxWrite(CDCTxRing *r, const uint8_t *data, uint32_t length);
+    uint32_t cdctxNext(CDCTxRing *r, const uint8_t **data, bool partial);
+    void cdctxDone(CDCTxRing *r, uint32_t length);
+
+    static inline uint32_t cdctxPending(const CDCTxRing *r) { return r->head - r->tail; }
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_CDC_RING_H */
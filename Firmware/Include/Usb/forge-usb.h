@@ -0,0 +1,578 @@
+/**
+ * @file forge-usb.h
+ * @brief USB port of the Forge: one composite device with a serial port for host commands, or with FORGE_USB_NETWORK a network interface and a TCP console, and the SD card as a mass storage drive, or with FORGE_USB_TELEMETRY a live telemetry stream or with FORGE_USB_DAP a CMSIS-DAP probe in its place.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_PORT_H
+#define __FORGE_USB_PORT_H
+
+#include "usb.h"
+#ifdef FORGE_USB_NETWORK
+#include "usb_ecm.h"
+#include "../Net/net.h"
+#include "../Net/fleet.h"
+#include "../Net/console.h"
+#else
+#include "usb_cdc.h"
+#endif
+#if defined(FORGE_USB_DAP)
+#include "usb_dap.h"
+#elif defined(FORGE_USB_TELEMETRY)
+#include "usb_telemetry.h"
+#else
+#include "usb_msc.h"
+#endif
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Core/profiler.h"
+#include "../Motion/gcode.h"
+#include "../Motion/motion.h"
+#include "../Neopixel/neopixel_batch.h"
+#include "../Net/json.h"
+#include "../Storage/sdprint.h"
+#include "../Storage/sd_diskio.h"
+#include "../Storage/recovery.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../STM32_USB_Device_Library/Class/CDC/Inc/usbd_cdc.h"
+#include "../STM32_USB_Device_Library/Class/CompositeBuilder/Inc/usbd_composite_builder.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern GcodeMachine ForgeGcode;
+    extern NPColorBenchmark ForgeColorBenchmark;
+
+    // Replies go back the way the commands came: the TCP console in the
+    // network build, which has no CDC port, or the CDC port
+    static uint32_t _hostWrite(const uint8_t *data, uint32_t length)
+    {
+#ifdef FORGE_USB_NETWORK
+        return consoleWrite(data, length);
+#else
+        return cdcWrite(data, length);
+#endif
+    }
+
+    static bool _hostOpen(void)
+    {
+#ifdef FORGE_USB_NETWORK
+        return CONSOLE.open;
+#else
+        return USB_CDC.open;
+#endif
+    }
+
+    static void _hostReply(const char *text)
+    {
+        _hostWrite((const uint8_t *)text, (uint32_t)strlen(text));
+    }
+
+    static bool _hostPrinting(void)
+    {
+        SDPrintState state = SD_PRINT.state;
+        return state == SDPRINT_RUNNING || state == SDPRINT_PAUSED;
+    }
+
+    static const char *const _sdprintErrors[] = {"", "busy", "open failed", "read failed", "seek failed",
+                                                 "file changed", "aborted"};
+
+    static void _hostCardError(SDPrintError err)
+    {
+        _hostReply("!! sd ");
+        _hostReply(_sdprintErrors[err]);
+        _hostReply("\n");
+    }
+
+    static const char *const _recoveryErrors[] = {"", "no record", "file changed", "failed to start"};
+
+    // A print cut off by a power loss waits for the user, who may have taken
+    // the part off the bed since
+    static void _hostRecovery(void)
+    {
+        RecoveryRecord r;
+        if (!recoveryPending(&r))
+        {
+            _hostReply("// recovery none\n");
+            return;
+        }
+        char line[48 + SDPRINT_MAX_PATH];
+        JsonWriter j = {line, line + sizeof(line) - 1};
+        jsonRaw(&j, "// recovery ");
+        jsonRaw(&j, r.path);
+        jsonRaw(&j, " at byte ");
+        jsonUint(&j, r.offset);
+        jsonRaw(&j, ", M413 S1 resumes, S0 forgets\n");
+        _hostWrite((const uint8_t *)line, (uint32_t)(j.p - line));
+    }
+
+    // The file M23 selected, as a FatFs path; empty until then
+    static char _cardPath[SDPRINT_MAX_PATH];
+
+    // The SD card commands, from the host or from the file being printed. The
+    // benchmark holds the comms task until the file has been read.
+    static void _hostCard(const GcodeCommand *cmd)
+    {
+        switch (cmd->code)
+        {
+        case 23:
+        {
+            const char *name = cmd->text;
+            uint16_t n = cmd->textLength;
+            if (n > 0 && name[0] == '/')
+            {
+                name++;
+                n--;
+            }
+            size_t root = strlen(SDPath);
+            if (n == 0 || root + n >= SDPRINT_MAX_PATH)
+            {
+                _cardPath[0] = '\0';
+                _hostReply("!! sd bad file name\n");
+                return;
+            }
+            memcpy(_cardPath, SDPath, root);
+            memcpy(&_cardPath[root], name, n);
+            _cardPath[root + n] = '\0';
+            return;
+        }
+        case 24:
+        {
+            // Also reached from inside the print, where it does nothing
+            SDPrintState state = SD_PRINT.state;
+            if (state == SDPRINT_PAUSED)
+                sdprintResume();
+            if (state == SDPRINT_RUNNING || state == SDPRINT_PAUSED)
+                return;
+            if (_cardPath[0] == '\0')
+            {
+                _hostReply("!! sd no file selected\n");
+                return;
+            }
+            SDPrintError err = sdprintStart(_cardPath);
+            if (err != SDPRINT_ERROR_NONE)
+                _hostCardError(err);
+            return;
+        }
+        case 25:
+            sdprintPause();
+            return;
+        case 413:
+        {
+            if (!gcodeHas(cmd, 'S'))
+            {
+                _hostRecovery();
+                return;
+            }
+            if (gcodeValue(cmd, 'S') == 0.0f)
+            {
+                recoveryClear();
+                return;
+            }
+            // Rehomes and reheats, holding the comms task until the print
+            // carries on
+            if (_hostPrinting())
+            {
+                _hostCardError(SDPRINT_ERROR_BUSY);
+                return;
+            }
+            RecoveryError err = recoveryResume();
+            if (err != RECOVERY_ERROR_NONE)
+            {
+                _hostReply("!! recovery ");
+                _hostReply(_recoveryErrors[err]);
+                _hostReply("\n");
+            }
+            return;
+        }
+        default:
+        {
+            // GCODE_SD_BENCHMARK: the card's read rate, and with S1 how fast
+            // the file parses and plans, against what a print needs
+            if (_cardPath[0] == '\0')
+            {
+                _hostReply("!! sd no file selected\n");
+                return;
+            }
+            bool parse = gcodeHas(cmd, 'S') && gcodeValue(cmd, 'S') != 0.0f;
+            SDPrintBenchmark b;
+            SDPrintError err = sdprintBenchmark(_cardPath, parse, &b);
+            if (err != SDPRINT_ERROR_NONE)
+            {
+                _hostCardError(err);
+                return;
+            }
+            char line[96];
+            JsonWriter j = {line, line + sizeof(line) - 1};
+            jsonRaw(&j, parse ? "// sd parse " : "// sd read ");
+            jsonFixed(&j, b.mbPerSec, 2);
+            jsonRaw(&j, " MB/s, ");
+            jsonUint(&j, b.bytes);
+            jsonRaw(&j, " bytes in ");
+            jsonUint(&j, b.ms);
+            jsonRaw(&j, " ms");
+            if (parse)
+            {
+                jsonRaw(&j, ", ");
+                jsonUint(&j, (uint32_t)b.segmentsPerSec);
+                jsonRaw(&j, " segments/s of ");
+                jsonUint(&j, SDPRINT_REQUIRED_SEGMENTS_PER_SEC);
+            }
+            jsonChar(&j, '\n');
+            _hostWrite((const uint8_t *)line, (uint32_t)(j.p - line));
+            return;
+        }
+        }
+    }
+
+    // A host line that began while a print had the interpreter, kept until
+    // its end so it can be looked at whole. It is kept to one byte past
+    // GCODE_MAX_LINE, so a line that didn't fit still reads as too long, with
+    // room after that for its line ending.
+    static char _heldLine[GCODE_MAX_LINE + 2];
+    static uint16_t _heldLength;
+    static bool _holding;
+
+    static void _hostHeld(void)
+    {
+        if (_heldLength > 0 && _heldLine[_heldLength - 1] == '\r')
+            _heldLength--;
+        if (!_hostPrinting())
+        {
+            // The print ended while the line came in
+            _heldLine[_heldLength] = '\n';
+            gcodeFeed(&ForgeGcode, (const uint8_t *)_heldLine, _heldLength + 1U);
+            _hostReply("ok\n");
+            return;
+        }
+
+        // The interpreter isn't reentrant, so only the card commands, which
+        // leave it alone, get past a print
+        GcodeCommand cmd;
+        if (_heldLength <= GCODE_MAX_LINE && gcodeParseLine(_heldLine, _heldLength, &cmd) == GCODE_ERROR_NONE &&
+            gcodeCardCommand(&cmd))
+        {
+            _hostCard(&cmd);
+            _hostReply("ok\n");
+            return;
+        }
+        _hostReply("!! busy\n");
+    }
+
+    // Host lines go to the same interpreter as an SD print, so while one is
+    // using it they are turned away, all but the card commands. Lines are run
+    // one at a time, as any of them may start a print. Every line gets one
+    // reply.
+    void hostReceive(const uint8_t *data, uint32_t length)
+    {
+        while (length > 0)
+        {
+            const uint8_t *nl = memchr(data, '\n', length);
+            uint32_t n = (nl != NULL) ? (uint32_t)(nl - data) + 1 : length;
+            if (!_holding && !_hostPrinting())
+            {
+                if (gcodeFeed(&ForgeGcode, data, n) > 0)
+                    _hostReply("ok\n");
+            }
+            else
+            {
+                _holding = true;
+                uint32_t keep = (nl != NULL) ? n - 1 : n;
+                uint32_t room = sizeof(_heldLine) - 1U - _heldLength;
+                if (keep > room)
+                    keep = room;
+                memcpy(&_heldLine[_heldLength], data, keep);
+                _heldLength += (uint16_t)keep;
+                if (nl != NULL)
+                {
+                    _hostHeld();
+                    _holding = false;
+                    _heldLength = 0;
+                }
+            }
+            data += n;
+            length -= n;
+        }
+    }
+
+    // The port feeds the comms task, which runs the host's lines
+    void forgeCommsWoken(void)
+    {
+#ifdef FORGE_USB_NETWORK
+        consoleWoken();
+#else
+        cdcWoken();
+#endif
+    }
+
+    void forgeCommsReceive(const uint8_t *data, size_t length)
+    {
+        hostReceive(data, (uint32_t)length);
+    }
+
+    void forgeCommsDrained(void)
+    {
+#ifdef FORGE_USB_NETWORK
+        consoleDrained();
+#else
+        cdcDrained();
+#endif
+    }
+
+    // Whoever opens the port is told where the memory went, as comments a
+    // host sending G-code skips
+#ifdef FORGE_USB_NETWORK
+    void consoleOpened(void)
+#else
+    void cdcOpened(void)
+#endif
+    {
+        char line[3 + FORGE_MEMORY_LINE] = "// ";
+        uint32_t n;
+        for (uint8_t i = 0; (n = forgeMemoryLine(i, &line[3])) > 0; i++)
+            _hostWrite((const uint8_t *)line, 3 + n);
+
+        // And what a pixel's color costs, measured at boot: scalar then batch
+        const NPColorBenchmark *b = &ForgeColorBenchmark;
+        JsonWriter j = {&line[3], line + sizeof(line) - 1};
+        jsonRaw(&j, "color hsv ");
+        jsonUint(&j, b->scalarHSV);
+        jsonChar(&j, ' ');
+        jsonUint(&j, b->batchHSV);
+        jsonRaw(&j, " gamma ");
+        jsonUint(&j, b->scalarGamma);
+        jsonChar(&j, ' ');
+        jsonUint(&j, b->batchGamma);
+        jsonRaw(&j, " cycles/pixel\n");
+        _hostWrite((const uint8_t *)line, (uint32_t)(j.p - line));
+
+        // And of a print a power loss cut off, which only M413 resumes
+        if (recoveryPending(NULL))
+            _hostRecovery();
+    }
+
+    // Profiler reports go the same way, while anyone is listening
+    void profileOutput(const char *line, uint32_t length)
+    {
+        if (!_hostOpen())
+            return;
+        char prefixed[3 + PROFILE_LINE] = "// ";
+        memcpy(&prefixed[3], line, length);
+        _hostWrite((const uint8_t *)prefixed, 3 + length);
+    }
+
+    // Endpoints per class, in the order the class driver asks for them
+#ifdef FORGE_USB_NETWORK
+    static uint8_t _ecmEps[] = {FORGE_ECM_IN_EP, FORGE_ECM_OUT_EP, FORGE_ECM_CMD_EP};
+#else
+    static uint8_t _cdcEps[] = {FORGE_CDC_IN_EP, FORGE_CDC_OUT_EP, FORGE_CDC_CMD_EP};
+#endif
+#if defined(FORGE_USB_DAP)
+    static uint8_t _dapEps[] = {FORGE_DAP_OUT_EP, FORGE_DAP_IN_EP};
+#elif defined(FORGE_USB_TELEMETRY)
+    static uint8_t _telemetryEps[] = {FORGE_TELEMETRY_IN_EP};
+#else
+    static uint8_t _mscEps[] = {FORGE_MSC_IN_EP, FORGE_MSC_OUT_EP};
+#endif
+
+    bool configureUsb(USBD_HandleTypeDef *dev)
+    {
+        // Both classes go in first; the builder numbers them in this order
+#ifdef FORGE_USB_NETWORK
+        if (USBD_RegisterClassComposite(dev, USBD_CDC_ECM_CLASS, CLASS_TYPE_ECM, _ecmEps) != USBD_OK ||
+#else
+        if (USBD_RegisterClassComposite(dev, USBD_CDC_CLASS, CLASS_TYPE_CDC, _cdcEps) != USBD_OK ||
+#endif
+#if defined(FORGE_USB_DAP)
+            USBD_RegisterClassComposite(dev, &USB_DAP_CLASS, CLASS_TYPE_DAP, _dapEps) != USBD_OK)
+#elif defined(FORGE_USB_TELEMETRY)
+            USBD_RegisterClassComposite(dev, &USB_TELEMETRY_CLASS, CLASS_TYPE_VENDOR, _telemetryEps) != USBD_OK)
+#else
+            USBD_RegisterClassComposite(dev, USBD_MSC_CLASS, CLASS_TYPE_MSC, _mscEps) != USBD_OK)
+#endif
+            return false;
+
+#ifdef FORGE_USB_NETWORK
+        USB_ECM.classId = (uint8_t)USBD_CMPSIT_SetClassID(dev, CLASS_TYPE_ECM, 0);
+        if (USBD_CDC_ECM_RegisterInterface(dev, &USB_ECM_FOPS) != USBD_OK)
+            return false;
+#else
+        USB_CDC.classId = (uint8_t)USBD_CMPSIT_SetClassID(dev, CLASS_TYPE_CDC, 0);
+        if (USBD_CDC_RegisterInterface(dev, &USB_CDC_FOPS) != USBD_OK)
+            return false;
+#endif
+#if defined(FORGE_USB_DAP) || defined(FORGE_USB_TELEMETRY)
+        return true;
+#else
+        USBD_CMPSIT_SetClassID(dev, CLASS_TYPE_MSC, 0);
+        return USBD_MSC_RegisterStorage(dev, &USB_MSC_FOPS) == USBD_OK;
+#endif
+    }
+
+#ifdef FORGE_USB_TELEMETRY
+    // Called from the step interrupt
+    void motionSegmentDone(const MotionSegment *seg, const int32_t position[FORGE_AXES])
+    {
+        TelemetrySegment record;
+        record.tag = seg->tag.offset;
+        for (uint8_t a = 0; a < FORGE_AXES; a++)
+            record.position[a] = position[a];
+        record.events = seg->events;
+        record.interval = seg->interval;
+        telemetryWrite(TELEMETRY_SEGMENT, &record, sizeof(record));
+    }
+
+    void forgeHeaterStepped(uint8_t index, const PIDControlConfig *heater)
+    {
+        TelemetryHeater record;
+        record.index = index;
+        record.target = heater->target_temp;
+        record.temperature = heater->lastTemp;
+        record.output = heater->lastOutput;
+        telemetryWrite(TELEMETRY_HEATER, &record, sizeof(record));
+    }
+#endif
+
+#ifdef FORGE_USB_NETWORK
+    // Fleet telemetry, from the network task
+    void fleetSample(FleetSample *sample)
+    {
+        const GcodeMachine *m = &ForgeGcode;
+        sample->hotend = (m->hotend != NULL) ? m->hotend->lastTemp : NAN;
+        sample->hotendTarget = (m->hotend != NULL) ? m->hotend->target_temp : NAN;
+        sample->bed = (m->bed != NULL) ? m->bed->lastTemp : NAN;
+        sample->bedTarget = (m->bed != NULL) ? m->bed->target_temp : NAN;
+
+        MotionTag tag;
+        int32_t steps[FORGE_AXES];
+        motionSnapshot(&tag, steps);
+        for (uint8_t a = 0; a < FORGE_AXES; a++)
+            sample->position[a] = (float32_t)steps[a] / m->planner->stepsPerMm[a];
+        sample->progress = sdprintProgress();
+        sample->state = (uint8_t)SD_PRINT.state;
+    }
+
+    // A target is set the way M104 and M140 set it
+    void fleetCommand(FleetCommand command, float value)
+    {
+        GcodeMachine *m = &ForgeGcode;
+        switch (command)
+        {
+        case FLEET_CMD_PAUSE:
+            sdprintPause();
+            break;
+        case FLEET_CMD_RESUME:
+            sdprintResume();
+            break;
+        case FLEET_CMD_HOTEND:
+            if (m->hotend != NULL)
+                m->hotend->target_temp = value;
+            break;
+        case FLEET_CMD_BED:
+            if (m->bed != NULL)
+                m->bed->target_temp = value;
+            break;
+        }
+    }
+#endif
+
+    // OTG_FS on PA11/PA12. Call after initStorage and initMotion: the host
+    // only gets the card once SDbegin has found it, and commands need the
+    // interpreter.
+    void initUsb(void)
+    {
+        ForgeGcode.card = _hostCard;
+#ifdef FORGE_USB_NETWORK
+        netInit();
+        usbecmInit(&NET.ecm, NET.hostMac);
+#else
+        cdcInit();
+#endif
+#if defined(FORGE_USB_DAP)
+        dapInit();
+        usbBegin(configureUsb, NULL);
+#elif defined(FORGE_USB_TELEMETRY)
+        telemetryInit();
+        usbBegin(configureUsb, NULL);
+#else
+        usbmscInit();
+        usbBegin(configureUsb, usbmscRelease);
+#endif
+    }
+
+    void OTG_FS_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        usbIRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_USB);
+    }
+
+#ifdef FORGE_USB_DAP
+    // SWO capture on PC7: USART6 and DMA2 Stream1 as a UART, TIM8 and DMA2
+    // Stream2 as Manchester
+    void DMA2_Stream1_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SWO_UART_DMA_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SWO);
+    }
+
+    void USART6_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SWO_UART_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SWO);
+    }
+
+    void DMA2_Stream2_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SWO_Manchester_DMA_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SWO);
+    }
+
+    void TIM8_UP_TIM13_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        SWO_Manchester_TIM_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_SWO);
+    }
+
+    // The target's UART on PA9/PA10: USART1, DMA2 Stream5 receiving and
+    // Stream7 sending
+    void USART1_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        UART_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_UART);
+    }
+
+    void DMA2_Stream5_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        UART_RX_DMA_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_UART);
+    }
+
+    void DMA2_Stream7_IRQHandler(void)
+    {
+        PROFILE_ISR_ENTER();
+        UART_TX_DMA_IRQHandler();
+        PROFILE_ISR_EXIT(PROFILE_ISR_UART);
+    }
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_PORT_H */
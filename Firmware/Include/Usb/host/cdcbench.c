@@ -0,0 +1,311 @@
+/**
+ * @file cdcbench.c
+ * @brief Host loopback benchmark of the CDC rings against a simulated endpoint.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Builds the firmware's CDC rings for Linux. From Firmware/Include:
+ *
+ *   gcc -O2 -pthread -D'CDC_RING_BARRIER()=__atomic_thread_fence(__ATOMIC_SEQ_CST)' \
+ *       -o cdcbench Usb/host/cdcbench.c Usb/cdc_ring.c
+ *
+ * Three threads stand in for the host, the USB task and the host task. The
+ * host sends G-code with a window of commands in flight, packing them into
+ * 64 byte OUT packets the way the host's driver does for back-to-back writes.
+ * The "USB task" copies each packet into a free RX slot, as the OTG FIFO
+ * read does, and sends whatever cdctxNext returns as IN transfers. The "host
+ * task" finds the lines in place in the ring and answers each with "ok\n",
+ * flushing when it runs out of input, like usb_cdc.c.
+ *
+ * Window 1 is a host that waits for every ok (ping-pong), larger windows a
+ * streaming host. Latency is from the host queueing a command to it seeing
+ * the ok, on this machine; the bus columns count packets, since on the wire
+ * each costs the same, and give the rate a full speed bus (19 bulk packets
+ * per 1ms frame) would top out at. "unbatched" sends every reply as its own
+ * IN transfer, as a firmware that transmits each one as it's written does.
+ */
+
+#include "../cdc_ring.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COMMANDS 200000
+#define OUT_QUEUE 16 // Packets the host controller holds before it's NAKed
+#define BUS_PACKETS_PER_MS 19.0
+
+static const char *_commands[] = {
+    "G1 X10.25 Y-3.5 E0.0412\n",
+    "G1 X12.5 Y-1.75 E0.05\n",
+    "G1 F3000 X100 Y100\n",
+    "M105\n",
+    "G1 Z0.3 F600\n",
+    "G1 X-4.125 Y7.875 E0.1337 F1800\n",
+};
+#define COMMAND_KINDS (sizeof(_commands) / sizeof(_commands[0]))
+
+static CDCRxRing _rx;
+static CDCTxRing _tx;
+static sem_t _usbWake;  // usbWake and the OTG interrupt
+static sem_t _hostWake; // The host task's notification
+
+// Simulated OUT endpoint
+static pthread_mutex_t _outLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _outCond = PTHREAD_COND_INITIALIZER;
+static uint8_t _outPackets[OUT_QUEUE][CDC_PACKET_SIZE];
+static uint16_t _outLengths[OUT_QUEUE];
+static uint32_t _outHead, _outTail;
+
+// Host side bookkeeping
+static pthread_mutex_t _hostLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _hostCond = PTHREAD_COND_INITIALIZER;
+static double *_sent;
+static double *_latency;
+static uint32_t _acked;
+static uint32_t _window;
+
+static volatile uint32_t _flushTo;
+static volatile int _running;
+static int _batched;
+static unsigned long _outCount, _inCount, _inTransfers;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void _flush(void)
+{
+    _flushTo = _tx.head;
+    sem_post(&_usbWake);
+}
+
+/**
+ * @brief  The USB task: receives OUT packets into free slots and sends queued replies.
+ */
+static void *_usbTask(void *arg)
+{
+    (void)arg;
+    uint32_t pendingOks = 0;
+    while (_running)
+    {
+        sem_wait(&_usbWake);
+
+        // OUT: one packet per free slot, the rest stay NAKed in the host
+        uint8_t *slot;
+        while ((slot = cdcrxSlot(&_rx)) != NULL)
+        {
+            pthread_mutex_lock(&_outLock);
+            if (_outHead == _outTail)
+            {
+                pthread_mutex_unlock(&_outLock);
+                break;
+            }
+            uint32_t i = _outTail % OUT_QUEUE;
+            uint16_t length = _outLengths[i];
+            memcpy(slot, _outPackets[i], length);
+            _outTail++;
+            pthread_cond_signal(&_outCond);
+            pthread_mutex_unlock(&_outLock);
+
+            cdcrxCommit(&_rx, length);
+            sem_post(&_hostWake);
+        }
+
+        // IN: transfers complete at once here, so keep going until empty
+        const uint8_t *data;
+        uint32_t n;
+        while ((n = cdctxNext(&_tx, &data, (int32_t)(_flushTo - _tx.tail) > 0)) > 0)
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (data[i] != '\n')
+                    continue;
+                pendingOks++;
+                // A firmware that transmits each reply as it's written
+                if (!_batched)
+                    n = i + 1;
+            }
+            _inTransfers++;
+            _inCount += (n + CDC_PACKET_SIZE - 1) / CDC_PACKET_SIZE;
+            cdctxDone(&_tx, n);
+        }
+
+        if (pendingOks > 0)
+        {
+            double t = _now();
+            pthread_mutex_lock(&_hostLock);
+            while (pendingOks > 0 && _acked < COMMANDS)
+            {
+                _latency[_acked] = t - _sent[_acked];
+                _acked++;
+                pendingOks--;
+            }
+            pthread_cond_broadcast(&_hostCond);
+            pthread_mutex_unlock(&_hostLock);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  The host task: dispatches lines in place and answers each one.
+ */
+static void *_hostTask(void *arg)
+{
+    (void)arg;
+    uint32_t lines = 0;
+    while (_running)
+    {
+        sem_wait(&_hostWake);
+        const uint8_t *data;
+        uint32_t n;
+        while ((n = cdcrxPeek(&_rx, &data)) > 0)
+        {
+            // Stands in for gcodeFeed, which parses whole lines where they lie
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (data[i] != '\n')
+                    continue;
+                while (cdctxWrite(&_tx, (const uint8_t *)"ok\n", 3) != 3)
+                    _flush();
+                lines++;
+                if (!_batched)
+                    _flush();
+                else if (cdctxPending(&_tx) >= CDC_PACKET_SIZE)
+                    sem_post(&_usbWake);
+            }
+            cdcrxConsume(&_rx, n);
+            sem_post(&_usbWake); // A slot may have been freed
+        }
+        _flush();
+    }
+    (void)lines;
+    return NULL;
+}
+
+static void _sendPacket(const uint8_t *packet, uint16_t length)
+{
+    pthread_mutex_lock(&_outLock);
+    while (_outHead - _outTail >= OUT_QUEUE)
+        pthread_cond_wait(&_outCond, &_outLock);
+    uint32_t i = _outHead % OUT_QUEUE;
+    memcpy(_outPackets[i], packet, length);
+    _outLengths[i] = length;
+    _outHead++;
+    pthread_mutex_unlock(&_outLock);
+    _outCount++;
+    sem_post(&_usbWake);
+}
+
+static int _compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void _run(uint32_t window, int batched)
+{
+    pthread_t usb, host;
+    cdcrxReset(&_rx);
+    cdctxReset(&_tx);
+    _flushTo = 0;
+    _outHead = _outTail = 0;
+    _acked = 0;
+    _window = window;
+    _batched = batched;
+    _outCount = _inCount = _inTransfers = 0;
+    _running = 1;
+    sem_init(&_usbWake, 0, 0);
+    sem_init(&_hostWake, 0, 0);
+    pthread_create(&usb, NULL, _usbTask, NULL);
+    pthread_create(&host, NULL, _hostTask, NULL);
+
+    uint8_t packet[CDC_PACKET_SIZE];
+    uint16_t length = 0;
+    double start = _now();
+    uint32_t next = 0;
+    while (next < COMMANDS)
+    {
+        pthread_mutex_lock(&_hostLock);
+        while (next - _acked >= _window)
+            pthread_cond_wait(&_hostCond, &_hostLock);
+        // Everything the window allows right now goes out back to back
+        uint32_t allowed = _acked + _window;
+        pthread_mutex_unlock(&_hostLock);
+
+        double t = _now();
+        while (next < allowed && next < COMMANDS)
+        {
+            const char *c = _commands[next % COMMAND_KINDS];
+            size_t n = strlen(c);
+            _sent[next++] = t;
+            for (size_t i = 0; i < n; i++)
+            {
+                packet[length++] = (uint8_t)c[i];
+                if (length == CDC_PACKET_SIZE)
+                {
+                    _sendPacket(packet, length);
+                    length = 0;
+                }
+            }
+        }
+        if (length > 0)
+        {
+            _sendPacket(packet, length);
+            length = 0;
+        }
+    }
+
+    pthread_mutex_lock(&_hostLock);
+    while (_acked < COMMANDS)
+        pthread_cond_wait(&_hostCond, &_hostLock);
+    pthread_mutex_unlock(&_hostLock);
+    double s = _now() - start;
+
+    _running = 0;
+    sem_post(&_usbWake);
+    sem_post(&_hostWake);
+    pthread_join(usb, NULL);
+    pthread_join(host, NULL);
+    sem_destroy(&_usbWake);
+    sem_destroy(&_hostWake);
+
+    qsort(_latency, COMMANDS, sizeof(double), _compare);
+    double perCommand = (double)(_outCount + _inCount) / COMMANDS;
+    printf("%6u %9s %10.0f %7.1f %7.1f %7.1f %7.1f %8.1f %7.3f %7.3f %9.0f\n", window,
+           batched ? "batched" : "unbatched", COMMANDS / s,
+           _latency[COMMANDS / 2] * 1e6, _latency[COMMANDS * 9 / 10] * 1e6,
+           _latency[COMMANDS * 99 / 100] * 1e6, _latency[COMMANDS * 999 / 1000] * 1e6,
+           _latency[COMMANDS - 1] * 1e6,
+           (double)_outCount / COMMANDS, (double)_inCount / COMMANDS,
+           BUS_PACKETS_PER_MS * 1000.0 / perCommand);
+}
+
+int main(void)
+{
+    const uint32_t windows[] = {1, 4, 32, 256};
+    _sent = malloc(COMMANDS * sizeof(double));
+    _latency = malloc(COMMANDS * sizeof(double));
+    if (_sent == NULL || _latency == NULL)
+        return 1;
+
+    printf("                           latency us                              packets/cmd   bus max\n");
+    printf("window      mode      cmd/s     p50     p90     p99   p99.9      max     out      in     cmd/s\n");
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+    {
+        _run(windows[w], 1);
+        _run(windows[w], 0);
+    }
+    free(_sent);
+    free(_latency);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file usb.c
+ * @brief USB device on OTG_FS, serviced from a task instead of the interrupt.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usb.h"
+#include "usbd_desc.h"
+#include "../Core/forge.h"
+#include "../Core/scheduler.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+UsbDevice USB_DEVICE;
+
+static StackType_t _usbStack[FORGE_STACK_USB];
+static StaticTask_t _usbTcb;
+
+/**
+ * @brief  Runs everything the HAL and the class drivers would otherwise do in the interrupt. Class callbacks, e.g. the MSC storage ones, can block here on the SD card or on a full buffer without holding off the step timer or any other interrupt.
+ */
+static void _usbTask(void *arg)
+{
+    (void)arg;
+    UsbDevice *usb = &USB_DEVICE;
+
+    if (USBD_Init(&usb->dev, &FORGE_USB_DESC, 0) != USBD_OK)
+    {
+        usb->lastError = USB_ERROR_FAILED_INIT;
+        vTaskDelete(NULL);
+    }
+    if (!usb->configure(&usb->dev))
+    {
+        usb->lastError = USB_ERROR_FAILED_CLASS;
+        vTaskDelete(NULL);
+    }
+    USBD_Start(&usb->dev);
+    HAL_NVIC_EnableIRQ(USB_IRQn);
+
+    for (;;)
+    {
+        // Woken by the interrupt, by usbWake or by the timeout. The core's
+        // interrupt status is simply empty in the last two cases.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(USB_SERVICE_PERIOD_MS));
+        HAL_PCD_IRQHandler(&usb->hpcd);
+        // Everything pending has been handled, so the line is low again
+        HAL_NVIC_EnableIRQ(USB_IRQn);
+        for (uint8_t i = 0; i < usb->serviceCount; i++)
+            usb->services[i]();
+
+        uint8_t state = usb->dev.dev_state;
+        if (state != usb->state)
+        {
+            // Without VBUS sensing a pulled cable also shows up as a suspend
+            if (state == USBD_STATE_SUSPENDED && usb->suspended != NULL)
+                usb->suspended();
+            usb->state = state;
+        }
+    }
+}
+
+/**
+ * @brief  Creates the USB task, which brings up the device and connects it to the bus. Call once before forgeStartScheduler.
+ * @param[in]  configure registers the classes, e.g. USBD_RegisterClassComposite and USBD_MSC_RegisterStorage. Returns false on failure.
+ * @param[in]  suspended is called when the bus is suspended, may be NULL.
+ * @retval None
+ * @headerfile usb.h
+ */
+void usbBegin(bool (*configure)(USBD_HandleTypeDef *dev), void (*suspended)(void))
+{
+    UsbDevice *usb = &USB_DEVICE;
+    forgeInitHAL();
+
+    usb->configure = configure;
+    usb->suspended = suspended;
+    usb->state = USBD_STATE_DEFAULT;
+    usb->interrupts = 0;
+    usb->lastError = USB_ERROR_NONE;
+
+    usb->task = forgeCreateTask(_usbTask, "usb", FORGE_STACK_USB, FORGE_PRIO_USB, _usbStack, &_usbTcb);
+}
+
+/**
+ * @brief  Registers a function for the USB task to run after each interrupt and usbWake. Call before forgeStartScheduler.
+ * @retval None
+ * @headerfile usb.h
+ */
+void usbAddService(void (*service)(void))
+{
+    UsbDevice *usb = &USB_DEVICE;
+    if (usb->serviceCount < USB_MAX_SERVICES)
+        usb->services[usb->serviceCount++] = service;
+}
+
+/**
+ * @brief  Makes the USB task run its services, e.g. after queueing data to send. Class functions that start transfers are only safe from the USB task. Call from a task.
+ * @retval None
+ * @headerfile usb.h
+ */
+void usbWake(void)
+{
+    if (USB_DEVICE.task != NULL)
+        xTaskNotifyGive(USB_DEVICE.task);
+}
+
+/**
+ * @brief  Hands the interrupt to the USB task. It stays masked in the NVIC until the task has run HAL_PCD_IRQHandler, since the core keeps it asserted until then.
+ * @retval None
+ * @headerfile usb.h
+ */
+void usbIRQHandler(void)
+{
+    UsbDevice *usb = &USB_DEVICE;
+    HAL_NVIC_DisableIRQ(USB_IRQn);
+    usb->interrupts++;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(usb->task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
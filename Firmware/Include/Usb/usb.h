@@ -0,0 +1,77 @@
+/**
+ * @file usb.h
+ * @brief USB device on OTG_FS, serviced from a task instead of the interrupt.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_H
+#define __FORGE_USB_H
+
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_def.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// The interrupt only wakes the task, so it has to be allowed to call FromISR
+// functions (configMAX_SYSCALL_INTERRUPT_PRIORITY is 5)
+#define USB_IRQ_PRIORITY 6
+#define USB_IRQn OTG_FS_IRQn
+#define USB_MAX_SERVICES 4
+// The services also run at least this often, e.g. to send what a stream
+// has buffered once it goes quiet
+#define USB_SERVICE_PERIOD_MS 10
+
+    /**
+     * @brief Stores an error from bringing up the USB device.
+     */
+    typedef enum
+    {
+        USB_ERROR_NONE = 0,
+        USB_ERROR_FAILED_INIT,
+        USB_ERROR_FAILED_CLASS
+    } UsbError;
+
+    /**
+     * @brief The single USB device.
+     */
+    typedef struct
+    {
+        USBD_HandleTypeDef dev;
+        PCD_HandleTypeDef hpcd;
+        TaskHandle_t task;
+
+        // Registers the classes and their interfaces with dev, from the USB task before the device connects
+        bool (*configure)(USBD_HandleTypeDef *dev);
+        // Called from the USB task when the host suspends the bus or the cable is pulled, may be NULL
+        void (*suspended)(void);
+        // Run by the USB task after every interrupt and usbWake, and every USB_SERVICE_PERIOD_MS, e.g. to start a transfer other tasks queued data for
+        void (*services[USB_MAX_SERVICES])(void);
+        uint8_t serviceCount;
+
+        volatile uint8_t state; // dev.dev_state as last seen by the task
+        uint32_t interrupts;
+
+        UsbError lastError;
+    } UsbDevice;
+
+    extern UsbDevice USB_DEVICE;
+
+    void usbBegin(bool (*configure)(USBD_HandleTypeDef *dev), void (*suspended)(void));
+    void usbAddService(void (*service)(void));
+    void usbWake(void);
+    void usbIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_H */
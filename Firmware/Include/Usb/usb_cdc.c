@@ -0,0 +1,303 @@
+/**
+ * @file usb_cdc.c
+ * @brief USB CDC serial port for host commands, on zero-copy rings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usb_cdc.h"
+#include "usb.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_def.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include <stdbool.h>
+#include <string.h>
+
+CDCPort USB_CDC;
+
+static StaticSemaphore_t _txLockBuffer;
+static StaticSemaphore_t _txSpaceBuffer;
+
+static bool _configured(void)
+{
+    return USB_DEVICE.dev.dev_state == USBD_STATE_CONFIGURED;
+}
+
+/**
+ * @brief  Queues what the ring holds for the comms task, as much of it as fits in its stream buffer. What doesn't stays in the ring until cdcDrained. USB task only.
+ */
+static void _pump(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    const uint8_t *data;
+    uint32_t n;
+    while ((n = cdcrxPeek(&cdc->rx, &data)) > 0)
+    {
+        uint32_t sent = (uint32_t)forgeCommsSend(data, n);
+        cdcrxConsume(&cdc->rx, sent);
+        if (sent < n)
+        {
+            cdc->rxBacklog = true;
+            return;
+        }
+    }
+    cdc->rxBacklog = false;
+}
+
+/**
+ * @brief  Points the OUT endpoint at the next free slot, or leaves it NAKing until _pump frees one. USB task only.
+ */
+static void _arm(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    uint8_t *slot = cdcrxSlot(&cdc->rx);
+    if (slot == NULL)
+    {
+        if (cdc->rxArmed)
+            cdc->stats.rxStalls++;
+        cdc->rxArmed = false;
+        return;
+    }
+    // These act on whichever class the core dispatched to last
+    USB_DEVICE.dev.classId = cdc->classId;
+    USBD_CDC_SetRxBuffer(&USB_DEVICE.dev, slot);
+    USBD_CDC_ReceivePacket(&USB_DEVICE.dev);
+    cdc->rxArmed = true;
+}
+
+/**
+ * @brief  Starts the next IN transfer if none is in flight: whole packets, or whatever is left up to flushTo. USB task only.
+ */
+static void _send(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    if (cdc->txBusy || !_configured())
+        return;
+
+    const uint8_t *data;
+    bool partial = (int32_t)(cdc->flushTo - cdc->tx.tail) > 0;
+    uint32_t n = cdctxNext(&cdc->tx, &data, partial);
+    if (n == 0)
+        return;
+
+    USBD_CDC_SetTxBuffer(&USB_DEVICE.dev, (uint8_t *)data, n, cdc->classId);
+    if (USBD_CDC_TransmitPacket(&USB_DEVICE.dev, cdc->classId) != USBD_OK)
+        return;
+    cdc->txBusy = true;
+    cdc->txLength = n;
+    cdc->stats.txTransfers++;
+    cdc->stats.txBytes += n;
+    if (n % CDC_PACKET_SIZE != 0)
+        cdc->stats.txPartial++;
+}
+
+static void _service(void)
+{
+    if (!_configured())
+        return;
+    _pump();
+    if (!USB_CDC.rxArmed)
+        _arm();
+    _send();
+}
+
+static int8_t CDC_Init(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    cdcrxReset(&cdc->rx);
+    cdctxReset(&cdc->tx);
+    cdc->flushTo = 0;
+    cdc->txBusy = false;
+    cdc->open = false;
+    cdc->rxBacklog = false;
+    // The class arms the endpoint itself right after this
+    USBD_CDC_SetRxBuffer(&USB_DEVICE.dev, cdcrxSlot(&cdc->rx));
+    cdc->rxArmed = true;
+    return USBD_OK;
+}
+
+static int8_t CDC_DeInit(void)
+{
+    USB_CDC.open = false;
+    USB_CDC.txBusy = false;
+    return USBD_OK;
+}
+
+static int8_t CDC_Control(uint8_t cmd, uint8_t *pbuf, uint16_t length)
+{
+    CDCPort *cdc = &USB_CDC;
+    switch (cmd)
+    {
+    case CDC_SET_LINE_CODING:
+        memcpy(cdc->lineCoding, pbuf, (length < sizeof(cdc->lineCoding)) ? length : sizeof(cdc->lineCoding));
+        break;
+    case CDC_GET_LINE_CODING:
+        memcpy(pbuf, cdc->lineCoding, (length < sizeof(cdc->lineCoding)) ? length : sizeof(cdc->lineCoding));
+        break;
+    case CDC_SET_CONTROL_LINE_STATE:
+    {
+        // No data stage, pbuf is the setup packet; DTR is bit 0 of wValue
+        bool open = (((USBD_SetupReqTypedef *)pbuf)->wValue & 0x0001U) != 0;
+        bool opened = open && !cdc->open;
+        cdc->open = open;
+        if (opened)
+        {
+            cdc->greet = true;
+            forgeCommsWake();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return USBD_OK;
+}
+
+/**
+ * @brief  The packet is already in its slot; publish it, queue it for the comms task and arm the next slot.
+ */
+static int8_t CDC_Receive(uint8_t *Buf, uint32_t *Len)
+{
+    (void)Buf;
+    CDCPort *cdc = &USB_CDC;
+    if (*Len > 0)
+    {
+        cdcrxCommit(&cdc->rx, (uint16_t)*Len);
+        cdc->stats.rxPackets++;
+        cdc->stats.rxBytes += *Len;
+        _pump();
+    }
+    _arm();
+    return USBD_OK;
+}
+
+static int8_t CDC_TransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
+{
+    (void)Buf;
+    (void)Len;
+    (void)epnum;
+    CDCPort *cdc = &USB_CDC;
+    cdctxDone(&cdc->tx, cdc->txLength);
+    cdc->txBusy = false;
+    xSemaphoreGive(cdc->txSpace);
+    _send();
+    return USBD_OK;
+}
+
+USBD_CDC_ItfTypeDef USB_CDC_FOPS = {
+    CDC_Init,
+    CDC_DeInit,
+    CDC_Control,
+    CDC_Receive,
+    CDC_TransmitCplt};
+
+/**
+ * @brief  Sets up the port. What the host sends goes to the comms task (Core/scheduler.c), whose forgeCommsWoken and forgeCommsDrained should call cdcWoken and cdcDrained. Call once before usbBegin, then register USB_CDC_FOPS with USBD_CDC_RegisterInterface and set classId.
+ * @retval None
+ * @headerfile usb_cdc.h
+ */
+void cdcInit(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    // 115200 8N1, only ever reported back
+    const uint8_t lineCoding[7] = {0x00, 0xC2, 0x01, 0x00, 0x00, 0x00, 0x08};
+    memcpy(cdc->lineCoding, lineCoding, sizeof(lineCoding));
+    memset(&cdc->stats, 0, sizeof(cdc->stats));
+    cdcrxReset(&cdc->rx);
+    cdctxReset(&cdc->tx);
+    cdc->txLock = xSemaphoreCreateMutexStatic(&_txLockBuffer);
+    cdc->txSpace = xSemaphoreCreateBinaryStatic(&_txSpaceBuffer);
+    forgeMemoryAdd("cdc", cdc, sizeof(*cdc));
+    usbAddService(_service);
+}
+
+/**
+ * @brief  Queues bytes for the host. They go out once they fill a packet, or on cdcFlush. Waits up to CDC_TX_TIMEOUT_MS for room. Call from a task.
+ * @retval The number of bytes queued; the rest were dropped, e.g. because the port isn't open.
+ * @headerfile usb_cdc.h
+ */
+uint32_t cdcWrite(const uint8_t *data, uint32_t length)
+{
+    CDCPort *cdc = &USB_CDC;
+    if (!cdc->open)
+    {
+        cdc->stats.txDropped += length;
+        return 0;
+    }
+
+    xSemaphoreTake(cdc->txLock, portMAX_DELAY);
+    uint32_t done = 0;
+    for (;;)
+    {
+        done += cdctxWrite(&cdc->tx, data + done, length - done);
+        // A transfer in flight picks up new packets when it completes
+        if (!cdc->txBusy && cdctxPending(&cdc->tx) >= CDC_PACKET_SIZE)
+            usbWake();
+        if (done == length)
+            break;
+        if (xSemaphoreTake(cdc->txSpace, pdMS_TO_TICKS(CDC_TX_TIMEOUT_MS)) != pdTRUE)
+            break;
+    }
+    xSemaphoreGive(cdc->txLock);
+
+    cdc->stats.txDropped += length - done;
+    return done;
+}
+
+/**
+ * @brief  Sends everything queued so far without waiting for a full packet. cdcDrained calls this whenever the comms task runs out of input.
+ * @retval None
+ * @headerfile usb_cdc.h
+ */
+void cdcFlush(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    uint32_t head = cdc->tx.head;
+    if (head == cdc->tx.tail || head == cdc->flushTo)
+        return;
+    cdc->flushTo = head;
+    usbWake();
+}
+
+/**
+ * @brief  Comms task side, as it wakes: runs cdcOpened if the host has just opened the port, ahead of any of its input.
+ * @retval None
+ * @headerfile usb_cdc.h
+ */
+void cdcWoken(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    if (cdc->greet)
+    {
+        cdc->greet = false;
+        cdcOpened();
+    }
+}
+
+/**
+ * @brief  Comms task side, once it has run everything queued: sends the replies, and has the USB task queue what the ring held back. A parser that blocks, e.g. on a full planner queue, just leaves the host NAKed once the ring fills up.
+ * @retval None
+ * @headerfile usb_cdc.h
+ */
+void cdcDrained(void)
+{
+    CDCPort *cdc = &USB_CDC;
+    // Out of input, so nothing more is coming to fill the last packet
+    cdcFlush();
+    if (cdc->rxBacklog || !cdc->rxArmed)
+        usbWake();
+}
+
+/**
+ * @brief  Called from the comms task when the host opens the port (raises DTR), before any of its input, e.g. to greet it. Whatever it writes goes out ahead of the replies. The default does nothing.
+ * @retval None
+ * @headerfile usb_cdc.h
+ */
+__weak void cdcOpened(void)
+{
+}
@@ -0,0 +1,81 @@
+/**
+ * @file usb_cdc.h
+ * @brief USB CDC serial port for host commands, on zero-copy rings.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_CDC_H
+#define __FORGE_USB_CDC_H
+
+#include "cdc_ring.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../STM32_USB_Device_Library/Class/CDC/Inc/usbd_cdc.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// How long cdcWrite waits for room before dropping the rest, e.g. when the
+// host stopped reading without closing the port
+#define CDC_TX_TIMEOUT_MS 50
+
+    /**
+     * @brief Counters, to see how well packets are being filled.
+     */
+    typedef struct
+    {
+        uint32_t rxPackets;
+        uint32_t rxBytes;
+        uint32_t rxStalls;    // Times the OUT endpoint was left NAKing on a full ring
+        uint32_t txTransfers; // IN transfers, each one or more packets
+        uint32_t txBytes;
+        uint32_t txPartial;   // Transfers that ended in a short packet
+        uint32_t txDropped;   // Bytes cdcWrite gave up on
+    } CDCStats;
+
+    /**
+     * @brief The single CDC port. The USB task fills rx, drains it into the comms task's stream buffer and drains tx; writers fill tx under txLock.
+     */
+    typedef struct
+    {
+        CDCRxRing rx;
+        CDCTxRing tx;
+        uint8_t classId; // The CDC class in the composite device
+        SemaphoreHandle_t txLock;
+        SemaphoreHandle_t txSpace; // Given when a transfer completes
+
+        volatile bool open;      // DTR set by the host
+        volatile bool greet;     // The port was just opened; cdcOpened is due
+        volatile bool rxArmed;   // The OUT endpoint has a slot to receive into
+        volatile bool rxBacklog; // The comms task's buffer was full; the ring holds more for it
+        volatile bool txBusy;
+        volatile uint32_t flushTo; // Send up to here even if it doesn't fill a packet
+        uint32_t txLength;         // Bytes in the transfer in flight
+        uint8_t lineCoding[7];     // Kept for GET_LINE_CODING; the baud rate means nothing here
+
+        CDCStats stats;
+    } CDCPort;
+
+    extern CDCPort USB_CDC;
+    extern USBD_CDC_ItfTypeDef USB_CDC_FOPS;
+
+    void cdcInit(void);
+    uint32_t cdcWrite(const uint8_t *data, uint32_t length);
+    void cdcFlush(void);
+    void cdcWoken(void);
+    void cdcDrained(void);
+    void cdcOpened(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_CDC_H */
@@ -0,0 +1,337 @@
+/**
+ * @file usb_dap.c
+ * @brief CMSIS-DAP v2 debug probe on a vendor interface: commands and responses on a pair of bulk endpoints, and with SWO_STREAM the SWO trace streamed on a third.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ *
+ * Plays the part of the reference firmware's USB layer and DAP_Thread. The
+ * USB task receives requests into a ring of DAP_PACKET_COUNT, so the host
+ * can have that many in flight, and the DAP task runs them in order and
+ * queues the responses for the USB task to send. ID_DAP_TransferAbort is
+ * acted on as it arrives instead, so it can stop a transfer that's running.
+ * The SWO stream (SWO_Thread in DAP/SWO.c) runs on a task of its own and
+ * hands its transfers over through SWO_QueueTransfer. On the Forge's OTG_FS
+ * there's no IN endpoint left for it, so SWO_STREAM is 0 and the host
+ * reads the trace with DAP_SWO_Data instead.
+ */
+
+#include "usb_dap.h"
+#include "usb.h"
+#include "../Core/memory.h"
+#include "../Core/scheduler.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_ctlreq.h"
+#include "../STM32_USB_Device_Library/Class/CompositeBuilder/Inc/usbd_composite_builder.h"
+#include <string.h>
+
+#define DAP_INTERFACE_STRING "Forge CMSIS-DAP"
+
+DapProbe USB_DAP;
+
+#if (USBD_CMPSIT_ACTIVATE_DAP == 1U) && ((SWO_STREAM != 0) != (USBD_CMPSIT_DAP_EPS == 3U))
+#error "SWO_STREAM needs the third DAP endpoint, USBD_CMPSIT_DAP_EPS 3U"
+#endif
+
+static StackType_t _dapStack[FORGE_STACK_DAP];
+static StaticTask_t _dapTcb;
+#if (SWO_STREAM != 0)
+TaskHandle_t SWO_ThreadId;
+static StackType_t _swoStack[FORGE_STACK_SWO];
+static StaticTask_t _swoTcb;
+#endif
+
+/**
+ * @brief  Arms the OUT endpoint for the next request if the ring has room for it. USB task only.
+ */
+static void _receive(DapProbe *d)
+{
+    if (!d->active || d->receiving || d->requestI - d->requestO >= DAP_PACKET_COUNT)
+        return;
+    d->receiving = true;
+    USBD_LL_PrepareReceive(&USB_DEVICE.dev, d->outEp, d->request[d->requestI % DAP_PACKET_COUNT], DAP_PACKET_SIZE);
+}
+
+/**
+ * @brief  Starts sending the next response and the SWO transfer, if they aren't already, and takes the next request once the DAP task has freed a slot. USB task only.
+ */
+static void _send(void)
+{
+    DapProbe *d = &USB_DAP;
+    if (!d->active)
+    {
+        // Nobody to send them to
+        d->responseO = d->responseI;
+        return;
+    }
+
+    if (!d->sending && d->responseO != d->responseI)
+    {
+        uint32_t slot = d->responseO % DAP_PACKET_COUNT;
+        d->sending = true;
+        USBD_LL_Transmit(&USB_DEVICE.dev, d->inEp, d->response[slot], d->responseLength[slot]);
+    }
+
+#if (SWO_STREAM != 0)
+    if (!d->swoBusy && d->swoQueued)
+    {
+        d->swoQueued = false;
+        d->swoBusy = true;
+        // A flush that stops short of a block on a packet boundary wouldn't
+        // end the host's read
+        d->swoZlp = (d->swoCount % USBD_CMPSIT_VENDOR_PACKET_SIZE) == 0 && (d->swoCount % DAP_SWO_BLOCK_SIZE) != 0;
+        USBD_LL_Transmit(&USB_DEVICE.dev, d->swoEp, d->swoBuffer, d->swoCount);
+    }
+#endif
+
+    _receive(d);
+}
+
+/**
+ * @brief  Runs the requests in order. Queued commands run as they come, as the reference firmware does over bulk endpoints, where there's no need to batch them.
+ */
+static void _dapTask(void *arg)
+{
+    (void)arg;
+    DapProbe *d = &USB_DAP;
+    for (;;)
+    {
+        while (d->requestO == d->requestI || d->responseI - d->responseO >= DAP_PACKET_COUNT)
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint8_t *request = d->request[d->requestO % DAP_PACKET_COUNT];
+        uint32_t slot = d->responseI % DAP_PACKET_COUNT;
+        if (request[0] == ID_DAP_QueueCommands)
+            request[0] = ID_DAP_ExecuteCommands;
+        uint32_t n = DAP_ExecuteCommand(request, d->response[slot]);
+        d->responseLength[slot] = (uint16_t)n;
+        d->stats.commands++;
+        __DMB();
+        d->responseI++;
+        d->requestO++;
+        usbWake();
+    }
+}
+
+#if (SWO_STREAM != 0)
+// Called by SWO_Thread on its own task
+void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+    DapProbe *d = &USB_DAP;
+    d->swoBuffer = buf;
+    d->swoCount = num;
+    __DMB();
+    d->swoQueued = true;
+    usbWake();
+}
+
+// Called by ClearTrace, on the DAP task. The class driver runs on the USB
+// task, so holding it off makes this atomic with a completion.
+void SWO_AbortTransfer(void)
+{
+    DapProbe *d = &USB_DAP;
+    taskENTER_CRITICAL();
+    d->swoQueued = false;
+    if (d->swoBusy)
+        d->swoDiscard = true;
+    taskEXIT_CRITICAL();
+}
+#endif
+
+static uint8_t _init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    (void)cfgidx;
+    DapProbe *d = &USB_DAP;
+    d->classId = (uint8_t)pdev->classId;
+    // In the order the builder was given them: command OUT, response IN, SWO IN
+    d->outEp = pdev->tclasslist[pdev->classId].Eps[0].add;
+    d->inEp = pdev->tclasslist[pdev->classId].Eps[1].add;
+    USBD_LL_OpenEP(pdev, d->outEp, USBD_EP_TYPE_BULK, USBD_CMPSIT_VENDOR_PACKET_SIZE);
+    USBD_LL_OpenEP(pdev, d->inEp, USBD_EP_TYPE_BULK, USBD_CMPSIT_VENDOR_PACKET_SIZE);
+    pdev->ep_out[d->outEp & 0xFU].is_used = 1U;
+    pdev->ep_in[d->inEp & 0xFU].is_used = 1U;
+#if (SWO_STREAM != 0)
+    d->swoEp = pdev->tclasslist[pdev->classId].Eps[2].add;
+    USBD_LL_OpenEP(pdev, d->swoEp, USBD_EP_TYPE_BULK, USBD_CMPSIT_VENDOR_PACKET_SIZE);
+    pdev->ep_in[d->swoEp & 0xFU].is_used = 1U;
+#endif
+    pdev->pClassDataCmsit[pdev->classId] = d;
+
+    // Requests the DAP task still has are run and their responses go to
+    // the new host, which starts with DAP_Info and ignores them
+    d->receiving = false;
+    d->sending = false;
+#if (SWO_STREAM != 0)
+    d->swoBusy = false;
+    d->swoDiscard = false;
+#endif
+    d->active = true;
+    _receive(d);
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t _deInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    (void)cfgidx;
+    DapProbe *d = &USB_DAP;
+    d->active = false;
+    USBD_LL_CloseEP(pdev, d->outEp);
+    USBD_LL_CloseEP(pdev, d->inEp);
+    pdev->ep_out[d->outEp & 0xFU].is_used = 0U;
+    pdev->ep_in[d->inEp & 0xFU].is_used = 0U;
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+
+#if (SWO_STREAM != 0)
+    USBD_LL_CloseEP(pdev, d->swoEp);
+    pdev->ep_in[d->swoEp & 0xFU].is_used = 0U;
+    // A stream transfer cut off never completes; SWO_Thread waits for one,
+    // so it's completed here, as the bytes are lost anyway
+    if (d->swoBusy && !d->swoDiscard)
+        SWO_TransferComplete();
+    d->swoBusy = false;
+#endif
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t _setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    // Only the standard interface requests, like the telemetry interface
+    static uint8_t zero[2] = {0, 0};
+    if ((req->bmRequest & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD &&
+        pdev->dev_state == USBD_STATE_CONFIGURED)
+    {
+        switch (req->bRequest)
+        {
+        case USB_REQ_GET_STATUS:
+            USBD_CtlSendData(pdev, zero, 2U);
+            return (uint8_t)USBD_OK;
+        case USB_REQ_GET_INTERFACE:
+            USBD_CtlSendData(pdev, zero, 1U);
+            return (uint8_t)USBD_OK;
+        case USB_REQ_SET_INTERFACE:
+            if (req->wValue == 0U)
+                return (uint8_t)USBD_OK;
+            break;
+        case USB_REQ_CLEAR_FEATURE:
+            return (uint8_t)USBD_OK;
+        default:
+            break;
+        }
+    }
+    USBD_CtlError(pdev, req);
+    return (uint8_t)USBD_FAIL;
+}
+
+static uint8_t _dataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    DapProbe *d = &USB_DAP;
+    if (epnum == (d->inEp & 0xFU))
+    {
+        d->responseO++;
+        d->sending = false;
+        // The slot it used is free for the next response
+        xTaskNotifyGive(d->task);
+    }
+#if (SWO_STREAM != 0)
+    else if (epnum == (d->swoEp & 0xFU))
+    {
+        if (d->swoZlp)
+        {
+            d->swoZlp = false;
+            USBD_LL_Transmit(pdev, d->swoEp, NULL, 0U);
+            return (uint8_t)USBD_OK;
+        }
+        d->swoBusy = false;
+        if (d->swoDiscard)
+        {
+            d->swoDiscard = false;
+        }
+        else
+        {
+            d->stats.swoBytes += d->swoCount;
+            SWO_TransferComplete();
+        }
+    }
+#endif
+    _send();
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t _dataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    (void)epnum;
+    DapProbe *d = &USB_DAP;
+    d->receiving = false;
+    uint8_t *request = d->request[d->requestI % DAP_PACKET_COUNT];
+    if (USBD_LL_GetRxDataSize(pdev, d->outEp) > 0U && request[0] == ID_DAP_TransferAbort)
+    {
+        // Not queued: the slot is taken again for the next request
+        DAP_TransferAbort = 1U;
+        d->stats.aborts++;
+    }
+    else
+    {
+        d->requestI++;
+        xTaskNotifyGive(d->task);
+    }
+    _receive(d);
+    return (uint8_t)USBD_OK;
+}
+
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+static uint8_t *_string(USBD_HandleTypeDef *pdev, uint8_t index, uint16_t *length)
+{
+    (void)pdev;
+    static uint8_t descriptor[2U + 2U * sizeof(DAP_INTERFACE_STRING)];
+    if (index != USBD_CMPSIT_DAP_STRING_INDEX)
+        return NULL;
+    USBD_GetString((uint8_t *)DAP_INTERFACE_STRING, descriptor, length);
+    return descriptor;
+}
+#endif
+
+// Descriptors come from the composite builder (USBD_CMPSIT_DAPDesc)
+USBD_ClassTypeDef USB_DAP_CLASS = {
+    _init,
+    _deInit,
+    _setup,
+    NULL, // EP0_TxSent
+    NULL, // EP0_RxReady
+    _dataIn,
+    _dataOut,
+    NULL, // SOF
+    NULL, // IsoINIncomplete
+    NULL, // IsoOUTIncomplete
+    NULL, // GetHSConfigDescriptor
+    NULL, // GetFSConfigDescriptor
+    NULL, // GetOtherSpeedConfigDescriptor
+    NULL, // GetDeviceQualifierDescriptor
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+    _string,
+#endif
+};
+
+/**
+ * @brief  Sets up the debug port, the SWO capture and the target's UART, and starts the DAP and SWO tasks. Call once before usbBegin, then register USB_DAP_CLASS with USBD_RegisterClassComposite as CLASS_TYPE_DAP.
+ * @retval None
+ * @headerfile usb_dap.h
+ */
+void dapInit(void)
+{
+    DapProbe *d = &USB_DAP;
+    forgeMemoryAdd("dap", d, sizeof(*d));
+    memset(&d->stats, 0, sizeof(d->stats));
+    d->active = false;
+
+    DAP_Setup();
+    SWO_Setup();
+#if (DAP_UART != 0)
+    UART_Setup();
+#endif
+    d->task = forgeCreateTask(_dapTask, "dap", FORGE_STACK_DAP, FORGE_PRIO_DAP, _dapStack, &_dapTcb);
+#if (SWO_STREAM != 0)
+    SWO_ThreadId = forgeCreateTask(SWO_Thread, "swo", FORGE_STACK_SWO, FORGE_PRIO_SWO, _swoStack, &_swoTcb);
+#endif
+    usbAddService(_send);
+}
@@ -0,0 +1,82 @@
+/**
+ * @file usb_dap.h
+ * @brief CMSIS-DAP v2 debug probe on a vendor interface: commands and responses on a pair of bulk endpoints, and with SWO_STREAM the SWO trace streamed on a third.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_DAP_H
+#define __FORGE_USB_DAP_H
+
+#include "../DAP/DAP_config.h"
+#include "../DAP/DAP.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_def.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Commands run on a task of their own, as they can hold the SWD lines for
+// milliseconds; the SWO stream's task only ever waits. Both sit with the
+// network, under anything that feeds the planner.
+#define FORGE_PRIO_DAP (tskIDLE_PRIORITY + 2)
+#define FORGE_PRIO_SWO (tskIDLE_PRIORITY + 2)
+#define FORGE_STACK_DAP 384
+#define FORGE_STACK_SWO 256
+
+// The host reads the SWO stream this much at a time, SWO.c's USB_BLOCK_SIZE
+#define DAP_SWO_BLOCK_SIZE 512U
+
+    typedef struct
+    {
+        uint32_t commands;
+        uint32_t aborts;   // ID_DAP_TransferAbort, acted on as it arrived
+        uint32_t swoBytes;
+    } DapStats;
+
+    /**
+     * @brief The single probe. Requests and responses each go through a ring of DAP_PACKET_COUNT packets: the USB task fills the request ring and empties the response ring, the DAP task the other way round. Indices only ever increase.
+     */
+    typedef struct
+    {
+        uint8_t request[DAP_PACKET_COUNT][DAP_PACKET_SIZE];
+        uint8_t response[DAP_PACKET_COUNT][DAP_PACKET_SIZE];
+        uint16_t responseLength[DAP_PACKET_COUNT];
+        volatile uint32_t requestI, requestO;
+        volatile uint32_t responseI, responseO;
+
+        uint8_t classId;
+        uint8_t outEp, inEp, swoEp;
+        volatile bool active;  // The host has configured the device
+        bool receiving;        // The OUT endpoint is armed for request[requestI]
+        bool sending;          // A response is in flight
+
+        // SWO_QueueTransfer's transfer, started by the USB task
+        uint8_t *swoBuffer;
+        uint32_t swoCount;
+        volatile bool swoQueued;
+        bool swoBusy;
+        bool swoZlp;
+        bool swoDiscard; // The transfer in flight was aborted; its completion isn't reported
+
+        TaskHandle_t task;
+        DapStats stats;
+    } DapProbe;
+
+    extern DapProbe USB_DAP;
+    extern USBD_ClassTypeDef USB_DAP_CLASS;
+
+    void dapInit(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_DAP_H */
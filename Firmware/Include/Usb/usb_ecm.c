@@ -0,0 +1,173 @@
+/**
+ * @file usb_ecm.c
+ * @brief USB CDC-ECM network function, feeding the LwIP interface in Net/ecmif.c.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usb_ecm.h"
+#include "usb.h"
+#include "../STM32_USB_Device_Library/Class/CDC_ECM/Inc/usbd_cdc_ecm_if_template.h"
+#include <stdbool.h>
+
+UsbEcmPort USB_ECM;
+
+// Only ever received into when every buffer was still with LwIP as the host
+// configured the device, and thrown away
+static uint8_t _discard[ECMIF_FRAME_SIZE] __ALIGNED(4);
+
+static USBD_CDC_ECM_HandleTypeDef *_handle(void)
+{
+    return (USBD_CDC_ECM_HandleTypeDef *)USB_DEVICE.dev.pClassDataCmsit[USB_ECM.classId];
+}
+
+/**
+ * @brief  Points the OUT endpoint at the next free buffer, or leaves it NAKing until LwIP frees one. USB task only.
+ */
+static void _arm(void)
+{
+    UsbEcmPort *port = &USB_ECM;
+    uint8_t *buffer = ecmifRxBuffer(port->ecm);
+    if (buffer == NULL)
+    {
+        if (port->rxArmed)
+            port->ecm->stats.rxStalls++;
+        port->rxArmed = false;
+        return;
+    }
+    // These act on whichever class the core dispatched to last
+    USB_DEVICE.dev.classId = port->classId;
+    USBD_CDC_ECM_SetRxBuffer(&USB_DEVICE.dev, buffer);
+    USBD_CDC_ECM_ReceivePacket(&USB_DEVICE.dev);
+    port->rxArmed = true;
+}
+
+/**
+ * @brief  Starts sending the next queued frame if none is in flight. The class follows a frame that fills its last packet with a zero length one. USB task only.
+ */
+static void _send(void)
+{
+    UsbEcmPort *port = &USB_ECM;
+    if (port->txBusy || !port->ecm->linkUp)
+        return;
+
+    const uint8_t *data;
+    uint32_t n = ecmifTxNext(port->ecm, &data);
+    if (n == 0)
+        return;
+    USBD_CDC_ECM_SetTxBuffer(&USB_DEVICE.dev, (uint8_t *)data, n, port->classId);
+    if (USBD_CDC_ECM_TransmitPacket(&USB_DEVICE.dev, port->classId) != USBD_OK)
+        return;
+    port->txBusy = true;
+}
+
+static void _service(void)
+{
+    if (USB_DEVICE.dev.dev_state != USBD_STATE_CONFIGURED || _handle() == NULL)
+        return;
+    if (!USB_ECM.rxArmed)
+        _arm();
+    _send();
+}
+
+static int8_t ECM_Init(void)
+{
+    UsbEcmPort *port = &USB_ECM;
+    port->txBusy = false;
+    // The class arms the endpoint itself right after this, and fails to
+    // configure without a buffer
+    uint8_t *buffer = ecmifRxBuffer(port->ecm);
+    USBD_CDC_ECM_SetRxBuffer(&USB_DEVICE.dev, (buffer != NULL) ? buffer : _discard);
+    port->rxArmed = true;
+    return USBD_OK;
+}
+
+static int8_t ECM_DeInit(void)
+{
+    UsbEcmPort *port = &USB_ECM;
+    ecmifLink(port->ecm, false);
+    ecmifTxFlush(port->ecm);
+    port->txBusy = false;
+    // The buffer it was receiving into stays first in line for next time
+    port->rxArmed = false;
+    return USBD_OK;
+}
+
+static int8_t ECM_Control(uint8_t cmd, uint8_t *pbuf, uint16_t length)
+{
+    (void)pbuf;
+    (void)length;
+    UsbEcmPort *port = &USB_ECM;
+    USBD_CDC_ECM_HandleTypeDef *hecm = _handle();
+
+    // Hosts set the packet filter once they have brought the interface up.
+    // macOS does so without a SET_INTERFACE, so this is where the link
+    // comes up, followed by the connection speed once the first
+    // notification is out.
+    if (cmd == CDC_ECM_SET_ETH_PACKET_FILTER && hecm != NULL && hecm->LinkStatus == 0U)
+    {
+        hecm->LinkStatus = 1U;
+        USBD_CDC_ECM_SendNotification(&USB_DEVICE.dev, NETWORK_CONNECTION, CDC_ECM_NET_CONNECTED, NULL);
+        hecm->NotificationStatus = 1U;
+        ecmifLink(port->ecm, true);
+    }
+    return USBD_OK;
+}
+
+/**
+ * @brief  A whole frame is in the buffer: hand it to LwIP as it is and arm the next buffer.
+ */
+static int8_t ECM_Receive(uint8_t *Buf, uint32_t *Len)
+{
+    if (Buf != _discard)
+        ecmifRxCommit(USB_ECM.ecm, *Len);
+    // The class adds each packet at this offset
+    *Len = 0;
+    _arm();
+    return USBD_OK;
+}
+
+static int8_t ECM_TransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
+{
+    (void)Buf;
+    (void)Len;
+    (void)epnum;
+    UsbEcmPort *port = &USB_ECM;
+    ecmifTxDone(port->ecm);
+    port->txBusy = false;
+    _send();
+    return USBD_OK;
+}
+
+USBD_CDC_ECM_ItfTypeDef USB_ECM_FOPS = {
+    ECM_Init,
+    ECM_DeInit,
+    ECM_Control,
+    ECM_Receive,
+    ECM_TransmitCplt,
+    NULL, // Process, never called by the class
+    (const uint8_t *)USB_ECM.hostMac};
+
+/**
+ * @brief  Connects the function to the interface and hooks it into the USB task. Call once before usbBegin, then register USB_ECM_FOPS with USBD_CDC_ECM_RegisterInterface and set classId.
+ * @param[in]  hostMac is the address the host's end of the link should use.
+ * @retval None
+ * @headerfile usb_ecm.h
+ */
+void usbecmInit(EcmInterface *ecm, const uint8_t hostMac[6])
+{
+    static const char hex[] = "0123456789ABCDEF";
+    UsbEcmPort *port = &USB_ECM;
+    port->ecm = ecm;
+    port->rxArmed = false;
+    port->txBusy = false;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        port->hostMac[2 * i] = hex[hostMac[i] >> 4];
+        port->hostMac[2 * i + 1] = hex[hostMac[i] & 0xFU];
+    }
+    port->hostMac[12] = '\0';
+    usbAddService(_service);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file usb_ecm.h
+ * @brief USB CDC-ECM network function, feeding the LwIP interface in Net/ecmif.c.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_ECM_H
+#define __FORGE_USB_ECM_H
+
+#include "../Net/ecmif.h"
+#include "../STM32_USB_Device_Library/Class/CDC_ECM/Inc/usbd_cdc_ecm.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief The single ECM function. Only the USB task touches it.
+     */
+    typedef struct
+    {
+        EcmInterface *ecm;
+        uint8_t classId;
+        bool rxArmed;     // The OUT endpoint has a buffer to receive into
+        bool txBusy;      // A frame is in flight
+        char hostMac[13]; // The host's address as the ECM descriptor gives it, 12 hex digits
+    } UsbEcmPort;
+
+    extern UsbEcmPort USB_ECM;
+    extern USBD_CDC_ECM_ItfTypeDef USB_ECM_FOPS;
+
+    void usbecmInit(EcmInterface *ecm, const uint8_t hostMac[6]);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_ECM_H */
@@ -0,0 +1,276 @@
+/**
+ * @file usb_msc.c
+ * @brief USB mass storage backend for the SD card, with write-behind.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usb_msc.h"
+#include "../Core/scheduler.h"
+#include "../Core/memory.h"
+#include "../Storage/sdcard.h"
+#include "../Storage/sd_diskio.h"
+#include "../Storage/diskcache.h"
+#include "../FatFs/src/ff.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define MSC_SLOT_MASK (MSC_WRITEBEHIND_SLOTS - 1)
+#define MSC_DRAIN_POLL_MS 10
+#define MSC_RETRY_MS 100
+
+MSCStorage USB_MSC;
+
+static StaticSemaphore_t _freeBuffer;
+static StaticSemaphore_t _drainedBuffer;
+static StackType_t _writerStack[FORGE_STACK_MSC];
+static StaticTask_t _writerTcb;
+
+static int8_t _inquiry[STANDARD_INQUIRY_DATA_LEN] = {
+    0x00, // Direct access
+    0x80, // Removable
+    0x02,
+    0x02,
+    (STANDARD_INQUIRY_DATA_LEN - 5),
+    0x00,
+    0x00,
+    0x00,
+    'F', 'o', 'r', 'g', 'e', ' ', ' ', ' ',                         // Vendor, 8 bytes
+    'S', 'D', ' ', 'C', 'a', 'r', 'd', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', // Product, 16 bytes
+    '1', '.', '0', '0'};                                           // Revision, 4 bytes
+
+/**
+ * @brief  Writes out filled slots in order. Slots that are next to each other in memory and on the card go out as one multi-block write. A slot is only freed once the card has taken it.
+ */
+static void _writerTask(void *arg)
+{
+    (void)arg;
+    MSCStorage *msc = &USB_MSC;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (msc->tail != msc->head)
+        {
+            uint32_t t = msc->tail;
+            uint32_t first = t & MSC_SLOT_MASK;
+            uint32_t n = 1;
+            uint32_t blocks = msc->count[first];
+            while (first + n < MSC_WRITEBEHIND_SLOTS && t + n != msc->head &&
+                   msc->count[first + n - 1] == MSC_SLOT_BLOCKS &&
+                   msc->block[first + n - 1] + MSC_SLOT_BLOCKS == msc->block[first + n])
+            {
+                blocks += msc->count[first + n];
+                n++;
+            }
+
+            // The host was told these were written, so a failed transfer is
+            // tried again until the card takes it, never dropped
+            msc->stats.transfers++;
+            if (SDwriteBlocks(msc->slots[first], msc->block[first], blocks) != SD_ERROR_NONE)
+            {
+                msc->stats.retries++;
+                msc->failed = true;
+                xSemaphoreGive(msc->drained); // Lets a flush report it
+                vTaskDelay(pdMS_TO_TICKS(MSC_RETRY_MS));
+                continue;
+            }
+            msc->stats.blocksWritten += blocks;
+            msc->failed = false;
+
+            msc->tail = t + n;
+            for (uint32_t i = 0; i < n; i++)
+                xSemaphoreGive(msc->free);
+        }
+        xSemaphoreGive(msc->drained);
+    }
+}
+
+/**
+ * @brief  Returns whether a slot that hasn't been written out yet holds any of these blocks.
+ */
+static bool _pending(uint32_t block, uint32_t count)
+{
+    MSCStorage *msc = &USB_MSC;
+    for (uint32_t t = msc->tail; t != msc->head; t++)
+    {
+        uint32_t s = t & MSC_SLOT_MASK;
+        if (block < msc->block[s] + msc->count[s] && msc->block[s] < block + count)
+            return true;
+    }
+    return false;
+}
+
+static int8_t STORAGE_Init(uint8_t lun)
+{
+    (void)lun;
+    return SD_CARD.ready ? 0 : -1;
+}
+
+static int8_t STORAGE_GetCapacity(uint8_t lun, uint32_t *block_num, uint16_t *block_size)
+{
+    (void)lun;
+    if (!SD_CARD.ready)
+        return -1;
+    *block_num = SD_CARD.blockCount;
+    *block_size = SD_BLOCK_SIZE;
+    return 0;
+}
+
+/**
+ * @brief  Hands the card to the host the first time it asks, unless a print or a push has it; the host sees no medium until they're done. From then on FatFs stays off the card until usbmscRelease.
+ */
+static int8_t STORAGE_IsReady(uint8_t lun)
+{
+    (void)lun;
+    if (!SD_CARD.ready)
+        return -1;
+    if (SD_CARD.owner == SD_OWNER_MSC)
+        return 0;
+    if (!SDclaim(SD_OWNER_MSC))
+        return -1;
+
+    // Anything FatFs held back goes out first, and what it read is about to
+    // go stale
+    diskcacheFlush(&SD_CACHE);
+    diskcacheInvalidate(&SD_CACHE);
+    return 0;
+}
+
+static int8_t STORAGE_IsWriteProtected(uint8_t lun)
+{
+    (void)lun;
+    return 0;
+}
+
+static int8_t STORAGE_Read(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len)
+{
+    (void)lun;
+    MSCStorage *msc = &USB_MSC;
+    msc->stats.reads++;
+    // Hosts read back the FAT and directory right after writing them
+    if (_pending(blk_addr, blk_len))
+    {
+        msc->stats.readDrains++;
+        if (!usbmscFlush())
+            return -1;
+    }
+    return (SDreadBlocks(buf, blk_addr, blk_len) == SD_ERROR_NONE) ? 0 : -1;
+}
+
+/**
+ * @brief  Queues a piece of a write and returns at once, so the class goes straight back to receiving the next piece while the card writes this one. Only waits when every slot is still waiting for the card.
+ */
+static int8_t STORAGE_Write(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len)
+{
+    (void)lun;
+    MSCStorage *msc = &USB_MSC;
+    // The card is refusing what's already queued: this piece isn't taken, so
+    // the host sees the error and nothing it was told is written gets lost
+    if (msc->failed)
+        return -1;
+
+    msc->stats.writes++;
+    if (xSemaphoreTake(msc->free, 0) != pdTRUE)
+    {
+        msc->stats.stalls++;
+        xSemaphoreTake(msc->free, portMAX_DELAY);
+    }
+    uint32_t s = msc->head & MSC_SLOT_MASK;
+    memcpy(msc->slots[s], buf, (size_t)blk_len * SD_BLOCK_SIZE);
+    msc->block[s] = blk_addr;
+    msc->count[s] = blk_len;
+    __DMB(); // The slot has to be complete before the writer can see it
+    msc->head++;
+    xTaskNotifyGive(msc->writer);
+    return 0;
+}
+
+static int8_t STORAGE_GetMaxLun(void)
+{
+    return 0;
+}
+
+USBD_StorageTypeDef USB_MSC_FOPS = {
+    STORAGE_Init,
+    STORAGE_GetCapacity,
+    STORAGE_IsReady,
+    STORAGE_IsWriteProtected,
+    STORAGE_Read,
+    STORAGE_Write,
+    STORAGE_GetMaxLun,
+    _inquiry};
+
+/**
+ * @brief  Creates the write-behind task. Call once before forgeStartScheduler, then register USB_MSC_FOPS with USBD_MSC_RegisterStorage.
+ * @retval None
+ * @headerfile usb_msc.h
+ */
+void usbmscInit(void)
+{
+    MSCStorage *msc = &USB_MSC;
+    msc->head = 0;
+    msc->tail = 0;
+    msc->failed = false;
+    memset(&msc->stats, 0, sizeof(msc->stats));
+    msc->free = xSemaphoreCreateCountingStatic(MSC_WRITEBEHIND_SLOTS, MSC_WRITEBEHIND_SLOTS, &_freeBuffer);
+    msc->drained = xSemaphoreCreateBinaryStatic(&_drainedBuffer);
+    forgeMemoryAdd("msc", msc, sizeof(*msc));
+
+    // Level with the SD reader: it only runs while the USB task is waiting
+    // on it anyway
+    msc->writer = forgeCreateTask(_writerTask, "mscwr", FORGE_STACK_MSC, FORGE_PRIO_STORAGE, _writerStack, &_writerTcb);
+}
+
+/**
+ * @brief  Waits until every queued write is on the card, e.g. for SYNCHRONIZE CACHE. Call from the USB task.
+ * @retval false if the card is failing one of them. It stays queued and the writer keeps trying it.
+ * @headerfile usb_msc.h
+ */
+bool usbmscFlush(void)
+{
+    MSCStorage *msc = &USB_MSC;
+    while (msc->tail != msc->head)
+    {
+        if (msc->failed)
+            return false;
+        xSemaphoreTake(msc->drained, pdMS_TO_TICKS(MSC_DRAIN_POLL_MS));
+    }
+    return SDsync() == SD_ERROR_NONE;
+}
+
+/**
+ * @brief  Gives the card back to the firmware after an eject or when the bus goes away. FatFs mounts it again on its next access, so it sees whatever the host wrote. While the card is failing a queued write the host keeps it instead, so FatFs never sees the card without that write; the next eject tries again. Call from the USB task.
+ * @retval None
+ * @headerfile usb_msc.h
+ */
+void usbmscRelease(void)
+{
+    MSCStorage *msc = &USB_MSC;
+    if (SD_CARD.owner != SD_OWNER_MSC)
+        return;
+    if (!usbmscFlush() && msc->tail != msc->head)
+        return;
+
+    diskcacheInvalidate(&SD_CACHE);
+    f_mount(&SDFatFs, SDPath, 0);
+    SDrelease(SD_OWNER_MSC);
+}
+
+/**
+ * @brief  Overrides the weak hook in usbd_msc_scsi.c. The status of SYNCHRONIZE CACHE and of an eject only goes back to the host once the write-behind slots are on the card.
+ */
+int8_t USBD_MSC_Sync(uint8_t lun, uint8_t eject)
+{
+    (void)lun;
+    USB_MSC.stats.syncs++;
+    bool ok = usbmscFlush();
+    if (eject)
+        usbmscRelease();
+    return ok ? 0 : -1;
+}
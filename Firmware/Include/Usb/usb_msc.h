@@ -0,0 +1,79 @@
+/**
+ * @file usb_msc.h
+ * @brief USB mass storage backend for the SD card, with write-behind.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_MSC_H
+#define __FORGE_USB_MSC_H
+
+#include "usbd_conf.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../FreeRTOS/Source/include/semphr.h"
+#include "../STM32_USB_Device_Library/Class/MSC/Inc/usbd_msc.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Each slot holds one MSC_MEDIA_PACKET piece of a WRITE10; full speed
+// delivers one every ~4ms. Slots that follow each other on the card go out
+// as one multi-block write, so while the card is busy with one write the
+// next one grows. A power of two, so head and tail can run freely.
+#define MSC_WRITEBEHIND_SLOTS 4
+#define MSC_SLOT_BLOCKS (MSC_MEDIA_PACKET / 512)
+
+    /**
+     * @brief Counters, to see whether the card or the bus is the bottleneck.
+     */
+    typedef struct
+    {
+        uint32_t writes;        // Pieces handed over by the class
+        uint32_t transfers;     // Multi-block writes actually issued
+        uint32_t retries;       // Of those, ones the card failed and that went again
+        uint32_t blocksWritten;
+        uint32_t stalls;        // Writes that had to wait for a free slot
+        uint32_t reads;
+        uint32_t readDrains;    // Reads that had to wait for held writes to them
+        uint32_t syncs;
+    } MSCStats;
+
+    /**
+     * @brief The single mass storage unit. The USB task fills slots, the writer task empties them; head and tail are each written by one side only.
+     */
+    typedef struct
+    {
+        uint8_t slots[MSC_WRITEBEHIND_SLOTS][MSC_MEDIA_PACKET] __ALIGNED(4); // DMA sources, so not in CCM RAM
+        uint32_t block[MSC_WRITEBEHIND_SLOTS];
+        uint16_t count[MSC_WRITEBEHIND_SLOTS];
+        volatile uint32_t head; // Slots filled so far; head % MSC_WRITEBEHIND_SLOTS is the next one
+        volatile uint32_t tail; // Slots written out so far
+
+        SemaphoreHandle_t free;    // Counts slots the USB task may fill
+        SemaphoreHandle_t drained; // Given when the writer catches up with head
+        TaskHandle_t writer;
+
+        volatile bool failed; // The card failed the oldest slot's last try; new writes and syncs fail until it takes it
+
+        MSCStats stats;
+    } MSCStorage;
+
+    extern MSCStorage USB_MSC;
+    extern USBD_StorageTypeDef USB_MSC_FOPS;
+
+    void usbmscInit(void);
+    bool usbmscFlush(void);
+    void usbmscRelease(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_MSC_H */
@@ -0,0 +1,251 @@
+/**
+ * @file usb_telemetry.c
+ * @brief Live telemetry over a vendor bulk IN endpoint, buffered like the DAP SWO stream.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usb_telemetry.h"
+#include "usb.h"
+#include "../Core/memory.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_ctlreq.h"
+#include "../FreeRTOS/Source/include/FreeRTOS.h"
+#include "../FreeRTOS/Source/include/task.h"
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define MASK (TELEMETRY_BUFFER_SIZE - 1U)
+
+TelemetryStream USB_TELEMETRY;
+
+static void _put(TelemetryStream *t, uint32_t index, const void *data, uint32_t length)
+{
+    const uint8_t *p = data;
+    for (uint32_t i = 0; i < length; i++)
+        t->buffer[(index + i) & MASK] = p[i];
+}
+
+/**
+ * @brief  Starts the next transfer if none is in flight, the same way SWO_Thread does: only up to a block boundary, unless the data has waited TELEMETRY_STREAM_TIMEOUT_MS. USB task only.
+ */
+static void _send(void)
+{
+    TelemetryStream *t = &USB_TELEMETRY;
+    if (!t->active || t->busy)
+        return;
+
+    uint32_t now = xTaskGetTickCount();
+    uint32_t count = t->indexI - t->indexO;
+    if (count == 0)
+    {
+        t->waitingSince = now;
+        return;
+    }
+    bool timeout = (now - t->waitingSince) >= pdMS_TO_TICKS(TELEMETRY_STREAM_TIMEOUT_MS);
+
+    uint32_t index = t->indexO & MASK;
+    uint32_t n = TELEMETRY_BUFFER_SIZE - index;
+    if (count > n)
+        count = n;
+    if (!timeout)
+    {
+        uint32_t i = index & (TELEMETRY_BLOCK_SIZE - 1U);
+        if (i == 0)
+        {
+            count &= ~(TELEMETRY_BLOCK_SIZE - 1U);
+        }
+        else
+        {
+            n = TELEMETRY_BLOCK_SIZE - i;
+            count = (count >= n) ? n : 0;
+        }
+    }
+    if (count == 0)
+        return;
+
+    t->transferSize = count;
+    // The host reads a block at a time, and a flush that stops short of one
+    // on a packet boundary wouldn't end its read
+    t->zlp = timeout && (count % USBD_CMPSIT_VENDOR_PACKET_SIZE) == 0;
+    t->busy = true;
+    t->waitingSince = now;
+    t->stats.transfers++;
+    USBD_LL_Transmit(&USB_DEVICE.dev, t->ep, &t->buffer[index], count);
+}
+
+static uint8_t _init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    (void)cfgidx;
+    TelemetryStream *t = &USB_TELEMETRY;
+    t->classId = (uint8_t)pdev->classId;
+    t->ep = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_BULK, (uint8_t)pdev->classId);
+    USBD_LL_OpenEP(pdev, t->ep, USBD_EP_TYPE_BULK, USBD_CMPSIT_VENDOR_PACKET_SIZE);
+    pdev->ep_in[t->ep & 0xFU].is_used = 1U;
+    pdev->pClassDataCmsit[pdev->classId] = t;
+
+    // Like ClearTrace: start the stream from nothing for the new host
+    t->indexI = 0;
+    t->indexO = 0;
+    t->dropped = 0;
+    t->busy = false;
+    t->waitingSince = xTaskGetTickCount();
+    __DMB();
+    t->active = true;
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t _deInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    (void)cfgidx;
+    TelemetryStream *t = &USB_TELEMETRY;
+    t->active = false;
+    t->busy = false;
+    USBD_LL_CloseEP(pdev, t->ep);
+    pdev->ep_in[t->ep & 0xFU].is_used = 0U;
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t _setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    // Only the standard interface requests; the stream has no controls
+    static uint8_t zero[2] = {0, 0};
+    if ((req->bmRequest & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD &&
+        pdev->dev_state == USBD_STATE_CONFIGURED)
+    {
+        switch (req->bRequest)
+        {
+        case USB_REQ_GET_STATUS:
+            USBD_CtlSendData(pdev, zero, 2U);
+            return (uint8_t)USBD_OK;
+        case USB_REQ_GET_INTERFACE:
+            USBD_CtlSendData(pdev, zero, 1U);
+            return (uint8_t)USBD_OK;
+        case USB_REQ_SET_INTERFACE:
+            if (req->wValue == 0U)
+                return (uint8_t)USBD_OK;
+            break;
+        case USB_REQ_CLEAR_FEATURE:
+            return (uint8_t)USBD_OK;
+        default:
+            break;
+        }
+    }
+    USBD_CtlError(pdev, req);
+    return (uint8_t)USBD_FAIL;
+}
+
+static uint8_t _dataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    (void)epnum;
+    TelemetryStream *t = &USB_TELEMETRY;
+    t->indexO += t->transferSize;
+    t->stats.bytes += t->transferSize;
+    t->transferSize = 0;
+    if (t->zlp)
+    {
+        t->zlp = false;
+        USBD_LL_Transmit(pdev, t->ep, NULL, 0U);
+        return (uint8_t)USBD_OK;
+    }
+    t->busy = false;
+    _send();
+    return (uint8_t)USBD_OK;
+}
+
+// Descriptors come from the composite builder (USBD_CMPSIT_VendorDesc)
+USBD_ClassTypeDef USB_TELEMETRY_CLASS = {
+    _init,
+    _deInit,
+    _setup,
+    NULL, // EP0_TxSent
+    NULL, // EP0_RxReady
+    _dataIn,
+    NULL, // DataOut
+    NULL, // SOF
+    NULL, // IsoINIncomplete
+    NULL, // IsoOUTIncomplete
+    NULL, // GetHSConfigDescriptor
+    NULL, // GetFSConfigDescriptor
+    NULL, // GetOtherSpeedConfigDescriptor
+    NULL, // GetDeviceQualifierDescriptor
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+    NULL,
+#endif
+};
+
+/**
+ * @brief  Starts the cycle counter the records are stamped with and hooks the stream into the USB task. Call once before usbBegin, then register USB_TELEMETRY_CLASS with USBD_RegisterClassComposite as CLASS_TYPE_VENDOR.
+ * @retval None
+ * @headerfile usb_telemetry.h
+ */
+void telemetryInit(void)
+{
+    TelemetryStream *t = &USB_TELEMETRY;
+    forgeMemoryAdd("telemetry", t, sizeof(*t));
+    memset(&t->stats, 0, sizeof(t->stats));
+    t->active = false;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    usbAddService(_send);
+}
+
+/**
+ * @brief  Appends a record to the stream. Safe from any task or interrupt, including the step interrupt: it never blocks and only masks interrupts for the copy. The USB task sends it within TELEMETRY_STREAM_TIMEOUT_MS.
+ * @param[in]  payload is length bytes, one of the Telemetry* payload structs.
+ * @retval false if the record was dropped, because no host is listening or the buffer is full.
+ * @headerfile usb_telemetry.h
+ */
+bool telemetryWrite(TelemetryType type, const void *payload, uint8_t length)
+{
+    TelemetryStream *t = &USB_TELEMETRY;
+    const uint32_t size = sizeof(TelemetryHeader) + length;
+    const uint32_t dropSize = sizeof(TelemetryHeader) + sizeof(TelemetryDropped);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!t->active)
+    {
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    uint32_t index = t->indexI;
+    uint32_t need = size + ((t->dropped != 0) ? dropSize : 0);
+    if (need > TELEMETRY_BUFFER_SIZE - (index - t->indexO))
+    {
+        // Like a paused SWO capture, except that only whole records are lost
+        t->dropped++;
+        t->stats.dropped++;
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    TelemetryHeader header;
+    header.cycles = DWT->CYCCNT;
+    if (t->dropped != 0)
+    {
+        TelemetryDropped lost = {t->dropped};
+        header.type = TELEMETRY_DROPPED;
+        header.length = sizeof(lost);
+        _put(t, index, &header, sizeof(header));
+        _put(t, index + sizeof(header), &lost, sizeof(lost));
+        index += dropSize;
+        t->dropped = 0;
+    }
+    header.type = (uint8_t)type;
+    header.length = length;
+    _put(t, index, &header, sizeof(header));
+    _put(t, index + sizeof(header), payload, length);
+    t->indexI = index + size;
+    t->stats.records++;
+    __set_PRIMASK(primask);
+    return true;
+}
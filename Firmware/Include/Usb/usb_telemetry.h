@@ -0,0 +1,105 @@
+/**
+ * @file usb_telemetry.h
+ * @brief Live telemetry over a vendor bulk IN endpoint, buffered like the DAP SWO stream.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USB_TELEMETRY_H
+#define __FORGE_USB_TELEMETRY_H
+
+#include "../Motion/motion.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_def.h"
+#include "../CMSIS-Core/cmsis_compiler.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TELEMETRY_BUFFER_SIZE 4096U     // Must be 2^n
+#define TELEMETRY_BLOCK_SIZE 512U       // Transfers end on these boundaries while the stream is busy (2^n)
+#define TELEMETRY_STREAM_TIMEOUT_MS 50U // After this, whatever is buffered goes out anyway
+
+    /**
+     * @brief Record types. Every record is a TelemetryHeader followed by length bytes of payload, all little endian.
+     */
+    typedef enum
+    {
+        TELEMETRY_DROPPED = 0, // TelemetryDropped, written ahead of the first record after an overrun
+        TELEMETRY_SEGMENT = 1, // TelemetrySegment, a motion segment was finished by the step interrupt
+        TELEMETRY_HEATER = 2   // TelemetryHeater, a heater was stepped
+    } TelemetryType;
+
+    typedef struct __PACKED
+    {
+        uint8_t type;    // TelemetryType
+        uint8_t length;  // Bytes of payload that follow
+        uint32_t cycles; // DWT->CYCCNT when the record was written, wraps every ~25s
+    } TelemetryHeader;
+
+    typedef struct __PACKED
+    {
+        uint32_t records; // Records lost since the last one that got through
+    } TelemetryDropped;
+
+    typedef struct __PACKED
+    {
+        uint32_t tag;                   // MotionSegment.tag.offset
+        int32_t position[FORGE_AXES];   // Step position at the end of the segment
+        uint32_t events;                // Step events in the segment
+        uint32_t interval;              // MOTION_TIMER ticks between them
+    } TelemetrySegment;
+
+    typedef struct __PACKED
+    {
+        uint8_t index;       // Order the heater was added in
+        float target;        // Degrees C
+        float temperature;   // Degrees C
+        float output;        // Duty cycle written to the heater
+    } TelemetryHeater;
+
+    typedef struct
+    {
+        uint32_t records;
+        uint32_t bytes;
+        uint32_t transfers;
+        uint32_t dropped; // Records that didn't fit
+    } TelemetryStats;
+
+    /**
+     * @brief The single telemetry stream. Writers fill the buffer at indexI with interrupts masked, from any task or interrupt; the USB task sends from indexO. Both indices only ever increase. The host should read TELEMETRY_BLOCK_SIZE bytes at a time.
+     */
+    typedef struct
+    {
+        uint8_t buffer[TELEMETRY_BUFFER_SIZE];
+        volatile uint32_t indexI;
+        volatile uint32_t indexO;
+
+        uint8_t classId;
+        uint8_t ep;
+        volatile bool active;  // The host has configured the device; records are dropped silently until then
+        volatile bool busy;    // A transfer is in flight
+        uint32_t transferSize;
+        bool zlp;              // Follow the transfer in flight with a zero length packet
+        uint32_t waitingSince; // Tick at which the oldest unsent data started waiting
+        uint32_t dropped;      // Records dropped since the last TELEMETRY_DROPPED
+
+        TelemetryStats stats;
+    } TelemetryStream;
+
+    extern TelemetryStream USB_TELEMETRY;
+    extern USBD_ClassTypeDef USB_TELEMETRY_CLASS;
+
+    void telemetryInit(void);
+    bool telemetryWrite(TelemetryType type, const void *payload, uint8_t length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USB_TELEMETRY_H */
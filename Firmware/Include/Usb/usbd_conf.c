@@ -0,0 +1,242 @@
+/**
+ * @file usbd_conf.c
+ * @brief Low level glue between the ST USB device library and the OTG_FS peripheral.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usbd_conf.h"
+#include "usb.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+// Class handles come from here instead of the heap. Classes are only
+// allocated together on SET_CONFIGURATION and freed together on a reset, so
+// a bump allocator that rewinds once everything is freed is enough.
+static uint32_t _pool[USBD_STATIC_POOL_WORDS];
+static uint32_t _poolUsed;
+static uint8_t _poolLive;
+
+void *USBD_static_malloc(uint32_t size)
+{
+    uint32_t words = (size + 3) / 4;
+    if (_poolUsed + words > USBD_STATIC_POOL_WORDS)
+        return NULL;
+    void *p = &_pool[_poolUsed];
+    _poolUsed += words;
+    _poolLive++;
+    return p;
+}
+
+void USBD_static_free(void *p)
+{
+    if (p == NULL || _poolLive == 0)
+        return;
+    if (--_poolLive == 0)
+        _poolUsed = 0;
+}
+
+static USBD_StatusTypeDef _status(HAL_StatusTypeDef status)
+{
+    switch (status)
+    {
+    case HAL_OK:
+        return USBD_OK;
+    case HAL_BUSY:
+        return USBD_BUSY;
+    default:
+        return USBD_FAIL;
+    }
+}
+
+void HAL_PCD_MspInit(PCD_HandleTypeDef *hpcd)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    if (hpcd->Instance != USB_OTG_FS)
+        return;
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    // PA11 is DM, PA12 is DP. VBUS (PA9) isn't sensed, the board is self powered,
+    // and ID (PA10) isn't used; with FORGE_USB_DAP both carry the probe's UART.
+    GPIO_InitStruct.Pin = GPIO_PIN_11 | GPIO_PIN_12;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF10_OTG_FS;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+    __HAL_RCC_USB_OTG_FS_CLK_ENABLE();
+    // Enabled by usbBegin once the task that services it exists
+    HAL_NVIC_SetPriority(USB_IRQn, USB_IRQ_PRIORITY, 0);
+}
+
+void HAL_PCD_MspDeInit(PCD_HandleTypeDef *hpcd)
+{
+    if (hpcd->Instance != USB_OTG_FS)
+        return;
+    HAL_NVIC_DisableIRQ(USB_IRQn);
+    __HAL_RCC_USB_OTG_FS_CLK_DISABLE();
+    HAL_GPIO_DeInit(GPIOA, GPIO_PIN_11 | GPIO_PIN_12);
+}
+
+// The HAL calls these from HAL_PCD_IRQHandler, which runs in the USB task
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_SetupStage((USBD_HandleTypeDef *)hpcd->pData, (uint8_t *)hpcd->Setup);
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    USBD_LL_DataOutStage((USBD_HandleTypeDef *)hpcd->pData, epnum, hpcd->OUT_ep[epnum].xfer_buff);
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    USBD_LL_DataInStage((USBD_HandleTypeDef *)hpcd->pData, epnum, hpcd->IN_ep[epnum].xfer_buff);
+}
+
+void HAL_PCD_SOFCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_SOF((USBD_HandleTypeDef *)hpcd->pData);
+}
+
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_SetSpeed((USBD_HandleTypeDef *)hpcd->pData, USBD_SPEED_FULL);
+    USBD_LL_Reset((USBD_HandleTypeDef *)hpcd->pData);
+}
+
+void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_Suspend((USBD_HandleTypeDef *)hpcd->pData);
+    __HAL_PCD_GATE_PHYCLOCK(hpcd);
+}
+
+void HAL_PCD_ResumeCallback(PCD_HandleTypeDef *hpcd)
+{
+    __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+    USBD_LL_Resume((USBD_HandleTypeDef *)hpcd->pData);
+}
+
+void HAL_PCD_ISOOUTIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    USBD_LL_IsoOUTIncomplete((USBD_HandleTypeDef *)hpcd->pData, epnum);
+}
+
+void HAL_PCD_ISOINIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    USBD_LL_IsoINIncomplete((USBD_HandleTypeDef *)hpcd->pData, epnum);
+}
+
+void HAL_PCD_ConnectCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_DevConnected((USBD_HandleTypeDef *)hpcd->pData);
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
+{
+    USBD_LL_DevDisconnected((USBD_HandleTypeDef *)hpcd->pData);
+}
+
+USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
+{
+    PCD_HandleTypeDef *hpcd = &USB_DEVICE.hpcd;
+    hpcd->pData = pdev;
+    pdev->pData = hpcd;
+
+    hpcd->Instance = USB_OTG_FS;
+    hpcd->Init.dev_endpoints = 4;
+    hpcd->Init.speed = PCD_SPEED_FULL;
+    hpcd->Init.dma_enable = DISABLE; // The FS core has no DMA
+    hpcd->Init.phy_itface = PCD_PHY_EMBEDDED;
+    hpcd->Init.Sof_enable = DISABLE;
+    hpcd->Init.low_power_enable = DISABLE;
+    hpcd->Init.lpm_enable = DISABLE;
+    hpcd->Init.vbus_sensing_enable = DISABLE;
+    hpcd->Init.use_dedicated_ep1 = DISABLE;
+    if (HAL_PCD_Init(hpcd) != HAL_OK)
+        return USBD_FAIL;
+
+    HAL_PCDEx_SetRxFiFo(hpcd, USBD_FIFO_RX_WORDS);
+    HAL_PCDEx_SetTxFiFo(hpcd, 0, USBD_FIFO_EP0_WORDS);
+    HAL_PCDEx_SetTxFiFo(hpcd, 1, USBD_FIFO_EP1_WORDS);
+    HAL_PCDEx_SetTxFiFo(hpcd, 2, USBD_FIFO_EP2_WORDS);
+    HAL_PCDEx_SetTxFiFo(hpcd, 3, USBD_FIFO_EP3_WORDS);
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef *pdev)
+{
+    return _status(HAL_PCD_DeInit((PCD_HandleTypeDef *)pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev)
+{
+    return _status(HAL_PCD_Start((PCD_HandleTypeDef *)pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef *pdev)
+{
+    return _status(HAL_PCD_Stop((PCD_HandleTypeDef *)pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps)
+{
+    return _status(HAL_PCD_EP_Open((PCD_HandleTypeDef *)pdev->pData, ep_addr, ep_mps, ep_type));
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    return _status(HAL_PCD_EP_Close((PCD_HandleTypeDef *)pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    return _status(HAL_PCD_EP_Flush((PCD_HandleTypeDef *)pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    return _status(HAL_PCD_EP_SetStall((PCD_HandleTypeDef *)pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    return _status(HAL_PCD_EP_ClrStall((PCD_HandleTypeDef *)pdev->pData, ep_addr));
+}
+
+uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+    if ((ep_addr & 0x80U) == 0x80U)
+        return hpcd->IN_ep[ep_addr & 0x7FU].is_stall;
+    return hpcd->OUT_ep[ep_addr & 0x7FU].is_stall;
+}
+
+USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef *pdev, uint8_t dev_addr)
+{
+    return _status(HAL_PCD_SetAddress((PCD_HandleTypeDef *)pdev->pData, dev_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size)
+{
+    return _status(HAL_PCD_EP_Transmit((PCD_HandleTypeDef *)pdev->pData, ep_addr, pbuf, size));
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size)
+{
+    return _status(HAL_PCD_EP_Receive((PCD_HandleTypeDef *)pdev->pData, ep_addr, pbuf, size));
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+    return HAL_PCD_EP_GetRxCount((PCD_HandleTypeDef *)pdev->pData, ep_addr);
+}
+
+void USBD_LL_Delay(uint32_t Delay)
+{
+    HAL_Delay(Delay);
+}
@@ -0,0 +1,119 @@
+/**
+ * @file usbd_conf.h
+ * @brief Configuration of the ST USB device library for the Forge. The library includes this as "usbd_conf.h", so this directory has to be on the include path, like Core/ is for FreeRTOSConfig.h.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __USBD_CONF_H
+#define __USBD_CONF_H
+
+#include "../HAL/stm32f4xx_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// One composite device in two functions, each on its own endpoints. The
+// first carries host commands: a CDC serial port, or with FORGE_USB_NETWORK
+// a CDC-ECM network interface (usb_ecm.c), over which commands reach the
+// printer on a TCP console (Net/console.c) instead. The second is the SD
+// card as a mass storage drive, or with FORGE_USB_TELEMETRY a vendor
+// interface streaming telemetry (usb_telemetry.c), or with FORGE_USB_DAP a
+// CMSIS-DAP v2 probe (usb_dap.c); the firmware's own events go out over
+// SWO (Core/trace.c) when the telemetry stream isn't there.
+#if defined(FORGE_USB_DAP) && defined(FORGE_USB_TELEMETRY)
+#error "FORGE_USB_DAP and FORGE_USB_TELEMETRY need the same endpoints"
+#endif
+#define USE_USBD_COMPOSITE
+#ifdef FORGE_USB_NETWORK
+#define USBD_CMPSIT_ACTIVATE_CDC_ECM 1U
+// The ECM descriptor names the host's MAC address in a string of its own
+#define USBD_SUPPORT_USER_STRING_DESC 1U
+#else
+#define USBD_CMPSIT_ACTIVATE_CDC 1U
+#endif
+#if defined(FORGE_USB_DAP)
+#define USBD_CMPSIT_ACTIVATE_DAP 1U
+// Commands and responses only; there's no IN endpoint left for the SWO
+// stream, so the host reads the trace with DAP_SWO_Data (SWO_STREAM is 0)
+#define USBD_CMPSIT_DAP_EPS 2U
+// The probe's interface is named for hosts to find it by
+#define USBD_SUPPORT_USER_STRING_DESC 1U
+#elif defined(FORGE_USB_TELEMETRY)
+#define USBD_CMPSIT_ACTIVATE_VENDOR 1U
+#else
+#define USBD_CMPSIT_ACTIVATE_MSC 1U
+#endif
+#define USBD_CMPSIT_VENDOR_PACKET_SIZE 64U // Full speed bulk maximum
+#define USBD_MAX_SUPPORTED_CLASS 2U
+#define USBD_CMPST_MAX_CONFDESC_SZ 128U // 102 bytes at most, for ECM and the drive
+#define USBD_MAX_NUM_INTERFACES 3U      // CDC or ECM control and data, then the second function
+
+#define USBD_MAX_NUM_CONFIGURATION 1U
+#define USBD_MAX_STR_DESC_SIZ 0x100U
+#define USBD_SELF_POWERED 1U
+#define USBD_DEBUG_LEVEL 0U
+
+// Endpoints. OTG_FS has three IN endpoints besides EP0: the first function
+// takes two, data and notifications, and the second the last one.
+#define FORGE_CDC_IN_EP 0x81U
+#define FORGE_CDC_OUT_EP 0x01U
+#define FORGE_CDC_CMD_EP 0x82U
+#define FORGE_ECM_IN_EP 0x81U
+#define FORGE_ECM_OUT_EP 0x01U
+#define FORGE_ECM_CMD_EP 0x82U
+#define FORGE_MSC_IN_EP 0x83U
+#define FORGE_MSC_OUT_EP 0x02U
+#define FORGE_TELEMETRY_IN_EP 0x83U
+#define FORGE_DAP_OUT_EP 0x02U
+#define FORGE_DAP_IN_EP 0x83U
+
+// The class hands a WRITE10 to the storage backend this much at a time,
+// ~4ms of bus time at full speed. The write-behind in usb_msc.c merges
+// consecutive pieces into longer SD writes.
+#define MSC_MEDIA_PACKET 4096U
+
+// OTG_FS FIFO RAM is 320 words: the shared RX FIFO, then one TX FIFO per
+// IN endpoint. The bulk IN endpoints get room for several packets so the
+// core can keep a transfer going between task wakeups; CDC or ECM data holds
+// a whole CDC_TX_MAX_TRANSFER.
+#define USBD_FIFO_RX_WORDS 0x60U
+#define USBD_FIFO_EP0_WORDS 0x10U
+#define USBD_FIFO_EP1_WORDS 0x80U // CDC or ECM data
+#define USBD_FIFO_EP2_WORDS 0x10U // CDC or ECM notifications
+#define USBD_FIFO_EP3_WORDS 0x40U // The drive, telemetry or DAP responses
+
+// Class handles: the MSC one is MSC_MEDIA_PACKET plus a few dozen bytes,
+// the ECM one a little over 2000 and the CDC one a little over 512 bytes.
+// Telemetry keeps its state in USB_TELEMETRY and the probe in USB_DAP.
+#ifdef FORGE_USB_NETWORK
+#define USBD_STATIC_POOL_WORDS ((MSC_MEDIA_PACKET + 2304U) / 4U)
+#else
+#define USBD_STATIC_POOL_WORDS ((MSC_MEDIA_PACKET + 1024U) / 4U)
+#endif
+
+#define USBD_malloc (void *)USBD_static_malloc
+#define USBD_free USBD_static_free
+#define USBD_memset memset
+#define USBD_memcpy memcpy
+#define USBD_Delay HAL_Delay
+
+#define USBD_UsrLog(...) do {} while (0)
+#define USBD_ErrLog(...) do {} while (0)
+#define USBD_DbgLog(...) do {} while (0)
+
+    void *USBD_static_malloc(uint32_t size);
+    void USBD_static_free(void *p);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __USBD_CONF_H */
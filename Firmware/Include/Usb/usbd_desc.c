@@ -0,0 +1,119 @@
+/**
+ * @file usbd_desc.c
+ * @brief USB device and string descriptors of the Forge.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#include "usbd_desc.h"
+#include "usbd_conf.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_core.h"
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_ctlreq.h"
+#include "../HAL/stm32f4xx_hal.h"
+
+// 24 hex digits of the unique ID, as UTF-16
+#define SERIAL_LENGTH (2 + 24 * 2)
+
+static uint8_t _deviceDesc[USB_LEN_DEV_DESC] __ALIGNED(4) = {
+    USB_LEN_DEV_DESC,
+    USB_DESC_TYPE_DEVICE,
+    0x00, 0x02, // USB 2.0
+    0xEF, // Miscellaneous, Interface Association: the functions are described by IADs
+    0x02,
+    0x01,
+    USB_MAX_EP0_SIZE,
+    LOBYTE(USBD_VID), HIBYTE(USBD_VID),
+    LOBYTE(USBD_PID), HIBYTE(USBD_PID),
+    0x00, 0x01, // Release 1.00
+    USBD_IDX_MFC_STR,
+    USBD_IDX_PRODUCT_STR,
+    USBD_IDX_SERIAL_STR,
+    USBD_MAX_NUM_CONFIGURATION};
+
+static uint8_t _langIdDesc[USB_LEN_LANGID_STR_DESC] __ALIGNED(4) = {
+    USB_LEN_LANGID_STR_DESC,
+    USB_DESC_TYPE_STRING,
+    LOBYTE(USBD_LANGID), HIBYTE(USBD_LANGID)};
+
+static uint8_t _serialDesc[SERIAL_LENGTH] __ALIGNED(4);
+static uint8_t _strDesc[USBD_MAX_STR_DESC_SIZ] __ALIGNED(4);
+
+static uint8_t *_device(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    *length = sizeof(_deviceDesc);
+    return _deviceDesc;
+}
+
+static uint8_t *_langId(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    *length = sizeof(_langIdDesc);
+    return _langIdDesc;
+}
+
+static uint8_t *_string(const char *s, uint16_t *length)
+{
+    USBD_GetString((uint8_t *)s, _strDesc, length);
+    return _strDesc;
+}
+
+static uint8_t *_manufacturer(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    return _string(USBD_MANUFACTURER_STRING, length);
+}
+
+static uint8_t *_product(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    return _string(USBD_PRODUCT_STRING, length);
+}
+
+static uint8_t *_configuration(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    return _string(USBD_CONFIGURATION_STRING, length);
+}
+
+static uint8_t *_interface(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    return _string(USBD_INTERFACE_STRING, length);
+}
+
+/**
+ * @brief  Serial number from the 96-bit unique ID, so two printers on one host keep their drive letters and ports apart.
+ */
+static uint8_t *_serial(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    (void)speed;
+    static const char hex[] = "0123456789ABCDEF";
+    const uint32_t *uid = (const uint32_t *)UID_BASE;
+    _serialDesc[0] = SERIAL_LENGTH;
+    _serialDesc[1] = USB_DESC_TYPE_STRING;
+    for (uint8_t w = 0; w < 3; w++)
+    {
+        uint32_t v = uid[w];
+        for (uint8_t d = 0; d < 8; d++)
+        {
+            uint8_t *c = &_serialDesc[2 + (w * 8 + d) * 2];
+            c[0] = (uint8_t)hex[v >> 28];
+            c[1] = 0;
+            v <<= 4;
+        }
+    }
+    *length = SERIAL_LENGTH;
+    return _serialDesc;
+}
+
+USBD_DescriptorsTypeDef FORGE_USB_DESC = {
+    _device,
+    _langId,
+    _manufacturer,
+    _product,
+    _serial,
+    _configuration,
+    _interface};
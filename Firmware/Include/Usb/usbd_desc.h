@@ -0,0 +1,49 @@
+/**
+ * @file usbd_desc.h
+ * @brief USB device and string descriptors of the Forge.
+ * @author Arthur Beck/@ave (averse.abfun@gmail.com)
+ * @note Written ad-hoc for Forge by Arthur Beck
+ * @version 1.0
+ * @copyright 2024
+ */
+
+#ifndef __FORGE_USBD_DESC_H
+#define __FORGE_USBD_DESC_H
+
+#include "../STM32_USB_Device_Library/Core/Inc/usbd_def.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// ST's VID. Hosts bind the CDC, ECM and MSC functions by interface class,
+// so the PID no longer picks a driver; the telemetry interface needs WinUSB
+// bound by hand on Windows, and so does the probe's. Hosts cache the
+// interface layout per PID, so each pair of functions gets its own: the
+// network bit, then the second function.
+#ifdef FORGE_USB_NETWORK
+#define USBD_PID_NETWORK 1
+#else
+#define USBD_PID_NETWORK 0
+#endif
+#if defined(FORGE_USB_DAP)
+#define USBD_PID (0x5744 + USBD_PID_NETWORK)
+#elif defined(FORGE_USB_TELEMETRY)
+#define USBD_PID (0x5746 + USBD_PID_NETWORK)
+#else
+#define USBD_PID (0x5742 + USBD_PID_NETWORK)
+#endif
+#define USBD_LANGID 0x0409
+#define USBD_MANUFACTURER_STRING "Forge"
+#define USBD_PRODUCT_STRING "Forge 3D Printer"
+#define USBD_CONFIGURATION_STRING "Forge Config"
+#define USBD_INTERFACE_STRING "Forge Interface"
+
+    extern USBD_DescriptorsTypeDef FORGE_USB_DESC;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FORGE_USBD_DESC_H */